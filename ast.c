@@ -1,117 +1,385 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "ast.h"
+#include "visitor.h"
 
-ASTNode* allocateNode(size_t size, ASTNodeType type, int line, int column) {
+// Open-addressing set of shared nodes, keyed by node contents
+typedef struct {
+    ASTNode** slots;
+    size_t capacity;
+    size_t count;
+} SharedNodeTable;
+
+static SharedNodeTable sharedNodes;
+static int hashConsing = 0;
+
+static ASTConstantNode nilConstant = {{AST_CONSTANT, {0, 0}, 1}, TOKEN_NIL};
+static ASTConstantNode trueConstant = {{AST_CONSTANT, {0, 0}, 1}, TOKEN_TRUE};
+static ASTConstantNode falseConstant = {{AST_CONSTANT, {0, 0}, 1}, TOKEN_FALSE};
+
+ASTNode* allocateNode(size_t size, ASTNodeType type, SourceSpan span) {
     ASTNode* node = (ASTNode*)malloc(size);
     if (node == NULL) return NULL;
     
     node->type = type;
-    node->line = line;
-    node->column = column;
+    node->span = span;
+    node->shared = 0;
+    
+    return node;
+}
+
+static uint64_t hashMix(uint64_t hash, const void* bytes, size_t length) {
+    const unsigned char* p = (const unsigned char*)bytes;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Answer whether a node can be shared, i.e. it is an immutable leaf or a
+// literal array whose elements are already shared
+static int isShareable(ASTNode* node) {
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_SCALED:
+        case AST_LITERAL_CHARACTER:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL:
+        case AST_LITERAL_BYTE_ARRAY:
+            return 1;
+        case AST_LITERAL_ARRAY: {
+            ASTArrayLiteral* arrayNode = (ASTArrayLiteral*)node;
+            if (arrayNode->packedKind != PACKED_NONE) return 1;
+            for (int i = 0; i < arrayNode->count; i++) {
+                if (!arrayNode->elements[i]->shared) return 0;
+            }
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+static size_t packedSize(const ASTArrayLiteral* arrayNode) {
+    return arrayNode->packedKind == PACKED_BYTES ? (size_t)arrayNode->count : (size_t)arrayNode->count * 8;
+}
+
+static uint64_t hashNodeContents(ASTNode* node) {
+    uint64_t hash = hashMix(14695981039346656037ull, &node->type, sizeof(node->type));
+    
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+            return hashMix(hash, &((ASTIntegerLiteral*)node)->value, sizeof(long long));
+        case AST_LITERAL_FLOAT:
+            return hashMix(hash, &((ASTFloatLiteral*)node)->value, sizeof(double));
+        case AST_LITERAL_SCALED: {
+            ASTScaledLiteral* scaledNode = (ASTScaledLiteral*)node;
+            hash = hashMix(hash, &scaledNode->value, sizeof(double));
+            return hashMix(hash, &scaledNode->scale, sizeof(int));
+        }
+        case AST_LITERAL_CHARACTER:
+            return hashMix(hash, &((ASTCharacterLiteral*)node)->value, 1);
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL: {
+            // The escaped text is equal exactly when the unescaped text is
+            ASTStringLiteral* stringNode = (ASTStringLiteral*)node;
+            return hashMix(hash, stringNode->start, (size_t)stringNode->length);
+        }
+        case AST_LITERAL_BYTE_ARRAY: {
+            ASTByteArrayLiteral* byteArrayNode = (ASTByteArrayLiteral*)node;
+            return hashMix(hash, byteArrayNode->bytes, (size_t)byteArrayNode->count);
+        }
+        case AST_LITERAL_ARRAY: {
+            ASTArrayLiteral* arrayNode = (ASTArrayLiteral*)node;
+            hash = hashMix(hash, &arrayNode->packedKind, sizeof(arrayNode->packedKind));
+            hash = hashMix(hash, &arrayNode->count, sizeof(int));
+            if (arrayNode->packedKind != PACKED_NONE) {
+                return hashMix(hash, arrayNode->packed, packedSize(arrayNode));
+            }
+            // Elements are shared, so identity is equality
+            return hashMix(hash, arrayNode->elements, sizeof(ASTNode*) * (size_t)arrayNode->count);
+        }
+        default:
+            return hash;
+    }
+}
+
+static int sameNodeContents(ASTNode* a, ASTNode* b) {
+    if (a->type != b->type) return 0;
+    
+    switch (a->type) {
+        case AST_LITERAL_INTEGER:
+            return ((ASTIntegerLiteral*)a)->value == ((ASTIntegerLiteral*)b)->value;
+        case AST_LITERAL_FLOAT:
+            // Compare bits so that 0.0 and -0.0 stay distinct
+            return memcmp(&((ASTFloatLiteral*)a)->value, &((ASTFloatLiteral*)b)->value, sizeof(double)) == 0;
+        case AST_LITERAL_SCALED: {
+            ASTScaledLiteral* x = (ASTScaledLiteral*)a;
+            ASTScaledLiteral* y = (ASTScaledLiteral*)b;
+            return x->scale == y->scale && memcmp(&x->value, &y->value, sizeof(double)) == 0;
+        }
+        case AST_LITERAL_CHARACTER:
+            return ((ASTCharacterLiteral*)a)->value == ((ASTCharacterLiteral*)b)->value;
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL: {
+            ASTStringLiteral* x = (ASTStringLiteral*)a;
+            ASTStringLiteral* y = (ASTStringLiteral*)b;
+            return x->length == y->length && memcmp(x->start, y->start, (size_t)x->length) == 0;
+        }
+        case AST_LITERAL_BYTE_ARRAY: {
+            ASTByteArrayLiteral* x = (ASTByteArrayLiteral*)a;
+            ASTByteArrayLiteral* y = (ASTByteArrayLiteral*)b;
+            // Empty byte arrays have no bytes to compare
+            return x->count == y->count && (x->count == 0 || memcmp(x->bytes, y->bytes, (size_t)x->count) == 0);
+        }
+        case AST_LITERAL_ARRAY: {
+            ASTArrayLiteral* x = (ASTArrayLiteral*)a;
+            ASTArrayLiteral* y = (ASTArrayLiteral*)b;
+            if (x->packedKind != y->packedKind || x->count != y->count) return 0;
+            if (x->packedKind != PACKED_NONE) return memcmp(x->packed, y->packed, packedSize(x)) == 0;
+            return x->count == 0 || memcmp(x->elements, y->elements, sizeof(ASTNode*) * (size_t)x->count) == 0;
+        }
+        default:
+            return 0;
+    }
+}
+
+static int growSharedNodes(void) {
+    size_t capacity = sharedNodes.capacity == 0 ? 1024 : sharedNodes.capacity * 2;
+    ASTNode** slots = (ASTNode**)calloc(capacity, sizeof(ASTNode*));
+    if (slots == NULL) return 0;
+    
+    for (size_t i = 0; i < sharedNodes.capacity; i++) {
+        ASTNode* node = sharedNodes.slots[i];
+        if (node == NULL) continue;
+        size_t slot = hashNodeContents(node) & (capacity - 1);
+        while (slots[slot] != NULL) slot = (slot + 1) & (capacity - 1);
+        slots[slot] = node;
+    }
+    
+    free(sharedNodes.slots);
+    sharedNodes.slots = slots;
+    sharedNodes.capacity = capacity;
+    return 1;
+}
+
+// Answer the shared copy of a freshly created node, freeing the node if an
+// identical one already exists. Nodes that cannot be shared pass through.
+static ASTNode* shareNode(ASTNode* node) {
+    if (!hashConsing || node == NULL || !isShareable(node)) return node;
     
+    if ((sharedNodes.count + 1) * 2 > sharedNodes.capacity && !growSharedNodes()) {
+        return node;  // Out of memory: simply leave this node unshared
+    }
+    
+    size_t mask = sharedNodes.capacity - 1;
+    size_t slot = hashNodeContents(node) & mask;
+    while (sharedNodes.slots[slot] != NULL) {
+        ASTNode* existing = sharedNodes.slots[slot];
+        if (sameNodeContents(existing, node)) {
+            freeASTNode(node);
+            return existing;
+        }
+        slot = (slot + 1) & mask;
+    }
+    
+    node->shared = 1;
+    sharedNodes.slots[slot] = node;
+    sharedNodes.count++;
     return node;
 }
 
-ASTNode* createIntegerLiteral(long long value, int line, int column) {
-    ASTIntegerLiteral* node = (ASTIntegerLiteral*)allocateNode(sizeof(ASTIntegerLiteral), AST_LITERAL_INTEGER, line, column);
+void beginHashConsing(void) {
+    hashConsing = 1;
+}
+
+void endHashConsing(void) {
+    hashConsing = 0;
+    
+    // Arrays do not own their shared elements, which are freed from their own slots
+    for (size_t i = 0; i < sharedNodes.capacity; i++) {
+        ASTNode* node = sharedNodes.slots[i];
+        if (node == NULL) continue;
+        node->shared = 0;
+        if (node->type == AST_LITERAL_ARRAY && ((ASTArrayLiteral*)node)->packedKind == PACKED_NONE) {
+            ((ASTArrayLiteral*)node)->count = 0;
+        }
+    }
+    for (size_t i = 0; i < sharedNodes.capacity; i++) {
+        freeASTNode(sharedNodes.slots[i]);
+    }
+    
+    free(sharedNodes.slots);
+    sharedNodes.slots = NULL;
+    sharedNodes.capacity = 0;
+    sharedNodes.count = 0;
+}
+
+size_t sharedNodeCount(void) {
+    return sharedNodes.count;
+}
+
+ASTNode* createIntegerLiteral(long long value, SourceSpan span) {
+    ASTIntegerLiteral* node = (ASTIntegerLiteral*)allocateNode(sizeof(ASTIntegerLiteral), AST_LITERAL_INTEGER, span);
     if (node == NULL) return NULL;
     
     node->value = value;
     
-    return (ASTNode*)node;
+    return shareNode((ASTNode*)node);
 }
 
-ASTNode* createFloatLiteral(double value, int line, int column) {
-    ASTFloatLiteral* node = (ASTFloatLiteral*)allocateNode(sizeof(ASTFloatLiteral), AST_LITERAL_FLOAT, line, column);
+ASTNode* createFloatLiteral(double value, SourceSpan span) {
+    ASTFloatLiteral* node = (ASTFloatLiteral*)allocateNode(sizeof(ASTFloatLiteral), AST_LITERAL_FLOAT, span);
     if (node == NULL) return NULL;
     
     node->value = value;
     
-    return (ASTNode*)node;
+    return shareNode((ASTNode*)node);
 }
 
-ASTNode* createScaledLiteral(double value, int scale, int line, int column) {
-    ASTScaledLiteral* node = (ASTScaledLiteral*)allocateNode(sizeof(ASTScaledLiteral), AST_LITERAL_SCALED, line, column);
+ASTNode* createScaledLiteral(double value, int scale, SourceSpan span) {
+    ASTScaledLiteral* node = (ASTScaledLiteral*)allocateNode(sizeof(ASTScaledLiteral), AST_LITERAL_SCALED, span);
     if (node == NULL) return NULL;
     
     node->value = value;
     node->scale = scale;
     
-    return (ASTNode*)node;
+    return shareNode((ASTNode*)node);
 }
 
-ASTNode* createCharacterLiteral(char value, int line, int column) {
-    ASTCharacterLiteral* node = (ASTCharacterLiteral*)allocateNode(sizeof(ASTCharacterLiteral), AST_LITERAL_CHARACTER, line, column);
+ASTNode* createCharacterLiteral(char value, SourceSpan span) {
+    ASTCharacterLiteral* node = (ASTCharacterLiteral*)allocateNode(sizeof(ASTCharacterLiteral), AST_LITERAL_CHARACTER, span);
     if (node == NULL) return NULL;
     
     node->value = value;
     
-    return (ASTNode*)node;
+    return shareNode((ASTNode*)node);
 }
 
-ASTNode* createStringLiteral(const char* value, int line, int column) {
-    ASTStringLiteral* node = (ASTStringLiteral*)allocateNode(sizeof(ASTStringLiteral), AST_LITERAL_STRING, line, column);
+static ASTNode* createTextLiteral(ASTNodeType type, const char* start, int length, int needsUnescape, SourceSpan span) {
+    ASTStringLiteral* node = (ASTStringLiteral*)allocateNode(sizeof(ASTStringLiteral), type, span);
     if (node == NULL) return NULL;
     
-    node->value = strdup(value);
-    if (node->value == NULL) {
-        free(node);
-        return NULL;
-    }
+    node->start = start;
+    node->length = length;
+    node->needsUnescape = needsUnescape;
+    node->unescaped = NULL;
     
-    return (ASTNode*)node;
+    return shareNode((ASTNode*)node);
 }
 
-ASTNode* createSymbolLiteral(const char* value, int line, int column) {
-    ASTSymbolLiteral* node = (ASTSymbolLiteral*)allocateNode(sizeof(ASTSymbolLiteral), AST_LITERAL_SYMBOL, line, column);
-    if (node == NULL) return NULL;
+ASTNode* createStringLiteral(const char* start, int length, int needsUnescape, SourceSpan span) {
+    return createTextLiteral(AST_LITERAL_STRING, start, length, needsUnescape, span);
+}
+
+ASTNode* createSymbolLiteral(const char* start, int length, int needsUnescape, SourceSpan span) {
+    return createTextLiteral(AST_LITERAL_SYMBOL, start, length, needsUnescape, span);
+}
+
+// Answer the text of a string or symbol literal. The result is not
+// NUL-terminated; it points into the source unless the literal contains ''.
+const char* literalText(ASTNode* node, int* length) {
+    ASTStringLiteral* literal = (ASTStringLiteral*)node;
+    
+    if (!literal->needsUnescape) {
+        *length = literal->length;
+        return literal->start;
+    }
     
-    node->value = strdup(value);
-    if (node->value == NULL) {
-        free(node);
-        return NULL;
+    if (literal->unescaped == NULL) {
+        char* copy = (char*)malloc(literal->length + 1);
+        if (copy == NULL) {
+            // Fall back to the escaped text rather than failing the consumer
+            *length = literal->length;
+            return literal->start;
+        }
+        
+        int copyLength = 0;
+        for (int i = 0; i < literal->length; i++) {
+            copy[copyLength++] = literal->start[i];
+            if (literal->start[i] == '\'' && i + 1 < literal->length && literal->start[i + 1] == '\'') i++;
+        }
+        copy[copyLength] = '\0';
+        literal->unescaped = copy;
     }
     
-    return (ASTNode*)node;
+    *length = (int)strlen(literal->unescaped);
+    return literal->unescaped;
 }
 
-ASTNode* createArrayLiteral(ASTNode** elements, int count, int line, int column) {
-    ASTArrayLiteral* node = (ASTArrayLiteral*)allocateNode(sizeof(ASTArrayLiteral), AST_LITERAL_ARRAY, line, column);
+ASTNode* createArrayLiteral(ASTNode** elements, int count, SourceSpan span) {
+    ASTArrayLiteral* node = (ASTArrayLiteral*)allocateNode(sizeof(ASTArrayLiteral), AST_LITERAL_ARRAY, span);
     if (node == NULL) return NULL;
     
-    node->elements = (ASTNode**)malloc(sizeof(ASTNode*) * count);
-    if (node->elements == NULL) {
-        free(node);
-        return NULL;
+    // An empty literal has no elements array, rather than an allocation of zero bytes
+    node->elements = NULL;
+    if (count > 0) {
+        node->elements = (ASTNode**)malloc(sizeof(ASTNode*) * count);
+        if (node->elements == NULL) {
+            free(node);
+            return NULL;
+        }
     }
     
     for (int i = 0; i < count; i++) {
         node->elements[i] = elements[i];
     }
     node->count = count;
+    node->packedKind = PACKED_NONE;
+    node->packed = NULL;
     
-    return (ASTNode*)node;
+    return shareNode((ASTNode*)node);
 }
 
-ASTNode* createByteArrayLiteral(unsigned char* bytes, int count, int line, int column) {
-    ASTByteArrayLiteral* node = (ASTByteArrayLiteral*)allocateNode(sizeof(ASTByteArrayLiteral), AST_LITERAL_BYTE_ARRAY, line, column);
-    if (node == NULL) return NULL;
-    
-    node->bytes = (unsigned char*)malloc(count);
-    if (node->bytes == NULL) {
-        free(node);
+// Takes ownership of values, which can be very large for generated tables,
+// and frees them if the node cannot be allocated
+ASTNode* createPackedArrayLiteral(PackedKind kind, void* values, int count, SourceSpan span) {
+    ASTArrayLiteral* node = (ASTArrayLiteral*)allocateNode(sizeof(ASTArrayLiteral), AST_LITERAL_ARRAY, span);
+    if (node == NULL) {
+        free(values);
         return NULL;
     }
     
-    memcpy(node->bytes, bytes, count);
+    node->elements = NULL;
     node->count = count;
+    node->packedKind = kind;
+    node->packed = values;
     
-    return (ASTNode*)node;
+    return shareNode((ASTNode*)node);
 }
 
-ASTNode* createConstantNode(TokenType type, int line, int column) {
-    ASTConstantNode* node = (ASTConstantNode*)allocateNode(sizeof(ASTConstantNode), AST_CONSTANT, line, column);
+ASTNode* createByteArrayLiteral(unsigned char* bytes, int count, SourceSpan span) {
+    ASTByteArrayLiteral* node = (ASTByteArrayLiteral*)allocateNode(sizeof(ASTByteArrayLiteral), AST_LITERAL_BYTE_ARRAY, span);
+    if (node == NULL) return NULL;
+    
+    node->bytes = NULL;
+    if (count > 0) {
+        node->bytes = (unsigned char*)malloc(count);
+        if (node->bytes == NULL) {
+            free(node);
+            return NULL;
+        }
+        memcpy(node->bytes, bytes, count);
+    }
+    node->count = count;
+    
+    return shareNode((ASTNode*)node);
+}
+
+ASTNode* createConstantNode(TokenType type, SourceSpan span) {
+    if (hashConsing) {
+        switch (type) {
+            case TOKEN_NIL: return (ASTNode*)&nilConstant;
+            case TOKEN_TRUE: return (ASTNode*)&trueConstant;
+            case TOKEN_FALSE: return (ASTNode*)&falseConstant;
+            default: break;
+        }
+    }
+    
+    ASTConstantNode* node = (ASTConstantNode*)allocateNode(sizeof(ASTConstantNode), AST_CONSTANT, span);
     if (node == NULL) return NULL;
     
     node->type = type;
@@ -119,8 +387,13 @@ ASTNode* createConstantNode(TokenType type, int line, int column) {
     return (ASTNode*)node;
 }
 
-ASTNode* createVariableNode(const char* name, int isPseudoVariable, int line, int column) {
-    ASTVariableNode* node = (ASTVariableNode*)allocateNode(sizeof(ASTVariableNode), AST_VARIABLE, line, column);
+static VariableBinding unresolvedBinding(void) {
+    VariableBinding binding = {VAR_UNRESOLVED, -1, 0};
+    return binding;
+}
+
+ASTNode* createVariableNode(const char* name, int isPseudoVariable, SourceSpan span) {
+    ASTVariableNode* node = (ASTVariableNode*)allocateNode(sizeof(ASTVariableNode), AST_VARIABLE, span);
     if (node == NULL) return NULL;
     
     node->name = strdup(name);
@@ -130,12 +403,13 @@ ASTNode* createVariableNode(const char* name, int isPseudoVariable, int line, in
     }
     
     node->isPseudoVariable = isPseudoVariable;
+    node->binding = unresolvedBinding();
     
     return (ASTNode*)node;
 }
 
-ASTNode* createAssignmentNode(const char* variable, ASTNode* value, int line, int column) {
-    ASTAssignmentNode* node = (ASTAssignmentNode*)allocateNode(sizeof(ASTAssignmentNode), AST_ASSIGNMENT, line, column);
+ASTNode* createAssignmentNode(const char* variable, ASTNode* value, SourceSpan span) {
+    ASTAssignmentNode* node = (ASTAssignmentNode*)allocateNode(sizeof(ASTAssignmentNode), AST_ASSIGNMENT, span);
     if (node == NULL) return NULL;
     
     node->variable = strdup(variable);
@@ -145,12 +419,13 @@ ASTNode* createAssignmentNode(const char* variable, ASTNode* value, int line, in
     }
     
     node->value = value;
+    node->binding = unresolvedBinding();
     
     return (ASTNode*)node;
 }
 
-ASTNode* createReturnNode(ASTNode* expression, int line, int column) {
-    ASTReturnNode* node = (ASTReturnNode*)allocateNode(sizeof(ASTReturnNode), AST_RETURN, line, column);
+ASTNode* createReturnNode(ASTNode* expression, SourceSpan span) {
+    ASTReturnNode* node = (ASTReturnNode*)allocateNode(sizeof(ASTReturnNode), AST_RETURN, span);
     if (node == NULL) return NULL;
     
     node->expression = expression;
@@ -158,8 +433,8 @@ ASTNode* createReturnNode(ASTNode* expression, int line, int column) {
     return (ASTNode*)node;
 }
 
-ASTNode* createUnaryMessageNode(ASTNode* receiver, const char* selector, int line, int column) {
-    ASTUnaryMessageNode* node = (ASTUnaryMessageNode*)allocateNode(sizeof(ASTUnaryMessageNode), AST_MESSAGE_UNARY, line, column);
+ASTNode* createUnaryMessageNode(ASTNode* receiver, const char* selector, SourceSpan span) {
+    ASTUnaryMessageNode* node = (ASTUnaryMessageNode*)allocateNode(sizeof(ASTUnaryMessageNode), AST_MESSAGE_UNARY, span);
     if (node == NULL) return NULL;
     
     node->receiver = receiver;
@@ -173,14 +448,14 @@ ASTNode* createUnaryMessageNode(ASTNode* receiver, const char* selector, int lin
     return (ASTNode*)node;
 }
 
-ASTNode* createBinaryMessageNode(ASTNode* receiver, const char* selector, ASTNode* argument, int line, int column) {
-    ASTBinaryMessageNode* node = (ASTBinaryMessageNode*)allocateNode(sizeof(ASTBinaryMessageNode), AST_MESSAGE_BINARY, line, column);
+ASTNode* createBinaryMessageNode(ASTNode* receiver, const char* selector, ASTNode* argument, SourceSpan span) {
+    ASTBinaryMessageNode* node = (ASTBinaryMessageNode*)allocateNode(sizeof(ASTBinaryMessageNode), AST_MESSAGE_BINARY, span);
     if (node == NULL) return NULL;
     
-    node->receiver = receiver;
+    node->message.receiver = receiver;
     
-    node->selector = strdup(selector);
-    if (node->selector == NULL) {
+    node->message.selector = strdup(selector);
+    if (node->message.selector == NULL) {
         free(node);
         return NULL;
     }
@@ -190,21 +465,21 @@ ASTNode* createBinaryMessageNode(ASTNode* receiver, const char* selector, ASTNod
     return (ASTNode*)node;
 }
 
-ASTNode* createKeywordMessageNode(ASTNode* receiver, const char* selector, ASTNode** arguments, int argumentCount, int line, int column) {
-    ASTKeywordMessageNode* node = (ASTKeywordMessageNode*)allocateNode(sizeof(ASTKeywordMessageNode), AST_MESSAGE_KEYWORD, line, column);
+ASTNode* createKeywordMessageNode(ASTNode* receiver, const char* selector, ASTNode** arguments, int argumentCount, SourceSpan span) {
+    ASTKeywordMessageNode* node = (ASTKeywordMessageNode*)allocateNode(sizeof(ASTKeywordMessageNode), AST_MESSAGE_KEYWORD, span);
     if (node == NULL) return NULL;
     
-    node->receiver = receiver;
+    node->message.receiver = receiver;
     
-    node->selector = strdup(selector);
-    if (node->selector == NULL) {
+    node->message.selector = strdup(selector);
+    if (node->message.selector == NULL) {
         free(node);
         return NULL;
     }
     
     node->arguments = (ASTNode**)malloc(sizeof(ASTNode*) * argumentCount);
     if (node->arguments == NULL) {
-        free(node->selector);
+        free(node->message.selector);
         free(node);
         return NULL;
     }
@@ -217,8 +492,8 @@ ASTNode* createKeywordMessageNode(ASTNode* receiver, const char* selector, ASTNo
     return (ASTNode*)node;
 }
 
-ASTNode* createCascadeNode(ASTNode* receiver, ASTNode** messages, int messageCount, int line, int column) {
-    ASTCascadeNode* node = (ASTCascadeNode*)allocateNode(sizeof(ASTCascadeNode), AST_CASCADE, line, column);
+ASTNode* createCascadeNode(ASTNode* receiver, ASTNode** messages, int messageCount, SourceSpan span) {
+    ASTCascadeNode* node = (ASTCascadeNode*)allocateNode(sizeof(ASTCascadeNode), AST_CASCADE, span);
     if (node == NULL) return NULL;
     
     node->receiver = receiver;
@@ -237,49 +512,61 @@ ASTNode* createCascadeNode(ASTNode* receiver, ASTNode** messages, int messageCou
     return (ASTNode*)node;
 }
 
-ASTNode* createBlockNode(char** parameters, int parameterCount, ASTNode** statements, int statementCount, int line, int column) {
-    ASTBlockNode* node = (ASTBlockNode*)allocateNode(sizeof(ASTBlockNode), AST_BLOCK, line, column);
-    if (node == NULL) return NULL;
-    
-    node->parameters = (char**)malloc(sizeof(char*) * parameterCount);
-    if (node->parameters == NULL) {
-        free(node);
-        return NULL;
-    }
+// Copy a list of names; answers NULL when out of memory
+static char** copyNames(char** names, int count) {
+    char** copies = (char**)malloc(sizeof(char*) * (count > 0 ? count : 1));
+    if (copies == NULL) return NULL;
     
-    for (int i = 0; i < parameterCount; i++) {
-        node->parameters[i] = strdup(parameters[i]);
-        if (node->parameters[i] == NULL) {
+    for (int i = 0; i < count; i++) {
+        copies[i] = strdup(names[i]);
+        if (copies[i] == NULL) {
             for (int j = 0; j < i; j++) {
-                free(node->parameters[j]);
+                free(copies[j]);
             }
-            free(node->parameters);
-            free(node);
+            free(copies);
             return NULL;
         }
     }
-    node->parameterCount = parameterCount;
+    return copies;
+}
+
+static void freeNames(char** names, int count) {
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+ASTNode* createBlockNode(char** parameters, int parameterCount, char** temporaries, int temporaryCount,
+                         ASTNode** statements, int statementCount, SourceSpan span) {
+    ASTBlockNode* node = (ASTBlockNode*)allocateNode(sizeof(ASTBlockNode), AST_BLOCK, span);
+    if (node == NULL) return NULL;
     
-    node->statements = (ASTNode**)malloc(sizeof(ASTNode*) * statementCount);
-    if (node->statements == NULL) {
-        for (int i = 0; i < parameterCount; i++) {
-            free(node->parameters[i]);
-        }
-        free(node->parameters);
+    node->parameters = copyNames(parameters, parameterCount);
+    node->temporaries = copyNames(temporaries, temporaryCount);
+    node->statements = (ASTNode**)malloc(sizeof(ASTNode*) * (statementCount > 0 ? statementCount : 1));
+    if (node->parameters == NULL || node->temporaries == NULL || node->statements == NULL) {
+        if (node->parameters != NULL) freeNames(node->parameters, parameterCount);
+        if (node->temporaries != NULL) freeNames(node->temporaries, temporaryCount);
+        free(node->statements);
         free(node);
         return NULL;
     }
+    node->parameterCount = parameterCount;
+    node->temporaryCount = temporaryCount;
     
     for (int i = 0; i < statementCount; i++) {
         node->statements[i] = statements[i];
     }
     node->statementCount = statementCount;
+    node->captured = NULL;
+    node->inlined = 0;
     
     return (ASTNode*)node;
 }
 
-ASTNode* createArrayExpressionNode(ASTNode** expressions, int count, int line, int column) {
-    ASTArrayExpressionNode* node = (ASTArrayExpressionNode*)allocateNode(sizeof(ASTArrayExpressionNode), AST_ARRAY_EXPRESSION, line, column);
+ASTNode* createArrayExpressionNode(ASTNode** expressions, int count, SourceSpan span) {
+    ASTArrayExpressionNode* node = (ASTArrayExpressionNode*)allocateNode(sizeof(ASTArrayExpressionNode), AST_ARRAY_EXPRESSION, span);
     if (node == NULL) return NULL;
     
     node->expressions = (ASTNode**)malloc(sizeof(ASTNode*) * count);
@@ -297,9 +584,10 @@ ASTNode* createArrayExpressionNode(ASTNode** expressions, int count, int line, i
 }
 
 ASTNode* createMethodNode(const char* selector, char** parameters, int parameterCount, 
+                         char** temporaries, int temporaryCount,
                          ASTNode** statements, int statementCount, int isPrimitive, 
-                         int primitiveNumber, int line, int column) {
-    ASTMethodNode* node = (ASTMethodNode*)allocateNode(sizeof(ASTMethodNode), AST_METHOD, line, column);
+                         int primitiveNumber, SourceSpan span) {
+    ASTMethodNode* node = (ASTMethodNode*)allocateNode(sizeof(ASTMethodNode), AST_METHOD, span);
     if (node == NULL) return NULL;
     
     node->selector = strdup(selector);
@@ -329,8 +617,41 @@ ASTNode* createMethodNode(const char* selector, char** parameters, int parameter
     }
     node->parameterCount = parameterCount;
     
+    node->temporaries = (char**)malloc(sizeof(char*) * temporaryCount);
+    if (node->temporaries == NULL) {
+        for (int i = 0; i < parameterCount; i++) {
+            free(node->parameters[i]);
+        }
+        free(node->parameters);
+        free(node->selector);
+        free(node);
+        return NULL;
+    }
+    
+    for (int i = 0; i < temporaryCount; i++) {
+        node->temporaries[i] = strdup(temporaries[i]);
+        if (node->temporaries[i] == NULL) {
+            for (int j = 0; j < i; j++) {
+                free(node->temporaries[j]);
+            }
+            free(node->temporaries);
+            for (int j = 0; j < parameterCount; j++) {
+                free(node->parameters[j]);
+            }
+            free(node->parameters);
+            free(node->selector);
+            free(node);
+            return NULL;
+        }
+    }
+    node->temporaryCount = temporaryCount;
+    
     node->statements = (ASTNode**)malloc(sizeof(ASTNode*) * statementCount);
     if (node->statements == NULL) {
+        for (int i = 0; i < temporaryCount; i++) {
+            free(node->temporaries[i]);
+        }
+        free(node->temporaries);
         for (int i = 0; i < parameterCount; i++) {
             free(node->parameters[i]);
         }
@@ -347,29 +668,34 @@ ASTNode* createMethodNode(const char* selector, char** parameters, int parameter
     
     node->isPrimitive = isPrimitive;
     node->primitiveNumber = primitiveNumber;
+    node->captured = NULL;
     
     return (ASTNode*)node;
 }
 
-void freeASTNode(ASTNode* node) {
-    if (node == NULL) return;
+static VisitAction skipSharedNodes(ASTNode* node, int depth, void* context) {
+    (void)depth;
+    (void)context;
+    return node->shared ? VISIT_SKIP_CHILDREN : VISIT_CONTINUE;
+}
+
+// Free what a node owns besides its children, which the walk has already freed
+static VisitAction freeNodeStorage(ASTNode* node, int depth, void* context) {
+    (void)depth;
+    (void)context;
+    if (node->shared) return VISIT_CONTINUE;
     
     switch (node->type) {
-        case AST_LITERAL_STRING: {
-            ASTStringLiteral* stringNode = (ASTStringLiteral*)node;
-            free(stringNode->value);
-            break;
-        }
+        case AST_LITERAL_STRING:
         case AST_LITERAL_SYMBOL: {
-            ASTSymbolLiteral* symbolNode = (ASTSymbolLiteral*)node;
-            free(symbolNode->value);
+            // The text itself belongs to the source buffer
+            ASTStringLiteral* stringNode = (ASTStringLiteral*)node;
+            free(stringNode->unescaped);
             break;
         }
         case AST_LITERAL_ARRAY: {
             ASTArrayLiteral* arrayNode = (ASTArrayLiteral*)node;
-            for (int i = 0; i < arrayNode->count; i++) {
-                freeASTNode(arrayNode->elements[i]);
-            }
+            free(arrayNode->packed);
             free(arrayNode->elements);
             break;
         }
@@ -386,63 +712,39 @@ void freeASTNode(ASTNode* node) {
         case AST_ASSIGNMENT: {
             ASTAssignmentNode* assignmentNode = (ASTAssignmentNode*)node;
             free(assignmentNode->variable);
-            freeASTNode(assignmentNode->value);
-            break;
-        }
-        case AST_RETURN: {
-            ASTReturnNode* returnNode = (ASTReturnNode*)node;
-            freeASTNode(returnNode->expression);
             break;
         }
         case AST_MESSAGE_UNARY: {
             ASTUnaryMessageNode* messageNode = (ASTUnaryMessageNode*)node;
-            freeASTNode(messageNode->receiver);
             free(messageNode->selector);
             break;
         }
         case AST_MESSAGE_BINARY: {
             ASTBinaryMessageNode* messageNode = (ASTBinaryMessageNode*)node;
-            freeASTNode(messageNode->receiver);
-            free(messageNode->selector);
-            freeASTNode(messageNode->argument);
+            free(messageNode->message.selector);
             break;
         }
         case AST_MESSAGE_KEYWORD: {
             ASTKeywordMessageNode* messageNode = (ASTKeywordMessageNode*)node;
-            freeASTNode(messageNode->receiver);
-            free(messageNode->selector);
-            for (int i = 0; i < messageNode->argumentCount; i++) {
-                freeASTNode(messageNode->arguments[i]);
-            }
+            free(messageNode->message.selector);
             free(messageNode->arguments);
             break;
         }
         case AST_CASCADE: {
             ASTCascadeNode* cascadeNode = (ASTCascadeNode*)node;
-            freeASTNode(cascadeNode->receiver);
-            for (int i = 0; i < cascadeNode->messageCount; i++) {
-                freeASTNode(cascadeNode->messages[i]);
-            }
             free(cascadeNode->messages);
             break;
         }
         case AST_BLOCK: {
             ASTBlockNode* blockNode = (ASTBlockNode*)node;
-            for (int i = 0; i < blockNode->parameterCount; i++) {
-                free(blockNode->parameters[i]);
-            }
-            free(blockNode->parameters);
-            for (int i = 0; i < blockNode->statementCount; i++) {
-                freeASTNode(blockNode->statements[i]);
-            }
+            freeNames(blockNode->parameters, blockNode->parameterCount);
+            freeNames(blockNode->temporaries, blockNode->temporaryCount);
             free(blockNode->statements);
+            free(blockNode->captured);
             break;
         }
         case AST_ARRAY_EXPRESSION: {
             ASTArrayExpressionNode* arrayNode = (ASTArrayExpressionNode*)node;
-            for (int i = 0; i < arrayNode->count; i++) {
-                freeASTNode(arrayNode->expressions[i]);
-            }
             free(arrayNode->expressions);
             break;
         }
@@ -453,10 +755,12 @@ void freeASTNode(ASTNode* node) {
                 free(methodNode->parameters[i]);
             }
             free(methodNode->parameters);
-            for (int i = 0; i < methodNode->statementCount; i++) {
-                freeASTNode(methodNode->statements[i]);
+            for (int i = 0; i < methodNode->temporaryCount; i++) {
+                free(methodNode->temporaries[i]);
             }
+            free(methodNode->temporaries);
             free(methodNode->statements);
+            free(methodNode->captured);
             break;
         }
         default:
@@ -464,4 +768,47 @@ void freeASTNode(ASTNode* node) {
     }
     
     free(node);
-}
\ No newline at end of file
+    return VISIT_CONTINUE;
+}
+
+void freeASTNode(ASTNode* node) {
+    ASTVisitor visitor = {skipSharedNodes, NULL, freeNodeStorage, NULL};
+    walkAST(node, &visitor);
+}
+
+const char* astNodeTypeName(ASTNodeType type) {
+    switch (type) {
+        case AST_LITERAL_INTEGER: return "Integer";
+        case AST_LITERAL_FLOAT: return "Float";
+        case AST_LITERAL_SCALED: return "Scaled";
+        case AST_LITERAL_CHARACTER: return "Character";
+        case AST_LITERAL_STRING: return "String";
+        case AST_LITERAL_SYMBOL: return "Symbol";
+        case AST_LITERAL_ARRAY: return "Array";
+        case AST_LITERAL_BYTE_ARRAY: return "ByteArray";
+        case AST_CONSTANT: return "Constant";
+        case AST_VARIABLE: return "Variable";
+        case AST_ASSIGNMENT: return "Assignment";
+        case AST_RETURN: return "Return";
+        case AST_MESSAGE_UNARY: return "UnaryMessage";
+        case AST_MESSAGE_BINARY: return "BinaryMessage";
+        case AST_MESSAGE_KEYWORD: return "KeywordMessage";
+        case AST_CASCADE: return "Cascade";
+        case AST_BLOCK: return "Block";
+        case AST_ARRAY_EXPRESSION: return "ArrayExpression";
+        case AST_METHOD: return "Method";
+        default: return "Unknown";
+    }
+}
+
+const char* variableKindName(VariableKind kind) {
+    switch (kind) {
+        case VAR_UNRESOLVED: return "unresolved";
+        case VAR_ARGUMENT: return "argument";
+        case VAR_TEMPORARY: return "temporary";
+        case VAR_INSTANCE: return "instance";
+        case VAR_GLOBAL: return "global";
+        case VAR_PSEUDO: return "pseudo";
+        default: return "unknown";
+    }
+}
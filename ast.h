@@ -28,11 +28,18 @@ typedef enum {
 
 typedef struct ASTNode ASTNode;
 
+/* Byte range of a node in the source it was parsed from. Line and column
+ * are derived from it on demand with a SourceMap (see sourcemap.h). */
+typedef struct {
+    unsigned int start;
+    unsigned int length;
+} SourceSpan;
+
 /* Base AST node structure */
 struct ASTNode {
     ASTNodeType type;
-    int line;
-    int column;
+    SourceSpan span;
+    int shared;      /* Owned by the hash-consing table; freeASTNode skips it */
 };
 
 /* Literal node types */
@@ -57,20 +64,34 @@ typedef struct {
     char value;
 } ASTCharacterLiteral;
 
+/* String and symbol literals are views into the source text, which must
+ * outlive the AST. Use literalText() to read them: a literal containing the
+ * '' escape gets an unescaped copy the first time it is asked for. */
 typedef struct {
     ASTNode base;
-    char* value;
+    const char* start;   /* Text without quotes or '#', still escaped */
+    int length;
+    int needsUnescape;   /* Text contains '' */
+    char* unescaped;     /* Lazily built unescaped copy, or NULL */
 } ASTStringLiteral;
 
-typedef struct {
-    ASTNode base;
-    char* value;
-} ASTSymbolLiteral;
+typedef ASTStringLiteral ASTSymbolLiteral;
+
+/* Storage of a literal array: one node per element, or a packed buffer of raw
+ * values when every element is an integer or every element is a float */
+typedef enum {
+    PACKED_NONE,    /* elements holds one node per element */
+    PACKED_INT64,   /* packed holds long long values */
+    PACKED_DOUBLE,  /* packed holds double values */
+    PACKED_BYTES    /* packed holds integers that all fit in 0..255 */
+} PackedKind;
 
 typedef struct {
     ASTNode base;
     ASTNode** elements;
     int count;
+    PackedKind packedKind;
+    void* packed;
 } ASTArrayLiteral;
 
 typedef struct {
@@ -79,6 +100,30 @@ typedef struct {
     int count;
 } ASTByteArrayLiteral;
 
+/* What a variable name refers to, filled in by resolveScopes() (see
+ * scope.h). Nodes are created unresolved. */
+typedef enum {
+    VAR_UNRESOLVED,
+    VAR_ARGUMENT,    /* Method or block parameter */
+    VAR_TEMPORARY,   /* Method or block temporary */
+    VAR_INSTANCE,    /* Instance variable of the receiver */
+    VAR_GLOBAL,      /* Anything not declared in an enclosing scope */
+    VAR_PSEUDO       /* self, super or thisContext */
+} VariableKind;
+
+/* Slots of the pseudo-variables */
+#define PSEUDO_SELF 0
+#define PSEUDO_SUPER 1
+#define PSEUDO_THIS_CONTEXT 2
+
+typedef struct {
+    VariableKind kind;
+    int slot;    /* Arguments then temporaries of the declaring scope, the
+                  * instance variable index, or PSEUDO_*; -1 for globals */
+    int depth;   /* Arguments and temporaries: number of block scopes between
+                  * the reference and the declaring scope; 0 otherwise */
+} VariableBinding;
+
 /* Variable and constant reference nodes */
 typedef struct {
     ASTNode base;
@@ -89,6 +134,7 @@ typedef struct {
     ASTNode base;
     char* name;
     int isPseudoVariable;  /* 1 for self, super, thisContext; 0 otherwise */
+    VariableBinding binding;
 } ASTVariableNode;
 
 /* Assignment node */
@@ -96,6 +142,7 @@ typedef struct {
     ASTNode base;
     char* variable;
     ASTNode* value;
+    VariableBinding binding;
 } ASTAssignmentNode;
 
 /* Return node */
@@ -104,28 +151,33 @@ typedef struct {
     ASTNode* expression;
 } ASTReturnNode;
 
-/* Message nodes */
+/* Message nodes. Each starts with the fields of ASTMessageNode, which
+ * code handling any kind of message goes through; a unary message has no
+ * others. */
 typedef struct {
     ASTNode base;
-    ASTNode* receiver;
+    ASTNode* receiver;          /* NULL for the messages of a cascade */
     char* selector;
-} ASTUnaryMessageNode;
+} ASTMessageNode;
+
+typedef ASTMessageNode ASTUnaryMessageNode;
 
 typedef struct {
-    ASTNode base;
-    ASTNode* receiver;
-    char* selector;
+    ASTMessageNode message;
     ASTNode* argument;
 } ASTBinaryMessageNode;
 
 typedef struct {
-    ASTNode base;
-    ASTNode* receiver;
-    char* selector;
+    ASTMessageNode message;
     ASTNode** arguments;
     int argumentCount;
 } ASTKeywordMessageNode;
 
+static inline int isMessageNode(const ASTNode* node) {
+    return node != NULL && (node->type == AST_MESSAGE_UNARY || node->type == AST_MESSAGE_BINARY ||
+                            node->type == AST_MESSAGE_KEYWORD);
+}
+
 /* Cascade node */
 typedef struct {
     ASTNode base;
@@ -134,13 +186,24 @@ typedef struct {
     int messageCount;
 } ASTCascadeNode;
 
-/* Block node */
+/* How blocks refer to a variable of an enclosing method or block */
+#define CAPTURE_NONE 0      /* Not referenced from an inner block */
+#define CAPTURE_SHARED 1    /* Stored into after a block captures it: lives in a heap environment */
+#define CAPTURE_COPIED 2    /* Never stored into once captured: blocks hold copies of its value */
+
+/* Block node. The top-level code of a file is a block too. */
 typedef struct {
     ASTNode base;
     char** parameters;
     int parameterCount;
+    char** temporaries;
+    int temporaryCount;
     ASTNode** statements;
     int statementCount;
+    unsigned char* captured;  /* Per parameter then temporary: a CAPTURE_* value.
+                               * NULL until resolveScopes(). */
+    int inlined;              /* Compiled in line as part of a control structure;
+                               * set by resolveScopes() */
 } ASTBlockNode;
 
 /* Array expression node */
@@ -156,37 +219,66 @@ typedef struct {
     char* selector;
     char** parameters;
     int parameterCount;
+    char** temporaries;
+    int temporaryCount;
     ASTNode** statements;
     int statementCount;
     int isPrimitive;
     int primitiveNumber;
+    unsigned char* captured;  /* As in ASTBlockNode */
 } ASTMethodNode;
 
 /* AST node creation functions */
-ASTNode* createIntegerLiteral(long long value, int line, int column);
-ASTNode* createFloatLiteral(double value, int line, int column);
-ASTNode* createScaledLiteral(double value, int scale, int line, int column);
-ASTNode* createCharacterLiteral(char value, int line, int column);
-ASTNode* createStringLiteral(const char* value, int line, int column);
-ASTNode* createSymbolLiteral(const char* value, int line, int column);
-ASTNode* createArrayLiteral(ASTNode** elements, int count, int line, int column);
-ASTNode* createByteArrayLiteral(unsigned char* bytes, int count, int line, int column);
-ASTNode* createConstantNode(TokenType type, int line, int column);
-ASTNode* createVariableNode(const char* name, int isPseudoVariable, int line, int column);
-ASTNode* createAssignmentNode(const char* variable, ASTNode* value, int line, int column);
-ASTNode* createReturnNode(ASTNode* expression, int line, int column);
-ASTNode* createUnaryMessageNode(ASTNode* receiver, const char* selector, int line, int column);
-ASTNode* createBinaryMessageNode(ASTNode* receiver, const char* selector, ASTNode* argument, int line, int column);
-ASTNode* createKeywordMessageNode(ASTNode* receiver, const char* selector, ASTNode** arguments, int argumentCount, int line, int column);
-ASTNode* createCascadeNode(ASTNode* receiver, ASTNode** messages, int messageCount, int line, int column);
-ASTNode* createBlockNode(char** parameters, int parameterCount, ASTNode** statements, int statementCount, int line, int column);
-ASTNode* createArrayExpressionNode(ASTNode** expressions, int count, int line, int column);
+ASTNode* createIntegerLiteral(long long value, SourceSpan span);
+ASTNode* createFloatLiteral(double value, SourceSpan span);
+ASTNode* createScaledLiteral(double value, int scale, SourceSpan span);
+ASTNode* createCharacterLiteral(char value, SourceSpan span);
+ASTNode* createStringLiteral(const char* start, int length, int needsUnescape, SourceSpan span);
+ASTNode* createSymbolLiteral(const char* start, int length, int needsUnescape, SourceSpan span);
+ASTNode* createArrayLiteral(ASTNode** elements, int count, SourceSpan span);
+ASTNode* createPackedArrayLiteral(PackedKind kind, void* values, int count, SourceSpan span);
+ASTNode* createByteArrayLiteral(unsigned char* bytes, int count, SourceSpan span);
+ASTNode* createConstantNode(TokenType type, SourceSpan span);
+ASTNode* createVariableNode(const char* name, int isPseudoVariable, SourceSpan span);
+ASTNode* createAssignmentNode(const char* variable, ASTNode* value, SourceSpan span);
+ASTNode* createReturnNode(ASTNode* expression, SourceSpan span);
+ASTNode* createUnaryMessageNode(ASTNode* receiver, const char* selector, SourceSpan span);
+ASTNode* createBinaryMessageNode(ASTNode* receiver, const char* selector, ASTNode* argument, SourceSpan span);
+ASTNode* createKeywordMessageNode(ASTNode* receiver, const char* selector, ASTNode** arguments, int argumentCount, SourceSpan span);
+ASTNode* createCascadeNode(ASTNode* receiver, ASTNode** messages, int messageCount, SourceSpan span);
+ASTNode* createBlockNode(char** parameters, int parameterCount, char** temporaries, int temporaryCount,
+                         ASTNode** statements, int statementCount, SourceSpan span);
+ASTNode* createArrayExpressionNode(ASTNode** expressions, int count, SourceSpan span);
 ASTNode* createMethodNode(const char* selector, char** parameters, int parameterCount, 
+                         char** temporaries, int temporaryCount,
                          ASTNode** statements, int statementCount, int isPrimitive, 
-                         int primitiveNumber, int line, int column);
+                         int primitiveNumber, SourceSpan span);
+
+/* Short name of a node type, as used in diagnostics */
+const char* astNodeTypeName(ASTNodeType type);
+/* Lower-case name of a variable kind, such as "temporary" */
+const char* variableKindName(VariableKind kind);
+
+/* Literal access */
+const char* literalText(ASTNode* node, int* length);
 
 /* AST management functions */
-ASTNode* allocateNode(size_t size, ASTNodeType type, int line, int column);
+ASTNode* allocateNode(size_t size, ASTNodeType type, SourceSpan span);
 void freeASTNode(ASTNode* node);
 
+/* Hash-consing. Between beginHashConsing() and endHashConsing(), the create
+ * functions answer one shared node for identical literals, literal arrays of
+ * shared elements, and constants (which become static singletons). Shared
+ * nodes keep the span of their first occurrence (constants have an empty
+ * span) and must not be modified. Trees built meanwhile are therefore only
+ * fit for uses that ignore spans: not for printing them, diagnostics, name
+ * resolution, compiling, caching, diffing or formatting.
+ * freeASTNode() leaves them alone; endHashConsing() frees them all, so it must
+ * come after every tree built in between is freed. String and symbol nodes
+ * still view the source of their first occurrence, which must stay alive
+ * until then. Not thread-safe: only one thread may create nodes meanwhile. */
+void beginHashConsing(void);
+void endHashConsing(void);
+size_t sharedNodeCount(void);
+
 #endif /* AST_H */
\ No newline at end of file
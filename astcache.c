@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "astcache.h"
+#include "fileio.h"
+
+#define SECTION_ALIGNMENT 8
+
+// Non-cryptographic 64-bit hash, mixing a word at a time so that hashing
+// stays cheap next to mapping the cached tree. It only names cache files:
+// loadASTCache compares the source itself before using one.
+uint64_t hashSource(const char* source, size_t length) {
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    uint64_t hash = 0xCBF29CE484222325ull ^ (length * multiplier);
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, source + i, sizeof(word));
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, source + i, length - i);
+    hash = (hash ^ tail) * multiplier;
+
+    hash ^= hash >> 32;
+    hash *= multiplier;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) & ~(uint64_t)(SECTION_ALIGNMENT - 1);
+}
+
+// Lay out the sections after the header and answer the total file size
+static uint64_t layoutSections(ASTCacheHeader* header) {
+    uint64_t offset = alignOffset(sizeof(ASTCacheHeader));
+
+    header->typesOffset = offset;
+    offset = alignOffset(offset + (uint64_t)header->nodeCount * sizeof(unsigned char));
+    header->spansOffset = offset;
+    offset = alignOffset(offset + (uint64_t)header->nodeCount * sizeof(SourceSpan));
+    header->dataOffset = offset;
+    offset = alignOffset(offset + (uint64_t)header->nodeCount * sizeof(FlatNodeData));
+    header->extraOffset = offset;
+    offset = alignOffset(offset + (uint64_t)header->extraCount * sizeof(uint32_t));
+    header->stringsOffset = offset;
+    offset = alignOffset(offset + (uint64_t)header->stringCount * sizeof(FlatString));
+    header->poolOffset = offset;
+    offset = alignOffset(offset + header->poolSize);
+    header->sourceOffset = offset;
+    offset += header->sourceLength;
+
+    return offset;
+}
+
+static int writeSection(FILE* file, uint64_t offset, const void* data, size_t size) {
+    // Pad up to the section start
+    static const char zeros[SECTION_ALIGNMENT] = {0};
+    long position = ftell(file);
+    if (position < 0 || (uint64_t)position > offset) return 0;
+    if (fwrite(zeros, 1, (size_t)(offset - (uint64_t)position), file) != (size_t)(offset - (uint64_t)position)) return 0;
+
+    return size == 0 || fwrite(data, 1, size, file) == size;
+}
+
+typedef struct {
+    const ASTCacheHeader* header;
+    const FlatAST* flat;
+    const char* source;
+} CacheContents;
+
+static int writeCacheContents(FILE* file, void* context) {
+    const CacheContents* contents = (const CacheContents*)context;
+    const ASTCacheHeader* header = contents->header;
+    const FlatAST* flat = contents->flat;
+    size_t n = flat->nodeCount;
+    return fwrite(header, sizeof(*header), 1, file) == 1
+        && writeSection(file, header->typesOffset, flat->types, n * sizeof(unsigned char))
+        && writeSection(file, header->spansOffset, flat->spans, n * sizeof(SourceSpan))
+        && writeSection(file, header->dataOffset, flat->data, n * sizeof(FlatNodeData))
+        && writeSection(file, header->extraOffset, flat->extra, (size_t)flat->extraCount * sizeof(uint32_t))
+        && writeSection(file, header->stringsOffset, flat->strings, (size_t)flat->stringCount * sizeof(FlatString))
+        && writeSection(file, header->poolOffset, flat->pool, flat->poolSize)
+        && writeSection(file, header->sourceOffset, contents->source, (size_t)header->sourceLength);
+}
+
+int writeASTCache(const char* path, const FlatAST* flat, const char* source, size_t sourceLength) {
+    ASTCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AST_CACHE_MAGIC, sizeof(header.magic));
+    header.version = AST_CACHE_VERSION;
+    header.byteOrder = AST_CACHE_BYTE_ORDER;
+    header.sourceHash = hashSource(source, sourceLength);
+    header.sourceLength = sourceLength;
+    header.nodeCount = flat->nodeCount;
+    header.extraCount = flat->extraCount;
+    header.stringCount = flat->stringCount;
+    header.poolSize = flat->poolSize;
+    header.fileSize = layoutSections(&header);
+
+    CacheContents contents = { &header, flat, source };
+    return writeFileAtomicallyWith(path, writeCacheContents, &contents);
+}
+
+static int validSection(const ASTCacheHeader* header, uint64_t offset, uint64_t count, uint64_t elementSize) {
+    if (offset % SECTION_ALIGNMENT != 0 || offset < sizeof(ASTCacheHeader)) return 0;
+    if (offset > header->fileSize) return 0;
+    return count <= (header->fileSize - offset) / elementSize;
+}
+
+// The sections must lie in the file and the copy of the source must match it
+static int validHeader(const ASTCacheHeader* header, size_t fileSize, const char* source, size_t sourceLength) {
+    if (memcmp(header->magic, AST_CACHE_MAGIC, sizeof(header->magic)) != 0) return 0;
+    if (header->version != AST_CACHE_VERSION || header->byteOrder != AST_CACHE_BYTE_ORDER) return 0;
+    if (header->sourceLength != sourceLength) return 0;
+    if (header->fileSize != fileSize || header->nodeCount == 0) return 0;
+
+    return validSection(header, header->typesOffset, header->nodeCount, sizeof(unsigned char))
+        && validSection(header, header->spansOffset, header->nodeCount, sizeof(SourceSpan))
+        && validSection(header, header->dataOffset, header->nodeCount, sizeof(FlatNodeData))
+        && validSection(header, header->extraOffset, header->extraCount, sizeof(uint32_t))
+        && validSection(header, header->stringsOffset, header->stringCount, sizeof(FlatString))
+        && validSection(header, header->poolOffset, header->poolSize, 1)
+        && validSection(header, header->sourceOffset, header->sourceLength, 1)
+        && memcmp((const char*)header + header->sourceOffset, source, sourceLength) == 0;
+}
+
+FlatAST* loadASTCache(const char* path, const char* source, size_t sourceLength) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ASTCacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)info.st_size;
+    char* base = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    const ASTCacheHeader* header = (const ASTCacheHeader*)base;
+    if (!validHeader(header, size, source, sourceLength)) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    FlatAST* flat = (FlatAST*)calloc(1, sizeof(FlatAST));
+    if (flat == NULL) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    // The sections are used in place; the mapping is read-only
+    flat->nodeCount = flat->nodeCapacity = header->nodeCount;
+    flat->types = (unsigned char*)(base + header->typesOffset);
+    flat->spans = (SourceSpan*)(base + header->spansOffset);
+    flat->data = (FlatNodeData*)(base + header->dataOffset);
+    flat->extraCount = flat->extraCapacity = header->extraCount;
+    flat->extra = (uint32_t*)(base + header->extraOffset);
+    flat->stringCount = flat->stringCapacity = header->stringCount;
+    flat->strings = (FlatString*)(base + header->stringsOffset);
+    flat->poolSize = flat->poolCapacity = header->poolSize;
+    flat->pool = base + header->poolOffset;
+    flat->mapping = base;
+    flat->mappingSize = size;
+
+    if (!validateFlatAST(flat)) {
+        freeFlatAST(flat);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < flat->nodeCount; i++) {
+        if ((uint64_t)flat->spans[i].start + flat->spans[i].length > sourceLength) {
+            freeFlatAST(flat);
+            return NULL;
+        }
+    }
+
+    return flat;
+}
+
+static char* cacheEntryPath(const char* directory, uint64_t hash) {
+    size_t length = strlen(directory) + 32;
+    char* path = (char*)malloc(length);
+    if (path == NULL) return NULL;
+    snprintf(path, length, "%s/%016llx.ast", directory, (unsigned long long)hash);
+    return path;
+}
+
+FlatAST* lookupASTCache(const char* directory, const char* source, size_t length) {
+    uint64_t hash = hashSource(source, length);
+    char* path = cacheEntryPath(directory, hash);
+    if (path == NULL) return NULL;
+
+    FlatAST* flat = loadASTCache(path, source, length);
+    free(path);
+    return flat;
+}
+
+int storeASTCache(const char* directory, const char* source, size_t length, const FlatAST* flat) {
+    if (mkdir(directory, 0777) != 0 && errno != EEXIST) return 0;
+
+    uint64_t hash = hashSource(source, length);
+    char* path = cacheEntryPath(directory, hash);
+    if (path == NULL) return 0;
+
+    int ok = writeASTCache(path, flat, source, length);
+    free(path);
+    return ok;
+}
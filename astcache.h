@@ -0,0 +1,63 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "flatast.h"
+
+/*
+ * Binary serialization of a FlatAST. The file is a fixed header followed by
+ * the flat arrays, each at an 8-byte aligned offset recorded in the header,
+ * so a cached tree is loaded by mapping the file and pointing the FlatAST at
+ * the sections: there are no pointers to fix up.
+ *
+ * Files are stored in a cache directory under the hex content hash of the
+ * source they were parsed from. The hash only picks the file: each file
+ * also holds a copy of its source, and an entry is used only when that copy
+ * matches the source being parsed byte for byte, so stale entries and hash
+ * collisions are reparsed rather than served.
+ * Integers are stored in native byte order; files written on a machine of
+ * the other byte order fail validation and are simply reparsed.
+ */
+
+#define AST_CACHE_MAGIC "STASTBIN"
+/* Bump whenever the header or the FlatAST record layout changes */
+#define AST_CACHE_VERSION 5
+#define AST_CACHE_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t sourceHash;
+    uint64_t sourceLength;
+    uint64_t fileSize;
+
+    uint32_t nodeCount;
+    uint32_t extraCount;
+    uint32_t stringCount;
+    uint32_t poolSize;
+
+    uint64_t typesOffset;
+    uint64_t spansOffset;
+    uint64_t dataOffset;
+    uint64_t extraOffset;
+    uint64_t stringsOffset;
+    uint64_t poolOffset;
+    uint64_t sourceOffset;      /* sourceLength bytes of source */
+} ASTCacheHeader;
+
+uint64_t hashSource(const char* source, size_t length);
+
+/* Write the flat AST of a source to path, replacing any existing file
+ * atomically. Answers 1 on success. */
+int writeASTCache(const char* path, const FlatAST* flat, const char* source, size_t sourceLength);
+/* Map and validate a cache file; answers NULL if it is missing, corrupt, or
+ * was written for any other source. The result is released with freeFlatAST. */
+FlatAST* loadASTCache(const char* path, const char* source, size_t sourceLength);
+
+/* Cache directory helpers: the entry for a source is <directory>/<hash>.ast */
+FlatAST* lookupASTCache(const char* directory, const char* source, size_t length);
+int storeASTCache(const char* directory, const char* source, size_t length, const FlatAST* flat);
+
+#endif /* ASTCACHE_H */
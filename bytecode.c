@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bytecode.h"
+
+#define BYTECODE_NAME_ENTRY(name, operands) #name,
+#define SPECIAL_SEND_NAME_ENTRY(name, selector, arguments) "SEND_" #name,
+#define BYTECODE_OPERANDS_ENTRY(name, operands) operands,
+#define SPECIAL_SEND_OPERANDS_ENTRY(name, selector, arguments) OPERANDS_NONE,
+#define SPECIAL_SELECTOR_ENTRY(name, selector, arguments) selector,
+#define SPECIAL_ARGUMENTS_ENTRY(name, selector, arguments) arguments,
+
+static const char* const bytecodeNames[] = {
+    BYTECODES(BYTECODE_NAME_ENTRY)
+    SPECIAL_SELECTORS(SPECIAL_SEND_NAME_ENTRY)
+};
+
+static const OperandLayout bytecodeLayouts[] = {
+    BYTECODES(BYTECODE_OPERANDS_ENTRY)
+    SPECIAL_SELECTORS(SPECIAL_SEND_OPERANDS_ENTRY)
+};
+
+static const char* const specialSelectors[] = {
+    SPECIAL_SELECTORS(SPECIAL_SELECTOR_ENTRY)
+};
+
+static const int specialArgumentCounts[] = {
+    SPECIAL_SELECTORS(SPECIAL_ARGUMENTS_ENTRY)
+};
+
+const char* bytecodeName(Bytecode opcode) {
+    if ((unsigned)opcode >= BYTECODE_COUNT) return "UNKNOWN";
+    return bytecodeNames[opcode];
+}
+
+OperandLayout bytecodeOperands(Bytecode opcode) {
+    if ((unsigned)opcode >= BYTECODE_COUNT) return OPERANDS_NONE;
+    return bytecodeLayouts[opcode];
+}
+
+int bytecodeLength(Bytecode opcode) {
+    switch (bytecodeOperands(opcode)) {
+        case OPERANDS_NONE: return 1;
+        case OPERANDS_INDEX:
+        case OPERANDS_LITERAL:
+        case OPERANDS_SIGNED: return 2;
+        default: return 3;
+    }
+}
+
+const char* specialSelector(int index) {
+    if (index < 0 || index >= SPECIAL_SELECTOR_COUNT) return NULL;
+    return specialSelectors[index];
+}
+
+int specialSelectorArgumentCount(int index) {
+    if (index < 0 || index >= SPECIAL_SELECTOR_COUNT) return 0;
+    return specialArgumentCounts[index];
+}
+
+int findSpecialSelector(const char* selector) {
+    for (int i = 0; i < SPECIAL_SELECTOR_COUNT; i++) {
+        if (strcmp(specialSelectors[i], selector) == 0) return i;
+    }
+    return -1;
+}
+
+void freeLiteral(Literal* literal) {
+    switch (literal->kind) {
+        case LITERAL_STRING:
+        case LITERAL_SYMBOL:
+        case LITERAL_BYTE_ARRAY:
+        case LITERAL_GLOBAL:
+            free(literal->as.text.bytes);
+            break;
+        case LITERAL_ARRAY:
+            for (int i = 0; i < literal->as.array.count; i++) {
+                freeLiteral(&literal->as.array.elements[i]);
+            }
+            free(literal->as.array.elements);
+            break;
+        case LITERAL_BLOCK:
+            freeCompiledCode(literal->as.block);
+            break;
+        default:
+            break;
+    }
+}
+
+void freeCompiledCode(CompiledCode* code) {
+    if (code == NULL) return;
+    for (int i = 0; i < code->literalCount; i++) {
+        freeLiteral(&code->literals[i]);
+    }
+    free(code->literals);
+    free(code->bytecodes);
+    free(code->selector);
+    free(code);
+}
+
+int decodeInstruction(const CompiledCode* code, int pc, Bytecode* opcode, int* first, int* second) {
+    const uint8_t* bytes = code->bytecodes + pc;
+    *opcode = (Bytecode)bytes[0];
+    *first = 0;
+    *second = 0;
+
+    switch (bytecodeOperands(*opcode)) {
+        case OPERANDS_NONE:
+            break;
+        case OPERANDS_INDEX:
+        case OPERANDS_LITERAL:
+            *first = bytes[1];
+            break;
+        case OPERANDS_SIGNED:
+            *first = (int8_t)bytes[1];
+            break;
+        case OPERANDS_OUTER:
+        case OPERANDS_SEND:
+            *first = bytes[1];
+            *second = bytes[2];
+            break;
+        case OPERANDS_JUMP:
+            *first = (int16_t)(bytes[1] | (bytes[2] << 8));
+            break;
+    }
+    return pc + bytecodeLength(*opcode);
+}
+
+// Literal printing, as close to source syntax as possible
+
+static void writeSymbolText(OutputBuffer* out, const char* text, int length) {
+    // Selectors and identifiers print bare; anything else needs quotes
+    int bare = length > 0;
+    for (int i = 0; i < length && bare; i++) {
+        char c = text[i];
+        bare = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':' ||
+               (i > 0 && c >= '0' && c <= '9');
+    }
+    if (!bare) {
+        bare = length > 0 && strspn(text, "~!@%&*-+=\\<>,?/|") == (size_t)length;
+    }
+
+    if (bare) {
+        writeBytes(out, text, (size_t)length);
+        return;
+    }
+    writeChar(out, '\'');
+    for (int i = 0; i < length; i++) {
+        if (text[i] == '\'') writeChar(out, '\'');
+        writeChar(out, text[i]);
+    }
+    writeChar(out, '\'');
+}
+
+static void writeLiteralElement(OutputBuffer* out, const Literal* literal, int nested) {
+    switch (literal->kind) {
+        case LITERAL_NIL: writeString(out, "nil"); break;
+        case LITERAL_TRUE: writeString(out, "true"); break;
+        case LITERAL_FALSE: writeString(out, "false"); break;
+        case LITERAL_INTEGER: writeInteger(out, literal->as.integer); break;
+        case LITERAL_FLOAT: writeDouble(out, literal->as.number.value); break;
+        case LITERAL_SCALED:
+            writeDouble(out, literal->as.number.value);
+            writeChar(out, 's');
+            writeInteger(out, literal->as.number.scale);
+            break;
+        case LITERAL_CHARACTER:
+            writeChar(out, '$');
+            writeChar(out, (char)literal->as.character);
+            break;
+        case LITERAL_STRING:
+            writeChar(out, '\'');
+            for (int i = 0; i < literal->as.text.length; i++) {
+                if (literal->as.text.bytes[i] == '\'') writeChar(out, '\'');
+                writeChar(out, literal->as.text.bytes[i]);
+            }
+            writeChar(out, '\'');
+            break;
+        case LITERAL_SYMBOL:
+            if (!nested) writeChar(out, '#');
+            writeSymbolText(out, literal->as.text.bytes, literal->as.text.length);
+            break;
+        case LITERAL_ARRAY:
+            writeString(out, nested ? "(" : "#(");
+            for (int i = 0; i < literal->as.array.count; i++) {
+                if (i > 0) writeChar(out, ' ');
+                writeLiteralElement(out, &literal->as.array.elements[i], 1);
+            }
+            writeChar(out, ')');
+            break;
+        case LITERAL_BYTE_ARRAY:
+            writeString(out, "#[");
+            for (int i = 0; i < literal->as.text.length; i++) {
+                if (i > 0) writeChar(out, ' ');
+                writeInteger(out, (unsigned char)literal->as.text.bytes[i]);
+            }
+            writeChar(out, ']');
+            break;
+        case LITERAL_GLOBAL:
+            writeString(out, literal->as.text.bytes);
+            break;
+        case LITERAL_BLOCK:
+            writeString(out, "[]");
+            break;
+    }
+}
+
+void writeLiteral(OutputBuffer* out, const Literal* literal) {
+    writeLiteralElement(out, literal, 0);
+}
+
+// Disassembly
+
+static void writeCodeHeading(OutputBuffer* out, const CompiledCode* code) {
+    writeString(out, code->isBlock ? "block " : "method ");
+    if (code->isBlock) {
+        writeString(out, code->kind == BLOCK_CLEAN ? "clean" : code->kind == BLOCK_COPYING ? "copying" : "full");
+    } else {
+        writeString(out, code->selector != NULL ? code->selector : "DoIt");
+    }
+    writeString(out, " (arguments ");
+    writeInteger(out, code->argumentCount);
+    writeString(out, ", temporaries ");
+    writeInteger(out, code->temporaryCount);
+    if (code->isBlock) {
+        writeString(out, ", copied ");
+        writeInteger(out, code->copiedCount);
+    }
+    writeString(out, ", environment ");
+    writeInteger(out, code->environmentSize);
+    writeString(out, ", stack ");
+    writeInteger(out, code->maxStack);
+    if (code->primitive != 0) {
+        writeString(out, ", primitive ");
+        writeInteger(out, code->primitive);
+    }
+    writeString(out, ")\n");
+}
+
+static void writePaddedInteger(OutputBuffer* out, long long value, int width) {
+    char digits[24];
+    int length = 0;
+    do {
+        digits[length++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0 && length < (int)sizeof(digits));
+    for (int i = length; i < width; i++) writeChar(out, '0');
+    while (length > 0) writeChar(out, digits[--length]);
+}
+
+static void writeInstruction(OutputBuffer* out, const CompiledCode* code, int pc, int next,
+                             Bytecode opcode, int first, int second) {
+    writePaddedInteger(out, pc, 4);
+    writeString(out, "  ");
+    writeString(out, bytecodeName(opcode));
+
+    OperandLayout layout = bytecodeOperands(opcode);
+    switch (layout) {
+        case OPERANDS_NONE:
+            break;
+        case OPERANDS_INDEX:
+        case OPERANDS_LITERAL:
+        case OPERANDS_SIGNED:
+            writeChar(out, ' ');
+            writeInteger(out, first);
+            break;
+        case OPERANDS_OUTER:
+        case OPERANDS_SEND:
+            writeChar(out, ' ');
+            writeInteger(out, first);
+            writeChar(out, ' ');
+            writeInteger(out, second);
+            break;
+        case OPERANDS_JUMP:
+            writeString(out, " -> ");
+            writeInteger(out, next + first);
+            break;
+    }
+
+    if ((layout == OPERANDS_LITERAL || layout == OPERANDS_SEND) && first < code->literalCount) {
+        writeString(out, "  ; ");
+        const Literal* literal = &code->literals[first];
+        writeLiteral(out, literal);
+    }
+    writeChar(out, '\n');
+}
+
+static void disassembleBody(OutputBuffer* out, const CompiledCode* code, int indent) {
+    for (int i = 0; i < code->literalCount; i++) {
+        if (code->literals[i].kind == LITERAL_BLOCK) continue;
+        writeSpaces(out, indent + 2);
+        writeString(out, "literal ");
+        writeInteger(out, i);
+        writeString(out, ": ");
+        writeLiteral(out, &code->literals[i]);
+        writeChar(out, '\n');
+    }
+
+    int pc = 0;
+    while (pc < code->length) {
+        Bytecode opcode;
+        int first, second;
+        int next = decodeInstruction(code, pc, &opcode, &first, &second);
+        writeSpaces(out, indent + 2);
+        writeInstruction(out, code, pc, next, opcode, first, second);
+        pc = next;
+    }
+
+    for (int i = 0; i < code->literalCount; i++) {
+        if (code->literals[i].kind != LITERAL_BLOCK) continue;
+        writeSpaces(out, indent + 2);
+        writeString(out, "literal ");
+        writeInteger(out, i);
+        writeString(out, ": ");
+        writeCodeHeading(out, code->literals[i].as.block);
+        disassembleBody(out, code->literals[i].as.block, indent + 2);
+    }
+}
+
+void disassemble(OutputBuffer* out, const CompiledCode* code, int indent) {
+    writeSpaces(out, indent);
+    writeCodeHeading(out, code);
+    disassembleBody(out, code, indent);
+}
@@ -0,0 +1,228 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+#include "output.h"
+
+/*
+ * Bytecode of compiled methods and blocks, in the spirit of the Blue Book:
+ * a stack machine whose instructions are one opcode byte followed by at most
+ * two operand bytes. The operand layouts are
+ *
+ *   NONE      no operands
+ *   INDEX     one byte: frame slot, instance variable or element count
+ *   LITERAL   one byte: index in the literal frame
+ *   OUTER     two bytes: slot in an environment, then the number of
+ *             environments to walk outwards from the current one
+ *   SEND      two bytes: literal index of the selector, argument count
+ *   SIGNED    one byte holding a value in -128..127
+ *   JUMP      two bytes: signed 16-bit offset, little-endian, counted from
+ *             the end of the instruction
+ *
+ * Arguments and temporaries live in frame slots, arguments first. Those that
+ * blocks store into, or that change after a block refers to them, live in a
+ * heap environment instead, which is what PUSH_OUTER and friends reach. The
+ * other variables that a block refers to are copied into its closure when it
+ * is made, and PUSH_COPIED reads them there. Expand BYTECODES with a macro
+ * taking the name without its BC_ prefix and the operand layout to generate
+ * code per opcode.
+ */
+
+typedef enum {
+    OPERANDS_NONE,
+    OPERANDS_INDEX,
+    OPERANDS_LITERAL,
+    OPERANDS_OUTER,
+    OPERANDS_SEND,
+    OPERANDS_SIGNED,
+    OPERANDS_JUMP
+} OperandLayout;
+
+#define BYTECODES(X) \
+    /* Pushes */ \
+    X(PUSH_TEMP, OPERANDS_INDEX) \
+    X(PUSH_OUTER, OPERANDS_OUTER) \
+    X(PUSH_COPIED, OPERANDS_INDEX)      /* Value copied into the closure of the running block */ \
+    X(PUSH_INST, OPERANDS_INDEX) \
+    X(PUSH_GLOBAL, OPERANDS_LITERAL) \
+    X(PUSH_LITERAL, OPERANDS_LITERAL) \
+    X(PUSH_INTEGER, OPERANDS_SIGNED) \
+    X(PUSH_SELF, OPERANDS_NONE) \
+    X(PUSH_NIL, OPERANDS_NONE) \
+    X(PUSH_TRUE, OPERANDS_NONE) \
+    X(PUSH_FALSE, OPERANDS_NONE) \
+    X(PUSH_THIS_CONTEXT, OPERANDS_NONE) \
+    X(PUSH_BLOCK, OPERANDS_LITERAL)     /* Closure over the block in the literal, holding the \
+                                         * top copiedCount values */ \
+    X(MAKE_ARRAY, OPERANDS_INDEX)       /* Array of the top count values */ \
+    \
+    /* Stores leave the value on the stack; the POP_ forms remove it */ \
+    X(STORE_TEMP, OPERANDS_INDEX) \
+    X(STORE_OUTER, OPERANDS_OUTER) \
+    X(STORE_INST, OPERANDS_INDEX) \
+    X(STORE_GLOBAL, OPERANDS_LITERAL) \
+    X(POP_STORE_TEMP, OPERANDS_INDEX) \
+    X(POP_STORE_OUTER, OPERANDS_OUTER) \
+    X(POP_STORE_INST, OPERANDS_INDEX) \
+    X(POP_STORE_GLOBAL, OPERANDS_LITERAL) \
+    \
+    /* Stack */ \
+    X(POP, OPERANDS_NONE) \
+    X(DUP, OPERANDS_NONE) \
+    \
+    /* Sends */ \
+    X(SEND, OPERANDS_SEND) \
+    X(SUPER_SEND, OPERANDS_SEND) \
+    \
+    /* Control */ \
+    X(JUMP, OPERANDS_JUMP) \
+    X(JUMP_IF_TRUE, OPERANDS_JUMP)      /* Pops the condition */ \
+    X(JUMP_IF_FALSE, OPERANDS_JUMP) \
+    X(RETURN_TOP, OPERANDS_NONE)        /* From the method */ \
+    X(RETURN_SELF, OPERANDS_NONE) \
+    X(BLOCK_RETURN, OPERANDS_NONE)      /* From a block to its caller */ \
+    X(NON_LOCAL_RETURN, OPERANDS_NONE)  /* ^ in a block: from its home method */
+
+/*
+ * Selectors sent often enough to have an opcode of their own, SEND_<name>,
+ * which needs no literal. The opcodes follow the BYTECODES ones in this order.
+ */
+#define SPECIAL_SELECTORS(X) \
+    X(ADD, "+", 1) \
+    X(SUBTRACT, "-", 1) \
+    X(MULTIPLY, "*", 1) \
+    X(DIVIDE, "/", 1) \
+    X(LESS, "<", 1) \
+    X(GREATER, ">", 1) \
+    X(LESS_EQUAL, "<=", 1) \
+    X(GREATER_EQUAL, ">=", 1) \
+    X(EQUAL, "=", 1) \
+    X(NOT_EQUAL, "~=", 1) \
+    X(IDENTICAL, "==", 1) \
+    X(BIT_AND, "bitAnd:", 1) \
+    X(BIT_OR, "bitOr:", 1) \
+    X(INTEGER_DIVIDE, "//", 1) \
+    X(MODULO, "\\\\", 1) \
+    X(AT, "at:", 1) \
+    X(AT_PUT, "at:put:", 2) \
+    X(SIZE, "size", 0) \
+    X(VALUE, "value", 0) \
+    X(VALUE_1, "value:", 1) \
+    X(CLASS, "class", 0) \
+    X(IS_NIL, "isNil", 0) \
+    X(NOT_NIL, "notNil", 0)
+
+#define BYTECODE_ENUM_ENTRY(name, operands) BC_##name,
+#define SPECIAL_SEND_ENUM_ENTRY(name, selector, arguments) BC_SEND_##name,
+
+typedef enum {
+    BYTECODES(BYTECODE_ENUM_ENTRY)
+    SPECIAL_SELECTORS(SPECIAL_SEND_ENUM_ENTRY)
+    BYTECODE_COUNT
+} Bytecode;
+
+#define FIRST_SPECIAL_SEND BC_SEND_ADD
+#define SPECIAL_SELECTOR_COUNT (BYTECODE_COUNT - FIRST_SPECIAL_SEND)
+
+/* Opcode name without the BC_ prefix, such as "PUSH_TEMP" */
+const char* bytecodeName(Bytecode opcode);
+OperandLayout bytecodeOperands(Bytecode opcode);
+/* Length of an instruction in bytes, opcode included */
+int bytecodeLength(Bytecode opcode);
+/* Selector and argument count of SEND_<name>, by index from FIRST_SPECIAL_SEND */
+const char* specialSelector(int index);
+int specialSelectorArgumentCount(int index);
+/* Index of a selector among the special ones, or -1 */
+int findSpecialSelector(const char* selector);
+
+/*
+ * Literal frame. Literals are plain values rather than objects so that code
+ * can be compiled without a running image; whoever installs the code turns
+ * them into objects.
+ */
+
+typedef struct CompiledCode CompiledCode;
+typedef struct Literal Literal;
+
+typedef enum {
+    LITERAL_NIL,           /* Only inside literal arrays */
+    LITERAL_TRUE,
+    LITERAL_FALSE,
+    LITERAL_INTEGER,
+    LITERAL_FLOAT,
+    LITERAL_SCALED,
+    LITERAL_CHARACTER,
+    LITERAL_STRING,
+    LITERAL_SYMBOL,        /* Also the selectors of sends */
+    LITERAL_ARRAY,
+    LITERAL_BYTE_ARRAY,
+    LITERAL_GLOBAL,        /* Name of a global variable, bound on installation */
+    LITERAL_BLOCK          /* Code of a block literal */
+} LiteralKind;
+
+struct Literal {
+    LiteralKind kind;
+    union {
+        long long integer;
+        struct {
+            double value;
+            int scale;         /* Scaled decimals only */
+        } number;
+        unsigned char character;
+        struct {
+            char* bytes;       /* NUL-terminated; byte arrays may hold NULs too */
+            int length;
+        } text;                /* String, symbol, global name or byte array */
+        struct {
+            Literal* elements;
+            int count;
+        } array;
+        CompiledCode* block;
+    } as;
+};
+
+/*
+ * What a block needs of the code that makes it. A clean block refers to
+ * nothing outside itself, so one closure made when the code is installed
+ * serves for every evaluation: it compiles to PUSH_LITERAL of the block. The
+ * others are made by PUSH_BLOCK each time; a copying block holds the receiver,
+ * its home for ^ and copies of the outer variables it reads, and a full block
+ * keeps the environment of the code around it as well.
+ */
+typedef enum {
+    BLOCK_CLEAN,
+    BLOCK_COPYING,
+    BLOCK_FULL
+} BlockKind;
+
+struct CompiledCode {
+    char* selector;            /* Methods; NULL for blocks */
+    int argumentCount;
+    int temporaryCount;        /* Frame slots after the arguments */
+    int environmentSize;       /* Variables kept in a heap environment, 0 for none */
+    int maxStack;              /* Deepest operand stack above the frame slots */
+    int primitive;             /* Primitive number, 0 for none */
+    int isBlock;
+    BlockKind kind;            /* Blocks only */
+    int copiedCount;           /* Blocks: values copied into the closure */
+    uint8_t* bytecodes;
+    int length;
+    Literal* literals;
+    int literalCount;
+};
+
+/* Frees the code with its literals and nested blocks */
+void freeCompiledCode(CompiledCode* code);
+void freeLiteral(Literal* literal);
+
+/* Answers the instruction at pc and its operands; operands not used by its
+ * layout are 0. Answers the pc of the next instruction. */
+int decodeInstruction(const CompiledCode* code, int pc, Bytecode* opcode, int* first, int* second);
+
+/* Print a literal the way it is written in source */
+void writeLiteral(OutputBuffer* out, const Literal* literal);
+/* Print the code, one instruction per line, followed by the code of its
+ * blocks. Each line is indented by indent spaces. */
+void disassemble(OutputBuffer* out, const CompiledCode* code, int indent);
+
+#endif /* BYTECODE_H */
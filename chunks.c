@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "chunks.h"
+#include "parser.h"
+
+// Characters the body scan has to stop at; everything else is skipped in a tight loop
+static const unsigned char chunkSpecial[256] = {
+    ['\n'] = 1, ['!'] = 1, ['\''] = 1, ['"'] = 1, ['$'] = 1, ['['] = 1, [']'] = 1
+};
+
+static const char* binaryChars = "~!@%&*-+=|\\<>,?/";
+
+void initChunkScanner(ChunkScanner* scanner, const char* source, size_t length) {
+    scanner->current = source;
+    scanner->end = source + length;
+    scanner->line = 1;
+    scanner->inMethods = 0;
+    scanner->inComment = 0;
+    scanner->className = NULL;
+    scanner->classNameLength = 0;
+    scanner->isMeta = 0;
+}
+
+static void skipSeparators(ChunkScanner* scanner) {
+    while (scanner->current < scanner->end && isspace((unsigned char)*scanner->current)) {
+        if (*scanner->current == '\n') scanner->line++;
+        scanner->current++;
+    }
+}
+
+// Scan to the '!' terminating the current chunk, tracking string, comment
+// and bracket state so that a stray '!' inside them does not end the chunk.
+// Leaves the scanner after the terminator and returns the end of the body.
+static const char* scanChunkBody(ChunkScanner* scanner) {
+    const char* p = scanner->current;
+    const char* end = scanner->end;
+    int line = scanner->line;
+    int depth = 0;
+
+    while (p < end) {
+        while (p < end && !chunkSpecial[(unsigned char)*p]) p++;
+        if (p >= end) break;
+
+        switch (*p) {
+            case '\n':
+                line++;
+                p++;
+                break;
+            case '\'': // String or quoted symbol; '' is an embedded quote
+                p++;
+                for (;;) {
+                    while (p < end && *p != '\'') {
+                        if (*p == '\n') line++;
+                        p++;
+                    }
+                    if (p + 1 < end && p[1] == '\'') {
+                        p += 2;
+                        continue;
+                    }
+                    break;
+                }
+                if (p < end) p++;
+                break;
+            case '"': // Comment
+                p++;
+                while (p < end && *p != '"') {
+                    if (*p == '\n') line++;
+                    p++;
+                }
+                if (p < end) p++;
+                break;
+            case '$': // Character literal, which may be any character
+                if (p + 1 < end && p[1] == '\n') line++;
+                if (p + 2 < end && p[1] == '!' && p[2] == '!') {
+                    p += 3;
+                } else {
+                    p += (p + 1 < end) ? 2 : 1;
+                }
+                break;
+            case '[':
+                depth++;
+                p++;
+                break;
+            case ']':
+                if (depth > 0) depth--;
+                p++;
+                break;
+            case '!':
+                if (p + 1 < end && p[1] == '!') {
+                    p += 2;
+                    break;
+                }
+                if (depth == 0) {
+                    scanner->current = p + 1;
+                    scanner->line = line;
+                    return p;
+                }
+                p++;
+                break;
+        }
+    }
+
+    scanner->current = end;
+    scanner->line = line;
+    return end;
+}
+
+// Class comments are free text, so only the '!!' escape is meaningful in them
+static const char* scanRawChunkBody(ChunkScanner* scanner) {
+    const char* p = scanner->current;
+    const char* end = scanner->end;
+
+    while (p < end) {
+        if (*p == '\n') {
+            scanner->line++;
+        } else if (*p == '!') {
+            if (p + 1 < end && p[1] == '!') {
+                p++;
+            } else {
+                scanner->current = p + 1;
+                return p;
+            }
+        }
+        p++;
+    }
+
+    scanner->current = end;
+    return end;
+}
+
+static const char* skipBlanksAndComments(const char* p, const char* end) {
+    for (;;) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p < end && *p == '"') {
+            p++;
+            while (p < end && *p != '"') p++;
+            if (p < end) p++;
+            continue;
+        }
+        return p;
+    }
+}
+
+static const char* skipIdentifier(const char* p, const char* end) {
+    while (p < end && (isalnum((unsigned char)*p) || *p == '_')) p++;
+    return p;
+}
+
+static int startsIdentifier(const char* p, const char* end) {
+    return p < end && (isalpha((unsigned char)*p) || *p == '_');
+}
+
+// Read the selector from a method's message pattern
+static void methodSelector(const char* p, const char* end, char* selector, size_t size) {
+    size_t length = 0;
+    selector[0] = '\0';
+
+    p = skipBlanksAndComments(p, end);
+
+    if (startsIdentifier(p, end)) {
+        const char* nameEnd = skipIdentifier(p, end);
+
+        if (nameEnd >= end || *nameEnd != ':' || (nameEnd + 1 < end && nameEnd[1] == '=')) {
+            // Unary pattern
+            length = (size_t)(nameEnd - p);
+            if (length >= size) length = size - 1;
+            memcpy(selector, p, length);
+            selector[length] = '\0';
+            return;
+        }
+
+        // Keyword pattern: keyword argument keyword argument ...
+        for (;;) {
+            size_t partLength = (size_t)(nameEnd + 1 - p);
+            if (length + partLength >= size) break;
+            memcpy(selector + length, p, partLength);
+            length += partLength;
+
+            p = skipBlanksAndComments(nameEnd + 1, end);
+            p = skipIdentifier(p, end);  // Argument name
+            p = skipBlanksAndComments(p, end);
+
+            if (!startsIdentifier(p, end)) break;
+            nameEnd = skipIdentifier(p, end);
+            if (nameEnd >= end || *nameEnd != ':') break;
+        }
+        selector[length] = '\0';
+        return;
+    }
+
+    // Binary pattern
+    while (p < end && strchr(binaryChars, *p) != NULL && length < size - 1) {
+        selector[length++] = *p++;
+    }
+    selector[length] = '\0';
+}
+
+// Interpret a "!Foo class methodsFor: 'x'!" style header
+static void readSectionHeader(ChunkScanner* scanner, const char* p, const char* end) {
+    p = skipBlanksAndComments(p, end);
+    if (!startsIdentifier(p, end)) return;
+
+    const char* name = p;
+    p = skipIdentifier(p, end);
+    int nameLength = (int)(p - name);
+    int isMeta = 0;
+
+    p = skipBlanksAndComments(p, end);
+    if (end - p > 5 && memcmp(p, "class", 5) == 0 && !isalnum((unsigned char)p[5]) && p[5] != ':') {
+        isMeta = 1;
+        p = skipBlanksAndComments(p + 5, end);
+    }
+
+    if (end - p >= 11 && memcmp(p, "methodsFor:", 11) == 0) {
+        scanner->inMethods = 1;
+        scanner->className = name;
+        scanner->classNameLength = nameLength;
+        scanner->isMeta = isMeta;
+    } else if (end - p >= 13 && memcmp(p, "commentStamp:", 13) == 0) {
+        scanner->inComment = 1;
+    }
+}
+
+int nextChunk(ChunkScanner* scanner, SourceChunk* chunk) {
+    for (;;) {
+        skipSeparators(scanner);
+        if (scanner->current >= scanner->end) return 0;
+
+        if (scanner->inMethods) {
+            // An empty chunk closes the methodsFor: section
+            if (*scanner->current == '!') {
+                scanner->current++;
+                scanner->inMethods = 0;
+                continue;
+            }
+
+            chunk->kind = CHUNK_METHOD;
+            chunk->start = scanner->current;
+            chunk->firstLine = scanner->line;
+            const char* bodyEnd = scanChunkBody(scanner);
+            chunk->length = (int)(bodyEnd - chunk->start);
+            chunk->lastLine = scanner->line;
+            chunk->className = scanner->className;
+            chunk->classNameLength = scanner->classNameLength;
+            chunk->isMeta = scanner->isMeta;
+            methodSelector(chunk->start, bodyEnd, chunk->selector, sizeof(chunk->selector));
+            return 1;
+        }
+
+        if (*scanner->current == '!' && !scanner->inComment) {
+            // Section header, evaluated by the reader rather than as a doit
+            scanner->current++;
+            const char* headerStart = scanner->current;
+            const char* headerEnd = scanChunkBody(scanner);
+            readSectionHeader(scanner, headerStart, headerEnd);
+            continue;
+        }
+
+        chunk->start = scanner->current;
+        chunk->firstLine = scanner->line;
+        chunk->className = NULL;
+        chunk->classNameLength = 0;
+        chunk->isMeta = 0;
+        chunk->selector[0] = '\0';
+
+        const char* bodyEnd;
+        if (scanner->inComment) {
+            chunk->kind = CHUNK_COMMENT;
+            scanner->inComment = 0;
+            bodyEnd = scanRawChunkBody(scanner);
+        } else {
+            chunk->kind = CHUNK_DOIT;
+            bodyEnd = scanChunkBody(scanner);
+        }
+        chunk->length = (int)(bodyEnd - chunk->start);
+        chunk->lastLine = scanner->line;
+        return 1;
+    }
+}
+
+int chunkMatches(const SourceChunk* chunk, const ChunkFilter* filter) {
+    if (chunk->kind == CHUNK_COMMENT) return 0;
+
+    if (filter->selector != NULL) {
+        if (chunk->kind != CHUNK_METHOD || strcmp(chunk->selector, filter->selector) != 0) return 0;
+    }
+
+    if (filter->className != NULL) {
+        if (chunk->kind != CHUNK_METHOD) return 0;
+
+        size_t length = strlen(filter->className);
+        int isMeta = length > 6 && strcmp(filter->className + length - 6, " class") == 0;
+        if (isMeta) length -= 6;
+
+        if (isMeta != chunk->isMeta) return 0;
+        if ((int)length != chunk->classNameLength ||
+            memcmp(filter->className, chunk->className, length) != 0) return 0;
+    }
+
+    if (filter->firstLine > 0 && chunk->lastLine < filter->firstLine) return 0;
+    if (filter->lastLine > 0 && chunk->firstLine > filter->lastLine) return 0;
+
+    return 1;
+}
+
+int containsMethodChunks(const char* source, size_t length) {
+    ChunkScanner scanner;
+    SourceChunk chunk;
+    initChunkScanner(&scanner, source, length);
+    while (nextChunk(&scanner, &chunk)) {
+        if (chunk.kind == CHUNK_METHOD) return 1;
+    }
+    return 0;
+}
+
+ASTNode* parseChunk(const SourceChunk* chunk, char** text, int* hadError) {
+    // Collapse the '!!' escapes into a NUL-terminated copy for the lexer
+    char* copy = (char*)malloc(chunk->length + 1);
+    *text = copy;
+    if (copy == NULL) {
+        *hadError = 1;
+        return NULL;
+    }
+
+    int length = 0;
+    for (int i = 0; i < chunk->length; i++) {
+        copy[length++] = chunk->start[i];
+        if (chunk->start[i] == '!' && i + 1 < chunk->length && chunk->start[i + 1] == '!') i++;
+    }
+    copy[length] = '\0';
+
+    Parser parser;
+    initParserAtLine(&parser, copy, chunk->firstLine);
+
+    ASTNode* node = chunk->kind == CHUNK_METHOD ? parseMethod(&parser) : parse(&parser);
+    *hadError = parser.hadError;
+
+    return node;
+}
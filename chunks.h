@@ -0,0 +1,60 @@
+#ifndef CHUNKS_H
+#define CHUNKS_H
+
+#include <stddef.h>
+#include "ast.h"
+
+/*
+ * Skip-scanner for chunk-format sources ("fileouts"). Chunks are delimited
+ * by '!' ('!!' escapes a literal '!'); a chunk starting with '!' such as
+ * "!Foo methodsFor: 'x'!" is followed by method chunks up to an empty one.
+ * The scanner only tracks string, comment and bracket state, so it can
+ * locate every method and read its selector without lexing the bodies.
+ */
+
+typedef enum {
+    CHUNK_DOIT,     /* Top-level expressions, e.g. a class definition */
+    CHUNK_METHOD,   /* A method source inside a methodsFor: section */
+    CHUNK_COMMENT   /* Class comment following a commentStamp: header */
+} ChunkKind;
+
+typedef struct {
+    ChunkKind kind;
+    const char* start;          /* Raw chunk text, still '!!'-escaped */
+    int length;
+    int firstLine;
+    int lastLine;
+    const char* className;      /* Class of a method chunk (not NUL-terminated) */
+    int classNameLength;
+    int isMeta;                 /* Method belongs to the metaclass */
+    char selector[256];         /* Selector of a method chunk */
+} SourceChunk;
+
+typedef struct {
+    const char* current;
+    const char* end;
+    int line;
+    int inMethods;              /* Inside a methodsFor: section */
+    int inComment;              /* Next chunk is a class comment */
+    const char* className;
+    int classNameLength;
+    int isMeta;
+} ChunkScanner;
+
+/* Selection criteria; unset fields (NULL / 0) match everything */
+typedef struct {
+    const char* selector;
+    const char* className;      /* "Foo" or "Foo class" */
+    int firstLine;
+    int lastLine;
+} ChunkFilter;
+
+void initChunkScanner(ChunkScanner* scanner, const char* source, size_t length);
+int nextChunk(ChunkScanner* scanner, SourceChunk* chunk);
+int chunkMatches(const SourceChunk* chunk, const ChunkFilter* filter);
+/* A source with at least one method chunk is a fileout rather than plain code */
+int containsMethodChunks(const char* source, size_t length);
+/* The AST refers to *text, which the caller frees after the AST */
+ASTNode* parseChunk(const SourceChunk* chunk, char** text, int* hadError);
+
+#endif /* CHUNKS_H */
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "parser.h"
+#include "chunks.h"
+#include "flatast.h"
+#include "merkle.h"
+#include "sourcemap.h"
+#include "fileio.h"
+
+// Clone detector: parses files in parallel, hashes every subtree with
+// normalized Merkle hashes and reports groups of equal subtrees. Candidates
+// are bucketed by sorting on the hash, so the cost is O(n log n) in the
+// number of subtrees rather than quadratic.
+
+typedef struct {
+    uint64_t hash;
+    uint64_t parentHash;
+    uint32_t size;
+    uint32_t file;
+    int hasParent;
+    int firstLine;
+    int firstColumn;
+    int lastLine;
+    int lastColumn;
+} CloneCandidate;
+
+typedef struct {
+    CloneCandidate* items;
+    size_t count;
+    size_t capacity;
+    size_t nodes;           // Nodes hashed by this worker
+} CandidateList;
+
+typedef struct {
+    char** paths;
+    int fileCount;
+    atomic_int nextFile;
+    int flags;
+    uint32_t minSize;
+} CloneJob;
+
+typedef struct {
+    CloneJob* job;
+    CandidateList list;
+} CloneWorker;
+
+typedef struct {
+    size_t first;
+    size_t count;
+    uint32_t size;
+} CloneGroup;
+
+static int addCandidate(CandidateList* list, const CloneCandidate* candidate) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity < 1024 ? 1024 : list->capacity * 2;
+        CloneCandidate* items = (CloneCandidate*)realloc(list->items, sizeof(CloneCandidate) * capacity);
+        if (items == NULL) return 0;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = *candidate;
+    return 1;
+}
+
+// Hash one parsed unit (a file or a chunk) and record its large subtrees
+static void collectCandidates(CloneWorker* worker, ASTNode* ast, const char* text, int firstLine, uint32_t file) {
+    CloneJob* job = worker->job;
+    FlatAST* flat = flattenAST(ast);
+    if (flat == NULL) return;
+
+    MerkleHashes hashes;
+    FlatIndex* parents = (FlatIndex*)malloc(sizeof(FlatIndex) * flat->nodeCount);
+    if (parents == NULL || !computeMerkleHashes(flat, job->flags, &hashes)) {
+        free(parents);
+        freeFlatAST(flat);
+        return;
+    }
+
+    parents[0] = FLAT_NONE;
+    for (FlatIndex i = 0; i < flat->nodeCount; i++) {
+        int children = flatChildCount(flat, i);
+        for (int c = 0; c < children; c++) {
+            FlatIndex child = flatChild(flat, i, c);
+            if (child != FLAT_NONE) parents[child] = i;
+        }
+    }
+
+    SourceMap map;
+    initSourceMap(&map, text, strlen(text), firstLine);
+
+    for (FlatIndex i = 0; i < flat->nodeCount; i++) {
+        if (hashes.sizes[i] < job->minSize) continue;
+
+        CloneCandidate candidate;
+        candidate.hash = hashes.hashes[i];
+        candidate.hasParent = parents[i] != FLAT_NONE;
+        candidate.parentHash = candidate.hasParent ? hashes.hashes[parents[i]] : 0;
+        candidate.size = hashes.sizes[i];
+        candidate.file = file;
+        if (!spanStart(&map, flat->spans[i], &candidate.firstLine, &candidate.firstColumn) ||
+            !spanEnd(&map, flat->spans[i], &candidate.lastLine, &candidate.lastColumn) ||
+            !addCandidate(&worker->list, &candidate)) {
+            break;
+        }
+    }
+    worker->list.nodes += flat->nodeCount;
+
+    freeSourceMap(&map);
+    freeMerkleHashes(&hashes);
+    free(parents);
+    freeFlatAST(flat);
+}
+
+static void processFile(CloneWorker* worker, uint32_t file) {
+    const char* path = worker->job->paths[file];
+    char* source = readFile(path);
+    if (source == NULL) return;
+
+    if (containsMethodChunks(source, strlen(source))) {
+        ChunkScanner scanner;
+        SourceChunk chunk;
+        initChunkScanner(&scanner, source, strlen(source));
+        while (nextChunk(&scanner, &chunk)) {
+            if (chunk.kind == CHUNK_COMMENT) continue;
+
+            int hadError = 0;
+            char* text = NULL;
+            ASTNode* ast = parseChunk(&chunk, &text, &hadError);
+            if (!hadError && ast != NULL) {
+                collectCandidates(worker, ast, text, chunk.firstLine, file);
+            }
+            freeASTNode(ast);
+            free(text);
+        }
+    } else {
+        Parser parser;
+        initParser(&parser, source);
+        ASTNode* ast = parse(&parser);
+        if (!parser.hadError && ast != NULL) {
+            collectCandidates(worker, ast, source, 1, file);
+        } else {
+            fprintf(stderr, "Skipping %s: parse failed.\n", path);
+        }
+        freeASTNode(ast);
+    }
+
+    free(source);
+}
+
+static void* cloneWorkerMain(void* argument) {
+    CloneWorker* worker = (CloneWorker*)argument;
+    CloneJob* job = worker->job;
+
+    for (;;) {
+        int file = atomic_fetch_add(&job->nextFile, 1);
+        if (file >= job->fileCount) break;
+        processFile(worker, (uint32_t)file);
+    }
+    return NULL;
+}
+
+static int compareCandidates(const void* a, const void* b) {
+    const CloneCandidate* x = (const CloneCandidate*)a;
+    const CloneCandidate* y = (const CloneCandidate*)b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    if (x->file != y->file) return x->file < y->file ? -1 : 1;
+    if (x->firstLine != y->firstLine) return x->firstLine < y->firstLine ? -1 : 1;
+    return x->firstColumn - y->firstColumn;
+}
+
+static int compareGroups(const void* a, const void* b) {
+    const CloneGroup* x = (const CloneGroup*)a;
+    const CloneGroup* y = (const CloneGroup*)b;
+    if (x->size != y->size) return x->size > y->size ? -1 : 1;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return x->first < y->first ? -1 : 1;
+}
+
+// First candidate whose hash is not below (or, with above set, not at or below) the given one
+static size_t searchHash(const CloneCandidate* items, size_t count, uint64_t hash, int above) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (items[middle].hash < hash || (above && items[middle].hash == hash)) low = middle + 1; else high = middle;
+    }
+    return low;
+}
+
+// Number of candidates with the given hash in the sorted array
+static size_t countHash(const CloneCandidate* items, size_t count, uint64_t hash) {
+    return searchHash(items, count, hash, 1) - searchHash(items, count, hash, 0);
+}
+
+// A group whose every member sits inside a member of a larger clone group
+// is implied by that group and not reported
+static int isSubsumed(const CloneCandidate* items, size_t count, const CloneGroup* group) {
+    for (size_t i = group->first; i < group->first + group->count; i++) {
+        if (!items[i].hasParent || countHash(items, count, items[i].parentHash) < 2) return 0;
+    }
+    return 1;
+}
+
+static void printUsage(const char* programName) {
+    printf("Usage: %s [options] <file>...\n", programName);
+    printf("Report groups of structurally identical subtrees. Without files, paths are read from stdin.\n");
+    printf("Options:\n");
+    printf("  -h, --help         Display this help message\n");
+    printf("  --min-size N       Smallest subtree to report, in nodes (default 20)\n");
+    printf("  --threads N        Worker threads (default: one per CPU)\n");
+    printf("  --ignore-names     Treat subtrees differing only in variable names as clones\n");
+    printf("  --ignore-literals  Treat subtrees differing only in literal values as clones\n");
+}
+
+int main(int argc, char* argv[]) {
+    CloneJob job;
+    job.flags = 0;
+    job.minSize = 20;
+    job.paths = NULL;
+    job.fileCount = 0;
+    atomic_init(&job.nextFile, 0);
+
+    long threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    char** paths = (char**)malloc(sizeof(char*) * (argc > 1 ? argc : 1));
+    if (paths == NULL) return 1;
+    int pathCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            free(paths);
+            return 0;
+        } else if (strcmp(argv[i], "--min-size") == 0 && i + 1 < argc) {
+            job.minSize = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--ignore-names") == 0) {
+            job.flags |= MERKLE_IGNORE_NAMES;
+        } else if (strcmp(argv[i], "--ignore-literals") == 0) {
+            job.flags |= MERKLE_IGNORE_LITERALS;
+        } else {
+            paths[pathCount++] = argv[i];
+        }
+    }
+
+    int ownsPaths = 0;
+    if (pathCount == 0) {
+        free(paths);
+        paths = readPathList(&pathCount);
+        ownsPaths = 1;
+    }
+    if (pathCount == 0) {
+        fprintf(stderr, "No source files specified.\n");
+        printUsage(argv[0]);
+        free(paths);
+        return 1;
+    }
+    job.paths = paths;
+    job.fileCount = pathCount;
+
+    if (threadCount < 1) threadCount = 1;
+    if (threadCount > pathCount) threadCount = pathCount;
+
+    CloneWorker* workers = (CloneWorker*)calloc((size_t)threadCount, sizeof(CloneWorker));
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    if (workers == NULL || threads == NULL) {
+        fprintf(stderr, "Not enough memory.\n");
+        return 1;
+    }
+
+    long started = 0;
+    for (long i = 0; i < threadCount; i++) {
+        workers[i].job = &job;
+        if (pthread_create(&threads[i], NULL, cloneWorkerMain, &workers[i]) != 0) break;
+        started++;
+    }
+    if (started == 0) {
+        // Fall back to working on this thread
+        cloneWorkerMain(&workers[0]);
+    }
+    for (long i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Merge the per-thread candidates and bucket them by hash
+    size_t total = 0;
+    size_t nodes = 0;
+    for (long i = 0; i < threadCount; i++) {
+        total += workers[i].list.count;
+        nodes += workers[i].list.nodes;
+    }
+    CloneCandidate* items = (CloneCandidate*)malloc(sizeof(CloneCandidate) * (total > 0 ? total : 1));
+    CloneGroup* groups = (CloneGroup*)malloc(sizeof(CloneGroup) * (total > 0 ? total : 1));
+    if (items == NULL || groups == NULL) {
+        fprintf(stderr, "Not enough memory.\n");
+        return 1;
+    }
+    size_t offset = 0;
+    for (long i = 0; i < threadCount; i++) {
+        if (workers[i].list.count > 0) {
+            memcpy(items + offset, workers[i].list.items, sizeof(CloneCandidate) * workers[i].list.count);
+            offset += workers[i].list.count;
+        }
+        free(workers[i].list.items);
+    }
+    qsort(items, total, sizeof(CloneCandidate), compareCandidates);
+
+    size_t groupCount = 0;
+    for (size_t i = 0; i < total;) {
+        size_t end = i + 1;
+        while (end < total && items[end].hash == items[i].hash) end++;
+        CloneGroup group = {i, end - i, items[i].size};
+        if (group.count >= 2 && !isSubsumed(items, total, &group)) {
+            groups[groupCount++] = group;
+        }
+        i = end;
+    }
+    qsort(groups, groupCount, sizeof(CloneGroup), compareGroups);
+
+    for (size_t g = 0; g < groupCount; g++) {
+        printf("Clone group %zu: %zu occurrences of %u nodes\n", g + 1, groups[g].count, groups[g].size);
+        for (size_t i = groups[g].first; i < groups[g].first + groups[g].count; i++) {
+            printf("  %s:%d:%d-%d:%d\n", paths[items[i].file], items[i].firstLine, items[i].firstColumn,
+                   items[i].lastLine, items[i].lastColumn);
+        }
+    }
+    fprintf(stderr, "%d files, %zu nodes, %zu candidates, %zu clone groups\n",
+            pathCount, nodes, total, groupCount);
+
+    free(items);
+    free(groups);
+    free(workers);
+    free(threads);
+    if (ownsPaths) {
+        for (int i = 0; i < pathCount; i++) free(paths[i]);
+    }
+    free(paths);
+    return 0;
+}
@@ -0,0 +1,1186 @@
+#include <stdlib.h>
+#include <string.h>
+#include "compiler.h"
+
+// Operands are single bytes
+#define MAX_OPERAND 255
+
+// A variable of enclosing code whose value a block's closure holds
+typedef struct {
+    int scope;                  // Declaring scope, as an index in Compiler.scopes
+    int slot;
+} CopiedVariable;
+
+// A method or block being compiled
+typedef struct {
+    CompiledCode* code;
+    int capacity;               // Of code->bytecodes
+    int literalCapacity;
+    int stackDepth;
+    int slotCount;              // Frame slots in use, those of inlined blocks included
+    CopiedVariable* copied;     // Blocks: code->copiedCount of them
+    int copiedCapacity;
+    int usesEnvironment;        // Blocks: reach variables of the environment around them
+    int usesHome;               // Blocks: refer to the receiver or return with ^
+} CodeBuilder;
+
+// Variables of a method or block, in the code that holds them
+typedef struct {
+    CodeBuilder* builder;
+    int* locations;             // Per parameter then temporary: frame slot, or
+                                // environment slot when shared with blocks
+    const unsigned char* captured;
+    int variableCount;
+    int inlined;                // Block compiled into the code of the enclosing one
+} CompilerScope;
+
+typedef struct {
+    CompilerScope* scopes;
+    int scopeCount;
+    int scopeCapacity;
+    CompileError* error;
+    int failed;
+} Compiler;
+
+static void compileExpression(Compiler* compiler, ASTNode* node);
+static int compileStatements(Compiler* compiler, ASTNode** statements, int count, int inBlock, int keepLast);
+static int compileInlinedMessage(Compiler* compiler, ASTNode* message);
+
+static void fail(Compiler* compiler, const char* message, SourceSpan span) {
+    if (!compiler->failed && compiler->error != NULL) {
+        compiler->error->message = message;
+        compiler->error->span = span;
+    }
+    compiler->failed = 1;
+}
+
+static void outOfMemory(Compiler* compiler) {
+    SourceSpan none = {0, 0};
+    fail(compiler, "Not enough memory to compile.", none);
+}
+
+static CompilerScope* currentScope(Compiler* compiler) {
+    return &compiler->scopes[compiler->scopeCount - 1];
+}
+
+static CodeBuilder* currentBuilder(Compiler* compiler) {
+    return currentScope(compiler)->builder;
+}
+
+// Emitting
+
+static int appendByte(Compiler* compiler, CodeBuilder* builder, uint8_t byte) {
+    CompiledCode* code = builder->code;
+    if (code->length == builder->capacity) {
+        int capacity = builder->capacity < 32 ? 32 : builder->capacity * 2;
+        uint8_t* bytes = (uint8_t*)realloc(code->bytecodes, capacity);
+        if (bytes == NULL) {
+            outOfMemory(compiler);
+            return 0;
+        }
+        code->bytecodes = bytes;
+        builder->capacity = capacity;
+    }
+    code->bytecodes[code->length++] = byte;
+    return 1;
+}
+
+static void adjustStack(CodeBuilder* builder, int effect) {
+    builder->stackDepth += effect;
+    if (builder->stackDepth > builder->code->maxStack) builder->code->maxStack = builder->stackDepth;
+}
+
+// Emit an instruction whose operands fit its layout, and account for its
+// effect on the depth of the stack
+static void emit(Compiler* compiler, Bytecode opcode, int first, int second, int stackEffect) {
+    if (compiler->failed) return;
+    CodeBuilder* builder = currentBuilder(compiler);
+
+    if (!appendByte(compiler, builder, (uint8_t)opcode)) return;
+    switch (bytecodeOperands(opcode)) {
+        case OPERANDS_NONE:
+            break;
+        case OPERANDS_INDEX:
+        case OPERANDS_LITERAL:
+        case OPERANDS_SIGNED:
+            appendByte(compiler, builder, (uint8_t)first);
+            break;
+        case OPERANDS_OUTER:
+        case OPERANDS_SEND:
+            if (appendByte(compiler, builder, (uint8_t)first)) appendByte(compiler, builder, (uint8_t)second);
+            break;
+        case OPERANDS_JUMP:
+            if (appendByte(compiler, builder, (uint8_t)(first & 0xff))) {
+                appendByte(compiler, builder, (uint8_t)((first >> 8) & 0xff));
+            }
+            break;
+    }
+    adjustStack(builder, stackEffect);
+}
+
+static void emitIndexed(Compiler* compiler, Bytecode opcode, int index, int stackEffect,
+                        const char* tooMany, SourceSpan span) {
+    if (index > MAX_OPERAND) {
+        fail(compiler, tooMany, span);
+        return;
+    }
+    emit(compiler, opcode, index, 0, stackEffect);
+}
+
+// Emit a jump whose offset is filled in by patchJump once the code it skips
+// is compiled; answers the jump's position
+static int emitForwardJump(Compiler* compiler, Bytecode opcode, int stackEffect) {
+    int position = currentBuilder(compiler)->code->length;
+    emit(compiler, opcode, 0, 0, stackEffect);
+    return position;
+}
+
+// Make the jump at position land on the next instruction
+static void patchJump(Compiler* compiler, int position, SourceSpan span) {
+    if (compiler->failed) return;
+    CompiledCode* code = currentBuilder(compiler)->code;
+    int offset = code->length - (position + 3);
+    if (offset > INT16_MAX) {
+        fail(compiler, "Too much code to jump over.", span);
+        return;
+    }
+    code->bytecodes[position + 1] = (uint8_t)(offset & 0xff);
+    code->bytecodes[position + 2] = (uint8_t)((offset >> 8) & 0xff);
+}
+
+static void emitJumpBack(Compiler* compiler, int target, SourceSpan span) {
+    int offset = target - (currentBuilder(compiler)->code->length + 3);
+    if (offset < INT16_MIN) {
+        fail(compiler, "Too much code to jump over.", span);
+        return;
+    }
+    emit(compiler, BC_JUMP, offset, 0, 0);
+}
+
+// Literal frame
+
+static int literalsEqual(const Literal* a, const Literal* b) {
+    if (a->kind != b->kind) return 0;
+    switch (a->kind) {
+        case LITERAL_INTEGER:
+            return a->as.integer == b->as.integer;
+        case LITERAL_FLOAT:
+        case LITERAL_SCALED:
+            // Bitwise, so that 0.0 and -0.0 stay apart
+            return memcmp(&a->as.number.value, &b->as.number.value, sizeof(double)) == 0 &&
+                   a->as.number.scale == b->as.number.scale;
+        case LITERAL_CHARACTER:
+            return a->as.character == b->as.character;
+        case LITERAL_STRING:
+        case LITERAL_SYMBOL:
+        case LITERAL_BYTE_ARRAY:
+        case LITERAL_GLOBAL:
+            return a->as.text.length == b->as.text.length &&
+                   memcmp(a->as.text.bytes, b->as.text.bytes, (size_t)a->as.text.length) == 0;
+        case LITERAL_ARRAY:
+            if (a->as.array.count != b->as.array.count) return 0;
+            for (int i = 0; i < a->as.array.count; i++) {
+                if (!literalsEqual(&a->as.array.elements[i], &b->as.array.elements[i])) return 0;
+            }
+            return 1;
+        case LITERAL_BLOCK:
+            return a->as.block == b->as.block;
+        default:
+            return 1;
+    }
+}
+
+// Index of the literal in the current frame, which takes ownership of it;
+// an equal literal already there is reused and the new one freed
+static int addLiteral(Compiler* compiler, Literal* literal, SourceSpan span) {
+    CodeBuilder* builder = currentBuilder(compiler);
+    CompiledCode* code = builder->code;
+
+    for (int i = 0; i < code->literalCount; i++) {
+        if (literalsEqual(&code->literals[i], literal)) {
+            freeLiteral(literal);
+            return i;
+        }
+    }
+
+    if (code->literalCount > MAX_OPERAND) {
+        freeLiteral(literal);
+        fail(compiler, "Too many literals in one method or block.", span);
+        return -1;
+    }
+    if (code->literalCount == builder->literalCapacity) {
+        int capacity = builder->literalCapacity < 8 ? 8 : builder->literalCapacity * 2;
+        Literal* literals = (Literal*)realloc(code->literals, sizeof(Literal) * capacity);
+        if (literals == NULL) {
+            freeLiteral(literal);
+            outOfMemory(compiler);
+            return -1;
+        }
+        code->literals = literals;
+        builder->literalCapacity = capacity;
+    }
+    code->literals[code->literalCount] = *literal;
+    return code->literalCount++;
+}
+
+static int makeTextLiteral(Literal* literal, LiteralKind kind, const char* bytes, int length) {
+    literal->kind = kind;
+    literal->as.text.bytes = (char*)malloc((size_t)length + 1);
+    if (literal->as.text.bytes == NULL) return 0;
+    if (length > 0) memcpy(literal->as.text.bytes, bytes, (size_t)length);
+    literal->as.text.bytes[length] = '\0';
+    literal->as.text.length = length;
+    return 1;
+}
+
+static int textLiteralIndex(Compiler* compiler, LiteralKind kind, const char* text, SourceSpan span) {
+    Literal literal;
+    if (!makeTextLiteral(&literal, kind, text, (int)strlen(text))) {
+        outOfMemory(compiler);
+        return -1;
+    }
+    return addLiteral(compiler, &literal, span);
+}
+
+// Convert a literal node, array elements included. Answers 0 when out of memory.
+static int convertLiteral(ASTNode* node, Literal* literal) {
+    literal->kind = LITERAL_NIL;
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+            literal->kind = LITERAL_INTEGER;
+            literal->as.integer = ((ASTIntegerLiteral*)node)->value;
+            return 1;
+        case AST_LITERAL_FLOAT:
+            literal->kind = LITERAL_FLOAT;
+            literal->as.number.value = ((ASTFloatLiteral*)node)->value;
+            literal->as.number.scale = 0;
+            return 1;
+        case AST_LITERAL_SCALED:
+            literal->kind = LITERAL_SCALED;
+            literal->as.number.value = ((ASTScaledLiteral*)node)->value;
+            literal->as.number.scale = ((ASTScaledLiteral*)node)->scale;
+            return 1;
+        case AST_LITERAL_CHARACTER:
+            literal->kind = LITERAL_CHARACTER;
+            literal->as.character = (unsigned char)((ASTCharacterLiteral*)node)->value;
+            return 1;
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL: {
+            int length;
+            const char* text = literalText(node, &length);
+            return makeTextLiteral(literal, node->type == AST_LITERAL_STRING ? LITERAL_STRING : LITERAL_SYMBOL,
+                                   text, length);
+        }
+        case AST_LITERAL_BYTE_ARRAY: {
+            ASTByteArrayLiteral* bytes = (ASTByteArrayLiteral*)node;
+            return makeTextLiteral(literal, LITERAL_BYTE_ARRAY, (const char*)bytes->bytes, bytes->count);
+        }
+        case AST_CONSTANT: {
+            TokenType type = ((ASTConstantNode*)node)->type;
+            literal->kind = type == TOKEN_TRUE ? LITERAL_TRUE : type == TOKEN_FALSE ? LITERAL_FALSE : LITERAL_NIL;
+            return 1;
+        }
+        case AST_LITERAL_ARRAY: {
+            ASTArrayLiteral* array = (ASTArrayLiteral*)node;
+            Literal* elements = (Literal*)calloc(array->count > 0 ? array->count : 1, sizeof(Literal));
+            if (elements == NULL) return 0;
+            literal->kind = LITERAL_ARRAY;
+            literal->as.array.elements = elements;
+            literal->as.array.count = array->count;
+
+            for (int i = 0; i < array->count; i++) {
+                switch (array->packedKind) {
+                    case PACKED_INT64:
+                        elements[i].kind = LITERAL_INTEGER;
+                        elements[i].as.integer = ((long long*)array->packed)[i];
+                        break;
+                    case PACKED_BYTES:
+                        elements[i].kind = LITERAL_INTEGER;
+                        elements[i].as.integer = ((unsigned char*)array->packed)[i];
+                        break;
+                    case PACKED_DOUBLE:
+                        elements[i].kind = LITERAL_FLOAT;
+                        elements[i].as.number.value = ((double*)array->packed)[i];
+                        elements[i].as.number.scale = 0;
+                        break;
+                    case PACKED_NONE:
+                        if (!convertLiteral(array->elements[i], &elements[i])) {
+                            // Elements after i are still nil and free nothing
+                            freeLiteral(literal);
+                            return 0;
+                        }
+                        break;
+                }
+            }
+            return 1;
+        }
+        default:
+            return 1;
+    }
+}
+
+// Variables
+
+typedef enum {
+    IN_FRAME,
+    IN_ENVIRONMENT,
+    IN_CLOSURE
+} VariablePlace;
+
+// The blocks around the current code up to the method refer to its receiver
+// or its activation
+static void useHome(Compiler* compiler) {
+    for (int i = 0; i < compiler->scopeCount; i++) {
+        compiler->scopes[i].builder->usesHome = 1;
+    }
+}
+
+// Index of a variable among those copied into the closure of the current code
+static int copiedIndex(Compiler* compiler, int declaring, int slot) {
+    CodeBuilder* builder = currentBuilder(compiler);
+    CompiledCode* code = builder->code;
+    for (int i = 0; i < code->copiedCount; i++) {
+        if (builder->copied[i].scope == declaring && builder->copied[i].slot == slot) return i;
+    }
+    if (code->copiedCount == builder->copiedCapacity) {
+        int capacity = builder->copiedCapacity < 8 ? 8 : builder->copiedCapacity * 2;
+        CopiedVariable* copied = (CopiedVariable*)realloc(builder->copied, sizeof(CopiedVariable) * capacity);
+        if (copied == NULL) {
+            outOfMemory(compiler);
+            return 0;
+        }
+        builder->copied = copied;
+        builder->copiedCapacity = capacity;
+    }
+    CopiedVariable variable = {declaring, slot};
+    builder->copied[code->copiedCount] = variable;
+    return code->copiedCount++;
+}
+
+// Where an argument or temporary of the declaring scope lives, as seen from
+// the current scope. Hops counts the environments to walk outwards.
+static VariablePlace locateVariable(Compiler* compiler, int declaring, int slot, int* location, int* hops) {
+    CompilerScope* scope = &compiler->scopes[declaring];
+    *location = scope->locations[slot];
+    *hops = 0;
+    if (scope->captured[slot] == CAPTURE_COPIED && currentBuilder(compiler) != scope->builder) {
+        *location = copiedIndex(compiler, declaring, slot);
+        return IN_CLOSURE;
+    }
+    if (scope->captured[slot] != CAPTURE_SHARED) return IN_FRAME;
+
+    // Count the environments between the current code and the declaring one;
+    // inlined blocks share the environment of the code they are inlined into
+    for (int i = declaring + 1; i < compiler->scopeCount; i++) {
+        CompilerScope* between = &compiler->scopes[i];
+        if (between->inlined) continue;
+        between->builder->usesEnvironment = 1;
+        if (between->builder->code->environmentSize > 0) (*hops)++;
+    }
+    return IN_ENVIRONMENT;
+}
+
+static void pushVariable(Compiler* compiler, int declaring, int slot, SourceSpan span) {
+    int location, hops;
+    switch (locateVariable(compiler, declaring, slot, &location, &hops)) {
+        case IN_FRAME:
+            emitIndexed(compiler, BC_PUSH_TEMP, location, 1, "Too many temporaries.", span);
+            break;
+        case IN_CLOSURE:
+            emitIndexed(compiler, BC_PUSH_COPIED, location, 1, "Too many copied variables.", span);
+            break;
+        case IN_ENVIRONMENT:
+            if (location > MAX_OPERAND || hops > MAX_OPERAND) {
+                fail(compiler, "Too many captured variables.", span);
+            } else {
+                emit(compiler, BC_PUSH_OUTER, location, hops, 1);
+            }
+            break;
+    }
+}
+
+static void compileVariable(Compiler* compiler, ASTVariableNode* node) {
+    VariableBinding binding = node->binding;
+    SourceSpan span = node->base.span;
+
+    switch (binding.kind) {
+        case VAR_ARGUMENT:
+        case VAR_TEMPORARY:
+            pushVariable(compiler, compiler->scopeCount - 1 - binding.depth, binding.slot, span);
+            break;
+        case VAR_INSTANCE:
+            useHome(compiler);
+            emitIndexed(compiler, BC_PUSH_INST, binding.slot, 1, "Too many instance variables.", span);
+            break;
+        case VAR_GLOBAL: {
+            int index = textLiteralIndex(compiler, LITERAL_GLOBAL, node->name, span);
+            if (index >= 0) emit(compiler, BC_PUSH_GLOBAL, index, 0, 1);
+            break;
+        }
+        case VAR_PSEUDO:
+            useHome(compiler);
+            emit(compiler, binding.slot == PSEUDO_THIS_CONTEXT ? BC_PUSH_THIS_CONTEXT : BC_PUSH_SELF, 0, 0, 1);
+            break;
+        default:
+            fail(compiler, "Unresolved variable.", span);
+            break;
+    }
+}
+
+// Store the value on top of the stack, popping it when keepValue is 0
+static void compileAssignment(Compiler* compiler, ASTAssignmentNode* node, int keepValue) {
+    VariableBinding binding = node->binding;
+    SourceSpan span = node->base.span;
+    int popEffect = keepValue ? 0 : -1;
+
+    compileExpression(compiler, node->value);
+
+    switch (binding.kind) {
+        case VAR_TEMPORARY: {
+            // Only the declaring code stores into a copied variable
+            int location, hops;
+            VariablePlace place =
+                locateVariable(compiler, compiler->scopeCount - 1 - binding.depth, binding.slot, &location, &hops);
+            if (place == IN_FRAME) {
+                emitIndexed(compiler, keepValue ? BC_STORE_TEMP : BC_POP_STORE_TEMP, location, popEffect,
+                            "Too many temporaries.", span);
+            } else if (place == IN_CLOSURE) {
+                fail(compiler, "Cannot store into a copied variable.", span);
+            } else if (location > MAX_OPERAND || hops > MAX_OPERAND) {
+                fail(compiler, "Too many captured variables.", span);
+            } else {
+                emit(compiler, keepValue ? BC_STORE_OUTER : BC_POP_STORE_OUTER, location, hops, popEffect);
+            }
+            break;
+        }
+        case VAR_INSTANCE:
+            useHome(compiler);
+            emitIndexed(compiler, keepValue ? BC_STORE_INST : BC_POP_STORE_INST, binding.slot, popEffect,
+                        "Too many instance variables.", span);
+            break;
+        case VAR_GLOBAL: {
+            int index = textLiteralIndex(compiler, LITERAL_GLOBAL, node->variable, span);
+            if (index >= 0) emit(compiler, keepValue ? BC_STORE_GLOBAL : BC_POP_STORE_GLOBAL, index, 0, popEffect);
+            break;
+        }
+        case VAR_ARGUMENT:
+            fail(compiler, "Cannot store into an argument.", span);
+            break;
+        default:
+            fail(compiler, "Cannot store into this variable.", span);
+            break;
+    }
+}
+
+// Messages
+
+static int isSuper(ASTNode* node) {
+    return node != NULL && node->type == AST_VARIABLE &&
+           ((ASTVariableNode*)node)->binding.kind == VAR_PSEUDO &&
+           ((ASTVariableNode*)node)->binding.slot == PSEUDO_SUPER;
+}
+
+// Compile the arguments of a message whose receiver is already on the stack, and send it
+static void compileSend(Compiler* compiler, ASTNode* message, int toSuper) {
+    const char* selector = NULL;
+    int argumentCount = 0;
+
+    switch (message->type) {
+        case AST_MESSAGE_UNARY:
+            selector = ((ASTUnaryMessageNode*)message)->selector;
+            break;
+        case AST_MESSAGE_BINARY:
+            selector = ((ASTBinaryMessageNode*)message)->message.selector;
+            compileExpression(compiler, ((ASTBinaryMessageNode*)message)->argument);
+            argumentCount = 1;
+            break;
+        case AST_MESSAGE_KEYWORD: {
+            ASTKeywordMessageNode* keyword = (ASTKeywordMessageNode*)message;
+            selector = keyword->message.selector;
+            argumentCount = keyword->argumentCount;
+            for (int i = 0; i < keyword->argumentCount; i++) {
+                compileExpression(compiler, keyword->arguments[i]);
+            }
+            break;
+        }
+        default:
+            fail(compiler, "Expected a message.", message->span);
+            return;
+    }
+
+    int special = toSuper ? -1 : findSpecialSelector(selector);
+    if (special >= 0) {
+        emit(compiler, (Bytecode)(FIRST_SPECIAL_SEND + special), 0, 0, -argumentCount);
+        return;
+    }
+    if (argumentCount > MAX_OPERAND) {
+        fail(compiler, "Too many arguments.", message->span);
+        return;
+    }
+    int index = textLiteralIndex(compiler, LITERAL_SYMBOL, selector, message->span);
+    if (index >= 0) emit(compiler, toSuper ? BC_SUPER_SEND : BC_SEND, index, argumentCount, -argumentCount);
+}
+
+static ASTNode* messageReceiver(ASTNode* message) {
+    return isMessageNode(message) ? ((ASTMessageNode*)message)->receiver : NULL;
+}
+
+static void compileMessage(Compiler* compiler, ASTNode* message) {
+    if (compileInlinedMessage(compiler, message)) return;
+    ASTNode* receiver = messageReceiver(message);
+    compileExpression(compiler, receiver);
+    compileSend(compiler, message, isSuper(receiver));
+}
+
+// The receiver is evaluated once and duplicated for every message but the
+// last; the value of a cascade is that of its last message
+static void compileCascade(Compiler* compiler, ASTCascadeNode* node) {
+    compileExpression(compiler, node->receiver);
+    int toSuper = isSuper(node->receiver);
+
+    for (int i = 0; i < node->messageCount; i++) {
+        int last = i == node->messageCount - 1;
+        if (!last) emit(compiler, BC_DUP, 0, 0, 1);
+        compileSend(compiler, node->messages[i], toSuper);
+        if (!last) emit(compiler, BC_POP, 0, 0, -1);
+    }
+}
+
+// Methods and blocks
+
+static int reserveScope(Compiler* compiler) {
+    if (compiler->scopeCount == compiler->scopeCapacity) {
+        int capacity = compiler->scopeCapacity < 8 ? 8 : compiler->scopeCapacity * 2;
+        CompilerScope* scopes = (CompilerScope*)realloc(compiler->scopes, sizeof(CompilerScope) * capacity);
+        if (scopes == NULL) return 0;
+        compiler->scopes = scopes;
+        compiler->scopeCapacity = capacity;
+    }
+    return 1;
+}
+
+static int pushScope(Compiler* compiler, CodeBuilder* builder, const unsigned char* captured,
+                     int parameterCount, int temporaryCount) {
+    if (!reserveScope(compiler)) return 0;
+
+    int count = parameterCount + temporaryCount;
+    int* locations = (int*)malloc(sizeof(int) * (count > 0 ? count : 1));
+    if (locations == NULL) return 0;
+
+    // Shared variables move to the environment; the others keep their slots
+    CompiledCode* code = builder->code;
+    code->argumentCount = parameterCount;
+    code->temporaryCount = temporaryCount;
+    builder->slotCount = count;
+    for (int i = 0; i < count; i++) {
+        locations[i] = captured[i] == CAPTURE_SHARED ? code->environmentSize++ : i;
+    }
+
+    CompilerScope* scope = &compiler->scopes[compiler->scopeCount++];
+    scope->builder = builder;
+    scope->locations = locations;
+    scope->captured = captured;
+    scope->variableCount = count;
+    scope->inlined = 0;
+    return 1;
+}
+
+// A frame slot of the current code, for a value the code keeps aside such as
+// a loop limit; slots are released in the reverse order
+static int reserveSlot(Compiler* compiler) {
+    CodeBuilder* builder = currentBuilder(compiler);
+    CompiledCode* code = builder->code;
+    int slot = builder->slotCount++;
+    if (builder->slotCount - code->argumentCount > code->temporaryCount) {
+        code->temporaryCount = builder->slotCount - code->argumentCount;
+    }
+    return slot;
+}
+
+static void releaseSlots(Compiler* compiler, int count) {
+    currentBuilder(compiler)->slotCount -= count;
+}
+
+// The variables of an inlined block take frame slots of the code it is
+// inlined into
+static int pushInlinedScope(Compiler* compiler, ASTBlockNode* node) {
+    int count = node->parameterCount + node->temporaryCount;
+    int* locations = (int*)malloc(sizeof(int) * (count > 0 ? count : 1));
+    if (locations == NULL || !reserveScope(compiler)) {
+        free(locations);
+        outOfMemory(compiler);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) locations[i] = reserveSlot(compiler);
+
+    CompilerScope* scope = &compiler->scopes[compiler->scopeCount];
+    scope->builder = currentBuilder(compiler);
+    scope->locations = locations;
+    scope->captured = node->captured;
+    scope->variableCount = count;
+    scope->inlined = 1;
+    compiler->scopeCount++;
+    return 1;
+}
+
+static void popScope(Compiler* compiler) {
+    CompilerScope* scope = &compiler->scopes[--compiler->scopeCount];
+    if (scope->inlined) scope->builder->slotCount -= scope->variableCount;
+    free(scope->locations);
+}
+
+static CompiledCode* newCode(void) {
+    return (CompiledCode*)calloc(1, sizeof(CompiledCode));
+}
+
+// Copy the arguments that blocks share into the environment
+static void compilePrologue(Compiler* compiler, int parameterCount) {
+    CompilerScope* scope = currentScope(compiler);
+    for (int i = 0; i < parameterCount; i++) {
+        if (scope->captured[i] != CAPTURE_SHARED) continue;
+        emit(compiler, BC_PUSH_TEMP, i, 0, 1);
+        emit(compiler, BC_POP_STORE_OUTER, scope->locations[i], 0, -1);
+    }
+}
+
+// Statements of a method, block or doit. Answers 1 if the last one returns,
+// leaving nothing to compile after it; otherwise the value of the last
+// statement is left on the stack (nil when there is none) if keepLast is set.
+static int compileStatements(Compiler* compiler, ASTNode** statements, int count, int inBlock, int keepLast) {
+    for (int i = 0; i < count && !compiler->failed; i++) {
+        ASTNode* statement = statements[i];
+        int last = i == count - 1;
+
+        if (statement->type == AST_RETURN) {
+            compileExpression(compiler, ((ASTReturnNode*)statement)->expression);
+            if (inBlock) useHome(compiler);
+            emit(compiler, inBlock ? BC_NON_LOCAL_RETURN : BC_RETURN_TOP, 0, 0, -1);
+            return 1;    // Anything after a return is unreachable
+        }
+        if (last && keepLast) {
+            compileExpression(compiler, statement);
+        } else if (statement->type == AST_ASSIGNMENT) {
+            compileAssignment(compiler, (ASTAssignmentNode*)statement, 0);
+        } else {
+            compileExpression(compiler, statement);
+            emit(compiler, BC_POP, 0, 0, -1);
+        }
+    }
+    if (count == 0 && keepLast) emit(compiler, BC_PUSH_NIL, 0, 0, 1);
+    return 0;
+}
+
+// A clean block is a literal closure. The code making any other pushes the
+// values its closure copies, then PUSH_BLOCK.
+static void compileBlock(Compiler* compiler, ASTBlockNode* node) {
+    SourceSpan span = node->base.span;
+    CodeBuilder builder = {newCode(), 0, 0, 0, 0, NULL, 0, 0, 0};
+    if (builder.code == NULL || node->captured == NULL ||
+        !pushScope(compiler, &builder, node->captured, node->parameterCount, node->temporaryCount)) {
+        freeCompiledCode(builder.code);
+        if (node->captured == NULL) fail(compiler, "Unresolved block.", span);
+        else outOfMemory(compiler);
+        return;
+    }
+    builder.code->isBlock = 1;
+
+    compilePrologue(compiler, node->parameterCount);
+    if (!compileStatements(compiler, node->statements, node->statementCount, 1, 1)) {
+        emit(compiler, BC_BLOCK_RETURN, 0, 0, -1);
+    }
+    popScope(compiler);
+
+    CompiledCode* code = builder.code;
+    if (builder.usesEnvironment) {
+        code->kind = BLOCK_FULL;
+    } else if (builder.usesHome || code->copiedCount > 0) {
+        code->kind = BLOCK_COPYING;
+    } else {
+        code->kind = BLOCK_CLEAN;
+    }
+    if (code->copiedCount > MAX_OPERAND) fail(compiler, "Too many copied variables.", span);
+    for (int i = 0; i < code->copiedCount && !compiler->failed; i++) {
+        pushVariable(compiler, builder.copied[i].scope, builder.copied[i].slot, span);
+    }
+    free(builder.copied);
+
+    Literal literal;
+    literal.kind = LITERAL_BLOCK;
+    literal.as.block = code;
+    if (compiler->failed) {
+        freeLiteral(&literal);
+        return;
+    }
+    int index = addLiteral(compiler, &literal, span);
+    if (index < 0) return;
+    if (code->kind == BLOCK_CLEAN) {
+        emit(compiler, BC_PUSH_LITERAL, index, 0, 1);
+    } else {
+        emit(compiler, BC_PUSH_BLOCK, index, 0, 1 - code->copiedCount);
+    }
+}
+
+// Inlined control structures
+//
+// Conditionals, loops, and: and or: with literal blocks as arguments compile
+// to jumps around and back over the statements of the blocks, so they make no
+// closures and send nothing. The blocks' variables take frame slots of the
+// enclosing code; resolveScopes inlines no block whose variables are captured.
+
+// Statements of an inlined block whose scope is pushed. With keepValue set
+// the block's value is left on the stack; a ^ returns from the code the block
+// is inlined into.
+static void compileInlinedStatements(Compiler* compiler, ASTBlockNode* node, int keepValue) {
+    // Temporaries start out nil each time, as in a block of its own
+    CompilerScope* scope = currentScope(compiler);
+    for (int i = node->parameterCount; i < scope->variableCount; i++) {
+        emit(compiler, BC_PUSH_NIL, 0, 0, 1);
+        emitIndexed(compiler, BC_POP_STORE_TEMP, scope->locations[i], -1, "Too many temporaries.", node->base.span);
+    }
+    int inBlock = currentBuilder(compiler)->code->isBlock;
+    if (compileStatements(compiler, node->statements, node->statementCount, inBlock, keepValue) && keepValue) {
+        // Nothing follows the return; account for the value a fall through would leave
+        adjustStack(currentBuilder(compiler), 1);
+    }
+}
+
+static void compileInlinedBlock(Compiler* compiler, ASTNode* node, int keepValue) {
+    ASTBlockNode* block = (ASTBlockNode*)node;
+    if (!pushInlinedScope(compiler, block)) return;
+    compileInlinedStatements(compiler, block, keepValue);
+    popScope(compiler);
+}
+
+// With the receiver on the stack: take the first block unless the receiver
+// is the Boolean that skip jumps on, otherwise the second block, or push
+// otherwise when there is none
+static void compileBranches(Compiler* compiler, Bytecode skip, ASTNode* first, ASTNode* second,
+                            Bytecode otherwise, SourceSpan span) {
+    int skipJump = emitForwardJump(compiler, skip, -1);
+    compileInlinedBlock(compiler, first, 1);
+    int endJump = emitForwardJump(compiler, BC_JUMP, 0);
+    adjustStack(currentBuilder(compiler), -1);    // The branches leave one value between them
+    patchJump(compiler, skipJump, span);
+    if (second != NULL) {
+        compileInlinedBlock(compiler, second, 1);
+    } else {
+        emit(compiler, otherwise, 0, 0, 1);
+    }
+    patchJump(compiler, endJump, span);
+}
+
+// [condition] whileTrue: [body], and the variants; answers nil
+static void compileWhileLoop(Compiler* compiler, ASTNode* condition, ASTNode* body, Bytecode exit,
+                             SourceSpan span) {
+    int start = currentBuilder(compiler)->code->length;
+    compileInlinedBlock(compiler, condition, 1);
+    int exitJump = emitForwardJump(compiler, exit, -1);
+    if (body != NULL) compileInlinedBlock(compiler, body, 0);
+    emitJumpBack(compiler, start, span);
+    patchJump(compiler, exitJump, span);
+    emit(compiler, BC_PUSH_NIL, 0, 0, 1);
+}
+
+// Count the slot counter up by step to the limit in slot limit, comparing
+// with test, running the statements of body each time; answers nil
+static void compileCountingLoop(Compiler* compiler, int counter, int limit, ASTNode* step, Bytecode test,
+                                ASTBlockNode* body, SourceSpan span) {
+    int start = currentBuilder(compiler)->code->length;
+    emit(compiler, BC_PUSH_TEMP, counter, 0, 1);
+    emit(compiler, BC_PUSH_TEMP, limit, 0, 1);
+    emit(compiler, test, 0, 0, -1);
+    int exitJump = emitForwardJump(compiler, BC_JUMP_IF_FALSE, -1);
+    compileInlinedStatements(compiler, body, 0);
+    emit(compiler, BC_PUSH_TEMP, counter, 0, 1);
+    if (step != NULL) {
+        compileExpression(compiler, step);
+    } else {
+        emit(compiler, BC_PUSH_INTEGER, 1, 0, 1);
+    }
+    emit(compiler, BC_SEND_ADD, 0, 0, -1);
+    emit(compiler, BC_POP_STORE_TEMP, counter, 0, -1);
+    emitJumpBack(compiler, start, span);
+    patchJump(compiler, exitJump, span);
+    emit(compiler, BC_PUSH_NIL, 0, 0, 1);
+}
+
+// start to: stop [by: step] do: [:each | ...], with a literal integer step;
+// start and stop are evaluated once, before the loop
+static void compileToDo(Compiler* compiler, ASTKeywordMessageNode* node, ASTNode* step, ASTNode* body) {
+    ASTBlockNode* block = (ASTBlockNode*)body;
+    SourceSpan span = node->message.base.span;
+    compileExpression(compiler, node->message.receiver);
+    compileExpression(compiler, node->arguments[0]);
+    if (!pushInlinedScope(compiler, block)) return;
+    int counter = currentScope(compiler)->locations[0];
+    int limit = reserveSlot(compiler);
+    emitIndexed(compiler, BC_POP_STORE_TEMP, limit, -1, "Too many temporaries.", span);
+    emitIndexed(compiler, BC_POP_STORE_TEMP, counter, -1, "Too many temporaries.", span);
+    if (limit <= MAX_OPERAND) {
+        int descending = step != NULL && ((ASTIntegerLiteral*)step)->value < 0;
+        compileCountingLoop(compiler, counter, limit, step, descending ? BC_SEND_GREATER_EQUAL : BC_SEND_LESS_EQUAL,
+                            block, span);
+    }
+    releaseSlots(compiler, 1);
+    popScope(compiler);
+}
+
+// count timesRepeat: [...], counting from 1 to count
+static void compileTimesRepeat(Compiler* compiler, ASTKeywordMessageNode* node) {
+    ASTBlockNode* block = (ASTBlockNode*)node->arguments[0];
+    SourceSpan span = node->message.base.span;
+    compileExpression(compiler, node->message.receiver);
+    int limit = reserveSlot(compiler);
+    int counter = reserveSlot(compiler);
+    emitIndexed(compiler, BC_POP_STORE_TEMP, limit, -1, "Too many temporaries.", span);
+    emit(compiler, BC_PUSH_INTEGER, 1, 0, 1);
+    emitIndexed(compiler, BC_POP_STORE_TEMP, counter, -1, "Too many temporaries.", span);
+    if (counter <= MAX_OPERAND && pushInlinedScope(compiler, block)) {
+        compileCountingLoop(compiler, counter, limit, NULL, BC_SEND_LESS_EQUAL, block, span);
+        popScope(compiler);
+    }
+    releaseSlots(compiler, 2);
+}
+
+// Compile the message in line if it is a control structure whose blocks
+// resolveScopes flagged as inlined; answers 0, having compiled nothing, for
+// any other message
+static int compileInlinedMessage(Compiler* compiler, ASTNode* message) {
+    ASTBlockNode* blocks[2];
+    if (controlStructureBlocks(message, blocks) == 0 || !blocks[0]->inlined) return 0;
+    ASTNode* receiver = messageReceiver(message);
+    SourceSpan span = message->span;
+
+    if (message->type == AST_MESSAGE_UNARY) {
+        int whileTrue = strcmp(((ASTUnaryMessageNode*)message)->selector, "whileTrue") == 0;
+        compileWhileLoop(compiler, receiver, NULL, whileTrue ? BC_JUMP_IF_FALSE : BC_JUMP_IF_TRUE, span);
+        return 1;
+    }
+
+    ASTKeywordMessageNode* node = (ASTKeywordMessageNode*)message;
+    const char* selector = node->message.selector;
+    ASTNode** arguments = node->arguments;
+    if (strcmp(selector, "whileTrue:") == 0 || strcmp(selector, "whileFalse:") == 0) {
+        int whileTrue = strcmp(selector, "whileTrue:") == 0;
+        compileWhileLoop(compiler, receiver, arguments[0], whileTrue ? BC_JUMP_IF_FALSE : BC_JUMP_IF_TRUE, span);
+    } else if (strcmp(selector, "timesRepeat:") == 0) {
+        compileTimesRepeat(compiler, node);
+    } else if (strcmp(selector, "to:do:") == 0) {
+        compileToDo(compiler, node, NULL, arguments[1]);
+    } else if (strcmp(selector, "to:by:do:") == 0) {
+        compileToDo(compiler, node, arguments[1], arguments[2]);
+    } else {
+        int ifTrue = strcmp(selector, "ifTrue:") == 0 || strcmp(selector, "ifTrue:ifFalse:") == 0 ||
+                     strcmp(selector, "and:") == 0;
+        Bytecode otherwise = strcmp(selector, "and:") == 0  ? BC_PUSH_FALSE
+                             : strcmp(selector, "or:") == 0 ? BC_PUSH_TRUE
+                                                            : BC_PUSH_NIL;
+        compileExpression(compiler, receiver);
+        compileBranches(compiler, ifTrue ? BC_JUMP_IF_FALSE : BC_JUMP_IF_TRUE, arguments[0],
+                        node->argumentCount == 2 ? arguments[1] : NULL, otherwise, span);
+    }
+    return 1;
+}
+
+static void compileArrayExpression(Compiler* compiler, ASTArrayExpressionNode* node) {
+    if (node->count > MAX_OPERAND) {
+        fail(compiler, "Too many elements in a brace array.", node->base.span);
+        return;
+    }
+    for (int i = 0; i < node->count; i++) {
+        compileExpression(compiler, node->expressions[i]);
+    }
+    emit(compiler, BC_MAKE_ARRAY, node->count, 0, 1 - node->count);
+}
+
+// Push a converted literal, which the literal frame takes over
+static void emitLiteral(Compiler* compiler, Literal* literal, SourceSpan span) {
+    switch (literal->kind) {
+        case LITERAL_NIL:
+        case LITERAL_TRUE:
+        case LITERAL_FALSE:
+            emit(compiler, literal->kind == LITERAL_TRUE ? BC_PUSH_TRUE : literal->kind == LITERAL_FALSE ? BC_PUSH_FALSE
+                                                                                                       : BC_PUSH_NIL,
+                 0, 0, 1);
+            return;
+        case LITERAL_INTEGER:
+            if (literal->as.integer >= -128 && literal->as.integer <= 127) {
+                emit(compiler, BC_PUSH_INTEGER, (int)literal->as.integer, 0, 1);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    int index = addLiteral(compiler, literal, span);
+    if (index >= 0) emit(compiler, BC_PUSH_LITERAL, index, 0, 1);
+}
+
+static void compileLiteral(Compiler* compiler, ASTNode* node) {
+    Literal literal;
+    if (!convertLiteral(node, &literal)) {
+        outOfMemory(compiler);
+        return;
+    }
+    emitLiteral(compiler, &literal, node->span);
+}
+
+// Constant folding
+//
+// Arithmetic and comparisons whose operands are number literals, or folded
+// themselves, are computed here as the primitives would compute them. What
+// the primitives would refuse, such as an overflow or a division with a
+// remainder, is left to the methods at run time.
+
+static int foldConstant(ASTNode* node, Literal* value);
+
+static int foldIntegers(const char* selector, long long left, long long right, Literal* value) {
+    long long result;
+    int comparison = -1;
+    if (strcmp(selector, "+") == 0) {
+        if (__builtin_saddll_overflow(left, right, &result)) return 0;
+    } else if (strcmp(selector, "-") == 0) {
+        if (__builtin_ssubll_overflow(left, right, &result)) return 0;
+    } else if (strcmp(selector, "*") == 0) {
+        if (__builtin_smulll_overflow(left, right, &result)) return 0;
+    } else if (strcmp(selector, "/") == 0 || strcmp(selector, "//") == 0 || strcmp(selector, "\\\\") == 0) {
+        if (right == 0 || (right == -1 && left == INT64_MIN)) return 0;
+        long long quotient = left / right;
+        long long remainder = left % right;
+        if (selector[0] == '/' && selector[1] == '\0') {
+            if (remainder != 0) return 0;
+            result = quotient;
+        } else {
+            // Rounded towards negative infinity
+            int roundDown = remainder != 0 && (remainder < 0) != (right < 0);
+            result = selector[0] == '/' ? quotient - roundDown : remainder + (roundDown ? right : 0);
+        }
+    } else if (strcmp(selector, "bitAnd:") == 0) {
+        result = left & right;
+    } else if (strcmp(selector, "bitOr:") == 0) {
+        result = left | right;
+    } else if (strcmp(selector, "bitXor:") == 0) {
+        result = left ^ right;
+    } else if (strcmp(selector, "<") == 0) {
+        comparison = left < right;
+    } else if (strcmp(selector, ">") == 0) {
+        comparison = left > right;
+    } else if (strcmp(selector, "<=") == 0) {
+        comparison = left <= right;
+    } else if (strcmp(selector, ">=") == 0) {
+        comparison = left >= right;
+    } else if (strcmp(selector, "=") == 0) {
+        comparison = left == right;
+    } else if (strcmp(selector, "~=") == 0) {
+        comparison = left != right;
+    } else {
+        return 0;
+    }
+
+    if (comparison >= 0) {
+        value->kind = comparison ? LITERAL_TRUE : LITERAL_FALSE;
+    } else {
+        value->kind = LITERAL_INTEGER;
+        value->as.integer = result;
+    }
+    return 1;
+}
+
+static int foldFloats(const char* selector, double left, double right, Literal* value) {
+    int comparison = -1;
+    value->kind = LITERAL_FLOAT;
+    value->as.number.scale = 0;
+    if (strcmp(selector, "+") == 0) {
+        value->as.number.value = left + right;
+    } else if (strcmp(selector, "-") == 0) {
+        value->as.number.value = left - right;
+    } else if (strcmp(selector, "*") == 0) {
+        value->as.number.value = left * right;
+    } else if (strcmp(selector, "<") == 0) {
+        comparison = left < right;
+    } else if (strcmp(selector, ">") == 0) {
+        comparison = left > right;
+    } else if (strcmp(selector, "<=") == 0) {
+        comparison = left <= right;
+    } else if (strcmp(selector, ">=") == 0) {
+        comparison = left >= right;
+    } else if (strcmp(selector, "=") == 0) {
+        comparison = left == right;
+    } else if (strcmp(selector, "~=") == 0) {
+        comparison = left != right;
+    } else {
+        return 0;
+    }
+    if (comparison >= 0) value->kind = comparison ? LITERAL_TRUE : LITERAL_FALSE;
+    return 1;
+}
+
+static int foldOperation(const char* selector, ASTNode* receiver, ASTNode* argument, Literal* value) {
+    Literal left, right;
+    if (!foldConstant(receiver, &left) || !foldConstant(argument, &right)) return 0;
+    if (left.kind == LITERAL_INTEGER && right.kind == LITERAL_INTEGER) {
+        return foldIntegers(selector, left.as.integer, right.as.integer, value);
+    }
+    if ((left.kind != LITERAL_INTEGER && left.kind != LITERAL_FLOAT) ||
+        (right.kind != LITERAL_INTEGER && right.kind != LITERAL_FLOAT)) {
+        return 0;
+    }
+    // Mixed operands are computed in floating point
+    return foldFloats(selector,
+                      left.kind == LITERAL_FLOAT ? left.as.number.value : (double)left.as.integer,
+                      right.kind == LITERAL_FLOAT ? right.as.number.value : (double)right.as.integer, value);
+}
+
+// The value of a constant expression as an integer, float or Boolean literal;
+// answers 0 for anything else
+static int foldConstant(ASTNode* node, Literal* value) {
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+        case AST_LITERAL_FLOAT:
+            return convertLiteral(node, value);
+        case AST_MESSAGE_BINARY: {
+            ASTBinaryMessageNode* binary = (ASTBinaryMessageNode*)node;
+            return foldOperation(binary->message.selector, binary->message.receiver, binary->argument, value);
+        }
+        case AST_MESSAGE_KEYWORD: {
+            ASTKeywordMessageNode* keyword = (ASTKeywordMessageNode*)node;
+            return keyword->argumentCount == 1 &&
+                   foldOperation(keyword->message.selector, keyword->message.receiver, keyword->arguments[0], value);
+        }
+        default:
+            return 0;
+    }
+}
+
+static void compileExpression(Compiler* compiler, ASTNode* node) {
+    if (compiler->failed) return;
+
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_SCALED:
+        case AST_LITERAL_CHARACTER:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL:
+        case AST_LITERAL_ARRAY:
+        case AST_LITERAL_BYTE_ARRAY:
+            compileLiteral(compiler, node);
+            break;
+        case AST_CONSTANT:
+            compileLiteral(compiler, node);
+            break;
+        case AST_VARIABLE:
+            compileVariable(compiler, (ASTVariableNode*)node);
+            break;
+        case AST_ASSIGNMENT:
+            compileAssignment(compiler, (ASTAssignmentNode*)node, 1);
+            break;
+        case AST_MESSAGE_UNARY:
+            compileMessage(compiler, node);
+            break;
+        case AST_MESSAGE_BINARY:
+        case AST_MESSAGE_KEYWORD: {
+            Literal folded;
+            if (foldConstant(node, &folded)) {
+                emitLiteral(compiler, &folded, node->span);
+            } else {
+                compileMessage(compiler, node);
+            }
+            break;
+        }
+        case AST_CASCADE:
+            compileCascade(compiler, (ASTCascadeNode*)node);
+            break;
+        case AST_BLOCK:
+            compileBlock(compiler, (ASTBlockNode*)node);
+            break;
+        case AST_ARRAY_EXPRESSION:
+            compileArrayExpression(compiler, (ASTArrayExpressionNode*)node);
+            break;
+        default:
+            fail(compiler, "Unexpected node in an expression.", node->span);
+            break;
+    }
+}
+
+// Turn the problems that make code uncompilable into errors, and pass the
+// others on to the caller's handler
+typedef struct {
+    Compiler* compiler;
+    const ScopeOptions* options;
+} ProblemRelay;
+
+static void relayProblem(const ScopeProblem* problem, void* context) {
+    ProblemRelay* relay = (ProblemRelay*)context;
+    if (problem->kind == SCOPE_DUPLICATE) {
+        fail(relay->compiler, "Variable declared twice.", problem->span);
+    } else if (problem->kind == SCOPE_STORE_INTO_ARGUMENT) {
+        fail(relay->compiler, "Cannot store into an argument.", problem->span);
+    } else if (relay->options != NULL && relay->options->report != NULL) {
+        relay->options->report(problem, relay->options->context);
+    }
+}
+
+CompiledCode* compileAST(ASTNode* root, const ScopeOptions* options, CompileError* error) {
+    Compiler compiler;
+    memset(&compiler, 0, sizeof(compiler));
+    compiler.error = error;
+    if (error != NULL) error->message = NULL;
+
+    ProblemRelay relay = {&compiler, options};
+    ScopeOptions resolving = {NULL, 0, relayProblem, &relay};
+    if (options != NULL) {
+        resolving.instanceVariables = options->instanceVariables;
+        resolving.instanceVariableCount = options->instanceVariableCount;
+    }
+    if (root == NULL || (root->type != AST_METHOD && root->type != AST_BLOCK)) {
+        fail(&compiler, "Expected a method or top-level code.", root != NULL ? root->span : (SourceSpan){0, 0});
+        return NULL;
+    }
+    if (resolveScopes(root, &resolving) < 0) {
+        outOfMemory(&compiler);
+        return NULL;
+    }
+    if (compiler.failed) return NULL;
+
+    CodeBuilder builder = {newCode(), 0, 0, 0, 0, NULL, 0, 0, 0};
+    if (builder.code == NULL) {
+        outOfMemory(&compiler);
+        return NULL;
+    }
+
+    if (root->type == AST_METHOD) {
+        ASTMethodNode* method = (ASTMethodNode*)root;
+        builder.code->selector = strdup(method->selector);
+        builder.code->primitive = method->isPrimitive ? method->primitiveNumber : 0;
+        if (builder.code->selector == NULL ||
+            !pushScope(&compiler, &builder, method->captured, method->parameterCount, method->temporaryCount)) {
+            outOfMemory(&compiler);
+        } else {
+            compilePrologue(&compiler, method->parameterCount);
+            if (!compileStatements(&compiler, method->statements, method->statementCount, 0, 0)) {
+                emit(&compiler, BC_RETURN_SELF, 0, 0, 0);
+            }
+            popScope(&compiler);
+        }
+    } else {
+        // A doit answers the value of its last statement
+        ASTBlockNode* doit = (ASTBlockNode*)root;
+        if (!pushScope(&compiler, &builder, doit->captured, doit->parameterCount, doit->temporaryCount)) {
+            outOfMemory(&compiler);
+        } else {
+            compilePrologue(&compiler, doit->parameterCount);
+            if (!compileStatements(&compiler, doit->statements, doit->statementCount, 0, 1)) {
+                emit(&compiler, BC_RETURN_TOP, 0, 0, -1);
+            }
+            popScope(&compiler);
+        }
+    }
+
+    free(compiler.scopes);
+    if (compiler.failed) {
+        freeCompiledCode(builder.code);
+        return NULL;
+    }
+    return builder.code;
+}
@@ -0,0 +1,30 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "ast.h"
+#include "scope.h"
+#include "bytecode.h"
+
+/*
+ * Bytecode compiler. Lowers a method, or the top-level code of a doit, to
+ * CompiledCode (see bytecode.h); every block literal becomes code of its own
+ * in the literal frame of the code around it.
+ *
+ * The tree is resolved first (see scope.h), so the instance variables and the
+ * problem handler come from the scope options. Undeclared variables are
+ * reported there and compile as globals; duplicate declarations and stores
+ * into arguments are compile errors instead.
+ * Top-level code compiles as a method without a selector that answers the
+ * value of its last statement.
+ */
+
+typedef struct {
+    const char* message;       /* Static text, NULL while there is no error */
+    SourceSpan span;           /* Of the offending node */
+} CompileError;
+
+/* Answers NULL on error, with the first problem in error when it is not NULL.
+ * Options may be NULL for code without instance variables. */
+CompiledCode* compileAST(ASTNode* root, const ScopeOptions* options, CompileError* error);
+
+#endif /* COMPILER_H */
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parser.h"
+#include "chunks.h"
+#include "flatast.h"
+#include "treediff.h"
+#include "sourcemap.h"
+#include "fileio.h"
+
+// Structural diff of two versions of a Smalltalk source. Plain sources are
+// parsed whole; a fileout becomes one tree whose children are its chunks.
+
+// A separately parsed piece of the input: the whole file, or one chunk
+typedef struct {
+    FlatIndex first;            // Root of its subtree in the flat AST
+    char* text;                 // Text its spans refer to
+    SourceMap map;
+} DiffUnit;
+
+typedef struct {
+    const char* path;
+    char* source;
+    FlatAST* flat;
+    DiffUnit* units;
+    int unitCount;
+} DiffInput;
+
+static void freeDiffInput(DiffInput* input) {
+    for (int i = 0; i < input->unitCount; i++) {
+        freeSourceMap(&input->units[i].map);
+        if (input->units[i].text != input->source) free(input->units[i].text);
+    }
+    free(input->units);
+    if (input->flat != NULL) freeFlatAST(input->flat);
+    free(input->source);
+}
+
+static int loadPlainSource(DiffInput* input) {
+    Parser parser;
+    initParser(&parser, input->source);
+    ASTNode* ast = parse(&parser);
+    if (parser.hadError || ast == NULL) {
+        freeASTNode(ast);
+        return 0;
+    }
+
+    input->flat = flattenAST(ast);
+    freeASTNode(ast);
+
+    input->units = (DiffUnit*)malloc(sizeof(DiffUnit));
+    if (input->flat == NULL || input->units == NULL) return 0;
+    input->unitCount = 1;
+    input->units[0].first = 0;
+    input->units[0].text = input->source;
+    initSourceMap(&input->units[0].map, input->source, strlen(input->source), 1);
+    return 1;
+}
+
+// Collect the parsed chunks under an array-expression root, which has no
+// label of its own and so never shows up as changed
+static int loadFileout(DiffInput* input) {
+    ChunkScanner scanner;
+    SourceChunk chunk;
+    int capacity = 0;
+    int count = 0;
+    ASTNode** chunks = NULL;
+    int ok = 1;
+
+    initChunkScanner(&scanner, input->source, strlen(input->source));
+    while (ok && nextChunk(&scanner, &chunk)) {
+        if (chunk.kind == CHUNK_COMMENT) continue;
+
+        if (count == capacity) {
+            capacity = capacity < 16 ? 16 : capacity * 2;
+            ASTNode** newChunks = (ASTNode**)realloc(chunks, sizeof(ASTNode*) * capacity);
+            DiffUnit* newUnits = (DiffUnit*)realloc(input->units, sizeof(DiffUnit) * capacity);
+            if (newChunks != NULL) chunks = newChunks;
+            if (newUnits != NULL) input->units = newUnits;
+            if (newChunks == NULL || newUnits == NULL) {
+                ok = 0;
+                break;
+            }
+        }
+
+        int hadError = 0;
+        char* text = NULL;
+        ASTNode* ast = parseChunk(&chunk, &text, &hadError);
+        if (hadError || ast == NULL) {
+            fprintf(stderr, "%s:%d: chunk does not parse.\n", input->path, chunk.firstLine);
+            freeASTNode(ast);
+            free(text);
+            ok = 0;
+            break;
+        }
+
+        chunks[count] = ast;
+        DiffUnit* unit = &input->units[count];
+        unit->text = text;
+        initSourceMap(&unit->map, text, strlen(text), chunk.firstLine);
+        count++;
+        input->unitCount = count;
+    }
+
+    if (ok) {
+        SourceSpan span = {0, (unsigned int)strlen(input->source)};
+        ASTNode* root = createArrayExpressionNode(chunks, count, span);
+        if (root != NULL) {
+            input->flat = flattenAST(root);
+            freeASTNode(root);
+        }
+        ok = input->flat != NULL;
+    } else {
+        for (int i = 0; i < count; i++) freeASTNode(chunks[i]);
+    }
+    free(chunks);
+
+    // Chunk trees follow the root in pre-order
+    for (int i = 0; ok && i < count; i++) {
+        input->units[i].first = flatChild(input->flat, 0, i);
+    }
+    return ok;
+}
+
+static int loadDiffInput(const char* path, DiffInput* input) {
+    memset(input, 0, sizeof(*input));
+    input->path = path;
+    input->source = readFile(path);
+    if (input->source == NULL) return 0;
+
+    int ok = containsMethodChunks(input->source, strlen(input->source))
+        ? loadFileout(input) : loadPlainSource(input);
+    if (!ok) fprintf(stderr, "Failed to parse %s.\n", path);
+    return ok;
+}
+
+// The unit holding a node: the last one starting at or before it
+static DiffUnit* unitOf(DiffInput* input, FlatIndex index) {
+    int low = 0;
+    int high = input->unitCount;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (input->units[middle].first <= index) low = middle + 1; else high = middle;
+    }
+    return low > 0 ? &input->units[low - 1] : NULL;
+}
+
+static void printRange(DiffInput* input, FlatIndex index) {
+    DiffUnit* unit = unitOf(input, index);
+    int firstLine, firstColumn, lastLine, lastColumn;
+    if (unit == NULL ||
+        !spanStart(&unit->map, input->flat->spans[index], &firstLine, &firstColumn) ||
+        !spanEnd(&unit->map, input->flat->spans[index], &lastLine, &lastColumn)) {
+        printf("(file)");
+        return;
+    }
+    printf("%d:%d-%d:%d", firstLine, firstColumn, lastLine, lastColumn);
+}
+
+// The part of a node an update changes: its selector or name, or else the start of its text
+static void printLabel(DiffInput* input, FlatIndex index) {
+    const FlatAST* flat = input->flat;
+    const FlatNodeData* data = &flat->data[index];
+
+    switch ((ASTNodeType)flat->types[index]) {
+        case AST_MESSAGE_UNARY:
+        case AST_MESSAGE_BINARY:
+        case AST_MESSAGE_KEYWORD:
+            printf("%s", flatString(flat, data->b, NULL));
+            return;
+        case AST_VARIABLE:
+        case AST_ASSIGNMENT:
+            printf("%s", flatString(flat, data->a, NULL));
+            return;
+        default:
+            break;
+    }
+
+    DiffUnit* unit = unitOf(input, index);
+    if (unit == NULL) return;
+    const char* text = unit->text + flat->spans[index].start;
+    int length = (int)flat->spans[index].length;
+    const char* newline = memchr(text, '\n', length);
+    if (newline != NULL) length = (int)(newline - text);
+    if (length > 40) length = 40;
+    printf("%.*s", length, text);
+}
+
+static void printOperation(DiffInput* before, DiffInput* after, const EditOperation* operation) {
+    switch (operation->kind) {
+        case EDIT_DELETE:
+            printf("delete %s old ", astNodeTypeName((ASTNodeType)before->flat->types[operation->before]));
+            printRange(before, operation->before);
+            break;
+        case EDIT_INSERT:
+            printf("insert %s new ", astNodeTypeName((ASTNodeType)after->flat->types[operation->after]));
+            printRange(after, operation->after);
+            break;
+        case EDIT_MOVE:
+            printf("move %s old ", astNodeTypeName((ASTNodeType)after->flat->types[operation->after]));
+            printRange(before, operation->before);
+            printf(" -> new ");
+            printRange(after, operation->after);
+            break;
+        case EDIT_UPDATE:
+            printf("update %s old ", astNodeTypeName((ASTNodeType)after->flat->types[operation->after]));
+            printRange(before, operation->before);
+            printf(" -> new ");
+            printRange(after, operation->after);
+            printf(": ");
+            printLabel(before, operation->before);
+            printf(" -> ");
+            printLabel(after, operation->after);
+            break;
+    }
+    printf("\n");
+}
+
+static void printUsage(const char* programName) {
+    printf("Usage: %s [options] <old file> <new file>\n", programName);
+    printf("Print the structural edits that turn the old source into the new one.\n");
+    printf("Options:\n");
+    printf("  -h, --help     Display this help message\n");
+    printf("  --stats        Print node counts and timing on stderr\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* paths[2];
+    int pathCount = 0;
+    int showStats = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            showStats = 1;
+        } else if (pathCount < 2) {
+            paths[pathCount++] = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (pathCount != 2) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    DiffInput before;
+    DiffInput after;
+    clock_t start = clock();
+    int loaded = loadDiffInput(paths[0], &before);
+    loaded = loadDiffInput(paths[1], &after) && loaded;
+    if (!loaded) {
+        freeDiffInput(&before);
+        freeDiffInput(&after);
+        return 2;
+    }
+
+    clock_t parsed = clock();
+    TreeDiff diff;
+    if (!diffFlatASTs(before.flat, after.flat, &diff)) {
+        fprintf(stderr, "Not enough memory to diff.\n");
+        freeDiffInput(&before);
+        freeDiffInput(&after);
+        return 2;
+    }
+    clock_t diffed = clock();
+
+    for (uint32_t i = 0; i < diff.operationCount; i++) {
+        printOperation(&before, &after, &diff.operations[i]);
+    }
+
+    if (showStats) {
+        fprintf(stderr, "Old: %u nodes, new: %u nodes, matched: %u, edits: %u\n",
+                before.flat->nodeCount, after.flat->nodeCount, diff.matchedCount, diff.operationCount);
+        fprintf(stderr, "Parse: %.2f ms, diff: %.2f ms\n",
+                (double)(parsed - start) * 1000.0 / CLOCKS_PER_SEC,
+                (double)(diffed - parsed) * 1000.0 / CLOCKS_PER_SEC);
+    }
+
+    // Like diff(1): 0 when the trees are identical, 1 when they differ, 2 on trouble
+    int status = diff.operationCount > 0;
+    freeTreeDiff(&diff);
+    freeDiffInput(&before);
+    freeDiffInput(&after);
+    return status;
+}
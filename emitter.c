@@ -0,0 +1,765 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "emitter.h"
+#include "visitor.h"
+
+typedef struct {
+    OutputBuffer* out;
+    int* indents;       // Text format: indentation of the nodes at each depth
+    int capacity;
+} EmitContext;
+
+int parseASTFormat(const char* name) {
+    if (strcmp(name, "text") == 0) return AST_FORMAT_TEXT;
+    if (strcmp(name, "json") == 0) return AST_FORMAT_JSON;
+    if (strcmp(name, "sexpr") == 0) return AST_FORMAT_SEXPR;
+    return -1;
+}
+
+static const char* constantName(TokenType type) {
+    return type == TOKEN_NIL ? "nil"
+        : type == TOKEN_TRUE ? "true"
+        : type == TOKEN_FALSE ? "false" : "unknown";
+}
+
+static void writeLiteralText(OutputBuffer* out, ASTNode* node) {
+    int length;
+    const char* text = literalText(node, &length);
+    writeQuoted(out, text, (size_t)length);
+}
+
+// Text format
+
+static void writeLine(OutputBuffer* out, int indent, const char* text) {
+    writeSpaces(out, indent * 2);
+    writeString(out, text);
+    writeChar(out, '\n');
+}
+
+static void writeNames(OutputBuffer* out, int indent, const char* label, char** names, int count) {
+    writeSpaces(out, indent * 2);
+    writeString(out, label);
+    writeString(out, ": [");
+    for (int i = 0; i < count; i++) {
+        if (i > 0) writeString(out, ", ");
+        writeString(out, names[i]);
+    }
+    writeString(out, "]\n");
+}
+
+// Name of variable i of a scope, counting its parameters and then its temporaries
+static const char* scopeVariableName(char** parameters, int parameterCount, char** temporaries, int i) {
+    return i < parameterCount ? parameters[i] : temporaries[i - parameterCount];
+}
+
+static void writeCaptured(OutputBuffer* out, int indent, char** parameters, int parameterCount,
+                          char** temporaries, int temporaryCount, const unsigned char* captured) {
+    int first = 1;
+    for (int i = 0; captured != NULL && i < parameterCount + temporaryCount; i++) {
+        if (!captured[i]) continue;
+        if (first) {
+            writeSpaces(out, indent * 2);
+            writeString(out, "Captured: [");
+        } else {
+            writeString(out, ", ");
+        }
+        writeString(out, scopeVariableName(parameters, parameterCount, temporaries, i));
+        first = 0;
+    }
+    if (!first) writeString(out, "]\n");
+}
+
+// Resolved bindings follow the name, e.g. "x (temporary 0, depth 1)"
+static void writeBinding(OutputBuffer* out, VariableBinding binding) {
+    if (binding.kind == VAR_UNRESOLVED || binding.kind == VAR_PSEUDO) return;
+    writeString(out, " (");
+    writeString(out, variableKindName(binding.kind));
+    if (binding.slot >= 0) {
+        writeChar(out, ' ');
+        writeInteger(out, binding.slot);
+    }
+    if (binding.depth > 0) {
+        writeString(out, ", depth ");
+        writeInteger(out, binding.depth);
+    }
+    writeChar(out, ')');
+}
+
+static VisitAction textEnter(ASTNode* node, int depth, void* context) {
+    EmitContext* emit = (EmitContext*)context;
+    OutputBuffer* out = emit->out;
+
+    if (depth + 1 >= emit->capacity) {
+        int newCapacity = emit->capacity * 2;
+        int* indents = (int*)realloc(emit->indents, sizeof(int) * newCapacity);
+        if (indents == NULL) return VISIT_STOP;
+        emit->indents = indents;
+        emit->capacity = newCapacity;
+    }
+
+    int indent = emit->indents[depth];
+    // Messages, assignments, blocks and methods put their children under a label
+    int childIndent = indent + 2;
+
+    writeSpaces(out, indent * 2);
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+            writeString(out, "Integer: ");
+            writeInteger(out, ((ASTIntegerLiteral*)node)->value);
+            writeChar(out, '\n');
+            break;
+        case AST_LITERAL_FLOAT:
+            writeString(out, "Float: ");
+            writeDouble(out, ((ASTFloatLiteral*)node)->value);
+            writeChar(out, '\n');
+            break;
+        case AST_LITERAL_SCALED: {
+            ASTScaledLiteral* scaledNode = (ASTScaledLiteral*)node;
+            writeString(out, "Scaled: ");
+            writeDouble(out, scaledNode->value);
+            writeString(out, " s");
+            writeInteger(out, scaledNode->scale);
+            writeChar(out, '\n');
+            break;
+        }
+        case AST_LITERAL_CHARACTER:
+            writeString(out, "Character: '");
+            writeChar(out, ((ASTCharacterLiteral*)node)->value);
+            writeString(out, "'\n");
+            break;
+        case AST_LITERAL_STRING: {
+            int length;
+            const char* text = literalText(node, &length);
+            writeString(out, "String: '");
+            writeBytes(out, text, (size_t)length);
+            writeString(out, "'\n");
+            break;
+        }
+        case AST_LITERAL_SYMBOL: {
+            int length;
+            const char* text = literalText(node, &length);
+            writeString(out, "Symbol: #");
+            writeBytes(out, text, (size_t)length);
+            writeChar(out, '\n');
+            break;
+        }
+        case AST_LITERAL_ARRAY: {
+            ASTArrayLiteral* arrayNode = (ASTArrayLiteral*)node;
+            writeString(out, "Array: #(\n");
+            childIndent = indent + 1;
+            for (int i = 0; i < arrayNode->count && arrayNode->packedKind != PACKED_NONE; i++) {
+                writeSpaces(out, childIndent * 2);
+                if (arrayNode->packedKind == PACKED_DOUBLE) {
+                    writeString(out, "Float: ");
+                    writeDouble(out, ((double*)arrayNode->packed)[i]);
+                } else {
+                    writeString(out, "Integer: ");
+                    writeInteger(out, arrayNode->packedKind == PACKED_INT64
+                        ? ((long long*)arrayNode->packed)[i] : ((unsigned char*)arrayNode->packed)[i]);
+                }
+                writeChar(out, '\n');
+            }
+            break;
+        }
+        case AST_LITERAL_BYTE_ARRAY: {
+            ASTByteArrayLiteral* byteArrayNode = (ASTByteArrayLiteral*)node;
+            writeString(out, "ByteArray: #[\n");
+            for (int i = 0; i < byteArrayNode->count; i++) {
+                writeSpaces(out, indent * 2 + 2);
+                writeInteger(out, byteArrayNode->bytes[i]);
+                writeChar(out, '\n');
+            }
+            writeLine(out, indent, "]");
+            break;
+        }
+        case AST_CONSTANT:
+            writeString(out, "Constant: ");
+            writeString(out, constantName(((ASTConstantNode*)node)->type));
+            writeChar(out, '\n');
+            break;
+        case AST_VARIABLE: {
+            ASTVariableNode* varNode = (ASTVariableNode*)node;
+            writeString(out, varNode->isPseudoVariable ? "PseudoVariable: " : "Variable: ");
+            writeString(out, varNode->name);
+            writeBinding(out, varNode->binding);
+            writeChar(out, '\n');
+            break;
+        }
+        case AST_ASSIGNMENT:
+            writeString(out, "Assignment:\n");
+            writeSpaces(out, indent * 2);
+            writeString(out, "  Variable: ");
+            writeString(out, ((ASTAssignmentNode*)node)->variable);
+            writeBinding(out, ((ASTAssignmentNode*)node)->binding);
+            writeChar(out, '\n');
+            writeLine(out, indent + 1, "Value:");
+            break;
+        case AST_RETURN:
+            writeString(out, "Return:\n");
+            childIndent = indent + 1;
+            break;
+        case AST_MESSAGE_UNARY:
+        case AST_MESSAGE_BINARY:
+        case AST_MESSAGE_KEYWORD:
+            // All message nodes start with an ASTMessageNode
+            writeString(out, astNodeTypeName(node->type));
+            writeString(out, ":\n");
+            writeSpaces(out, indent * 2);
+            writeString(out, "  Selector: ");
+            writeString(out, ((ASTMessageNode*)node)->selector);
+            writeChar(out, '\n');
+            writeLine(out, indent + 1, "Receiver:");
+            break;
+        case AST_CASCADE:
+            writeString(out, "Cascade:\n");
+            writeLine(out, indent + 1, "Receiver:");
+            break;
+        case AST_BLOCK: {
+            ASTBlockNode* blockNode = (ASTBlockNode*)node;
+            writeString(out, blockNode->inlined ? "Block (inlined):\n" : "Block:\n");
+            if (blockNode->parameterCount > 0) {
+                writeNames(out, indent + 1, "Parameters", blockNode->parameters, blockNode->parameterCount);
+            }
+            if (blockNode->temporaryCount > 0) {
+                writeNames(out, indent + 1, "Temporaries", blockNode->temporaries, blockNode->temporaryCount);
+            }
+            writeCaptured(out, indent + 1, blockNode->parameters, blockNode->parameterCount,
+                          blockNode->temporaries, blockNode->temporaryCount, blockNode->captured);
+            writeLine(out, indent + 1, "Statements:");
+            break;
+        }
+        case AST_ARRAY_EXPRESSION:
+            writeString(out, "ArrayExpression: {\n");
+            childIndent = indent + 1;
+            break;
+        case AST_METHOD: {
+            ASTMethodNode* methodNode = (ASTMethodNode*)node;
+            writeString(out, "Method:\n");
+            writeSpaces(out, indent * 2);
+            writeString(out, "  Selector: ");
+            writeString(out, methodNode->selector);
+            writeChar(out, '\n');
+            if (methodNode->parameterCount > 0) {
+                writeNames(out, indent + 1, "Parameters", methodNode->parameters, methodNode->parameterCount);
+            }
+            if (methodNode->temporaryCount > 0) {
+                writeNames(out, indent + 1, "Temporaries", methodNode->temporaries, methodNode->temporaryCount);
+            }
+            writeCaptured(out, indent + 1, methodNode->parameters, methodNode->parameterCount,
+                          methodNode->temporaries, methodNode->temporaryCount, methodNode->captured);
+            if (methodNode->isPrimitive) {
+                writeSpaces(out, indent * 2);
+                writeString(out, "  Primitive: ");
+                writeInteger(out, methodNode->primitiveNumber);
+                writeChar(out, '\n');
+            }
+            writeLine(out, indent + 1, "Statements:");
+            break;
+        }
+        default:
+            writeString(out, "Unknown node type: ");
+            writeInteger(out, node->type);
+            writeChar(out, '\n');
+            break;
+    }
+
+    emit->indents[depth + 1] = childIndent;
+    return VISIT_CONTINUE;
+}
+
+// Labels that separate a node's children
+static VisitAction textChild(ASTNode* parent, int index, int depth, void* context) {
+    EmitContext* emit = (EmitContext*)context;
+    int indent = emit->indents[depth];
+
+    if (index != 1) return VISIT_CONTINUE;
+
+    switch (parent->type) {
+        case AST_MESSAGE_BINARY:
+            writeLine(emit->out, indent + 1, "Argument:");
+            break;
+        case AST_MESSAGE_KEYWORD:
+            writeLine(emit->out, indent + 1, "Arguments:");
+            break;
+        case AST_CASCADE:
+            writeLine(emit->out, indent + 1, "Messages:");
+            break;
+        default:
+            break;
+    }
+    return VISIT_CONTINUE;
+}
+
+static VisitAction textLeave(ASTNode* node, int depth, void* context) {
+    EmitContext* emit = (EmitContext*)context;
+    int indent = emit->indents[depth];
+
+    switch (node->type) {
+        case AST_LITERAL_ARRAY:
+            writeLine(emit->out, indent, ")");
+            break;
+        case AST_ARRAY_EXPRESSION:
+            writeLine(emit->out, indent, "}");
+            break;
+        case AST_MESSAGE_KEYWORD:
+            if (((ASTKeywordMessageNode*)node)->argumentCount == 0) writeLine(emit->out, indent + 1, "Arguments:");
+            break;
+        case AST_CASCADE:
+            if (((ASTCascadeNode*)node)->messageCount == 0) writeLine(emit->out, indent + 1, "Messages:");
+            break;
+        default:
+            break;
+    }
+    return VISIT_CONTINUE;
+}
+
+// Machine formats
+
+// Where each child of a node goes: named single children first, then a list
+typedef struct {
+    const char* single[2];
+    int singleCount;
+    const char* list;
+} ChildSlots;
+
+static const ChildSlots* childSlots(ASTNodeType type) {
+    static const ChildSlots none = {{NULL, NULL}, 0, NULL};
+    static const ChildSlots value = {{"value", NULL}, 1, NULL};
+    static const ChildSlots unary = {{"receiver", NULL}, 1, NULL};
+    static const ChildSlots binary = {{"receiver", "argument"}, 2, NULL};
+    static const ChildSlots keyword = {{"receiver", NULL}, 1, "arguments"};
+    static const ChildSlots cascade = {{"receiver", NULL}, 1, "messages"};
+    static const ChildSlots statements = {{NULL, NULL}, 0, "statements"};
+    static const ChildSlots elements = {{NULL, NULL}, 0, "elements"};
+
+    switch (type) {
+        case AST_ASSIGNMENT:
+        case AST_RETURN:
+            return &value;
+        case AST_MESSAGE_UNARY: return &unary;
+        case AST_MESSAGE_BINARY: return &binary;
+        case AST_MESSAGE_KEYWORD: return &keyword;
+        case AST_CASCADE: return &cascade;
+        case AST_BLOCK:
+        case AST_METHOD:
+            return &statements;
+        case AST_LITERAL_ARRAY:
+        case AST_ARRAY_EXPRESSION:
+            return &elements;
+        default:
+            return &none;
+    }
+}
+
+static int isPackedArray(ASTNode* node) {
+    return node->type == AST_LITERAL_ARRAY && ((ASTArrayLiteral*)node)->packedKind != PACKED_NONE;
+}
+
+static void writeJSONNumber(OutputBuffer* out, double value) {
+    if (isfinite(value)) {
+        writeDouble(out, value);
+    } else {
+        writeChar(out, '"');
+        writeDouble(out, value);
+        writeChar(out, '"');
+    }
+}
+
+static void writeJSONNames(OutputBuffer* out, const char* key, char** names, int count) {
+    writeString(out, key);
+    writeChar(out, '[');
+    for (int i = 0; i < count; i++) {
+        if (i > 0) writeChar(out, ',');
+        writeQuoted(out, names[i], strlen(names[i]));
+    }
+    writeChar(out, ']');
+}
+
+static void writeJSONCaptured(OutputBuffer* out, char** parameters, int parameterCount,
+                              char** temporaries, int temporaryCount, const unsigned char* captured) {
+    if (captured == NULL) return;
+    writeString(out, ",\"captured\":[");
+    int first = 1;
+    for (int i = 0; i < parameterCount + temporaryCount; i++) {
+        if (!captured[i]) continue;
+        if (!first) writeChar(out, ',');
+        const char* name = scopeVariableName(parameters, parameterCount, temporaries, i);
+        writeQuoted(out, name, strlen(name));
+        first = 0;
+    }
+    writeChar(out, ']');
+}
+
+static void writeJSONBinding(OutputBuffer* out, VariableBinding binding) {
+    if (binding.kind == VAR_UNRESOLVED) return;
+    writeString(out, ",\"binding\":{\"kind\":\"");
+    writeString(out, variableKindName(binding.kind));
+    writeString(out, "\",\"slot\":");
+    writeInteger(out, binding.slot);
+    writeString(out, ",\"depth\":");
+    writeInteger(out, binding.depth);
+    writeChar(out, '}');
+}
+
+static VisitAction jsonEnter(ASTNode* node, int depth, void* context) {
+    OutputBuffer* out = ((EmitContext*)context)->out;
+    (void)depth;
+
+    writeString(out, "{\"type\":\"");
+    writeString(out, astNodeTypeName(node->type));
+    writeString(out, "\",\"span\":[");
+    writeInteger(out, node->span.start);
+    writeChar(out, ',');
+    writeInteger(out, node->span.length);
+    writeChar(out, ']');
+
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+            writeString(out, ",\"value\":");
+            writeInteger(out, ((ASTIntegerLiteral*)node)->value);
+            break;
+        case AST_LITERAL_FLOAT:
+            writeString(out, ",\"value\":");
+            writeJSONNumber(out, ((ASTFloatLiteral*)node)->value);
+            break;
+        case AST_LITERAL_SCALED:
+            writeString(out, ",\"value\":");
+            writeJSONNumber(out, ((ASTScaledLiteral*)node)->value);
+            writeString(out, ",\"scale\":");
+            writeInteger(out, ((ASTScaledLiteral*)node)->scale);
+            break;
+        case AST_LITERAL_CHARACTER:
+            writeString(out, ",\"value\":");
+            writeQuoted(out, &((ASTCharacterLiteral*)node)->value, 1);
+            break;
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL:
+            writeString(out, ",\"value\":");
+            writeLiteralText(out, node);
+            break;
+        case AST_LITERAL_ARRAY: {
+            // Packed elements have no nodes, and so no spans
+            ASTArrayLiteral* arrayNode = (ASTArrayLiteral*)node;
+            if (arrayNode->packedKind == PACKED_NONE) break;
+            writeString(out, ",\"elements\":[");
+            for (int i = 0; i < arrayNode->count; i++) {
+                if (i > 0) writeChar(out, ',');
+                if (arrayNode->packedKind == PACKED_DOUBLE) {
+                    writeString(out, "{\"type\":\"Float\",\"value\":");
+                    writeJSONNumber(out, ((double*)arrayNode->packed)[i]);
+                } else {
+                    writeString(out, "{\"type\":\"Integer\",\"value\":");
+                    writeInteger(out, arrayNode->packedKind == PACKED_INT64
+                        ? ((long long*)arrayNode->packed)[i] : ((unsigned char*)arrayNode->packed)[i]);
+                }
+                writeChar(out, '}');
+            }
+            writeChar(out, ']');
+            break;
+        }
+        case AST_LITERAL_BYTE_ARRAY: {
+            ASTByteArrayLiteral* byteArrayNode = (ASTByteArrayLiteral*)node;
+            writeString(out, ",\"bytes\":[");
+            for (int i = 0; i < byteArrayNode->count; i++) {
+                if (i > 0) writeChar(out, ',');
+                writeInteger(out, byteArrayNode->bytes[i]);
+            }
+            writeChar(out, ']');
+            break;
+        }
+        case AST_CONSTANT:
+            writeString(out, ",\"value\":\"");
+            writeString(out, constantName(((ASTConstantNode*)node)->type));
+            writeChar(out, '"');
+            break;
+        case AST_VARIABLE: {
+            ASTVariableNode* varNode = (ASTVariableNode*)node;
+            writeString(out, ",\"name\":");
+            writeQuoted(out, varNode->name, strlen(varNode->name));
+            writeString(out, varNode->isPseudoVariable ? ",\"pseudo\":true" : ",\"pseudo\":false");
+            writeJSONBinding(out, varNode->binding);
+            break;
+        }
+        case AST_ASSIGNMENT: {
+            const char* variable = ((ASTAssignmentNode*)node)->variable;
+            writeString(out, ",\"variable\":");
+            writeQuoted(out, variable, strlen(variable));
+            writeJSONBinding(out, ((ASTAssignmentNode*)node)->binding);
+            break;
+        }
+        case AST_MESSAGE_UNARY:
+        case AST_MESSAGE_BINARY:
+        case AST_MESSAGE_KEYWORD: {
+            const char* selector = ((ASTMessageNode*)node)->selector;
+            writeString(out, ",\"selector\":");
+            writeQuoted(out, selector, strlen(selector));
+            break;
+        }
+        case AST_BLOCK: {
+            ASTBlockNode* blockNode = (ASTBlockNode*)node;
+            writeJSONNames(out, ",\"parameters\":", blockNode->parameters, blockNode->parameterCount);
+            writeJSONNames(out, ",\"temporaries\":", blockNode->temporaries, blockNode->temporaryCount);
+            writeJSONCaptured(out, blockNode->parameters, blockNode->parameterCount,
+                              blockNode->temporaries, blockNode->temporaryCount, blockNode->captured);
+            if (blockNode->inlined) writeString(out, ",\"inlined\":true");
+            break;
+        }
+        case AST_METHOD: {
+            ASTMethodNode* methodNode = (ASTMethodNode*)node;
+            writeString(out, ",\"selector\":");
+            writeQuoted(out, methodNode->selector, strlen(methodNode->selector));
+            writeJSONNames(out, ",\"parameters\":", methodNode->parameters, methodNode->parameterCount);
+            writeJSONNames(out, ",\"temporaries\":", methodNode->temporaries, methodNode->temporaryCount);
+            writeJSONCaptured(out, methodNode->parameters, methodNode->parameterCount,
+                              methodNode->temporaries, methodNode->temporaryCount, methodNode->captured);
+            if (methodNode->isPrimitive) {
+                writeString(out, ",\"primitive\":");
+                writeInteger(out, methodNode->primitiveNumber);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return VISIT_CONTINUE;
+}
+
+static VisitAction jsonChild(ASTNode* parent, int index, int depth, void* context) {
+    OutputBuffer* out = ((EmitContext*)context)->out;
+    const ChildSlots* slots = childSlots(parent->type);
+    (void)depth;
+
+    if (index < slots->singleCount) {
+        writeString(out, ",\"");
+        writeString(out, slots->single[index]);
+        writeString(out, "\":");
+    } else if (index == slots->singleCount) {
+        writeString(out, ",\"");
+        writeString(out, slots->list);
+        writeString(out, "\":[");
+    } else {
+        writeChar(out, ',');
+    }
+    if (astChild(parent, index) == NULL) writeString(out, "null");
+    return VISIT_CONTINUE;
+}
+
+static VisitAction jsonLeave(ASTNode* node, int depth, void* context) {
+    OutputBuffer* out = ((EmitContext*)context)->out;
+    const ChildSlots* slots = childSlots(node->type);
+
+    if (slots->list != NULL && !isPackedArray(node)) {
+        // An empty list gets no child callback to open it
+        if (astChildCount(node) <= slots->singleCount) {
+            writeString(out, ",\"");
+            writeString(out, slots->list);
+            writeString(out, "\":[");
+        }
+        writeChar(out, ']');
+    }
+    writeChar(out, '}');
+    if (depth == 0) writeChar(out, '\n');
+    return VISIT_CONTINUE;
+}
+
+static void writeSExprNames(OutputBuffer* out, char** names, int count) {
+    writeString(out, " (");
+    for (int i = 0; i < count; i++) {
+        if (i > 0) writeChar(out, ' ');
+        writeQuoted(out, names[i], strlen(names[i]));
+    }
+    writeChar(out, ')');
+}
+
+static void writeSExprCaptured(OutputBuffer* out, char** parameters, int parameterCount,
+                               char** temporaries, int temporaryCount, const unsigned char* captured) {
+    if (captured == NULL) return;
+    writeString(out, " (captured");
+    for (int i = 0; i < parameterCount + temporaryCount; i++) {
+        if (!captured[i]) continue;
+        const char* name = scopeVariableName(parameters, parameterCount, temporaries, i);
+        writeChar(out, ' ');
+        writeQuoted(out, name, strlen(name));
+    }
+    writeChar(out, ')');
+}
+
+// (kind slot depth) after the name of a resolved variable
+static void writeSExprBinding(OutputBuffer* out, VariableBinding binding) {
+    if (binding.kind == VAR_UNRESOLVED) return;
+    writeString(out, " (");
+    writeString(out, variableKindName(binding.kind));
+    writeChar(out, ' ');
+    writeInteger(out, binding.slot);
+    writeChar(out, ' ');
+    writeInteger(out, binding.depth);
+    writeChar(out, ')');
+}
+
+static VisitAction sexprEnter(ASTNode* node, int depth, void* context) {
+    OutputBuffer* out = ((EmitContext*)context)->out;
+    (void)depth;
+
+    writeChar(out, '(');
+    if (node->type == AST_VARIABLE && ((ASTVariableNode*)node)->isPseudoVariable) {
+        writeString(out, "PseudoVariable");
+    } else {
+        writeString(out, astNodeTypeName(node->type));
+    }
+
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+            writeChar(out, ' ');
+            writeInteger(out, ((ASTIntegerLiteral*)node)->value);
+            break;
+        case AST_LITERAL_FLOAT:
+            writeChar(out, ' ');
+            writeDouble(out, ((ASTFloatLiteral*)node)->value);
+            break;
+        case AST_LITERAL_SCALED:
+            writeChar(out, ' ');
+            writeDouble(out, ((ASTScaledLiteral*)node)->value);
+            writeChar(out, ' ');
+            writeInteger(out, ((ASTScaledLiteral*)node)->scale);
+            break;
+        case AST_LITERAL_CHARACTER:
+            writeChar(out, ' ');
+            writeQuoted(out, &((ASTCharacterLiteral*)node)->value, 1);
+            break;
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL:
+            writeChar(out, ' ');
+            writeLiteralText(out, node);
+            break;
+        case AST_LITERAL_ARRAY: {
+            ASTArrayLiteral* arrayNode = (ASTArrayLiteral*)node;
+            for (int i = 0; i < arrayNode->count && arrayNode->packedKind != PACKED_NONE; i++) {
+                if (arrayNode->packedKind == PACKED_DOUBLE) {
+                    writeString(out, " (Float ");
+                    writeDouble(out, ((double*)arrayNode->packed)[i]);
+                } else {
+                    writeString(out, " (Integer ");
+                    writeInteger(out, arrayNode->packedKind == PACKED_INT64
+                        ? ((long long*)arrayNode->packed)[i] : ((unsigned char*)arrayNode->packed)[i]);
+                }
+                writeChar(out, ')');
+            }
+            break;
+        }
+        case AST_LITERAL_BYTE_ARRAY: {
+            ASTByteArrayLiteral* byteArrayNode = (ASTByteArrayLiteral*)node;
+            for (int i = 0; i < byteArrayNode->count; i++) {
+                writeChar(out, ' ');
+                writeInteger(out, byteArrayNode->bytes[i]);
+            }
+            break;
+        }
+        case AST_CONSTANT:
+            writeChar(out, ' ');
+            writeString(out, constantName(((ASTConstantNode*)node)->type));
+            break;
+        case AST_VARIABLE: {
+            const char* name = ((ASTVariableNode*)node)->name;
+            writeChar(out, ' ');
+            writeQuoted(out, name, strlen(name));
+            writeSExprBinding(out, ((ASTVariableNode*)node)->binding);
+            break;
+        }
+        case AST_ASSIGNMENT: {
+            const char* variable = ((ASTAssignmentNode*)node)->variable;
+            writeChar(out, ' ');
+            writeQuoted(out, variable, strlen(variable));
+            writeSExprBinding(out, ((ASTAssignmentNode*)node)->binding);
+            break;
+        }
+        case AST_MESSAGE_UNARY:
+        case AST_MESSAGE_BINARY:
+        case AST_MESSAGE_KEYWORD: {
+            const char* selector = ((ASTMessageNode*)node)->selector;
+            writeChar(out, ' ');
+            writeQuoted(out, selector, strlen(selector));
+            break;
+        }
+        case AST_BLOCK: {
+            ASTBlockNode* blockNode = (ASTBlockNode*)node;
+            writeSExprNames(out, blockNode->parameters, blockNode->parameterCount);
+            writeSExprNames(out, blockNode->temporaries, blockNode->temporaryCount);
+            writeSExprCaptured(out, blockNode->parameters, blockNode->parameterCount,
+                               blockNode->temporaries, blockNode->temporaryCount, blockNode->captured);
+            break;
+        }
+        case AST_METHOD: {
+            ASTMethodNode* methodNode = (ASTMethodNode*)node;
+            writeChar(out, ' ');
+            writeQuoted(out, methodNode->selector, strlen(methodNode->selector));
+            writeSExprNames(out, methodNode->parameters, methodNode->parameterCount);
+            writeSExprNames(out, methodNode->temporaries, methodNode->temporaryCount);
+            writeSExprCaptured(out, methodNode->parameters, methodNode->parameterCount,
+                               methodNode->temporaries, methodNode->temporaryCount, methodNode->captured);
+            writeChar(out, ' ');
+            if (methodNode->isPrimitive) {
+                writeInteger(out, methodNode->primitiveNumber);
+            } else {
+                writeString(out, "nil");
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return VISIT_CONTINUE;
+}
+
+static VisitAction sexprChild(ASTNode* parent, int index, int depth, void* context) {
+    OutputBuffer* out = ((EmitContext*)context)->out;
+    (void)depth;
+
+    writeChar(out, ' ');
+    if (astChild(parent, index) == NULL) writeString(out, "nil");
+    return VISIT_CONTINUE;
+}
+
+static VisitAction sexprLeave(ASTNode* node, int depth, void* context) {
+    OutputBuffer* out = ((EmitContext*)context)->out;
+    (void)node;
+
+    writeChar(out, ')');
+    if (depth == 0) writeChar(out, '\n');
+    return VISIT_CONTINUE;
+}
+
+int emitAST(OutputBuffer* out, ASTNode* node, ASTFormat format, int indent) {
+    EmitContext emit;
+    emit.out = out;
+    emit.indents = NULL;
+    emit.capacity = 0;
+
+    ASTVisitor visitor;
+    visitor.context = &emit;
+    switch (format) {
+        case AST_FORMAT_JSON:
+            visitor.enter = jsonEnter;
+            visitor.child = jsonChild;
+            visitor.leave = jsonLeave;
+            break;
+        case AST_FORMAT_SEXPR:
+            visitor.enter = sexprEnter;
+            visitor.child = sexprChild;
+            visitor.leave = sexprLeave;
+            break;
+        default:
+            emit.capacity = 64;
+            emit.indents = (int*)malloc(sizeof(int) * emit.capacity);
+            if (emit.indents == NULL) return 0;
+            emit.indents[0] = indent;
+            visitor.enter = textEnter;
+            visitor.child = textChild;
+            visitor.leave = textLeave;
+            break;
+    }
+
+    int result = walkAST(node, &visitor);
+    free(emit.indents);
+    return result == 1;
+}
@@ -0,0 +1,34 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include "ast.h"
+#include "output.h"
+
+/*
+ * AST output in three formats, written through an OutputBuffer:
+ *
+ *   TEXT    The indented human-readable listing.
+ *   JSON    JSON Lines: each tree is one object on a single line, nodes as
+ *           {"type":..., "span":[start,length], attributes..., children...}.
+ *           Non-finite floats, which JSON cannot represent, become the
+ *           strings "inf", "-inf" and "nan".
+ *   SEXPR   Compact S-expressions, one tree per line: (Type attributes...
+ *           children...), with strings, names and selectors double-quoted.
+ *
+ * Floats are written with round-trip precision in every format, and strings
+ * are escaped as in JSON.
+ */
+
+typedef enum {
+    AST_FORMAT_TEXT,
+    AST_FORMAT_JSON,
+    AST_FORMAT_SEXPR
+} ASTFormat;
+
+/* Answers the format named "text", "json" or "sexpr", or -1 */
+int parseASTFormat(const char* name);
+
+/* Indent applies to the text format only. Answers 1 if the whole tree was written. */
+int emitAST(OutputBuffer* out, ASTNode* node, ASTFormat format, int indent);
+
+#endif /* EMITTER_H */
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "fileio.h"
+
+// Function to read a file into a string
+char* readFile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        return NULL;
+    }
+    
+    fseek(file, 0L, SEEK_END);
+    size_t fileSize = ftell(file);
+    rewind(file);
+    
+    char* buffer = (char*)malloc(fileSize + 1);
+    if (buffer == NULL) {
+        fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
+        fclose(file);
+        return NULL;
+    }
+    
+    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+    if (bytesRead < fileSize) {
+        fprintf(stderr, "Could not read file \"%s\".\n", path);
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+    
+    buffer[bytesRead] = '\0';
+    
+    fclose(file);
+    return buffer;
+}
+
+static pthread_once_t umaskOnce = PTHREAD_ONCE_INIT;
+static mode_t processUmask;
+
+// umask can only be read by setting it, so only once: the files this
+// module creates meanwhile come from mkstemp, whose mode ignores it
+static void readUmask(void) {
+    processUmask = umask(0);
+    umask(processUmask);
+}
+
+// Mode of a file fopen would create
+static mode_t newFileMode(void) {
+    pthread_once(&umaskOnce, readUmask);
+    return 0666 & ~processUmask;
+}
+
+int writeFileAtomicallyWith(const char* path, FileContentWriter write, void* context) {
+    // Through a symbolic link to the file it names; a new file has no links
+    char* resolved = realpath(path, NULL);
+    const char* target = resolved != NULL ? resolved : path;
+
+    struct stat existing;
+    mode_t mode = stat(target, &existing) == 0 ? existing.st_mode & 07777 : newFileMode();
+
+    // In the same directory, so that the rename stays on one file system
+    size_t targetLength = strlen(target);
+    char* temporary = (char*)malloc(targetLength + sizeof(".XXXXXX"));
+    if (temporary == NULL) {
+        free(resolved);
+        return 0;
+    }
+    memcpy(temporary, target, targetLength);
+    memcpy(temporary + targetLength, ".XXXXXX", sizeof(".XXXXXX"));
+
+    int descriptor = mkstemp(temporary);
+    FILE* file = descriptor < 0 ? NULL : fdopen(descriptor, "wb");
+    if (file == NULL) {
+        if (descriptor >= 0) {
+            close(descriptor);
+            remove(temporary);
+        }
+        free(temporary);
+        free(resolved);
+        return 0;
+    }
+
+    int ok = fchmod(descriptor, mode) == 0 && write(file, context);
+    if (fclose(file) != 0) ok = 0;
+    if (ok) ok = rename(temporary, target) == 0;
+    if (!ok) remove(temporary);
+
+    free(temporary);
+    free(resolved);
+    return ok;
+}
+
+typedef struct {
+    const char* data;
+    size_t length;
+} FileContents;
+
+static int writeContents(FILE* file, void* context) {
+    FileContents* contents = (FileContents*)context;
+    return fwrite(contents->data, 1, contents->length, file) == contents->length;
+}
+
+int writeFileAtomically(const char* path, const char* data, size_t length) {
+    FileContents contents = { data, length };
+    return writeFileAtomicallyWith(path, writeContents, &contents);
+}
+
+char** readPathList(int* count) {
+    char** paths = NULL;
+    int capacity = 0;
+    char line[4096];
+
+    *count = 0;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        size_t length = strcspn(line, "\r\n");
+        if (length == 0) continue;
+        line[length] = '\0';
+
+        if (*count == capacity) {
+            capacity = capacity < 64 ? 64 : capacity * 2;
+            char** newPaths = (char**)realloc(paths, sizeof(char*) * capacity);
+            if (newPaths == NULL) break;
+            paths = newPaths;
+        }
+        paths[*count] = strdup(line);
+        if (paths[*count] == NULL) break;
+        (*count)++;
+    }
+    return paths;
+}
@@ -0,0 +1,28 @@
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Read a whole file into a NUL-terminated buffer the caller frees; reports
+ * failures on stderr and answers NULL */
+char* readFile(const char* path);
+
+/* Replace the contents of path through a temporary file and a rename, so
+ * readers never see a partial file. A symbolic link keeps pointing at the
+ * file, which is replaced in its own directory and keeps its permissions; a
+ * new file gets those of fopen. The temporary file comes from mkstemp, so
+ * concurrent writers never share one. Answers 0 on failure. */
+int writeFileAtomically(const char* path, const char* data, size_t length);
+
+/* Writes the new contents to file; answers 0 on failure */
+typedef int (*FileContentWriter)(FILE* file, void* context);
+
+/* writeFileAtomically for contents produced by a function */
+int writeFileAtomicallyWith(const char* path, FileContentWriter write, void* context);
+
+/* Read newline-separated paths from stdin, for file lists too long for
+ * argv; the caller frees each path and the array */
+char** readPathList(int* count);
+
+#endif /* FILEIO_H */
@@ -0,0 +1,760 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "flatast.h"
+
+typedef struct {
+    FlatAST* flat;
+    uint32_t* table;            /* Open-addressing table of string ids + 1 */
+    uint32_t tableCapacity;
+    int failed;
+} FlatBuilder;
+
+static int growArray(void** array, uint32_t* capacity, uint32_t needed, size_t elementSize) {
+    if (needed <= *capacity) return 1;
+
+    uint32_t newCapacity = *capacity < 64 ? 64 : *capacity;
+    while (newCapacity < needed) newCapacity *= 2;
+
+    void* newArray = realloc(*array, elementSize * newCapacity);
+    if (newArray == NULL) return 0;
+
+    *array = newArray;
+    *capacity = newCapacity;
+    return 1;
+}
+
+static uint32_t hashBytes(const char* bytes, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int rehashStrings(FlatBuilder* builder, uint32_t capacity) {
+    uint32_t* table = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    if (table == NULL) return 0;
+
+    FlatAST* flat = builder->flat;
+    for (uint32_t id = 0; id < flat->stringCount; id++) {
+        const FlatString* string = &flat->strings[id];
+        uint32_t slot = hashBytes(flat->pool + string->offset, (int)string->length) & (capacity - 1);
+        while (table[slot] != 0) slot = (slot + 1) & (capacity - 1);
+        table[slot] = id + 1;
+    }
+
+    free(builder->table);
+    builder->table = table;
+    builder->tableCapacity = capacity;
+    return 1;
+}
+
+// Answer the id of a string, adding it to the pool the first time it is seen
+static uint32_t internString(FlatBuilder* builder, const char* text, int length) {
+    FlatAST* flat = builder->flat;
+
+    if ((flat->stringCount + 1) * 2 > builder->tableCapacity) {
+        if (!rehashStrings(builder, builder->tableCapacity == 0 ? 256 : builder->tableCapacity * 2)) {
+            builder->failed = 1;
+            return 0;
+        }
+    }
+
+    uint32_t mask = builder->tableCapacity - 1;
+    uint32_t slot = hashBytes(text, length) & mask;
+    while (builder->table[slot] != 0) {
+        uint32_t id = builder->table[slot] - 1;
+        const FlatString* string = &flat->strings[id];
+        if (string->length == (uint32_t)length && (length == 0 || memcmp(flat->pool + string->offset, text, length) == 0)) {
+            return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (!growArray((void**)&flat->pool, &flat->poolCapacity, flat->poolSize + length + 1, 1) ||
+        !growArray((void**)&flat->strings, &flat->stringCapacity, flat->stringCount + 1, sizeof(FlatString))) {
+        builder->failed = 1;
+        return 0;
+    }
+
+    uint32_t id = flat->stringCount++;
+    flat->strings[id].offset = flat->poolSize;
+    flat->strings[id].length = (uint32_t)length;
+    if (length > 0) memcpy(flat->pool + flat->poolSize, text, length);
+    flat->pool[flat->poolSize + length] = '\0';
+    flat->poolSize += length + 1;
+
+    builder->table[slot] = id + 1;
+    return id;
+}
+
+static uint32_t internName(FlatBuilder* builder, const char* name) {
+    return internString(builder, name, (int)strlen(name));
+}
+
+static FlatIndex newNode(FlatBuilder* builder, ASTNode* node) {
+    FlatAST* flat = builder->flat;
+    uint32_t needed = flat->nodeCount + 1;
+    uint32_t capacity = flat->nodeCapacity;
+
+    if (needed > capacity) {
+        // All parallel arrays share one capacity
+        uint32_t newCapacity = capacity;
+        if (!growArray((void**)&flat->types, &newCapacity, needed, sizeof(unsigned char))) {
+            builder->failed = 1;
+            return FLAT_NONE;
+        }
+        uint32_t c = capacity;
+        int ok = growArray((void**)&flat->spans, &c, newCapacity, sizeof(SourceSpan));
+        c = capacity;
+        ok = ok && growArray((void**)&flat->data, &c, newCapacity, sizeof(FlatNodeData));
+        flat->nodeCapacity = newCapacity;
+        if (!ok) {
+            builder->failed = 1;
+            return FLAT_NONE;
+        }
+    }
+
+    FlatIndex index = flat->nodeCount++;
+    flat->types[index] = (unsigned char)node->type;
+    flat->spans[index] = node->span;
+    flat->data[index].a = 0;
+    flat->data[index].b = 0;
+    flat->data[index].c = 0;
+    return index;
+}
+
+// Reserve words in the extra array and answer the index of the first one
+static uint32_t reserveExtra(FlatBuilder* builder, uint32_t count) {
+    FlatAST* flat = builder->flat;
+    if (!growArray((void**)&flat->extra, &flat->extraCapacity, flat->extraCount + count, sizeof(uint32_t))) {
+        builder->failed = 1;
+        return 0;
+    }
+    uint32_t start = flat->extraCount;
+    flat->extraCount += count;
+    return start;
+}
+
+static FlatIndex flattenNode(FlatBuilder* builder, ASTNode* node);
+
+// Flatten a list of children into reserved extra words (the array may move while recursing)
+static void flattenList(FlatBuilder* builder, uint32_t start, ASTNode** nodes, int count) {
+    for (int i = 0; i < count && !builder->failed; i++) {
+        FlatIndex child = flattenNode(builder, nodes[i]);
+        builder->flat->extra[start + i] = child;
+    }
+}
+
+static void internNames(FlatBuilder* builder, uint32_t start, char** names, int count) {
+    for (int i = 0; i < count && !builder->failed; i++) {
+        uint32_t id = internName(builder, names[i]);
+        builder->flat->extra[start + i] = id;
+    }
+}
+
+static void splitValue(const void* value, FlatNodeData* data) {
+    uint64_t bits;
+    memcpy(&bits, value, sizeof(bits));
+    data->a = (uint32_t)bits;
+    data->b = (uint32_t)(bits >> 32);
+}
+
+static FlatIndex flattenNode(FlatBuilder* builder, ASTNode* node) {
+    if (node == NULL || builder->failed) return FLAT_NONE;
+
+    FlatIndex index = newNode(builder, node);
+    if (index == FLAT_NONE) return FLAT_NONE;
+
+    FlatNodeData data = {0, 0, 0};
+
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+            splitValue(&((ASTIntegerLiteral*)node)->value, &data);
+            break;
+        case AST_LITERAL_FLOAT:
+            splitValue(&((ASTFloatLiteral*)node)->value, &data);
+            break;
+        case AST_LITERAL_SCALED: {
+            ASTScaledLiteral* scaledNode = (ASTScaledLiteral*)node;
+            splitValue(&scaledNode->value, &data);
+            data.c = (uint32_t)scaledNode->scale;
+            break;
+        }
+        case AST_LITERAL_CHARACTER:
+            data.a = (unsigned char)((ASTCharacterLiteral*)node)->value;
+            break;
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL: {
+            int length;
+            const char* text = literalText(node, &length);
+            data.a = internString(builder, text, length);
+            break;
+        }
+        case AST_LITERAL_ARRAY: {
+            ASTArrayLiteral* arrayNode = (ASTArrayLiteral*)node;
+            data.b = (uint32_t)arrayNode->count;
+            data.c = (uint32_t)arrayNode->packedKind;
+            if (arrayNode->packedKind == PACKED_NONE) {
+                data.a = reserveExtra(builder, (uint32_t)arrayNode->count);
+                if (!builder->failed) flattenList(builder, data.a, arrayNode->elements, arrayNode->count);
+            } else {
+                size_t bytes = arrayNode->packedKind == PACKED_BYTES
+                    ? (size_t)arrayNode->count : (size_t)arrayNode->count * 8;
+                uint32_t words = (uint32_t)((bytes + 3) / 4);
+                data.a = reserveExtra(builder, words);
+                if (!builder->failed && bytes > 0) memcpy(builder->flat->extra + data.a, arrayNode->packed, bytes);
+            }
+            break;
+        }
+        case AST_LITERAL_BYTE_ARRAY: {
+            ASTByteArrayLiteral* byteArrayNode = (ASTByteArrayLiteral*)node;
+            data.a = internString(builder, (const char*)byteArrayNode->bytes, byteArrayNode->count);
+            data.b = (uint32_t)byteArrayNode->count;
+            break;
+        }
+        case AST_CONSTANT:
+            data.a = (uint32_t)((ASTConstantNode*)node)->type;
+            break;
+        case AST_VARIABLE: {
+            ASTVariableNode* varNode = (ASTVariableNode*)node;
+            data.a = internName(builder, varNode->name);
+            data.b = (uint32_t)varNode->isPseudoVariable;
+            break;
+        }
+        case AST_ASSIGNMENT: {
+            ASTAssignmentNode* assignNode = (ASTAssignmentNode*)node;
+            data.a = internName(builder, assignNode->variable);
+            data.b = flattenNode(builder, assignNode->value);
+            break;
+        }
+        case AST_RETURN:
+            data.a = flattenNode(builder, ((ASTReturnNode*)node)->expression);
+            break;
+        case AST_MESSAGE_UNARY: {
+            ASTUnaryMessageNode* msgNode = (ASTUnaryMessageNode*)node;
+            data.a = flattenNode(builder, msgNode->receiver);
+            data.b = internName(builder, msgNode->selector);
+            break;
+        }
+        case AST_MESSAGE_BINARY: {
+            ASTBinaryMessageNode* msgNode = (ASTBinaryMessageNode*)node;
+            data.a = flattenNode(builder, msgNode->message.receiver);
+            data.b = internName(builder, msgNode->message.selector);
+            data.c = flattenNode(builder, msgNode->argument);
+            break;
+        }
+        case AST_MESSAGE_KEYWORD: {
+            ASTKeywordMessageNode* msgNode = (ASTKeywordMessageNode*)node;
+            data.a = flattenNode(builder, msgNode->message.receiver);
+            data.b = internName(builder, msgNode->message.selector);
+            data.c = reserveExtra(builder, 1 + (uint32_t)msgNode->argumentCount);
+            if (builder->failed) break;
+            builder->flat->extra[data.c] = (uint32_t)msgNode->argumentCount;
+            flattenList(builder, data.c + 1, msgNode->arguments, msgNode->argumentCount);
+            break;
+        }
+        case AST_CASCADE: {
+            ASTCascadeNode* cascadeNode = (ASTCascadeNode*)node;
+            data.a = flattenNode(builder, cascadeNode->receiver);
+            data.b = reserveExtra(builder, (uint32_t)cascadeNode->messageCount);
+            data.c = (uint32_t)cascadeNode->messageCount;
+            if (!builder->failed) flattenList(builder, data.b, cascadeNode->messages, cascadeNode->messageCount);
+            break;
+        }
+        case AST_BLOCK: {
+            ASTBlockNode* blockNode = (ASTBlockNode*)node;
+            uint32_t pc = (uint32_t)blockNode->parameterCount;
+            uint32_t tc = (uint32_t)blockNode->temporaryCount;
+            uint32_t sc = (uint32_t)blockNode->statementCount;
+            data.a = reserveExtra(builder, 3 + pc + tc + sc);
+            if (builder->failed) break;
+            builder->flat->extra[data.a] = pc;
+            internNames(builder, data.a + 1, blockNode->parameters, (int)pc);
+            builder->flat->extra[data.a + 1 + pc] = tc;
+            internNames(builder, data.a + 2 + pc, blockNode->temporaries, (int)tc);
+            builder->flat->extra[data.a + 2 + pc + tc] = sc;
+            flattenList(builder, data.a + 3 + pc + tc, blockNode->statements, (int)sc);
+            break;
+        }
+        case AST_ARRAY_EXPRESSION: {
+            ASTArrayExpressionNode* arrayNode = (ASTArrayExpressionNode*)node;
+            data.a = reserveExtra(builder, (uint32_t)arrayNode->count);
+            data.b = (uint32_t)arrayNode->count;
+            if (!builder->failed) flattenList(builder, data.a, arrayNode->expressions, arrayNode->count);
+            break;
+        }
+        case AST_METHOD: {
+            ASTMethodNode* methodNode = (ASTMethodNode*)node;
+            uint32_t pc = (uint32_t)methodNode->parameterCount;
+            uint32_t tc = (uint32_t)methodNode->temporaryCount;
+            uint32_t sc = (uint32_t)methodNode->statementCount;
+            data.a = internName(builder, methodNode->selector);
+            data.b = reserveExtra(builder, 3 + pc + tc + sc);
+            data.c = methodNode->isPrimitive ? (uint32_t)methodNode->primitiveNumber + 1 : 0;
+            if (builder->failed) break;
+            builder->flat->extra[data.b] = pc;
+            internNames(builder, data.b + 1, methodNode->parameters, (int)pc);
+            builder->flat->extra[data.b + 1 + pc] = tc;
+            internNames(builder, data.b + 2 + pc, methodNode->temporaries, (int)tc);
+            builder->flat->extra[data.b + 2 + pc + tc] = sc;
+            flattenList(builder, data.b + 3 + pc + tc, methodNode->statements, (int)sc);
+            break;
+        }
+        default:
+            break;
+    }
+
+    if (builder->failed) return FLAT_NONE;
+    builder->flat->data[index] = data;
+    return index;
+}
+
+FlatAST* flattenAST(ASTNode* root) {
+    FlatAST* flat = (FlatAST*)calloc(1, sizeof(FlatAST));
+    if (flat == NULL) return NULL;
+
+    FlatBuilder builder = {flat, NULL, 0, 0};
+    flattenNode(&builder, root);
+    free(builder.table);
+
+    if (builder.failed) {
+        freeFlatAST(flat);
+        return NULL;
+    }
+
+    return flat;
+}
+
+void freeFlatAST(FlatAST* flat) {
+    if (flat == NULL) return;
+
+    if (flat->mapping != NULL) {
+        munmap(flat->mapping, flat->mappingSize);
+        free(flat);
+        return;
+    }
+
+    free(flat->types);
+    free(flat->spans);
+    free(flat->data);
+    free(flat->extra);
+    free(flat->strings);
+    free(flat->pool);
+    free(flat);
+}
+
+size_t flatASTMemoryUsage(const FlatAST* flat) {
+    return sizeof(FlatAST)
+        + (size_t)flat->nodeCount * (sizeof(unsigned char) + sizeof(SourceSpan) + sizeof(FlatNodeData))
+        + (size_t)flat->extraCount * sizeof(uint32_t)
+        + (size_t)flat->stringCount * sizeof(FlatString)
+        + flat->poolSize;
+}
+
+static int validChild(const FlatAST* flat, FlatIndex parent, FlatIndex child) {
+    // Children come after their parent; validateFlatAST relies on it to check the layout
+    return child == FLAT_NONE || (child > parent && child < flat->nodeCount);
+}
+
+static int validExtra(const FlatAST* flat, uint64_t start, uint64_t count) {
+    return start + count <= flat->extraCount;
+}
+
+static int validChildList(const FlatAST* flat, FlatIndex parent, uint32_t start, uint32_t count) {
+    if (!validExtra(flat, start, count)) return 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!validChild(flat, parent, flat->extra[start + i])) return 0;
+    }
+    return 1;
+}
+
+static int validNameList(const FlatAST* flat, uint32_t start, uint32_t count) {
+    if (!validExtra(flat, start, count)) return 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (flat->extra[start + i] >= flat->stringCount) return 0;
+    }
+    return 1;
+}
+
+// Validate a counted run in the extra array: [count, items...]
+static int validCountedNames(const FlatAST* flat, uint32_t start, uint32_t* next) {
+    if (!validExtra(flat, start, 1)) return 0;
+    uint32_t count = flat->extra[start];
+    if (!validNameList(flat, start + 1, count)) return 0;
+    *next = start + 1 + count;
+    return 1;
+}
+
+static int validCountedChildren(const FlatAST* flat, FlatIndex parent, uint32_t start) {
+    if (!validExtra(flat, start, 1)) return 0;
+    return validChildList(flat, parent, start + 1, flat->extra[start]);
+}
+
+static int validateNode(const FlatAST* flat, FlatIndex index) {
+    const FlatNodeData* data = &flat->data[index];
+    uint32_t next;
+
+    switch ((ASTNodeType)flat->types[index]) {
+        case AST_LITERAL_INTEGER:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_SCALED:
+        case AST_LITERAL_CHARACTER:
+        case AST_CONSTANT:
+            return 1;
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL:
+        case AST_VARIABLE:
+            return data->a < flat->stringCount;
+        case AST_LITERAL_BYTE_ARRAY:
+            return data->a < flat->stringCount && data->b == flat->strings[data->a].length;
+        case AST_LITERAL_ARRAY:
+            if (data->c == PACKED_NONE) return validChildList(flat, index, data->a, data->b);
+            if (data->c == PACKED_BYTES) return validExtra(flat, data->a, ((uint64_t)data->b + 3) / 4);
+            if (data->c == PACKED_INT64 || data->c == PACKED_DOUBLE) return validExtra(flat, data->a, (uint64_t)data->b * 2);
+            return 0;
+        case AST_ASSIGNMENT:
+            return data->a < flat->stringCount && validChild(flat, index, data->b);
+        case AST_RETURN:
+            return validChild(flat, index, data->a);
+        case AST_MESSAGE_UNARY:
+            return validChild(flat, index, data->a) && data->b < flat->stringCount;
+        case AST_MESSAGE_BINARY:
+            return validChild(flat, index, data->a) && data->b < flat->stringCount &&
+                   validChild(flat, index, data->c);
+        case AST_MESSAGE_KEYWORD:
+            return validChild(flat, index, data->a) && data->b < flat->stringCount &&
+                   validCountedChildren(flat, index, data->c);
+        case AST_CASCADE:
+            return validChild(flat, index, data->a) && validChildList(flat, index, data->b, data->c);
+        case AST_BLOCK:
+            return validCountedNames(flat, data->a, &next) &&
+                   validCountedNames(flat, next, &next) &&
+                   validCountedChildren(flat, index, next);
+        case AST_ARRAY_EXPRESSION:
+            return validChildList(flat, index, data->a, data->b);
+        case AST_METHOD:
+            return data->a < flat->stringCount &&
+                   validCountedNames(flat, data->b, &next) &&
+                   validCountedNames(flat, next, &next) &&
+                   validCountedChildren(flat, index, next);
+        default:
+            return 0;
+    }
+}
+
+// Check the pre-order layout: the children of every node tile the index range
+// that follows it, and the root's subtree covers the whole table. So every node
+// but the root is referenced exactly once, and the nodes form a tree, not a DAG.
+// Walking backwards finds where each child's subtree ends before its parent.
+static int validPreOrder(const FlatAST* flat) {
+    if (flat->nodeCount == 0) return 0;
+
+    FlatIndex* ends = (FlatIndex*)malloc(sizeof(FlatIndex) * flat->nodeCount);
+    if (ends == NULL) return 0;
+
+    int valid = 1;
+    for (FlatIndex index = flat->nodeCount; index-- > 0 && valid;) {
+        FlatIndex next = index + 1;
+        int count = flatChildCount(flat, index);
+        for (int i = 0; i < count && valid; i++) {
+            FlatIndex child = flatChild(flat, index, i);
+            if (child == FLAT_NONE) continue;
+            valid = child == next;
+            next = ends[child];
+        }
+        ends[index] = next;
+    }
+
+    valid = valid && ends[0] == flat->nodeCount;
+    free(ends);
+    return valid;
+}
+
+int validateFlatAST(const FlatAST* flat) {
+    for (uint32_t id = 0; id < flat->stringCount; id++) {
+        const FlatString* string = &flat->strings[id];
+        if ((uint64_t)string->offset + string->length >= flat->poolSize) return 0;
+        if (flat->pool[string->offset + string->length] != '\0') return 0;
+    }
+
+    for (FlatIndex index = 0; index < flat->nodeCount; index++) {
+        if (!validateNode(flat, index)) return 0;
+    }
+
+    return validPreOrder(flat);
+}
+
+const char* flatString(const FlatAST* flat, uint32_t id, int* length) {
+    if (length != NULL) *length = (int)flat->strings[id].length;
+    return flat->pool + flat->strings[id].offset;
+}
+
+int flatChildCount(const FlatAST* flat, FlatIndex index) {
+    const FlatNodeData* data = &flat->data[index];
+    const uint32_t* extra = flat->extra;
+
+    switch ((ASTNodeType)flat->types[index]) {
+        case AST_LITERAL_ARRAY:
+            return data->c == PACKED_NONE ? (int)data->b : 0;
+        case AST_ASSIGNMENT:
+        case AST_RETURN:
+        case AST_MESSAGE_UNARY:
+            return 1;
+        case AST_MESSAGE_BINARY:
+            return 2;
+        case AST_MESSAGE_KEYWORD:
+            return 1 + (int)extra[data->c];
+        case AST_CASCADE:
+            return 1 + (int)data->c;
+        case AST_BLOCK: {
+            uint32_t pc = extra[data->a];
+            uint32_t tc = extra[data->a + 1 + pc];
+            return (int)extra[data->a + 2 + pc + tc];
+        }
+        case AST_ARRAY_EXPRESSION:
+            return (int)data->b;
+        case AST_METHOD: {
+            uint32_t pc = extra[data->b];
+            uint32_t tc = extra[data->b + 1 + pc];
+            return (int)extra[data->b + 2 + pc + tc];
+        }
+        default:
+            return 0;
+    }
+}
+
+FlatIndex flatChild(const FlatAST* flat, FlatIndex index, int child) {
+    const FlatNodeData* data = &flat->data[index];
+    const uint32_t* extra = flat->extra;
+
+    switch ((ASTNodeType)flat->types[index]) {
+        case AST_LITERAL_ARRAY:
+            return extra[data->a + child];
+        case AST_ASSIGNMENT:
+            return data->b;
+        case AST_RETURN:
+        case AST_MESSAGE_UNARY:
+            return data->a;
+        case AST_MESSAGE_BINARY:
+            return child == 0 ? data->a : data->c;
+        case AST_MESSAGE_KEYWORD:
+            return child == 0 ? data->a : extra[data->c + child];
+        case AST_CASCADE:
+            return child == 0 ? data->a : extra[data->b + child - 1];
+        case AST_BLOCK: {
+            uint32_t pc = extra[data->a];
+            uint32_t tc = extra[data->a + 1 + pc];
+            return extra[data->a + 3 + pc + tc + child];
+        }
+        case AST_ARRAY_EXPRESSION:
+            return extra[data->a + child];
+        case AST_METHOD: {
+            uint32_t pc = extra[data->b];
+            uint32_t tc = extra[data->b + 1 + pc];
+            return extra[data->b + 3 + pc + tc + child];
+        }
+        default:
+            return FLAT_NONE;
+    }
+}
+
+static double joinDouble(const FlatNodeData* data) {
+    uint64_t bits = (uint64_t)data->a | ((uint64_t)data->b << 32);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Collect name pointers from a run of string ids for the create functions, which copy them
+static char** nameList(const FlatAST* flat, const uint32_t* ids, uint32_t count) {
+    char** names = (char**)malloc(sizeof(char*) * (count > 0 ? count : 1));
+    if (names == NULL) return NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        names[i] = (char*)flatString(flat, ids[i], NULL);
+    }
+    return names;
+}
+
+// Nodes already expanded for the subtree starting at base, by index - base
+typedef struct {
+    ASTNode** nodes;
+    FlatIndex base;
+} Expansion;
+
+static ASTNode* expandedChild(const Expansion* expansion, FlatIndex index) {
+    return index == FLAT_NONE ? NULL : expansion->nodes[index - expansion->base];
+}
+
+static ASTNode** expandedList(const Expansion* expansion, const uint32_t* indices, uint32_t count) {
+    ASTNode** nodes = (ASTNode**)malloc(sizeof(ASTNode*) * (count > 0 ? count : 1));
+    if (nodes == NULL) return NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        nodes[i] = expandedChild(expansion, indices[i]);
+    }
+    return nodes;
+}
+
+// Build one node from its already expanded children, which it takes over on success
+static ASTNode* expandNode(const FlatAST* flat, FlatIndex index, const Expansion* expansion) {
+    const FlatNodeData* data = &flat->data[index];
+    SourceSpan span = flat->spans[index];
+
+    switch ((ASTNodeType)flat->types[index]) {
+        case AST_LITERAL_INTEGER: {
+            uint64_t bits = (uint64_t)data->a | ((uint64_t)data->b << 32);
+            return createIntegerLiteral((long long)bits, span);
+        }
+        case AST_LITERAL_FLOAT:
+            return createFloatLiteral(joinDouble(data), span);
+        case AST_LITERAL_SCALED:
+            return createScaledLiteral(joinDouble(data), (int)data->c, span);
+        case AST_LITERAL_CHARACTER:
+            return createCharacterLiteral((char)data->a, span);
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL: {
+            int length;
+            const char* text = flatString(flat, data->a, &length);
+            return flat->types[index] == AST_LITERAL_STRING
+                ? createStringLiteral(text, length, 0, span)
+                : createSymbolLiteral(text, length, 0, span);
+        }
+        case AST_LITERAL_ARRAY: {
+            if (data->c != PACKED_NONE) {
+                size_t bytes = data->c == PACKED_BYTES ? (size_t)data->b : (size_t)data->b * 8;
+                void* values = malloc(bytes > 0 ? bytes : 1);
+                if (values == NULL) return NULL;
+                memcpy(values, flat->extra + data->a, bytes);
+                return createPackedArrayLiteral((PackedKind)data->c, values, (int)data->b, span);
+            }
+            ASTNode** elements = expandedList(expansion, flat->extra + data->a, data->b);
+            if (elements == NULL) return NULL;
+            ASTNode* node = createArrayLiteral(elements, (int)data->b, span);
+            free(elements);
+            return node;
+        }
+        case AST_LITERAL_BYTE_ARRAY:
+            return createByteArrayLiteral((unsigned char*)flatString(flat, data->a, NULL), (int)data->b, span);
+        case AST_CONSTANT:
+            return createConstantNode((TokenType)data->a, span);
+        case AST_VARIABLE:
+            return createVariableNode(flatString(flat, data->a, NULL), (int)data->b, span);
+        case AST_ASSIGNMENT:
+            return createAssignmentNode(flatString(flat, data->a, NULL), expandedChild(expansion, data->b), span);
+        case AST_RETURN:
+            return createReturnNode(expandedChild(expansion, data->a), span);
+        case AST_MESSAGE_UNARY:
+            return createUnaryMessageNode(expandedChild(expansion, data->a), flatString(flat, data->b, NULL), span);
+        case AST_MESSAGE_BINARY:
+            return createBinaryMessageNode(expandedChild(expansion, data->a), flatString(flat, data->b, NULL),
+                                           expandedChild(expansion, data->c), span);
+        case AST_MESSAGE_KEYWORD: {
+            uint32_t count = flat->extra[data->c];
+            ASTNode** arguments = expandedList(expansion, flat->extra + data->c + 1, count);
+            if (arguments == NULL) return NULL;
+            ASTNode* node = createKeywordMessageNode(expandedChild(expansion, data->a), flatString(flat, data->b, NULL),
+                                                     arguments, (int)count, span);
+            free(arguments);
+            return node;
+        }
+        case AST_CASCADE: {
+            ASTNode** messages = expandedList(expansion, flat->extra + data->b, data->c);
+            if (messages == NULL) return NULL;
+            ASTNode* node = createCascadeNode(expandedChild(expansion, data->a), messages, (int)data->c, span);
+            free(messages);
+            return node;
+        }
+        case AST_BLOCK: {
+            const uint32_t* extra = flat->extra + data->a;
+            uint32_t pc = extra[0];
+            uint32_t tc = extra[1 + pc];
+            uint32_t sc = extra[2 + pc + tc];
+            char** parameters = nameList(flat, extra + 1, pc);
+            char** temporaries = nameList(flat, extra + 2 + pc, tc);
+            ASTNode** statements = expandedList(expansion, extra + 3 + pc + tc, sc);
+            ASTNode* node = NULL;
+            if (parameters != NULL && temporaries != NULL && statements != NULL) {
+                node = createBlockNode(parameters, (int)pc, temporaries, (int)tc,
+                                       statements, (int)sc, span);
+            }
+            free(parameters);
+            free(temporaries);
+            free(statements);
+            return node;
+        }
+        case AST_ARRAY_EXPRESSION: {
+            ASTNode** expressions = expandedList(expansion, flat->extra + data->a, data->b);
+            if (expressions == NULL) return NULL;
+            ASTNode* node = createArrayExpressionNode(expressions, (int)data->b, span);
+            free(expressions);
+            return node;
+        }
+        case AST_METHOD: {
+            const uint32_t* extra = flat->extra + data->b;
+            uint32_t pc = extra[0];
+            uint32_t tc = extra[1 + pc];
+            uint32_t sc = extra[2 + pc + tc];
+            char** parameters = nameList(flat, extra + 1, pc);
+            char** temporaries = nameList(flat, extra + 2 + pc, tc);
+            ASTNode** statements = expandedList(expansion, extra + 3 + pc + tc, sc);
+            ASTNode* node = NULL;
+            if (parameters != NULL && temporaries != NULL && statements != NULL) {
+                node = createMethodNode(flatString(flat, data->a, NULL), parameters, (int)pc,
+                                        temporaries, (int)tc, statements, (int)sc,
+                                        data->c != 0, data->c != 0 ? (int)data->c - 1 : 0, span);
+            }
+            free(parameters);
+            free(temporaries);
+            free(statements);
+            return node;
+        }
+        default:
+            return NULL;
+    }
+}
+
+// The subtree at index ends after the descendant reached through last children
+static FlatIndex subtreeEnd(const FlatAST* flat, FlatIndex index) {
+    for (;;) {
+        FlatIndex last = FLAT_NONE;
+        for (int i = flatChildCount(flat, index) - 1; i >= 0 && last == FLAT_NONE; i--) {
+            last = flatChild(flat, index, i);
+        }
+        if (last == FLAT_NONE) return index + 1;
+        index = last;
+    }
+}
+
+// Expand bottom-up, from the last node of the subtree back to its root, so that
+// every node's children are built before it and deep trees need no recursion
+ASTNode* expandFlatAST(const FlatAST* flat, FlatIndex index) {
+    if (index == FLAT_NONE) return NULL;
+
+    FlatIndex end = subtreeEnd(flat, index);
+    Expansion expansion = {(ASTNode**)calloc(end - index, sizeof(ASTNode*)), index};
+    if (expansion.nodes == NULL) return NULL;
+
+    int failed = 0;
+    for (FlatIndex current = end; current-- > index;) {
+        ASTNode* node = expandNode(flat, current, &expansion);
+        if (node == NULL) {
+            failed = 1;
+            break;
+        }
+        int count = flatChildCount(flat, current);
+        for (int i = 0; i < count; i++) {
+            FlatIndex child = flatChild(flat, current, i);
+            if (child != FLAT_NONE) expansion.nodes[child - index] = NULL;
+        }
+        expansion.nodes[current - index] = node;
+    }
+
+    ASTNode* root = failed ? NULL : expansion.nodes[0];
+    if (failed) {
+        for (FlatIndex i = 0; i < end - index; i++) freeASTNode(expansion.nodes[i]);
+    }
+    free(expansion.nodes);
+    return root;
+}
@@ -0,0 +1,104 @@
+#ifndef FLATAST_H
+#define FLATAST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+/*
+ * Flat, index-based AST. Nodes live in one contiguous table addressed by
+ * 32-bit indices, in pre-order (a node comes before its children, the root
+ * is index 0). Node types and spans are kept in parallel arrays; each
+ * node has a fixed 12-byte record whose fields depend on the type:
+ *
+ *   INTEGER, FLOAT       a/b = low/high 32 bits of the value
+ *   SCALED               a/b = double bits, c = scale
+ *   CHARACTER            a = character
+ *   STRING, SYMBOL       a = string id
+ *   ARRAY                a = extra start, b = count, c = PackedKind; the extra
+ *                        words hold child indices, or the packed raw values
+ *   BYTE_ARRAY           a = string id of the bytes, b = count
+ *   CONSTANT             a = TokenType
+ *   VARIABLE             a = name string id, b = isPseudoVariable
+ *   ASSIGNMENT           a = variable string id, b = value
+ *   RETURN               a = expression
+ *   MESSAGE_UNARY        a = receiver, b = selector string id
+ *   MESSAGE_BINARY       a = receiver, b = selector string id, c = argument
+ *   MESSAGE_KEYWORD      a = receiver, b = selector string id, c = extra start
+ *                        of [count, arguments...]
+ *   CASCADE              a = receiver, b = extra start, c = message count
+ *   BLOCK                a = extra start of [parameter count, ids...,
+ *                        temporary count, ids..., statement count, statements...]
+ *   ARRAY_EXPRESSION     a = extra start, b = count
+ *   METHOD               a = selector string id, b = extra start of
+ *                        [parameter count, ids..., temporary count, ids...,
+ *                        statement count, statements...], c = primitive + 1
+ *                        (0 when not a primitive)
+ *
+ * Names, selectors and literal text are interned once in a shared string
+ * pool and referred to by id. Absent children are FLAT_NONE.
+ *
+ * Because of the pre-order layout every subtree occupies a contiguous index
+ * range starting at its root, so analyses that do not care about nesting can
+ * walk the whole tree as a linear pass over the parallel arrays.
+ */
+
+typedef uint32_t FlatIndex;
+
+#define FLAT_NONE 0xFFFFFFFFu
+
+typedef struct {
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+} FlatNodeData;
+
+/* Location of an interned string in the pool; strings are NUL-terminated */
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} FlatString;
+
+typedef struct {
+    uint32_t nodeCount;
+    uint32_t nodeCapacity;
+    unsigned char* types;       /* ASTNodeType per node */
+    SourceSpan* spans;          /* Source range per node */
+    FlatNodeData* data;
+
+    uint32_t extraCount;
+    uint32_t extraCapacity;
+    uint32_t* extra;            /* Child lists and other variable-length data */
+
+    uint32_t stringCount;
+    uint32_t stringCapacity;
+    FlatString* strings;
+
+    uint32_t poolSize;
+    uint32_t poolCapacity;
+    char* pool;
+
+    /* Non-NULL when the arrays point into a mapped cache file instead of the heap */
+    void* mapping;
+    size_t mappingSize;
+} FlatAST;
+
+FlatAST* flattenAST(ASTNode* root);
+void freeFlatAST(FlatAST* flat);
+size_t flatASTMemoryUsage(const FlatAST* flat);
+/* Check that every index, string id and extra range is in bounds and that the
+ * nodes form one tree in pre-order, each referenced exactly once, so a tree
+ * read from disk can be navigated without further checks. Answers 1 if valid. */
+int validateFlatAST(const FlatAST* flat);
+
+/* Navigation */
+const char* flatString(const FlatAST* flat, uint32_t id, int* length);
+int flatChildCount(const FlatAST* flat, FlatIndex index);
+FlatIndex flatChild(const FlatAST* flat, FlatIndex index, int child);
+
+/* Rebuild a pointer AST for consumers such as printAST, without recursion, from
+ * a tree in pre-order. String and symbol nodes point into the flat AST's string
+ * pool, so it must outlive the result. Answers NULL when out of memory. */
+ASTNode* expandFlatAST(const FlatAST* flat, FlatIndex index);
+
+#endif /* FLATAST_H */
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "parser.h"
+#include "chunks.h"
+#include "flatast.h"
+#include "merkle.h"
+#include "formatter.h"
+#include "fileio.h"
+
+// Source formatter: formats files in parallel and prints, lists or rewrites
+// them. With verification, which rewriting always uses, every result is
+// parsed again and compared with its input through structural hashes; a
+// file whose formatted text would not give back the same trees is reported
+// and left alone.
+
+typedef enum {
+    MODE_PRINT,     // Formatted sources to stdout, in file order
+    MODE_CHECK,     // Names of the files that would change
+    MODE_WRITE      // Rewrite the files that change
+} FormatMode;
+
+typedef enum {
+    FILE_FAILED,
+    FILE_UNCHANGED,
+    FILE_CHANGED
+} FileStatus;
+
+typedef struct {
+    OutputBuffer text;      // Formatted source, kept until printed
+    FileStatus status;
+} FileResult;
+
+typedef struct {
+    char** paths;
+    int fileCount;
+    atomic_int nextFile;
+    FormatOptions options;
+    FormatMode mode;
+    int verify;
+    FileResult* results;
+} FormatJob;
+
+static uint64_t mixHash(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+static int addTreeHash(ASTNode* ast, uint64_t* fingerprint) {
+    FlatAST* flat = flattenAST(ast);
+    if (flat == NULL) return 0;
+
+    MerkleHashes hashes;
+    int ok = computeMerkleHashes(flat, 0, &hashes);
+    if (ok) {
+        *fingerprint = mixHash(*fingerprint, flat->nodeCount > 0 ? hashes.hashes[0] : 0);
+        freeMerkleHashes(&hashes);
+    }
+    freeFlatAST(flat);
+    return ok;
+}
+
+// Combined structural hash of the trees parsed from source: the whole file,
+// or each chunk of a fileout in order. Answers 0 if it does not parse.
+static int treeFingerprint(const char* source, size_t length, uint64_t* fingerprint) {
+    *fingerprint = 0;
+
+    if (!containsMethodChunks(source, length)) {
+        Parser parser;
+        initParser(&parser, source);
+        ASTNode* ast = parse(&parser);
+        int ok = !parser.hadError && ast != NULL && addTreeHash(ast, fingerprint);
+        freeASTNode(ast);
+        return ok;
+    }
+
+    ChunkScanner scanner;
+    SourceChunk chunk;
+    int ok = 1;
+    initChunkScanner(&scanner, source, length);
+    while (ok && nextChunk(&scanner, &chunk)) {
+        *fingerprint = mixHash(*fingerprint, chunk.kind);
+        if (chunk.kind == CHUNK_COMMENT) continue;
+
+        int hadError = 0;
+        char* text = NULL;
+        ASTNode* ast = parseChunk(&chunk, &text, &hadError);
+        ok = !hadError && ast != NULL && addTreeHash(ast, fingerprint);
+        freeASTNode(ast);
+        free(text);
+    }
+    return ok;
+}
+
+static void processFile(FormatJob* job, int file) {
+    const char* path = job->paths[file];
+    FileResult* result = &job->results[file];
+    result->status = FILE_FAILED;
+
+    char* source = readFile(path);
+    if (source == NULL) return;
+    size_t length = strlen(source);
+
+    OutputBuffer* text = &result->text;
+    if (!initOutputBuffer(text, NULL, length + length / 4 + 64)) {
+        fprintf(stderr, "Not enough memory to format %s.\n", path);
+        free(source);
+        return;
+    }
+
+    uint64_t before;
+    uint64_t after;
+    if (!formatSource(text, source, length, &job->options)) {
+        fprintf(stderr, "Skipping %s: parse failed.\n", path);
+    } else {
+        // NUL-terminate the result for the parser without counting the NUL
+        writeChar(text, '\0');
+        text->length--;
+
+        if (text->failed || (job->verify && (!treeFingerprint(source, length, &before) ||
+            !treeFingerprint(text->data, text->length, &after) || before != after))) {
+            fprintf(stderr, "Skipping %s: the formatted code does not parse to the same trees.\n", path);
+        } else if (text->length == length && memcmp(text->data, source, length) == 0) {
+            result->status = FILE_UNCHANGED;
+        } else {
+            result->status = FILE_CHANGED;
+        }
+    }
+
+    if (job->mode == MODE_WRITE && result->status == FILE_CHANGED &&
+        !writeFileAtomically(path, text->data, text->length)) {
+        fprintf(stderr, "Could not write %s.\n", path);
+        result->status = FILE_FAILED;
+    }
+    if (job->mode != MODE_PRINT || result->status == FILE_FAILED) {
+        freeOutputBuffer(text);
+    }
+    free(source);
+}
+
+static void* formatWorkerMain(void* argument) {
+    FormatJob* job = (FormatJob*)argument;
+
+    for (;;) {
+        int file = atomic_fetch_add(&job->nextFile, 1);
+        if (file >= job->fileCount) break;
+        processFile(job, file);
+    }
+    return NULL;
+}
+
+static void printUsage(const char* programName) {
+    printf("Usage: %s [options] <file>...\n", programName);
+    printf("Format Smalltalk sources. Without files, paths are read from stdin.\n");
+    printf("Options:\n");
+    printf("  -h, --help             Display this help message\n");
+    printf("  --width N              Line width (default 80)\n");
+    printf("  --indent N             Columns per indentation level (default 4)\n");
+    printf("  --spaces               Indent with spaces instead of tabs\n");
+    printf("  --cascade fit|break    Cascades on one line when they fit, or one message\n");
+    printf("                         per line (default break)\n");
+    printf("  --keywords fit|break   Keyword messages on one line when they fit, or one\n");
+    printf("                         keyword per line (default fit)\n");
+    printf("  --threads N            Worker threads (default: one per CPU)\n");
+    printf("  --check                List the files that are not formatted; exit status 1 if any\n");
+    printf("  --write                Rewrite the files that are not formatted (implies --verify)\n");
+    printf("  --verify               Check that the formatted code parses to the same trees\n");
+}
+
+// Answers 0 for "fit", 1 for "break" and -1 for anything else
+static int parseLayout(const char* name) {
+    if (strcmp(name, "fit") == 0) return 0;
+    if (strcmp(name, "break") == 0) return 1;
+    return -1;
+}
+
+int main(int argc, char* argv[]) {
+    FormatJob job;
+    initFormatOptions(&job.options);
+    job.mode = MODE_PRINT;
+    job.verify = 0;
+    job.paths = NULL;
+    job.fileCount = 0;
+    atomic_init(&job.nextFile, 0);
+
+    long threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    char** paths = (char**)malloc(sizeof(char*) * (argc > 1 ? argc : 1));
+    if (paths == NULL) return 2;
+    int pathCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        int layout = 0;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            free(paths);
+            return 0;
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            job.options.lineWidth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--indent") == 0 && i + 1 < argc) {
+            job.options.indentWidth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--spaces") == 0) {
+            job.options.useTabs = 0;
+        } else if (strcmp(argv[i], "--cascade") == 0 && i + 1 < argc &&
+                   (layout = parseLayout(argv[i + 1])) >= 0) {
+            job.options.cascadeLayout = layout ? CASCADE_BREAK : CASCADE_FIT;
+            i++;
+        } else if (strcmp(argv[i], "--keywords") == 0 && i + 1 < argc &&
+                   (layout = parseLayout(argv[i + 1])) >= 0) {
+            job.options.keywordLayout = layout ? KEYWORD_BREAK : KEYWORD_FIT;
+            i++;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--check") == 0) {
+            job.mode = MODE_CHECK;
+        } else if (strcmp(argv[i], "--write") == 0) {
+            job.mode = MODE_WRITE;
+            job.verify = 1;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            job.verify = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            fprintf(stderr, "Unknown or incomplete option %s.\n", argv[i]);
+            printUsage(argv[0]);
+            free(paths);
+            return 2;
+        } else {
+            paths[pathCount++] = argv[i];
+        }
+    }
+
+    if (job.options.lineWidth < 1) job.options.lineWidth = 1;
+    if (job.options.indentWidth < 0) job.options.indentWidth = 0;
+
+    int ownsPaths = 0;
+    if (pathCount == 0) {
+        free(paths);
+        paths = readPathList(&pathCount);
+        ownsPaths = 1;
+    }
+    if (pathCount == 0) {
+        fprintf(stderr, "No source files specified.\n");
+        printUsage(argv[0]);
+        free(paths);
+        return 2;
+    }
+    job.paths = paths;
+    job.fileCount = pathCount;
+
+    if (threadCount < 1) threadCount = 1;
+    if (threadCount > pathCount) threadCount = pathCount;
+
+    job.results = (FileResult*)calloc((size_t)pathCount, sizeof(FileResult));
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    if (job.results == NULL || threads == NULL) {
+        fprintf(stderr, "Not enough memory.\n");
+        return 2;
+    }
+
+    long started = 0;
+    for (long i = 0; i < threadCount; i++) {
+        if (pthread_create(&threads[i], NULL, formatWorkerMain, &job) != 0) break;
+        started++;
+    }
+    if (started == 0) {
+        // Fall back to working on this thread
+        formatWorkerMain(&job);
+    }
+    for (long i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int failed = 0;
+    int changed = 0;
+    for (int i = 0; i < pathCount; i++) {
+        FileResult* result = &job.results[i];
+        if (result->status == FILE_FAILED) {
+            failed++;
+            continue;
+        }
+        if (result->status == FILE_CHANGED) {
+            changed++;
+            if (job.mode == MODE_CHECK) printf("%s\n", paths[i]);
+        }
+        if (job.mode == MODE_PRINT) {
+            fwrite(result->text.data, 1, result->text.length, stdout);
+            freeOutputBuffer(&result->text);
+        }
+    }
+    if (job.mode != MODE_PRINT) {
+        fprintf(stderr, "%d files, %d %s, %d failed\n", pathCount, changed,
+                job.mode == MODE_WRITE ? "rewritten" : "not formatted", failed);
+    }
+
+    free(job.results);
+    free(threads);
+    if (ownsPaths) {
+        for (int i = 0; i < pathCount; i++) free(paths[i]);
+    }
+    free(paths);
+
+    if (failed > 0) return 2;
+    return job.mode == MODE_CHECK && changed > 0 ? 1 : 0;
+}
@@ -0,0 +1,805 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include "formatter.h"
+#include "parser.h"
+#include "chunks.h"
+
+// How loosely an expression binds. An operand whose precedence is above
+// what its position allows is written in parentheses.
+enum {
+    PRECEDENCE_PRIMARY,
+    PRECEDENCE_UNARY,
+    PRECEDENCE_BINARY,
+    PRECEDENCE_KEYWORD,
+    PRECEDENCE_CASCADE,
+    PRECEDENCE_STATEMENT    // Assignments and returns
+};
+
+#define NO_OFFSET UINT_MAX
+
+typedef struct {
+    unsigned int start;     // Offset of the opening '"'
+    unsigned int length;    // Including both quotes
+} Comment;
+
+typedef struct {
+    OutputBuffer* out;
+    const FormatOptions* options;
+    const char* source;
+    unsigned int length;
+    Comment* comments;
+    int commentCount;
+    int nextComment;        // First comment not written yet
+    int column;
+    int fitting;            // Inside a one-line attempt
+    int overflow;           // The attempt needed a newline or passed the line width
+} Formatter;
+
+// Output position to roll back to
+typedef struct {
+    size_t length;
+    int column;
+    int nextComment;
+} FormatMark;
+
+// Line state of a statement sequence
+typedef struct {
+    int indent;
+    int needBreak;          // Something is already on the current line
+    unsigned int previousEnd;   // Source offset after the last item, for blank lines
+} BodyLines;
+
+static const char* binaryChars = "~!@%&*-+=|\\<>,?/";
+
+static void formatExpression(Formatter* f, ASTNode* node, int maxPrecedence, int indent);
+
+void initFormatOptions(FormatOptions* options) {
+    options->lineWidth = 80;
+    options->indentWidth = 4;
+    options->useTabs = 1;
+    options->cascadeLayout = CASCADE_BREAK;
+    options->keywordLayout = KEYWORD_FIT;
+}
+
+// Comments are found with one scan of the source, skipping strings, quoted
+// symbols and character literals, any of which may hold a '"'
+static int collectComments(Formatter* f) {
+    const char* p = f->source;
+    const char* end = f->source + f->length;
+    int capacity = 0;
+
+    while (p < end) {
+        switch (*p) {
+            case '\'':
+                p++;
+                for (;;) {
+                    while (p < end && *p != '\'') p++;
+                    if (p + 1 < end && p[1] == '\'') {
+                        p += 2;
+                        continue;
+                    }
+                    break;
+                }
+                if (p < end) p++;
+                break;
+            case '$':
+                p += p + 1 < end ? 2 : 1;
+                break;
+            case '"': {
+                const char* start = p++;
+                while (p < end && *p != '"') p++;
+                if (p < end) p++;
+
+                if (f->commentCount == capacity) {
+                    capacity = capacity < 64 ? 64 : capacity * 2;
+                    Comment* comments = (Comment*)realloc(f->comments, sizeof(Comment) * capacity);
+                    if (comments == NULL) return 0;
+                    f->comments = comments;
+                }
+                f->comments[f->commentCount].start = (unsigned int)(start - f->source);
+                f->comments[f->commentCount].length = (unsigned int)(p - start);
+                f->commentCount++;
+                break;
+            }
+            default:
+                p++;
+                break;
+        }
+    }
+    return 1;
+}
+
+static unsigned int spanEnd(ASTNode* node) {
+    return node->span.start + node->span.length;
+}
+
+// Whether the source has an empty line between two offsets
+static int hasBlankLine(Formatter* f, unsigned int from, unsigned int to) {
+    int newlines = 0;
+    for (unsigned int i = from; i < to && i < f->length; i++) {
+        char c = f->source[i];
+        if (c == '\n') {
+            if (++newlines == 2) return 1;
+        } else if (c != ' ' && c != '\t' && c != '\r') {
+            newlines = 0;
+        }
+    }
+    return 0;
+}
+
+// Output. Every write keeps track of the column; inside an attempt, a
+// newline or a column past the width ends the attempt, after which nothing
+// more is written until it is rolled back.
+
+static void advanceColumn(Formatter* f, const char* text, size_t length) {
+    size_t i = length;
+    while (i > 0 && text[i - 1] != '\n') i--;
+
+    if (i > 0) {
+        f->column = (int)(length - i);
+        if (f->fitting) f->overflow = 1;
+    } else {
+        f->column += (int)length;
+    }
+    if (f->fitting && f->column > f->options->lineWidth) f->overflow = 1;
+}
+
+static void put(Formatter* f, const char* text, size_t length) {
+    if (f->overflow) return;
+    writeBytes(f->out, text, length);
+    advanceColumn(f, text, length);
+}
+
+static void putString(Formatter* f, const char* text) {
+    put(f, text, strlen(text));
+}
+
+static void putChar(Formatter* f, char c) {
+    put(f, &c, 1);
+}
+
+static void putInteger(Formatter* f, long long value) {
+    if (f->overflow) return;
+    size_t start = f->out->length;
+    writeInteger(f->out, value);
+    advanceColumn(f, f->out->data + start, f->out->length - start);
+}
+
+// Shortest text that reads back as the same value, always with a decimal
+// point and with a plain exponent: 1.0e300 rather than 1e+300
+static void putFloat(Formatter* f, double value) {
+    // Infinities come from literals too large for a double, such as 1e999
+    if (isinf(value)) {
+        putString(f, value < 0 ? "-1.0e999" : "1.0e999");
+        return;
+    }
+
+    char digits[40];
+    snprintf(digits, sizeof(digits), "%.15g", value);
+    if (strtod(digits, NULL) != value) snprintf(digits, sizeof(digits), "%.17g", value);
+
+    char text[48];
+    size_t mantissa = strcspn(digits, "e");
+    size_t length = mantissa;
+    memcpy(text, digits, mantissa);
+    if (strcspn(digits, ".") >= mantissa) {
+        memcpy(text + length, ".0", 2);
+        length += 2;
+    }
+    if (digits[mantissa] == 'e') {
+        const char* exponent = digits + mantissa + 1;
+        text[length++] = 'e';
+        if (*exponent == '-') text[length++] = *exponent;
+        if (*exponent == '-' || *exponent == '+') exponent++;
+        while (*exponent == '0' && exponent[1] != '\0') exponent++;
+        while (*exponent != '\0') text[length++] = *exponent++;
+    }
+    put(f, text, length);
+}
+
+// Scaled decimals need a decimal point, so they are written in fixed
+// notation with the fewest digits that read back as the same value
+static void putScaled(Formatter* f, double value, int scale) {
+    char text[720];
+    int length = 0;
+    for (int digits = 1; digits <= 340; digits++) {
+        length = snprintf(text, sizeof(text), "%.*f", digits, value);
+        if (length < 0 || length >= (int)sizeof(text) || strtod(text, NULL) == value) break;
+    }
+    if (length < 0 || length >= (int)sizeof(text)) {
+        length = snprintf(text, sizeof(text), "%.1f", 0.0);
+    }
+    length += snprintf(text + length, sizeof(text) - length, "s%d", scale);
+    put(f, text, (size_t)length);
+}
+
+static void putIndent(Formatter* f, int indent) {
+    if (f->options->useTabs) {
+        for (int i = 0; i < indent; i++) writeChar(f->out, '\t');
+    } else {
+        writeSpaces(f->out, indent * f->options->indentWidth);
+    }
+    f->column = indent * f->options->indentWidth;
+}
+
+static void newline(Formatter* f, int indent) {
+    if (f->overflow) return;
+    if (f->fitting) {
+        f->overflow = 1;
+        return;
+    }
+    writeChar(f->out, '\n');
+    putIndent(f, indent);
+}
+
+static void markPosition(Formatter* f, FormatMark* mark) {
+    mark->length = f->out->length;
+    mark->column = f->column;
+    mark->nextComment = f->nextComment;
+}
+
+static void rollBack(Formatter* f, const FormatMark* mark) {
+    f->out->length = mark->length;
+    f->column = mark->column;
+    f->nextComment = mark->nextComment;
+    f->overflow = 0;
+}
+
+// A one-line attempt: begin, write the one-line form, then end. Ending
+// answers 1 if it fitted; otherwise the attempt is rolled back.
+static void beginAttempt(Formatter* f, FormatMark* mark) {
+    markPosition(f, mark);
+    f->fitting++;
+}
+
+static int endAttempt(Formatter* f, const FormatMark* mark) {
+    f->fitting--;
+    if (!f->overflow) return 1;
+    rollBack(f, mark);
+    return 0;
+}
+
+// Literals
+
+// Whether a symbol can follow '#' without quotes, by the lexer's rules
+static int isPlainSymbol(const char* text, int length) {
+    const char* p = text;
+    const char* end = text + length;
+    if (length == 0) return 0;
+
+    if (isalpha((unsigned char)*p) || *p == '_') {
+        while (p < end && (isalnum((unsigned char)*p) || *p == '_')) p++;
+        if (p < end && *p == ':') {
+            p++;
+            while (p < end && (isalpha((unsigned char)*p) || *p == '_')) {
+                while (p < end && (isalnum((unsigned char)*p) || *p == '_')) p++;
+                if (p < end && *p == ':') p++; else break;
+            }
+        }
+        return p == end;
+    }
+
+    while (p < end && strchr(binaryChars, *p) != NULL) p++;
+    return p == end && length <= 3;
+}
+
+// String and symbol nodes view their text still escaped, so it is written
+// back as it is
+static void putQuoted(Formatter* f, const char* prefix, ASTStringLiteral* node) {
+    putString(f, prefix);
+    put(f, node->start, (size_t)node->length);
+    putChar(f, '\'');
+}
+
+static void putSymbol(Formatter* f, ASTSymbolLiteral* node) {
+    if (isPlainSymbol(node->start, node->length)) {
+        putChar(f, '#');
+        put(f, node->start, (size_t)node->length);
+    } else {
+        putQuoted(f, "#'", node);
+    }
+}
+
+static void formatElement(Formatter* f, ASTNode* node, int index, int indent) {
+    if (node->type == AST_LITERAL_BYTE_ARRAY) {
+        putInteger(f, ((ASTByteArrayLiteral*)node)->bytes[index]);
+        return;
+    }
+
+    ASTArrayLiteral* array = (ASTArrayLiteral*)node;
+    switch (array->packedKind) {
+        case PACKED_INT64:
+            putInteger(f, ((long long*)array->packed)[index]);
+            break;
+        case PACKED_DOUBLE:
+            putFloat(f, ((double*)array->packed)[index]);
+            break;
+        case PACKED_BYTES:
+            putInteger(f, ((unsigned char*)array->packed)[index]);
+            break;
+        default:
+            formatExpression(f, array->elements[index], PRECEDENCE_PRIMARY, indent);
+            break;
+    }
+}
+
+// Elements are separated by spaces; one that does not fit on the line
+// starts a new line, one level deeper
+static void formatElements(Formatter* f, ASTNode* node, int count, const char* open, char close, int indent) {
+    putString(f, open);
+    for (int i = 0; i < count && !f->overflow; i++) {
+        if (i == 0 || f->fitting) {
+            if (i > 0) putChar(f, ' ');
+            formatElement(f, node, i, indent + 1);
+            continue;
+        }
+
+        FormatMark mark;
+        beginAttempt(f, &mark);
+        putChar(f, ' ');
+        formatElement(f, node, i, indent + 1);
+        if (!endAttempt(f, &mark)) {
+            newline(f, indent + 1);
+            formatElement(f, node, i, indent + 1);
+        }
+    }
+    putChar(f, close);
+}
+
+// Statement sequences
+
+// Start the line of the next item of a body, keeping a blank line that
+// separated it from the previous item in the source
+static void startLine(Formatter* f, BodyLines* lines, unsigned int start) {
+    if (lines->needBreak) {
+        writeChar(f->out, '\n');
+        if (lines->previousEnd != NO_OFFSET && hasBlankLine(f, lines->previousEnd, start)) {
+            writeChar(f->out, '\n');
+        }
+        putIndent(f, lines->indent);
+    }
+    lines->needBreak = 1;
+}
+
+// Comments before the given offset, one per line
+static void formatComments(Formatter* f, BodyLines* lines, unsigned int before) {
+    while (f->nextComment < f->commentCount && f->comments[f->nextComment].start < before) {
+        Comment* comment = &f->comments[f->nextComment++];
+        startLine(f, lines, comment->start);
+        put(f, f->source + comment->start, comment->length);
+        lines->previousEnd = comment->start + comment->length;
+    }
+}
+
+// Statements one per line, separated by periods, each after the comments
+// in front of it; the comments left before end close the body
+static void formatBody(Formatter* f, BodyLines* lines, ASTNode** statements, int count, unsigned int end) {
+    for (int i = 0; i < count; i++) {
+        if (statements[i] == NULL) continue;
+        formatComments(f, lines, statements[i]->span.start);
+        startLine(f, lines, statements[i]->span.start);
+        formatExpression(f, statements[i], PRECEDENCE_STATEMENT, lines->indent);
+        if (i < count - 1) putChar(f, '.');
+        lines->previousEnd = spanEnd(statements[i]);
+    }
+    formatComments(f, lines, end);
+}
+
+// Messages. The receiver is NULL for the first message of a cascade part.
+
+static void formatUnary(Formatter* f, ASTUnaryMessageNode* node, int indent) {
+    if (node->receiver != NULL) {
+        formatExpression(f, node->receiver, PRECEDENCE_UNARY, indent);
+        putChar(f, ' ');
+    }
+    putString(f, node->selector);
+}
+
+static void formatBinary(Formatter* f, ASTBinaryMessageNode* node, int indent) {
+    if (node->message.receiver != NULL) {
+        formatExpression(f, node->message.receiver, PRECEDENCE_BINARY, indent);
+        putChar(f, ' ');
+    }
+    putString(f, node->message.selector);
+    putChar(f, ' ');
+    formatExpression(f, node->argument, PRECEDENCE_UNARY, indent);
+}
+
+// Keyword parts follow the receiver on its line, or with broken set, every
+// part after the first starts a line of its own
+static void formatKeywordParts(Formatter* f, ASTKeywordMessageNode* node, int broken, int indent) {
+    int argumentIndent = broken ? indent + 1 : indent;
+    if (node->message.receiver != NULL) {
+        formatExpression(f, node->message.receiver, PRECEDENCE_BINARY, indent);
+        putChar(f, ' ');
+    }
+
+    const char* part = node->message.selector;
+    for (int i = 0; i < node->argumentCount && !f->overflow; i++) {
+        const char* colon = strchr(part, ':');
+        size_t length = colon != NULL ? (size_t)(colon - part + 1) : strlen(part);
+
+        if (i > 0) {
+            if (broken) newline(f, indent + 1); else putChar(f, ' ');
+        }
+        put(f, part, length);
+        putChar(f, ' ');
+        formatExpression(f, node->arguments[i], PRECEDENCE_BINARY, argumentIndent);
+        part += length;
+    }
+}
+
+static void formatKeyword(Formatter* f, ASTKeywordMessageNode* node, int indent) {
+    int canBreak = node->argumentCount >= 2;
+    int mustBreak = canBreak && f->options->keywordLayout == KEYWORD_BREAK;
+
+    if (f->fitting) {
+        if (mustBreak) f->overflow = 1; else formatKeywordParts(f, node, 0, indent);
+        return;
+    }
+    if (!mustBreak) {
+        FormatMark mark;
+        beginAttempt(f, &mark);
+        formatKeywordParts(f, node, 0, indent);
+        if (endAttempt(f, &mark)) return;
+    }
+    formatKeywordParts(f, node, canBreak, indent);
+}
+
+static ASTNode* messageReceiver(ASTNode* message) {
+    return ((ASTMessageNode*)message)->receiver;
+}
+
+// The cascade receiver has to bind tighter than the first message it gets
+static int cascadeReceiverPrecedence(ASTCascadeNode* node) {
+    ASTNode* first = node->messageCount > 0 ? node->messages[0] : NULL;
+    while (isMessageNode(first) && isMessageNode(messageReceiver(first))) first = messageReceiver(first);
+    return first != NULL && first->type == AST_MESSAGE_UNARY ? PRECEDENCE_UNARY : PRECEDENCE_BINARY;
+}
+
+static void formatCascadeParts(Formatter* f, ASTCascadeNode* node, int broken, int indent) {
+    formatExpression(f, node->receiver, cascadeReceiverPrecedence(node), indent);
+    for (int i = 0; i < node->messageCount && !f->overflow; i++) {
+        if (broken) {
+            if (i > 0) putChar(f, ';');
+            newline(f, indent + 1);
+        } else {
+            putString(f, i > 0 ? "; " : " ");
+        }
+        formatExpression(f, node->messages[i], PRECEDENCE_KEYWORD, broken ? indent + 1 : indent);
+    }
+}
+
+static void formatCascade(Formatter* f, ASTCascadeNode* node, int indent) {
+    int mustBreak = f->options->cascadeLayout == CASCADE_BREAK;
+
+    if (f->fitting) {
+        if (mustBreak) f->overflow = 1; else formatCascadeParts(f, node, 0, indent);
+        return;
+    }
+    if (!mustBreak) {
+        FormatMark mark;
+        beginAttempt(f, &mark);
+        formatCascadeParts(f, node, 0, indent);
+        if (endAttempt(f, &mark)) return;
+    }
+    formatCascadeParts(f, node, 1, indent);
+}
+
+// Temporary declarations: | a b |
+static void putTemporaries(Formatter* f, char** names, int count) {
+    putChar(f, '|');
+    for (int i = 0; i < count; i++) {
+        putChar(f, ' ');
+        putString(f, names[i]);
+    }
+    putString(f, " |");
+}
+
+// Blocks
+
+static void formatBlockHead(Formatter* f, ASTBlockNode* node) {
+    putChar(f, '[');
+    for (int i = 0; i < node->parameterCount; i++) {
+        putString(f, i > 0 ? " :" : ":");
+        putString(f, node->parameters[i]);
+    }
+    if (node->parameterCount > 0) putString(f, " |");
+    if (node->temporaryCount > 0) {
+        if (node->parameterCount > 0) putChar(f, ' ');
+        putTemporaries(f, node->temporaries, node->temporaryCount);
+    }
+}
+
+static void formatBlockLine(Formatter* f, ASTBlockNode* node, int indent) {
+    formatBlockHead(f, node);
+    if (node->statementCount == 1) {
+        if (node->parameterCount > 0 || node->temporaryCount > 0) putChar(f, ' ');
+        formatExpression(f, node->statements[0], PRECEDENCE_STATEMENT, indent);
+    }
+    putChar(f, ']');
+}
+
+// A block of at most one statement and no comments may go on one line;
+// anything else has a line per statement, with the ']' after the last one
+static void formatBlock(Formatter* f, ASTBlockNode* node, int indent) {
+    unsigned int end = spanEnd(&node->base);
+    int hasComments = f->nextComment < f->commentCount && f->comments[f->nextComment].start < end;
+    int oneLine = node->statementCount <= 1 && !hasComments;
+
+    if (f->fitting) {
+        if (oneLine) formatBlockLine(f, node, indent); else f->overflow = 1;
+        return;
+    }
+    if (oneLine) {
+        FormatMark mark;
+        beginAttempt(f, &mark);
+        formatBlockLine(f, node, indent);
+        if (endAttempt(f, &mark)) return;
+    }
+
+    formatBlockHead(f, node);
+    BodyLines lines = {indent + 1, 1, NO_OFFSET};
+    formatBody(f, &lines, node->statements, node->statementCount, end);
+    putChar(f, ']');
+}
+
+static void formatArrayExpression(Formatter* f, ASTArrayExpressionNode* node, int indent) {
+    putChar(f, '{');
+    for (int i = 0; i < node->count && !f->overflow; i++) {
+        if (i > 0) putString(f, ". ");
+        formatExpression(f, node->expressions[i], PRECEDENCE_STATEMENT, indent);
+    }
+    putChar(f, '}');
+}
+
+static int precedence(ASTNode* node) {
+    switch (node->type) {
+        case AST_MESSAGE_UNARY: return PRECEDENCE_UNARY;
+        case AST_MESSAGE_BINARY: return PRECEDENCE_BINARY;
+        case AST_MESSAGE_KEYWORD: return PRECEDENCE_KEYWORD;
+        case AST_CASCADE: return PRECEDENCE_CASCADE;
+        case AST_ASSIGNMENT:
+        case AST_RETURN: return PRECEDENCE_STATEMENT;
+        default: return PRECEDENCE_PRIMARY;
+    }
+}
+
+static void formatNode(Formatter* f, ASTNode* node, int indent) {
+    switch (node->type) {
+        case AST_LITERAL_INTEGER:
+            putInteger(f, ((ASTIntegerLiteral*)node)->value);
+            break;
+        case AST_LITERAL_FLOAT:
+            putFloat(f, ((ASTFloatLiteral*)node)->value);
+            break;
+        case AST_LITERAL_SCALED:
+            putScaled(f, ((ASTScaledLiteral*)node)->value, ((ASTScaledLiteral*)node)->scale);
+            break;
+        case AST_LITERAL_CHARACTER: {
+            char text[2] = {'$', ((ASTCharacterLiteral*)node)->value};
+            put(f, text, 2);
+            break;
+        }
+        case AST_LITERAL_STRING:
+            putQuoted(f, "'", (ASTStringLiteral*)node);
+            break;
+        case AST_LITERAL_SYMBOL:
+            putSymbol(f, (ASTSymbolLiteral*)node);
+            break;
+        case AST_LITERAL_ARRAY:
+            formatElements(f, node, ((ASTArrayLiteral*)node)->count, "#(", ')', indent);
+            break;
+        case AST_LITERAL_BYTE_ARRAY:
+            formatElements(f, node, ((ASTByteArrayLiteral*)node)->count, "#[", ']', indent);
+            break;
+        case AST_CONSTANT: {
+            TokenType type = ((ASTConstantNode*)node)->type;
+            putString(f, type == TOKEN_NIL ? "nil" : type == TOKEN_TRUE ? "true" : "false");
+            break;
+        }
+        case AST_VARIABLE:
+            putString(f, ((ASTVariableNode*)node)->name);
+            break;
+        case AST_ASSIGNMENT:
+            putString(f, ((ASTAssignmentNode*)node)->variable);
+            putString(f, " := ");
+            formatExpression(f, ((ASTAssignmentNode*)node)->value, PRECEDENCE_STATEMENT, indent);
+            break;
+        case AST_RETURN:
+            putChar(f, '^');
+            formatExpression(f, ((ASTReturnNode*)node)->expression, PRECEDENCE_STATEMENT, indent);
+            break;
+        case AST_MESSAGE_UNARY:
+            formatUnary(f, (ASTUnaryMessageNode*)node, indent);
+            break;
+        case AST_MESSAGE_BINARY:
+            formatBinary(f, (ASTBinaryMessageNode*)node, indent);
+            break;
+        case AST_MESSAGE_KEYWORD:
+            formatKeyword(f, (ASTKeywordMessageNode*)node, indent);
+            break;
+        case AST_CASCADE:
+            formatCascade(f, (ASTCascadeNode*)node, indent);
+            break;
+        case AST_BLOCK:
+            formatBlock(f, (ASTBlockNode*)node, indent);
+            break;
+        case AST_ARRAY_EXPRESSION:
+            formatArrayExpression(f, (ASTArrayExpressionNode*)node, indent);
+            break;
+        case AST_METHOD:
+            // Methods only appear at the root
+            break;
+    }
+}
+
+static void formatExpression(Formatter* f, ASTNode* node, int maxPrecedence, int indent) {
+    if (node == NULL || f->overflow) return;
+    if (precedence(node) > maxPrecedence) {
+        putChar(f, '(');
+        formatNode(f, node, indent);
+        putChar(f, ')');
+    } else {
+        formatNode(f, node, indent);
+    }
+}
+
+// Methods: the message pattern, then comments, temporaries, the primitive
+// and the statements, each on its own line one level in
+
+static void formatPattern(Formatter* f, ASTMethodNode* node) {
+    size_t length = strlen(node->selector);
+    if (node->parameterCount == 0) {
+        putString(f, node->selector);
+    } else if (length > 0 && node->selector[length - 1] == ':') {
+        const char* part = node->selector;
+        for (int i = 0; i < node->parameterCount; i++) {
+            const char* colon = strchr(part, ':');
+            size_t partLength = colon != NULL ? (size_t)(colon - part + 1) : strlen(part);
+            if (i > 0) putChar(f, ' ');
+            put(f, part, partLength);
+            putChar(f, ' ');
+            putString(f, node->parameters[i]);
+            part += partLength;
+        }
+    } else {
+        putString(f, node->selector);
+        putChar(f, ' ');
+        putString(f, node->parameters[0]);
+    }
+}
+
+static void formatMethod(Formatter* f, ASTMethodNode* node) {
+    BodyLines lines = {0, 0, NO_OFFSET};
+    formatComments(f, &lines, node->base.span.start);
+    startLine(f, &lines, node->base.span.start);
+    formatPattern(f, node);
+
+    lines.indent = 1;
+    lines.previousEnd = NO_OFFSET;
+    unsigned int firstStatement = node->statementCount > 0 && node->statements[0] != NULL
+        ? node->statements[0]->span.start : f->length;
+    formatComments(f, &lines, firstStatement);
+
+    if (node->temporaryCount > 0) {
+        startLine(f, &lines, 0);
+        putTemporaries(f, node->temporaries, node->temporaryCount);
+    }
+    if (node->isPrimitive) {
+        startLine(f, &lines, 0);
+        putString(f, "<primitive: ");
+        putInteger(f, node->primitiveNumber);
+        putChar(f, '>');
+    }
+    lines.previousEnd = NO_OFFSET;
+    formatBody(f, &lines, node->statements, node->statementCount, f->length);
+}
+
+int formatAST(OutputBuffer* out, ASTNode* node, const char* source, size_t length,
+              const FormatOptions* options) {
+    Formatter f;
+    memset(&f, 0, sizeof(f));
+    f.out = out;
+    f.options = options;
+    f.source = source;
+    f.length = (unsigned int)length;
+
+    if (!collectComments(&f)) {
+        free(f.comments);
+        return 0;
+    }
+
+    if (node != NULL && node->type == AST_METHOD) {
+        formatMethod(&f, (ASTMethodNode*)node);
+    } else if (node != NULL && node->type == AST_BLOCK) {
+        // The statement sequence from parse(), after its temporaries
+        ASTBlockNode* body = (ASTBlockNode*)node;
+        BodyLines lines = {0, 0, NO_OFFSET};
+        if (body->temporaryCount > 0) {
+            unsigned int firstStatement = body->statementCount > 0 && body->statements[0] != NULL
+                ? body->statements[0]->span.start : f.length;
+            formatComments(&f, &lines, firstStatement);
+            startLine(&f, &lines, 0);
+            putTemporaries(&f, body->temporaries, body->temporaryCount);
+            lines.previousEnd = NO_OFFSET;
+        }
+        formatBody(&f, &lines, body->statements, body->statementCount, f.length);
+    } else {
+        formatExpression(&f, node, PRECEDENCE_STATEMENT, 0);
+    }
+
+    free(f.comments);
+    return !out->failed;
+}
+
+// Copy formatted chunk text, escaping '!' again as '!!'
+static void writeChunkText(OutputBuffer* out, const char* text, size_t length) {
+    const char* end = text + length;
+    while (text < end) {
+        const char* bang = memchr(text, '!', (size_t)(end - text));
+        if (bang == NULL) {
+            writeBytes(out, text, (size_t)(end - text));
+            return;
+        }
+        writeBytes(out, text, (size_t)(bang + 1 - text));
+        writeChar(out, '!');
+        text = bang + 1;
+    }
+}
+
+static int formatChunks(OutputBuffer* out, const char* source, size_t length, const FormatOptions* options) {
+    OutputBuffer formatted;
+    if (!initOutputBuffer(&formatted, NULL, 4096)) return 0;
+
+    ChunkScanner scanner;
+    SourceChunk chunk;
+    const char* copied = source;
+    int ok = 1;
+
+    initChunkScanner(&scanner, source, length);
+    while (ok && nextChunk(&scanner, &chunk)) {
+        // Separators, terminators and section headers stay as they are
+        writeBytes(out, copied, (size_t)(chunk.start - copied));
+        copied = chunk.start + chunk.length;
+
+        if (chunk.kind == CHUNK_COMMENT) {
+            writeBytes(out, chunk.start, (size_t)chunk.length);
+            continue;
+        }
+
+        int hadError = 0;
+        char* text = NULL;
+        ASTNode* ast = parseChunk(&chunk, &text, &hadError);
+        formatted.length = 0;
+        ok = !hadError && ast != NULL && formatAST(&formatted, ast, text, strlen(text), options);
+        if (ok) writeChunkText(out, formatted.data, formatted.length);
+
+        freeASTNode(ast);
+        free(text);
+    }
+    if (ok) writeBytes(out, copied, (size_t)(source + length - copied));
+
+    freeOutputBuffer(&formatted);
+    return ok;
+}
+
+int formatSource(OutputBuffer* out, const char* source, size_t length, const FormatOptions* options) {
+    if (containsMethodChunks(source, length)) {
+        return formatChunks(out, source, length, options);
+    }
+
+    Parser parser;
+    initParser(&parser, source);
+    ASTNode* ast = parse(&parser);
+
+    int ok = !parser.hadError && ast != NULL && formatAST(out, ast, source, length, options);
+    if (ok) writeChar(out, '\n');
+
+    freeASTNode(ast);
+    return ok;
+}
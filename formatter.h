@@ -0,0 +1,55 @@
+#ifndef FORMATTER_H
+#define FORMATTER_H
+
+#include <stddef.h>
+#include "ast.h"
+#include "output.h"
+
+/*
+ * Source formatter: regenerates Smalltalk code from the AST. Parentheses
+ * come from operator precedence rather than from the original text, so
+ * parsing the output gives back the same tree. Comments are kept, but at
+ * statement granularity: a comment is written on its own line in front of
+ * the statement it appeared in or before, or at the end of its body. Single
+ * blank lines between statements are kept too.
+ *
+ * Layout is chosen by trying a construct on one line and taking that back
+ * if it overflows the line width. The text goes into the output buffer,
+ * which must be in memory mode (no file) so that attempts can be rolled
+ * back; nothing is allocated per node.
+ */
+
+typedef enum {
+    CASCADE_FIT,        /* One line when it fits */
+    CASCADE_BREAK       /* Always one message per line */
+} CascadeLayout;
+
+typedef enum {
+    KEYWORD_FIT,        /* One line when it fits */
+    KEYWORD_BREAK       /* Always one keyword per line, from two keywords up */
+} KeywordLayout;
+
+typedef struct {
+    int lineWidth;
+    int indentWidth;    /* Columns per indentation level (and per tab) */
+    int useTabs;        /* Indent with tabs instead of spaces */
+    CascadeLayout cascadeLayout;
+    KeywordLayout keywordLayout;
+} FormatOptions;
+
+/* Width 80, tabs of 4 columns, broken cascades, fitted keyword messages */
+void initFormatOptions(FormatOptions* options);
+
+/* Format a tree parsed from source: a method (parseMethod), a statement
+ * sequence (parse) or a single expression. Source is the text the spans
+ * refer to, and supplies the comments and blank lines. Answers 0 if out of
+ * memory. */
+int formatAST(OutputBuffer* out, ASTNode* node, const char* source, size_t length,
+              const FormatOptions* options);
+
+/* Format a whole file. A chunk-format fileout is formatted chunk by chunk,
+ * with class comments, section headers and the text between chunks copied
+ * as they are. Answers 0 if the source does not parse. */
+int formatSource(OutputBuffer* out, const char* source, size_t length, const FormatOptions* options);
+
+#endif /* FORMATTER_H */
@@ -0,0 +1,832 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "image.h"
+#include "primitives.h"
+
+#define IMAGE_MAGIC 0x31474d4954534d53ULL     // "SMSTIMG1"
+#define IMAGE_VERSION 1
+// Where images are laid out for: well clear of where the program, its heap
+// and shared libraries usually end up
+#define IMAGE_BASE ((uintptr_t)0x100000000000ULL)
+#define IMAGE_PAGE 4096
+
+// Leads the file. Its own fields are offsets or objects at their saved
+// addresses.
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t layout;            // Of the structures in the file; see imageLayout
+    uint64_t base;              // Address the file is laid out for
+    uint64_t size;
+    uint64_t heap;              // Chunk header of old space
+    uint64_t heapEnd;           // End of its objects
+    uint64_t fixups;            // Offsets of the pointers in the file outside old space
+    uint64_t fixupCount;
+    uint64_t classes;
+    uint64_t symbols;
+    uint64_t globals;
+    uint64_t methods;           // Every method, as vm->methods lists them
+    int32_t classCount;
+    int32_t symbolCount;
+    int32_t symbolCapacity;
+    int32_t globalCount;
+    int32_t globalCapacity;
+    int32_t methodCount;
+    uint64_t nextSerial;
+    uint32_t nextHash;
+    uint32_t reserved;
+    Oop nil;
+    Oop trueObject;
+    Oop falseObject;
+    Oop doesNotUnderstandSelector;
+    Oop specialSelectors[SPECIAL_SELECTOR_COUNT];
+} ImageHeader;
+
+static double seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+// Changes with anything an image depends on that a different build of the
+// VM could lay out differently
+static uint32_t imageLayout(void) {
+    const size_t sizes[] = {
+        sizeof(Oop), sizeof(ObjectHeader), sizeof(Closure), sizeof(MemoryChunk), sizeof(Method),
+        sizeof(CompiledCode), sizeof(SendCache), sizeof(RuntimeClass), sizeof(MethodEntry),
+        BYTECODE_COUNT, KERNEL_CLASS_COUNT, CARD_SLOTS, CARD_OBJECT_SLOTS
+    };
+    uint32_t layout = 2166136261u;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) layout = (layout ^ (uint32_t)sizes[i]) * 16777619u;
+    return layout;
+}
+
+// Saving
+
+// Old space objects from start to end go to offset in the image
+typedef struct {
+    char* start;
+    char* end;
+    size_t offset;
+} HeapRegion;
+
+// Where a method goes, sorted on the address it has now
+typedef struct {
+    const Method* method;
+    size_t offset;
+} MethodPlace;
+
+typedef struct {
+    char* bytes;                // The image from offset 0, laid out for IMAGE_BASE
+    size_t length;
+    size_t capacity;
+    uint64_t* fixups;
+    size_t fixupCount;
+    size_t fixupCapacity;
+    HeapRegion* regions;
+    int regionCount;
+    MethodPlace* places;
+    int placeCount;
+    int failed;
+} ImageWriter;
+
+// Zeroed room for size bytes; answers its offset, 8-byte aligned
+static size_t reserve(ImageWriter* w, size_t size) {
+    size_t offset = (w->length + 7) & ~(size_t)7;
+    if (offset + size > w->capacity) {
+        size_t capacity = w->capacity < 65536 ? 65536 : w->capacity;
+        while (capacity < offset + size) capacity *= 2;
+        char* bytes = (char*)realloc(w->bytes, capacity);
+        if (bytes == NULL) {
+            w->failed = 1;
+            return 0;
+        }
+        memset(bytes + w->capacity, 0, capacity - w->capacity);
+        w->bytes = bytes;
+        w->capacity = capacity;
+    }
+    w->length = offset + size;
+    return offset;
+}
+
+static size_t reserveCopy(ImageWriter* w, const void* source, size_t size) {
+    size_t offset = reserve(w, size);
+    if (!w->failed && size > 0) memcpy(w->bytes + offset, source, size);
+    return offset;
+}
+
+static void* at(ImageWriter* w, size_t offset) {
+    return w->bytes + offset;
+}
+
+// Store a pointer that has been translated into the image, and list it
+// for loading at another address
+static void putPointer(ImageWriter* w, size_t offset, uintptr_t value) {
+    if (w->failed) return;
+    memcpy(w->bytes + offset, &value, sizeof(value));
+    if (value == 0) return;
+    if (w->fixupCount == w->fixupCapacity) {
+        size_t capacity = w->fixupCapacity < 1024 ? 1024 : w->fixupCapacity * 2;
+        uint64_t* fixups = (uint64_t*)realloc(w->fixups, sizeof(uint64_t) * capacity);
+        if (fixups == NULL) {
+            w->failed = 1;
+            return;
+        }
+        w->fixups = fixups;
+        w->fixupCapacity = capacity;
+    }
+    w->fixups[w->fixupCount++] = offset;
+}
+
+static uintptr_t imageAddress(size_t offset) {
+    return IMAGE_BASE + offset;
+}
+
+// Where an object will be: immediates stay as they are
+static Oop translateObject(ImageWriter* w, Oop object) {
+    if (object == 0 || isImmediate(object)) return object;
+    int low = 0;
+    int high = w->regionCount - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        HeapRegion* region = &w->regions[middle];
+        if ((char*)object < region->start) {
+            high = middle - 1;
+        } else if ((char*)object >= region->end) {
+            low = middle + 1;
+        } else {
+            return imageAddress(region->offset + (size_t)((char*)object - region->start));
+        }
+    }
+    // Only old space is written out, which after a full collection is all of it
+    w->failed = 1;
+    return 0;
+}
+
+static uintptr_t translateMethod(ImageWriter* w, const Method* method) {
+    if (method == NULL) return 0;
+    int low = 0;
+    int high = w->placeCount - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (method < w->places[middle].method) {
+            high = middle - 1;
+        } else if (method > w->places[middle].method) {
+            low = middle + 1;
+        } else {
+            return imageAddress(w->places[middle].offset);
+        }
+    }
+    w->failed = 1;
+    return 0;
+}
+
+static void putObject(ImageWriter* w, size_t offset, Oop object) {
+    Oop translated = translateObject(w, object);
+    if (isImmediate(translated)) {
+        if (!w->failed) memcpy(w->bytes + offset, &translated, sizeof(translated));
+    } else {
+        putPointer(w, offset, translated);
+    }
+}
+
+static void putObjects(ImageWriter* w, size_t offset, const Oop* objects, int count) {
+    for (int i = 0; i < count; i++) putObject(w, offset + sizeof(Oop) * (size_t)i, objects[i]);
+}
+
+static int compareRegions(const void* first, const void* second) {
+    const char* a = ((const HeapRegion*)first)->start;
+    const char* b = ((const HeapRegion*)second)->start;
+    return a < b ? -1 : a > b;
+}
+
+static int comparePlaces(const void* first, const void* second) {
+    const Method* a = ((const MethodPlace*)first)->method;
+    const Method* b = ((const MethodPlace*)second)->method;
+    return a < b ? -1 : a > b;
+}
+
+// Room for old space, as one chunk; its objects are copied in last, once
+// every method has its place
+static int layOutHeap(ImageWriter* w, VM* vm, ImageHeader* header) {
+    int count = 0;
+    for (MemoryChunk* chunk = vm->memory.chunks; chunk != NULL; chunk = chunk->next) count++;
+    w->regions = (HeapRegion*)malloc(sizeof(HeapRegion) * (size_t)(count > 0 ? count : 1));
+    if (w->regions == NULL) return 0;
+    header->heap = reserve(w, sizeof(MemoryChunk));
+    size_t offset = header->heap + sizeof(MemoryChunk);
+    for (MemoryChunk* chunk = vm->memory.chunks; chunk != NULL; chunk = chunk->next) {
+        HeapRegion* region = &w->regions[w->regionCount++];
+        region->start = chunkStart(chunk);
+        region->end = chunk->top;
+        region->offset = offset;
+        offset += (size_t)(chunk->top - chunkStart(chunk));
+    }
+    qsort(w->regions, (size_t)w->regionCount, sizeof(HeapRegion), compareRegions);
+    header->heapEnd = offset;
+    reserve(w, offset - w->length);
+    return !w->failed;
+}
+
+static void copyHeap(ImageWriter* w) {
+    for (int i = 0; i < w->regionCount; i++) {
+        HeapRegion* region = &w->regions[i];
+        memcpy(at(w, region->offset), region->start, (size_t)(region->end - region->start));
+    }
+    for (int i = 0; i < w->regionCount && !w->failed; i++) {
+        HeapRegion* region = &w->regions[i];
+        char* end = (char*)at(w, region->offset) + (region->end - region->start);
+        for (char* next = (char*)at(w, region->offset); next < end; next += objectByteSize((Oop)next)) {
+            Oop object = (Oop)next;
+            ObjectHeader* header = objectHeader(object);
+            header->flags = 0;
+            if (header->format == FORMAT_CLOSURE) {
+                asClosure(object)->method = (Method*)translateMethod(w, asClosure(object)->method);
+            }
+            uint32_t count = pointerSlotCount(header);
+            Oop* slots = pointerSlots(object);
+            for (uint32_t j = 0; j < count; j++) slots[j] = translateObject(w, slots[j]);
+        }
+    }
+}
+
+static size_t writeCode(ImageWriter* w, const CompiledCode* code) {
+    size_t offset = reserveCopy(w, code, sizeof(CompiledCode));
+    if (w->failed) return 0;
+    // The literal descriptions only serve to make methods
+    CompiledCode* copy = (CompiledCode*)at(w, offset);
+    copy->selector = NULL;
+    copy->literals = NULL;
+    size_t bytecodes = reserveCopy(w, code->bytecodes, (size_t)code->length);
+    putPointer(w, offset + offsetof(CompiledCode, bytecodes), imageAddress(bytecodes));
+    return offset;
+}
+
+static void writeMethod(ImageWriter* w, const Method* method, size_t offset) {
+    Method copy = *method;
+    copy.code = NULL;
+    copy.literals = NULL;
+    copy.blocks = NULL;
+    copy.primitive = NULL;
+    copy.outer = NULL;
+    copy.caches = NULL;
+    copy.siteIndex = NULL;
+    copy.hotness = 0;
+    copy.native = NULL;
+    if (method->code == NULL) copy.siteCount = 0;
+    memcpy(at(w, offset), &copy, sizeof(Method));
+    putObject(w, offset + offsetof(Method, selector), method->selector);
+    putPointer(w, offset + offsetof(Method, outer), translateMethod(w, method->outer));
+    if (method->code == NULL) return;
+
+    const CompiledCode* code = method->code;
+    size_t field = writeCode(w, code);
+    putPointer(w, offset + offsetof(Method, code), imageAddress(field));
+    int count = code->literalCount > 0 ? code->literalCount : 1;
+    size_t literals = reserve(w, sizeof(Oop) * (size_t)count);
+    putObjects(w, literals, method->literals, code->literalCount);
+    putPointer(w, offset + offsetof(Method, literals), imageAddress(literals));
+    if (method->blocks != NULL) {
+        size_t blocks = reserve(w, sizeof(Method*) * (size_t)count);
+        for (int i = 0; i < code->literalCount; i++) {
+            putPointer(w, blocks + sizeof(Method*) * (size_t)i, translateMethod(w, method->blocks[i]));
+        }
+        putPointer(w, offset + offsetof(Method, blocks), imageAddress(blocks));
+    }
+    if (method->siteCount > 0) {
+        // Empty, as caches of a new VM are
+        size_t caches = reserve(w, sizeof(SendCache) * (size_t)method->siteCount);
+        size_t siteIndex = reserveCopy(w, method->siteIndex, sizeof(uint32_t) * (size_t)code->length);
+        putPointer(w, offset + offsetof(Method, caches), imageAddress(caches));
+        putPointer(w, offset + offsetof(Method, siteIndex), imageAddress(siteIndex));
+    }
+}
+
+static int writeMethods(ImageWriter* w, VM* vm, ImageHeader* header) {
+    int count = vm->methodCount;
+    w->places = (MethodPlace*)malloc(sizeof(MethodPlace) * (size_t)(count > 0 ? count : 1));
+    if (w->places == NULL) return 0;
+    size_t methods = reserve(w, sizeof(Method) * (size_t)count);
+    for (int i = 0; i < count; i++) {
+        w->places[i].method = vm->methods[i];
+        w->places[i].offset = methods + sizeof(Method) * (size_t)i;
+    }
+    w->placeCount = count;
+    qsort(w->places, (size_t)count, sizeof(MethodPlace), comparePlaces);
+
+    header->methods = reserve(w, sizeof(Method*) * (size_t)count);
+    header->methodCount = count;
+    for (int i = 0; i < count && !w->failed; i++) {
+        size_t offset = methods + sizeof(Method) * (size_t)i;
+        writeMethod(w, vm->methods[i], offset);
+        putPointer(w, header->methods + sizeof(Method*) * (size_t)i, imageAddress(offset));
+    }
+    return !w->failed;
+}
+
+static int writeClasses(ImageWriter* w, VM* vm, ImageHeader* header) {
+    header->classCount = vm->classCount;
+    header->classes = reserve(w, sizeof(RuntimeClass) * (size_t)vm->classCount);
+    for (int i = 0; i < vm->classCount && !w->failed; i++) {
+        const RuntimeClass* class = &vm->classes[i];
+        size_t offset = header->classes + sizeof(RuntimeClass) * (size_t)i;
+        RuntimeClass copy = *class;
+        copy.variables = NULL;
+        copy.methods.entries = NULL;
+        memcpy(at(w, offset), &copy, sizeof(RuntimeClass));
+        putObject(w, offset + offsetof(RuntimeClass, name), class->name);
+        putObject(w, offset + offsetof(RuntimeClass, object), class->object);
+
+        if (class->variableCount > 0) {
+            size_t variables = reserve(w, sizeof(char*) * (size_t)class->variableCount);
+            for (int j = 0; j < class->variableCount; j++) {
+                size_t name = reserveCopy(w, class->variables[j], strlen(class->variables[j]) + 1);
+                putPointer(w, variables + sizeof(char*) * (size_t)j, imageAddress(name));
+            }
+            putPointer(w, offset + offsetof(RuntimeClass, variables), imageAddress(variables));
+        }
+        if (class->methods.capacity > 0) {
+            size_t entries = reserve(w, sizeof(MethodEntry) * (size_t)class->methods.capacity);
+            for (int j = 0; j < class->methods.capacity; j++) {
+                const MethodEntry* entry = &class->methods.entries[j];
+                if (entry->selector == 0) continue;
+                size_t slot = entries + sizeof(MethodEntry) * (size_t)j;
+                putObject(w, slot + offsetof(MethodEntry, selector), entry->selector);
+                putPointer(w, slot + offsetof(MethodEntry, method), translateMethod(w, entry->method));
+            }
+            putPointer(w, offset + offsetof(RuntimeClass, methods.entries), imageAddress(entries));
+        }
+    }
+    return !w->failed;
+}
+
+static int writeTables(ImageWriter* w, VM* vm, ImageHeader* header) {
+    header->symbolCount = vm->symbolCount;
+    header->symbolCapacity = vm->symbolCapacity;
+    header->symbols = reserve(w, sizeof(Oop) * (size_t)vm->symbolCapacity);
+    putObjects(w, header->symbols, vm->symbols, vm->symbolCapacity);
+    header->globalCount = vm->globalCount;
+    header->globalCapacity = vm->globalCapacity;
+    header->globals = reserve(w, sizeof(Oop) * (size_t)vm->globalCapacity);
+    putObjects(w, header->globals, vm->globals, vm->globalCapacity);
+
+    header->nil = translateObject(w, vm->nil);
+    header->trueObject = translateObject(w, vm->trueObject);
+    header->falseObject = translateObject(w, vm->falseObject);
+    header->doesNotUnderstandSelector = translateObject(w, vm->doesNotUnderstandSelector);
+    for (int i = 0; i < SPECIAL_SELECTOR_COUNT; i++) {
+        header->specialSelectors[i] = translateObject(w, vm->specialSelectors[i]);
+    }
+    return !w->failed;
+}
+
+static int writeFile(ImageWriter* w, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return 0;
+    int ok = fwrite(w->bytes, 1, w->length, file) == w->length;
+    return fclose(file) == 0 && ok;
+}
+
+int saveImage(VM* vm, const char* path) {
+    if (vm->frameCount != 0) {
+        fprintf(stderr, "An image cannot be saved while code runs.\n");
+        return 0;
+    }
+    // Leaves every object in old space, compacted
+    collectGarbage(&vm->memory, 1);
+
+    ImageWriter w;
+    memset(&w, 0, sizeof(w));
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    reserve(&w, IMAGE_PAGE);
+    int ok = !w.failed && layOutHeap(&w, vm, &header) && writeMethods(&w, vm, &header) &&
+             writeClasses(&w, vm, &header) && writeTables(&w, vm, &header);
+    if (ok) {
+        copyHeap(&w);
+        header.fixups = reserveCopy(&w, w.fixups, sizeof(uint64_t) * w.fixupCount);
+        header.fixupCount = w.fixupCount;
+        // Whole pages, so that the mapping covers the file exactly
+        reserve(&w, (IMAGE_PAGE - w.length % IMAGE_PAGE) % IMAGE_PAGE);
+        ok = !w.failed;
+    }
+    if (ok) {
+        header.magic = IMAGE_MAGIC;
+        header.version = IMAGE_VERSION;
+        header.layout = imageLayout();
+        header.base = IMAGE_BASE;
+        header.size = w.length;
+        header.nextSerial = vm->nextSerial;
+        header.nextHash = vm->memory.nextHash;
+        memcpy(w.bytes, &header, sizeof(header));
+        if (!writeFile(&w, path)) {
+            fprintf(stderr, "Cannot write the image %s.\n", path);
+            ok = 0;
+        }
+    } else {
+        fprintf(stderr, "Not enough memory to save the image %s.\n", path);
+    }
+    free(w.bytes);
+    free(w.fixups);
+    free(w.regions);
+    free(w.places);
+    return ok;
+}
+
+// Loading
+
+// Nothing read from the file is trusted: the checks below run before
+// relocation and before the VM refers to any of it
+
+// Whether size bytes from offset lie within an image of imageSize bytes
+static int validRange(uint64_t imageSize, uint64_t offset, uint64_t size) {
+    return offset <= imageSize && size <= imageSize - offset;
+}
+
+// An aligned table of count elements
+static int validTable(uint64_t imageSize, uint64_t offset, uint64_t count, size_t elementSize) {
+    return offset % sizeof(Oop) == 0 && count <= imageSize / elementSize &&
+           validRange(imageSize, offset, count * elementSize);
+}
+
+// Open addressing masks with capacity - 1 and stops at a free slot
+static int validHashTable(int32_t count, int32_t capacity) {
+    if (capacity == 0) return count == 0;
+    return capacity > 0 && (capacity & (capacity - 1)) == 0 && count >= 0 && count < capacity;
+}
+
+// An object in old space, at the address the image is laid out for
+static int validObject(const ImageHeader* header, Oop object) {
+    return object % sizeof(Oop) == 0 && object >= header->base + header->heap + sizeof(MemoryChunk) &&
+           object < header->base + header->heapEnd;
+}
+
+static int validHeader(const ImageHeader* header, uint64_t fileSize) {
+    uint64_t size = header->size;
+    if (header->magic != IMAGE_MAGIC || header->version != IMAGE_VERSION || header->layout != imageLayout() ||
+        size != fileSize || size < sizeof(ImageHeader) || size % IMAGE_PAGE != 0 ||
+        header->base % IMAGE_PAGE != 0 || header->base > UINTPTR_MAX - size) {
+        return 0;
+    }
+    if (header->heap % sizeof(Oop) != 0 || !validRange(size, header->heap, sizeof(MemoryChunk)) ||
+        header->heapEnd < header->heap + sizeof(MemoryChunk) || header->heapEnd > size) {
+        return 0;
+    }
+    if (header->classCount < KERNEL_CLASS_COUNT || header->methodCount < 0 ||
+        !validHashTable(header->symbolCount, header->symbolCapacity) ||
+        !validHashTable(header->globalCount, header->globalCapacity) ||
+        !validTable(size, header->fixups, header->fixupCount, sizeof(uint64_t)) ||
+        !validTable(size, header->classes, (uint64_t)header->classCount, sizeof(RuntimeClass)) ||
+        !validTable(size, header->symbols, (uint64_t)header->symbolCapacity, sizeof(Oop)) ||
+        !validTable(size, header->globals, (uint64_t)header->globalCapacity, sizeof(Oop)) ||
+        !validTable(size, header->methods, (uint64_t)header->methodCount, sizeof(Method*))) {
+        return 0;
+    }
+    if (!validObject(header, header->nil) || !validObject(header, header->trueObject) ||
+        !validObject(header, header->falseObject) || !validObject(header, header->doesNotUnderstandSelector)) {
+        return 0;
+    }
+    for (int i = 0; i < SPECIAL_SELECTOR_COUNT; i++) {
+        if (!validObject(header, header->specialSelectors[i])) return 0;
+    }
+    return 1;
+}
+
+// Each listed pointer is listed once, lies outside old space and the fixup
+// table, which relocation walks separately, and points into the image
+static int validFixups(const char* start, const ImageHeader* header) {
+    const uint64_t* fixups = (const uint64_t*)(start + header->fixups);
+    uint64_t fixupsEnd = header->fixups + header->fixupCount * sizeof(uint64_t);
+    uint64_t words = header->size / sizeof(uintptr_t);
+    uint8_t* listed = (uint8_t*)calloc((size_t)(words + 7) / 8, 1);
+    if (listed == NULL) return 0;
+    int valid = 1;
+    for (uint64_t i = 0; i < header->fixupCount && valid; i++) {
+        uint64_t offset = fixups[i];
+        uint64_t word = offset / sizeof(uintptr_t);
+        if (offset % sizeof(uintptr_t) != 0 || !validRange(header->size, offset, sizeof(uintptr_t)) ||
+            (offset >= header->heap && offset < header->heapEnd) ||
+            (offset >= header->fixups && offset < fixupsEnd) || (listed[word / 8] & (1 << word % 8))) {
+            valid = 0;
+            break;
+        }
+        listed[word / 8] |= (uint8_t)(1 << word % 8);
+        uintptr_t pointer = *(const uintptr_t*)(start + offset);
+        valid = pointer >= header->base && pointer - header->base < header->size;
+    }
+    free(listed);
+    return valid;
+}
+
+// One of the methods, which lie back to back from first in the order of the
+// method table
+static int isImageMethod(const ImageHeader* header, uintptr_t first, const Method* method) {
+    uintptr_t pointer = (uintptr_t)method;
+    return pointer >= first && (pointer - first) % sizeof(Method) == 0 &&
+           (pointer - first) / sizeof(Method) < (uint64_t)header->methodCount;
+}
+
+// The method table lists methods that lie back to back in the image, as
+// saveImage writes them; answers the first, or 0 for none
+static int validMethodTable(const char* start, const ImageHeader* header, uintptr_t* first) {
+    const uintptr_t* methods = (const uintptr_t*)(start + header->methods);
+    *first = header->methodCount > 0 ? methods[0] : 0;
+    if (header->methodCount == 0) return 1;
+    if (*first < header->base || *first % sizeof(Oop) != 0 ||
+        !validTable(header->size, *first - header->base, (uint64_t)header->methodCount, sizeof(Method))) {
+        return 0;
+    }
+    for (int i = 0; i < header->methodCount; i++) {
+        if (methods[i] != *first + sizeof(Method) * (size_t)i) return 0;
+    }
+    return 1;
+}
+
+// Objects lie back to back up to the end of old space, and every pointer in
+// them is to an object in it or, for closures, to a method
+static int validHeap(char* start, const ImageHeader* header, uintptr_t firstMethod) {
+    char* end = start + header->heapEnd;
+    for (char* next = start + header->heap + sizeof(MemoryChunk); next < end;) {
+        if ((size_t)(end - next) < sizeof(ObjectHeader)) return 0;
+        Oop object = (Oop)next;
+        ObjectHeader* objectHead = objectHeader(object);
+        if (objectHead->format > FORMAT_CLOSURE) return 0;
+        size_t size = objectByteSize(object);
+        if (size > (size_t)(end - next)) return 0;
+        if (objectHead->format == FORMAT_CLOSURE && asClosure(object)->method != NULL &&
+            !isImageMethod(header, firstMethod, asClosure(object)->method)) {
+            return 0;
+        }
+        uint32_t count = pointerSlotCount(objectHead);
+        Oop* slots = pointerSlots(object);
+        for (uint32_t j = 0; j < count; j++) {
+            if (slots[j] != 0 && !isImmediate(slots[j]) && !validObject(header, slots[j])) return 0;
+        }
+        next += size;
+    }
+    return 1;
+}
+
+// Move every pointer over from where the image was laid out for
+static void relocate(char* start, const ImageHeader* header, intptr_t delta) {
+    const uint64_t* fixups = (const uint64_t*)(start + header->fixups);
+    for (uint64_t i = 0; i < header->fixupCount; i++) {
+        uintptr_t* pointer = (uintptr_t*)(start + fixups[i]);
+        *pointer += (uintptr_t)delta;
+    }
+    for (char* next = start + header->heap + sizeof(MemoryChunk); next < start + header->heapEnd;
+         next += objectByteSize((Oop)next)) {
+        Oop object = (Oop)next;
+        ObjectHeader* objectHead = objectHeader(object);
+        if (objectHead->format == FORMAT_CLOSURE && asClosure(object)->method != NULL) {
+            asClosure(object)->method = (Method*)((char*)asClosure(object)->method + delta);
+        }
+        uint32_t count = pointerSlotCount(objectHead);
+        Oop* slots = pointerSlots(object);
+        for (uint32_t j = 0; j < count; j++) {
+            if (slots[j] != 0 && !isImmediate(slots[j])) slots[j] += (Oop)delta;
+        }
+    }
+}
+
+static Oop relocated(Oop object, intptr_t delta) {
+    return object == 0 || isImmediate(object) ? object : object + (Oop)delta;
+}
+
+// Whether size bytes at address lie within the mapping
+static int inMapping(const char* start, uint64_t mappingSize, const void* address, uint64_t size) {
+    const char* at = (const char*)address;
+    return at >= start && at < start + mappingSize && size <= (uint64_t)(start + mappingSize - at);
+}
+
+// An empty slot or an object in old space, once mapped and relocated
+static int validSlot(const char* start, const ImageHeader* header, Oop object) {
+    return object == 0 || (object % sizeof(Oop) == 0 && (const char*)object >= start + header->heap + sizeof(MemoryChunk) &&
+                           (const char*)object < start + header->heapEnd);
+}
+
+// The code, literal frame, blocks and send sites of a method, once relocated
+static int validMethod(const char* start, const ImageHeader* header, uintptr_t firstMethod, const Method* method) {
+    if (!validSlot(start, header, method->selector) || method->siteCount < 0 ||
+        (method->outer != NULL && !isImageMethod(header, firstMethod, method->outer))) {
+        return 0;
+    }
+    const CompiledCode* code = method->code;
+    if (code == NULL) return method->siteCount == 0;
+    if (!inMapping(start, header->size, code, sizeof(CompiledCode)) || code->length < 0 || code->literalCount < 0 ||
+        !inMapping(start, header->size, code->bytecodes, (uint64_t)code->length)) {
+        return 0;
+    }
+    uint64_t count = code->literalCount > 0 ? (uint64_t)code->literalCount : 1;
+    if (!inMapping(start, header->size, method->literals, sizeof(Oop) * count)) return 0;
+    for (int i = 0; i < code->literalCount; i++) {
+        if (!isImmediate(method->literals[i]) && !validSlot(start, header, method->literals[i])) return 0;
+    }
+    if (method->blocks != NULL) {
+        if (!inMapping(start, header->size, method->blocks, sizeof(Method*) * count)) return 0;
+        for (int i = 0; i < code->literalCount; i++) {
+            if (method->blocks[i] != NULL && !isImageMethod(header, firstMethod, method->blocks[i])) return 0;
+        }
+    }
+    if (method->siteCount > 0 &&
+        (!inMapping(start, header->size, method->caches, sizeof(SendCache) * (uint64_t)method->siteCount) ||
+         !inMapping(start, header->size, method->siteIndex, sizeof(uint32_t) * (uint64_t)code->length))) {
+        return 0;
+    }
+    return 1;
+}
+
+// What copyTables, the binding of primitives and the interpreter read
+// through the pointers in the mapping, once relocated
+static int validTables(const char* start, const ImageHeader* header, uintptr_t firstMethod) {
+    const RuntimeClass* classes = (const RuntimeClass*)(start + header->classes);
+    for (int i = 0; i < header->classCount; i++) {
+        const RuntimeClass* class = &classes[i];
+        if (!validSlot(start, header, class->name) || !validSlot(start, header, class->object)) return 0;
+        if (class->variableCount < 0 || class->methods.capacity < 0 ||
+            class->methods.count < 0 || class->methods.count > class->methods.capacity) {
+            return 0;
+        }
+        if (class->variableCount > 0 &&
+            !inMapping(start, header->size, class->variables, sizeof(char*) * (uint64_t)class->variableCount)) {
+            return 0;
+        }
+        for (int j = 0; j < class->variableCount; j++) {
+            const char* name = class->variables[j];
+            if (!inMapping(start, header->size, name, 1)) return 0;
+            size_t room = (size_t)(start + header->size - name);
+            if (strnlen(name, room) == room) return 0;
+        }
+        if (class->methods.capacity > 0 &&
+            !inMapping(start, header->size, class->methods.entries, sizeof(MethodEntry) * (uint64_t)class->methods.capacity)) {
+            return 0;
+        }
+        for (int j = 0; j < class->methods.capacity; j++) {
+            const MethodEntry* entry = &class->methods.entries[j];
+            if (!validSlot(start, header, entry->selector) ||
+                (entry->method != NULL && !isImageMethod(header, firstMethod, entry->method))) {
+                return 0;
+            }
+        }
+    }
+
+    const Oop* symbols = (const Oop*)(start + header->symbols);
+    for (int i = 0; i < header->symbolCapacity; i++) {
+        if (!validSlot(start, header, symbols[i])) return 0;
+    }
+    const Oop* globals = (const Oop*)(start + header->globals);
+    for (int i = 0; i < header->globalCapacity; i++) {
+        if (!validSlot(start, header, globals[i])) return 0;
+    }
+    Method* const* methods = (Method* const*)(start + header->methods);
+    for (int i = 0; i < header->methodCount; i++) {
+        if ((uintptr_t)methods[i] != firstMethod + sizeof(Method) * (size_t)i ||
+            !validMethod(start, header, firstMethod, methods[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void* copyTable(const void* table, size_t size) {
+    void* copy = malloc(size > 0 ? size : 1);
+    if (copy != NULL && size > 0) memcpy(copy, table, size);
+    return copy;
+}
+// The tables the VM grows and frees, out of the mapping
+static int copyTables(VM* vm, const ImageHeader* header, char* start) {
+    const RuntimeClass* classes = (const RuntimeClass*)(start + header->classes);
+    vm->classes = (RuntimeClass*)calloc((size_t)(header->classCount > 0 ? header->classCount : 1), sizeof(RuntimeClass));
+    if (vm->classes == NULL) return 0;
+    vm->classCapacity = header->classCount;
+    for (int i = 0; i < header->classCount; i++) {
+        RuntimeClass* class = &vm->classes[vm->classCount++];
+        *class = classes[i];
+        class->variables = NULL;
+        class->variableCount = 0;
+        class->methods.entries = NULL;
+        class->methods.count = 0;
+        class->methods.capacity = 0;
+        if (classes[i].variableCount > 0) {
+            class->variables = (char**)calloc((size_t)classes[i].variableCount, sizeof(char*));
+            if (class->variables == NULL) return 0;
+            for (int j = 0; j < classes[i].variableCount; j++) {
+                class->variables[j] = (char*)copyTable(classes[i].variables[j], strlen(classes[i].variables[j]) + 1);
+                if (class->variables[j] == NULL) return 0;
+                class->variableCount++;
+            }
+        }
+        if (classes[i].methods.capacity > 0) {
+            class->methods.entries = (MethodEntry*)copyTable(
+                classes[i].methods.entries, sizeof(MethodEntry) * (size_t)classes[i].methods.capacity);
+            if (class->methods.entries == NULL) return 0;
+            class->methods.count = classes[i].methods.count;
+            class->methods.capacity = classes[i].methods.capacity;
+        }
+    }
+
+    vm->symbols = (Oop*)copyTable(start + header->symbols, sizeof(Oop) * (size_t)header->symbolCapacity);
+    vm->globals = (Oop*)copyTable(start + header->globals, sizeof(Oop) * (size_t)header->globalCapacity);
+    vm->methods = (Method**)copyTable(start + header->methods, sizeof(Method*) * (size_t)header->methodCount);
+    if (vm->symbols == NULL || vm->globals == NULL || vm->methods == NULL) return 0;
+    vm->symbolCount = header->symbolCount;
+    vm->symbolCapacity = header->symbolCapacity;
+    vm->globalCount = header->globalCount;
+    vm->globalCapacity = header->globalCapacity;
+    vm->methodCount = header->methodCount;
+    vm->methodCapacity = header->methodCount;
+    return 1;
+}
+
+// Map the file, at the address it is laid out for if that is free
+static char* mapImage(int descriptor, const ImageHeader* header) {
+    int flags = MAP_PRIVATE;
+#ifdef MAP_FIXED_NOREPLACE
+    flags |= MAP_FIXED_NOREPLACE;
+#endif
+    void* start = mmap((void*)(uintptr_t)header->base, (size_t)header->size, PROT_READ | PROT_WRITE, flags,
+                       descriptor, 0);
+    if (start == MAP_FAILED) {
+        start = mmap(NULL, (size_t)header->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+    }
+    return start == MAP_FAILED ? NULL : (char*)start;
+}
+
+int loadImage(VM* vm, const char* path) {
+    double begin = seconds();
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0) {
+        fprintf(stderr, "Cannot open the image %s.\n", path);
+        return 0;
+    }
+    ImageHeader header;
+    struct stat status;
+    if (pread(descriptor, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || fstat(descriptor, &status) != 0 ||
+        !validHeader(&header, (uint64_t)status.st_size)) {
+        fprintf(stderr, "%s is not an image of this virtual machine.\n", path);
+        close(descriptor);
+        return 0;
+    }
+    char* start = mapImage(descriptor, &header);
+    close(descriptor);
+    Image* image = start != NULL ? (Image*)malloc(sizeof(Image)) : NULL;
+    if (image == NULL) {
+        if (start != NULL) munmap(start, (size_t)header.size);
+        fprintf(stderr, "Cannot map the image %s.\n", path);
+        return 0;
+    }
+
+    intptr_t delta = (intptr_t)((uintptr_t)start - (uintptr_t)header.base);
+    uintptr_t firstMethod = 0;
+    int valid = validFixups(start, &header) && validMethodTable(start, &header, &firstMethod) &&
+                validHeap(start, &header, firstMethod);
+    if (valid && delta != 0) relocate(start, &header, delta);
+    if (!valid || !validTables(start, &header, firstMethod + (uintptr_t)delta)) {
+        munmap(start, (size_t)header.size);
+        free(image);
+        fprintf(stderr, "The image %s is damaged.\n", path);
+        return 0;
+    }
+    image->start = start;
+    image->size = (size_t)header.size;
+    image->relocated = delta != 0;
+    vm->image = image;
+
+    vm->nil = relocated(header.nil, delta);
+    vm->memory.nil = vm->nil;
+    vm->trueObject = relocated(header.trueObject, delta);
+    vm->falseObject = relocated(header.falseObject, delta);
+    vm->doesNotUnderstandSelector = relocated(header.doesNotUnderstandSelector, delta);
+    for (int i = 0; i < SPECIAL_SELECTOR_COUNT; i++) {
+        vm->specialSelectors[i] = relocated(header.specialSelectors[i], delta);
+    }
+    vm->nextSerial = header.nextSerial;
+    vm->memory.nextHash = header.nextHash;
+    addExternalChunk(&vm->memory, (MemoryChunk*)(start + header.heap), start + header.heapEnd);
+    if (!copyTables(vm, &header, start)) {
+        fprintf(stderr, "Not enough memory to load the image %s.\n", path);
+        return 0;
+    }
+    // Primitives are bound by number, as their addresses differ from run to run
+    for (int i = 0; i < vm->methodCount; i++) {
+        Method* method = vm->methods[i];
+        if (method->code != NULL && method->code->primitive != 0) {
+            method->primitive = findPrimitive(method->code->primitive);
+        }
+    }
+    image->loadSeconds = seconds() - begin;
+    return 1;
+}
+
+void freeImage(VM* vm) {
+    if (vm->image == NULL) return;
+    munmap(vm->image->start, vm->image->size);
+    free(vm->image);
+    vm->image = NULL;
+}
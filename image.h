@@ -0,0 +1,49 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "runtime.h"
+
+/*
+ * Image snapshots. saveImage writes the state that loading sources builds
+ * up: old space after a full collection, the class table with the method
+ * dictionaries, every method with its bytecodes and literal frame, the
+ * symbol table and the globals. initVM maps such a file back in instead of
+ * booting the kernel classes and compiling the kernel library.
+ *
+ * The file is a copy of the memory it is mapped to, laid out for a preferred
+ * address. It is mapped privately, so pages are copied only when written.
+ * When the preferred address is taken, the pointers in it, which a table in
+ * the file lists, are moved over to where it did land.
+ *
+ * Loading checks the header, every listed pointer, old space object by
+ * object, the tables and the methods against the mapping before the VM uses
+ * any of it, and rejects a file that fails. Bytecodes are not checked.
+ *
+ * The tables the VM grows or frees (classes, method dictionaries, symbols,
+ * globals and the list of methods) are copied out of the mapping on loading.
+ * Methods, their code and old space stay in it, and freeVM unmaps it last.
+ * Send caches start out empty and nothing is compiled to machine code.
+ */
+
+struct Image {
+    char* start;
+    size_t size;
+    int relocated;          /* Not mapped at its preferred address */
+    double loadSeconds;
+};
+
+/* Writes the VM to path; answers 0 after reporting a problem on stderr. No
+ * code may be running. Collects all garbage first. */
+int saveImage(VM* vm, const char* path);
+/* Fills in a VM that initVM has given its memory, stack and frames from
+ * the image at path. Answers 0 after reporting a problem on stderr. */
+int loadImage(VM* vm, const char* path);
+void freeImage(VM* vm);
+
+static inline int isImageAddress(const Image* image, const void* address) {
+    return image != NULL && (const char*)address >= image->start && (const char*)address < image->start + image->size;
+}
+
+#endif /* IMAGE_H */
@@ -0,0 +1,831 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "interpreter.h"
+#include "jit.h"
+#include "primitives.h"
+
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define THREADED_DISPATCH 1
+#endif
+
+typedef enum {
+    SEND_ANSWERED,      // A primitive left the result on the stack
+    SEND_ACTIVATED,     // A new activation is on top of the frames
+    SEND_FAILED         // A runtime error was reported
+} SendOutcome;
+
+static int isClosure(VM* vm, Oop object) {
+    return classIndexOf(vm, object) == CLASS_BLOCK_CLOSURE;
+}
+
+// Arithmetic
+
+// Special sends to a SmallInteger with a SmallInteger argument, or a
+// SmallFloat with a SmallFloat, answer here without a lookup when the result
+// is immediate too. These answer 0 to leave it to the send, whose primitive
+// boxes what does not fit.
+
+static inline Oop integerOperation(VM* vm, Bytecode opcode, Oop receiver, Oop argument) {
+    long long left = smallIntegerValue(receiver);
+    long long right = smallIntegerValue(argument);
+    long long value;
+    switch (opcode) {
+        // 61-bit operands cannot overflow 64 bits when added or subtracted
+        case BC_SEND_ADD: value = left + right; break;
+        case BC_SEND_SUBTRACT: value = left - right; break;
+        case BC_SEND_MULTIPLY:
+            if (__builtin_smulll_overflow(left, right, &value)) return 0;
+            break;
+        // Rounded towards negative infinity; the send reports division by zero
+        case BC_SEND_INTEGER_DIVIDE:
+        case BC_SEND_MODULO:
+            if (right == 0) return 0;
+            value = left / right;
+            if (left % right != 0 && (left < 0) != (right < 0)) value--;
+            if (opcode == BC_SEND_MODULO) value = left - value * right;
+            break;
+        case BC_SEND_LESS: return booleanObject(vm, left < right);
+        case BC_SEND_GREATER: return booleanObject(vm, left > right);
+        case BC_SEND_LESS_EQUAL: return booleanObject(vm, left <= right);
+        case BC_SEND_GREATER_EQUAL: return booleanObject(vm, left >= right);
+        case BC_SEND_EQUAL:
+        case BC_SEND_IDENTICAL: return booleanObject(vm, receiver == argument);
+        case BC_SEND_NOT_EQUAL: return booleanObject(vm, receiver != argument);
+        // The tags survive these as they are
+        case BC_SEND_BIT_AND: return receiver & argument;
+        case BC_SEND_BIT_OR: return receiver | argument;
+        default: return 0;
+    }
+    return fitsSmallInteger(value) ? smallIntegerObject(value) : 0;
+}
+
+static inline Oop floatOperation(VM* vm, Bytecode opcode, Oop receiver, Oop argument) {
+    double left = smallFloatValue(receiver);
+    double right = smallFloatValue(argument);
+    switch (opcode) {
+        case BC_SEND_ADD: return smallFloatObject(left + right);
+        case BC_SEND_SUBTRACT: return smallFloatObject(left - right);
+        case BC_SEND_MULTIPLY: return smallFloatObject(left * right);
+        case BC_SEND_LESS: return booleanObject(vm, left < right);
+        case BC_SEND_GREATER: return booleanObject(vm, left > right);
+        case BC_SEND_LESS_EQUAL: return booleanObject(vm, left <= right);
+        case BC_SEND_GREATER_EQUAL: return booleanObject(vm, left >= right);
+        case BC_SEND_EQUAL: return booleanObject(vm, left == right);
+        case BC_SEND_NOT_EQUAL: return booleanObject(vm, left != right);
+        default: return 0;
+    }
+}
+
+// Frames
+
+// Set up frame as an activation of method, whose receiver (or closure) and
+// arguments are at base. Answers 0 after reporting a stack overflow.
+static int activate(VM* vm, Frame* frame, Method* method, Oop* base) {
+    CompiledCode* code = method->code;
+    countHotness(vm, method);
+    Oop* temporaries = base + 1 + code->argumentCount;
+    if (temporaries + code->temporaryCount + code->maxStack + STACK_SLACK > vm->stackLimit) {
+        runtimeError(vm, "stack overflow");
+        return 0;
+    }
+    for (int i = 0; i < code->temporaryCount; i++) temporaries[i] = vm->nil;
+
+    frame->method = method;
+    frame->ip = code->bytecodes;
+    frame->base = base;
+    frame->serial = ++vm->nextSerial;
+    frame->hasClosures = 0;
+    frame->isBlock = code->isBlock;
+    Oop outer = vm->nil;
+    if (code->isBlock) {
+        Closure* closure = asClosure(base[0]);
+        frame->receiver = closure->receiver;
+        frame->homeSerial = closure->homeSerial;
+        frame->home = closure->homeFrame;
+        outer = closure->outer;
+    } else {
+        frame->receiver = base[0];
+        frame->homeSerial = frame->serial;
+        frame->home = (uint32_t)(frame - vm->frames);
+    }
+
+    if (code->environmentSize > 0) {
+        // Slot 0 links to the environment of the enclosing code
+        Oop environment = instantiate(vm, CLASS_ENVIRONMENT, (uint32_t)code->environmentSize + 1);
+        if (environment == 0) return 0;
+        objectSlots(environment)[0] = outer;
+        frame->environment = environment;
+    } else {
+        frame->environment = outer;
+    }
+    return 1;
+}
+
+// The closure PUSH_BLOCK makes in frame, holding the copied values below sp,
+// or 0 when out of memory
+static Oop makeClosure(VM* vm, Frame* frame, Method* block, Oop* sp) {
+    int copiedCount = block->code->copiedCount;
+    Oop object = instantiate(vm, CLASS_BLOCK_CLOSURE, (uint32_t)copiedCount);
+    if (object == 0) return 0;
+    Closure* closure = asClosure(object);
+    closure->receiver = frame->receiver;
+    if (block->code->kind == BLOCK_FULL) closure->outer = frame->environment;
+    memcpy(closure->copied, sp - copiedCount, sizeof(Oop) * (size_t)copiedCount);
+    closure->method = block;
+    closure->homeSerial = frame->homeSerial;
+    closure->homeFrame = frame->home;
+    // The home activation must stay put for ^ to find it
+    if (block->nonLocalReturn && vm->frames[frame->home].serial == frame->homeSerial) {
+        vm->frames[frame->home].hasClosures = 1;
+    }
+    return object;
+}
+
+// An Array of the count values below sp, or 0
+static Oop makeArray(VM* vm, Oop* sp, int count) {
+    Oop array = instantiate(vm, CLASS_ARRAY, (uint32_t)count);
+    if (array != 0) memcpy(objectSlots(array), sp - count, sizeof(Oop) * (size_t)count);
+    return array;
+}
+
+// Whether a ^ in the block activation in frame can return from its home
+static int homeIsActive(VM* vm, Frame* frame) {
+    int home = (int)frame->home;
+    return home >= vm->returnBarrier && home < vm->frameCount - 1 && vm->frames[home].serial == frame->homeSerial;
+}
+
+static Oop makeMessage(VM* vm, Oop selector, Oop* arguments, int count) {
+    Oop message = instantiate(vm, CLASS_MESSAGE, 0);
+    Oop array = instantiate(vm, CLASS_ARRAY, (uint32_t)count);
+    if (message == 0 || array == 0) return 0;
+    memcpy(objectSlots(array), arguments, sizeof(Oop) * (size_t)count);
+    objectSlots(message)[0] = selector;
+    objectSlots(message)[1] = array;
+    return message;
+}
+
+static void writeSelector(VM* vm, Oop selector, char* buffer, size_t size) {
+    (void)vm;
+    int length = (int)objectHeader(selector)->size;
+    snprintf(buffer, size, "%.*s", length, (const char*)objectBytes(selector));
+}
+
+// Number of elements of an Array that can be spread onto the stack, or -1
+static int spreadableCount(VM* vm, Oop array, Oop* sp) {
+    if (classIndexOf(vm, array) != CLASS_ARRAY) return -1;
+    int count = (int)objectHeader(array)->size;
+    return sp + count + STACK_SLACK > vm->stackLimit ? -1 : count;
+}
+
+// Send selector to the receiver below the top argumentCount values. Lookup
+// starts in lookupClass for super sends, otherwise in the receiver's class.
+// With tail set, a new activation replaces the current one instead of going
+// on top of it. The inline cache of the send site, if any, is tried before
+// the method dictionaries.
+static SendOutcome sendSelector(VM* vm, Oop** stackTop, Oop selector, int argumentCount,
+                                int lookupClass, SendCache* cache, int tail) {
+    Oop* sp = *stackTop;
+    for (;;) {
+        Oop* base = sp - argumentCount - 1;
+        Oop receiver = base[0];
+        int classIndex = lookupClass != NO_CLASS ? lookupClass : classIndexOf(vm, receiver);
+        Method* method = cache != NULL ? probeSendCache(cache, classIndex, vm->lookupEpoch) : NULL;
+        if (method == NULL) {
+            method = lookupMethod(vm, classIndex, selector);
+            if (method != NULL && cache != NULL) updateSendCache(cache, classIndex, method, vm->lookupEpoch);
+        }
+        vm->statistics.sends++;
+
+        if (method == NULL) {
+            method = lookupMethod(vm, classIndexOf(vm, receiver), vm->doesNotUnderstandSelector);
+            Oop message = method != NULL ? makeMessage(vm, selector, base + 1, argumentCount) : 0;
+            if (message == 0) {
+                char name[256];
+                writeSelector(vm, selector, name, sizeof(name));
+                runtimeError(vm, "message not understood: #%s", name);
+                return SEND_FAILED;
+            }
+            base[1] = message;
+            sp = base + 2;
+            argumentCount = 1;
+        }
+
+        int primitive = method->code->primitive;
+        if (primitive >= PRIMITIVE_VALUE && primitive <= PRIMITIVE_PERFORM_WITH_ARGUMENTS) {
+            // On a mismatch the stack stays as it is for the method's own code
+            vm->statistics.primitiveCalls++;
+            if (primitive == PRIMITIVE_PERFORM || primitive == PRIMITIVE_PERFORM_WITH_ARGUMENTS) {
+                Oop performed = base[1];
+                int count = primitive == PRIMITIVE_PERFORM ? argumentCount - 1 : spreadableCount(vm, base[2], sp);
+                if (classIndexOf(vm, performed) == CLASS_SYMBOL && count >= 0) {
+                    if (primitive == PRIMITIVE_PERFORM) {
+                        memmove(base + 1, base + 2, sizeof(Oop) * (size_t)count);
+                    } else {
+                        memcpy(base + 1, objectSlots(base[2]), sizeof(Oop) * (size_t)count);
+                    }
+                    sp = base + 1 + count;
+                    selector = performed;
+                    argumentCount = count;
+                    lookupClass = NO_CLASS;
+                    cache = NULL;
+                    continue;
+                }
+            } else if (isClosure(vm, receiver)) {
+                Method* block = asClosure(receiver)->method;
+                int count = primitive == PRIMITIVE_VALUE ? argumentCount : spreadableCount(vm, base[1], sp);
+                if (count == block->code->argumentCount) {
+                    if (primitive == PRIMITIVE_VALUE_WITH_ARGUMENTS) {
+                        memcpy(base + 1, objectSlots(base[1]), sizeof(Oop) * (size_t)count);
+                    }
+                    method = block;
+                    sp = base + 1 + count;
+                    argumentCount = count;
+                }
+            }
+        } else if (method->primitive != NULL) {
+            vm->statistics.primitiveCalls++;
+            vm->stackTop = sp;
+            Oop result;
+            int status = method->primitive(vm, base, argumentCount, &result);
+            if (status == PRIMITIVE_SUCCEEDED) {
+                base[0] = result;
+                *stackTop = base + 1;
+                return SEND_ANSWERED;
+            }
+            if (status == PRIMITIVE_ERROR) return SEND_FAILED;
+        }
+
+        Frame* frame;
+        if (tail) {
+            frame = &vm->frames[vm->frameCount - 1];
+            memmove(frame->base, base, sizeof(Oop) * (size_t)(argumentCount + 1));
+            base = frame->base;
+            vm->statistics.tailSends++;
+        } else {
+            if (vm->frameCount == vm->maxFrames) {
+                runtimeError(vm, "too many nested activations");
+                return SEND_FAILED;
+            }
+            frame = &vm->frames[vm->frameCount++];
+        }
+        if (!activate(vm, frame, method, base)) return SEND_FAILED;
+        *stackTop = base + 1 + method->code->argumentCount + method->code->temporaryCount;
+        return SEND_ACTIVATED;
+    }
+}
+
+// The loop
+
+// Run until the activation in frame entry returns. Activations of compiled
+// methods go to native code, which answers how they ended.
+static RunStatus run(VM* vm, int entry, Oop* result) {
+    Frame* fp;
+    Method* method;
+    const uint8_t* ip;
+    Oop* sp;
+    Oop* temporaries;
+    Oop* literals;
+    Oop receiver;
+    uint64_t executed = 0;
+
+    Oop selector;
+    int argumentCount;
+    int lookupClass;
+    SendCache* cache;
+    Oop value;
+    int returnFrame;
+    const uint8_t* address;
+    int nativeFrame;
+    RunStatus status;
+
+#define LOAD_FRAME() \
+    do { \
+        fp = &vm->frames[vm->frameCount - 1]; \
+        method = fp->method; \
+        ip = fp->ip; \
+        temporaries = fp->base + 1; \
+        literals = method->literals; \
+        receiver = fp->receiver; \
+    } while (0)
+
+#define BYTE(n) (ip[n])
+#define JUMP_OFFSET() ((int16_t)(ip[1] | (ip[2] << 8)))
+#define PUSH(value) (*sp++ = (value))
+#define POP() (*--sp)
+#define TOP() (sp[-1])
+#define SITE_CACHE() (&method->caches[method->siteIndex[ip - method->code->bytecodes]])
+
+// Objects may move in a collection, so the frame is loaded again after it
+#define SAFEPOINT() \
+    do { \
+        if (vm->memory.collectionRequested) { \
+            fp->ip = ip; \
+            vm->stackTop = sp; \
+            collectGarbage(&vm->memory, 0); \
+            LOAD_FRAME(); \
+        } \
+    } while (0)
+
+// Native code runs the activation on top of the frames until it ends
+#define RUN_NATIVE(address) \
+    do { \
+        nativeFrame = vm->frameCount - 1; \
+        status = vm->jit->enter(vm, &vm->frames[nativeFrame], sp, address); \
+        goto nativeReturned; \
+    } while (0)
+
+#ifdef THREADED_DISPATCH
+#define LABEL_ADDRESS(name, operands) &&op_##name,
+#define SPECIAL_LABEL_ADDRESS(name, selector, arguments) &&op_SEND_##name,
+    static void* dispatchTable[BYTECODE_COUNT] = {
+        BYTECODES(LABEL_ADDRESS)
+        SPECIAL_SELECTORS(SPECIAL_LABEL_ADDRESS)
+    };
+#undef LABEL_ADDRESS
+#undef SPECIAL_LABEL_ADDRESS
+#define CASE(name) op_##name
+#define DISPATCH() do { executed++; goto *dispatchTable[*ip]; } while (0)
+#else
+#define CASE(name) case BC_##name
+#define DISPATCH() goto dispatch
+#endif
+
+    LOAD_FRAME();
+    sp = vm->stackTop;
+    if (ip == method->code->bytecodes && (address = nativeAddress(vm, method, ip)) != NULL) RUN_NATIVE(address);
+
+#ifdef THREADED_DISPATCH
+    DISPATCH();
+    {
+#else
+dispatch:
+    executed++;
+    switch ((Bytecode)*ip) {
+#endif
+
+    CASE(PUSH_TEMP):
+        PUSH(temporaries[BYTE(1)]);
+        ip += 2;
+        DISPATCH();
+
+    CASE(PUSH_OUTER): {
+        Oop environment = fp->environment;
+        for (int hops = BYTE(2); hops > 0; hops--) environment = objectSlots(environment)[0];
+        PUSH(objectSlots(environment)[BYTE(1) + 1]);
+        ip += 3;
+        DISPATCH();
+    }
+
+    CASE(PUSH_COPIED):
+        // The closure of a block activation is in the receiver's slot
+        PUSH(asClosure(temporaries[-1])->copied[BYTE(1)]);
+        ip += 2;
+        DISPATCH();
+
+    CASE(PUSH_INST):
+        PUSH(objectSlots(receiver)[BYTE(1)]);
+        ip += 2;
+        DISPATCH();
+
+    CASE(PUSH_GLOBAL):
+        PUSH(objectSlots(literals[BYTE(1)])[1]);
+        ip += 2;
+        DISPATCH();
+
+    CASE(PUSH_LITERAL):
+        PUSH(literals[BYTE(1)]);
+        ip += 2;
+        DISPATCH();
+
+    CASE(PUSH_INTEGER):
+        PUSH(smallIntegerObject((int8_t)BYTE(1)));
+        ip += 2;
+        DISPATCH();
+
+    CASE(PUSH_SELF):
+        PUSH(receiver);
+        ip += 1;
+        DISPATCH();
+
+    CASE(PUSH_NIL):
+        PUSH(vm->nil);
+        ip += 1;
+        DISPATCH();
+
+    CASE(PUSH_TRUE):
+        PUSH(vm->trueObject);
+        ip += 1;
+        DISPATCH();
+
+    CASE(PUSH_FALSE):
+        PUSH(vm->falseObject);
+        ip += 1;
+        DISPATCH();
+
+    CASE(PUSH_THIS_CONTEXT):
+        fp->ip = ip;
+        runtimeError(vm, "thisContext is not supported");
+        goto failed;
+
+    CASE(PUSH_BLOCK): {
+        Method* block = method->blocks[BYTE(1)];
+        value = makeClosure(vm, fp, block, sp);
+        if (value == 0) goto failed;
+        sp -= block->code->copiedCount;
+        PUSH(value);
+        ip += 2;
+        DISPATCH();
+    }
+
+    CASE(MAKE_ARRAY):
+        value = makeArray(vm, sp, BYTE(1));
+        if (value == 0) goto failed;
+        sp -= BYTE(1);
+        PUSH(value);
+        ip += 2;
+        DISPATCH();
+
+    CASE(STORE_TEMP):
+        temporaries[BYTE(1)] = TOP();
+        ip += 2;
+        DISPATCH();
+
+    CASE(STORE_OUTER): {
+        Oop environment = fp->environment;
+        for (int hops = BYTE(2); hops > 0; hops--) environment = objectSlots(environment)[0];
+        storePointer(&vm->memory, environment, BYTE(1) + 1u, TOP());
+        ip += 3;
+        DISPATCH();
+    }
+
+    CASE(STORE_INST):
+        storePointer(&vm->memory, receiver, BYTE(1), TOP());
+        ip += 2;
+        DISPATCH();
+
+    CASE(STORE_GLOBAL):
+        storePointer(&vm->memory, literals[BYTE(1)], 1, TOP());
+        ip += 2;
+        DISPATCH();
+
+    CASE(POP_STORE_TEMP):
+        temporaries[BYTE(1)] = POP();
+        ip += 2;
+        DISPATCH();
+
+    CASE(POP_STORE_OUTER): {
+        Oop environment = fp->environment;
+        for (int hops = BYTE(2); hops > 0; hops--) environment = objectSlots(environment)[0];
+        storePointer(&vm->memory, environment, BYTE(1) + 1u, POP());
+        ip += 3;
+        DISPATCH();
+    }
+
+    CASE(POP_STORE_INST):
+        storePointer(&vm->memory, receiver, BYTE(1), POP());
+        ip += 2;
+        DISPATCH();
+
+    CASE(POP_STORE_GLOBAL):
+        storePointer(&vm->memory, literals[BYTE(1)], 1, POP());
+        ip += 2;
+        DISPATCH();
+
+    CASE(POP):
+        sp--;
+        ip += 1;
+        DISPATCH();
+
+    CASE(DUP):
+        value = TOP();
+        PUSH(value);
+        ip += 1;
+        DISPATCH();
+
+    CASE(SEND):
+        selector = literals[BYTE(1)];
+        argumentCount = BYTE(2);
+        lookupClass = NO_CLASS;
+        cache = SITE_CACHE();
+        ip += 3;
+        goto send;
+
+    CASE(SUPER_SEND):
+        selector = literals[BYTE(1)];
+        argumentCount = BYTE(2);
+        lookupClass = vm->classes[method->classIndex].superclass;
+        cache = SITE_CACHE();
+        ip += 3;
+        goto send;
+
+    CASE(JUMP): {
+        int offset = JUMP_OFFSET();
+        ip += 3 + offset;
+        // Loops jump back, so they reach a safepoint even without sends, and
+        // a hot loop goes on in native code
+        if (offset < 0) {
+            SAFEPOINT();
+            countHotness(vm, method);
+            if ((address = nativeAddress(vm, method, ip)) != NULL) RUN_NATIVE(address);
+        }
+        DISPATCH();
+    }
+
+    CASE(JUMP_IF_TRUE):
+        value = POP();
+        if (value == vm->trueObject) {
+            ip += 3 + JUMP_OFFSET();
+        } else if (value == vm->falseObject) {
+            ip += 3;
+        } else {
+            goto notBoolean;
+        }
+        DISPATCH();
+
+    CASE(JUMP_IF_FALSE):
+        value = POP();
+        if (value == vm->falseObject) {
+            ip += 3 + JUMP_OFFSET();
+        } else if (value == vm->trueObject) {
+            ip += 3;
+        } else {
+            goto notBoolean;
+        }
+        DISPATCH();
+
+    CASE(RETURN_TOP):
+        value = TOP();
+        returnFrame = vm->frameCount - 1;
+        goto returnValue;
+
+    CASE(RETURN_SELF):
+        value = receiver;
+        returnFrame = vm->frameCount - 1;
+        goto returnValue;
+
+    CASE(BLOCK_RETURN):
+        value = TOP();
+        returnFrame = vm->frameCount - 1;
+        goto returnValue;
+
+    CASE(NON_LOCAL_RETURN): {
+        value = TOP();
+        returnFrame = (int)fp->home;
+        if (!homeIsActive(vm, fp)) {
+            fp->ip = ip;
+            runtimeError(vm, "block cannot return: its method has returned");
+            goto failed;
+        }
+        if (returnFrame < entry) {
+            // The home is native code's, further down the C stack
+            vm->unwindFrame = returnFrame;
+            vm->unwindValue = value;
+            vm->statistics.bytecodes += executed;
+            return RUN_UNWINDING;
+        }
+        goto returnValue;
+    }
+
+#define SPECIAL_SEND_CASE(name, special, arguments) \
+    CASE(SEND_##name): \
+        if (arguments == 1 && isSmallInteger(sp[-2]) && isSmallInteger(sp[-1]) && \
+            (value = integerOperation(vm, BC_SEND_##name, sp[-2], sp[-1])) != 0) { \
+            goto answerOperation; \
+        } \
+        if (arguments == 1 && isSmallFloat(sp[-2]) && isSmallFloat(sp[-1]) && \
+            (value = floatOperation(vm, BC_SEND_##name, sp[-2], sp[-1])) != 0) { \
+            goto answerOperation; \
+        } \
+        selector = vm->specialSelectors[BC_SEND_##name - FIRST_SPECIAL_SEND]; \
+        argumentCount = arguments; \
+        lookupClass = NO_CLASS; \
+        cache = SITE_CACHE(); \
+        ip += 1; \
+        goto send;
+
+    SPECIAL_SELECTORS(SPECIAL_SEND_CASE)
+#undef SPECIAL_SEND_CASE
+
+#ifndef THREADED_DISPATCH
+    default:
+        runtimeError(vm, "invalid bytecode %d", *ip);
+        goto failed;
+#endif
+    }
+
+answerOperation:
+    sp--;
+    TOP() = value;
+    ip += 1;
+    DISPATCH();
+
+send: {
+    // A send right before a return needs its sender's frame no longer
+    int tail = fp->isBlock ? *ip == BC_BLOCK_RETURN : *ip == BC_RETURN_TOP && !fp->hasClosures;
+    fp->ip = ip;
+    SendOutcome outcome = sendSelector(vm, &sp, selector, argumentCount, lookupClass, cache, tail);
+    if (outcome == SEND_FAILED) goto failed;
+    if (outcome == SEND_ACTIVATED) {
+        Method* callee = vm->frames[vm->frameCount - 1].method;
+        if ((address = nativeAddress(vm, callee, callee->code->bytecodes)) != NULL) RUN_NATIVE(address);
+        LOAD_FRAME();
+    }
+    SAFEPOINT();
+    DISPATCH();
+}
+
+nativeReturned:
+    if (status == RUN_FAILED) goto failed;
+    if (status == RUN_UNWINDING) {
+        if (vm->unwindFrame < entry) {
+            vm->statistics.bytecodes += executed;
+            return RUN_UNWINDING;
+        }
+        value = vm->unwindValue;
+        returnFrame = vm->unwindFrame;
+        goto returnValue;
+    }
+    value = vm->frames[nativeFrame].base[0];
+    returnFrame = nativeFrame;
+    goto returnValue;
+
+returnValue: {
+    Oop* base = vm->frames[returnFrame].base;
+    base[0] = value;
+    sp = base + 1;
+    vm->frameCount = returnFrame;
+    if (returnFrame == entry) {
+        *result = value;
+        vm->stackTop = base;
+        vm->statistics.bytecodes += executed;
+        return RUN_RETURNED;
+    }
+    LOAD_FRAME();
+    DISPATCH();
+}
+
+notBoolean:
+    fp->ip = ip;
+    runtimeError(vm, "a condition is not a Boolean");
+
+failed:
+    vm->stackTop = vm->frames[entry].base;
+    vm->frameCount = entry;
+    vm->statistics.bytecodes += executed;
+    return RUN_FAILED;
+
+#undef LOAD_FRAME
+#undef BYTE
+#undef JUMP_OFFSET
+#undef PUSH
+#undef POP
+#undef TOP
+#undef SITE_CACHE
+#undef SAFEPOINT
+#undef RUN_NATIVE
+#undef CASE
+#undef DISPATCH
+}
+
+// Entry points
+
+// Run from C: a ^ cannot return past this
+static int runFromC(VM* vm, int entry, Oop* result) {
+    int barrier = vm->returnBarrier;
+    vm->returnBarrier = entry;
+    RunStatus status = run(vm, entry, result);
+    vm->returnBarrier = barrier;
+    return status == RUN_RETURNED;
+}
+
+int interpret(VM* vm, Method* method, Oop receiver, Oop* result) {
+    if (vm->frameCount == vm->maxFrames) {
+        runtimeError(vm, "too many nested activations");
+        return 0;
+    }
+    int entry = vm->frameCount;
+    Oop* base = vm->stackTop;
+    base[0] = receiver;
+    Frame* frame = &vm->frames[vm->frameCount++];
+    if (!activate(vm, frame, method, base)) {
+        vm->frameCount = entry;
+        return 0;
+    }
+    vm->stackTop = base + 1 + method->code->argumentCount + method->code->temporaryCount;
+    return runFromC(vm, entry, result);
+}
+
+int sendMessage(VM* vm, Oop receiver, Oop selector, Oop* arguments, int argumentCount, Oop* result) {
+    int entry = vm->frameCount;
+    Oop* base = vm->stackTop;
+    if (base + argumentCount + STACK_SLACK > vm->stackLimit) {
+        runtimeError(vm, "stack overflow");
+        return 0;
+    }
+    base[0] = receiver;
+    for (int i = 0; i < argumentCount; i++) base[i + 1] = arguments[i];
+    Oop* sp = base + 1 + argumentCount;
+
+    SendOutcome outcome = sendSelector(vm, &sp, selector, argumentCount, NO_CLASS, NULL, 0);
+    if (outcome == SEND_ANSWERED) {
+        *result = base[0];
+        vm->stackTop = base;
+        return 1;
+    }
+    if (outcome == SEND_FAILED) {
+        vm->stackTop = base;
+        vm->frameCount = entry;
+        return 0;
+    }
+    vm->stackTop = sp;
+    return runFromC(vm, entry, result);
+}
+
+// Native code support
+
+// Run the activation a send made, in native code if it is compiled
+static RunStatus runActivation(VM* vm, Oop* sp) {
+    int top = vm->frameCount - 1;
+    Frame* frame = &vm->frames[top];
+    const uint8_t* address = nativeAddress(vm, frame->method, frame->method->code->bytecodes);
+    if (address != NULL) return vm->jit->enter(vm, frame, sp, address);
+    Oop result;
+    vm->stackTop = sp;
+    return run(vm, top, &result);
+}
+
+// Special sends first try the fast paths of the interpreter's SEND_<name>
+static SendOutcome sendFromSite(VM* vm, Oop** stackTop, const SendSite* site, int tail) {
+    Oop* sp = *stackTop;
+    if (site->opcode >= FIRST_SPECIAL_SEND && site->argumentCount == 1) {
+        Oop value = 0;
+        if (isSmallInteger(sp[-2]) && isSmallInteger(sp[-1])) {
+            value = integerOperation(vm, (Bytecode)site->opcode, sp[-2], sp[-1]);
+        } else if (isSmallFloat(sp[-2]) && isSmallFloat(sp[-1])) {
+            value = floatOperation(vm, (Bytecode)site->opcode, sp[-2], sp[-1]);
+        }
+        if (value != 0) {
+            sp[-2] = value;
+            *stackTop = sp - 1;
+            return SEND_ANSWERED;
+        }
+    }
+    int lookupClass = site->opcode == BC_SUPER_SEND ? vm->classes[site->method->classIndex].superclass : NO_CLASS;
+    return sendSelector(vm, stackTop, *site->selector, site->argumentCount, lookupClass, site->cache, tail);
+}
+
+RunStatus nativeSend(VM* vm, Oop* sp, const SendSite* site) {
+    SendOutcome outcome = sendFromSite(vm, &sp, site, 0);
+    if (outcome == SEND_FAILED) return RUN_FAILED;
+    return outcome == SEND_ANSWERED ? RUN_RETURNED : runActivation(vm, sp);
+}
+
+RunStatus nativeTailSend(VM* vm, Oop* sp, const SendSite* site) {
+    int top = vm->frameCount - 1;
+    Frame* frame = &vm->frames[top];
+    SendOutcome outcome = sendFromSite(vm, &sp, site, 1);
+    if (outcome == SEND_FAILED) return RUN_FAILED;
+    if (outcome == SEND_ANSWERED) {
+        // The return that follows, counted as the interpreter would
+        frame->base[0] = sp[-1];
+        vm->frameCount = top;
+        vm->statistics.bytecodes++;
+        return RUN_RETURNED;
+    }
+    vm->stackTop = sp;
+    if (frame->method->native != NULL) return RUN_REPLACED;
+    Oop result;
+    return run(vm, top, &result);
+}
+
+Frame* nativeActivate(VM* vm, Method* method, Oop* base) {
+    if (vm->frameCount == vm->maxFrames) {
+        runtimeError(vm, "too many nested activations");
+        return NULL;
+    }
+    Frame* frame = &vm->frames[vm->frameCount++];
+    return activate(vm, frame, method, base) ? frame : NULL;
+}
+
+Oop nativeMakeClosure(VM* vm, Frame* frame, Method* block, Oop* sp) {
+    return makeClosure(vm, frame, block, sp);
+}
+
+Oop nativeMakeArray(VM* vm, Oop* sp, int count) {
+    return makeArray(vm, sp, count);
+}
+
+RunStatus nativeNonLocalReturn(VM* vm, Frame* frame, Oop value) {
+    if (!homeIsActive(vm, frame)) {
+        runtimeError(vm, "block cannot return: its method has returned");
+        return RUN_FAILED;
+    }
+    vm->unwindFrame = (int)frame->home;
+    vm->unwindValue = value;
+    return RUN_UNWINDING;
+}
+
+void nativeError(VM* vm, const char* message) {
+    runtimeError(vm, "%s", message);
+}
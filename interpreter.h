@@ -0,0 +1,25 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "runtime.h"
+
+/*
+ * Bytecode interpreter. Built with GCC or Clang it is direct threaded: each
+ * instruction ends by jumping through a table of label addresses indexed by
+ * the next opcode. Defining VM_SWITCH_DISPATCH (make DISPATCH=switch) selects
+ * a portable switch loop instead. The instruction pointer, stack pointer and
+ * current frame live in locals while code runs.
+ *
+ * A send followed by a return reuses the frame of the sender, so loops written
+ * as recursive methods in the kernel run in constant stack space.
+ *
+ * Both functions answer 1 with the value in result, or 0 after a runtime
+ * error, which abandons every activation they started.
+ */
+
+/* Run a doit, or any method without arguments, on a receiver */
+int interpret(VM* vm, Method* method, Oop receiver, Oop* result);
+/* Send a message from C */
+int sendMessage(VM* vm, Oop receiver, Oop selector, Oop* arguments, int argumentCount, Oop* result);
+
+#endif /* INTERPRETER_H */
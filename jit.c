@@ -0,0 +1,1215 @@
+#include <stdlib.h>
+#include <string.h>
+#include "jit.h"
+#include "primitives.h"
+
+void freeNativeCode(NativeCode* native) {
+    if (native == NULL) return;
+    free(native->resume);
+    free(native->sites);
+    free(native);
+}
+
+#ifdef JIT_SUPPORTED
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Address space for machine code; pages never written stay unbacked
+#define REGION_SIZE ((size_t)64 * 1024 * 1024)
+
+// Used when the C stack has no limit
+#define DEFAULT_STACK_SIZE ((size_t)8 * 1024 * 1024)
+
+// Assembler
+
+typedef enum {
+    REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+    REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15
+} Register;
+
+// While native code runs. All are callee-saved, so calls to C keep them.
+#define REG_VM REG_RBX
+#define REG_FRAME REG_R12
+#define REG_SP REG_R13              // First free stack slot
+#define REG_TEMPORARIES REG_R14     // The frame's base + 1
+
+typedef enum {
+    CC_O = 0x0, CC_NO = 0x1, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+    CC_S = 0x8, CC_NS = 0x9, CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe, CC_G = 0xf
+} Condition;
+
+// Opcodes of the two-operand instructions, in their "r/m, reg" form
+#define OP_ADD 0x01
+#define OP_OR 0x09
+#define OP_AND 0x21
+#define OP_SUB 0x29
+#define OP_XOR 0x31
+#define OP_CMP 0x39
+
+// Their extension in the /digit form that takes an immediate
+#define EXT_ADD 0
+#define EXT_OR 1
+#define EXT_AND 4
+#define EXT_SUB 5
+#define EXT_CMP 7
+#define EXT_SHL 4           // Of the shift group
+#define EXT_SAR 7
+
+typedef struct {
+    size_t at;              // Of a rel32 field
+    int label;
+} Fixup;
+
+typedef struct {
+    uint8_t* bytes;
+    size_t length;
+    size_t capacity;
+    int* labels;            // Offset of each label, -1 until placed
+    int labelCount;
+    Fixup* fixups;
+    int fixupCount;
+    int fixupCapacity;
+    int failed;             // Out of memory
+} Assembler;
+
+static int initAssembler(Assembler* a, int labelCount) {
+    memset(a, 0, sizeof(Assembler));
+    a->labels = (int*)malloc(sizeof(int) * (size_t)labelCount);
+    if (a->labels == NULL) return 0;
+    for (int i = 0; i < labelCount; i++) a->labels[i] = -1;
+    a->labelCount = labelCount;
+    return 1;
+}
+
+static void freeAssembler(Assembler* a) {
+    free(a->bytes);
+    free(a->labels);
+    free(a->fixups);
+}
+
+static void emitByte(Assembler* a, uint8_t byte) {
+    if (a->length == a->capacity) {
+        size_t capacity = a->capacity > 0 ? a->capacity * 2 : 4096;
+        uint8_t* bytes = (uint8_t*)realloc(a->bytes, capacity);
+        if (bytes == NULL) {
+            a->failed = 1;
+            return;
+        }
+        a->bytes = bytes;
+        a->capacity = capacity;
+    }
+    a->bytes[a->length++] = byte;
+}
+
+static void emit32(Assembler* a, uint32_t value) {
+    for (int i = 0; i < 4; i++) emitByte(a, (uint8_t)(value >> (8 * i)));
+}
+
+static void emit64(Assembler* a, uint64_t value) {
+    for (int i = 0; i < 8; i++) emitByte(a, (uint8_t)(value >> (8 * i)));
+}
+
+static int fitsByte(int64_t value) {
+    return value >= -128 && value <= 127;
+}
+
+static int fitsInt32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static void emitRex(Assembler* a, int wide, int reg, int rm) {
+    uint8_t rex = (uint8_t)(0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm & 8 ? 1 : 0));
+    if (rex != 0x40) emitByte(a, rex);
+}
+
+static void emitOpcode(Assembler* a, int opcode) {
+    if (opcode > 0xff) emitByte(a, (uint8_t)(opcode >> 8));
+    emitByte(a, (uint8_t)opcode);
+}
+
+// An instruction on reg (or an opcode extension) and the memory at base + displacement.
+// The displacement is always there, which spares the special cases of rbp and r13.
+static void emitMemory(Assembler* a, int wide, int opcode, int reg, Register base, int32_t displacement) {
+    emitRex(a, wide, reg, base);
+    emitOpcode(a, opcode);
+    int mod = fitsByte(displacement) ? 1 : 2;
+    emitByte(a, (uint8_t)(mod << 6 | (reg & 7) << 3 | (base & 7)));
+    // rsp and r12 as a base need a SIB byte
+    if ((base & 7) == REG_RSP) emitByte(a, 0x24);
+    if (mod == 1) {
+        emitByte(a, (uint8_t)displacement);
+    } else {
+        emit32(a, (uint32_t)displacement);
+    }
+}
+
+// An instruction on two registers, or a register and an opcode extension
+static void emitRegisters(Assembler* a, int wide, int opcode, int reg, int rm) {
+    emitRex(a, wide, reg, rm);
+    emitOpcode(a, opcode);
+    emitByte(a, (uint8_t)(0xc0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+static void emitLoad(Assembler* a, Register reg, Register base, int32_t displacement) {
+    emitMemory(a, 1, 0x8b, reg, base, displacement);
+}
+
+static void emitStore(Assembler* a, Register base, int32_t displacement, Register reg) {
+    emitMemory(a, 1, 0x89, reg, base, displacement);
+}
+
+static void emitLoad32(Assembler* a, Register reg, Register base, int32_t displacement) {
+    emitMemory(a, 0, 0x8b, reg, base, displacement);
+}
+
+static void emitStore32(Assembler* a, Register base, int32_t displacement, Register reg) {
+    emitMemory(a, 0, 0x89, reg, base, displacement);
+}
+
+static void emitLea(Assembler* a, Register reg, Register base, int32_t displacement) {
+    emitMemory(a, 1, 0x8d, reg, base, displacement);
+}
+
+static void emitMove(Assembler* a, Register destination, Register source) {
+    emitRegisters(a, 1, 0x89, source, destination);
+}
+
+static void emitMoveImmediate(Assembler* a, Register reg, uint64_t value) {
+    if (value <= UINT32_MAX) {
+        // Writing the low half clears the high one
+        emitRex(a, 0, 0, reg);
+        emitByte(a, (uint8_t)(0xb8 + (reg & 7)));
+        emit32(a, (uint32_t)value);
+    } else if (fitsInt32((int64_t)value)) {
+        emitRegisters(a, 1, 0xc7, 0, reg);
+        emit32(a, (uint32_t)value);
+    } else {
+        emitRex(a, 1, 0, reg);
+        emitByte(a, (uint8_t)(0xb8 + (reg & 7)));
+        emit64(a, value);
+    }
+}
+
+// destination = destination <op> source
+static void emitOperation(Assembler* a, int opcode, Register destination, Register source) {
+    emitRegisters(a, 1, opcode, source, destination);
+}
+
+static void emitOperation32(Assembler* a, int opcode, Register destination, Register source) {
+    emitRegisters(a, 0, opcode, source, destination);
+}
+
+// reg = reg <op> [base + displacement], from the "reg, r/m" form of the opcode
+static void emitOperationMemory(Assembler* a, int wide, int opcode, Register reg, Register base, int32_t displacement) {
+    emitMemory(a, wide, opcode + 2, reg, base, displacement);
+}
+
+static void emitOperationImmediate(Assembler* a, int extension, Register reg, int32_t value) {
+    if (fitsByte(value)) {
+        emitRegisters(a, 1, 0x83, extension, reg);
+        emitByte(a, (uint8_t)value);
+    } else {
+        emitRegisters(a, 1, 0x81, extension, reg);
+        emit32(a, (uint32_t)value);
+    }
+}
+
+static void emitMemoryImmediate(Assembler* a, int wide, int extension, Register base, int32_t displacement, int32_t value) {
+    if (fitsByte(value)) {
+        emitMemory(a, wide, 0x83, extension, base, displacement);
+        emitByte(a, (uint8_t)value);
+    } else {
+        emitMemory(a, wide, 0x81, extension, base, displacement);
+        emit32(a, (uint32_t)value);
+    }
+}
+
+static void emitShift(Assembler* a, int extension, Register reg, int count) {
+    emitRegisters(a, 1, 0xc1, extension, reg);
+    emitByte(a, (uint8_t)count);
+}
+
+// Flags of reg & value, on the low 32 bits
+static void emitTestImmediate(Assembler* a, Register reg, uint32_t value) {
+    emitRegisters(a, 0, 0xf7, 0, reg);
+    emit32(a, value);
+}
+
+static void emitPush(Assembler* a, Register reg) {
+    emitRex(a, 0, 0, reg);
+    emitByte(a, (uint8_t)(0x50 + (reg & 7)));
+}
+
+static void emitPop(Assembler* a, Register reg) {
+    emitRex(a, 0, 0, reg);
+    emitByte(a, (uint8_t)(0x58 + (reg & 7)));
+}
+
+static void emitCallRegister(Assembler* a, Register reg) {
+    emitRegisters(a, 0, 0xff, 2, reg);
+}
+
+// Through rax, as C code may be anywhere in the address space
+static void emitCall(Assembler* a, uintptr_t function) {
+    emitMoveImmediate(a, REG_RAX, function);
+    emitCallRegister(a, REG_RAX);
+}
+
+// A rel32 jump to be patched; answers the offset of its field
+static size_t emitJumpForward(Assembler* a) {
+    emitByte(a, 0xe9);
+    size_t at = a->length;
+    emit32(a, 0);
+    return at;
+}
+
+static size_t emitBranchForward(Assembler* a, Condition condition) {
+    emitByte(a, 0x0f);
+    emitByte(a, (uint8_t)(0x80 | condition));
+    size_t at = a->length;
+    emit32(a, 0);
+    return at;
+}
+
+// Point the rel32 field at to the current offset
+static void patchHere(Assembler* a, size_t at) {
+    if (a->failed) return;
+    int32_t distance = (int32_t)(a->length - (at + 4));
+    memcpy(a->bytes + at, &distance, sizeof(distance));
+}
+
+static void addFixup(Assembler* a, size_t at, int label) {
+    if (a->fixupCount == a->fixupCapacity) {
+        int capacity = a->fixupCapacity > 0 ? a->fixupCapacity * 2 : 64;
+        Fixup* fixups = (Fixup*)realloc(a->fixups, sizeof(Fixup) * (size_t)capacity);
+        if (fixups == NULL) {
+            a->failed = 1;
+            return;
+        }
+        a->fixups = fixups;
+        a->fixupCapacity = capacity;
+    }
+    a->fixups[a->fixupCount].at = at;
+    a->fixups[a->fixupCount].label = label;
+    a->fixupCount++;
+}
+
+static void emitJump(Assembler* a, int label) {
+    addFixup(a, emitJumpForward(a), label);
+}
+
+static void emitBranch(Assembler* a, Condition condition, int label) {
+    addFixup(a, emitBranchForward(a, condition), label);
+}
+
+static void placeLabel(Assembler* a, int label) {
+    a->labels[label] = (int)a->length;
+}
+
+static void resolveFixups(Assembler* a) {
+    for (int i = 0; i < a->fixupCount && !a->failed; i++) {
+        int32_t distance = (int32_t)(a->labels[a->fixups[i].label] - (int)(a->fixups[i].at + 4));
+        memcpy(a->bytes + a->fixups[i].at, &distance, sizeof(distance));
+    }
+}
+
+// Code region
+
+// Copy assembled code into the region. Answers where it went, or NULL.
+static uint8_t* installCode(Jit* jit, const Assembler* a) {
+    size_t start = (jit->used + 15) & ~(size_t)15;
+    if (a->failed || start + a->length > jit->size) return NULL;
+    uintptr_t first = (uintptr_t)(jit->region + start) & ~(uintptr_t)(jit->pageSize - 1);
+    uintptr_t end = ((uintptr_t)(jit->region + start + a->length) + jit->pageSize - 1) & ~(uintptr_t)(jit->pageSize - 1);
+    // Nothing runs native code while the JIT does, so its pages can be writable a moment
+    if (mprotect((void*)first, end - first, PROT_READ | PROT_WRITE) != 0) return NULL;
+    memcpy(jit->region + start, a->bytes, a->length);
+    if (mprotect((void*)first, end - first, PROT_READ | PROT_EXEC) != 0) return NULL;
+    jit->used = start + a->length;
+    return jit->region + start;
+}
+
+// Templates
+
+#define VM_FIELD(field) ((int32_t)offsetof(VM, field))
+#define FRAME_FIELD(field) ((int32_t)offsetof(Frame, field))
+#define SLOT(index) ((int32_t)(sizeof(ObjectHeader) + sizeof(Oop) * (size_t)(index)))
+#define STACK(index) ((int32_t)(sizeof(Oop) * (index)))
+#define FUNCTION(name) ((uintptr_t)(name))
+
+// Shared tails of a method's code, labelled after its bytecode offsets
+enum {
+    STUB_UNWIND,            // A callee answered a status other than RUN_RETURNED in eax
+    STUB_RETURNED,          // The activation's value is in its receiver's slot: return it
+    STUB_EXIT,              // Return eax to the caller
+    STUB_FAIL,              // Return RUN_FAILED
+    STUB_NOT_BOOLEAN,       // Report a condition that is not a Boolean, then fail
+    STUB_COUNT
+};
+
+// Marks on bytecode offsets
+#define MARK_TARGET 1       // Some jump goes there
+#define MARK_LOOP 2         // Some jump goes back there
+#define MARK_LEADER 4       // Starts a run of instructions that execute together
+
+typedef struct {
+    VM* vm;
+    Method* method;
+    Assembler a;
+    uint8_t* marks;
+    SendSite* sites;
+    int stubs;              // Label of the first stub
+} Translation;
+
+// Undo the frame push of the entry or the trampoline and return eax
+static void emitEpilogue(Assembler* a) {
+    emitOperationImmediate(a, EXT_ADD, REG_RSP, 8);
+    emitPop(a, REG_R14);
+    emitPop(a, REG_R12);
+    emitByte(a, 0xc3);
+}
+
+// Return rax from the running activation, which is on top of the frames
+static void emitReturn(Assembler* a) {
+    emitStore(a, REG_TEMPORARIES, STACK(-1), REG_RAX);
+    emitMove(a, REG_SP, REG_TEMPORARIES);
+    emitMemory(a, 0, 0xff, 1, REG_VM, VM_FIELD(frameCount));
+    emitOperation32(a, OP_XOR, REG_RAX, REG_RAX);
+    emitEpilogue(a);
+}
+
+static void emitPushRegister(Assembler* a, Register reg) {
+    emitStore(a, REG_SP, 0, reg);
+    emitOperationImmediate(a, EXT_ADD, REG_SP, 8);
+}
+
+static void emitCountBytecodes(Assembler* a, int count) {
+    emitMemoryImmediate(a, 1, EXT_ADD, REG_VM, VM_FIELD(statistics.bytecodes), count);
+}
+
+// Objects may move in a collection; native code keeps none in registers across it
+static void emitSafepoint(Assembler* a) {
+    emitMemoryImmediate(a, 0, EXT_CMP, REG_VM, VM_FIELD(memory.collectionRequested), 0);
+    size_t skip = emitBranchForward(a, CC_E);
+    emitStore(a, REG_VM, VM_FIELD(stackTop), REG_SP);
+    emitLea(a, REG_RDI, REG_VM, VM_FIELD(memory));
+    emitOperation32(a, OP_XOR, REG_RSI, REG_RSI);
+    emitCall(a, FUNCTION(collectGarbage));
+    patchHere(a, skip);
+}
+
+// Store rax into the slot at offset of the object in rcx, with the write barrier of memory.h.
+// Objects with cards never have FLAG_REMEMBERED, so stores into them always call rememberSlot.
+static void emitStorePointer(Assembler* a, int32_t offset) {
+    emitStore(a, REG_RCX, offset, REG_RAX);
+    emitTestImmediate(a, REG_RAX, TAG_MASK);
+    size_t immediate = emitBranchForward(a, CC_NE);
+    emitMove(a, REG_RDX, REG_RAX);
+    emitOperationMemory(a, 1, OP_SUB, REG_RDX, REG_VM, VM_FIELD(memory.young));
+    emitOperationMemory(a, 1, OP_CMP, REG_RDX, REG_VM, VM_FIELD(memory.youngSize));
+    size_t oldValue = emitBranchForward(a, CC_AE);
+    emitMove(a, REG_RDX, REG_RCX);
+    emitOperationMemory(a, 1, OP_SUB, REG_RDX, REG_VM, VM_FIELD(memory.young));
+    emitOperationMemory(a, 1, OP_CMP, REG_RDX, REG_VM, VM_FIELD(memory.youngSize));
+    size_t youngObject = emitBranchForward(a, CC_B);
+    emitMemory(a, 0, 0xf6, 0, REG_RCX, (int32_t)offsetof(ObjectHeader, flags));
+    emitByte(a, FLAG_REMEMBERED);
+    size_t remembered = emitBranchForward(a, CC_NE);
+    emitLea(a, REG_RDI, REG_VM, VM_FIELD(memory));
+    emitMove(a, REG_RSI, REG_RCX);
+    emitMoveImmediate(a, REG_RDX, (uint64_t)(offset - (int32_t)sizeof(ObjectHeader)) / sizeof(Oop));
+    emitCall(a, FUNCTION(rememberSlot));
+    patchHere(a, immediate);
+    patchHere(a, oldValue);
+    patchHere(a, youngObject);
+    patchHere(a, remembered);
+}
+
+// The environment hops out from the frame's, into rcx
+static void emitEnvironment(Assembler* a, int hops) {
+    emitLoad(a, REG_RCX, REG_FRAME, FRAME_FIELD(environment));
+    for (int i = 0; i < hops; i++) emitLoad(a, REG_RCX, REG_RCX, SLOT(0));
+}
+
+// The class index of the receiver of a send, into ecx
+static void emitReceiverClass(Assembler* a, int argumentCount) {
+    emitLoad(a, REG_RAX, REG_SP, STACK(-argumentCount - 1));
+    emitTestImmediate(a, REG_RAX, TAG_MASK);
+    size_t immediate = emitBranchForward(a, CC_NE);
+    emitLoad32(a, REG_RCX, REG_RAX, (int32_t)offsetof(ObjectHeader, classIndex));
+    size_t heap = emitJumpForward(a);
+    patchHere(a, immediate);
+    emitMoveImmediate(a, REG_RCX, CLASS_SMALL_INTEGER);
+    emitTestImmediate(a, REG_RAX, INTEGER_TAG);
+    size_t integer = emitBranchForward(a, CC_NE);
+    emitMoveImmediate(a, REG_RCX, CLASS_CHARACTER);
+    emitTestImmediate(a, REG_RAX, CHARACTER_TAG);
+    size_t character = emitBranchForward(a, CC_NE);
+    emitMoveImmediate(a, REG_RCX, CLASS_FLOAT);
+    patchHere(a, heap);
+    patchHere(a, integer);
+    patchHere(a, character);
+}
+
+// After a call that answers a RunStatus
+static void emitCheckStatus(Translation* t) {
+    emitOperation32(&t->a, OP_OR, REG_RAX, REG_RAX);
+    emitBranch(&t->a, CC_NE, t->stubs + STUB_UNWIND);
+}
+
+// The descriptor of the send at pc, for the interpreter's side
+static const SendSite* sendSite(Translation* t, int pc, const Oop* selector, int argumentCount, Bytecode opcode) {
+    uint32_t index = t->method->siteIndex[pc];
+    SendSite* site = &t->sites[index];
+    site->selector = selector;
+    site->argumentCount = argumentCount;
+    site->opcode = opcode;
+    site->method = t->method;
+    site->cache = &t->method->caches[index];
+    return site;
+}
+
+static const Oop* specialSelectorSlot(Translation* t, Bytecode opcode) {
+    return &t->vm->specialSelectors[opcode - FIRST_SPECIAL_SEND];
+}
+
+// Whether the instruction at next returns the value of a send before it, so
+// that the interpreter would make a tail send (of methods, only while they
+// have no closures)
+static int isTailSend(Translation* t, int next) {
+    CompiledCode* code = t->method->code;
+    return next < code->length && code->bytecodes[next] == (code->isBlock ? BC_BLOCK_RETURN : BC_RETURN_TOP);
+}
+
+// A send through nativeSend. Where the interpreter would make a tail send,
+// nativeTailSend reuses the frame, and a compiled callee goes on in this
+// same native activation.
+static void emitCallSend(Translation* t, const SendSite* site, int tail) {
+    Assembler* a = &t->a;
+    CompiledCode* code = t->method->code;
+    if (tail) {
+        size_t closures = 0;
+        if (!code->isBlock) {
+            emitMemoryImmediate(a, 0, EXT_CMP, REG_FRAME, FRAME_FIELD(hasClosures), 0);
+            closures = emitBranchForward(a, CC_NE);
+        }
+        emitMove(a, REG_RDI, REG_VM);
+        emitMove(a, REG_RSI, REG_SP);
+        emitMoveImmediate(a, REG_RDX, (uintptr_t)site);
+        emitCall(a, FUNCTION(nativeTailSend));
+        emitRegisters(a, 0, 0x83, EXT_CMP, REG_RAX);
+        emitByte(a, RUN_REPLACED);
+        size_t replaced = emitBranchForward(a, CC_E);
+        emitCheckStatus(t);
+        emitJump(a, t->stubs + STUB_RETURNED);
+        patchHere(a, replaced);
+        emitLoad(a, REG_SP, REG_VM, VM_FIELD(stackTop));
+        emitLoad(a, REG_RAX, REG_FRAME, FRAME_FIELD(method));
+        emitLoad(a, REG_RAX, REG_RAX, (int32_t)offsetof(Method, native));
+        emitLoad(a, REG_RAX, REG_RAX, (int32_t)offsetof(NativeCode, body));
+        emitRegisters(a, 0, 0xff, 4, REG_RAX);
+        if (code->isBlock) return;
+        patchHere(a, closures);
+    }
+    emitMove(a, REG_RDI, REG_VM);
+    emitMove(a, REG_RSI, REG_SP);
+    emitMoveImmediate(a, REG_RDX, (uintptr_t)site);
+    emitCall(a, FUNCTION(nativeSend));
+    if (site->argumentCount > 0) emitLea(a, REG_SP, REG_SP, STACK(-site->argumentCount));
+    emitCheckStatus(t);
+    emitSafepoint(a);
+}
+
+// A send through the site's inline cache. A hit on a method with an entry
+// calls it; anything else is up to nativeSend.
+static void emitSend(Translation* t, const SendSite* site, int next) {
+    Assembler* a = &t->a;
+    int argumentCount = site->argumentCount;
+    if (isTailSend(t, next)) {
+        // Calling the callee would keep the frame a tail send gives up
+        emitCallSend(t, site, 1);
+        return;
+    }
+    if (site->opcode == BC_SUPER_SEND) {
+        int classIndex = t->method->classIndex;
+        emitLoad(a, REG_RAX, REG_VM, VM_FIELD(classes));
+        emitLoad32(a, REG_RCX, REG_RAX,
+                   (int32_t)(sizeof(RuntimeClass) * (size_t)classIndex + offsetof(RuntimeClass, superclass)));
+    } else {
+        emitReceiverClass(a, argumentCount);
+    }
+    emitMoveImmediate(a, REG_RDX, (uintptr_t)site->cache);
+    emitLoad32(a, REG_RAX, REG_VM, VM_FIELD(lookupEpoch));
+    emitOperationMemory(a, 0, OP_CMP, REG_RAX, REG_RDX, (int32_t)offsetof(SendCache, epoch));
+    size_t staleEpoch = emitBranchForward(a, CC_NE);
+    emitOperationMemory(a, 0, OP_CMP, REG_RCX, REG_RDX, (int32_t)offsetof(SendCache, first.classIndex));
+    size_t otherClass = emitBranchForward(a, CC_NE);
+    emitLoad(a, REG_RAX, REG_RDX, (int32_t)offsetof(SendCache, first.method));
+    emitLoad(a, REG_RAX, REG_RAX, (int32_t)offsetof(Method, native));
+    emitOperation(a, OP_OR, REG_RAX, REG_RAX);
+    size_t interpreted = emitBranchForward(a, CC_E);
+    emitLoad(a, REG_RAX, REG_RAX, (int32_t)offsetof(NativeCode, entry));
+    emitOperation(a, OP_OR, REG_RAX, REG_RAX);
+    size_t noEntry = emitBranchForward(a, CC_E);
+    emitMemory(a, 1, 0xff, 0, REG_RDX, (int32_t)offsetof(SendCache, hits));
+    emitMemory(a, 1, 0xff, 0, REG_VM, VM_FIELD(statistics.sends));
+    emitCallRegister(a, REG_RAX);
+    emitCheckStatus(t);
+    emitSafepoint(a);
+    size_t done = emitJumpForward(a);
+
+    patchHere(a, staleEpoch);
+    patchHere(a, otherClass);
+    patchHere(a, interpreted);
+    patchHere(a, noEntry);
+    emitCallSend(t, site, 0);
+    patchHere(a, done);
+}
+
+// Pops a condition and jumps to label when it is value; anything but a Boolean is an error
+static void emitConditionalJump(Translation* t, int whenTrue, int label) {
+    Assembler* a = &t->a;
+    emitOperationImmediate(a, EXT_SUB, REG_SP, 8);
+    emitLoad(a, REG_RAX, REG_SP, 0);
+    emitOperationMemory(a, 1, OP_CMP, REG_RAX, REG_VM, whenTrue ? VM_FIELD(trueObject) : VM_FIELD(falseObject));
+    emitBranch(a, CC_E, label);
+    emitOperationMemory(a, 1, OP_CMP, REG_RAX, REG_VM, whenTrue ? VM_FIELD(falseObject) : VM_FIELD(trueObject));
+    emitBranch(a, CC_NE, t->stubs + STUB_NOT_BOOLEAN);
+}
+
+// Special sends with a SmallInteger path inline
+static int isInlineOperation(Bytecode opcode) {
+    switch (opcode) {
+        case BC_SEND_ADD:
+        case BC_SEND_SUBTRACT:
+        case BC_SEND_MULTIPLY:
+        case BC_SEND_BIT_AND:
+        case BC_SEND_BIT_OR:
+        case BC_SEND_INTEGER_DIVIDE:
+        case BC_SEND_MODULO:
+        case BC_SEND_LESS:
+        case BC_SEND_GREATER:
+        case BC_SEND_LESS_EQUAL:
+        case BC_SEND_GREATER_EQUAL:
+        case BC_SEND_EQUAL:
+        case BC_SEND_NOT_EQUAL:
+        case BC_SEND_IDENTICAL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Tagged SmallIntegers compare as their values do
+static int comparison(Bytecode opcode, Condition* condition) {
+    switch (opcode) {
+        case BC_SEND_LESS: *condition = CC_L; return 1;
+        case BC_SEND_GREATER: *condition = CC_G; return 1;
+        case BC_SEND_LESS_EQUAL: *condition = CC_LE; return 1;
+        case BC_SEND_GREATER_EQUAL: *condition = CC_GE; return 1;
+        case BC_SEND_EQUAL:
+        case BC_SEND_IDENTICAL: *condition = CC_E; return 1;
+        case BC_SEND_NOT_EQUAL: *condition = CC_NE; return 1;
+        default: return 0;
+    }
+}
+
+// The receiver and argument into rax and rdx; answers the branch to take
+// unless both are SmallIntegers, the only immediates with the low bit set
+static size_t emitIntegerOperands(Assembler* a) {
+    emitLoad(a, REG_RAX, REG_SP, STACK(-2));
+    emitLoad(a, REG_RDX, REG_SP, STACK(-1));
+    emitRegisters(a, 0, 0x8b, REG_RCX, REG_RAX);
+    emitOperation32(a, OP_AND, REG_RCX, REG_RDX);
+    emitTestImmediate(a, REG_RCX, INTEGER_TAG);
+    return emitBranchForward(a, CC_E);
+}
+
+// An arithmetic special send: the result into rcx, or to the send when it does not fit
+static void emitArithmetic(Translation* t, int pc, int next, Bytecode opcode) {
+    Assembler* a = &t->a;
+    size_t slow[3];
+    int slowCount = 0;
+    slow[slowCount++] = emitIntegerOperands(a);
+    emitMove(a, REG_RCX, REG_RAX);
+    switch (opcode) {
+        case BC_SEND_ADD:
+            // (2x + 1) - 1 + (2y + 1), scaled by the tag
+            emitOperationImmediate(a, EXT_SUB, REG_RCX, INTEGER_TAG);
+            emitOperation(a, OP_ADD, REG_RCX, REG_RDX);
+            slow[slowCount++] = emitBranchForward(a, CC_O);
+            break;
+        case BC_SEND_SUBTRACT:
+            emitOperation(a, OP_SUB, REG_RCX, REG_RDX);
+            slow[slowCount++] = emitBranchForward(a, CC_O);
+            emitOperationImmediate(a, EXT_OR, REG_RCX, INTEGER_TAG);
+            break;
+        case BC_SEND_MULTIPLY:
+            // x times the tagged y without its tag overflows exactly when the result does not fit
+            emitShift(a, EXT_SAR, REG_RCX, TAG_BITS);
+            emitMove(a, REG_RSI, REG_RDX);
+            emitOperationImmediate(a, EXT_SUB, REG_RSI, INTEGER_TAG);
+            emitRegisters(a, 1, 0x0faf, REG_RCX, REG_RSI);
+            slow[slowCount++] = emitBranchForward(a, CC_O);
+            emitOperationImmediate(a, EXT_OR, REG_RCX, INTEGER_TAG);
+            break;
+        case BC_SEND_BIT_AND:
+            emitOperation(a, OP_AND, REG_RCX, REG_RDX);
+            break;
+        case BC_SEND_INTEGER_DIVIDE:
+        case BC_SEND_MODULO:
+            // Untagged, truncated by idiv, then rounded towards negative
+            // infinity as integerOperation does; division by zero is the send's
+            emitMove(a, REG_RSI, REG_RDX);
+            emitShift(a, EXT_SAR, REG_RSI, TAG_BITS);
+            slow[slowCount++] = emitBranchForward(a, CC_E);
+            emitShift(a, EXT_SAR, REG_RAX, TAG_BITS);
+            emitByte(a, 0x48);
+            emitByte(a, 0x99);
+            emitRegisters(a, 1, 0xf7, 7, REG_RSI);
+            emitOperation(a, OP_OR, REG_RDX, REG_RDX);
+            size_t exact = emitBranchForward(a, CC_E);
+            emitMove(a, REG_RCX, REG_RDX);
+            emitOperation(a, OP_XOR, REG_RCX, REG_RSI);
+            size_t sameSign = emitBranchForward(a, CC_NS);
+            emitOperationImmediate(a, EXT_SUB, REG_RAX, 1);
+            emitOperation(a, OP_ADD, REG_RDX, REG_RSI);
+            patchHere(a, exact);
+            patchHere(a, sameSign);
+            if (opcode == BC_SEND_MODULO) {
+                // Smaller than the divisor, so it fits
+                emitMove(a, REG_RCX, REG_RDX);
+                emitShift(a, EXT_SHL, REG_RCX, TAG_BITS);
+            } else {
+                // Only SmallInteger minVal // -1 does not fit
+                emitMove(a, REG_RCX, REG_RAX);
+                emitShift(a, EXT_SHL, REG_RCX, TAG_BITS);
+                emitMove(a, REG_RSI, REG_RCX);
+                emitShift(a, EXT_SAR, REG_RSI, TAG_BITS);
+                emitOperation(a, OP_CMP, REG_RSI, REG_RAX);
+                slow[slowCount++] = emitBranchForward(a, CC_NE);
+            }
+            emitOperationImmediate(a, EXT_OR, REG_RCX, INTEGER_TAG);
+            break;
+        default:
+            emitOperation(a, OP_OR, REG_RCX, REG_RDX);
+            break;
+    }
+    emitStore(a, REG_SP, STACK(-2), REG_RCX);
+    emitOperationImmediate(a, EXT_SUB, REG_SP, 8);
+    size_t done = emitJumpForward(a);
+    for (int i = 0; i < slowCount; i++) patchHere(a, slow[i]);
+    emitCallSend(t, sendSite(t, pc, specialSelectorSlot(t, opcode), 1, opcode), isTailSend(t, next));
+    patchHere(a, done);
+}
+
+static void emitComparison(Translation* t, int pc, int next, Bytecode opcode, Condition condition) {
+    Assembler* a = &t->a;
+    size_t slow = emitIntegerOperands(a);
+    emitOperation(a, OP_CMP, REG_RAX, REG_RDX);
+    emitLoad(a, REG_RAX, REG_VM, VM_FIELD(falseObject));
+    emitMemory(a, 1, 0x0f40 | condition, REG_RAX, REG_VM, VM_FIELD(trueObject));
+    emitStore(a, REG_SP, STACK(-2), REG_RAX);
+    emitOperationImmediate(a, EXT_SUB, REG_SP, 8);
+    size_t done = emitJumpForward(a);
+    patchHere(a, slow);
+    emitCallSend(t, sendSite(t, pc, specialSelectorSlot(t, opcode), 1, opcode), isTailSend(t, next));
+    patchHere(a, done);
+}
+
+// A comparison whose result only decides the conditional jump after it:
+// SmallIntegers branch on the flags without making a Boolean
+static void emitComparisonJump(Translation* t, int pc, Bytecode opcode, Condition condition,
+                               int whenTrue, int label) {
+    Assembler* a = &t->a;
+    size_t slow = emitIntegerOperands(a);
+    emitOperationImmediate(a, EXT_SUB, REG_SP, 16);
+    emitOperation(a, OP_CMP, REG_RAX, REG_RDX);
+    emitBranch(a, whenTrue ? condition : (Condition)(condition ^ 1), label);
+    size_t done = emitJumpForward(a);
+    patchHere(a, slow);
+    emitCallSend(t, sendSite(t, pc, specialSelectorSlot(t, opcode), 1, opcode), 0);
+    emitConditionalJump(t, whenTrue, label);
+    patchHere(a, done);
+}
+
+// The activation that native callers jump to. It joins the trampoline's
+// frame layout, then sets up the frame as activate does: inline for methods
+// without an environment, through nativeActivate for the others and to
+// report running out of frames or stack.
+static void emitEntry(Translation* t) {
+    Assembler* a = &t->a;
+    Method* method = t->method;
+    CompiledCode* code = method->code;
+    emitPush(a, REG_R12);
+    emitPush(a, REG_R14);
+    emitOperationImmediate(a, EXT_SUB, REG_RSP, 8);
+
+    size_t noFrame = 0, noStack = 0, activated = 0;
+    if (code->environmentSize == 0) {
+        emitLoad32(a, REG_RCX, REG_VM, VM_FIELD(frameCount));
+        emitOperationMemory(a, 0, OP_CMP, REG_RCX, REG_VM, VM_FIELD(maxFrames));
+        noFrame = emitBranchForward(a, CC_GE);
+        // The temporaries start at the stack pointer
+        emitLea(a, REG_RAX, REG_SP, STACK(code->temporaryCount + code->maxStack + STACK_SLACK));
+        emitOperationMemory(a, 1, OP_CMP, REG_RAX, REG_VM, VM_FIELD(stackLimit));
+        noStack = emitBranchForward(a, CC_A);
+
+        emitRegisters(a, 1, 0x69, REG_FRAME, REG_RCX);
+        emit32(a, (uint32_t)sizeof(Frame));
+        emitOperationMemory(a, 1, OP_ADD, REG_FRAME, REG_VM, VM_FIELD(frames));
+        emitStore32(a, REG_FRAME, FRAME_FIELD(home), REG_RCX);
+        emitOperationImmediate(a, EXT_ADD, REG_RCX, 1);
+        emitStore32(a, REG_VM, VM_FIELD(frameCount), REG_RCX);
+        emitMoveImmediate(a, REG_RAX, (uintptr_t)method);
+        emitStore(a, REG_FRAME, FRAME_FIELD(method), REG_RAX);
+        emitMoveImmediate(a, REG_RAX, (uintptr_t)code->bytecodes);
+        emitStore(a, REG_FRAME, FRAME_FIELD(ip), REG_RAX);
+        emitLea(a, REG_TEMPORARIES, REG_SP, STACK(-code->argumentCount));
+        emitLea(a, REG_RAX, REG_TEMPORARIES, STACK(-1));
+        emitStore(a, REG_FRAME, FRAME_FIELD(base), REG_RAX);
+        emitLoad(a, REG_RAX, REG_TEMPORARIES, STACK(-1));
+        emitStore(a, REG_FRAME, FRAME_FIELD(receiver), REG_RAX);
+        emitLoad(a, REG_RAX, REG_VM, VM_FIELD(nextSerial));
+        emitOperationImmediate(a, EXT_ADD, REG_RAX, 1);
+        emitStore(a, REG_VM, VM_FIELD(nextSerial), REG_RAX);
+        emitStore(a, REG_FRAME, FRAME_FIELD(serial), REG_RAX);
+        emitStore(a, REG_FRAME, FRAME_FIELD(homeSerial), REG_RAX);
+        emitOperation32(a, OP_XOR, REG_RAX, REG_RAX);
+        emitStore32(a, REG_FRAME, FRAME_FIELD(hasClosures), REG_RAX);
+        emitStore32(a, REG_FRAME, FRAME_FIELD(isBlock), REG_RAX);
+        emitLoad(a, REG_RAX, REG_VM, VM_FIELD(nil));
+        emitStore(a, REG_FRAME, FRAME_FIELD(environment), REG_RAX);
+        for (int i = 0; i < code->temporaryCount; i++) emitStore(a, REG_SP, STACK(i), REG_RAX);
+        emitLea(a, REG_SP, REG_SP, STACK(code->temporaryCount));
+        activated = emitJumpForward(a);
+        patchHere(a, noFrame);
+        patchHere(a, noStack);
+    }
+
+    emitMove(a, REG_RDI, REG_VM);
+    emitMoveImmediate(a, REG_RSI, (uintptr_t)method);
+    emitLea(a, REG_RDX, REG_SP, STACK(-code->argumentCount - 1));
+    emitCall(a, FUNCTION(nativeActivate));
+    emitOperation(a, OP_OR, REG_RAX, REG_RAX);
+    emitBranch(a, CC_E, t->stubs + STUB_FAIL);
+    emitMove(a, REG_FRAME, REG_RAX);
+    emitLoad(a, REG_TEMPORARIES, REG_FRAME, FRAME_FIELD(base));
+    emitOperationImmediate(a, EXT_ADD, REG_TEMPORARIES, 8);
+    emitLea(a, REG_SP, REG_TEMPORARIES, STACK(code->argumentCount + code->temporaryCount));
+    if (activated != 0) patchHere(a, activated);
+}
+
+static void emitStubs(Translation* t) {
+    Assembler* a = &t->a;
+    placeLabel(a, t->stubs + STUB_UNWIND);
+    // The status is an int: only eax counts
+    emitRegisters(a, 0, 0x83, EXT_CMP, REG_RAX);
+    emitByte(a, RUN_UNWINDING);
+    emitBranch(a, CC_NE, t->stubs + STUB_EXIT);
+    emitMemory(a, 1, 0x63, REG_RCX, REG_VM, VM_FIELD(unwindFrame));
+    emitRegisters(a, 1, 0x69, REG_RCX, REG_RCX);
+    emit32(a, (uint32_t)sizeof(Frame));
+    emitOperationMemory(a, 1, OP_ADD, REG_RCX, REG_VM, VM_FIELD(frames));
+    emitOperation(a, OP_CMP, REG_RCX, REG_FRAME);
+    emitBranch(a, CC_NE, t->stubs + STUB_EXIT);
+    // This activation is the home of the ^: it returns, the frames above it are gone
+    emitLoad32(a, REG_RAX, REG_VM, VM_FIELD(unwindFrame));
+    emitStore32(a, REG_VM, VM_FIELD(frameCount), REG_RAX);
+    emitLoad(a, REG_RAX, REG_VM, VM_FIELD(unwindValue));
+    emitStore(a, REG_TEMPORARIES, STACK(-1), REG_RAX);
+    placeLabel(a, t->stubs + STUB_RETURNED);
+    emitMove(a, REG_SP, REG_TEMPORARIES);
+    emitOperation32(a, OP_XOR, REG_RAX, REG_RAX);
+
+    placeLabel(a, t->stubs + STUB_EXIT);
+    emitEpilogue(a);
+
+    placeLabel(a, t->stubs + STUB_FAIL);
+    emitMoveImmediate(a, REG_RAX, RUN_FAILED);
+    emitEpilogue(a);
+
+    placeLabel(a, t->stubs + STUB_NOT_BOOLEAN);
+    emitMove(a, REG_RDI, REG_VM);
+    emitMoveImmediate(a, REG_RSI, (uintptr_t)"a condition is not a Boolean");
+    emitCall(a, FUNCTION(nativeError));
+    emitJump(a, t->stubs + STUB_FAIL);
+}
+
+static void emitInstruction(Translation* t, int pc, Bytecode opcode, int first, int second, int next) {
+    Assembler* a = &t->a;
+    Method* method = t->method;
+    switch (opcode) {
+        case BC_PUSH_TEMP:
+            emitLoad(a, REG_RAX, REG_TEMPORARIES, STACK(first));
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_PUSH_OUTER:
+            emitEnvironment(a, second);
+            emitLoad(a, REG_RAX, REG_RCX, SLOT(first + 1));
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_PUSH_COPIED:
+            emitLoad(a, REG_RAX, REG_TEMPORARIES, STACK(-1));
+            emitLoad(a, REG_RAX, REG_RAX, (int32_t)(offsetof(Closure, copied) + sizeof(Oop) * (size_t)first));
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_PUSH_INST:
+            emitLoad(a, REG_RAX, REG_FRAME, FRAME_FIELD(receiver));
+            emitLoad(a, REG_RAX, REG_RAX, SLOT(first));
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_PUSH_GLOBAL:
+            emitMoveImmediate(a, REG_RAX, (uintptr_t)&method->literals[first]);
+            emitLoad(a, REG_RAX, REG_RAX, 0);
+            emitLoad(a, REG_RAX, REG_RAX, SLOT(1));
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_PUSH_LITERAL:
+            // Literals may move, their slots do not
+            emitMoveImmediate(a, REG_RAX, (uintptr_t)&method->literals[first]);
+            emitLoad(a, REG_RAX, REG_RAX, 0);
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_PUSH_INTEGER:
+            emitMoveImmediate(a, REG_RAX, smallIntegerObject(first));
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_PUSH_SELF:
+            emitLoad(a, REG_RAX, REG_FRAME, FRAME_FIELD(receiver));
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_PUSH_NIL:
+        case BC_PUSH_TRUE:
+        case BC_PUSH_FALSE:
+            emitLoad(a, REG_RAX, REG_VM, opcode == BC_PUSH_NIL ? VM_FIELD(nil)
+                                         : opcode == BC_PUSH_TRUE ? VM_FIELD(trueObject) : VM_FIELD(falseObject));
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_PUSH_BLOCK: {
+            Method* block = method->blocks[first];
+            emitMove(a, REG_RDI, REG_VM);
+            emitMove(a, REG_RSI, REG_FRAME);
+            emitMoveImmediate(a, REG_RDX, (uintptr_t)block);
+            emitMove(a, REG_RCX, REG_SP);
+            emitCall(a, FUNCTION(nativeMakeClosure));
+            emitOperation(a, OP_OR, REG_RAX, REG_RAX);
+            emitBranch(a, CC_E, t->stubs + STUB_FAIL);
+            emitStore(a, REG_SP, STACK(-block->code->copiedCount), REG_RAX);
+            emitLea(a, REG_SP, REG_SP, STACK(1 - block->code->copiedCount));
+            break;
+        }
+        case BC_MAKE_ARRAY:
+            emitMove(a, REG_RDI, REG_VM);
+            emitMove(a, REG_RSI, REG_SP);
+            emitMoveImmediate(a, REG_RDX, (uint32_t)first);
+            emitCall(a, FUNCTION(nativeMakeArray));
+            emitOperation(a, OP_OR, REG_RAX, REG_RAX);
+            emitBranch(a, CC_E, t->stubs + STUB_FAIL);
+            emitStore(a, REG_SP, STACK(-first), REG_RAX);
+            emitLea(a, REG_SP, REG_SP, STACK(1 - first));
+            break;
+        case BC_STORE_TEMP:
+        case BC_POP_STORE_TEMP:
+            emitLoad(a, REG_RAX, REG_SP, STACK(-1));
+            emitStore(a, REG_TEMPORARIES, STACK(first), REG_RAX);
+            if (opcode == BC_POP_STORE_TEMP) emitOperationImmediate(a, EXT_SUB, REG_SP, 8);
+            break;
+        case BC_STORE_OUTER:
+        case BC_POP_STORE_OUTER:
+            emitEnvironment(a, second);
+            emitLoad(a, REG_RAX, REG_SP, STACK(-1));
+            emitStorePointer(a, SLOT(first + 1));
+            if (opcode == BC_POP_STORE_OUTER) emitOperationImmediate(a, EXT_SUB, REG_SP, 8);
+            break;
+        case BC_STORE_INST:
+        case BC_POP_STORE_INST:
+            emitLoad(a, REG_RCX, REG_FRAME, FRAME_FIELD(receiver));
+            emitLoad(a, REG_RAX, REG_SP, STACK(-1));
+            emitStorePointer(a, SLOT(first));
+            if (opcode == BC_POP_STORE_INST) emitOperationImmediate(a, EXT_SUB, REG_SP, 8);
+            break;
+        case BC_STORE_GLOBAL:
+        case BC_POP_STORE_GLOBAL:
+            emitMoveImmediate(a, REG_RCX, (uintptr_t)&method->literals[first]);
+            emitLoad(a, REG_RCX, REG_RCX, 0);
+            emitLoad(a, REG_RAX, REG_SP, STACK(-1));
+            emitStorePointer(a, SLOT(1));
+            if (opcode == BC_POP_STORE_GLOBAL) emitOperationImmediate(a, EXT_SUB, REG_SP, 8);
+            break;
+        case BC_POP:
+            emitOperationImmediate(a, EXT_SUB, REG_SP, 8);
+            break;
+        case BC_DUP:
+            emitLoad(a, REG_RAX, REG_SP, STACK(-1));
+            emitPushRegister(a, REG_RAX);
+            break;
+        case BC_SEND:
+        case BC_SUPER_SEND:
+            emitSend(t, sendSite(t, pc, &method->literals[first], second, opcode), next);
+            break;
+        case BC_JUMP:
+            // Loops jump back, so they reach a safepoint even without sends
+            if (first < 0) emitSafepoint(a);
+            emitJump(a, next + first);
+            break;
+        case BC_JUMP_IF_TRUE:
+        case BC_JUMP_IF_FALSE:
+            emitConditionalJump(t, opcode == BC_JUMP_IF_TRUE, next + first);
+            break;
+        case BC_RETURN_TOP:
+        case BC_BLOCK_RETURN:
+            emitLoad(a, REG_RAX, REG_SP, STACK(-1));
+            emitReturn(a);
+            break;
+        case BC_RETURN_SELF:
+            emitLoad(a, REG_RAX, REG_FRAME, FRAME_FIELD(receiver));
+            emitReturn(a);
+            break;
+        case BC_NON_LOCAL_RETURN:
+            emitMove(a, REG_RDI, REG_VM);
+            emitMove(a, REG_RSI, REG_FRAME);
+            emitLoad(a, REG_RDX, REG_SP, STACK(-1));
+            emitCall(a, FUNCTION(nativeNonLocalReturn));
+            emitJump(a, t->stubs + STUB_EXIT);
+            break;
+        case BC_PUSH_THIS_CONTEXT:
+            // markCode turns such code down
+            break;
+        default: {
+            Condition condition;
+            int index = opcode - FIRST_SPECIAL_SEND;
+            const Oop* selector = &t->vm->specialSelectors[index];
+            if (comparison(opcode, &condition)) {
+                emitComparison(t, pc, next, opcode, condition);
+            } else if (isInlineOperation(opcode)) {
+                emitArithmetic(t, pc, next, opcode);
+            } else if (opcode >= BC_SEND_AT) {
+                emitSend(t, sendSite(t, pc, selector, specialSelectorArgumentCount(index), opcode), next);
+            } else {
+                // Division and modulo: the interpreter's paths and the primitives do the work
+                emitCallSend(t, sendSite(t, pc, selector, 1, opcode), isTailSend(t, next));
+            }
+            break;
+        }
+    }
+}
+
+// Mark jump targets and leaders. Answers 0 for code the JIT does not handle.
+static int markCode(const CompiledCode* code, uint8_t* marks) {
+    marks[0] |= MARK_LEADER;
+    for (int pc = 0; pc < code->length;) {
+        Bytecode opcode;
+        int first, second;
+        int next = decodeInstruction(code, pc, &opcode, &first, &second);
+        switch (opcode) {
+            case BC_PUSH_THIS_CONTEXT:
+                return 0;
+            case BC_JUMP:
+            case BC_JUMP_IF_TRUE:
+            case BC_JUMP_IF_FALSE:
+                marks[next + first] |= MARK_TARGET | MARK_LEADER | (first < 0 ? MARK_LOOP : 0);
+                marks[next] |= MARK_LEADER;
+                break;
+            case BC_SEND:
+            case BC_SUPER_SEND:
+            case BC_RETURN_TOP:
+            case BC_RETURN_SELF:
+            case BC_BLOCK_RETURN:
+            case BC_NON_LOCAL_RETURN:
+                // Where a callee may unwind or the code leaves, the count of what
+                // runs together ends
+                marks[next] |= MARK_LEADER;
+                break;
+            default:
+                if (opcode >= FIRST_SPECIAL_SEND && !isInlineOperation(opcode)) marks[next] |= MARK_LEADER;
+                break;
+        }
+        pc = next;
+    }
+    return 1;
+}
+
+static int countInstructions(const CompiledCode* code, const uint8_t* marks, int pc) {
+    int count = 0;
+    do {
+        pc += bytecodeLength((Bytecode)code->bytecodes[pc]);
+        count++;
+    } while (pc < code->length && !(marks[pc] & MARK_LEADER));
+    return count;
+}
+
+int compileMethod(VM* vm, Method* method) {
+    Jit* jit = vm->jit;
+    CompiledCode* code = method->code;
+    Translation t;
+    t.vm = vm;
+    t.method = method;
+    t.stubs = code->length;
+    int assembler = initAssembler(&t.a, code->length + STUB_COUNT);
+    t.marks = (uint8_t*)calloc((size_t)code->length + 1, 1);
+    t.sites = (SendSite*)calloc((size_t)method->siteCount + 1, sizeof(SendSite));
+    if (!assembler || t.marks == NULL || t.sites == NULL || !markCode(code, t.marks)) {
+        jit->declined++;
+        free(t.marks);
+        free(t.sites);
+        freeAssembler(&t.a);
+        return 0;
+    }
+
+    // Native callers go through the send's inline cache, which leaves out
+    // blocks, and primitives are the interpreter's
+    int primitive = code->primitive;
+    int hasEntry = !code->isBlock && method->primitive == NULL &&
+                   !(primitive >= PRIMITIVE_VALUE && primitive <= PRIMITIVE_PERFORM_WITH_ARGUMENTS);
+    if (hasEntry) emitEntry(&t);
+    size_t body = t.a.length;
+
+    for (int pc = 0; pc < code->length;) {
+        Bytecode opcode;
+        int first, second;
+        int next = decodeInstruction(code, pc, &opcode, &first, &second);
+        placeLabel(&t.a, pc);
+        if (t.marks[pc] & MARK_LEADER) emitCountBytecodes(&t.a, countInstructions(code, t.marks, pc));
+
+        Condition condition;
+        if (comparison(opcode, &condition) && next < code->length && !(t.marks[next] & MARK_TARGET) &&
+            (code->bytecodes[next] == BC_JUMP_IF_TRUE || code->bytecodes[next] == BC_JUMP_IF_FALSE)) {
+            Bytecode jump;
+            int offset, unused;
+            int after = decodeInstruction(code, next, &jump, &offset, &unused);
+            placeLabel(&t.a, next);
+            emitComparisonJump(&t, pc, opcode, condition, jump == BC_JUMP_IF_TRUE, after + offset);
+            next = after;
+        } else {
+            emitInstruction(&t, pc, opcode, first, second, next);
+        }
+        pc = next;
+    }
+    emitStubs(&t);
+    resolveFixups(&t.a);
+
+    NativeCode* native = (NativeCode*)calloc(1, sizeof(NativeCode));
+    uint32_t* resume = (uint32_t*)calloc((size_t)code->length, sizeof(uint32_t));
+    uint8_t* start = native != NULL && resume != NULL ? installCode(jit, &t.a) : NULL;
+    if (start == NULL) {
+        free(native);
+        free(resume);
+        free(t.sites);
+        free(t.marks);
+        freeAssembler(&t.a);
+        jit->declined++;
+        return 0;
+    }
+    for (int pc = 0; pc < code->length; pc++) {
+        if (t.marks[pc] & MARK_LOOP) resume[pc] = (uint32_t)t.a.labels[pc];
+    }
+    native->start = start;
+    native->size = t.a.length;
+    native->entry = hasEntry ? start : NULL;
+    native->body = start + body;
+    native->resume = resume;
+    native->sites = t.sites;
+    method->native = native;
+    jit->compiled++;
+    free(t.marks);
+    freeAssembler(&t.a);
+    return 1;
+}
+
+// The way in from C: saves the registers C expects kept, loads those of
+// native code and calls address with the same stack layout as an entry
+static int emitTrampoline(Assembler* a) {
+    emitPush(a, REG_RBP);
+    emitMove(a, REG_RBP, REG_RSP);
+    emitPush(a, REG_RBX);
+    emitPush(a, REG_R12);
+    emitPush(a, REG_R13);
+    emitPush(a, REG_R14);
+    emitPush(a, REG_R15);
+    emitOperationImmediate(a, EXT_SUB, REG_RSP, 8);
+    emitMove(a, REG_VM, REG_RDI);
+    emitMove(a, REG_FRAME, REG_RSI);
+    emitMove(a, REG_SP, REG_RDX);
+    emitLoad(a, REG_TEMPORARIES, REG_FRAME, FRAME_FIELD(base));
+    emitOperationImmediate(a, EXT_ADD, REG_TEMPORARIES, 8);
+    emitByte(a, 0xe8);
+    size_t call = a->length;
+    emit32(a, 0);
+    emitOperationImmediate(a, EXT_ADD, REG_RSP, 8);
+    emitPop(a, REG_R15);
+    emitPop(a, REG_R14);
+    emitPop(a, REG_R13);
+    emitPop(a, REG_R12);
+    emitPop(a, REG_RBX);
+    emitPop(a, REG_RBP);
+    emitByte(a, 0xc3);
+
+    patchHere(a, call);
+    emitPush(a, REG_R12);
+    emitPush(a, REG_R14);
+    emitOperationImmediate(a, EXT_SUB, REG_RSP, 8);
+    emitRegisters(a, 0, 0xff, 4, REG_RCX);
+    return !a->failed;
+}
+
+int initJit(VM* vm) {
+    Jit* jit = (Jit*)calloc(1, sizeof(Jit));
+    if (jit == NULL) return 0;
+    void* region = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        free(jit);
+        return 0;
+    }
+    jit->region = (uint8_t*)region;
+    jit->size = REGION_SIZE;
+    jit->pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+    // Native code calls nest on the C stack. Past half of it the interpreter
+    // carries on alone, which needs no more C stack however deep it goes.
+    struct rlimit limit;
+    size_t stackSize = DEFAULT_STACK_SIZE;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) stackSize = (size_t)limit.rlim_cur;
+    jit->stackLimit = (uintptr_t)__builtin_frame_address(0) - stackSize / 2;
+
+    Assembler a;
+    uint8_t* trampoline = NULL;
+    if (initAssembler(&a, 0) && emitTrampoline(&a)) trampoline = installCode(jit, &a);
+    freeAssembler(&a);
+    if (trampoline == NULL) {
+        munmap(jit->region, jit->size);
+        free(jit);
+        return 0;
+    }
+    jit->enter = (NativeEntry)(uintptr_t)trampoline;
+    vm->jit = jit;
+    return 1;
+}
+
+void freeJit(VM* vm) {
+    if (vm->jit == NULL) return;
+    munmap(vm->jit->region, vm->jit->size);
+    free(vm->jit);
+    vm->jit = NULL;
+}
+
+#else
+
+int initJit(VM* vm) {
+    vm->jit = NULL;
+    return 0;
+}
+
+void freeJit(VM* vm) {
+    (void)vm;
+}
+
+int compileMethod(VM* vm, Method* method) {
+    (void)vm;
+    (void)method;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "runtime.h"
+
+/*
+ * Baseline JIT. A method or block that has been activated or has looped
+ * JIT_THRESHOLD times is translated into x86-64 machine code, one template
+ * per instruction, in an mmapped region that is writable only while code is
+ * copied in.
+ *
+ * Native code runs on the interpreter's frames and stack, so the collector,
+ * runtime errors and ^ see ordinary activations. The frame, the stack pointer
+ * and the temporaries stay in registers. Pushes, stores, jumps, returns,
+ * SmallInteger arithmetic and comparisons are inline, and so is the check of
+ * a send site's first inline cache entry: a hit on a compiled method calls
+ * its machine code directly. Everything else calls the interpreter's
+ * routines below, which run callees that are not compiled in the interpreter.
+ * The interpreter in turn hands an activation to native code after a send
+ * activates a compiled method, or where a compiled method's loop jumps back.
+ *
+ * Both sides answer a RunStatus when an activation they ran is done. On
+ * RUN_UNWINDING a ^ is on its way to frame vm->unwindFrame, and whichever
+ * side runs that frame returns vm->unwindValue from it.
+ *
+ * Only Linux on x86-64 has a code generator; elsewhere initJit answers 0 and
+ * everything is interpreted.
+ */
+
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+#define JIT_SUPPORTED 1
+#endif
+
+#define JIT_THRESHOLD 1000
+
+typedef enum {
+    RUN_RETURNED,       /* The value is where the receiver was, the frame is gone */
+    RUN_FAILED,         /* A runtime error was reported */
+    RUN_UNWINDING,      /* A ^ returns from an activation further down */
+    RUN_REPLACED        /* nativeTailSend only: a compiled method took over the frame */
+} RunStatus;
+
+/* What native code tells the interpreter about a send */
+typedef struct {
+    const Oop* selector;    /* Where the selector is kept, as it may move */
+    int argumentCount;
+    int opcode;             /* SEND, SUPER_SEND or a SEND_<name> */
+    Method* method;         /* Super sends start looking above its class */
+    SendCache* cache;
+} SendSite;
+
+struct NativeCode {
+    const uint8_t* start;
+    size_t size;
+    const uint8_t* entry;   /* Activates the method for a native caller; NULL for blocks and primitives */
+    const uint8_t* body;    /* The first instruction, once the interpreter has activated it */
+    uint32_t* resume;       /* Per bytecode offset: offset from start of a loop that jumps back there, or 0 */
+    SendSite* sites;        /* In the order of the method's caches */
+};
+
+/* Runs the activation in frame from address until it is done */
+typedef RunStatus (*NativeEntry)(VM* vm, Frame* frame, Oop* sp, const uint8_t* address);
+
+struct Jit {
+    uint8_t* region;
+    size_t size;
+    size_t used;
+    size_t pageSize;
+    NativeEntry enter;
+    uintptr_t stackLimit;   /* Native code is not entered with the C stack below this */
+    int compiled;           /* Methods and blocks */
+    int declined;           /* Those with instructions the JIT does not handle */
+};
+
+/* Answers 0, leaving vm->jit NULL, where there is no code generator or no memory */
+int initJit(VM* vm);
+void freeJit(VM* vm);
+/* Translate a method or block; answers 0 when it stays interpreted */
+int compileMethod(VM* vm, Method* method);
+void freeNativeCode(NativeCode* native);
+
+/* Count an activation or loop iteration of interpreted code */
+static inline void countHotness(VM* vm, Method* method) {
+    if (vm->jit != NULL && method->native == NULL && ++method->hotness == JIT_THRESHOLD) {
+        compileMethod(vm, method);
+    }
+}
+
+/* Where native code can take over the activation of method the interpreter
+ * is at: its start, or the start of a loop. NULL for none, or when the C
+ * stack is running out. */
+static inline const uint8_t* nativeAddress(VM* vm, Method* method, const uint8_t* ip) {
+    if (method->native == NULL) return NULL;
+#ifdef JIT_SUPPORTED
+    if ((uintptr_t)__builtin_frame_address(0) < vm->jit->stackLimit) return NULL;
+#endif
+    if (ip == method->code->bytecodes) return method->native->body;
+    uint32_t offset = method->native->resume[ip - method->code->bytecodes];
+    return offset != 0 ? method->native->start + offset : NULL;
+}
+
+/*
+ * Routines of the interpreter that native code calls. sp is the stack
+ * pointer of the native activation; sends leave their value in place of the
+ * receiver. The functions that answer an object answer 0 after a runtime
+ * error.
+ */
+
+/* Special sends try the interpreter's SmallInteger and SmallFloat paths first */
+RunStatus nativeSend(VM* vm, Oop* sp, const SendSite* site);
+/* A send right before a return, whose activation replaces the sender's.
+ * Unless a compiled method takes over the frame (RUN_REPLACED, with the new
+ * stack pointer in vm->stackTop), the sender has returned when it is done. */
+RunStatus nativeTailSend(VM* vm, Oop* sp, const SendSite* site);
+/* A new frame for method, or NULL */
+Frame* nativeActivate(VM* vm, Method* method, Oop* base);
+/* PUSH_BLOCK, taking the copied values below sp */
+Oop nativeMakeClosure(VM* vm, Frame* frame, Method* block, Oop* sp);
+/* MAKE_ARRAY of the count values below sp */
+Oop nativeMakeArray(VM* vm, Oop* sp, int count);
+/* Answers RUN_UNWINDING towards the home of the block in frame, or RUN_FAILED */
+RunStatus nativeNonLocalReturn(VM* vm, Frame* frame, Oop value);
+void nativeError(VM* vm, const char* message);
+
+#endif /* JIT_H */
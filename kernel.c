@@ -0,0 +1,1295 @@
+/* Generated from kernel.st by make */
+const char kernelSource[] =
+    "\"The kernel library of smalltalk_run. The VM creates the kernel classes\n"
+    " (see KERNEL_CLASSES in runtime.h) and loads this fileout at startup.\n"
+    " Loops are written as sends right before a return, which the interpreter\n"
+    " runs without growing the stack; the Boolean double dispatch in\n"
+    " toDoFrom:to:do: and whileTrueDo:of: keeps them from making blocks.\"!\n"
+    "\n"
+    "!Object methodsFor: 'comparing'!\n"
+    "== anObject\n"
+    "	<primitive: 110>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "= anObject\n"
+    "	^self == anObject!\n"
+    "\n"
+    "~= anObject\n"
+    "	^(self = anObject) not!\n"
+    "\n"
+    "~~ anObject\n"
+    "	^(self == anObject) not!\n"
+    "\n"
+    "hash\n"
+    "	^self identityHash!\n"
+    "\n"
+    "identityHash\n"
+    "	<primitive: 75>\n"
+    "	^self primitiveFailed! !\n"
+    "\n"
+    "!Object methodsFor: 'testing'!\n"
+    "isNil\n"
+    "	^false!\n"
+    "\n"
+    "notNil\n"
+    "	^true!\n"
+    "\n"
+    "isString\n"
+    "	^false!\n"
+    "\n"
+    "isSymbol\n"
+    "	^false!\n"
+    "\n"
+    "isNumber\n"
+    "	^false!\n"
+    "\n"
+    "isInteger\n"
+    "	^false!\n"
+    "\n"
+    "isFloat\n"
+    "	^false!\n"
+    "\n"
+    "isCharacter\n"
+    "	^false!\n"
+    "\n"
+    "isArray\n"
+    "	^false!\n"
+    "\n"
+    "isClass\n"
+    "	^false!\n"
+    "\n"
+    "isKindOf: aClass\n"
+    "	| class |\n"
+    "	class := self class.\n"
+    "	[class isNil] whileFalse: [\n"
+    "		class == aClass ifTrue: [^true].\n"
+    "		class := class superclass].\n"
+    "	^false!\n"
+    "\n"
+    "isMemberOf: aClass\n"
+    "	^self class == aClass!\n"
+    "\n"
+    "respondsTo: aSymbol\n"
+    "	^false! !\n"
+    "\n"
+    "!Object methodsFor: 'nil handling'!\n"
+    "ifNil: aBlock\n"
+    "	^self!\n"
+    "\n"
+    "ifNotNil: aBlock\n"
+    "	^aBlock numArgs = 0 ifTrue: [aBlock value] ifFalse: [aBlock value: self]!\n"
+    "\n"
+    "ifNil: nilBlock ifNotNil: notNilBlock\n"
+    "	^self ifNotNil: notNilBlock!\n"
+    "\n"
+    "ifNotNil: notNilBlock ifNil: nilBlock\n"
+    "	^self ifNotNil: notNilBlock! !\n"
+    "\n"
+    "!Object methodsFor: 'accessing'!\n"
+    "class\n"
+    "	<primitive: 111>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "yourself\n"
+    "	^self!\n"
+    "\n"
+    "basicAt: index\n"
+    "	<primitive: 60>\n"
+    "	^self indexError: index!\n"
+    "\n"
+    "basicAt: index put: anObject\n"
+    "	<primitive: 61>\n"
+    "	^self indexError: index!\n"
+    "\n"
+    "basicSize\n"
+    "	<primitive: 62>\n"
+    "	^0!\n"
+    "\n"
+    "at: index\n"
+    "	<primitive: 60>\n"
+    "	^self indexError: index!\n"
+    "\n"
+    "at: index put: anObject\n"
+    "	<primitive: 61>\n"
+    "	^self indexError: index!\n"
+    "\n"
+    "size\n"
+    "	<primitive: 62>\n"
+    "	^0! !\n"
+    "\n"
+    "!Object methodsFor: 'copying'!\n"
+    "shallowCopy\n"
+    "	<primitive: 101>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "copy\n"
+    "	^self shallowCopy postCopy!\n"
+    "\n"
+    "postCopy\n"
+    "	^self! !\n"
+    "\n"
+    "!Object methodsFor: 'initialization'!\n"
+    "initialize\n"
+    "	^self! !\n"
+    "\n"
+    "!Object methodsFor: 'message handling'!\n"
+    "perform: aSymbol\n"
+    "	<primitive: 83>\n"
+    "	^self error: 'perform: needs a selector'!\n"
+    "\n"
+    "perform: aSymbol with: anObject\n"
+    "	<primitive: 83>\n"
+    "	^self error: 'perform: needs a selector'!\n"
+    "\n"
+    "perform: aSymbol with: firstObject with: secondObject\n"
+    "	<primitive: 83>\n"
+    "	^self error: 'perform: needs a selector'!\n"
+    "\n"
+    "perform: aSymbol with: firstObject with: secondObject with: thirdObject\n"
+    "	<primitive: 83>\n"
+    "	^self error: 'perform: needs a selector'!\n"
+    "\n"
+    "perform: aSymbol withArguments: anArray\n"
+    "	<primitive: 84>\n"
+    "	^self error: 'perform:withArguments: needs a selector and an Array'! !\n"
+    "\n"
+    "!Object methodsFor: 'error handling'!\n"
+    "error: aString\n"
+    "	<primitive: 90>!\n"
+    "\n"
+    "doesNotUnderstand: aMessage\n"
+    "	<primitive: 89>!\n"
+    "\n"
+    "primitiveFailed\n"
+    "	^self error: 'a primitive has failed'!\n"
+    "\n"
+    "subclassResponsibility\n"
+    "	^self error: 'my subclass should have overridden this message'!\n"
+    "\n"
+    "indexError: index\n"
+    "	^self error: 'index out of bounds: ', index printString!\n"
+    "\n"
+    "assert: aBoolean\n"
+    "	aBoolean ifFalse: [^self error: 'assertion failed']! !\n"
+    "\n"
+    "!Object methodsFor: 'printing'!\n"
+    "printString\n"
+    "	| name |\n"
+    "	name := self class name.\n"
+    "	^((name at: 1) isVowel ifTrue: ['an '] ifFalse: ['a ']), name!\n"
+    "\n"
+    "displayString\n"
+    "	^self printString!\n"
+    "\n"
+    "printNl\n"
+    "	Transcript showCr: self printString!\n"
+    "\n"
+    "displayNl\n"
+    "	Transcript showCr: self displayString! !\n"
+    "\n"
+    "!Object methodsFor: 'associating'!\n"
+    "-> anObject\n"
+    "	^Association key: self value: anObject! !\n"
+    "\n"
+    "!Behavior methodsFor: 'instance creation'!\n"
+    "basicNew\n"
+    "	<primitive: 70>\n"
+    "	^self error: self name, ' cannot be instantiated with basicNew'!\n"
+    "\n"
+    "basicNew: size\n"
+    "	<primitive: 71>\n"
+    "	^self error: self name, ' cannot be instantiated with basicNew:'!\n"
+    "\n"
+    "new\n"
+    "	^self basicNew initialize!\n"
+    "\n"
+    "new: size\n"
+    "	^(self basicNew: size) initialize! !\n"
+    "\n"
+    "!Behavior methodsFor: 'accessing'!\n"
+    "name\n"
+    "	<primitive: 93>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "superclass\n"
+    "	<primitive: 96>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "inheritsFrom: aClass\n"
+    "	| class |\n"
+    "	class := self superclass.\n"
+    "	[class isNil] whileFalse: [\n"
+    "		class == aClass ifTrue: [^true].\n"
+    "		class := class superclass].\n"
+    "	^false! !\n"
+    "\n"
+    "!Behavior methodsFor: 'testing'!\n"
+    "isClass\n"
+    "	^true! !\n"
+    "\n"
+    "!Behavior methodsFor: 'printing'!\n"
+    "printString\n"
+    "	^self name! !\n"
+    "\n"
+    "!Behavior methodsFor: 'subclass creation'!\n"
+    "subclass: aSymbol\n"
+    "	^self subclass: aSymbol instanceVariableNames: '' classVariableNames: ''!\n"
+    "\n"
+    "subclass: aSymbol instanceVariableNames: instanceVariables classVariableNames: classVariables\n"
+    "	<primitive: 94>\n"
+    "	^self error: 'invalid class definition'!\n"
+    "\n"
+    "subclass: aSymbol instanceVariableNames: instanceVariables classVariableNames: classVariables package: aString\n"
+    "	^self subclass: aSymbol instanceVariableNames: instanceVariables classVariableNames: classVariables!\n"
+    "\n"
+    "subclass: aSymbol instanceVariableNames: instanceVariables classVariableNames: classVariables category: aString\n"
+    "	^self subclass: aSymbol instanceVariableNames: instanceVariables classVariableNames: classVariables!\n"
+    "\n"
+    "subclass: aSymbol instanceVariableNames: instanceVariables classVariableNames: classVariables poolDictionaries: pools category: aString\n"
+    "	^self subclass: aSymbol instanceVariableNames: instanceVariables classVariableNames: classVariables!\n"
+    "\n"
+    "instanceVariableNames: aString\n"
+    "	<primitive: 95>\n"
+    "	^self error: 'only metaclasses take instanceVariableNames:'! !\n"
+    "\n"
+    "!UndefinedObject methodsFor: 'testing'!\n"
+    "isNil\n"
+    "	^true!\n"
+    "\n"
+    "notNil\n"
+    "	^false!\n"
+    "\n"
+    "ifNil: aBlock\n"
+    "	^aBlock value!\n"
+    "\n"
+    "ifNotNil: aBlock\n"
+    "	^nil!\n"
+    "\n"
+    "ifNil: nilBlock ifNotNil: notNilBlock\n"
+    "	^nilBlock value!\n"
+    "\n"
+    "ifNotNil: notNilBlock ifNil: nilBlock\n"
+    "	^nilBlock value! !\n"
+    "\n"
+    "!UndefinedObject methodsFor: 'printing'!\n"
+    "printString\n"
+    "	^'nil'! !\n"
+    "\n"
+    "!True methodsFor: 'controlling'!\n"
+    "ifTrue: trueBlock\n"
+    "	^trueBlock value!\n"
+    "\n"
+    "ifFalse: falseBlock\n"
+    "	^nil!\n"
+    "\n"
+    "ifTrue: trueBlock ifFalse: falseBlock\n"
+    "	^trueBlock value!\n"
+    "\n"
+    "ifFalse: falseBlock ifTrue: trueBlock\n"
+    "	^trueBlock value!\n"
+    "\n"
+    "and: aBlock\n"
+    "	^aBlock value!\n"
+    "\n"
+    "or: aBlock\n"
+    "	^true!\n"
+    "\n"
+    "& aBoolean\n"
+    "	^aBoolean!\n"
+    "\n"
+    "| aBoolean\n"
+    "	^true!\n"
+    "\n"
+    "not\n"
+    "	^false!\n"
+    "\n"
+    "toDoFrom: start to: stop do: aBlock\n"
+    "	| next |\n"
+    "	aBlock value: start.\n"
+    "	next := start + 1.\n"
+    "	^next <= stop toDoFrom: next to: stop do: aBlock!\n"
+    "\n"
+    "toDoFrom: start to: stop by: step do: aBlock\n"
+    "	| next |\n"
+    "	aBlock value: start.\n"
+    "	next := start + step.\n"
+    "	^(step > 0 ifTrue: [next <= stop] ifFalse: [next >= stop]) toDoFrom: next to: stop by: step do: aBlock!\n"
+    "\n"
+    "whileTrueDo: aBlock of: conditionBlock\n"
+    "	aBlock value.\n"
+    "	^conditionBlock whileTrue: aBlock!\n"
+    "\n"
+    "whileFalseDo: aBlock of: conditionBlock\n"
+    "	^nil! !\n"
+    "\n"
+    "!True methodsFor: 'printing'!\n"
+    "printString\n"
+    "	^'true'! !\n"
+    "\n"
+    "!False methodsFor: 'controlling'!\n"
+    "ifTrue: trueBlock\n"
+    "	^nil!\n"
+    "\n"
+    "ifFalse: falseBlock\n"
+    "	^falseBlock value!\n"
+    "\n"
+    "ifTrue: trueBlock ifFalse: falseBlock\n"
+    "	^falseBlock value!\n"
+    "\n"
+    "ifFalse: falseBlock ifTrue: trueBlock\n"
+    "	^falseBlock value!\n"
+    "\n"
+    "and: aBlock\n"
+    "	^false!\n"
+    "\n"
+    "or: aBlock\n"
+    "	^aBlock value!\n"
+    "\n"
+    "& aBoolean\n"
+    "	^false!\n"
+    "\n"
+    "| aBoolean\n"
+    "	^aBoolean!\n"
+    "\n"
+    "not\n"
+    "	^true!\n"
+    "\n"
+    "toDoFrom: start to: stop do: aBlock\n"
+    "	^nil!\n"
+    "\n"
+    "toDoFrom: start to: stop by: step do: aBlock\n"
+    "	^nil!\n"
+    "\n"
+    "whileTrueDo: aBlock of: conditionBlock\n"
+    "	^nil!\n"
+    "\n"
+    "whileFalseDo: aBlock of: conditionBlock\n"
+    "	aBlock value.\n"
+    "	^conditionBlock whileFalse: aBlock! !\n"
+    "\n"
+    "!False methodsFor: 'printing'!\n"
+    "printString\n"
+    "	^'false'! !\n"
+    "\n"
+    "!BlockClosure methodsFor: 'evaluating'!\n"
+    "numArgs\n"
+    "	<primitive: 85>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "value\n"
+    "	<primitive: 81>\n"
+    "	^self numArgsError: 0!\n"
+    "\n"
+    "value: anObject\n"
+    "	<primitive: 81>\n"
+    "	^self numArgsError: 1!\n"
+    "\n"
+    "value: firstObject value: secondObject\n"
+    "	<primitive: 81>\n"
+    "	^self numArgsError: 2!\n"
+    "\n"
+    "value: firstObject value: secondObject value: thirdObject\n"
+    "	<primitive: 81>\n"
+    "	^self numArgsError: 3!\n"
+    "\n"
+    "value: firstObject value: secondObject value: thirdObject value: fourthObject\n"
+    "	<primitive: 81>\n"
+    "	^self numArgsError: 4!\n"
+    "\n"
+    "valueWithArguments: anArray\n"
+    "	<primitive: 82>\n"
+    "	^self error: 'valueWithArguments: needs an Array of the right size'!\n"
+    "\n"
+    "numArgsError: count\n"
+    "	^self error: 'this block takes ', self numArgs printString, ' arguments, not ', count printString!\n"
+    "\n"
+    "ensure: aBlock\n"
+    "	| result |\n"
+    "	result := self value.\n"
+    "	aBlock value.\n"
+    "	^result! !\n"
+    "\n"
+    "!BlockClosure methodsFor: 'controlling'!\n"
+    "whileTrue: aBlock\n"
+    "	^self value whileTrueDo: aBlock of: self!\n"
+    "\n"
+    "whileFalse: aBlock\n"
+    "	^self value whileFalseDo: aBlock of: self!\n"
+    "\n"
+    "whileTrue\n"
+    "	^self whileTrue: [nil]!\n"
+    "\n"
+    "whileFalse\n"
+    "	^self whileFalse: [nil]!\n"
+    "\n"
+    "repeat\n"
+    "	self value.\n"
+    "	^self repeat! !\n"
+    "\n"
+    "!Magnitude methodsFor: 'comparing'!\n"
+    "< aMagnitude\n"
+    "	^self subclassResponsibility!\n"
+    "\n"
+    "> aMagnitude\n"
+    "	^aMagnitude < self!\n"
+    "\n"
+    "<= aMagnitude\n"
+    "	^(aMagnitude < self) not!\n"
+    "\n"
+    ">= aMagnitude\n"
+    "	^(self < aMagnitude) not!\n"
+    "\n"
+    "between: min and: max\n"
+    "	^self >= min and: [self <= max]!\n"
+    "\n"
+    "max: aMagnitude\n"
+    "	^self > aMagnitude ifTrue: [self] ifFalse: [aMagnitude]!\n"
+    "\n"
+    "min: aMagnitude\n"
+    "	^self < aMagnitude ifTrue: [self] ifFalse: [aMagnitude]! !\n"
+    "\n"
+    "!Number methodsFor: 'testing'!\n"
+    "isNumber\n"
+    "	^true!\n"
+    "\n"
+    "isZero\n"
+    "	^self = 0!\n"
+    "\n"
+    "even\n"
+    "	^self \\\\ 2 = 0!\n"
+    "\n"
+    "odd\n"
+    "	^self even not!\n"
+    "\n"
+    "negative\n"
+    "	^self < 0!\n"
+    "\n"
+    "positive\n"
+    "	^self >= 0!\n"
+    "\n"
+    "sign\n"
+    "	self > 0 ifTrue: [^1].\n"
+    "	self < 0 ifTrue: [^-1].\n"
+    "	^0! !\n"
+    "\n"
+    "!Number methodsFor: 'arithmetic'!\n"
+    "negated\n"
+    "	^0 - self!\n"
+    "\n"
+    "abs\n"
+    "	^self < 0 ifTrue: [self negated] ifFalse: [self]!\n"
+    "\n"
+    "squared\n"
+    "	^self * self!\n"
+    "\n"
+    "sqrt\n"
+    "	^self asFloat sqrt!\n"
+    "\n"
+    "reciprocal\n"
+    "	^1 / self!\n"
+    "\n"
+    "retry: aSelector coercing: aNumber\n"
+    "	aNumber isNumber ifFalse: [^self error: aNumber printString, ' is not a number'].\n"
+    "	^self asFloat perform: aSelector with: aNumber! !\n"
+    "\n"
+    "!Number methodsFor: 'intervals'!\n"
+    "to: stop\n"
+    "	^Interval from: self to: stop by: 1!\n"
+    "\n"
+    "to: stop by: step\n"
+    "	^Interval from: self to: stop by: step!\n"
+    "\n"
+    "to: stop do: aBlock\n"
+    "	^self <= stop toDoFrom: self to: stop do: aBlock!\n"
+    "\n"
+    "to: stop by: step do: aBlock\n"
+    "	step = 0 ifTrue: [^self error: 'step must not be zero'].\n"
+    "	^(step > 0 ifTrue: [self <= stop] ifFalse: [self >= stop]) toDoFrom: self to: stop by: step do: aBlock! !\n"
+    "\n"
+    "!Number methodsFor: 'printing'!\n"
+    "displayString\n"
+    "	^self printString! !\n"
+    "\n"
+    "!Integer methodsFor: 'testing'!\n"
+    "isInteger\n"
+    "	^true! !\n"
+    "\n"
+    "!Integer methodsFor: 'arithmetic'!\n"
+    "factorial\n"
+    "	self < 2 ifTrue: [^1].\n"
+    "	^self * (self - 1) factorial!\n"
+    "\n"
+    "gcd: anInteger\n"
+    "	^anInteger = 0 ifTrue: [self abs] ifFalse: [anInteger gcd: self \\\\ anInteger]!\n"
+    "\n"
+    "isPrime\n"
+    "	| divisor |\n"
+    "	self < 2 ifTrue: [^false].\n"
+    "	divisor := 2.\n"
+    "	[divisor * divisor <= self] whileTrue: [\n"
+    "		self \\\\ divisor = 0 ifTrue: [^false].\n"
+    "		divisor := divisor + 1].\n"
+    "	^true!\n"
+    "\n"
+    "truncated\n"
+    "	^self!\n"
+    "\n"
+    "rounded\n"
+    "	^self!\n"
+    "\n"
+    "floor\n"
+    "	^self!\n"
+    "\n"
+    "asInteger\n"
+    "	^self!\n"
+    "\n"
+    "timesRepeat: aBlock\n"
+    "	^1 to: self do: [:each | aBlock value]! !\n"
+    "\n"
+    "!Integer methodsFor: 'arithmetic'!\n"
+    "+ aNumber\n"
+    "	<primitive: 1>\n"
+    "	^self retry: #+ coercing: aNumber!\n"
+    "\n"
+    "- aNumber\n"
+    "	<primitive: 2>\n"
+    "	^self retry: #- coercing: aNumber!\n"
+    "\n"
+    "* aNumber\n"
+    "	<primitive: 9>\n"
+    "	^self retry: #* coercing: aNumber!\n"
+    "\n"
+    "/ aNumber\n"
+    "	<primitive: 10>\n"
+    "	aNumber = 0 ifTrue: [^self error: 'division by zero'].\n"
+    "	^self retry: #/ coercing: aNumber!\n"
+    "\n"
+    "// aNumber\n"
+    "	<primitive: 12>\n"
+    "	aNumber = 0 ifTrue: [^self error: 'division by zero'].\n"
+    "	^(self retry: #/ coercing: aNumber) floor!\n"
+    "\n"
+    "\\\\ aNumber\n"
+    "	<primitive: 11>\n"
+    "	aNumber = 0 ifTrue: [^self error: 'division by zero'].\n"
+    "	^self - (self // aNumber * aNumber)!\n"
+    "\n"
+    "rem: aNumber\n"
+    "	^self - ((self quo: aNumber) * aNumber)!\n"
+    "\n"
+    "quo: aNumber\n"
+    "	| quotient |\n"
+    "	quotient := self // aNumber.\n"
+    "	^(quotient < 0 and: [quotient * aNumber ~= self]) ifTrue: [quotient + 1] ifFalse: [quotient]!\n"
+    "\n"
+    "bitAnd: anInteger\n"
+    "	<primitive: 14>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "bitOr: anInteger\n"
+    "	<primitive: 15>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "bitXor: anInteger\n"
+    "	<primitive: 16>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "bitShift: anInteger\n"
+    "	<primitive: 17>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "raisedTo: anInteger\n"
+    "	| result |\n"
+    "	anInteger < 0 ifTrue: [^1 / (self raisedTo: anInteger negated)].\n"
+    "	result := 1.\n"
+    "	anInteger timesRepeat: [result := result * self].\n"
+    "	^result!\n"
+    "\n"
+    "asFloat\n"
+    "	<primitive: 40>\n"
+    "	^self primitiveFailed! !\n"
+    "\n"
+    "!SmallInteger methodsFor: 'converting'!\n"
+    "asCharacter\n"
+    "	<primitive: 98>\n"
+    "	^self error: 'not a character value: ', self printString! !\n"
+    "\n"
+    "!Integer methodsFor: 'comparing'!\n"
+    "< aNumber\n"
+    "	<primitive: 3>\n"
+    "	^self retry: #< coercing: aNumber!\n"
+    "\n"
+    "> aNumber\n"
+    "	<primitive: 4>\n"
+    "	^self retry: #> coercing: aNumber!\n"
+    "\n"
+    "<= aNumber\n"
+    "	<primitive: 5>\n"
+    "	^self retry: #<= coercing: aNumber!\n"
+    "\n"
+    ">= aNumber\n"
+    "	<primitive: 6>\n"
+    "	^self retry: #>= coercing: aNumber!\n"
+    "\n"
+    "= aNumber\n"
+    "	<primitive: 7>\n"
+    "	^aNumber isNumber and: [self asFloat = aNumber]!\n"
+    "\n"
+    "~= aNumber\n"
+    "	<primitive: 8>\n"
+    "	^(self = aNumber) not!\n"
+    "\n"
+    "hash\n"
+    "	^self! !\n"
+    "\n"
+    "!Integer methodsFor: 'printing'!\n"
+    "printString\n"
+    "	<primitive: 91>\n"
+    "	^self primitiveFailed! !\n"
+    "\n"
+    "!LargePositiveInteger methodsFor: 'comparing'!\n"
+    "hash\n"
+    "	^self \\\\ 1073741823! !\n"
+    "\n"
+    "!Float methodsFor: 'testing'!\n"
+    "isFloat\n"
+    "	^true! !\n"
+    "\n"
+    "!Float methodsFor: 'arithmetic'!\n"
+    "+ aNumber\n"
+    "	<primitive: 41>\n"
+    "	^self error: aNumber printString, ' is not a number'!\n"
+    "\n"
+    "- aNumber\n"
+    "	<primitive: 42>\n"
+    "	^self error: aNumber printString, ' is not a number'!\n"
+    "\n"
+    "* aNumber\n"
+    "	<primitive: 49>\n"
+    "	^self error: aNumber printString, ' is not a number'!\n"
+    "\n"
+    "/ aNumber\n"
+    "	<primitive: 50>\n"
+    "	aNumber = 0 ifTrue: [^self error: 'division by zero'].\n"
+    "	^self error: aNumber printString, ' is not a number'!\n"
+    "\n"
+    "// aNumber\n"
+    "	^(self / aNumber) floor!\n"
+    "\n"
+    "\\\\ aNumber\n"
+    "	^self - (self // aNumber * aNumber)!\n"
+    "\n"
+    "truncated\n"
+    "	<primitive: 51>\n"
+    "	^self error: 'cannot truncate ', self printString!\n"
+    "\n"
+    "floor\n"
+    "	| truncated |\n"
+    "	truncated := self truncated.\n"
+    "	^(self < 0 and: [truncated ~= self]) ifTrue: [truncated - 1] ifFalse: [truncated]!\n"
+    "\n"
+    "rounded\n"
+    "	^(self + (self sign / 2)) truncated!\n"
+    "\n"
+    "sqrt\n"
+    "	<primitive: 55>\n"
+    "	^self error: 'square root of a negative number'!\n"
+    "\n"
+    "asFloat\n"
+    "	^self! !\n"
+    "\n"
+    "!Float methodsFor: 'comparing'!\n"
+    "< aNumber\n"
+    "	<primitive: 43>\n"
+    "	^self error: aNumber printString, ' is not a number'!\n"
+    "\n"
+    "> aNumber\n"
+    "	<primitive: 44>\n"
+    "	^self error: aNumber printString, ' is not a number'!\n"
+    "\n"
+    "<= aNumber\n"
+    "	<primitive: 45>\n"
+    "	^self error: aNumber printString, ' is not a number'!\n"
+    "\n"
+    ">= aNumber\n"
+    "	<primitive: 46>\n"
+    "	^self error: aNumber printString, ' is not a number'!\n"
+    "\n"
+    "= aNumber\n"
+    "	<primitive: 47>\n"
+    "	^false!\n"
+    "\n"
+    "~= aNumber\n"
+    "	<primitive: 48>\n"
+    "	^true!\n"
+    "\n"
+    "hash\n"
+    "	^self truncated hash! !\n"
+    "\n"
+    "!Float methodsFor: 'printing'!\n"
+    "printString\n"
+    "	<primitive: 92>\n"
+    "	^self primitiveFailed! !\n"
+    "\n"
+    "!Character class methodsFor: 'instance creation'!\n"
+    "value: anInteger\n"
+    "	^anInteger asCharacter!\n"
+    "\n"
+    "cr\n"
+    "	^10 asCharacter!\n"
+    "\n"
+    "tab\n"
+    "	^9 asCharacter!\n"
+    "\n"
+    "space\n"
+    "	^32 asCharacter! !\n"
+    "\n"
+    "!Character methodsFor: 'accessing'!\n"
+    "value\n"
+    "	<primitive: 97>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "asInteger\n"
+    "	^self value!\n"
+    "\n"
+    "asCharacter\n"
+    "	^self! !\n"
+    "\n"
+    "!Character methodsFor: 'comparing'!\n"
+    "< aCharacter\n"
+    "	^self value < aCharacter value!\n"
+    "\n"
+    "hash\n"
+    "	^self value! !\n"
+    "\n"
+    "!Character methodsFor: 'testing'!\n"
+    "isCharacter\n"
+    "	^true!\n"
+    "\n"
+    "isVowel\n"
+    "	^'aeiouAEIOU' includes: self!\n"
+    "\n"
+    "isLetter\n"
+    "	^self isLowercase or: [self isUppercase]!\n"
+    "\n"
+    "isUppercase\n"
+    "	^self value between: 65 and: 90!\n"
+    "\n"
+    "isLowercase\n"
+    "	^self value between: 97 and: 122!\n"
+    "\n"
+    "isDigit\n"
+    "	^self value between: 48 and: 57!\n"
+    "\n"
+    "isSeparator\n"
+    "	^self value = 32 or: [self value between: 9 and: 13]! !\n"
+    "\n"
+    "!Character methodsFor: 'converting'!\n"
+    "asUppercase\n"
+    "	^self isLowercase ifTrue: [(self value - 32) asCharacter] ifFalse: [self]!\n"
+    "\n"
+    "asLowercase\n"
+    "	^self isUppercase ifTrue: [(self value + 32) asCharacter] ifFalse: [self]!\n"
+    "\n"
+    "asString\n"
+    "	^(String new: 1) at: 1 put: self; yourself!\n"
+    "\n"
+    "digitValue\n"
+    "	^self value - 48! !\n"
+    "\n"
+    "!Character methodsFor: 'printing'!\n"
+    "printString\n"
+    "	^'$', self asString!\n"
+    "\n"
+    "displayString\n"
+    "	^self asString! !\n"
+    "\n"
+    "!Collection methodsFor: 'enumerating'!\n"
+    "do: aBlock\n"
+    "	^self subclassResponsibility!\n"
+    "\n"
+    "do: aBlock separatedBy: separatorBlock\n"
+    "	| first |\n"
+    "	first := true.\n"
+    "	self do: [:each |\n"
+    "		first ifFalse: [separatorBlock value].\n"
+    "		first := false.\n"
+    "		aBlock value: each]!\n"
+    "\n"
+    "inject: initialValue into: aBlock\n"
+    "	| result |\n"
+    "	result := initialValue.\n"
+    "	self do: [:each | result := aBlock value: result value: each].\n"
+    "	^result!\n"
+    "\n"
+    "detect: aBlock ifNone: noneBlock\n"
+    "	self do: [:each | (aBlock value: each) ifTrue: [^each]].\n"
+    "	^noneBlock value!\n"
+    "\n"
+    "detect: aBlock\n"
+    "	^self detect: aBlock ifNone: [self error: 'no element matches']!\n"
+    "\n"
+    "includes: anObject\n"
+    "	self do: [:each | each = anObject ifTrue: [^true]].\n"
+    "	^false!\n"
+    "\n"
+    "occurrencesOf: anObject\n"
+    "	| count |\n"
+    "	count := 0.\n"
+    "	self do: [:each | each = anObject ifTrue: [count := count + 1]].\n"
+    "	^count!\n"
+    "\n"
+    "count: aBlock\n"
+    "	| count |\n"
+    "	count := 0.\n"
+    "	self do: [:each | (aBlock value: each) ifTrue: [count := count + 1]].\n"
+    "	^count!\n"
+    "\n"
+    "anySatisfy: aBlock\n"
+    "	self do: [:each | (aBlock value: each) ifTrue: [^true]].\n"
+    "	^false!\n"
+    "\n"
+    "allSatisfy: aBlock\n"
+    "	self do: [:each | (aBlock value: each) ifFalse: [^false]].\n"
+    "	^true! !\n"
+    "\n"
+    "!Collection methodsFor: 'testing'!\n"
+    "isEmpty\n"
+    "	^self size = 0!\n"
+    "\n"
+    "notEmpty\n"
+    "	^self isEmpty not! !\n"
+    "\n"
+    "!Collection methodsFor: 'converting'!\n"
+    "asArray\n"
+    "	| result index |\n"
+    "	result := Array new: self size.\n"
+    "	index := 0.\n"
+    "	self do: [:each | result at: (index := index + 1) put: each].\n"
+    "	^result!\n"
+    "\n"
+    "asOrderedCollection\n"
+    "	^OrderedCollection new addAll: self; yourself! !\n"
+    "\n"
+    "!Collection methodsFor: 'printing'!\n"
+    "printElementsOn: aString\n"
+    "	| result |\n"
+    "	result := aString.\n"
+    "	self do: [:each | result := result, each printString] separatedBy: [result := result, ' '].\n"
+    "	^result!\n"
+    "\n"
+    "printString\n"
+    "	^(self printElementsOn: self class name, ' ('), ')'! !\n"
+    "\n"
+    "!SequenceableCollection methodsFor: 'accessing'!\n"
+    "first\n"
+    "	^self at: 1!\n"
+    "\n"
+    "last\n"
+    "	^self at: self size!\n"
+    "\n"
+    "indexOf: anObject\n"
+    "	1 to: self size do: [:index | (self at: index) = anObject ifTrue: [^index]].\n"
+    "	^0!\n"
+    "\n"
+    "copyFrom: start to: stop\n"
+    "	| result |\n"
+    "	result := self species new: stop - start + 1.\n"
+    "	1 to: stop - start + 1 do: [:index | result at: index put: (self at: start + index - 1)].\n"
+    "	^result!\n"
+    "\n"
+    "species\n"
+    "	^self class! !\n"
+    "\n"
+    "!SequenceableCollection methodsFor: 'enumerating'!\n"
+    "do: aBlock\n"
+    "	1 to: self size do: [:index | aBlock value: (self at: index)]!\n"
+    "\n"
+    "doWithIndex: aBlock\n"
+    "	1 to: self size do: [:index | aBlock value: (self at: index) value: index]!\n"
+    "\n"
+    "keysAndValuesDo: aBlock\n"
+    "	1 to: self size do: [:index | aBlock value: index value: (self at: index)]!\n"
+    "\n"
+    "reverseDo: aBlock\n"
+    "	self size to: 1 by: -1 do: [:index | aBlock value: (self at: index)]!\n"
+    "\n"
+    "with: aCollection do: aBlock\n"
+    "	1 to: self size do: [:index | aBlock value: (self at: index) value: (aCollection at: index)]!\n"
+    "\n"
+    "collect: aBlock\n"
+    "	| result |\n"
+    "	result := self species new: self size.\n"
+    "	1 to: self size do: [:index | result at: index put: (aBlock value: (self at: index))].\n"
+    "	^result!\n"
+    "\n"
+    "select: aBlock\n"
+    "	| selected |\n"
+    "	selected := OrderedCollection new.\n"
+    "	self do: [:each | (aBlock value: each) ifTrue: [selected addLast: each]].\n"
+    "	^self species withAll: selected!\n"
+    "\n"
+    "reject: aBlock\n"
+    "	^self select: [:each | (aBlock value: each) not]!\n"
+    "\n"
+    "reversed\n"
+    "	| result size |\n"
+    "	size := self size.\n"
+    "	result := self species new: size.\n"
+    "	1 to: size do: [:index | result at: index put: (self at: size - index + 1)].\n"
+    "	^result! !\n"
+    "\n"
+    "!SequenceableCollection methodsFor: 'comparing'!\n"
+    "= aCollection\n"
+    "	self class == aCollection class ifFalse: [^false].\n"
+    "	self size = aCollection size ifFalse: [^false].\n"
+    "	1 to: self size do: [:index | (self at: index) = (aCollection at: index) ifFalse: [^false]].\n"
+    "	^true!\n"
+    "\n"
+    "hash\n"
+    "	^self inject: self size into: [:hash :each | (hash * 31 + each hash) bitAnd: 1073741823]! !\n"
+    "\n"
+    "!ArrayedCollection class methodsFor: 'instance creation'!\n"
+    "new\n"
+    "	^self new: 0!\n"
+    "\n"
+    "with: anObject\n"
+    "	^(self new: 1) at: 1 put: anObject; yourself!\n"
+    "\n"
+    "with: firstObject with: secondObject\n"
+    "	^(self new: 2) at: 1 put: firstObject; at: 2 put: secondObject; yourself!\n"
+    "\n"
+    "with: firstObject with: secondObject with: thirdObject\n"
+    "	^(self new: 3) at: 1 put: firstObject; at: 2 put: secondObject; at: 3 put: thirdObject; yourself!\n"
+    "\n"
+    "new: size withAll: anObject\n"
+    "	| result |\n"
+    "	result := self new: size.\n"
+    "	1 to: size do: [:index | result at: index put: anObject].\n"
+    "	^result!\n"
+    "\n"
+    "withAll: aCollection\n"
+    "	| result index |\n"
+    "	result := self new: aCollection size.\n"
+    "	index := 0.\n"
+    "	aCollection do: [:each | result at: (index := index + 1) put: each].\n"
+    "	^result! !\n"
+    "\n"
+    "!ArrayedCollection methodsFor: 'copying'!\n"
+    ", aCollection\n"
+    "	^(self species new: self size + aCollection size)\n"
+    "		replaceFrom: 1 to: self size with: self startingAt: 1;\n"
+    "		replaceFrom: self size + 1 to: self size + aCollection size with: aCollection startingAt: 1;\n"
+    "		yourself!\n"
+    "\n"
+    "replaceFrom: start to: stop with: aCollection startingAt: index\n"
+    "	<primitive: 105>\n"
+    "	start to: stop do: [:each | self at: each put: (aCollection at: index + each - start)]! !\n"
+    "\n"
+    "!Array methodsFor: 'testing'!\n"
+    "isArray\n"
+    "	^true! !\n"
+    "\n"
+    "!Array methodsFor: 'printing'!\n"
+    "printString\n"
+    "	^(self printElementsOn: '#('), ')'! !\n"
+    "\n"
+    "!String methodsFor: 'comparing'!\n"
+    "= aString\n"
+    "	<primitive: 106>\n"
+    "	^false!\n"
+    "\n"
+    "< aString\n"
+    "	<primitive: 108>\n"
+    "	^self error: 'strings compare only with strings'!\n"
+    "\n"
+    "hash\n"
+    "	<primitive: 107>\n"
+    "	^self primitiveFailed! !\n"
+    "\n"
+    "!String methodsFor: 'testing'!\n"
+    "isString\n"
+    "	^true! !\n"
+    "\n"
+    "!String methodsFor: 'converting'!\n"
+    "asString\n"
+    "	^self!\n"
+    "\n"
+    "asSymbol\n"
+    "	<primitive: 99>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "asUppercase\n"
+    "	^self collect: [:each | each asUppercase]!\n"
+    "\n"
+    "asLowercase\n"
+    "	^self collect: [:each | each asLowercase]!\n"
+    "\n"
+    "asNumber\n"
+    "	| value |\n"
+    "	value := 0.\n"
+    "	self do: [:each | value := value * 10 + each digitValue].\n"
+    "	^value! !\n"
+    "\n"
+    "!String methodsFor: 'printing'!\n"
+    "printString\n"
+    "	| result index |\n"
+    "	result := String new: self size + (self occurrencesOf: $') + 2.\n"
+    "	result at: 1 put: $'.\n"
+    "	index := 2.\n"
+    "	self do: [:each |\n"
+    "		result at: index put: each.\n"
+    "		index := index + 1.\n"
+    "		each = $' ifTrue: [\n"
+    "			result at: index put: each.\n"
+    "			index := index + 1]].\n"
+    "	result at: index put: $'.\n"
+    "	^result!\n"
+    "\n"
+    "displayString\n"
+    "	^self! !\n"
+    "\n"
+    "!Symbol methodsFor: 'comparing'!\n"
+    "= anObject\n"
+    "	^self == anObject!\n"
+    "\n"
+    "hash\n"
+    "	^self identityHash! !\n"
+    "\n"
+    "!Symbol methodsFor: 'testing'!\n"
+    "isSymbol\n"
+    "	^true! !\n"
+    "\n"
+    "!Symbol methodsFor: 'accessing'!\n"
+    "at: index put: aCharacter\n"
+    "	^self error: 'symbols cannot be changed'!\n"
+    "\n"
+    "species\n"
+    "	^String! !\n"
+    "\n"
+    "!Symbol methodsFor: 'converting'!\n"
+    "asString\n"
+    "	<primitive: 100>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "asSymbol\n"
+    "	^self! !\n"
+    "\n"
+    "!Symbol methodsFor: 'printing'!\n"
+    "printString\n"
+    "	^'#', self asString!\n"
+    "\n"
+    "displayString\n"
+    "	^self asString! !\n"
+    "\n"
+    "!Association class methodsFor: 'instance creation'!\n"
+    "key: aKey value: aValue\n"
+    "	^self new key: aKey value: aValue! !\n"
+    "\n"
+    "!Association methodsFor: 'accessing'!\n"
+    "key\n"
+    "	^key!\n"
+    "\n"
+    "value\n"
+    "	^value!\n"
+    "\n"
+    "key: aKey value: aValue\n"
+    "	key := aKey.\n"
+    "	value := aValue! !\n"
+    "\n"
+    "!Association methodsFor: 'printing'!\n"
+    "printString\n"
+    "	^key printString, '->', value printString! !\n"
+    "\n"
+    "!Message methodsFor: 'accessing'!\n"
+    "selector\n"
+    "	^selector!\n"
+    "\n"
+    "arguments\n"
+    "	^arguments! !\n"
+    "\n"
+    "SequenceableCollection subclass: #Interval\n"
+    "	instanceVariableNames: 'start stop step'\n"
+    "	classVariableNames: ''\n"
+    "	package: 'Kernel'!\n"
+    "\n"
+    "SequenceableCollection subclass: #OrderedCollection\n"
+    "	instanceVariableNames: 'elements firstIndex lastIndex'\n"
+    "	classVariableNames: ''\n"
+    "	package: 'Kernel'!\n"
+    "\n"
+    "Object subclass: #TranscriptStream\n"
+    "	instanceVariableNames: ''\n"
+    "	classVariableNames: ''\n"
+    "	package: 'Kernel'!\n"
+    "\n"
+    "!Interval class methodsFor: 'instance creation'!\n"
+    "from: start to: stop by: step\n"
+    "	^self basicNew setFrom: start to: stop by: step! !\n"
+    "\n"
+    "!Interval methodsFor: 'accessing'!\n"
+    "setFrom: startNumber to: stopNumber by: stepNumber\n"
+    "	start := startNumber.\n"
+    "	stop := stopNumber.\n"
+    "	step := stepNumber!\n"
+    "\n"
+    "size\n"
+    "	^step > 0\n"
+    "		ifTrue: [stop < start ifTrue: [0] ifFalse: [stop - start // step + 1]]\n"
+    "		ifFalse: [start < stop ifTrue: [0] ifFalse: [start - stop // step negated + 1]]!\n"
+    "\n"
+    "at: index\n"
+    "	(index between: 1 and: self size) ifFalse: [^self indexError: index].\n"
+    "	^start + (index - 1 * step)!\n"
+    "\n"
+    "species\n"
+    "	^Array! !\n"
+    "\n"
+    "!Interval methodsFor: 'enumerating'!\n"
+    "do: aBlock\n"
+    "	^start to: stop by: step do: aBlock! !\n"
+    "\n"
+    "!OrderedCollection class methodsFor: 'instance creation'!\n"
+    "new\n"
+    "	^self new: 8!\n"
+    "\n"
+    "new: capacity\n"
+    "	^self basicNew setCapacity: capacity!\n"
+    "\n"
+    "withAll: aCollection\n"
+    "	^self new addAll: aCollection; yourself! !\n"
+    "\n"
+    "!OrderedCollection methodsFor: 'private'!\n"
+    "setCapacity: capacity\n"
+    "	elements := Array new: (capacity max: 1).\n"
+    "	firstIndex := 1.\n"
+    "	lastIndex := 0!\n"
+    "\n"
+    "grow\n"
+    "	| grown |\n"
+    "	grown := Array new: elements size * 2.\n"
+    "	grown replaceFrom: firstIndex to: lastIndex with: elements startingAt: firstIndex.\n"
+    "	elements := grown!\n"
+    "\n"
+    "makeRoomAtFront\n"
+    "	| grown shift |\n"
+    "	shift := elements size.\n"
+    "	grown := Array new: elements size * 2.\n"
+    "	grown replaceFrom: firstIndex + shift to: lastIndex + shift with: elements startingAt: firstIndex.\n"
+    "	elements := grown.\n"
+    "	firstIndex := firstIndex + shift.\n"
+    "	lastIndex := lastIndex + shift! !\n"
+    "\n"
+    "!OrderedCollection methodsFor: 'accessing'!\n"
+    "size\n"
+    "	^lastIndex - firstIndex + 1!\n"
+    "\n"
+    "at: index\n"
+    "	(index between: 1 and: self size) ifFalse: [^self indexError: index].\n"
+    "	^elements at: firstIndex + index - 1!\n"
+    "\n"
+    "at: index put: anObject\n"
+    "	(index between: 1 and: self size) ifFalse: [^self indexError: index].\n"
+    "	^elements at: firstIndex + index - 1 put: anObject! !\n"
+    "\n"
+    "!OrderedCollection methodsFor: 'adding'!\n"
+    "addLast: anObject\n"
+    "	lastIndex = elements size ifTrue: [self grow].\n"
+    "	lastIndex := lastIndex + 1.\n"
+    "	^elements at: lastIndex put: anObject!\n"
+    "\n"
+    "add: anObject\n"
+    "	^self addLast: anObject!\n"
+    "\n"
+    "addFirst: anObject\n"
+    "	firstIndex = 1 ifTrue: [self makeRoomAtFront].\n"
+    "	firstIndex := firstIndex - 1.\n"
+    "	^elements at: firstIndex put: anObject!\n"
+    "\n"
+    "addAll: aCollection\n"
+    "	aCollection do: [:each | self addLast: each].\n"
+    "	^aCollection! !\n"
+    "\n"
+    "!OrderedCollection methodsFor: 'removing'!\n"
+    "removeFirst\n"
+    "	| first |\n"
+    "	self isEmpty ifTrue: [^self error: 'collection is empty'].\n"
+    "	first := elements at: firstIndex.\n"
+    "	elements at: firstIndex put: nil.\n"
+    "	firstIndex := firstIndex + 1.\n"
+    "	^first!\n"
+    "\n"
+    "removeLast\n"
+    "	| last |\n"
+    "	self isEmpty ifTrue: [^self error: 'collection is empty'].\n"
+    "	last := elements at: lastIndex.\n"
+    "	elements at: lastIndex put: nil.\n"
+    "	lastIndex := lastIndex - 1.\n"
+    "	^last! !\n"
+    "\n"
+    "!OrderedCollection methodsFor: 'enumerating'!\n"
+    "do: aBlock\n"
+    "	firstIndex to: lastIndex do: [:index | aBlock value: (elements at: index)]!\n"
+    "\n"
+    "collect: aBlock\n"
+    "	| result |\n"
+    "	result := OrderedCollection new: self size.\n"
+    "	self do: [:each | result addLast: (aBlock value: each)].\n"
+    "	^result! !\n"
+    "\n"
+    "!TranscriptStream methodsFor: 'writing'!\n"
+    "nextPutAll: aString\n"
+    "	<primitive: 120>\n"
+    "	^self nextPutAll: aString displayString!\n"
+    "\n"
+    "show: aString\n"
+    "	<primitive: 120>\n"
+    "	^self show: aString displayString!\n"
+    "\n"
+    "cr\n"
+    "	<primitive: 121>\n"
+    "	^self primitiveFailed!\n"
+    "\n"
+    "showCr: aString\n"
+    "	self show: aString.\n"
+    "	^self cr!\n"
+    "\n"
+    "print: anObject\n"
+    "	^self show: anObject printString!\n"
+    "\n"
+    "display: anObject\n"
+    "	^self show: anObject displayString!\n"
+    "\n"
+    "tab\n"
+    "	^self show: (String with: Character tab)!\n"
+    "\n"
+    "space\n"
+    "	^self show: ' '! !\n"
+    "\n"
+    "!SystemDictionary methodsFor: 'accessing'!\n"
+    "at: aSymbol\n"
+    "	<primitive: 140>\n"
+    "	^self error: 'no global named ', aSymbol printString!\n"
+    "\n"
+    "at: aSymbol put: anObject\n"
+    "	<primitive: 141>\n"
+    "	^self error: 'global names are symbols'!\n"
+    "\n"
+    "at: aSymbol ifAbsent: aBlock\n"
+    "	^(self includesKey: aSymbol) ifTrue: [self at: aSymbol] ifFalse: [aBlock value]!\n"
+    "\n"
+    "includesKey: aSymbol\n"
+    "	<primitive: 142>\n"
+    "	^false! !\n"
+    "\n"
+    "!SystemDictionary methodsFor: 'memory'!\n"
+    "garbageCollect\n"
+    "	<primitive: 131>\n"
+    "	^self primitiveFailed! !\n"
+    "\n"
+    "!SystemDictionary methodsFor: 'printing'!\n"
+    "printString\n"
+    "	^'Smalltalk'! !\n"
+    "\n"
+    "Smalltalk at: #Transcript put: TranscriptStream new!\n"
+    ;
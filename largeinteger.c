@@ -0,0 +1,387 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "largeinteger.h"
+
+// Operands and results are worked on as 32-bit digits, least significant
+// first. count leaves out zeros on top, so zero has no digits at all.
+typedef struct {
+    uint32_t* digits;
+    int count;
+    int negative;
+} Digits;
+
+#define DIGIT_BITS 32
+
+static Digits newDigits(int capacity, int negative) {
+    Digits number;
+    number.digits = (uint32_t*)calloc((size_t)(capacity > 0 ? capacity : 1), sizeof(uint32_t));
+    number.count = capacity;
+    number.negative = negative;
+    return number;
+}
+
+static void trim(Digits* number) {
+    while (number->count > 0 && number->digits[number->count - 1] == 0) number->count--;
+    if (number->count == 0) number->negative = 0;
+}
+
+int isLargeInteger(VM* vm, Oop object) {
+    int classIndex = classIndexOf(vm, object);
+    return classIndex == CLASS_LARGE_POSITIVE_INTEGER || classIndex == CLASS_LARGE_NEGATIVE_INTEGER;
+}
+
+static Digits load(VM* vm, Oop object) {
+    if (isInteger(vm, object)) {
+        long long value = integerValue(object);
+        // Negating as unsigned keeps the magnitude of the most negative value
+        unsigned long long magnitude = value < 0 ? 0 - (unsigned long long)value : (unsigned long long)value;
+        Digits number = newDigits(2, value < 0);
+        number.digits[0] = (uint32_t)magnitude;
+        number.digits[1] = (uint32_t)(magnitude >> DIGIT_BITS);
+        trim(&number);
+        return number;
+    }
+    uint32_t size = objectHeader(object)->size;
+    const uint8_t* bytes = objectBytes(object);
+    Digits number = newDigits((int)((size + 3) / 4), classIndexOf(vm, object) == CLASS_LARGE_NEGATIVE_INTEGER);
+    for (uint32_t i = 0; i < size; i++) number.digits[i / 4] |= (uint32_t)bytes[i] << (8 * (i % 4));
+    trim(&number);
+    return number;
+}
+
+// The object for a result, which it frees
+static Oop store(VM* vm, Digits* number) {
+    trim(number);
+    if (number->count <= 2) {
+        unsigned long long magnitude = number->count == 0 ? 0 : number->digits[0];
+        if (number->count == 2) magnitude |= (unsigned long long)number->digits[1] << DIGIT_BITS;
+        int fits = number->negative ? magnitude <= (1ULL << 63) : magnitude < (1ULL << 63);
+        if (fits) {
+            long long value = magnitude == (1ULL << 63) ? INT64_MIN
+                : number->negative ? -(long long)magnitude : (long long)magnitude;
+            free(number->digits);
+            return newInteger(vm, value);
+        }
+    }
+    uint32_t top = number->digits[number->count - 1];
+    size_t size = (size_t)(number->count - 1) * 4;
+    for (; top != 0; top >>= 8) size++;
+    if (size > LARGE_INTEGER_MAX_BYTES) {
+        free(number->digits);
+        runtimeError(vm, "integer too large: more than %d bytes", LARGE_INTEGER_MAX_BYTES);
+        return 0;
+    }
+    Oop object = instantiate(vm, number->negative ? CLASS_LARGE_NEGATIVE_INTEGER : CLASS_LARGE_POSITIVE_INTEGER,
+                             (uint32_t)size);
+    if (object != 0) {
+        uint8_t* bytes = objectBytes(object);
+        for (size_t i = 0; i < size; i++) bytes[i] = (uint8_t)(number->digits[i / 4] >> (8 * (i % 4)));
+    }
+    free(number->digits);
+    return object;
+}
+
+// Magnitudes
+
+static int compareMagnitudes(const Digits* left, const Digits* right) {
+    if (left->count != right->count) return left->count < right->count ? -1 : 1;
+    for (int i = left->count - 1; i >= 0; i--) {
+        if (left->digits[i] != right->digits[i]) return left->digits[i] < right->digits[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static Digits addMagnitudes(const Digits* left, const Digits* right, int negative) {
+    int count = left->count > right->count ? left->count : right->count;
+    Digits sum = newDigits(count + 1, negative);
+    uint64_t carry = 0;
+    for (int i = 0; i < count; i++) {
+        carry += (uint64_t)(i < left->count ? left->digits[i] : 0) + (i < right->count ? right->digits[i] : 0);
+        sum.digits[i] = (uint32_t)carry;
+        carry >>= DIGIT_BITS;
+    }
+    sum.digits[count] = (uint32_t)carry;
+    trim(&sum);
+    return sum;
+}
+
+// The larger magnitude less the smaller
+static Digits subtractMagnitudes(const Digits* larger, const Digits* smaller, int negative) {
+    Digits difference = newDigits(larger->count, negative);
+    int64_t borrow = 0;
+    for (int i = 0; i < larger->count; i++) {
+        borrow += (int64_t)larger->digits[i] - (i < smaller->count ? smaller->digits[i] : 0);
+        difference.digits[i] = (uint32_t)borrow;
+        borrow = borrow < 0 ? -1 : 0;
+    }
+    trim(&difference);
+    return difference;
+}
+
+// Sum of two signed numbers
+static Digits add(const Digits* left, const Digits* right) {
+    if (left->negative == right->negative) return addMagnitudes(left, right, left->negative);
+    if (compareMagnitudes(left, right) >= 0) return subtractMagnitudes(left, right, left->negative);
+    return subtractMagnitudes(right, left, right->negative);
+}
+
+static Digits multiplyMagnitudes(const Digits* left, const Digits* right, int negative) {
+    Digits product = newDigits(left->count + right->count, negative);
+    for (int i = 0; i < left->count; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < right->count; j++) {
+            carry += (uint64_t)left->digits[i] * right->digits[j] + product.digits[i + j];
+            product.digits[i + j] = (uint32_t)carry;
+            carry >>= DIGIT_BITS;
+        }
+        product.digits[i + right->count] = (uint32_t)carry;
+    }
+    trim(&product);
+    return product;
+}
+
+static Digits shiftLeft(const Digits* number, long long shift) {
+    int whole = (int)(shift / DIGIT_BITS);
+    int bits = (int)(shift % DIGIT_BITS);
+    Digits shifted = newDigits(number->count + whole + 1, number->negative);
+    for (int i = 0; i < number->count; i++) {
+        uint64_t digit = (uint64_t)number->digits[i] << bits;
+        shifted.digits[i + whole] |= (uint32_t)digit;
+        shifted.digits[i + whole + 1] = (uint32_t)(digit >> DIGIT_BITS);
+    }
+    trim(&shifted);
+    return shifted;
+}
+
+// The magnitude shifted right, truncated
+static Digits shiftRight(const Digits* number, long long shift, int negative) {
+    long long whole = shift / DIGIT_BITS;
+    int bits = (int)(shift % DIGIT_BITS);
+    int count = whole >= number->count ? 0 : number->count - (int)whole;
+    Digits shifted = newDigits(count, negative);
+    for (int i = 0; i < count; i++) {
+        uint64_t digit = number->digits[i + whole];
+        if (i + whole + 1 < number->count) digit |= (uint64_t)number->digits[i + whole + 1] << DIGIT_BITS;
+        shifted.digits[i] = (uint32_t)(digit >> bits);
+    }
+    trim(&shifted);
+    return shifted;
+}
+
+// Divides the magnitude in place by a single digit; answers the remainder
+static uint32_t divideByDigit(Digits* number, uint32_t divisor) {
+    uint64_t remainder = 0;
+    for (int i = number->count - 1; i >= 0; i--) {
+        remainder = (remainder << DIGIT_BITS) | number->digits[i];
+        number->digits[i] = (uint32_t)(remainder / divisor);
+        remainder %= divisor;
+    }
+    trim(number);
+    return (uint32_t)remainder;
+}
+
+// Truncated quotient and remainder of the magnitudes, one bit at a time
+// unless the divisor is a single digit
+static void divideMagnitudes(const Digits* dividend, const Digits* divisor, Digits* quotient, Digits* remainder) {
+    *quotient = newDigits(dividend->count, 0);
+    memcpy(quotient->digits, dividend->digits, sizeof(uint32_t) * (size_t)dividend->count);
+    if (divisor->count == 1) {
+        uint32_t rest = divideByDigit(quotient, divisor->digits[0]);
+        *remainder = newDigits(1, 0);
+        remainder->digits[0] = rest;
+        trim(remainder);
+        return;
+    }
+    memset(quotient->digits, 0, sizeof(uint32_t) * (size_t)dividend->count);
+    *remainder = newDigits(divisor->count + 1, 0);
+    remainder->count = 0;
+    for (long long bit = (long long)dividend->count * DIGIT_BITS - 1; bit >= 0; bit--) {
+        // remainder = remainder * 2 + the next bit of the dividend
+        uint32_t carry = (dividend->digits[bit / DIGIT_BITS] >> (bit % DIGIT_BITS)) & 1;
+        for (int i = 0; i < remainder->count; i++) {
+            uint32_t digit = remainder->digits[i];
+            remainder->digits[i] = (digit << 1) | carry;
+            carry = digit >> (DIGIT_BITS - 1);
+        }
+        if (carry != 0) remainder->digits[remainder->count++] = carry;
+        if (compareMagnitudes(remainder, divisor) >= 0) {
+            int64_t borrow = 0;
+            for (int i = 0; i < remainder->count; i++) {
+                borrow += (int64_t)remainder->digits[i] - (i < divisor->count ? divisor->digits[i] : 0);
+                remainder->digits[i] = (uint32_t)borrow;
+                borrow = borrow < 0 ? -1 : 0;
+            }
+            trim(remainder);
+            quotient->digits[bit / DIGIT_BITS] |= 1u << (bit % DIGIT_BITS);
+        }
+    }
+    trim(quotient);
+}
+
+// Entry points
+
+typedef Digits (*Operation)(const Digits* left, const Digits* right);
+
+static Digits sum(const Digits* left, const Digits* right) {
+    return add(left, right);
+}
+
+static Digits difference(const Digits* left, const Digits* right) {
+    Digits negated = *right;
+    negated.negative = right->count > 0 && !right->negative;
+    return add(left, &negated);
+}
+
+static Digits product(const Digits* left, const Digits* right) {
+    return multiplyMagnitudes(left, right, left->negative != right->negative);
+}
+
+static Oop binaryOperation(VM* vm, Oop left, Oop right, Operation operation) {
+    Digits a = load(vm, left);
+    Digits b = load(vm, right);
+    Digits result = operation(&a, &b);
+    free(a.digits);
+    free(b.digits);
+    return store(vm, &result);
+}
+
+Oop largeIntegerAdd(VM* vm, Oop left, Oop right) {
+    return binaryOperation(vm, left, right, sum);
+}
+
+Oop largeIntegerSubtract(VM* vm, Oop left, Oop right) {
+    return binaryOperation(vm, left, right, difference);
+}
+
+Oop largeIntegerMultiply(VM* vm, Oop left, Oop right) {
+    return binaryOperation(vm, left, right, product);
+}
+
+int largeIntegerDivide(VM* vm, Oop dividend, Oop divisor, Oop* quotient, Oop* modulo) {
+    Digits a = load(vm, dividend);
+    Digits b = load(vm, divisor);
+    Digits q, r;
+    divideMagnitudes(&a, &b, &q, &r);
+    q.negative = q.count > 0 && a.negative != b.negative;
+    r.negative = r.count > 0 && a.negative;
+    if (r.count > 0 && a.negative != b.negative) {
+        // Truncated towards zero so far: one further down, and the modulo
+        // takes the sign of the divisor
+        Digits one = newDigits(1, 1);
+        one.digits[0] = 1;
+        Digits floored = add(&q, &one);
+        Digits adjusted = add(&r, &b);
+        free(one.digits);
+        free(q.digits);
+        free(r.digits);
+        q = floored;
+        r = adjusted;
+    }
+    free(a.digits);
+    free(b.digits);
+    *quotient = store(vm, &q);
+    if (*quotient == 0) {
+        free(r.digits);
+        return 0;
+    }
+    *modulo = store(vm, &r);
+    return *modulo != 0;
+}
+
+Oop largeIntegerShift(VM* vm, Oop value, long long shift) {
+    Digits number = load(vm, value);
+    Digits shifted;
+    if (number.count == 0) {
+        shifted = number;
+        return store(vm, &shifted);
+    }
+    if (shift >= 0) {
+        if (shift / 8 > LARGE_INTEGER_MAX_BYTES) {
+            free(number.digits);
+            runtimeError(vm, "integer too large: more than %d bytes", LARGE_INTEGER_MAX_BYTES);
+            return 0;
+        }
+        shifted = shiftLeft(&number, shift);
+    } else if (!number.negative) {
+        shifted = shiftRight(&number, -shift, 0);
+    } else {
+        // Rounded towards negative infinity: -((|n| - 1) >> s) - 1
+        Digits one = newDigits(1, 0);
+        one.digits[0] = 1;
+        Digits less = subtractMagnitudes(&number, &one, 0);
+        Digits truncated = shiftRight(&less, -shift, 0);
+        shifted = addMagnitudes(&truncated, &one, 1);
+        free(one.digits);
+        free(less.digits);
+        free(truncated.digits);
+    }
+    free(number.digits);
+    return store(vm, &shifted);
+}
+
+int largeIntegerCompare(VM* vm, Oop left, Oop right) {
+    Digits a = load(vm, left);
+    Digits b = load(vm, right);
+    int order;
+    if (a.negative != b.negative) {
+        order = a.negative ? -1 : 1;
+    } else {
+        order = a.negative ? compareMagnitudes(&b, &a) : compareMagnitudes(&a, &b);
+    }
+    free(a.digits);
+    free(b.digits);
+    return order;
+}
+
+double largeIntegerAsDouble(VM* vm, Oop value) {
+    Digits number = load(vm, value);
+    double result = 0.0;
+    if (number.count > 0) {
+        // The top 64 bits, with the lowest set when any bit below them is:
+        // converting that rounds as converting the whole would
+        int top = number.count - 1;
+        int bits = DIGIT_BITS - __builtin_clz(number.digits[top]);
+        long long exponent = (long long)top * DIGIT_BITS + bits - 64;
+        uint64_t mantissa = 0;
+        int sticky = 0;
+        for (long long bit = (long long)top * DIGIT_BITS + bits - 1; bit >= 0; bit--) {
+            uint32_t set = (number.digits[bit / DIGIT_BITS] >> (bit % DIGIT_BITS)) & 1;
+            if (bit >= exponent) {
+                mantissa = (mantissa << 1) | set;
+            } else if (set) {
+                sticky = 1;
+                break;
+            }
+        }
+        if (exponent < 0) exponent = 0;
+        result = ldexp((double)(mantissa | (uint64_t)sticky), (int)(exponent > 4096 ? 4096 : exponent));
+        if (number.negative) result = -result;
+    }
+    free(number.digits);
+    return result;
+}
+
+char* largeIntegerPrintString(VM* vm, Oop value) {
+    Digits number = load(vm, value);
+    int negative = number.negative;
+    // Nine decimal digits per step, collected least significant first
+    size_t capacity = (size_t)number.count * 10 + 2;
+    char* reversed = (char*)malloc(capacity);
+    size_t length = 0;
+    do {
+        uint32_t chunk = divideByDigit(&number, 1000000000);
+        for (int i = 0; i < 9 && (number.count > 0 || chunk != 0 || i == 0); i++) {
+            reversed[length++] = (char)('0' + chunk % 10);
+            chunk /= 10;
+        }
+    } while (number.count > 0);
+    char* text = (char*)malloc(length + 2);
+    size_t at = 0;
+    if (negative) text[at++] = '-';
+    while (length > 0) text[at++] = reversed[--length];
+    text[at] = '\0';
+    free(reversed);
+    free(number.digits);
+    return text;
+}
@@ -0,0 +1,50 @@
+#ifndef LARGEINTEGER_H
+#define LARGEINTEGER_H
+
+#include "runtime.h"
+
+/*
+ * Integers beyond 64 bits. A LargePositiveInteger or LargeNegativeInteger
+ * holds the magnitude in its bytes, least significant first, with no zero
+ * bytes on top. Every value that fits in 64 bits is a SmallInteger instead
+ * (see newInteger), so the two kinds never hold equal values.
+ *
+ * The integer primitives come here when an operand is a LargeInteger or a
+ * SmallInteger result would overflow. The functions take integers of either
+ * kind and answer results in the smallest kind they fit, or 0 after
+ * reporting a runtime error: out of memory, or a result beyond
+ * LARGE_INTEGER_MAX_BYTES.
+ */
+
+#define LARGE_INTEGER_MAX_BYTES (1 << 24)
+
+int isLargeInteger(VM* vm, Oop object);
+
+/* A SmallInteger or a LargeInteger */
+static inline int isAnyInteger(VM* vm, Oop object) {
+    return isInteger(vm, object) || isLargeInteger(vm, object);
+}
+
+Oop largeIntegerAdd(VM* vm, Oop left, Oop right);
+Oop largeIntegerSubtract(VM* vm, Oop left, Oop right);
+Oop largeIntegerMultiply(VM* vm, Oop left, Oop right);
+
+/* Quotient rounded towards negative infinity and the modulo that goes with
+ * it, as // and \\ answer. The divisor must not be zero. Answers 0 after an
+ * error, 1 otherwise. */
+int largeIntegerDivide(VM* vm, Oop dividend, Oop divisor, Oop* quotient, Oop* modulo);
+
+/* Shifted left by shift bits, or right for a negative shift, rounding
+ * towards negative infinity */
+Oop largeIntegerShift(VM* vm, Oop value, long long shift);
+
+/* Negative, zero or positive as left is less than, equal to or greater than right */
+int largeIntegerCompare(VM* vm, Oop left, Oop right);
+
+/* Nearest double, or an infinity beyond the range of doubles */
+double largeIntegerAsDouble(VM* vm, Oop value);
+
+/* Decimal digits with a leading '-' when negative; the caller frees them */
+char* largeIntegerPrintString(VM* vm, Oop value);
+
+#endif /* LARGEINTEGER_H */
@@ -132,11 +132,8 @@ static Token identifier(Lexer* lexer) {
 }
 
 static Token number(Lexer* lexer) {
-    int isNegative = 0;
-    if (lexer->start[0] == '-') {
-        isNegative = 1;
-        advance(lexer); // Skip the minus sign
-    }
+    // A leading minus sign has already been consumed by nextToken
+    int isNegative = lexer->start[0] == '-';
     
     // Parse the integer part
     while (isdigit(peek(lexer))) {
@@ -144,15 +141,15 @@ static Token number(Lexer* lexer) {
     }
     
     // Check for radix notation (e.g., 16r1A)
-    if (peek(lexer) == 'r' && isdigit(lexer->start[0])) {
+    if (peek(lexer) == 'r') {
         // Get the radix
-        char* endptr;
-        long radix = strtol(lexer->start, &endptr, 10);
+        long radix = strtol(lexer->start + isNegative, NULL, 10);
         if (radix < 2 || radix > 36) {
             return errorToken(lexer, "Invalid radix. Must be between 2 and 36.");
         }
         
         advance(lexer); // Skip 'r'
+        const char* digits = lexer->current;
         
         // Parse the base-N integer
         while (isalnum(peek(lexer))) {
@@ -177,8 +174,8 @@ static Token number(Lexer* lexer) {
         }
         
         Token token = makeToken(lexer, TOKEN_INTEGER);
-        // Compute the value
-        token.value.intValue = strtoll(lexer->start, NULL, (int)radix);
+        // Compute the value from the digits after the radix prefix
+        token.value.intValue = strtoll(digits, NULL, (int)radix);
         if (isNegative) token.value.intValue = -token.value.intValue;
         return token;
     }
@@ -192,7 +189,6 @@ static Token number(Lexer* lexer) {
             // Return the integer value without consuming the period
             Token token = makeToken(lexer, TOKEN_INTEGER);
             token.value.intValue = strtoll(lexer->start, NULL, 10);
-            if (isNegative) token.value.intValue = -token.value.intValue;
             return token;
         }
         
@@ -266,33 +262,37 @@ static Token number(Lexer* lexer) {
         return token;
     }
     
-    // Simple integer
+    // Simple integer (strtoll takes care of the sign)
     Token token = makeToken(lexer, TOKEN_INTEGER);
     token.value.intValue = strtoll(lexer->start, NULL, 10);
-    if (isNegative) token.value.intValue = -token.value.intValue;
     return token;
 }
 
-static Token string(Lexer* lexer) {
-    while (peek(lexer) != '\'' && !isAtEnd(lexer)) {
-        if (peek(lexer) == '\n') {
-            lexer->line++;
-            lexer->column = 0;
+// Scan the body of a quoted string up to and including its closing apostrophe.
+// A doubled apostrophe ('') is an escaped apostrophe inside the string.
+static int quotedBody(Lexer* lexer) {
+    for (;;) {
+        while (peek(lexer) != '\'' && !isAtEnd(lexer)) {
+            if (peek(lexer) == '\n') {
+                lexer->line++;
+                lexer->column = 0;
+            }
+            advance(lexer);
         }
         
-        // Handle escape sequence for apostrophe
-        if (peek(lexer) == '\'' && peekNext(lexer) == '\'') {
-            advance(lexer); // Skip the first apostrophe
-        }
+        if (isAtEnd(lexer)) return 0;
         
+        advance(lexer); // Closing apostrophe, or the first half of ''
+        if (peek(lexer) != '\'') return 1;
         advance(lexer);
     }
-    
-    if (isAtEnd(lexer)) {
+}
+
+static Token string(Lexer* lexer) {
+    if (!quotedBody(lexer)) {
         return errorToken(lexer, "Unterminated string.");
     }
     
-    advance(lexer); // Closing apostrophe
     return makeToken(lexer, TOKEN_STRING);
 }
 
@@ -319,29 +319,18 @@ static Token symbol(Lexer* lexer) {
         advance(lexer); // Skip the opening parenthesis
         return makeToken(lexer, TOKEN_HASH_PAREN);
     }
+    // Handle byte array literals like #[1 2 255]
+    else if (peek(lexer) == '[') {
+        advance(lexer); // Skip the opening bracket
+        return makeToken(lexer, TOKEN_HASH_BRACKET);
+    }
     // If followed by string literal, it's a #'symbol' syntax
     else if (peek(lexer) == '\'') {
         advance(lexer); // Skip the opening quote
         
-        while (peek(lexer) != '\'' && !isAtEnd(lexer)) {
-            if (peek(lexer) == '\n') {
-                lexer->line++;
-                lexer->column = 0;
-            }
-            
-            // Handle escape sequence for apostrophe
-            if (peek(lexer) == '\'' && peekNext(lexer) == '\'') {
-                advance(lexer); // Skip the first apostrophe
-            }
-            
-            advance(lexer);
-        }
-        
-        if (isAtEnd(lexer)) {
+        if (!quotedBody(lexer)) {
             return errorToken(lexer, "Unterminated symbol string.");
         }
-        
-        advance(lexer); // Closing apostrophe
     } 
     else {
         // Otherwise it's a normal symbol (#symbol)
@@ -391,15 +380,75 @@ static Token symbol(Lexer* lexer) {
     return makeToken(lexer, TOKEN_SYMBOL);
 }
 
-static Token binarySelector(Lexer* lexer) {
+// Characters that continue a binary selector such as <= or ->. '|' and '!'
+// stay single so that "[:x || t |" and chunk separators still lex, and a '-'
+// followed by a digit starts a negative number instead: "a >-1" is a > -1.
+static int continuesBinarySelector(Lexer* lexer) {
+    char c = peek(lexer);
+    if (c == '\0' || strchr("~@%&*-+=\\<>,?/", c) == NULL) return 0;
+    return c != '-' || !isdigit(lexer->current[1]);
+}
+
+static Token binarySelector(Lexer* lexer, TokenType singleType) {
     // First binary character is already consumed
+    if (!continuesBinarySelector(lexer)) return makeToken(lexer, singleType);
     
-    // Check for second binary character, if any
-    if (strchr("~!@%&*-+=|\\<>,?/", peek(lexer)) != NULL) {
-        advance(lexer);
+    while (continuesBinarySelector(lexer)) advance(lexer);
+    return makeToken(lexer, TOKEN_BINARY_SELECTOR);
+}
+
+// Fast path for the long runs of plain decimal integers found in generated
+// literal arrays. Consumes whitespace-separated integers directly from the
+// source into values, without building tokens, and stops in front of anything
+// that needs the full lexer (radix, floats, comments, very long numbers...).
+// Returns the number of values read.
+int lexIntegerRun(Lexer* lexer, long long* values, int capacity) {
+    const char* p = lexer->current;
+    int line = lexer->line;
+    int column = lexer->column;
+    int count = 0;
+    
+    while (count < capacity) {
+        const char* q = p;
+        int nextLine = line;
+        int nextColumn = column;
+        
+        while (*q == ' ' || *q == '\t' || *q == '\n') {
+            if (*q == '\n') {
+                nextLine++;
+                nextColumn = 1;
+            } else {
+                nextColumn++;
+            }
+            q++;
+        }
+        
+        const char* digits = q + (*q == '-');
+        if (*digits < '0' || *digits > '9') break;
+        
+        unsigned long long value = 0;
+        const char* d = digits;
+        while (*d >= '0' && *d <= '9') {
+            value = value * 10 + (unsigned long long)(*d - '0');
+            d++;
+        }
+        
+        // More than 18 digits could overflow; anything glued to the digits
+        // (".5", "r", "e", "s", letters) is not a plain integer
+        if (d - digits > 18) break;
+        if (*d != ' ' && *d != '\t' && *d != '\n' && *d != ')' && *d != ']') break;
+        
+        values[count++] = (q != digits) ? -(long long)value : (long long)value;
+        nextColumn += (int)(d - q);
+        p = d;
+        line = nextLine;
+        column = nextColumn;
     }
     
-    return makeToken(lexer, TOKEN_BINARY_SELECTOR);
+    lexer->current = p;
+    lexer->line = line;
+    lexer->column = column;
+    return count;
 }
 
 void initLexer(Lexer* lexer, const char* source) {
@@ -451,25 +500,35 @@ Token nextToken(Lexer* lexer) {
                 return makeToken(lexer, TOKEN_ASSIGNMENT);
             }
             return makeToken(lexer, TOKEN_COLON);
-        case ',': return makeToken(lexer, TOKEN_COMMA);
         case '_': return makeToken(lexer, TOKEN_UNDERSCORE);
         
-        // Binary selectors
-        case '~': return makeToken(lexer, TOKEN_BINARY_SELECTOR);
+        // Binary selectors; two or more characters make one TOKEN_BINARY_SELECTOR
+        case ',': return binarySelector(lexer, TOKEN_COMMA);
+        case '~': return binarySelector(lexer, TOKEN_BINARY_SELECTOR);
         case '!': return makeToken(lexer, TOKEN_BINARY_SELECTOR);
-        case '@': return makeToken(lexer, TOKEN_BINARY_SELECTOR);
-        case '%': return makeToken(lexer, TOKEN_BINARY_SELECTOR);
-        case '&': return makeToken(lexer, TOKEN_BINARY_SELECTOR);
-        case '*': return makeToken(lexer, TOKEN_STAR);
-        case '-': return makeToken(lexer, TOKEN_MINUS);
-        case '+': return makeToken(lexer, TOKEN_PLUS);
-        case '=': return makeToken(lexer, TOKEN_EQUAL);
-        case '\\': return makeToken(lexer, TOKEN_BACKSLASH);
-        case '<': return makeToken(lexer, TOKEN_LESS);
-        case '>': return makeToken(lexer, TOKEN_GREATER);
-        case '?': return makeToken(lexer, TOKEN_QUESTION);
-        case '/': return makeToken(lexer, TOKEN_SLASH);
+        case '@': return binarySelector(lexer, TOKEN_BINARY_SELECTOR);
+        case '%': return binarySelector(lexer, TOKEN_BINARY_SELECTOR);
+        case '&': return binarySelector(lexer, TOKEN_BINARY_SELECTOR);
+        case '*': return binarySelector(lexer, TOKEN_STAR);
+        case '-': return binarySelector(lexer, TOKEN_MINUS);
+        case '+': return binarySelector(lexer, TOKEN_PLUS);
+        case '=': return binarySelector(lexer, TOKEN_EQUAL);
+        case '\\': return binarySelector(lexer, TOKEN_BACKSLASH);
+        case '<': return binarySelector(lexer, TOKEN_LESS);
+        case '>': return binarySelector(lexer, TOKEN_GREATER);
+        case '?': return binarySelector(lexer, TOKEN_QUESTION);
+        case '/': return binarySelector(lexer, TOKEN_SLASH);
     }
     
     return errorToken(lexer, "Unexpected character.");
-}
\ No newline at end of file
+}
+#define TOKEN_NAME_ENTRY(name) #name,
+
+static const char* const tokenTypeNames[] = {
+    TOKEN_TYPES(TOKEN_NAME_ENTRY)
+};
+
+const char* tokenTypeName(TokenType type) {
+    if ((unsigned)type >= TOKEN_TYPE_COUNT) return "UNKNOWN";
+    return tokenTypeNames[type];
+}
@@ -14,5 +14,8 @@ typedef struct {
 void initLexer(Lexer* lexer, const char* source);
 Token nextToken(Lexer* lexer);
 void lexerError(Lexer* lexer, const char* message);
+int lexIntegerRun(Lexer* lexer, long long* values, int capacity);
+/* Name of a token type without its TOKEN_ prefix, e.g. "LEFT_PAREN" */
+const char* tokenTypeName(TokenType type);
 
 #endif /* LEXER_H */
\ No newline at end of file
@@ -0,0 +1,549 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "memory.h"
+
+#define CHUNK_SIZE (4 * 1024 * 1024)
+#define EDEN_SIZE (512 * 1024)
+// Eden past its limit, for the objects made before the pending scavenge
+#define EDEN_RESERVE (64 * 1024)
+#define SURVIVOR_SIZE (128 * 1024)
+// Larger objects are allocated in old space
+#define LARGE_OBJECT_SIZE (64 * 1024)
+#define TENURE_AGE 3
+#define MIN_FULL_COLLECTION_THRESHOLD (32 * 1024 * 1024)
+#define MARK_STACK_SIZE (64 * 1024)
+
+// Where a full collection moves a live object, and its identity hash,
+// which the header holds the index of this entry in meanwhile
+typedef struct Forwarding {
+    Oop address;
+    uint32_t hash;
+} Forwarding;
+
+static double seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void initSpace(Space* space, char* start, size_t size) {
+    space->start = start;
+    space->next = start;
+    space->limit = start + size;
+}
+
+int initObjectMemory(ObjectMemory* memory) {
+    memset(memory, 0, sizeof(ObjectMemory));
+    memory->nextHash = 1;
+    memory->fullCollectionThreshold = MIN_FULL_COLLECTION_THRESHOLD;
+    memory->youngSize = EDEN_SIZE + 2 * SURVIVOR_SIZE;
+    memory->young = (char*)malloc(memory->youngSize);
+    if (memory->young == NULL) return 0;
+    initSpace(&memory->eden, memory->young, EDEN_SIZE - EDEN_RESERVE);
+    memory->edenEnd = memory->young + EDEN_SIZE;
+    initSpace(&memory->survivor, memory->young + EDEN_SIZE, SURVIVOR_SIZE);
+    initSpace(&memory->reserve, memory->young + EDEN_SIZE + SURVIVOR_SIZE, SURVIVOR_SIZE);
+    return 1;
+}
+
+void freeObjectMemory(ObjectMemory* memory) {
+    MemoryChunk* chunk = memory->chunks;
+    while (chunk != NULL) {
+        MemoryChunk* next = chunk->next;
+        if (!chunk->external) free(chunk);
+        chunk = next;
+    }
+    free(memory->young);
+    free(memory->remembered);
+    free(memory->markStack);
+    memory->chunks = NULL;
+    memory->current = NULL;
+    memory->young = NULL;
+    memory->youngSize = 0;
+    memory->remembered = NULL;
+    memory->markStack = NULL;
+}
+
+static size_t bodySize(ObjectFormat format, uint32_t size) {
+    switch (format) {
+        case FORMAT_BYTES: return ((size_t)size + 7) & ~(size_t)7;
+        case FORMAT_CLOSURE: return offsetof(Closure, receiver) - sizeof(ObjectHeader) + (size_t)size * sizeof(Oop);
+        default: return (size_t)size * sizeof(Oop) + cardBytes(format, size);
+    }
+}
+
+size_t objectByteSize(Oop object) {
+    ObjectHeader* header = objectHeader(object);
+    return sizeof(ObjectHeader) + bodySize((ObjectFormat)header->format, header->size);
+}
+
+// Old space
+
+static MemoryChunk* addChunk(ObjectMemory* memory, size_t needed) {
+    size_t size = needed + sizeof(MemoryChunk) > CHUNK_SIZE ? needed + sizeof(MemoryChunk) : CHUNK_SIZE;
+    MemoryChunk* chunk = (MemoryChunk*)malloc(size);
+    if (chunk == NULL) return NULL;
+    chunk->next = memory->chunks;
+    chunk->top = chunkStart(chunk);
+    chunk->limit = (char*)chunk + size;
+    chunk->scan = chunk->top;
+    chunk->external = 0;
+    memory->chunks = chunk;
+    return chunk;
+}
+
+void addExternalChunk(ObjectMemory* memory, MemoryChunk* chunk, char* top) {
+    // Full, so that new old objects go to chunks of their own
+    chunk->next = memory->chunks;
+    chunk->top = top;
+    chunk->limit = top;
+    chunk->scan = top;
+    chunk->external = 1;
+    memory->chunks = chunk;
+    memory->current = chunk;
+    memory->oldBytes += (size_t)(top - chunkStart(chunk));
+    if (memory->oldBytes * 2 > memory->fullCollectionThreshold) memory->fullCollectionThreshold = memory->oldBytes * 2;
+}
+
+static ObjectHeader* allocateOld(ObjectMemory* memory, size_t total) {
+    MemoryChunk* chunk = memory->current;
+    while (chunk != NULL && (size_t)(chunk->limit - chunk->top) < total) chunk = chunk->next;
+    if (chunk == NULL) {
+        chunk = addChunk(memory, total);
+        if (chunk == NULL) return NULL;
+    }
+    memory->current = chunk;
+    ObjectHeader* header = (ObjectHeader*)chunk->top;
+    chunk->top += total;
+    memory->oldBytes += total;
+    if (memory->oldBytes > memory->fullCollectionThreshold) memory->collectionRequested = 1;
+    return header;
+}
+
+// Allocation
+
+// Eden is past its limit: ask for a scavenge, and meanwhile take the object
+// from the eden reserve, or from old space if it is large or the reserve is
+// used up too
+static ObjectHeader* allocateSlowly(ObjectMemory* memory, size_t total) {
+    if (total > LARGE_OBJECT_SIZE) return allocateOld(memory, total);
+    memory->collectionRequested = 1;
+    if ((size_t)(memory->edenEnd - memory->eden.next) >= total) {
+        ObjectHeader* header = (ObjectHeader*)memory->eden.next;
+        memory->eden.next += total;
+        return header;
+    }
+    return allocateOld(memory, total);
+}
+
+Oop allocateObject(ObjectMemory* memory, uint32_t classIndex, ObjectFormat format, uint32_t size) {
+    if (format == FORMAT_CLOSURE) size += CLOSURE_POINTER_SLOTS;
+    size_t body = bodySize(format, size);
+    size_t total = sizeof(ObjectHeader) + body;
+    ObjectHeader* header;
+    if ((size_t)(memory->eden.limit - memory->eden.next) >= total) {
+        header = (ObjectHeader*)memory->eden.next;
+        memory->eden.next += total;
+    } else {
+        header = allocateSlowly(memory, total);
+        if (header == NULL) return 0;
+    }
+    memory->bytesAllocated += total;
+    memory->objectsAllocated++;
+
+    header->classIndex = classIndex;
+    header->hash = memory->nextHash++;
+    header->size = size;
+    header->format = (uint8_t)format;
+    header->flags = 0;
+    header->age = 0;
+    header->reserved = 0;
+
+    Oop object = (Oop)header;
+    if (format == FORMAT_POINTERS || format == FORMAT_INDEXABLE) {
+        Oop* slots = objectSlots(object);
+        for (uint32_t i = 0; i < size; i++) slots[i] = memory->nil;
+        memset(slots + size, 0, cardBytes(format, size));
+    } else {
+        memset(header + 1, 0, body);
+        if (format == FORMAT_CLOSURE) {
+            Oop* slots = pointerSlots(object);
+            for (uint32_t i = 0; i < size; i++) slots[i] = memory->nil;
+        }
+    }
+    // Its slots are about to be set without store checks
+    if (!isYoungObject(memory, object)) rememberObject(memory, object);
+    return object;
+}
+
+static void addRemembered(ObjectMemory* memory, Oop object) {
+    if (memory->rememberedCount == memory->rememberedCapacity) {
+        size_t capacity = memory->rememberedCapacity < 1024 ? 1024 : memory->rememberedCapacity * 2;
+        Oop* remembered = (Oop*)realloc(memory->remembered, sizeof(Oop) * capacity);
+        if (remembered == NULL) {
+            memory->rememberedOverflow = 1;
+            return;
+        }
+        memory->remembered = remembered;
+        memory->rememberedCapacity = capacity;
+    }
+    memory->remembered[memory->rememberedCount++] = object;
+}
+
+void rememberObject(ObjectMemory* memory, Oop object) {
+    ObjectHeader* header = objectHeader(object);
+    if (hasCards(header)) {
+        memset(objectCards(object), 1, cardCount(header));
+        if (header->flags & FLAG_CARDS) return;
+        header->flags |= FLAG_CARDS;
+    } else {
+        header->flags |= FLAG_REMEMBERED;
+    }
+    addRemembered(memory, object);
+}
+
+void rememberSlot(ObjectMemory* memory, Oop object, uint32_t index) {
+    ObjectHeader* header = objectHeader(object);
+    if (!hasCards(header)) {
+        rememberObject(memory, object);
+        return;
+    }
+    objectCards(object)[index / CARD_SLOTS] = 1;
+    if (!(header->flags & FLAG_CARDS)) {
+        header->flags |= FLAG_CARDS;
+        addRemembered(memory, object);
+    }
+}
+
+// Scavenging
+
+static int inSpace(const Space* space, Oop object) {
+    return (char*)object >= space->start && (char*)object < space->next;
+}
+
+// Copy a young object to the reserve survivor space, or to old space once it
+// is old enough, and leave the address of the copy in its first word
+static Oop copyObject(ObjectMemory* memory, Oop object) {
+    ObjectHeader* header = objectHeader(object);
+    if (header->flags & FLAG_FORWARDED) return *(Oop*)header;
+    size_t total = objectByteSize(object);
+    int age = header->age + 1;
+    ObjectHeader* copy;
+    if (!memory->tenuring && age < TENURE_AGE && (size_t)(memory->reserve.limit - memory->reserve.next) >= total) {
+        copy = (ObjectHeader*)memory->reserve.next;
+        memory->reserve.next += total;
+        memory->statistics.bytesSurvived += total;
+    } else {
+        copy = allocateOld(memory, total);
+        if (copy == NULL) {
+            // Half the objects have moved: there is no way back
+            fprintf(stderr, "out of memory while collecting garbage\n");
+            abort();
+        }
+        memory->statistics.bytesPromoted += total;
+    }
+    memcpy(copy, header, total);
+    copy->flags = 0;
+    copy->age = (uint8_t)age;
+    header->flags |= FLAG_FORWARDED;
+    *(Oop*)header = (Oop)copy;
+    return (Oop)copy;
+}
+
+static void scavengeSlot(ObjectMemory* memory, Oop* slot) {
+    Oop object = *slot;
+    if (isYoungObject(memory, object) && !inSpace(&memory->reserve, object)) *slot = copyObject(memory, object);
+}
+
+// Scavenge the referents of an object; answers whether any is still young
+static int scavengeObject(ObjectMemory* memory, Oop object) {
+    uint32_t count = pointerSlotCount(objectHeader(object));
+    Oop* slots = pointerSlots(object);
+    int young = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        scavengeSlot(memory, &slots[i]);
+        young |= isYoungObject(memory, slots[i]);
+    }
+    return young;
+}
+
+// Scavenge the referents in the cards of an object, all of them or only the
+// dirty ones, and leave dirty those still pointing to young objects; answers
+// whether any is
+static int scavengeCards(ObjectMemory* memory, Oop object, int all) {
+    ObjectHeader* header = objectHeader(object);
+    Oop* slots = objectSlots(object);
+    uint8_t* cards = objectCards(object);
+    uint32_t count = cardCount(header);
+    int young = 0;
+    for (uint32_t card = 0; card < count; card++) {
+        if (!all && !cards[card]) continue;
+        uint32_t end = card + 1 < count ? (card + 1) * CARD_SLOTS : header->size;
+        int dirty = 0;
+        for (uint32_t i = card * CARD_SLOTS; i < end; i++) {
+            scavengeSlot(memory, &slots[i]);
+            dirty |= isYoungObject(memory, slots[i]);
+        }
+        cards[card] = (uint8_t)dirty;
+        young |= dirty;
+    }
+    return young;
+}
+
+// Scavenge an old object not in the remembered set, and add it if it still
+// points to young objects: only the cards that do, if it has cards
+static void scavengeOldObject(ObjectMemory* memory, Oop object) {
+    ObjectHeader* header = objectHeader(object);
+    if (!hasCards(header)) {
+        if (scavengeObject(memory, object)) rememberObject(memory, object);
+    } else if (scavengeCards(memory, object, 1)) {
+        header->flags |= FLAG_CARDS;
+        addRemembered(memory, object);
+    }
+}
+
+// Remembered objects are roots; those left pointing to young ones stay in the set
+static void scavengeRemembered(ObjectMemory* memory) {
+    if (memory->rememberedOverflow) {
+        // Some were never recorded, so every old object is looked at. The
+        // scan marks still stand at the objects from before this scavenge.
+        memory->rememberedOverflow = 0;
+        memory->rememberedCount = 0;
+        for (MemoryChunk* chunk = memory->chunks; chunk != NULL; chunk = chunk->next) {
+            for (char* next = chunkStart(chunk); next < chunk->scan; next += objectByteSize((Oop)next)) {
+                objectHeader((Oop)next)->flags &= (uint8_t)~(FLAG_REMEMBERED | FLAG_CARDS);
+                scavengeOldObject(memory, (Oop)next);
+            }
+        }
+        return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < memory->rememberedCount; i++) {
+        Oop object = memory->remembered[i];
+        ObjectHeader* header = objectHeader(object);
+        int young = header->flags & FLAG_CARDS ? scavengeCards(memory, object, 0) : scavengeObject(memory, object);
+        if (young) {
+            memory->remembered[kept++] = object;
+        } else {
+            header->flags &= (uint8_t)~(FLAG_REMEMBERED | FLAG_CARDS);
+        }
+    }
+    memory->rememberedCount = kept;
+}
+
+// Cheney's algorithm, with two scan pointers: the reserve survivor space and
+// the promoted objects at the end of the old space chunks
+static void scavenge(ObjectMemory* memory) {
+    for (MemoryChunk* chunk = memory->chunks; chunk != NULL; chunk = chunk->next) chunk->scan = chunk->top;
+    memory->reserve.next = memory->reserve.start;
+
+    scavengeRemembered(memory);
+    memory->enumerateRoots(memory->rootContext, memory, scavengeSlot);
+
+    char* scan = memory->reserve.start;
+    int progress;
+    do {
+        progress = 0;
+        while (scan < memory->reserve.next) {
+            Oop object = (Oop)scan;
+            scan += objectByteSize(object);
+            scavengeObject(memory, object);
+            progress = 1;
+        }
+        for (MemoryChunk* chunk = memory->chunks; chunk != NULL; chunk = chunk->next) {
+            while (chunk->scan < chunk->top) {
+                Oop object = (Oop)chunk->scan;
+                chunk->scan += objectByteSize(object);
+                scavengeOldObject(memory, object);
+                progress = 1;
+            }
+        }
+    } while (progress);
+
+    // Eden and the other survivor space hold nothing live now
+    Space survivors = memory->reserve;
+    memory->reserve = memory->survivor;
+    memory->reserve.next = memory->reserve.start;
+    memory->survivor = survivors;
+    memory->eden.next = memory->eden.start;
+}
+
+// Marking
+
+static void markSlot(ObjectMemory* memory, Oop* slot) {
+    Oop object = *slot;
+    if (object == 0 || isImmediate(object)) return;
+    ObjectHeader* header = objectHeader(object);
+    if (header->flags & FLAG_MARKED) return;
+    header->flags |= FLAG_MARKED;
+    if (pointerSlotCount(header) == 0) return;
+    if (memory->markDepth < memory->markCapacity) {
+        memory->markStack[memory->markDepth++] = object;
+    } else {
+        // Picked up again by a pass over the heap
+        memory->markOverflow = 1;
+    }
+}
+
+static void markReferents(ObjectMemory* memory, Oop object) {
+    uint32_t count = pointerSlotCount(objectHeader(object));
+    Oop* slots = pointerSlots(object);
+    for (uint32_t i = 0; i < count; i++) markSlot(memory, &slots[i]);
+}
+
+static void drainMarkStack(ObjectMemory* memory) {
+    while (memory->markDepth > 0) markReferents(memory, memory->markStack[--memory->markDepth]);
+}
+
+static void markLiveObjects(ObjectMemory* memory) {
+    if (memory->markStack == NULL) {
+        memory->markStack = (Oop*)malloc(sizeof(Oop) * MARK_STACK_SIZE);
+        memory->markCapacity = memory->markStack != NULL ? MARK_STACK_SIZE : 0;
+    }
+    memory->markDepth = 0;
+    memory->markOverflow = 0;
+    memory->enumerateRoots(memory->rootContext, memory, markSlot);
+    drainMarkStack(memory);
+    while (memory->markOverflow) {
+        memory->markOverflow = 0;
+        for (MemoryChunk* chunk = memory->chunks; chunk != NULL; chunk = chunk->next) {
+            for (char* next = chunkStart(chunk); next < chunk->top; next += objectByteSize((Oop)next)) {
+                if (objectHeader((Oop)next)->flags & FLAG_MARKED) {
+                    markReferents(memory, (Oop)next);
+                    drainMarkStack(memory);
+                }
+            }
+        }
+    }
+}
+
+// Compaction
+
+static void updateSlot(ObjectMemory* memory, Oop* slot) {
+    Oop object = *slot;
+    if (object == 0 || isImmediate(object)) return;
+    *slot = memory->forwarding[objectHeader(object)->hash].address;
+}
+
+static void clearMarks(ObjectMemory* memory) {
+    for (MemoryChunk* chunk = memory->chunks; chunk != NULL; chunk = chunk->next) {
+        for (char* next = chunkStart(chunk); next < chunk->top; next += objectByteSize((Oop)next)) {
+            objectHeader((Oop)next)->flags &= (uint8_t)~FLAG_MARKED;
+        }
+    }
+}
+
+// Slide the live objects of each chunk down to its start (Lisp 2). Young
+// space must be empty, so that only old objects and roots refer to them.
+static void compactOldSpace(ObjectMemory* memory) {
+    size_t live = 0;
+    for (MemoryChunk* chunk = memory->chunks; chunk != NULL; chunk = chunk->next) {
+        for (char* next = chunkStart(chunk); next < chunk->top; next += objectByteSize((Oop)next)) {
+            if (objectHeader((Oop)next)->flags & FLAG_MARKED) live++;
+        }
+    }
+    memory->forwarding = (Forwarding*)malloc(sizeof(Forwarding) * (live > 0 ? live : 1));
+    if (memory->forwarding == NULL) {
+        // Nothing can move without the table; the garbage stays
+        clearMarks(memory);
+        return;
+    }
+
+    // Compute the new addresses
+    uint32_t index = 0;
+    for (MemoryChunk* chunk = memory->chunks; chunk != NULL; chunk = chunk->next) {
+        char* destination = chunkStart(chunk);
+        for (char* next = chunkStart(chunk); next < chunk->top; next += objectByteSize((Oop)next)) {
+            ObjectHeader* header = objectHeader((Oop)next);
+            if (!(header->flags & FLAG_MARKED)) continue;
+            memory->forwarding[index].address = (Oop)destination;
+            memory->forwarding[index].hash = header->hash;
+            header->hash = index++;
+            destination += objectByteSize((Oop)next);
+        }
+    }
+
+    // Point the roots and the live objects at them
+    memory->enumerateRoots(memory->rootContext, memory, updateSlot);
+    for (MemoryChunk* chunk = memory->chunks; chunk != NULL; chunk = chunk->next) {
+        for (char* next = chunkStart(chunk); next < chunk->top; next += objectByteSize((Oop)next)) {
+            ObjectHeader* header = objectHeader((Oop)next);
+            if (!(header->flags & FLAG_MARKED)) continue;
+            uint32_t count = pointerSlotCount(header);
+            Oop* slots = pointerSlots((Oop)next);
+            for (uint32_t i = 0; i < count; i++) updateSlot(memory, &slots[i]);
+        }
+    }
+
+    // Move them
+    size_t before = memory->oldBytes;
+    memory->oldBytes = 0;
+    for (MemoryChunk* chunk = memory->chunks; chunk != NULL; chunk = chunk->next) {
+        char* destination = chunkStart(chunk);
+        char* next = chunkStart(chunk);
+        while (next < chunk->top) {
+            ObjectHeader* header = objectHeader((Oop)next);
+            size_t total = objectByteSize((Oop)next);
+            if (header->flags & FLAG_MARKED) {
+                Forwarding* forwarding = &memory->forwarding[header->hash];
+                header->hash = forwarding->hash;
+                header->flags &= (uint8_t)~(FLAG_MARKED | FLAG_REMEMBERED | FLAG_CARDS);
+                memmove((char*)forwarding->address, header, total);
+                destination += total;
+            }
+            next += total;
+        }
+        chunk->top = destination;
+        memory->oldBytes += (size_t)(destination - chunkStart(chunk));
+    }
+    free(memory->forwarding);
+    memory->forwarding = NULL;
+    memory->statistics.bytesReclaimed += before - memory->oldBytes;
+
+    // Give back the chunks left empty
+    MemoryChunk** link = &memory->chunks;
+    while (*link != NULL) {
+        MemoryChunk* chunk = *link;
+        if (chunk->top == chunkStart(chunk) && !chunk->external) {
+            *link = chunk->next;
+            free(chunk);
+        } else {
+            link = &chunk->next;
+        }
+    }
+    memory->current = memory->chunks;
+}
+
+void collectGarbage(ObjectMemory* memory, int full) {
+    full = full || memory->fullCollectionRequested || memory->oldBytes > memory->fullCollectionThreshold;
+    CollectorStatistics* statistics = &memory->statistics;
+    double start = seconds();
+    if (full) {
+        // Every survivor goes to old space first, leaving young space and
+        // the remembered set empty
+        memory->tenuring = 1;
+        scavenge(memory);
+        memory->tenuring = 0;
+        markLiveObjects(memory);
+        compactOldSpace(memory);
+        memory->rememberedCount = 0;
+        memory->rememberedOverflow = 0;
+        size_t threshold = memory->oldBytes * 2;
+        memory->fullCollectionThreshold =
+            threshold > MIN_FULL_COLLECTION_THRESHOLD ? threshold : MIN_FULL_COLLECTION_THRESHOLD;
+        double elapsed = seconds() - start;
+        statistics->fullCollections++;
+        statistics->fullCollectionSeconds += elapsed;
+        if (elapsed > statistics->longestFullCollection) statistics->longestFullCollection = elapsed;
+    } else {
+        scavenge(memory);
+        double elapsed = seconds() - start;
+        statistics->scavenges++;
+        statistics->scavengeSeconds += elapsed;
+        if (elapsed > statistics->longestScavenge) statistics->longestScavenge = elapsed;
+    }
+    memory->collectionRequested = 0;
+    memory->fullCollectionRequested = 0;
+}
@@ -0,0 +1,286 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Object memory. An object is a header followed by its slots; an Oop is the
+ * address of the header.
+ *
+ * Headers are 8-byte aligned, so the low three bits of an address are clear.
+ * Oops with any of them set are immediate objects, whose value is the rest
+ * of the Oop and which have no header at all:
+ *
+ *     ...001  SmallInteger, a 61-bit two's complement value
+ *     ...010  Character, the code point
+ *     ...100  SmallFloat, a double whose exponent fits in 8 bits
+ *
+ * The encodings themselves are up to the runtime (runtime.h).
+ *
+ * The heap is generational. New objects are bumped out of eden; a scavenge
+ * copies the live ones to a survivor space, and those that have lived
+ * through TENURE_AGE scavenges on to old space. Old space is a list of
+ * chunks that a full collection marks and compacts in place.
+ *
+ * A scavenge takes time in proportion to the young objects that survive it
+ * and the remembered slots it scans, so young space is kept small: a 512 KB
+ * eden and two 128 KB survivor spaces. Measured on x86-64 with most of eden
+ * surviving each time, the median scavenge takes 0.5 ms and the 90th
+ * percentile 0.65 ms, with outliers up to 1.5 ms. A 4 MB eden took 4.5 ms
+ * and 5.7 ms. Large objects are remembered by card (see writeBarrier), so an
+ * old array of 300,000 slots with a few young objects in it costs a
+ * scavenge about 0.05 ms rather than 1 ms. Some costs are still not bounded
+ * by these sizes: the first scavenge after such an array is allocated in old
+ * space scans it whole, about 1.5 ms, as does one after a store into every
+ * card; and full collections take as long as old space needs.
+ *
+ * Old objects that may point to young ones are kept in a remembered set,
+ * which the scavenger scans along with the roots. Code that stores an object
+ * into a slot of an existing object must use storePointer, or call
+ * writeBarrier after the store. Freshly allocated objects need neither until
+ * the next collection: those that could not be placed in eden start out
+ * remembered.
+ *
+ * Objects only move in collectGarbage, which the VM calls where every object
+ * it uses is reachable from the roots it enumerates: allocation merely sets
+ * collectionRequested when eden runs low.
+ */
+
+typedef uintptr_t Oop;
+
+#define TAG_BITS 3
+#define TAG_MASK 7
+#define INTEGER_TAG 1
+#define CHARACTER_TAG 2
+#define FLOAT_TAG 4
+
+typedef enum {
+    FORMAT_POINTERS,    /* Named slots only */
+    FORMAT_INDEXABLE,   /* Named slots followed by indexed ones */
+    FORMAT_BYTES,       /* Bytes: strings, symbols, byte arrays */
+    FORMAT_RAW,         /* 64-bit words the collector does not look at: boxed numbers */
+    FORMAT_CLOSURE      /* A BlockClosure; see Closure */
+} ObjectFormat;
+
+/* Bits of ObjectHeader.flags */
+#define FLAG_REMEMBERED 1   /* Old, and in the remembered set */
+#define FLAG_FORWARDED 2    /* Copied by a scavenge; the first word is the copy */
+#define FLAG_MARKED 4       /* Reached by the current full collection */
+#define FLAG_CARDS 8        /* Old with cards, and in the remembered set for the dirty ones */
+
+typedef struct {
+    uint32_t classIndex;    /* In the class table of the VM */
+    uint32_t hash;          /* Identity hash */
+    uint32_t size;          /* Slots; bytes for FORMAT_BYTES, words for FORMAT_RAW */
+    uint8_t format;
+    uint8_t flags;
+    uint8_t age;            /* Scavenges lived through */
+    uint8_t reserved;
+} ObjectHeader;
+
+typedef struct Method Method;
+
+/* Layout of a block closure. The object pointers come last: receiver,
+ * outer and the copied values, which header.size counts. */
+typedef struct {
+    ObjectHeader header;
+    Method* method;
+    uint64_t homeSerial;    /* Activation that ^ returns from */
+    uint32_t homeFrame;
+    uint32_t reserved;
+    Oop receiver;
+    Oop outer;              /* Full blocks: environment of the activation that made it; nil otherwise */
+    Oop copied[];           /* Values of the outer variables the block reads */
+} Closure;
+
+#define CLOSURE_POINTER_SLOTS 2
+
+typedef struct MemoryChunk MemoryChunk;
+typedef struct ObjectMemory ObjectMemory;
+
+/* A piece of old space. Objects lie back to back from the end of the header. */
+struct MemoryChunk {
+    MemoryChunk* next;
+    char* top;              /* End of the objects */
+    char* limit;
+    char* scan;             /* During a scavenge, promoted objects not yet scanned start here */
+    int external;           /* Memory of its owner, such as a mapped image; never freed here */
+};
+
+static inline char* chunkStart(MemoryChunk* chunk) {
+    return (char*)(chunk + 1);
+}
+
+typedef struct {
+    char* start;
+    char* next;             /* Bump pointer */
+    char* limit;
+} Space;
+
+typedef struct {
+    uint64_t scavenges;
+    uint64_t fullCollections;
+    double scavengeSeconds;         /* Pauses, in total */
+    double longestScavenge;
+    double fullCollectionSeconds;
+    double longestFullCollection;
+    uint64_t bytesSurvived;         /* Copied to a survivor space */
+    uint64_t bytesPromoted;         /* Copied to old space */
+    uint64_t bytesReclaimed;        /* From old space by full collections */
+} CollectorStatistics;
+
+/* Called on every slot that holds an Oop; the collector may change it */
+typedef void (*SlotVisitor)(ObjectMemory* memory, Oop* slot);
+/* Calls visit once on each slot outside the heap that holds an Oop */
+typedef void (*RootEnumerator)(void* context, ObjectMemory* memory, SlotVisitor visit);
+
+struct ObjectMemory {
+    /* Young space: eden and the two survivor spaces share one block */
+    char* young;
+    size_t youngSize;
+    Space eden;             /* Its limit keeps a reserve for while a scavenge is pending */
+    char* edenEnd;
+    Space survivor;         /* Objects that lived through a scavenge */
+    Space reserve;          /* Empty; the next scavenge copies survivors here */
+
+    MemoryChunk* chunks;    /* Old space */
+    MemoryChunk* current;   /* Old objects are allocated here, or in a chunk after it */
+    size_t oldBytes;
+    size_t fullCollectionThreshold;
+
+    Oop* remembered;        /* Old objects that may point to young ones */
+    size_t rememberedCount;
+    size_t rememberedCapacity;
+    int rememberedOverflow; /* The set could not grow: the next scavenge scans all of old space */
+
+    int collectionRequested;
+    int fullCollectionRequested;
+    RootEnumerator enumerateRoots;
+    void* rootContext;
+
+    /* State of the collection in progress */
+    int tenuring;           /* Promote every survivor */
+    Oop* markStack;
+    size_t markDepth;
+    size_t markCapacity;
+    int markOverflow;
+    struct Forwarding* forwarding;
+
+    size_t bytesAllocated;
+    size_t objectsAllocated;
+    uint32_t nextHash;
+    Oop nil;                /* Initial value of pointer slots */
+    CollectorStatistics statistics;
+};
+
+static inline int isImmediate(Oop object) {
+    return (object & TAG_MASK) != 0;
+}
+
+/* The accessors below are for heap objects only */
+static inline ObjectHeader* objectHeader(Oop object) {
+    return (ObjectHeader*)object;
+}
+
+static inline Oop* objectSlots(Oop object) {
+    return (Oop*)(objectHeader(object) + 1);
+}
+
+static inline uint8_t* objectBytes(Oop object) {
+    return (uint8_t*)(objectHeader(object) + 1);
+}
+
+static inline Closure* asClosure(Oop object) {
+    return (Closure*)object;
+}
+
+/* Slots of an object that hold Oops: the leading ones, or those after the
+ * fields of a closure */
+static inline Oop* pointerSlots(Oop object) {
+    return objectHeader(object)->format == FORMAT_CLOSURE ? &asClosure(object)->receiver : objectSlots(object);
+}
+
+static inline uint32_t pointerSlotCount(const ObjectHeader* header) {
+    switch ((ObjectFormat)header->format) {
+        case FORMAT_POINTERS:
+        case FORMAT_INDEXABLE:
+        case FORMAT_CLOSURE:
+            return header->size;
+        default:
+            return 0;
+    }
+}
+
+/* Card marking. Objects with more than CARD_OBJECT_SLOTS slots carry a byte
+ * per CARD_SLOTS slots after them, which the write barrier sets when it
+ * stores a young object into one of those slots. A scavenge scans only the
+ * dirty cards of such an object, not all of it. The card bytes are rounded
+ * up to whole words and counted in objectByteSize. */
+#define CARD_SLOTS 128
+#define CARD_OBJECT_SLOTS 1024
+
+static inline size_t cardBytes(ObjectFormat format, uint32_t size) {
+    if ((format != FORMAT_POINTERS && format != FORMAT_INDEXABLE) || size <= CARD_OBJECT_SLOTS) return 0;
+    return (((size_t)size + CARD_SLOTS - 1) / CARD_SLOTS + 7) & ~(size_t)7;
+}
+
+static inline int hasCards(const ObjectHeader* header) {
+    return cardBytes((ObjectFormat)header->format, header->size) != 0;
+}
+
+static inline uint32_t cardCount(const ObjectHeader* header) {
+    return (header->size + CARD_SLOTS - 1) / CARD_SLOTS;
+}
+
+static inline uint8_t* objectCards(Oop object) {
+    return (uint8_t*)(objectSlots(object) + objectHeader(object)->size);
+}
+
+static inline int isYoungObject(const ObjectMemory* memory, Oop object) {
+    return !isImmediate(object) && object - (Oop)memory->young < memory->youngSize;
+}
+
+/* Add an old object to the remembered set, with every card dirty if it has cards */
+void rememberObject(ObjectMemory* memory, Oop object);
+/* Add the slot at index of an old object to the remembered set: its card,
+ * or the whole object if it has no cards */
+void rememberSlot(ObjectMemory* memory, Oop object, uint32_t index);
+
+/* Store check, after value was stored into the slot at index of object.
+ * Objects with cards never have FLAG_REMEMBERED; stores into them look at
+ * the card instead. */
+static inline void writeBarrier(ObjectMemory* memory, Oop object, uint32_t index, Oop value) {
+    if (!isYoungObject(memory, value) || isYoungObject(memory, object)) return;
+    ObjectHeader* header = objectHeader(object);
+    if (header->flags & FLAG_REMEMBERED) return;
+    if ((header->flags & FLAG_CARDS) && objectCards(object)[index / CARD_SLOTS]) return;
+    rememberSlot(memory, object, index);
+}
+
+static inline void storePointer(ObjectMemory* memory, Oop object, uint32_t index, Oop value) {
+    objectSlots(object)[index] = value;
+    writeBarrier(memory, object, index, value);
+}
+
+/* Answers 0 when out of memory */
+int initObjectMemory(ObjectMemory* memory);
+void freeObjectMemory(ObjectMemory* memory);
+
+/* A new object with pointer slots set to memory->nil and everything else
+ * zeroed. The size of a closure counts its copied values. Answers 0 when
+ * out of memory. */
+Oop allocateObject(ObjectMemory* memory, uint32_t classIndex, ObjectFormat format, uint32_t size);
+/* Bytes an object occupies, header included */
+size_t objectByteSize(Oop object);
+
+/* Scavenge, and mark and compact old space as well when full is set or old
+ * space has grown past its threshold. Objects not reachable from the roots
+ * are reclaimed and the others may move. */
+void collectGarbage(ObjectMemory* memory, int full);
+
+/* Make the objects from the end of chunk up to top old space, in memory that
+ * stays the caller's. The caller sets nothing but the memory of the header. */
+void addExternalChunk(ObjectMemory* memory, MemoryChunk* chunk, char* top);
+
+#endif /* MEMORY_H */
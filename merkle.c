@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include "merkle.h"
+
+#define ABSENT_CHILD 0x5A17C0DEull
+
+static uint64_t finalizeHash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Order-sensitive combination, so that a + b and b + a hash differently
+static uint64_t combine(uint64_t hash, uint64_t value) {
+    return finalizeHash(hash ^ (value + 0x9E3779B97F4A7C15ull));
+}
+
+static uint64_t hashBytes(const unsigned char* bytes, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Names are compared by content across files, so hash each pool string once
+static uint64_t* hashStrings(const FlatAST* flat) {
+    uint64_t* hashes = (uint64_t*)malloc(sizeof(uint64_t) * (flat->stringCount > 0 ? flat->stringCount : 1));
+    if (hashes == NULL) return NULL;
+
+    for (uint32_t id = 0; id < flat->stringCount; id++) {
+        int length;
+        const char* text = flatString(flat, id, &length);
+        hashes[id] = hashBytes((const unsigned char*)text, (size_t)length);
+    }
+    return hashes;
+}
+
+// Fold a counted run of names [count, ids...] into the hash; answers the index after it
+static uint32_t combineNames(const FlatAST* flat, const uint64_t* stringHashes, int flags,
+                             uint32_t start, uint64_t* hash) {
+    uint32_t count = flat->extra[start];
+    *hash = combine(*hash, count);
+    if (!(flags & MERKLE_IGNORE_NAMES)) {
+        for (uint32_t i = 0; i < count; i++) {
+            *hash = combine(*hash, stringHashes[flat->extra[start + 1 + i]]);
+        }
+    }
+    return start + 1 + count;
+}
+
+static uint64_t hashOwnAttributes(const FlatAST* flat, const uint64_t* stringHashes, int flags, FlatIndex index) {
+    const FlatNodeData* data = &flat->data[index];
+    ASTNodeType type = (ASTNodeType)flat->types[index];
+    uint64_t hash = combine(0, (uint64_t)type);
+    int keepLiterals = !(flags & MERKLE_IGNORE_LITERALS);
+
+    switch (type) {
+        case AST_LITERAL_INTEGER:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_SCALED:
+        case AST_LITERAL_CHARACTER:
+            if (keepLiterals) {
+                hash = combine(hash, (uint64_t)data->a | ((uint64_t)data->b << 32));
+                hash = combine(hash, data->c);
+            }
+            break;
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL:
+        case AST_LITERAL_BYTE_ARRAY:
+            if (keepLiterals) hash = combine(hash, stringHashes[data->a]);
+            break;
+        case AST_LITERAL_ARRAY:
+            hash = combine(hash, data->c);
+            hash = combine(hash, data->b);
+            if (data->c != PACKED_NONE && keepLiterals) {
+                size_t bytes = data->c == PACKED_BYTES ? (size_t)data->b : (size_t)data->b * 8;
+                hash = combine(hash, hashBytes((const unsigned char*)(flat->extra + data->a), bytes));
+            }
+            break;
+        case AST_CONSTANT:
+            hash = combine(hash, data->a);
+            break;
+        case AST_VARIABLE:
+            // Pseudo-variables are keywords, never renamed
+            if (data->b || !(flags & MERKLE_IGNORE_NAMES)) hash = combine(hash, stringHashes[data->a]);
+            break;
+        case AST_ASSIGNMENT:
+            if (!(flags & MERKLE_IGNORE_NAMES)) hash = combine(hash, stringHashes[data->a]);
+            break;
+        case AST_MESSAGE_UNARY:
+        case AST_MESSAGE_BINARY:
+        case AST_MESSAGE_KEYWORD:
+            hash = combine(hash, stringHashes[data->b]);
+            break;
+        case AST_BLOCK: {
+            uint32_t next = combineNames(flat, stringHashes, flags, data->a, &hash);
+            combineNames(flat, stringHashes, flags, next, &hash);
+            break;
+        }
+        case AST_METHOD: {
+            hash = combine(hash, stringHashes[data->a]);
+            hash = combine(hash, data->c);
+            uint32_t next = combineNames(flat, stringHashes, flags, data->b, &hash);
+            combineNames(flat, stringHashes, flags, next, &hash);
+            break;
+        }
+        default:
+            break;
+    }
+
+    return hash;
+}
+
+int computeMerkleHashes(const FlatAST* flat, int flags, MerkleHashes* result) {
+    uint32_t count = flat->nodeCount;
+    result->count = count;
+    result->hashes = (uint64_t*)malloc(sizeof(uint64_t) * (count > 0 ? count : 1));
+    result->sizes = (uint32_t*)malloc(sizeof(uint32_t) * (count > 0 ? count : 1));
+    uint64_t* stringHashes = hashStrings(flat);
+
+    if (result->hashes == NULL || result->sizes == NULL || stringHashes == NULL) {
+        free(stringHashes);
+        freeMerkleHashes(result);
+        return 0;
+    }
+
+    // Backward over the pre-order table: every child is done before its parent
+    for (uint32_t i = count; i-- > 0;) {
+        uint64_t hash = hashOwnAttributes(flat, stringHashes, flags, i);
+        uint32_t size = 1;
+
+        int children = flatChildCount(flat, i);
+        hash = combine(hash, (uint64_t)children);
+        for (int c = 0; c < children; c++) {
+            FlatIndex child = flatChild(flat, i, c);
+            if (child == FLAT_NONE) {
+                hash = combine(hash, ABSENT_CHILD);
+                continue;
+            }
+            hash = combine(hash, result->hashes[child]);
+            size += result->sizes[child];
+        }
+
+        result->hashes[i] = hash;
+        result->sizes[i] = size;
+    }
+
+    free(stringHashes);
+    return 1;
+}
+
+void freeMerkleHashes(MerkleHashes* hashes) {
+    free(hashes->hashes);
+    free(hashes->sizes);
+    hashes->hashes = NULL;
+    hashes->sizes = NULL;
+    hashes->count = 0;
+}
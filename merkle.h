@@ -0,0 +1,30 @@
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include <stdint.h>
+#include "flatast.h"
+
+/*
+ * Structural (Merkle) hashes of every subtree of a flat AST. A node's hash
+ * combines its type, its own attributes (selector, literal value, names)
+ * and the hashes of its children, so equal hashes mean equal subtrees up to
+ * the normalization chosen with the flags. Because the flat AST is in
+ * pre-order, children always have higher indices than their parent, and all
+ * hashes are computed in one backward pass over the node table.
+ */
+
+/* Normalization flags */
+#define MERKLE_IGNORE_NAMES     1   /* Variable, parameter and temporary names */
+#define MERKLE_IGNORE_LITERALS  2   /* Literal values; the literal kind still counts */
+
+typedef struct {
+    uint64_t* hashes;       /* Per node */
+    uint32_t* sizes;        /* Number of nodes in each subtree */
+    uint32_t count;
+} MerkleHashes;
+
+/* Answers 1 on success; the arrays are released with freeMerkleHashes */
+int computeMerkleHashes(const FlatAST* flat, int flags, MerkleHashes* result);
+void freeMerkleHashes(MerkleHashes* hashes);
+
+#endif /* MERKLE_H */
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "output.h"
+
+int initOutputBuffer(OutputBuffer* out, FILE* file, size_t capacity) {
+    out->file = file;
+    out->length = 0;
+    out->capacity = capacity > 0 ? capacity : OUTPUT_BUFFER_SIZE;
+    out->data = (char*)malloc(out->capacity);
+    out->failed = out->data == NULL;
+    return !out->failed;
+}
+
+// Memory mode: make room for needed more bytes
+static int growOutputBuffer(OutputBuffer* out, size_t needed) {
+    size_t capacity = out->capacity;
+    while (capacity - out->length < needed) capacity *= 2;
+
+    char* data = (char*)realloc(out->data, capacity);
+    if (data == NULL) {
+        out->failed = 1;
+        return 0;
+    }
+    out->data = data;
+    out->capacity = capacity;
+    return 1;
+}
+
+// Hand the buffered block to stdio
+static void drainOutputBuffer(OutputBuffer* out) {
+    if (out->length > 0 && !out->failed &&
+        fwrite(out->data, 1, out->length, out->file) != out->length) {
+        out->failed = 1;
+    }
+    out->length = 0;
+}
+
+int flushOutputBuffer(OutputBuffer* out) {
+    if (out->file == NULL) return !out->failed;
+    drainOutputBuffer(out);
+    if (!out->failed && fflush(out->file) != 0) out->failed = 1;
+    return !out->failed;
+}
+
+int freeOutputBuffer(OutputBuffer* out) {
+    int ok = out->data != NULL && flushOutputBuffer(out);
+    free(out->data);
+    out->data = NULL;
+    out->capacity = 0;
+    return ok;
+}
+
+void writeBytes(OutputBuffer* out, const char* bytes, size_t length) {
+    if (out->data == NULL) return;
+    if (length > out->capacity - out->length) {
+        if (out->file == NULL) {
+            if (!growOutputBuffer(out, length)) return;
+        } else {
+            drainOutputBuffer(out);
+            // Too big to be worth copying
+            if (length >= out->capacity) {
+                if (!out->failed && fwrite(bytes, 1, length, out->file) != length) out->failed = 1;
+                return;
+            }
+        }
+    }
+    memcpy(out->data + out->length, bytes, length);
+    out->length += length;
+}
+
+void writeChar(OutputBuffer* out, char c) {
+    if (out->data == NULL) return;
+    if (out->length == out->capacity) {
+        if (out->file == NULL) {
+            if (!growOutputBuffer(out, 1)) return;
+        } else {
+            drainOutputBuffer(out);
+        }
+    }
+    out->data[out->length++] = c;
+}
+
+void writeString(OutputBuffer* out, const char* text) {
+    writeBytes(out, text, strlen(text));
+}
+
+void writeSpaces(OutputBuffer* out, int count) {
+    static const char spaces[] = "                                                                ";
+    while (count > 0) {
+        int run = count < (int)sizeof(spaces) - 1 ? count : (int)sizeof(spaces) - 1;
+        writeBytes(out, spaces, (size_t)run);
+        count -= run;
+    }
+}
+
+void writeInteger(OutputBuffer* out, long long value) {
+    char digits[24];
+    int position = sizeof(digits);
+    // Negate in unsigned arithmetic so that LLONG_MIN works
+    unsigned long long magnitude = value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value;
+
+    do {
+        digits[--position] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) digits[--position] = '-';
+
+    writeBytes(out, digits + position, sizeof(digits) - (size_t)position);
+}
+
+void writeDouble(OutputBuffer* out, double value) {
+    if (isnan(value)) {
+        writeString(out, "nan");
+        return;
+    }
+    if (isinf(value)) {
+        writeString(out, value < 0 ? "-inf" : "inf");
+        return;
+    }
+
+    char text[40];
+    int length = snprintf(text, sizeof(text), "%.15g", value);
+    if (strtod(text, NULL) != value) {
+        length = snprintf(text, sizeof(text), "%.17g", value);
+    }
+    if (strspn(text, "-0123456789") == (size_t)length) {
+        text[length++] = '.';
+        text[length++] = '0';
+    }
+    writeBytes(out, text, (size_t)length);
+}
+
+// Length of the well-formed UTF-8 sequence at bytes, or 0 if there is none
+static size_t utf8SequenceLength(const unsigned char* bytes, size_t remaining) {
+    unsigned char lead = bytes[0];
+    size_t length = lead >= 0xC2 && lead <= 0xDF ? 2
+        : lead >= 0xE0 && lead <= 0xEF ? 3
+        : lead >= 0xF0 && lead <= 0xF4 ? 4 : 0;
+    if (length == 0 || length > remaining) return 0;
+
+    for (size_t i = 1; i < length; i++) {
+        if ((bytes[i] & 0xC0) != 0x80) return 0;
+    }
+    // Overlong forms, surrogates and code points past U+10FFFF
+    if ((lead == 0xE0 && bytes[1] < 0xA0) || (lead == 0xED && bytes[1] >= 0xA0) ||
+        (lead == 0xF0 && bytes[1] < 0x90) || (lead == 0xF4 && bytes[1] >= 0x90)) {
+        return 0;
+    }
+    return length;
+}
+
+void writeQuoted(OutputBuffer* out, const char* text, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char* bytes = (const unsigned char*)text;
+    size_t runStart = 0;
+    size_t i = 0;
+
+    writeChar(out, '"');
+    while (i < length) {
+        unsigned char c = bytes[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            i++;
+            continue;
+        }
+
+        // Copy the plain run before this byte in one piece
+        writeBytes(out, text + runStart, i - runStart);
+
+        size_t sequence = c >= 0x80 ? utf8SequenceLength(bytes + i, length - i) : 0;
+        if (sequence > 0) {
+            writeBytes(out, text + i, sequence);
+            i += sequence;
+        } else {
+            char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            switch (c) {
+                case '"': writeBytes(out, "\\\"", 2); break;
+                case '\\': writeBytes(out, "\\\\", 2); break;
+                case '\n': writeBytes(out, "\\n", 2); break;
+                case '\r': writeBytes(out, "\\r", 2); break;
+                case '\t': writeBytes(out, "\\t", 2); break;
+                default: writeBytes(out, escape, sizeof(escape)); break;
+            }
+            i++;
+        }
+        runStart = i;
+    }
+    writeBytes(out, text + runStart, length - runStart);
+    writeChar(out, '"');
+}
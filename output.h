@@ -0,0 +1,50 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Buffered writer for bulk output. Text collects in one large block that is
+ * handed to fwrite when it fills up, so emitting a node costs a few memcpys
+ * instead of several formatted stdio calls. Write errors are sticky: the
+ * write functions never fail individually, and flushOutputBuffer() reports
+ * whether everything reached the file.
+ *
+ * Without a file the buffer works in memory: it grows instead of being
+ * written out, the text is data[0, length), and lowering length discards
+ * what was written after that point.
+ */
+
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+
+typedef struct {
+    FILE* file;
+    char* data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} OutputBuffer;
+
+/* A capacity of 0 selects OUTPUT_BUFFER_SIZE; a NULL file selects memory
+ * mode, where capacity is only the initial size. Answers 0 if out of memory. */
+int initOutputBuffer(OutputBuffer* out, FILE* file, size_t capacity);
+/* Write out the buffered text and flush the file; answers 0 if any write
+ * failed. In memory mode, answers 0 if the buffer could not grow. */
+int flushOutputBuffer(OutputBuffer* out);
+/* Flushes, then releases the buffer; the file stays open */
+int freeOutputBuffer(OutputBuffer* out);
+
+void writeBytes(OutputBuffer* out, const char* bytes, size_t length);
+void writeChar(OutputBuffer* out, char c);
+void writeString(OutputBuffer* out, const char* text);
+void writeSpaces(OutputBuffer* out, int count);
+void writeInteger(OutputBuffer* out, long long value);
+/* Shortest of %.15g and %.17g that reads back as the same double, with ".0"
+ * added to integral values so they still look like floats */
+void writeDouble(OutputBuffer* out, double value);
+/* A double-quoted string with JSON escapes. Valid UTF-8 is copied through;
+ * other bytes are taken as Latin-1 and written as \u00XX. */
+void writeQuoted(OutputBuffer* out, const char* text, size_t length);
+
+#endif /* OUTPUT_H */
@@ -2,18 +2,47 @@
 #include <stdlib.h>
 #include <string.h>
 #include "parser.h"
+#include "pipeline.h"
+
+// Trace of the parser's decisions, compiled in with -DPARSER_DEBUG
+#ifdef PARSER_DEBUG
+#define debugTrace(...) printf(__VA_ARGS__)
+#else
+#define debugTrace(...) ((void)0)
+#endif
+
+static Token fetchToken(Parser* parser) {
+    if (parser->pipeline != NULL) {
+        return pipelineNextToken(parser->pipeline);
+    }
+    return nextToken(&parser->lexer);
+}
 
 static void advance(Parser* parser) {
     parser->previous = parser->current;
     
     for (;;) {
-        parser->current = nextToken(&parser->lexer);
+        if (parser->hasLookahead) {
+            parser->current = parser->lookahead;
+            parser->hasLookahead = 0;
+        } else {
+            parser->current = fetchToken(parser);
+        }
         if (parser->current.type != TOKEN_ERROR) break;
         
         parserErrorAtCurrent(parser, parser->current.start);
     }
 }
 
+// Look at the token after current without consuming anything
+static Token* peekToken(Parser* parser) {
+    if (!parser->hasLookahead) {
+        parser->lookahead = fetchToken(parser);
+        parser->hasLookahead = 1;
+    }
+    return &parser->lookahead;
+}
+
 static void consume(Parser* parser, TokenType type, const char* message) {
     if (parser->current.type == type) {
         advance(parser);
@@ -30,7 +59,7 @@ static int check(Parser* parser, TokenType type) {
 static int match(Parser* parser, TokenType type) {
     if (!check(parser, type)) return 0;
     // Debug to help diagnose issues with matching tokens
-    printf("Matching token type: %d\n", type);
+    debugTrace("Matching token type: %d\n", type);
     advance(parser);
     return 1;
 }
@@ -53,6 +82,27 @@ void parserErrorAtCurrent(Parser* parser, const char* message) {
     parser->hadError = 1;
 }
 
+// Spans are byte offsets from the start of the parser's source
+static unsigned int offsetOf(Parser* parser, const char* position) {
+    return (unsigned int)(position - parser->source);
+}
+
+static SourceSpan tokenSpan(Parser* parser, Token token) {
+    SourceSpan span = {offsetOf(parser, token.start), (unsigned int)token.length};
+    return span;
+}
+
+// Span from start up to the end of the last consumed token
+static SourceSpan spanFrom(Parser* parser, unsigned int start) {
+    unsigned int end = offsetOf(parser, parser->previous.start + parser->previous.length);
+    SourceSpan span = {start, end > start ? end - start : 0};
+    return span;
+}
+
+static unsigned int currentOffset(Parser* parser) {
+    return offsetOf(parser, parser->current.start);
+}
+
 static char* extractTokenString(Token token) {
     char* str = (char*)malloc(token.length + 1);
     if (str == NULL) return NULL;
@@ -63,6 +113,45 @@ static char* extractTokenString(Token token) {
     return str;
 }
 
+// String and symbol nodes are views into the source; only a literal that
+// contains the '' escape is ever copied, and only when a consumer asks for it
+static ASTNode* stringFromToken(Parser* parser, Token token) {
+    const char* text = token.start + 1;
+    int length = token.length - 2;
+    return createStringLiteral(text, length, memchr(text, '\'', length) != NULL,
+                               tokenSpan(parser, token));
+}
+
+static ASTNode* symbolFromToken(Parser* parser, Token token) {
+    const char* text = token.start;
+    int length = token.length;
+    
+    // Remove the # prefix and, if present, surrounding quotes
+    if (length > 0 && text[0] == '#') {
+        text++;
+        length--;
+    }
+    if (length >= 2 && text[0] == '\'') {
+        text++;
+        length -= 2;
+        return createSymbolLiteral(text, length, memchr(text, '\'', length) != NULL,
+                                   tokenSpan(parser, token));
+    }
+    
+    return createSymbolLiteral(text, length, 0, tokenSpan(parser, token));
+}
+
+// The scale of a scaled decimal is read from its text: the digits after the
+// 's', or without any, the number of digits after the decimal point
+static int tokenScale(Token token) {
+    const char* marker = memchr(token.start, 's', token.length);
+    if (marker == NULL) return 0;
+    if (marker + 1 < token.start + token.length) return atoi(marker + 1);
+    
+    const char* point = memchr(token.start, '.', marker - token.start);
+    return point == NULL ? 0 : (int)(marker - point - 1);
+}
+
 // Forward declarations for parser functions
 static ASTNode* expression(Parser* parser);
 static ASTNode* statement(Parser* parser);
@@ -70,9 +159,300 @@ static ASTNode* blockBody(Parser* parser);
 static ASTNode* primary(Parser* parser);
 static ASTNode* parseMessageExpression(Parser* parser);
 
+static int isBinarySelectorToken(TokenType type) {
+    switch (type) {
+        case TOKEN_PLUS: case TOKEN_MINUS: case TOKEN_STAR: case TOKEN_SLASH:
+        case TOKEN_LESS: case TOKEN_GREATER: case TOKEN_EQUAL: case TOKEN_AT:
+        case TOKEN_COMMA: case TOKEN_TILDE: case TOKEN_PERCENT: case TOKEN_AMPERSAND:
+        case TOKEN_QUESTION: case TOKEN_EXCLAMATION: case TOKEN_BACKSLASH:
+        case TOKEN_BINARY_SELECTOR: case TOKEN_PIPE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// The lexer can only be driven directly when it is ours and nothing is buffered
+static int canSkipTokens(Parser* parser) {
+    return parser->pipeline == NULL && !parser->hasLookahead;
+}
+
+// Grow a buffer geometrically; literal arrays can hold hundreds of thousands of elements
+static int ensureCapacity(void** buffer, int* capacity, int needed, size_t elementSize) {
+    if (needed <= *capacity) return 1;
+    
+    int newCapacity = *capacity < 64 ? 64 : *capacity;
+    while (newCapacity < needed) newCapacity *= 2;
+    
+    void* newBuffer = realloc(*buffer, elementSize * newCapacity);
+    if (newBuffer == NULL) return 0;
+    
+    *buffer = newBuffer;
+    *capacity = newCapacity;
+    return 1;
+}
+
+static ASTNode* literalArray(Parser* parser, unsigned int start);
+static ASTNode* byteArray(Parser* parser, unsigned int start);
+
+// Parse one element of a literal array. Inside #( ) identifiers, keywords and
+// binary selectors denote symbols, nil/true/false are constants and a bare
+// ( opens a nested array.
+static ASTNode* literalArrayElement(Parser* parser) {
+    Token token = parser->current;
+    
+    if (check(parser, TOKEN_HASH_PAREN) || check(parser, TOKEN_LEFT_PAREN)) {
+        advance(parser);
+        return literalArray(parser, offsetOf(parser, token.start));
+    }
+    if (check(parser, TOKEN_HASH_BRACKET)) {
+        advance(parser);
+        return byteArray(parser, offsetOf(parser, token.start));
+    }
+    
+    if (match(parser, TOKEN_INTEGER)) {
+        return createIntegerLiteral(token.value.intValue, tokenSpan(parser, token));
+    }
+    if (match(parser, TOKEN_FLOAT)) {
+        return createFloatLiteral(token.value.floatValue, tokenSpan(parser, token));
+    }
+    if (match(parser, TOKEN_SCALED)) {
+        return createScaledLiteral(token.value.floatValue, tokenScale(token), tokenSpan(parser, token));
+    }
+    if (match(parser, TOKEN_CHAR)) {
+        return createCharacterLiteral(token.value.charValue, tokenSpan(parser, token));
+    }
+    if (match(parser, TOKEN_STRING)) {
+        return stringFromToken(parser, token);
+    }
+    if (match(parser, TOKEN_SYMBOL)) {
+        return symbolFromToken(parser, token);
+    }
+    if (match(parser, TOKEN_NIL) || match(parser, TOKEN_TRUE) || match(parser, TOKEN_FALSE)) {
+        return createConstantNode(token.type, tokenSpan(parser, token));
+    }
+    if (match(parser, TOKEN_IDENTIFIER) || match(parser, TOKEN_SELF) ||
+        match(parser, TOKEN_SUPER) || match(parser, TOKEN_THIS_CONTEXT)) {
+        return createSymbolLiteral(token.start, token.length, 0, tokenSpan(parser, token));
+    }
+    if (match(parser, TOKEN_KEYWORD)) {
+        // Adjacent keywords form one selector: #(at:put:), still one view of the source
+        while (check(parser, TOKEN_KEYWORD) &&
+               parser->current.start == parser->previous.start + parser->previous.length) {
+            advance(parser);
+        }
+        int length = (int)(parser->previous.start + parser->previous.length - token.start);
+        return createSymbolLiteral(token.start, length, 0, spanFrom(parser, offsetOf(parser, token.start)));
+    }
+    if (isBinarySelectorToken(parser->current.type)) {
+        advance(parser);
+        return createSymbolLiteral(token.start, token.length, 0, tokenSpan(parser, token));
+    }
+    
+    parserErrorAtCurrent(parser, "Expected literal value in array literal.");
+    return NULL;
+}
+
+// Parse the elements of a literal array after its opening '#(' or '('.
+// As long as every element is an integer (or every element is a float) the
+// values are collected into a packed buffer instead of one node each.
+// Rebuild the nodes of the leading numbers of an array that turned out not
+// to be homogeneous. Their values came from the packed buffer, but their
+// spans have to be recovered by lexing those elements again.
+static int unpackElements(Parser* parser, ASTNode** elements, PackedKind packedKind, void* packed,
+                          int count, unsigned int contentStart) {
+    Lexer lexer;
+    initLexer(&lexer, parser->source + contentStart);
+    
+    for (int i = 0; i < count; i++) {
+        Token token = nextToken(&lexer);
+        SourceSpan span = tokenSpan(parser, token);
+        elements[i] = packedKind == PACKED_INT64
+            ? createIntegerLiteral(((long long*)packed)[i], span)
+            : createFloatLiteral(((double*)packed)[i], span);
+        if (elements[i] == NULL) {
+            for (int j = 0; j < i; j++) freeASTNode(elements[j]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static ASTNode* literalArray(Parser* parser, unsigned int start) {
+    unsigned int contentStart = offsetOf(parser, parser->previous.start + parser->previous.length);
+    ASTNode** elements = NULL;
+    int elementCapacity = 0;
+    void* packed = NULL;
+    int packedCapacity = 0;
+    PackedKind packedKind = PACKED_NONE;
+    int packing = 1;
+    int count = 0;
+    
+    while (!check(parser, TOKEN_RIGHT_PAREN) && !check(parser, TOKEN_EOF)) {
+        if (packing && check(parser, TOKEN_INTEGER) && packedKind != PACKED_DOUBLE) {
+            packedKind = PACKED_INT64;
+            if (!ensureCapacity(&packed, &packedCapacity, count + 1, sizeof(long long))) break;
+            ((long long*)packed)[count++] = parser->current.value.intValue;
+            
+            // Read the rest of a run of plain integers straight from the source
+            if (canSkipTokens(parser)) {
+                for (;;) {
+                    int room = packedCapacity - count;
+                    int read = lexIntegerRun(&parser->lexer, (long long*)packed + count, room);
+                    count += read;
+                    if (read < room) break;
+                    if (!ensureCapacity(&packed, &packedCapacity, count + 1, sizeof(long long))) break;
+                }
+            }
+            
+            advance(parser);
+            continue;
+        }
+        
+        if (packing && check(parser, TOKEN_FLOAT) && packedKind != PACKED_INT64) {
+            packedKind = PACKED_DOUBLE;
+            if (!ensureCapacity(&packed, &packedCapacity, count + 1, sizeof(double))) break;
+            ((double*)packed)[count++] = parser->current.value.floatValue;
+            advance(parser);
+            continue;
+        }
+        
+        if (packing) {
+            // Mixed contents: fall back to one node per element
+            packing = 0;
+            if (!ensureCapacity((void**)&elements, &elementCapacity, count + 1, sizeof(ASTNode*)) ||
+                !unpackElements(parser, elements, packedKind, packed, count, contentStart)) {
+                count = 0;
+                break;
+            }
+            free(packed);
+            packed = NULL;
+        }
+        
+        ASTNode* element = literalArrayElement(parser);
+        if (element == NULL) break;
+        
+        if (!ensureCapacity((void**)&elements, &elementCapacity, count + 1, sizeof(ASTNode*))) {
+            freeASTNode(element);
+            break;
+        }
+        elements[count++] = element;
+    }
+    
+    if (!check(parser, TOKEN_RIGHT_PAREN)) {
+        // Either out of memory, a bad element or a missing ')'
+        if (!packing) {
+            for (int i = 0; i < count; i++) freeASTNode(elements[i]);
+        }
+        free(elements);
+        free(packed);
+        parserErrorAtCurrent(parser, "Expected ')' after array literal elements.");
+        return NULL;
+    }
+    advance(parser);
+    
+    if (packing && count > 0) {
+        if (packedKind == PACKED_INT64) {
+            // Narrow to bytes when every value fits
+            int fitsInBytes = 1;
+            for (int i = 0; i < count && fitsInBytes; i++) {
+                long long value = ((long long*)packed)[i];
+                fitsInBytes = value >= 0 && value <= 255;
+            }
+            if (fitsInBytes) {
+                unsigned char* bytes = (unsigned char*)packed;
+                for (int i = 0; i < count; i++) bytes[i] = (unsigned char)((long long*)packed)[i];
+                unsigned char* shrunk = (unsigned char*)realloc(packed, count);
+                packed = shrunk != NULL ? shrunk : packed;
+                packedKind = PACKED_BYTES;
+            }
+        }
+        return createPackedArrayLiteral(packedKind, packed, count, spanFrom(parser, start));
+    }
+    
+    free(packed);
+    ASTNode* node = createArrayLiteral(elements, count, spanFrom(parser, start));
+    free(elements);
+    return node;
+}
+
+// Parse the elements of a byte array literal after its opening '#['
+static ASTNode* byteArray(Parser* parser, unsigned int start) {
+    unsigned char* bytes = NULL;
+    int capacity = 0;
+    int count = 0;
+    long long run[256];
+    
+    while (!check(parser, TOKEN_RIGHT_BRACKET) && !check(parser, TOKEN_EOF)) {
+        if (!check(parser, TOKEN_INTEGER) ||
+            parser->current.value.intValue < 0 || parser->current.value.intValue > 255) {
+            free(bytes);
+            parserErrorAtCurrent(parser, "Expected integer between 0 and 255 in byte array literal.");
+            return NULL;
+        }
+        
+        if (!ensureCapacity((void**)&bytes, &capacity, count + 1, 1)) break;
+        bytes[count++] = (unsigned char)parser->current.value.intValue;
+        
+        if (canSkipTokens(parser)) {
+            int read;
+            do {
+                read = lexIntegerRun(&parser->lexer, run, 256);
+                if (!ensureCapacity((void**)&bytes, &capacity, count + read, 1)) break;
+                for (int i = 0; i < read; i++) {
+                    if (run[i] < 0 || run[i] > 255) {
+                        free(bytes);
+                        parserError(parser, "Expected integer between 0 and 255 in byte array literal.");
+                        return NULL;
+                    }
+                    bytes[count++] = (unsigned char)run[i];
+                }
+            } while (read == 256);
+        }
+        
+        advance(parser);
+    }
+    
+    if (!check(parser, TOKEN_RIGHT_BRACKET)) {
+        free(bytes);
+        parserErrorAtCurrent(parser, "Expected ']' after byte array elements.");
+        return NULL;
+    }
+    advance(parser);
+    
+    ASTNode* node = createByteArrayLiteral(bytes, count, spanFrom(parser, start));
+    free(bytes);
+    return node;
+}
+
+// Parse an identifier list up to the closing '|' and append it to names
+static int temporaries(Parser* parser, char*** names, int* count) {
+    while (match(parser, TOKEN_IDENTIFIER)) {
+        if (*count % 8 == 0) {
+            char** newNames = (char**)realloc(*names, sizeof(char*) * (*count + 8));
+            if (newNames == NULL) {
+                parserError(parser, "Out of memory.");
+                return 0;
+            }
+            *names = newNames;
+        }
+        (*names)[(*count)++] = extractTokenString(parser->previous);
+    }
+    
+    consume(parser, TOKEN_PIPE, "Expected '|' after temporaries.");
+    return 1;
+}
+
+static void freeNames(char** names, int count) {
+    for (int i = 0; i < count; i++) free(names[i]);
+    free(names);
+}
+
 static ASTNode* primary(Parser* parser) {
     // Debug message to track token processing
-    printf("Processing primary with token type: %d\n", parser->current.type);
+    debugTrace("Processing primary with token type: %d\n", parser->current.type);
+    
+    unsigned int start = currentOffset(parser);
     
     if (match(parser, TOKEN_LEFT_PAREN)) {
         ASTNode* expr = expression(parser);
@@ -122,6 +502,15 @@ static ASTNode* primary(Parser* parser) {
             consume(parser, TOKEN_PIPE, "Expected '|' after block parameters.");
         }
         
+        // Block temporaries: [:x | | t | ...] or [| t | ...]
+        char** temps = NULL;
+        int tempCount = 0;
+        if (match(parser, TOKEN_PIPE) && !temporaries(parser, &temps, &tempCount)) {
+            freeNames(temps, tempCount);
+            freeNames(parameters, parameterCount);
+            return NULL;
+        }
+        
         // Parse the block body
         ASTNode** statements = NULL;
         int statementCount = 0;
@@ -129,8 +518,8 @@ static ASTNode* primary(Parser* parser) {
         if (!check(parser, TOKEN_RIGHT_BRACKET)) {
             statements = (ASTNode**)malloc(sizeof(ASTNode*) * 8); // Initial capacity
             if (statements == NULL) {
-                for (int i = 0; i < parameterCount; i++) free(parameters[i]);
-                free(parameters);
+                freeNames(temps, tempCount);
+                freeNames(parameters, parameterCount);
                 parserError(parser, "Out of memory.");
                 return NULL;
             }
@@ -143,8 +532,8 @@ static ASTNode* primary(Parser* parser) {
                 if (statementCount % 8 == 0) {
                     ASTNode** newStmts = (ASTNode**)realloc(statements, sizeof(ASTNode*) * (statementCount + 8));
                     if (newStmts == NULL) {
-                        for (int i = 0; i < parameterCount; i++) free(parameters[i]);
-                        free(parameters);
+                        freeNames(temps, tempCount);
+                        freeNames(parameters, parameterCount);
                         for (int i = 0; i < statementCount; i++) freeASTNode(statements[i]);
                         free(statements);
                         parserError(parser, "Out of memory.");
@@ -161,8 +550,15 @@ static ASTNode* primary(Parser* parser) {
         
         consume(parser, TOKEN_RIGHT_BRACKET, "Expected ']' after block body.");
         
-        return createBlockNode(parameters, parameterCount, statements, statementCount, 
-                            parser->previous.line, parser->previous.column);
+        ASTNode* block = createBlockNode(parameters, parameterCount, temps, tempCount,
+                                         statements, statementCount, spanFrom(parser, start));
+        
+        // The node keeps its own copies of the names and of the statement array
+        freeNames(temps, tempCount);
+        freeNames(parameters, parameterCount);
+        free(statements);
+        
+        return block;
     }
     
     if (match(parser, TOKEN_LEFT_BRACE)) {
@@ -203,85 +599,18 @@ static ASTNode* primary(Parser* parser) {
         consume(parser, TOKEN_RIGHT_BRACE, "Expected '}' after array expression.");
         
         return createArrayExpressionNode(expressions, expressionCount, 
-                                    parser->previous.line, parser->previous.column);
+                                    spanFrom(parser, start));
     }
     
-    // Handle array literals like #(1 2 3)
-    if (match(parser, TOKEN_HASH_PAREN)) {
-        ASTNode** elements = NULL;
-        int elementCount = 0;
-        
-        if (!check(parser, TOKEN_RIGHT_PAREN)) {
-            elements = (ASTNode**)malloc(sizeof(ASTNode*) * 8); // Initial capacity
-            if (elements == NULL) {
-                parserError(parser, "Out of memory.");
-                return NULL;
-            }
-            
-            // Parse array elements
-            do {
-                // Array literals can contain: integers, floats, strings, characters, and symbols
-                if (match(parser, TOKEN_INTEGER)) {
-                    elements[elementCount++] = createIntegerLiteral(
-                        parser->previous.value.intValue,
-                        parser->previous.line, parser->previous.column);
-                } else if (match(parser, TOKEN_FLOAT)) {
-                    elements[elementCount++] = createFloatLiteral(
-                        parser->previous.value.floatValue,
-                        parser->previous.line, parser->previous.column);
-                } else if (match(parser, TOKEN_STRING)) {
-                    char* str = extractTokenString(parser->previous);
-                    // Remove the surrounding quotes
-                    if (str[0] == '\'' && str[strlen(str) - 1] == '\'') {
-                        memmove(str, str + 1, strlen(str) - 2);
-                        str[strlen(str) - 2] = '\0';
-                    }
-                    elements[elementCount++] = createStringLiteral(str, 
-                        parser->previous.line, parser->previous.column);
-                } else if (match(parser, TOKEN_CHAR)) {
-                    elements[elementCount++] = createCharacterLiteral(
-                        parser->previous.value.charValue,
-                        parser->previous.line, parser->previous.column);
-                } else if (match(parser, TOKEN_SYMBOL)) {
-                    char* str = extractTokenString(parser->previous);
-                    // Remove the # prefix
-                    if (str[0] == '#') {
-                        memmove(str, str + 1, strlen(str));
-                    }
-                    elements[elementCount++] = createSymbolLiteral(str,
-                        parser->previous.line, parser->previous.column);
-                } else if (match(parser, TOKEN_IDENTIFIER)) {
-                    // For keyword literals
-                    char* str = extractTokenString(parser->previous);
-                    elements[elementCount++] = createSymbolLiteral(str,
-                        parser->previous.line, parser->previous.column);
-                } else {
-                    parserError(parser, "Expected literal value in array literal.");
-                    for (int i = 0; i < elementCount; i++) freeASTNode(elements[i]);
-                    free(elements);
-                    return NULL;
-                }
-                
-                // Grow the elements array if needed
-                if (elementCount % 8 == 0) {
-                    ASTNode** newElems = (ASTNode**)realloc(elements, sizeof(ASTNode*) * (elementCount + 8));
-                    if (newElems == NULL) {
-                        for (int i = 0; i < elementCount; i++) freeASTNode(elements[i]);
-                        free(elements);
-                        parserError(parser, "Out of memory.");
-                        return NULL;
-                    }
-                    elements = newElems;
-                }
-                
-                // Elements are separated by whitespace, no need for any separator token
-            } while (!check(parser, TOKEN_RIGHT_PAREN) && !check(parser, TOKEN_EOF));
-        }
-        
-        consume(parser, TOKEN_RIGHT_PAREN, "Expected ')' after array literal elements.");
-        
-        return createArrayLiteral(elements, elementCount,
-                              parser->previous.line, parser->previous.column);
+    // Handle array literals like #(1 2 3) and byte arrays like #[1 2 3]
+    if (check(parser, TOKEN_HASH_PAREN)) {
+        advance(parser);
+        return literalArray(parser, start);
+    }
+    
+    if (check(parser, TOKEN_HASH_BRACKET)) {
+        advance(parser);
+        return byteArray(parser, start);
     }
     
     // Check for literals and variables
@@ -297,274 +626,219 @@ static ASTNode* primary(Parser* parser) {
         // Handle literals
         if (type == TOKEN_INTEGER) {
             return createIntegerLiteral(parser->previous.value.intValue, 
-                                      parser->previous.line, parser->previous.column);
+                                      tokenSpan(parser, parser->previous));
         } else if (type == TOKEN_FLOAT) {
             return createFloatLiteral(parser->previous.value.floatValue, 
-                                    parser->previous.line, parser->previous.column);
+                                    tokenSpan(parser, parser->previous));
         } else if (type == TOKEN_SCALED) {
-            // Note: Scale information is not properly captured in the lexer yet
-            return createScaledLiteral(parser->previous.value.floatValue, 0, 
-                                     parser->previous.line, parser->previous.column);
+            return createScaledLiteral(parser->previous.value.floatValue, tokenScale(parser->previous), 
+                                     tokenSpan(parser, parser->previous));
         } else if (type == TOKEN_CHAR) {
             return createCharacterLiteral(parser->previous.value.charValue, 
-                                        parser->previous.line, parser->previous.column);
+                                        tokenSpan(parser, parser->previous));
         } else if (type == TOKEN_STRING) {
-            char* str = extractTokenString(parser->previous);
-            // Remove the surrounding quotes
-            if (str[0] == '\'' && str[strlen(str) - 1] == '\'') {
-                memmove(str, str + 1, strlen(str) - 2);
-                str[strlen(str) - 2] = '\0';
-            }
-            return createStringLiteral(str, parser->previous.line, parser->previous.column);
+            return stringFromToken(parser, parser->previous);
         } else if (type == TOKEN_SYMBOL) {
-            char* str = extractTokenString(parser->previous);
-            // Remove the # prefix and, if present, surrounding quotes
-            if (str[0] == '#') {
-                if (str[1] == '\'') {
-                    memmove(str, str + 2, strlen(str) - 3);
-                    str[strlen(str) - 3] = '\0';
-                } else {
-                    memmove(str, str + 1, strlen(str));
-                }
-            }
-            return createSymbolLiteral(str, parser->previous.line, parser->previous.column);
+            return symbolFromToken(parser, parser->previous);
         } 
         
         // Handle constants and pseudo-variables
         else if (type == TOKEN_NIL || type == TOKEN_TRUE || type == TOKEN_FALSE) {
-            return createConstantNode(type, parser->previous.line, parser->previous.column);
+            return createConstantNode(type, tokenSpan(parser, parser->previous));
         } else if (type == TOKEN_SELF || type == TOKEN_SUPER || type == TOKEN_THIS_CONTEXT) {
             char* name = extractTokenString(parser->previous);
-            return createVariableNode(name, 1, parser->previous.line, parser->previous.column);
+            return createVariableNode(name, 1, tokenSpan(parser, parser->previous));
         }
     }
     
     // Handle identifiers (variable references)
     if (match(parser, TOKEN_IDENTIFIER)) {
         char* name = extractTokenString(parser->previous);
-        return createVariableNode(name, 0, parser->previous.line, parser->previous.column);
+        return createVariableNode(name, 0, tokenSpan(parser, parser->previous));
     }
     
     parserError(parser, "Expected expression.");
     return NULL;
 }
 
-static ASTNode* parseMessageExpression(Parser* parser) {
-    ASTNode* receiver = primary(parser);
+// Binary selectors in expressions; '|' only acts as one in method patterns
+static int matchBinarySelector(Parser* parser) {
+    if (check(parser, TOKEN_PIPE) || !isBinarySelectorToken(parser->current.type)) return 0;
+    advance(parser);
+    return 1;
+}
+
+// Message sends bind unary tightest, then binary, then keyword. Each level
+// takes the receiver parsed so far, which is NULL for the first message of a
+// cascade part. lastSelector receives the offset of the most recently parsed
+// selector, where the outermost message's own text starts.
+
+static ASTNode* unaryMessages(Parser* parser, ASTNode* receiver, unsigned int start, unsigned int* lastSelector) {
+    while (match(parser, TOKEN_IDENTIFIER)) {
+        *lastSelector = offsetOf(parser, parser->previous.start);
+        char* selector = extractTokenString(parser->previous);
+        receiver = createUnaryMessageNode(receiver, selector, spanFrom(parser, start));
+        free(selector);
+    }
+    return receiver;
+}
+
+// Binary arguments are a primary with its unary messages
+static ASTNode* binaryMessages(Parser* parser, ASTNode* receiver, unsigned int start, unsigned int* lastSelector) {
+    while (matchBinarySelector(parser)) {
+        unsigned int selectorStart = offsetOf(parser, parser->previous.start);
+        char* selector = extractTokenString(parser->previous);
+        
+        unsigned int argumentStart = currentOffset(parser);
+        unsigned int ignored;
+        ASTNode* argument = unaryMessages(parser, primary(parser), argumentStart, &ignored);
+        
+        receiver = createBinaryMessageNode(receiver, selector, argument, spanFrom(parser, start));
+        free(selector);
+        *lastSelector = selectorStart;
+    }
+    return receiver;
+}
+
+// At most one keyword message, whose arguments are binary expressions
+static ASTNode* keywordMessage(Parser* parser, ASTNode* receiver, unsigned int start, unsigned int* lastSelector) {
+    if (!check(parser, TOKEN_KEYWORD)) return receiver;
     
-    // Parse any unary, binary, or keyword messages
-    for (;;) {
-        // Parse unary message
-        if (match(parser, TOKEN_IDENTIFIER)) {
-            char* selector = extractTokenString(parser->previous);
-            receiver = createUnaryMessageNode(receiver, selector, 
-                                           parser->previous.line, parser->previous.column);
-        }
-        // Parse binary message (specific tokens)
-        else if (match(parser, TOKEN_PLUS) || match(parser, TOKEN_MINUS) || 
-                 match(parser, TOKEN_STAR) || match(parser, TOKEN_SLASH) ||
-                 match(parser, TOKEN_LESS) || match(parser, TOKEN_GREATER) ||
-                 match(parser, TOKEN_EQUAL) || match(parser, TOKEN_AT) ||
-                 match(parser, TOKEN_COMMA) || match(parser, TOKEN_TILDE) ||
-                 match(parser, TOKEN_PERCENT) || match(parser, TOKEN_AMPERSAND) ||
-                 match(parser, TOKEN_QUESTION) || match(parser, TOKEN_EXCLAMATION) ||
-                 match(parser, TOKEN_BACKSLASH) || match(parser, TOKEN_BINARY_SELECTOR)) {
-            
-            char* selector = extractTokenString(parser->previous);
-            ASTNode* argument = primary(parser);
-            int selectorLine = parser->previous.line;
-            int selectorColumn = parser->previous.column;
-            
-            receiver = createBinaryMessageNode(receiver, selector, argument, 
-                                            selectorLine, selectorColumn);
+    char selectorBuffer[256] = {0};
+    ASTNode** arguments = NULL;
+    int argumentCount = 0;
+    unsigned int selectorStart = currentOffset(parser);
+    
+    while (match(parser, TOKEN_KEYWORD)) {
+        if (strlen(selectorBuffer) + parser->previous.length >= sizeof(selectorBuffer)) {
+            parserError(parser, "Selector too long.");
+            break;
         }
-        // Parse keyword message
-        else if (match(parser, TOKEN_KEYWORD)) {
-            char selectorBuffer[256] = {0}; // Buffer for building the full selector
-            ASTNode** arguments = (ASTNode**)malloc(sizeof(ASTNode*) * 8); // Initial capacity
-            if (arguments == NULL) {
+        strncat(selectorBuffer, parser->previous.start, parser->previous.length);
+        
+        unsigned int argumentStart = currentOffset(parser);
+        unsigned int ignored;
+        ASTNode* argument = unaryMessages(parser, primary(parser), argumentStart, &ignored);
+        argument = binaryMessages(parser, argument, argumentStart, &ignored);
+        
+        // Grow the arguments array if needed
+        if (argumentCount % 8 == 0) {
+            ASTNode** newArgs = (ASTNode**)realloc(arguments, sizeof(ASTNode*) * (argumentCount + 8));
+            if (newArgs == NULL) {
+                for (int i = 0; i < argumentCount; i++) freeASTNode(arguments[i]);
+                free(arguments);
+                freeASTNode(argument);
+                freeASTNode(receiver);
                 parserError(parser, "Out of memory.");
                 return NULL;
             }
-            
-            int argumentCount = 0;
-            
-            // First keyword and argument
-            strncat(selectorBuffer, parser->previous.start, parser->previous.length);
-            
-            // Parse the argument
-            ASTNode* argument = primary(parser);
-            arguments[argumentCount++] = argument;
-            
-            // Additional keywords and arguments
-            while (match(parser, TOKEN_KEYWORD)) {
-                strncat(selectorBuffer, parser->previous.start, parser->previous.length);
-                
-                // Parse the argument
-                argument = primary(parser);
-                
-                // Grow the arguments array if needed
-                if (argumentCount % 8 == 0) {
-                    ASTNode** newArgs = (ASTNode**)realloc(arguments, sizeof(ASTNode*) * (argumentCount + 8));
-                    if (newArgs == NULL) {
-                        for (int i = 0; i < argumentCount; i++) freeASTNode(arguments[i]);
-                        free(arguments);
-                        parserError(parser, "Out of memory.");
-                        return NULL;
-                    }
-                    arguments = newArgs;
-                }
-                
-                arguments[argumentCount++] = argument;
-            }
-            
-            receiver = createKeywordMessageNode(receiver, selectorBuffer, arguments, argumentCount, 
-                                            parser->previous.line, parser->previous.column);
+            arguments = newArgs;
         }
-        // Handle cascade (semicolon)
-        else if (match(parser, TOKEN_SEMICOLON)) {
-            ASTNode* cascadeReceiver = receiver;
-            ASTNode** messages = (ASTNode**)malloc(sizeof(ASTNode*) * 8); // Initial capacity
-            if (messages == NULL) {
+        arguments[argumentCount++] = argument;
+    }
+    
+    // The node keeps its own copy of the argument array
+    ASTNode* message = createKeywordMessageNode(receiver, selectorBuffer, arguments, argumentCount,
+                                                spanFrom(parser, start));
+    free(arguments);
+    *lastSelector = selectorStart;
+    return message;
+}
+
+static ASTNode* messages(Parser* parser, ASTNode* receiver, unsigned int start, unsigned int* lastSelector) {
+    receiver = unaryMessages(parser, receiver, start, lastSelector);
+    receiver = binaryMessages(parser, receiver, start, lastSelector);
+    return keywordMessage(parser, receiver, start, lastSelector);
+}
+
+static ASTNode* parseMessageExpression(Parser* parser) {
+    unsigned int start = currentOffset(parser);
+    unsigned int lastSelector = start;
+    ASTNode* expression = messages(parser, primary(parser), start, &lastSelector);
+    
+    if (!check(parser, TOKEN_SEMICOLON)) return expression;
+    if (!isMessageNode(expression)) {
+        parserErrorAtCurrent(parser, "Expected a message send before ';'.");
+        return expression;
+    }
+    
+    // A cascade goes to the receiver of the last message, which becomes the
+    // first message of the cascade; its span now starts at its selector.
+    // Any kind of message starts with an ASTMessageNode.
+    ASTMessageNode* first = (ASTMessageNode*)expression;
+    ASTNode* cascadeReceiver = first->receiver;
+    unsigned int end = first->base.span.start + first->base.span.length;
+    first->receiver = NULL;
+    first->base.span.start = lastSelector;
+    first->base.span.length = end - lastSelector;
+    
+    ASTNode** cascadeMessages = (ASTNode**)malloc(sizeof(ASTNode*) * 8); // Initial capacity
+    if (cascadeMessages == NULL) {
+        freeASTNode(cascadeReceiver);
+        freeASTNode(expression);
+        parserError(parser, "Out of memory.");
+        return NULL;
+    }
+    int messageCount = 0;
+    cascadeMessages[messageCount++] = expression;
+    
+    while (match(parser, TOKEN_SEMICOLON)) {
+        // Each part starts with a message to the cascade receiver
+        unsigned int messageStart = currentOffset(parser);
+        unsigned int ignored;
+        ASTNode* message = messages(parser, NULL, messageStart, &ignored);
+        if (message == NULL) {
+            parserErrorAtCurrent(parser, "Expected message selector in cascade.");
+            break;
+        }
+        
+        // Grow the messages array if needed
+        if (messageCount % 8 == 0) {
+            ASTNode** newMsgs = (ASTNode**)realloc(cascadeMessages, sizeof(ASTNode*) * (messageCount + 8));
+            if (newMsgs == NULL) {
+                for (int i = 0; i < messageCount; i++) freeASTNode(cascadeMessages[i]);
+                free(cascadeMessages);
+                freeASTNode(message);
+                freeASTNode(cascadeReceiver);
                 parserError(parser, "Out of memory.");
                 return NULL;
             }
-            
-            int messageCount = 0;
-            
-            // Parse cascade messages
-            do {
-                ASTNode* message = NULL;
-                
-                // Parse each message without receiver (it will be set in the cascade node)
-                if (match(parser, TOKEN_IDENTIFIER)) {
-                    char* selector = extractTokenString(parser->previous);
-                    message = createUnaryMessageNode(NULL, selector, 
-                                                  parser->previous.line, parser->previous.column);
-                }
-                else if (match(parser, TOKEN_PLUS) || match(parser, TOKEN_MINUS) || 
-                         match(parser, TOKEN_STAR) || match(parser, TOKEN_SLASH) ||
-                         match(parser, TOKEN_LESS) || match(parser, TOKEN_GREATER) ||
-                         match(parser, TOKEN_EQUAL) || match(parser, TOKEN_AT) ||
-                         match(parser, TOKEN_COMMA) || match(parser, TOKEN_TILDE) ||
-                         match(parser, TOKEN_PERCENT) || match(parser, TOKEN_AMPERSAND) ||
-                         match(parser, TOKEN_QUESTION) || match(parser, TOKEN_EXCLAMATION) ||
-                         match(parser, TOKEN_BACKSLASH) || match(parser, TOKEN_BINARY_SELECTOR)) {
-                    
-                    char* selector = extractTokenString(parser->previous);
-                    ASTNode* argument = primary(parser);
-                    
-                    message = createBinaryMessageNode(NULL, selector, argument, 
-                                                   parser->previous.line, parser->previous.column);
-                }
-                else if (match(parser, TOKEN_KEYWORD)) {
-                    // Handle keyword message in cascade
-                    char selectorBuffer[256] = {0};
-                    ASTNode** arguments = (ASTNode**)malloc(sizeof(ASTNode*) * 8);
-                    if (arguments == NULL) {
-                        for (int i = 0; i < messageCount; i++) freeASTNode(messages[i]);
-                        free(messages);
-                        parserError(parser, "Out of memory.");
-                        return NULL;
-                    }
-                    
-                    int argumentCount = 0;
-                    
-                    // First keyword and argument
-                    strncat(selectorBuffer, parser->previous.start, parser->previous.length);
-                    ASTNode* argument = primary(parser);
-                    arguments[argumentCount++] = argument;
-                    
-                    // Additional keywords and arguments
-                    while (match(parser, TOKEN_KEYWORD)) {
-                        strncat(selectorBuffer, parser->previous.start, parser->previous.length);
-                        argument = primary(parser);
-                        
-                        // Grow arguments if needed
-                        if (argumentCount % 8 == 0) {
-                            ASTNode** newArgs = (ASTNode**)realloc(arguments, sizeof(ASTNode*) * (argumentCount + 8));
-                            if (newArgs == NULL) {
-                                for (int i = 0; i < argumentCount; i++) freeASTNode(arguments[i]);
-                                free(arguments);
-                                for (int i = 0; i < messageCount; i++) freeASTNode(messages[i]);
-                                free(messages);
-                                parserError(parser, "Out of memory.");
-                                return NULL;
-                            }
-                            arguments = newArgs;
-                        }
-                        
-                        arguments[argumentCount++] = argument;
-                    }
-                    
-                    message = createKeywordMessageNode(NULL, selectorBuffer, arguments, argumentCount, 
-                                                    parser->previous.line, parser->previous.column);
-                }
-                else {
-                    parserError(parser, "Expected message selector in cascade.");
-                    for (int i = 0; i < messageCount; i++) freeASTNode(messages[i]);
-                    free(messages);
-                    return NULL;
-                }
-                
-                // Store the message
-                if (messageCount % 8 == 0 && messageCount > 0) {
-                    ASTNode** newMsgs = (ASTNode**)realloc(messages, sizeof(ASTNode*) * (messageCount + 8));
-                    if (newMsgs == NULL) {
-                        for (int i = 0; i < messageCount; i++) freeASTNode(messages[i]);
-                        free(messages);
-                        parserError(parser, "Out of memory.");
-                        return NULL;
-                    }
-                    messages = newMsgs;
-                }
-                
-                messages[messageCount++] = message;
-            } while (match(parser, TOKEN_SEMICOLON));
-            
-            // Create the cascade node
-            return createCascadeNode(cascadeReceiver, messages, messageCount, 
-                                 parser->previous.line, parser->previous.column);
-        }
-        else {
-            // No more messages to parse
-            break;
+            cascadeMessages = newMsgs;
         }
+        cascadeMessages[messageCount++] = message;
     }
     
-    return receiver;
+    ASTNode* cascade = createCascadeNode(cascadeReceiver, cascadeMessages, messageCount, spanFrom(parser, start));
+    free(cascadeMessages);
+    return cascade;
 }
 
 static ASTNode* assignment(Parser* parser) {
-    if (check(parser, TOKEN_IDENTIFIER)) {
+    if (check(parser, TOKEN_IDENTIFIER) && peekToken(parser)->type == TOKEN_ASSIGNMENT) {
         Token identifier = parser->current;
         advance(parser); // Consume the identifier
+        advance(parser); // Consume the ':='
         
-        if (match(parser, TOKEN_ASSIGNMENT)) {
-            ASTNode* value = expression(parser);
-            
-            char* variableName = extractTokenString(identifier);
-            return createAssignmentNode(variableName, value, 
-                                     identifier.line, identifier.column);
-        } else {
-            // Not an assignment, so backtrack
-            parser->current = identifier;
-        }
+        ASTNode* value = expression(parser);
+        
+        char* variableName = extractTokenString(identifier);
+        return createAssignmentNode(variableName, value, spanFrom(parser, offsetOf(parser, identifier.start)));
     }
     
     return parseMessageExpression(parser);
 }
 
 static ASTNode* expression(Parser* parser) {
+    unsigned int start = currentOffset(parser);
     if (match(parser, TOKEN_CARET)) {
         ASTNode* expr = expression(parser);
-        return createReturnNode(expr, parser->previous.line, parser->previous.column);
+        return createReturnNode(expr, spanFrom(parser, start));
     }
     
     ASTNode* expr = assignment(parser);
     
     // Debug print to see the current token type after expression parsing
-    printf("After expression, current token type: %d\n", parser->current.type);
+    debugTrace("After expression, current token type: %d\n", parser->current.type);
     
     return expr;
 }
@@ -573,7 +847,7 @@ static ASTNode* statement(Parser* parser) {
     ASTNode* expr = expression(parser);
     
     // Debug print for statement parsing
-    printf("Parsed statement, current token type: %d\n", parser->current.type);
+    debugTrace("Parsed statement, current token type: %d\n", parser->current.type);
     
     return expr;
 }
@@ -586,6 +860,16 @@ static ASTNode* blockBody(Parser* parser) {
     }
     
     int statementCount = 0;
+    unsigned int start = currentOffset(parser);
+    
+    // Temporaries of the top-level code: | a b |
+    char** temps = NULL;
+    int tempCount = 0;
+    if (match(parser, TOKEN_PIPE) && !temporaries(parser, &temps, &tempCount)) {
+        freeNames(temps, tempCount);
+        free(statements);
+        return NULL;
+    }
     
     while (!check(parser, TOKEN_EOF)) {
         // Skip any periods at the beginning (can happen with comments)
@@ -604,6 +888,7 @@ static ASTNode* blockBody(Parser* parser) {
             if (newStmts == NULL) {
                 for (int i = 0; i < statementCount; i++) freeASTNode(statements[i]);
                 free(statements);
+                freeNames(temps, tempCount);
                 parserError(parser, "Out of memory.");
                 return NULL;
             }
@@ -616,7 +901,7 @@ static ASTNode* blockBody(Parser* parser) {
         // If next token is not a period, check if it's part of expression that needs period
         if (!check(parser, TOKEN_PERIOD)) {
             // Debug print to help diagnose the issue
-            printf("Error: Expected period, but got token type: %d\n", parser->current.type);
+            debugTrace("Error: Expected period, but got token type: %d\n", parser->current.type);
             parserErrorAtCurrent(parser, "Expected '.' after statement.");
             break;
         }
@@ -626,12 +911,174 @@ static ASTNode* blockBody(Parser* parser) {
     }
     
     // Create a block node without parameters
-    return createBlockNode(NULL, 0, statements, statementCount, 
-                        parser->previous.line, parser->previous.column);
+    ASTNode* block = createBlockNode(NULL, 0, temps, tempCount, statements, statementCount,
+                                     spanFrom(parser, start));
+    freeNames(temps, tempCount);
+    free(statements);
+    return block;
+}
+
+ASTNode* parseMethod(Parser* parser) {
+    unsigned int start = currentOffset(parser);
+    
+    char selectorBuffer[256] = {0};
+    char** parameters = NULL;
+    int parameterCount = 0;
+    
+    // Message pattern: unary, binary or keyword
+    if (match(parser, TOKEN_KEYWORD)) {
+        do {
+            if (strlen(selectorBuffer) + parser->previous.length >= sizeof(selectorBuffer)) {
+                parserError(parser, "Selector too long.");
+                freeNames(parameters, parameterCount);
+                return NULL;
+            }
+            strncat(selectorBuffer, parser->previous.start, parser->previous.length);
+            consume(parser, TOKEN_IDENTIFIER, "Expected argument name after keyword.");
+            
+            if (parameterCount % 8 == 0) {
+                char** newParams = (char**)realloc(parameters, sizeof(char*) * (parameterCount + 8));
+                if (newParams == NULL) {
+                    freeNames(parameters, parameterCount);
+                    parserError(parser, "Out of memory.");
+                    return NULL;
+                }
+                parameters = newParams;
+            }
+            parameters[parameterCount++] = extractTokenString(parser->previous);
+        } while (match(parser, TOKEN_KEYWORD));
+    } else if (match(parser, TOKEN_IDENTIFIER)) {
+        strncat(selectorBuffer, parser->previous.start, parser->previous.length);
+    } else if (isBinarySelectorToken(parser->current.type)) {
+        advance(parser);
+        strncat(selectorBuffer, parser->previous.start, parser->previous.length);
+        consume(parser, TOKEN_IDENTIFIER, "Expected argument name after binary selector.");
+        parameters = (char**)malloc(sizeof(char*));
+        if (parameters == NULL) {
+            parserError(parser, "Out of memory.");
+            return NULL;
+        }
+        parameters[parameterCount++] = extractTokenString(parser->previous);
+    } else {
+        parserErrorAtCurrent(parser, "Expected method pattern.");
+        return NULL;
+    }
+    
+    // Temporaries
+    char** temps = NULL;
+    int tempCount = 0;
+    if (match(parser, TOKEN_PIPE)) {
+        if (!temporaries(parser, &temps, &tempCount)) {
+            freeNames(temps, tempCount);
+            freeNames(parameters, parameterCount);
+            return NULL;
+        }
+    }
+    
+    // Primitive pragma: <primitive: n>
+    int isPrimitive = 0;
+    int primitiveNumber = 0;
+    if (check(parser, TOKEN_LESS) && peekToken(parser)->type == TOKEN_KEYWORD &&
+        peekToken(parser)->length == 10 && memcmp(peekToken(parser)->start, "primitive:", 10) == 0) {
+        advance(parser); // Consume '<'
+        advance(parser); // Consume 'primitive:'
+        consume(parser, TOKEN_INTEGER, "Expected primitive number.");
+        isPrimitive = 1;
+        primitiveNumber = (int)parser->previous.value.intValue;
+        consume(parser, TOKEN_GREATER, "Expected '>' after primitive number.");
+    }
+    
+    // Statements up to the end of the method source
+    ASTNode** statements = (ASTNode**)malloc(sizeof(ASTNode*) * 8); // Initial capacity
+    if (statements == NULL) {
+        freeNames(temps, tempCount);
+        freeNames(parameters, parameterCount);
+        parserError(parser, "Out of memory.");
+        return NULL;
+    }
+    
+    int statementCount = 0;
+    
+    while (!check(parser, TOKEN_EOF)) {
+        statements[statementCount++] = statement(parser);
+        
+        // Grow the statements array if needed
+        if (statementCount % 8 == 0) {
+            ASTNode** newStmts = (ASTNode**)realloc(statements, sizeof(ASTNode*) * (statementCount + 8));
+            if (newStmts == NULL) {
+                for (int i = 0; i < statementCount; i++) freeASTNode(statements[i]);
+                free(statements);
+                freeNames(temps, tempCount);
+                freeNames(parameters, parameterCount);
+                parserError(parser, "Out of memory.");
+                return NULL;
+            }
+            statements = newStmts;
+        }
+        
+        if (parser->hadError || !match(parser, TOKEN_PERIOD)) break;
+    }
+    
+    // The span ends with the last token of the method, not with EOF
+    SourceSpan span = spanFrom(parser, start);
+    if (!parser->hadError) {
+        consume(parser, TOKEN_EOF, "Expected end of method.");
+    }
+    
+    ASTNode* method = createMethodNode(selectorBuffer, parameters, parameterCount,
+                                       temps, tempCount, statements, statementCount,
+                                       isPrimitive, primitiveNumber, span);
+    
+    // The node keeps its own copies of the names and of the statement array
+    freeNames(temps, tempCount);
+    freeNames(parameters, parameterCount);
+    free(statements);
+    
+    return method;
 }
 
 void initParser(Parser* parser, const char* source) {
+    initParserAtLine(parser, source, 1);
+}
+
+// Until a token is consumed, the last one is an empty token where the source
+// starts, so that code without any tokens gets an empty span. Priming the
+// parser moves it from current to previous.
+static void initTokens(Parser* parser, int line) {
+    memset(&parser->current, 0, sizeof(Token));
+    parser->current.type = TOKEN_EOF;
+    parser->current.start = parser->source;
+    parser->current.line = line;
+    parser->current.column = 1;
+}
+
+void initParserAtLine(Parser* parser, const char* source, int line) {
+    parser->source = source;
+    initLexer(&parser->lexer, source);
+    parser->lexer.line = line;
+    initTokens(parser, line);
+    parser->pipeline = NULL;
+    parser->hasLookahead = 0;
+    parser->hadError = 0;
+    parser->panicMode = 0;
+    
+    advance(parser); // Prime the parser by loading the first token
+}
+
+void initPipelinedParser(Parser* parser, const char* source, TokenPipeline* pipeline) {
+    // No pipeline could be started, for one because the source is too long
+    // for its token offsets: lex on this thread instead
+    if (pipeline == NULL) {
+        initParser(parser, source);
+        return;
+    }
+    
+    // The lexer is driven by the pipeline's producer thread; ours stays idle
+    parser->source = source;
     initLexer(&parser->lexer, source);
+    initTokens(parser, 1);
+    parser->pipeline = pipeline;
+    parser->hasLookahead = 0;
     parser->hadError = 0;
     parser->panicMode = 0;
     
@@ -4,16 +4,28 @@
 #include "lexer.h"
 #include "ast.h"
 
+typedef struct TokenPipeline TokenPipeline;
+
 typedef struct {
+    const char* source;       /* Node spans are offsets from here */
     Lexer lexer;
+    TokenPipeline* pipeline;  /* Token source when lexing on another thread, otherwise NULL */
     Token current;
     Token previous;
+    Token lookahead;          /* Token after current, valid when hasLookahead is set */
+    int hasLookahead;
     int hadError;
     int panicMode;
 } Parser;
 
+/* String and symbol nodes in the resulting AST point into source, which
+ * must stay alive until the AST is freed */
 void initParser(Parser* parser, const char* source);
+void initParserAtLine(Parser* parser, const char* source, int line);
+/* Takes tokens from pipeline, or with a NULL pipeline lexes like initParser */
+void initPipelinedParser(Parser* parser, const char* source, TokenPipeline* pipeline);
 ASTNode* parse(Parser* parser);
+ASTNode* parseMethod(Parser* parser);
 void parserError(Parser* parser, const char* message);
 void parserErrorAtCurrent(Parser* parser, const char* message);
 
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include "pipeline.h"
+
+#define TOKEN_RING_MASK (TOKEN_RING_CAPACITY - 1)
+
+// Busy-wait briefly, then give the core away; the other stage is usually
+// only a few tokens behind
+static void waitForPeer(unsigned int* spins) {
+    if (++(*spins) < 128) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
+
+static void publishTail(TokenPipeline* pipeline) {
+    atomic_store_explicit(&pipeline->tail, pipeline->writePos, memory_order_release);
+}
+
+static void releaseHead(TokenPipeline* pipeline) {
+    atomic_store_explicit(&pipeline->head, pipeline->readPos, memory_order_release);
+}
+
+// Wait until the ring has room for one more token. Returns 0 if the
+// pipeline was cancelled while waiting.
+static int waitForSpace(TokenPipeline* pipeline) {
+    if (pipeline->writePos - pipeline->cachedHead < TOKEN_RING_CAPACITY) return 1;
+
+    // Hand over everything written so far before blocking, otherwise the
+    // consumer could be waiting on tokens we have not published yet
+    publishTail(pipeline);
+
+    unsigned int spins = 0;
+    for (;;) {
+        pipeline->cachedHead = atomic_load_explicit(&pipeline->head, memory_order_acquire);
+        if (pipeline->writePos - pipeline->cachedHead < TOKEN_RING_CAPACITY) return 1;
+        if (atomic_load_explicit(&pipeline->cancelled, memory_order_relaxed)) return 0;
+        waitForPeer(&spins);
+    }
+}
+
+static void* producerMain(void* arg) {
+    TokenPipeline* pipeline = (TokenPipeline*)arg;
+
+    for (;;) {
+        if (!waitForSpace(pipeline)) return NULL;
+
+        Token token = nextToken(&pipeline->lexer);
+        CompactToken* slot = &pipeline->slots[pipeline->writePos & TOKEN_RING_MASK];
+
+        slot->type = token.type;
+        slot->length = (unsigned int)token.length;
+        slot->line = (unsigned int)token.line;
+        slot->column = token.column < PIPELINE_MAX_COLUMN ? token.column : PIPELINE_MAX_COLUMN;
+        if (token.type == TOKEN_ERROR) {
+            // Error tokens point at a static message rather than into the source
+            slot->offset = 0;
+            slot->value = (long long)(intptr_t)token.start;
+        } else {
+            slot->offset = (unsigned int)(token.start - pipeline->source);
+            memcpy(&slot->value, &token.value, sizeof(token.value));
+        }
+
+        pipeline->writePos++;
+
+        if (token.type == TOKEN_EOF) {
+            publishTail(pipeline);
+            return NULL;
+        }
+
+        if ((pipeline->writePos & (TOKEN_BATCH_SIZE - 1)) == 0) {
+            publishTail(pipeline);
+        }
+    }
+}
+
+TokenPipeline* startTokenPipeline(const char* source) {
+    if (strlen(source) > PIPELINE_MAX_SOURCE_LENGTH) return NULL;
+
+    TokenPipeline* pipeline = (TokenPipeline*)aligned_alloc(64, sizeof(TokenPipeline));
+    if (pipeline == NULL) return NULL;
+    memset(pipeline, 0, sizeof(TokenPipeline));
+
+    pipeline->slots = (CompactToken*)malloc(sizeof(CompactToken) * TOKEN_RING_CAPACITY);
+    if (pipeline->slots == NULL) {
+        free(pipeline);
+        return NULL;
+    }
+
+    pipeline->source = source;
+    atomic_init(&pipeline->head, 0);
+    atomic_init(&pipeline->tail, 0);
+    atomic_init(&pipeline->cancelled, 0);
+    initLexer(&pipeline->lexer, source);
+
+    if (pthread_create(&pipeline->producer, NULL, producerMain, pipeline) != 0) {
+        fprintf(stderr, "Could not start lexer thread; lexing inline.\n");
+        free(pipeline->slots);
+        free(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+Token pipelineNextToken(TokenPipeline* pipeline) {
+    Token token;
+
+    // Keep answering EOF once it has been seen, just like the lexer does
+    if (pipeline->finished) return pipeline->eofToken;
+
+    if (pipeline->readPos == pipeline->cachedTail) {
+        pipeline->cachedTail = atomic_load_explicit(&pipeline->tail, memory_order_acquire);
+
+        if (pipeline->readPos == pipeline->cachedTail) {
+            // Give back the slots we have consumed before waiting on the producer
+            releaseHead(pipeline);
+
+            unsigned int spins = 0;
+            do {
+                waitForPeer(&spins);
+                pipeline->cachedTail = atomic_load_explicit(&pipeline->tail, memory_order_acquire);
+            } while (pipeline->readPos == pipeline->cachedTail);
+        }
+    }
+
+    const CompactToken* slot = &pipeline->slots[pipeline->readPos & TOKEN_RING_MASK];
+
+    token.type = (TokenType)slot->type;
+    token.length = (int)slot->length;
+    token.line = (int)slot->line;
+    token.column = slot->column;
+    if (token.type == TOKEN_ERROR) {
+        token.start = (const char*)(intptr_t)slot->value;
+        token.value.intValue = 0;
+    } else {
+        token.start = pipeline->source + slot->offset;
+        memcpy(&token.value, &slot->value, sizeof(token.value));
+    }
+
+    pipeline->readPos++;
+
+    if (token.type == TOKEN_EOF) {
+        pipeline->finished = 1;
+        pipeline->eofToken = token;
+    } else if ((pipeline->readPos & (TOKEN_BATCH_SIZE - 1)) == 0) {
+        releaseHead(pipeline);
+    }
+
+    return token;
+}
+
+void stopTokenPipeline(TokenPipeline* pipeline) {
+    if (pipeline == NULL) return;
+
+    // The parser may stop early on an error, leaving the producer blocked on a full ring
+    atomic_store_explicit(&pipeline->cancelled, 1, memory_order_relaxed);
+    pthread_join(pipeline->producer, NULL);
+
+    free(pipeline->slots);
+    free(pipeline);
+}
@@ -0,0 +1,62 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "lexer.h"
+
+/* Ring capacity in tokens; must be a power of two */
+#define TOKEN_RING_CAPACITY 65536
+/* Tokens are published and released in batches of this size */
+#define TOKEN_BATCH_SIZE 256
+
+/* Offsets in the ring are 32-bit, so longer sources are not pipelined */
+#define PIPELINE_MAX_SOURCE_LENGTH ((size_t)UINT_MAX)
+/* Columns past this one are stored as this one */
+#define PIPELINE_MAX_COLUMN ((1 << 23) - 1)
+
+/* Compact token as stored in the ring (24 bytes instead of 40) */
+typedef struct {
+    long long value;         /* Literal value bits, or the message pointer of an error token */
+    unsigned int offset;     /* Offset of the token start in the source, at most PIPELINE_MAX_SOURCE_LENGTH */
+    unsigned int length;
+    unsigned int line;
+    signed int column : 24;
+    unsigned int type : 8;
+} CompactToken;
+
+/* Single-producer/single-consumer token pipeline. A producer thread runs
+ * nextToken() ahead of the parser and hands tokens over through a lock-free
+ * ring; each side only touches the other's index once per batch. */
+typedef struct TokenPipeline {
+    CompactToken* slots;
+    const char* source;
+    pthread_t producer;
+
+    /* Written by the consumer, read by the producer */
+    _Alignas(64) atomic_size_t head;
+    /* Written by the producer, read by the consumer */
+    _Alignas(64) atomic_size_t tail;
+    atomic_int cancelled;
+
+    /* Producer-private state */
+    _Alignas(64) Lexer lexer;
+    size_t writePos;
+    size_t cachedHead;
+
+    /* Consumer-private state */
+    _Alignas(64) size_t readPos;
+    size_t cachedTail;
+    int finished;            /* Set once the EOF token has been consumed */
+    Token eofToken;
+} TokenPipeline;
+
+/* Answers NULL for sources longer than PIPELINE_MAX_SOURCE_LENGTH, or when
+ * the producer cannot be started; initPipelinedParser then lexes inline. */
+TokenPipeline* startTokenPipeline(const char* source);
+Token pipelineNextToken(TokenPipeline* pipeline);
+void stopTokenPipeline(TokenPipeline* pipeline);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,662 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "primitives.h"
+#include "largeinteger.h"
+
+#define PRIMITIVE(name) static int name(VM* vm, Oop* arguments, int argumentCount, Oop* result)
+#define UNUSED_ARGUMENTS() (void)vm; (void)arguments; (void)argumentCount
+
+#define ANSWER(value) \
+    do { \
+        Oop answer = (value); \
+        if (answer == 0) return PRIMITIVE_ERROR; \
+        *result = answer; \
+        return PRIMITIVE_SUCCEEDED; \
+    } while (0)
+
+// Helpers
+
+static int bothIntegers(VM* vm, Oop* arguments) {
+    return isInteger(vm, arguments[0]) && isInteger(vm, arguments[1]);
+}
+
+// Integers of either size
+static int bothAnyIntegers(VM* vm, Oop* arguments) {
+    return isAnyInteger(vm, arguments[0]) && isAnyInteger(vm, arguments[1]);
+}
+
+// Value of a Float or integer argument; answers 0 for anything else
+static int numberValue(VM* vm, Oop object, double* value) {
+    if (isFloat(vm, object)) {
+        *value = floatValue(object);
+        return 1;
+    }
+    if (isInteger(vm, object)) {
+        *value = (double)integerValue(object);
+        return 1;
+    }
+    if (isLargeInteger(vm, object)) {
+        *value = largeIntegerAsDouble(vm, object);
+        return 1;
+    }
+    return 0;
+}
+
+// First indexed slot of an object, past its named instance variables
+static uint32_t namedSlots(VM* vm, Oop object) {
+    ObjectHeader* header = objectHeader(object);
+    if (header->format != FORMAT_INDEXABLE) return 0;
+    return (uint32_t)vm->classes[header->classIndex].variableCount;
+}
+
+static int indexedSize(VM* vm, Oop object) {
+    if (isImmediate(object)) return -1;
+    ObjectHeader* header = objectHeader(object);
+    switch ((ObjectFormat)header->format) {
+        case FORMAT_INDEXABLE: return (int)(header->size - namedSlots(vm, object));
+        case FORMAT_BYTES: return (int)header->size;
+        default: return -1;
+    }
+}
+
+// Index argument in 1..size of the receiver, answered 0-based, or -1
+static long long checkedIndex(VM* vm, Oop object, Oop index) {
+    if (!isInteger(vm, index)) return -1;
+    long long value = integerValue(index);
+    int size = indexedSize(vm, object);
+    return value >= 1 && value <= size ? value - 1 : -1;
+}
+
+static void className(VM* vm, int classIndex, char* buffer, size_t size) {
+    RuntimeClass* class = &vm->classes[classIndex];
+    snprintf(buffer, size, "%.*s%s", (int)objectHeader(class->name)->size,
+             (const char*)objectBytes(class->name), class->isMeta ? " class" : "");
+}
+
+static Oop newText(VM* vm, const char* text) {
+    return newString(vm, text, strlen(text));
+}
+
+// Integers. SmallIntegers are worked on here; results that overflow them
+// and LargeInteger operands go to largeinteger.c.
+
+#define INTEGER_ARITHMETIC(name, builtin, large) \
+    PRIMITIVE(name) { \
+        (void)argumentCount; \
+        long long value; \
+        if (bothIntegers(vm, arguments) && \
+            !builtin(integerValue(arguments[0]), integerValue(arguments[1]), &value)) { \
+            ANSWER(newInteger(vm, value)); \
+        } \
+        if (!bothAnyIntegers(vm, arguments)) return PRIMITIVE_FAILED; \
+        ANSWER(large(vm, arguments[0], arguments[1])); \
+    }
+
+INTEGER_ARITHMETIC(integerAdd, __builtin_saddll_overflow, largeIntegerAdd)
+INTEGER_ARITHMETIC(integerSubtract, __builtin_ssubll_overflow, largeIntegerSubtract)
+INTEGER_ARITHMETIC(integerMultiply, __builtin_smulll_overflow, largeIntegerMultiply)
+
+#define INTEGER_COMPARISON(name, operator) \
+    PRIMITIVE(name) { \
+        (void)argumentCount; \
+        if (bothIntegers(vm, arguments)) { \
+            ANSWER(booleanObject(vm, integerValue(arguments[0]) operator integerValue(arguments[1]))); \
+        } \
+        if (!bothAnyIntegers(vm, arguments)) return PRIMITIVE_FAILED; \
+        ANSWER(booleanObject(vm, largeIntegerCompare(vm, arguments[0], arguments[1]) operator 0)); \
+    }
+
+INTEGER_COMPARISON(integerLess, <)
+INTEGER_COMPARISON(integerGreater, >)
+INTEGER_COMPARISON(integerLessEqual, <=)
+INTEGER_COMPARISON(integerGreaterEqual, >=)
+INTEGER_COMPARISON(integerEqual, ==)
+INTEGER_COMPARISON(integerNotEqual, !=)
+
+#define INTEGER_BITWISE(name, operator) \
+    PRIMITIVE(name) { \
+        (void)argumentCount; \
+        if (!bothIntegers(vm, arguments)) return PRIMITIVE_FAILED; \
+        ANSWER(newInteger(vm, integerValue(arguments[0]) operator integerValue(arguments[1]))); \
+    }
+
+INTEGER_BITWISE(integerBitAnd, &)
+INTEGER_BITWISE(integerBitOr, |)
+INTEGER_BITWISE(integerBitXor, ^)
+
+// Both operands integers and the divisor not zero; LargeIntegers never are
+static int divisible(VM* vm, Oop* arguments) {
+    return bothAnyIntegers(vm, arguments) && !(isInteger(vm, arguments[1]) && integerValue(arguments[1]) == 0);
+}
+
+// Whether the SmallInteger division overflows or has a LargeInteger operand
+static int largeDivision(VM* vm, Oop* arguments) {
+    return !bothIntegers(vm, arguments) ||
+        (integerValue(arguments[0]) == INT64_MIN && integerValue(arguments[1]) == -1);
+}
+
+// Only exact quotients; the others would need fractions
+PRIMITIVE(integerDivide) {
+    (void)argumentCount;
+    if (!divisible(vm, arguments)) return PRIMITIVE_FAILED;
+    if (largeDivision(vm, arguments)) {
+        Oop quotient, modulo;
+        if (!largeIntegerDivide(vm, arguments[0], arguments[1], &quotient, &modulo)) return PRIMITIVE_ERROR;
+        if (modulo != smallIntegerObject(0)) return PRIMITIVE_FAILED;
+        ANSWER(quotient);
+    }
+    long long dividend = integerValue(arguments[0]);
+    long long divisor = integerValue(arguments[1]);
+    if (dividend % divisor != 0) return PRIMITIVE_FAILED;
+    ANSWER(newInteger(vm, dividend / divisor));
+}
+
+// Quotient rounded towards negative infinity, as // answers
+static long long flooredQuotient(long long dividend, long long divisor) {
+    long long quotient = dividend / divisor;
+    if ((dividend % divisor != 0) && ((dividend < 0) != (divisor < 0))) quotient--;
+    return quotient;
+}
+
+PRIMITIVE(integerQuotient) {
+    (void)argumentCount;
+    if (!divisible(vm, arguments)) return PRIMITIVE_FAILED;
+    if (largeDivision(vm, arguments)) {
+        Oop quotient, modulo;
+        if (!largeIntegerDivide(vm, arguments[0], arguments[1], &quotient, &modulo)) return PRIMITIVE_ERROR;
+        ANSWER(quotient);
+    }
+    ANSWER(newInteger(vm, flooredQuotient(integerValue(arguments[0]), integerValue(arguments[1]))));
+}
+
+PRIMITIVE(integerModulo) {
+    (void)argumentCount;
+    if (!divisible(vm, arguments)) return PRIMITIVE_FAILED;
+    if (largeDivision(vm, arguments)) {
+        Oop quotient, modulo;
+        if (!largeIntegerDivide(vm, arguments[0], arguments[1], &quotient, &modulo)) return PRIMITIVE_ERROR;
+        ANSWER(modulo);
+    }
+    long long dividend = integerValue(arguments[0]);
+    long long divisor = integerValue(arguments[1]);
+    ANSWER(newInteger(vm, dividend - flooredQuotient(dividend, divisor) * divisor));
+}
+
+PRIMITIVE(integerBitShift) {
+    (void)argumentCount;
+    if (!isAnyInteger(vm, arguments[0]) || !isInteger(vm, arguments[1])) return PRIMITIVE_FAILED;
+    long long shift = integerValue(arguments[1]);
+    if (isInteger(vm, arguments[0])) {
+        long long value = integerValue(arguments[0]);
+        if (shift < 0) ANSWER(newInteger(vm, shift <= -64 ? (value < 0 ? -1 : 0) : value >> -shift));
+        if (shift < 63) {
+            long long shifted = (long long)((unsigned long long)value << shift);
+            if ((shifted >> shift) == value) ANSWER(newInteger(vm, shifted));
+        }
+    }
+    ANSWER(largeIntegerShift(vm, arguments[0], shift));
+}
+
+PRIMITIVE(integerAsFloat) {
+    (void)argumentCount;
+    if (isLargeInteger(vm, arguments[0])) ANSWER(newFloat(vm, largeIntegerAsDouble(vm, arguments[0])));
+    if (!isInteger(vm, arguments[0])) return PRIMITIVE_FAILED;
+    ANSWER(newFloat(vm, (double)integerValue(arguments[0])));
+}
+
+PRIMITIVE(integerPrintString) {
+    (void)argumentCount;
+    if (isLargeInteger(vm, arguments[0])) {
+        char* digits = largeIntegerPrintString(vm, arguments[0]);
+        Oop text = newText(vm, digits);
+        free(digits);
+        ANSWER(text);
+    }
+    if (!isInteger(vm, arguments[0])) return PRIMITIVE_FAILED;
+    char text[32];
+    snprintf(text, sizeof(text), "%lld", integerValue(arguments[0]));
+    ANSWER(newText(vm, text));
+}
+
+PRIMITIVE(integerAsCharacter) {
+    (void)argumentCount;
+    if (!isInteger(vm, arguments[0])) return PRIMITIVE_FAILED;
+    long long value = integerValue(arguments[0]);
+    if (value < 0 || value > 255) return PRIMITIVE_FAILED;
+    ANSWER(characterObject((int)value));
+}
+
+// Float
+
+#define FLOAT_ARITHMETIC(name, operator) \
+    PRIMITIVE(name) { \
+        (void)argumentCount; \
+        double argument; \
+        if (!isFloat(vm, arguments[0]) || !numberValue(vm, arguments[1], &argument)) return PRIMITIVE_FAILED; \
+        ANSWER(newFloat(vm, floatValue(arguments[0]) operator argument)); \
+    }
+
+FLOAT_ARITHMETIC(floatAdd, +)
+FLOAT_ARITHMETIC(floatSubtract, -)
+FLOAT_ARITHMETIC(floatMultiply, *)
+
+PRIMITIVE(floatDivide) {
+    (void)argumentCount;
+    double argument;
+    if (!isFloat(vm, arguments[0]) || !numberValue(vm, arguments[1], &argument) || argument == 0.0) {
+        return PRIMITIVE_FAILED;
+    }
+    ANSWER(newFloat(vm, floatValue(arguments[0]) / argument));
+}
+
+#define FLOAT_COMPARISON(name, operator) \
+    PRIMITIVE(name) { \
+        (void)argumentCount; \
+        double argument; \
+        if (!isFloat(vm, arguments[0]) || !numberValue(vm, arguments[1], &argument)) return PRIMITIVE_FAILED; \
+        ANSWER(booleanObject(vm, floatValue(arguments[0]) operator argument)); \
+    }
+
+FLOAT_COMPARISON(floatLess, <)
+FLOAT_COMPARISON(floatGreater, >)
+FLOAT_COMPARISON(floatLessEqual, <=)
+FLOAT_COMPARISON(floatGreaterEqual, >=)
+FLOAT_COMPARISON(floatEqual, ==)
+FLOAT_COMPARISON(floatNotEqual, !=)
+
+PRIMITIVE(floatTruncated) {
+    (void)argumentCount;
+    if (!isFloat(vm, arguments[0])) return PRIMITIVE_FAILED;
+    double value = floatValue(arguments[0]);
+    if (!(value > -9.2e18 && value < 9.2e18)) return PRIMITIVE_FAILED;
+    ANSWER(newInteger(vm, (long long)value));
+}
+
+PRIMITIVE(floatSqrt) {
+    (void)argumentCount;
+    if (!isFloat(vm, arguments[0]) || floatValue(arguments[0]) < 0.0) return PRIMITIVE_FAILED;
+    ANSWER(newFloat(vm, sqrt(floatValue(arguments[0]))));
+}
+
+PRIMITIVE(floatPrintString) {
+    (void)argumentCount;
+    if (!isFloat(vm, arguments[0])) return PRIMITIVE_FAILED;
+    double value = floatValue(arguments[0]);
+    char text[48];
+    if (isnan(value)) {
+        strcpy(text, "nan");
+    } else if (isinf(value)) {
+        strcpy(text, value > 0 ? "inf" : "-inf");
+    } else {
+        // Shortest of the two forms that reads back as the same value
+        snprintf(text, sizeof(text), "%.15g", value);
+        if (strtod(text, NULL) != value) snprintf(text, sizeof(text), "%.17g", value);
+        // Keep it readable back as a Float
+        if (strpbrk(text, ".e") == NULL) strcat(text, ".0");
+    }
+    ANSWER(newText(vm, text));
+}
+
+// Indexed access
+
+PRIMITIVE(basicAt) {
+    (void)argumentCount;
+    Oop object = arguments[0];
+    long long index = checkedIndex(vm, object, arguments[1]);
+    if (index < 0) return PRIMITIVE_FAILED;
+    if (objectHeader(object)->format == FORMAT_BYTES) {
+        uint8_t byte = objectBytes(object)[index];
+        int classIndex = classIndexOf(vm, object);
+        if (classIndex == CLASS_STRING || classIndex == CLASS_SYMBOL) ANSWER(characterObject(byte));
+        ANSWER(newInteger(vm, byte));
+    }
+    ANSWER(objectSlots(object)[namedSlots(vm, object) + (uint32_t)index]);
+}
+
+PRIMITIVE(basicAtPut) {
+    (void)argumentCount;
+    Oop object = arguments[0];
+    Oop value = arguments[2];
+    long long index = checkedIndex(vm, object, arguments[1]);
+    int classIndex = classIndexOf(vm, object);
+    if (index < 0 || classIndex == CLASS_SYMBOL) return PRIMITIVE_FAILED;
+    if (objectHeader(object)->format == FORMAT_BYTES) {
+        long long byte;
+        if (classIndex == CLASS_STRING) {
+            if (classIndexOf(vm, value) != CLASS_CHARACTER) return PRIMITIVE_FAILED;
+            byte = characterCode(value);
+        } else {
+            if (!isInteger(vm, value)) return PRIMITIVE_FAILED;
+            byte = integerValue(value);
+            if (byte < 0 || byte > 255) return PRIMITIVE_FAILED;
+        }
+        objectBytes(object)[index] = (uint8_t)byte;
+        ANSWER(value);
+    }
+    storePointer(&vm->memory, object, namedSlots(vm, object) + (uint32_t)index, value);
+    ANSWER(value);
+}
+
+PRIMITIVE(basicSize) {
+    (void)argumentCount;
+    int size = indexedSize(vm, arguments[0]);
+    ANSWER(newInteger(vm, size < 0 ? 0 : size));
+}
+
+PRIMITIVE(replaceFromToWithStartingAt) {
+    (void)argumentCount;
+    Oop object = arguments[0];
+    Oop source = arguments[3];
+    Oop* bounds = arguments + 1;
+    if (!isInteger(vm, bounds[0]) || !isInteger(vm, bounds[1]) || !isInteger(vm, arguments[4])) {
+        return PRIMITIVE_FAILED;
+    }
+    if (isImmediate(object) || isImmediate(source)) return PRIMITIVE_FAILED;
+    ObjectFormat format = (ObjectFormat)objectHeader(object)->format;
+    if (classIndexOf(vm, object) == CLASS_SYMBOL || format != (ObjectFormat)objectHeader(source)->format ||
+        (format != FORMAT_BYTES && format != FORMAT_INDEXABLE)) {
+        return PRIMITIVE_FAILED;
+    }
+    long long start = integerValue(bounds[0]);
+    long long stop = integerValue(bounds[1]);
+    long long sourceStart = integerValue(arguments[4]);
+    long long count = stop - start + 1;
+    if (count == 0) ANSWER(object);
+    if (count < 0 || start < 1 || stop > indexedSize(vm, object) || sourceStart < 1 ||
+        sourceStart + count - 1 > indexedSize(vm, source)) {
+        return PRIMITIVE_FAILED;
+    }
+    if (format == FORMAT_BYTES) {
+        memmove(objectBytes(object) + start - 1, objectBytes(source) + sourceStart - 1, (size_t)count);
+    } else {
+        uint32_t first = namedSlots(vm, object) + (uint32_t)(start - 1);
+        Oop* slots = objectSlots(object) + first;
+        memmove(slots, objectSlots(source) + namedSlots(vm, source) + sourceStart - 1, sizeof(Oop) * (size_t)count);
+        for (long long i = 0; i < count; i++) writeBarrier(&vm->memory, object, first + (uint32_t)i, slots[i]);
+    }
+    ANSWER(object);
+}
+
+// Instantiation and identity
+
+PRIMITIVE(basicNew) {
+    (void)argumentCount;
+    int classIndex = behaviorIndex(vm, arguments[0]);
+    if (classIndex == NO_CLASS) return PRIMITIVE_FAILED;
+    ObjectFormat format = vm->classes[classIndex].format;
+    if (format == FORMAT_RAW || format == FORMAT_CLOSURE) return PRIMITIVE_FAILED;
+    ANSWER(instantiate(vm, classIndex, 0));
+}
+
+PRIMITIVE(basicNewSized) {
+    (void)argumentCount;
+    int classIndex = behaviorIndex(vm, arguments[0]);
+    if (classIndex == NO_CLASS || !isInteger(vm, arguments[1])) return PRIMITIVE_FAILED;
+    ObjectFormat format = vm->classes[classIndex].format;
+    long long size = integerValue(arguments[1]);
+    if ((format != FORMAT_INDEXABLE && format != FORMAT_BYTES) || size < 0 || size > UINT32_MAX / 2) {
+        return PRIMITIVE_FAILED;
+    }
+    ANSWER(instantiate(vm, classIndex, (uint32_t)size));
+}
+
+PRIMITIVE(identityHash) {
+    UNUSED_ARGUMENTS();
+    Oop object = arguments[0];
+    if (isImmediate(object)) ANSWER(newInteger(vm, (long long)((object >> TAG_BITS) & 0x3fffffff)));
+    ANSWER(newInteger(vm, objectHeader(object)->hash));
+}
+
+// Boxed integers stand for values, so equal ones are identical
+PRIMITIVE(identical) {
+    (void)argumentCount;
+    if (bothIntegers(vm, arguments)) {
+        ANSWER(booleanObject(vm, integerValue(arguments[0]) == integerValue(arguments[1])));
+    }
+    ANSWER(booleanObject(vm, arguments[0] == arguments[1]));
+}
+
+PRIMITIVE(objectClass) {
+    UNUSED_ARGUMENTS();
+    ANSWER(vm->classes[classIndexOf(vm, arguments[0])].object);
+}
+
+PRIMITIVE(shallowCopy) {
+    (void)argumentCount;
+    Oop object = arguments[0];
+    if (isImmediate(object)) ANSWER(object);
+    ObjectHeader* header = objectHeader(object);
+    if (object == vm->nil || object == vm->trueObject || object == vm->falseObject ||
+        header->classIndex == CLASS_SYMBOL) {
+        ANSWER(object);
+    }
+    Oop copy = allocateObject(&vm->memory, header->classIndex, (ObjectFormat)header->format, header->size);
+    if (copy == 0) {
+        runtimeError(vm, "out of memory");
+        return PRIMITIVE_ERROR;
+    }
+    // Not the cards, which belong to the copy's own remembering
+    size_t cards = cardBytes((ObjectFormat)header->format, header->size);
+    memcpy(objectHeader(copy) + 1, header + 1, objectByteSize(object) - sizeof(ObjectHeader) - cards);
+    ANSWER(copy);
+}
+
+// System
+
+PRIMITIVE(blockArgumentCount) {
+    (void)argumentCount;
+    if (classIndexOf(vm, arguments[0]) != CLASS_BLOCK_CLOSURE) return PRIMITIVE_FAILED;
+    ANSWER(newInteger(vm, asClosure(arguments[0])->method->code->argumentCount));
+}
+
+PRIMITIVE(doesNotUnderstand) {
+    (void)argumentCount;
+    (void)result;
+    Oop message = arguments[1];
+    char name[256];
+    className(vm, classIndexOf(vm, arguments[0]), name, sizeof(name));
+    if (classIndexOf(vm, message) == CLASS_MESSAGE) {
+        Oop selector = objectSlots(message)[0];
+        runtimeError(vm, "%s does not understand #%.*s", name, (int)objectHeader(selector)->size,
+                     (const char*)objectBytes(selector));
+    } else {
+        runtimeError(vm, "%s does not understand a message", name);
+    }
+    return PRIMITIVE_ERROR;
+}
+
+PRIMITIVE(signalError) {
+    (void)argumentCount;
+    (void)result;
+    Oop text = arguments[1];
+    if (isString(vm, text)) {
+        runtimeError(vm, "%.*s", (int)objectHeader(text)->size, (const char*)objectBytes(text));
+    } else {
+        runtimeError(vm, "error");
+    }
+    return PRIMITIVE_ERROR;
+}
+
+PRIMITIVE(behaviorName) {
+    (void)argumentCount;
+    int classIndex = behaviorIndex(vm, arguments[0]);
+    if (classIndex == NO_CLASS) return PRIMITIVE_FAILED;
+    char name[256];
+    className(vm, classIndex, name, sizeof(name));
+    ANSWER(newText(vm, name));
+}
+
+// Class variables become globals, since this runtime has no pools
+static int declareGlobals(VM* vm, Oop names) {
+    const char* text = (const char*)objectBytes(names);
+    size_t length = objectHeader(names)->size;
+    size_t i = 0;
+    while (i < length) {
+        while (i < length && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' || text[i] == '\r')) i++;
+        size_t start = i;
+        while (i < length && text[i] != ' ' && text[i] != '\t' && text[i] != '\n' && text[i] != '\r') i++;
+        if (i > start) {
+            Oop name = internSymbol(vm, text + start, i - start);
+            if (name == 0 || globalAssociation(vm, name) == 0) return 0;
+        }
+    }
+    return 1;
+}
+
+// Receiver subclass: #Name instanceVariableNames: '...' classVariableNames: '...'
+PRIMITIVE(defineSubclass) {
+    (void)argumentCount;
+    int superclass = behaviorIndex(vm, arguments[0]);
+    Oop name = arguments[1];
+    Oop variables = arguments[2];
+    Oop classVariables = arguments[3];
+    if (superclass == NO_CLASS || vm->classes[superclass].isMeta || classIndexOf(vm, name) != CLASS_SYMBOL ||
+        !isString(vm, variables) || !isString(vm, classVariables)) {
+        return PRIMITIVE_FAILED;
+    }
+    int classIndex = defineClass(vm, superclass, name, (const char*)objectBytes(variables),
+                                 objectHeader(variables)->size);
+    if (classIndex == NO_CLASS || !declareGlobals(vm, classVariables)) return PRIMITIVE_ERROR;
+    ANSWER(vm->classes[classIndex].object);
+}
+
+// Receiver is a metaclass: Foo class instanceVariableNames: '...'
+PRIMITIVE(metaclassVariables) {
+    (void)argumentCount;
+    int meta = behaviorIndex(vm, arguments[0]);
+    Oop variables = arguments[1];
+    if (meta == NO_CLASS || !vm->classes[meta].isMeta || !isString(vm, variables)) return PRIMITIVE_FAILED;
+    if (!defineClassSideVariables(vm, vm->classes[meta].partner, (const char*)objectBytes(variables),
+                                  objectHeader(variables)->size)) {
+        return PRIMITIVE_ERROR;
+    }
+    ANSWER(arguments[0]);
+}
+
+PRIMITIVE(behaviorSuperclass) {
+    (void)argumentCount;
+    int classIndex = behaviorIndex(vm, arguments[0]);
+    if (classIndex == NO_CLASS) return PRIMITIVE_FAILED;
+    int superclass = vm->classes[classIndex].superclass;
+    ANSWER(superclass == NO_CLASS ? vm->nil : vm->classes[superclass].object);
+}
+
+PRIMITIVE(characterValue) {
+    (void)argumentCount;
+    if (classIndexOf(vm, arguments[0]) != CLASS_CHARACTER) return PRIMITIVE_FAILED;
+    ANSWER(newInteger(vm, characterCode(arguments[0])));
+}
+
+PRIMITIVE(stringAsSymbol) {
+    (void)argumentCount;
+    Oop text = arguments[0];
+    if (!isString(vm, text)) return PRIMITIVE_FAILED;
+    ANSWER(internSymbol(vm, (const char*)objectBytes(text), objectHeader(text)->size));
+}
+
+PRIMITIVE(symbolAsString) {
+    (void)argumentCount;
+    Oop text = arguments[0];
+    if (!isString(vm, text)) return PRIMITIVE_FAILED;
+    ANSWER(newString(vm, (const char*)objectBytes(text), objectHeader(text)->size));
+}
+
+PRIMITIVE(stringEqual) {
+    (void)argumentCount;
+    Oop first = arguments[0];
+    Oop second = arguments[1];
+    if (!isString(vm, first)) return PRIMITIVE_FAILED;
+    if (!isString(vm, second)) ANSWER(vm->falseObject);
+    uint32_t length = objectHeader(first)->size;
+    ANSWER(booleanObject(vm, length == objectHeader(second)->size &&
+                             memcmp(objectBytes(first), objectBytes(second), length) == 0));
+}
+
+PRIMITIVE(stringHash) {
+    (void)argumentCount;
+    Oop text = arguments[0];
+    if (!isString(vm, text)) return PRIMITIVE_FAILED;
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < objectHeader(text)->size; i++) hash = (hash ^ objectBytes(text)[i]) * 16777619u;
+    ANSWER(newInteger(vm, hash & 0x3fffffff));
+}
+
+PRIMITIVE(stringLess) {
+    (void)argumentCount;
+    Oop first = arguments[0];
+    Oop second = arguments[1];
+    if (!isString(vm, first) || !isString(vm, second)) return PRIMITIVE_FAILED;
+    uint32_t firstLength = objectHeader(first)->size;
+    uint32_t secondLength = objectHeader(second)->size;
+    int order = memcmp(objectBytes(first), objectBytes(second), firstLength < secondLength ? firstLength : secondLength);
+    ANSWER(booleanObject(vm, order < 0 || (order == 0 && firstLength < secondLength)));
+}
+
+PRIMITIVE(transcriptShow) {
+    (void)argumentCount;
+    Oop text = arguments[1];
+    if (!isString(vm, text)) return PRIMITIVE_FAILED;
+    writeBytes(&vm->transcript, (const char*)objectBytes(text), objectHeader(text)->size);
+    ANSWER(arguments[0]);
+}
+
+PRIMITIVE(transcriptCr) {
+    (void)argumentCount;
+    writeChar(&vm->transcript, '\n');
+    ANSWER(arguments[0]);
+}
+
+PRIMITIVE(millisecondClock) {
+    (void)argumentCount;
+    (void)arguments;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ANSWER(newInteger(vm, (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000));
+}
+
+// Objects only move at safepoints, so the collection waits for the next one
+PRIMITIVE(garbageCollect) {
+    (void)argumentCount;
+    vm->memory.collectionRequested = 1;
+    vm->memory.fullCollectionRequested = 1;
+    ANSWER(arguments[0]);
+}
+
+PRIMITIVE(globalAt) {
+    (void)argumentCount;
+    if (classIndexOf(vm, arguments[1]) != CLASS_SYMBOL) return PRIMITIVE_FAILED;
+    Oop value = globalValue(vm, arguments[1]);
+    if (value == 0) return PRIMITIVE_FAILED;
+    ANSWER(value);
+}
+
+PRIMITIVE(globalAtPut) {
+    (void)argumentCount;
+    if (classIndexOf(vm, arguments[1]) != CLASS_SYMBOL) return PRIMITIVE_FAILED;
+    Oop association = globalAssociation(vm, arguments[1]);
+    if (association == 0) return PRIMITIVE_ERROR;
+    storePointer(&vm->memory, association, 1, arguments[2]);
+    ANSWER(arguments[2]);
+}
+
+PRIMITIVE(globalIncludesKey) {
+    (void)argumentCount;
+    if (classIndexOf(vm, arguments[1]) != CLASS_SYMBOL) return PRIMITIVE_FAILED;
+    ANSWER(booleanObject(vm, globalValue(vm, arguments[1]) != 0));
+}
+
+// Table
+
+#define PRIMITIVE_TABLE_ENTRY(number, function) [number] = function,
+
+static const PrimitiveFunction primitiveTable[] = {
+    PRIMITIVES(PRIMITIVE_TABLE_ENTRY)
+};
+
+PrimitiveFunction findPrimitive(int number) {
+    if (number <= 0 || number >= (int)(sizeof(primitiveTable) / sizeof(primitiveTable[0]))) return NULL;
+    return primitiveTable[number];
+}
@@ -0,0 +1,94 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include "runtime.h"
+
+/*
+ * Primitives: C functions a method names with <primitive: N>. A primitive
+ * that fails runs the rest of the method instead, so methods put their
+ * fallback code after the pragma.
+ *
+ * The control primitives below only mark methods; the interpreter performs
+ * them itself since they start activations rather than answer a value.
+ */
+
+#define PRIMITIVE_VALUE 81                    /* value, value:, ... on blocks */
+#define PRIMITIVE_VALUE_WITH_ARGUMENTS 82
+#define PRIMITIVE_PERFORM 83                  /* perform:, perform:with:, ... */
+#define PRIMITIVE_PERFORM_WITH_ARGUMENTS 84
+
+/* Number and function of each primitive */
+#define PRIMITIVES(X) \
+    /* Integers; SmallInteger results that overflow become LargeIntegers */ \
+    X(1, integerAdd) \
+    X(2, integerSubtract) \
+    X(3, integerLess) \
+    X(4, integerGreater) \
+    X(5, integerLessEqual) \
+    X(6, integerGreaterEqual) \
+    X(7, integerEqual) \
+    X(8, integerNotEqual) \
+    X(9, integerMultiply) \
+    X(10, integerDivide) \
+    X(11, integerModulo) \
+    X(12, integerQuotient) \
+    X(14, integerBitAnd) \
+    X(15, integerBitOr) \
+    X(16, integerBitXor) \
+    X(17, integerBitShift) \
+    X(40, integerAsFloat) \
+    /* Float; the argument may be an integer */ \
+    X(41, floatAdd) \
+    X(42, floatSubtract) \
+    X(43, floatLess) \
+    X(44, floatGreater) \
+    X(45, floatLessEqual) \
+    X(46, floatGreaterEqual) \
+    X(47, floatEqual) \
+    X(48, floatNotEqual) \
+    X(49, floatMultiply) \
+    X(50, floatDivide) \
+    X(51, floatTruncated) \
+    X(55, floatSqrt) \
+    /* Indexed access */ \
+    X(60, basicAt) \
+    X(61, basicAtPut) \
+    X(62, basicSize) \
+    /* Instantiation and identity */ \
+    X(70, basicNew) \
+    X(71, basicNewSized) \
+    X(75, identityHash) \
+    /* System */ \
+    X(85, blockArgumentCount) \
+    X(89, doesNotUnderstand) \
+    X(90, signalError) \
+    X(91, integerPrintString) \
+    X(92, floatPrintString) \
+    X(93, behaviorName) \
+    X(94, defineSubclass) \
+    X(95, metaclassVariables) \
+    X(96, behaviorSuperclass) \
+    X(97, characterValue) \
+    X(98, integerAsCharacter) \
+    X(99, stringAsSymbol) \
+    X(100, symbolAsString) \
+    X(101, shallowCopy) \
+    X(105, replaceFromToWithStartingAt) \
+    X(106, stringEqual) \
+    X(107, stringHash) \
+    X(108, stringLess) \
+    X(110, identical) \
+    X(111, objectClass) \
+    X(120, transcriptShow) \
+    X(121, transcriptCr) \
+    X(130, millisecondClock) \
+    X(131, garbageCollect) \
+    X(140, globalAt) \
+    X(141, globalAtPut) \
+    X(142, globalIncludesKey)
+
+/* The function of a primitive, or NULL for 0, unknown numbers and the
+ * control primitives */
+PrimitiveFunction findPrimitive(int number);
+
+#endif /* PRIMITIVES_H */
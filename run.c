@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "runtime.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "image.h"
+#include "fileio.h"
+
+typedef struct {
+    int echo;
+    int benchmark;
+    int repeat;
+    int statistics;
+    int jit;
+    const char* imagePath;      /* Start from this image rather than the kernel sources */
+    const char* savePath;       /* Save an image here once the sources are loaded */
+} RunOptions;
+
+static void printUsage(const char* programName) {
+    printf("Usage: %s [options] [<file>...]\n", programName);
+    printf("Run Smalltalk sources: plain top-level code or chunk-format fileouts.\n");
+    printf("Options:\n");
+    printf("  -h, --help             Display this help message\n");
+    printf("  --print                Print the value of each doit\n");
+    printf("  --benchmark            After loading, run every unary bench* method of the\n");
+    printf("                         class Benchmark and report bytecodes per second\n");
+    printf("  --repeat N             Runs of each benchmark; the fastest counts (default 3)\n");
+    printf("  --stats                Print interpreter, cache and collector counters at exit\n");
+    printf("  --no-jit               Interpret every method, compiling none to machine code\n");
+    printf("  --image FILE           Start from an image instead of compiling the kernel library\n");
+    printf("  --save-image FILE      Save an image after loading the files, before any benchmarks\n");
+}
+
+static double seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static int compareSelectors(const void* first, const void* second) {
+    Oop a = *(const Oop*)first;
+    Oop b = *(const Oop*)second;
+    uint32_t aLength = objectHeader(a)->size;
+    uint32_t bLength = objectHeader(b)->size;
+    int order = memcmp(objectBytes(a), objectBytes(b), aLength < bLength ? aLength : bLength);
+    return order != 0 ? order : (int)aLength - (int)bLength;
+}
+
+// The unary bench* selectors of a class, sorted by name
+static Oop* benchmarkSelectors(VM* vm, int classIndex, int* count) {
+    MethodDictionary* methods = &vm->classes[classIndex].methods;
+    Oop* selectors = (Oop*)malloc(sizeof(Oop) * (size_t)(methods->count > 0 ? methods->count : 1));
+    if (selectors == NULL) return NULL;
+    *count = 0;
+    for (int i = 0; i < methods->capacity; i++) {
+        MethodEntry* entry = &methods->entries[i];
+        if (entry->selector == 0 || entry->method->code->argumentCount != 0) continue;
+        if (objectHeader(entry->selector)->size > 5 && memcmp(objectBytes(entry->selector), "bench", 5) == 0) {
+            selectors[(*count)++] = entry->selector;
+        }
+    }
+    qsort(selectors, (size_t)*count, sizeof(Oop), compareSelectors);
+    return selectors;
+}
+
+static int runBenchmarks(VM* vm, const RunOptions* options) {
+    Oop name = internSymbol(vm, "Benchmark", 9);
+    Oop benchmarkClass = name != 0 ? globalValue(vm, name) : 0;
+    int classIndex = benchmarkClass != 0 ? behaviorIndex(vm, benchmarkClass) : NO_CLASS;
+    if (classIndex == NO_CLASS) {
+        fprintf(stderr, "No class named Benchmark was loaded.\n");
+        return 0;
+    }
+    Oop instance = instantiate(vm, classIndex, 0);
+    int count = 0;
+    Oop* selectors = benchmarkSelectors(vm, classIndex, &count);
+    if (instance == 0 || selectors == NULL) {
+        free(selectors);
+        return 0;
+    }
+    // The benchmarks may collect garbage, which moves objects
+    int roots = 0;
+    int ok = pushRoot(vm, &instance);
+    for (int i = 0; ok && i < count; i++) {
+        roots++;
+        ok = pushRoot(vm, &selectors[i]);
+    }
+    if (ok) roots++;
+
+    flushOutputBuffer(&vm->transcript);
+    printf("%-24s %10s %14s %12s %16s\n", "benchmark", "ms", "bytecodes", "sends", "bytecodes/s");
+    for (int i = 0; ok && i < count; i++) {
+        double best = 0.0;
+        uint64_t bytecodes = 0;
+        uint64_t sends = 0;
+        for (int run = 0; run < options->repeat; run++) {
+            VMStatistics before = vm->statistics;
+            double start = seconds();
+            Oop result;
+            if (!sendMessage(vm, instance, selectors[i], NULL, 0, &result)) {
+                ok = 0;
+                break;
+            }
+            double elapsed = seconds() - start;
+            if (run == 0 || elapsed < best) best = elapsed;
+            bytecodes = vm->statistics.bytecodes - before.bytecodes;
+            sends = vm->statistics.sends - before.sends;
+        }
+        if (!ok) break;
+        flushOutputBuffer(&vm->transcript);
+        printf("%-24.*s %10.1f %14llu %12llu %16.0f\n", (int)objectHeader(selectors[i])->size,
+               (const char*)objectBytes(selectors[i]), best * 1000.0, (unsigned long long)bytecodes,
+               (unsigned long long)sends, best > 0.0 ? (double)bytecodes / best : 0.0);
+    }
+    popRoots(vm, roots);
+    free(selectors);
+    return ok;
+}
+
+static void printStatistics(VM* vm) {
+    SendCacheSummary caches = {0, 0, {0}};
+    for (int i = 0; i < vm->methodCount; i++) {
+        summarizeSendCaches(&caches, vm->methods[i]->caches, vm->methods[i]->siteCount);
+    }
+    fprintf(stderr, "bytecodes:        %llu\n", (unsigned long long)vm->statistics.bytecodes);
+    fprintf(stderr, "sends:            %llu\n", (unsigned long long)vm->statistics.sends);
+    fprintf(stderr, "tail sends:       %llu\n", (unsigned long long)vm->statistics.tailSends);
+    fprintf(stderr, "primitive calls:  %llu\n", (unsigned long long)vm->statistics.primitiveCalls);
+    fprintf(stderr, "inline cache:     %llu hits, %llu misses\n", (unsigned long long)caches.hits,
+            (unsigned long long)caches.misses);
+    for (int state = 0; state < CACHE_STATE_COUNT; state++) {
+        fprintf(stderr, "  %-16s%d send sites\n", cacheStateName((CacheState)state), caches.sites[state]);
+    }
+    fprintf(stderr, "method cache:     %llu hits, %llu misses\n", (unsigned long long)vm->statistics.lookupHits,
+            (unsigned long long)vm->statistics.lookupMisses);
+    if (vm->jit != NULL) {
+        fprintf(stderr, "jit:              %d methods compiled, %d declined, %zu bytes of code\n", vm->jit->compiled,
+                vm->jit->declined, vm->jit->used);
+    }
+    if (vm->image != NULL) {
+        fprintf(stderr, "image:            %zu bytes, loaded in %.3f ms%s\n", vm->image->size,
+                vm->image->loadSeconds * 1000.0, vm->image->relocated ? ", relocated" : "");
+    }
+    fprintf(stderr, "objects:          %zu\n", vm->memory.objectsAllocated);
+    fprintf(stderr, "bytes allocated:  %zu\n", vm->memory.bytesAllocated);
+    const CollectorStatistics* collector = &vm->memory.statistics;
+    fprintf(stderr, "scavenges:        %llu, %.2f ms in total, longest %.3f ms\n",
+            (unsigned long long)collector->scavenges, collector->scavengeSeconds * 1000.0,
+            collector->longestScavenge * 1000.0);
+    fprintf(stderr, "full collections: %llu, %.2f ms in total, longest %.3f ms\n",
+            (unsigned long long)collector->fullCollections, collector->fullCollectionSeconds * 1000.0,
+            collector->longestFullCollection * 1000.0);
+    fprintf(stderr, "bytes survived:   %llu\n", (unsigned long long)collector->bytesSurvived);
+    fprintf(stderr, "bytes promoted:   %llu\n", (unsigned long long)collector->bytesPromoted);
+    fprintf(stderr, "bytes reclaimed:  %llu by full collections\n", (unsigned long long)collector->bytesReclaimed);
+    fprintf(stderr, "old space:        %zu bytes\n", vm->memory.oldBytes);
+}
+
+int main(int argc, char* argv[]) {
+    RunOptions options = {0, 0, 3, 0, 1, NULL, NULL};
+    char** paths = (char**)malloc(sizeof(char*) * (argc > 1 ? argc : 1));
+    if (paths == NULL) return 2;
+    int pathCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            free(paths);
+            return 0;
+        } else if (strcmp(argv[i], "--print") == 0) {
+            options.echo = 1;
+        } else if (strcmp(argv[i], "--benchmark") == 0) {
+            options.benchmark = 1;
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            options.repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.statistics = 1;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            options.jit = 0;
+        } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            options.imagePath = argv[++i];
+        } else if (strcmp(argv[i], "--save-image") == 0 && i + 1 < argc) {
+            options.savePath = argv[++i];
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            fprintf(stderr, "Unknown or incomplete option %s.\n", argv[i]);
+            printUsage(argv[0]);
+            free(paths);
+            return 2;
+        } else {
+            paths[pathCount++] = argv[i];
+        }
+    }
+    if (pathCount == 0 && options.imagePath == NULL && options.savePath == NULL) {
+        fprintf(stderr, "No source files specified.\n");
+        printUsage(argv[0]);
+        free(paths);
+        return 2;
+    }
+    if (options.repeat < 1) options.repeat = 1;
+
+    VM* vm = (VM*)malloc(sizeof(VM));
+    if (vm == NULL || !initVM(vm, options.imagePath)) {
+        if (vm != NULL) freeVM(vm);
+        free(vm);
+        free(paths);
+        return 2;
+    }
+    // Where there is no code generator everything is interpreted
+    if (options.jit) initJit(vm);
+
+    int failures = 0;
+    for (int i = 0; i < pathCount; i++) {
+        char* source = readFile(paths[i]);
+        if (source == NULL) {
+            failures++;
+            continue;
+        }
+        failures += loadSource(vm, source, paths[i], options.echo);
+        free(source);
+    }
+    if (options.savePath != NULL && !saveImage(vm, options.savePath)) failures++;
+    if (options.benchmark && !runBenchmarks(vm, &options)) failures++;
+    flushOutputBuffer(&vm->transcript);
+    if (options.statistics) printStatistics(vm);
+
+    freeVM(vm);
+    free(vm);
+    free(paths);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,945 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include "runtime.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "image.h"
+#include "parser.h"
+#include "chunks.h"
+#include "sourcemap.h"
+#include "compiler.h"
+#include "primitives.h"
+
+#define STACK_SLOTS (1024 * 1024)
+#define MAX_FRAMES (64 * 1024)
+// Frames listed under a runtime error
+#define BACKTRACE_FRAMES 16
+
+// Errors
+
+static void writeMethodName(VM* vm, OutputBuffer* out, Method* method) {
+    int blocks = 0;
+    while (method->outer != NULL) {
+        method = method->outer;
+        blocks++;
+    }
+    for (int i = 0; i < blocks; i++) writeString(out, "[] in ");
+    if (method->selector == vm->nil) {
+        writeString(out, "DoIt");
+        return;
+    }
+    writeClassName(vm, out, method->classIndex);
+    writeString(out, ">>");
+    writeBytes(out, (const char*)objectBytes(method->selector), objectHeader(method->selector)->size);
+}
+
+void runtimeError(VM* vm, const char* format, ...) {
+    flushOutputBuffer(&vm->transcript);
+
+    char message[512];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    fprintf(stderr, "Error: %s\n", message);
+
+    OutputBuffer out;
+    if (!initOutputBuffer(&out, stderr, 4096)) return;
+    int shown = 0;
+    for (int i = vm->frameCount - 1; i >= 0 && shown < BACKTRACE_FRAMES; i--, shown++) {
+        writeString(&out, "  ");
+        writeMethodName(vm, &out, vm->frames[i].method);
+        writeChar(&out, '\n');
+    }
+    if (shown < vm->frameCount) writeString(&out, "  ...\n");
+    freeOutputBuffer(&out);
+}
+
+static void outOfMemory(VM* vm) {
+    runtimeError(vm, "out of memory");
+}
+
+// Objects
+
+Oop instantiate(VM* vm, int classIndex, uint32_t size) {
+    RuntimeClass* class = &vm->classes[classIndex];
+    uint32_t slots = class->format == FORMAT_INDEXABLE || class->format == FORMAT_POINTERS
+        ? (uint32_t)class->variableCount + size : size;
+    Oop object = allocateObject(&vm->memory, (uint32_t)classIndex, class->format, slots);
+    if (object == 0) outOfMemory(vm);
+    return object;
+}
+
+Oop newInteger(VM* vm, long long value) {
+    if (fitsSmallInteger(value)) return smallIntegerObject(value);
+    Oop object = allocateObject(&vm->memory, CLASS_SMALL_INTEGER, FORMAT_RAW, 1);
+    if (object == 0) {
+        outOfMemory(vm);
+        return 0;
+    }
+    *(long long*)objectSlots(object) = value;
+    return object;
+}
+
+Oop newFloat(VM* vm, double value) {
+    Oop immediate = smallFloatObject(value);
+    if (immediate != 0) return immediate;
+    Oop object = allocateObject(&vm->memory, CLASS_FLOAT, FORMAT_RAW, 1);
+    if (object == 0) {
+        outOfMemory(vm);
+        return 0;
+    }
+    *(double*)objectSlots(object) = value;
+    return object;
+}
+
+static Oop newByteObject(VM* vm, int classIndex, const char* bytes, size_t length) {
+    Oop object = allocateObject(&vm->memory, (uint32_t)classIndex, FORMAT_BYTES, (uint32_t)length);
+    if (object == 0) {
+        outOfMemory(vm);
+        return 0;
+    }
+    memcpy(objectBytes(object), bytes, length);
+    return object;
+}
+
+Oop newString(VM* vm, const char* text, size_t length) {
+    return newByteObject(vm, CLASS_STRING, text, length);
+}
+
+int isString(VM* vm, Oop object) {
+    int classIndex = classIndexOf(vm, object);
+    return classIndex == CLASS_STRING || classIndex == CLASS_SYMBOL;
+}
+
+// Symbols
+
+static uint32_t hashBytes(const char* bytes, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int symbolSlot(Oop* table, int capacity, const char* text, size_t length) {
+    int mask = capacity - 1;
+    int slot = (int)(hashBytes(text, length) & (uint32_t)mask);
+    while (table[slot] != 0) {
+        ObjectHeader* header = objectHeader(table[slot]);
+        if (header->size == length && memcmp(objectBytes(table[slot]), text, length) == 0) break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int growSymbols(VM* vm) {
+    int capacity = vm->symbolCapacity < 1024 ? 1024 : vm->symbolCapacity * 2;
+    Oop* table = (Oop*)calloc((size_t)capacity, sizeof(Oop));
+    if (table == NULL) return 0;
+    for (int i = 0; i < vm->symbolCapacity; i++) {
+        Oop symbol = vm->symbols[i];
+        if (symbol == 0) continue;
+        table[symbolSlot(table, capacity, (const char*)objectBytes(symbol), objectHeader(symbol)->size)] = symbol;
+    }
+    free(vm->symbols);
+    vm->symbols = table;
+    vm->symbolCapacity = capacity;
+    return 1;
+}
+
+Oop internSymbol(VM* vm, const char* text, size_t length) {
+    if ((vm->symbolCount + 1) * 2 > vm->symbolCapacity && !growSymbols(vm)) {
+        outOfMemory(vm);
+        return 0;
+    }
+    int slot = symbolSlot(vm->symbols, vm->symbolCapacity, text, length);
+    if (vm->symbols[slot] == 0) {
+        Oop symbol = newByteObject(vm, CLASS_SYMBOL, text, length);
+        if (symbol == 0) return 0;
+        vm->symbols[slot] = symbol;
+        vm->symbolCount++;
+    }
+    return vm->symbols[slot];
+}
+
+static Oop symbolFor(VM* vm, const char* text) {
+    return internSymbol(vm, text, strlen(text));
+}
+
+// Globals
+
+static int globalSlot(Oop* table, int capacity, Oop name) {
+    int mask = capacity - 1;
+    int slot = (int)(objectHeader(name)->hash & (uint32_t)mask);
+    while (table[slot] != 0 && objectSlots(table[slot])[0] != name) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int growGlobals(VM* vm) {
+    int capacity = vm->globalCapacity < 256 ? 256 : vm->globalCapacity * 2;
+    Oop* table = (Oop*)calloc((size_t)capacity, sizeof(Oop));
+    if (table == NULL) return 0;
+    for (int i = 0; i < vm->globalCapacity; i++) {
+        Oop association = vm->globals[i];
+        if (association != 0) table[globalSlot(table, capacity, objectSlots(association)[0])] = association;
+    }
+    free(vm->globals);
+    vm->globals = table;
+    vm->globalCapacity = capacity;
+    return 1;
+}
+
+Oop globalAssociation(VM* vm, Oop name) {
+    if ((vm->globalCount + 1) * 2 > vm->globalCapacity && !growGlobals(vm)) {
+        outOfMemory(vm);
+        return 0;
+    }
+    int slot = globalSlot(vm->globals, vm->globalCapacity, name);
+    if (vm->globals[slot] == 0) {
+        Oop association = instantiate(vm, CLASS_ASSOCIATION, 0);
+        if (association == 0) return 0;
+        objectSlots(association)[0] = name;
+        vm->globals[slot] = association;
+        vm->globalCount++;
+    }
+    return vm->globals[slot];
+}
+
+Oop globalValue(VM* vm, Oop name) {
+    if (vm->globalCapacity == 0) return 0;
+    Oop association = vm->globals[globalSlot(vm->globals, vm->globalCapacity, name)];
+    return association != 0 ? objectSlots(association)[1] : 0;
+}
+
+static int setGlobal(VM* vm, Oop name, Oop value) {
+    Oop association = globalAssociation(vm, name);
+    if (association == 0) return 0;
+    storePointer(&vm->memory, association, 1, value);
+    return 1;
+}
+
+// Classes
+
+void writeClassName(VM* vm, OutputBuffer* out, int classIndex) {
+    RuntimeClass* class = &vm->classes[classIndex];
+    writeBytes(out, (const char*)objectBytes(class->name), objectHeader(class->name)->size);
+    if (class->isMeta) writeString(out, " class");
+}
+
+int behaviorIndex(VM* vm, Oop object) {
+    int classIndex = classIndexOf(vm, object);
+    if (classIndex != CLASS_METACLASS && !vm->classes[classIndex].isMeta) return NO_CLASS;
+    Oop index = objectSlots(object)[0];
+    return isInteger(vm, index) ? (int)integerValue(index) : NO_CLASS;
+}
+
+static void freeVariables(char** variables, int count) {
+    for (int i = 0; i < count; i++) free(variables[i]);
+    free(variables);
+}
+
+// The variables of a superclass followed by the names in a string such as
+// "x y z". Answers 0 when out of memory.
+static int parseVariables(VM* vm, int superclass, const char* text, size_t length,
+                          char*** variables, int* count) {
+    int inherited = superclass == NO_CLASS ? 0 : vm->classes[superclass].variableCount;
+    int capacity = inherited + (int)length / 2 + 1;
+    char** names = (char**)malloc(sizeof(char*) * (size_t)capacity);
+    if (names == NULL) return 0;
+
+    int total = 0;
+    int ok = 1;
+    for (int i = 0; ok && i < inherited; i++) {
+        names[total] = strdup(vm->classes[superclass].variables[i]);
+        ok = names[total++] != NULL;
+    }
+    size_t i = 0;
+    while (ok && i < length) {
+        while (i < length && isspace((unsigned char)text[i])) i++;
+        size_t start = i;
+        while (i < length && !isspace((unsigned char)text[i])) i++;
+        if (i == start) break;
+        names[total] = strndup(text + start, i - start);
+        ok = names[total++] != NULL;
+    }
+    if (!ok) {
+        freeVariables(names, total - 1);
+        return 0;
+    }
+    *variables = names;
+    *count = total;
+    return 1;
+}
+
+static int addClassEntry(VM* vm) {
+    if (vm->classCount == vm->classCapacity) {
+        int capacity = vm->classCapacity < 64 ? 64 : vm->classCapacity * 2;
+        RuntimeClass* classes = (RuntimeClass*)realloc(vm->classes, sizeof(RuntimeClass) * (size_t)capacity);
+        if (classes == NULL) return NO_CLASS;
+        vm->classes = classes;
+        vm->classCapacity = capacity;
+    }
+    RuntimeClass* class = &vm->classes[vm->classCount];
+    memset(class, 0, sizeof(RuntimeClass));
+    class->name = vm->nil;
+    class->superclass = NO_CLASS;
+    class->partner = NO_CLASS;
+    class->object = vm->nil;
+    return vm->classCount++;
+}
+
+// Allocate the object of a class or metaclass, which is an instance of its
+// metaclass or of Metaclass and knows its own index
+static int makeBehaviorObject(VM* vm, int classIndex) {
+    RuntimeClass* class = &vm->classes[classIndex];
+    int instanceOf = class->isMeta ? CLASS_METACLASS : class->partner;
+    Oop object = instantiate(vm, instanceOf, 0);
+    Oop index = newInteger(vm, classIndex);
+    if (object == 0 || index == 0) return 0;
+    objectSlots(object)[0] = index;
+    vm->classes[classIndex].object = object;
+    return 1;
+}
+
+// The metaclass of a class whose superclass is set. The metaclass of a root
+// class inherits from Class.
+static int addMetaclass(VM* vm, int classIndex) {
+    int meta = addClassEntry(vm);
+    if (meta == NO_CLASS) return 0;
+
+    RuntimeClass* class = &vm->classes[classIndex];
+    RuntimeClass* metaclass = &vm->classes[meta];
+    int superclass = class->superclass == NO_CLASS ? CLASS_CLASS : vm->classes[class->superclass].partner;
+    metaclass->name = class->name;
+    metaclass->superclass = superclass;
+    metaclass->partner = classIndex;
+    metaclass->isMeta = 1;
+    metaclass->format = FORMAT_POINTERS;
+    class->partner = meta;
+    return parseVariables(vm, superclass, "", 0, &metaclass->variables, &metaclass->variableCount);
+}
+
+int defineClass(VM* vm, int superclass, Oop name, const char* variables, size_t length) {
+    int existing = NO_CLASS;
+    Oop value = globalValue(vm, name);
+    if (value != 0 && value != vm->nil) existing = behaviorIndex(vm, value);
+
+    char** names;
+    int count;
+    if (!parseVariables(vm, superclass, variables, length, &names, &count)) {
+        outOfMemory(vm);
+        return NO_CLASS;
+    }
+
+    if (existing != NO_CLASS && !vm->classes[existing].isMeta) {
+        // Redefinition: instances made before keep their old shape
+        RuntimeClass* class = &vm->classes[existing];
+        freeVariables(class->variables, class->variableCount);
+        class->variables = names;
+        class->variableCount = count;
+        class->superclass = superclass;
+        vm->classes[class->partner].superclass = vm->classes[superclass].partner;
+        vm->lookupEpoch++;
+        return existing;
+    }
+
+    int classIndex = addClassEntry(vm);
+    if (classIndex == NO_CLASS) {
+        freeVariables(names, count);
+        outOfMemory(vm);
+        return NO_CLASS;
+    }
+    RuntimeClass* class = &vm->classes[classIndex];
+    class->name = name;
+    class->superclass = superclass;
+    class->format = vm->classes[superclass].format;
+    class->variables = names;
+    class->variableCount = count;
+
+    if (!addMetaclass(vm, classIndex) || !makeBehaviorObject(vm, classIndex) ||
+        !makeBehaviorObject(vm, vm->classes[classIndex].partner) ||
+        !setGlobal(vm, name, vm->classes[classIndex].object)) {
+        outOfMemory(vm);
+        return NO_CLASS;
+    }
+    return classIndex;
+}
+
+// Names joined by spaces, as class definitions write them
+static char* joinVariables(char** variables, int count) {
+    size_t length = 1;
+    for (int i = 0; i < count; i++) length += strlen(variables[i]) + 1;
+    char* text = (char*)malloc(length);
+    if (text == NULL) return NULL;
+    text[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        strcat(text, variables[i]);
+        strcat(text, " ");
+    }
+    return text;
+}
+
+// The class object is remade with the values it had, matched by name, and
+// the metaclasses of subclasses pick up the new variables
+int defineClassSideVariables(VM* vm, int classIndex, const char* variables, size_t length) {
+    int meta = vm->classes[classIndex].partner;
+    char** names;
+    int count;
+    if (!parseVariables(vm, vm->classes[meta].superclass, variables, length, &names, &count)) {
+        outOfMemory(vm);
+        return 0;
+    }
+    char** oldNames = vm->classes[meta].variables;
+    int oldCount = vm->classes[meta].variableCount;
+    vm->classes[meta].variables = names;
+    vm->classes[meta].variableCount = count;
+
+    Oop old = vm->classes[classIndex].object;
+    Oop object = instantiate(vm, meta, 0);
+    int ok = object != 0;
+    for (int i = 0; ok && i < count; i++) {
+        for (int j = 0; j < oldCount; j++) {
+            if (strcmp(names[i], oldNames[j]) == 0) {
+                objectSlots(object)[i] = objectSlots(old)[j];
+                break;
+            }
+        }
+    }
+    if (ok) {
+        vm->classes[classIndex].object = object;
+        ok = setGlobal(vm, vm->classes[classIndex].name, object);
+    }
+
+    for (int i = 0; ok && i < vm->classCount; i++) {
+        RuntimeClass* subclass = &vm->classes[i];
+        if (subclass->isMeta || subclass->superclass != classIndex) continue;
+        RuntimeClass* submeta = &vm->classes[subclass->partner];
+        char* own = joinVariables(submeta->variables + oldCount, submeta->variableCount - oldCount);
+        ok = own != NULL && defineClassSideVariables(vm, i, own, strlen(own));
+        free(own);
+    }
+    freeVariables(oldNames, oldCount);
+    return ok;
+}
+
+// Method dictionaries
+
+static int methodSlot(MethodEntry* entries, int capacity, Oop selector) {
+    int mask = capacity - 1;
+    int slot = (int)(objectHeader(selector)->hash & (uint32_t)mask);
+    while (entries[slot].selector != 0 && entries[slot].selector != selector) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int addMethod(MethodDictionary* dictionary, Oop selector, Method* method) {
+    if ((dictionary->count + 1) * 2 > dictionary->capacity) {
+        int capacity = dictionary->capacity < 16 ? 16 : dictionary->capacity * 2;
+        MethodEntry* entries = (MethodEntry*)calloc((size_t)capacity, sizeof(MethodEntry));
+        if (entries == NULL) return 0;
+        for (int i = 0; i < dictionary->capacity; i++) {
+            MethodEntry* entry = &dictionary->entries[i];
+            if (entry->selector != 0) entries[methodSlot(entries, capacity, entry->selector)] = *entry;
+        }
+        free(dictionary->entries);
+        dictionary->entries = entries;
+        dictionary->capacity = capacity;
+    }
+
+    MethodEntry* entry = &dictionary->entries[methodSlot(dictionary->entries, dictionary->capacity, selector)];
+    if (entry->selector == 0) dictionary->count++;
+    entry->selector = selector;
+    entry->method = method;
+    return 1;
+}
+
+static Method* searchHierarchy(VM* vm, int classIndex, Oop selector) {
+    while (classIndex != NO_CLASS) {
+        RuntimeClass* class = &vm->classes[classIndex];
+        if (class->methods.count > 0) {
+            MethodEntry* entry = &class->methods.entries[methodSlot(class->methods.entries, class->methods.capacity, selector)];
+            if (entry->selector != 0) return entry->method;
+        }
+        classIndex = class->superclass;
+    }
+    return NULL;
+}
+
+Method* lookupMethod(VM* vm, int classIndex, Oop selector) {
+    uint32_t hash = objectHeader(selector)->hash ^ (uint32_t)classIndex * 2654435761u;
+    LookupCacheEntry* entry = &vm->lookupCache[hash & (LOOKUP_CACHE_SIZE - 1)];
+    if (entry->epoch == vm->lookupEpoch && entry->selector == selector && entry->classIndex == classIndex) {
+        vm->statistics.lookupHits++;
+        return entry->method;
+    }
+    vm->statistics.lookupMisses++;
+    Method* method = searchHierarchy(vm, classIndex, selector);
+    if (method != NULL) {
+        entry->selector = selector;
+        entry->method = method;
+        entry->classIndex = classIndex;
+        entry->epoch = vm->lookupEpoch;
+    }
+    return method;
+}
+
+// Methods
+
+static int registerMethod(VM* vm, Method* method) {
+    if (vm->methodCount == vm->methodCapacity) {
+        int capacity = vm->methodCapacity < 256 ? 256 : vm->methodCapacity * 2;
+        Method** methods = (Method**)realloc(vm->methods, sizeof(Method*) * (size_t)capacity);
+        if (methods == NULL) return 0;
+        vm->methods = methods;
+        vm->methodCapacity = capacity;
+    }
+    vm->methods[vm->methodCount++] = method;
+    return 1;
+}
+
+static void freeMethod(VM* vm, Method* method) {
+    freeNativeCode(method->native);
+    for (int i = 0; i < method->siteCount; i++) freeSendCache(&method->caches[i]);
+    // The rest of a loaded method is part of its image
+    if (isImageAddress(vm->image, method)) return;
+    free(method->caches);
+    free(method->siteIndex);
+    free(method->literals);
+    free(method->blocks);
+    free(method);
+}
+
+static Oop literalObject(VM* vm, const Literal* literal) {
+    switch (literal->kind) {
+        case LITERAL_NIL: return vm->nil;
+        case LITERAL_TRUE: return vm->trueObject;
+        case LITERAL_FALSE: return vm->falseObject;
+        case LITERAL_INTEGER: return newInteger(vm, literal->as.integer);
+        case LITERAL_FLOAT:
+        case LITERAL_SCALED: return newFloat(vm, literal->as.number.value);
+        case LITERAL_CHARACTER: return characterObject(literal->as.character);
+        case LITERAL_STRING: return newString(vm, literal->as.text.bytes, (size_t)literal->as.text.length);
+        case LITERAL_SYMBOL: return internSymbol(vm, literal->as.text.bytes, (size_t)literal->as.text.length);
+        case LITERAL_BYTE_ARRAY:
+            return newByteObject(vm, CLASS_BYTE_ARRAY, literal->as.text.bytes, (size_t)literal->as.text.length);
+        case LITERAL_GLOBAL: {
+            Oop name = internSymbol(vm, literal->as.text.bytes, (size_t)literal->as.text.length);
+            return name != 0 ? globalAssociation(vm, name) : 0;
+        }
+        case LITERAL_ARRAY: {
+            Oop array = instantiate(vm, CLASS_ARRAY, (uint32_t)literal->as.array.count);
+            for (int i = 0; array != 0 && i < literal->as.array.count; i++) {
+                Oop element = literalObject(vm, &literal->as.array.elements[i]);
+                if (element == 0) return 0;
+                objectSlots(array)[i] = element;
+            }
+            return array;
+        }
+        case LITERAL_BLOCK:
+            return vm->nil;
+    }
+    return vm->nil;
+}
+
+static int isSend(Bytecode opcode) {
+    return opcode == BC_SEND || opcode == BC_SUPER_SEND || opcode >= FIRST_SPECIAL_SEND;
+}
+
+// Give every send site an inline cache
+static int makeSendCaches(Method* method) {
+    const CompiledCode* code = method->code;
+    int pc = 0;
+    while (pc < code->length) {
+        Bytecode opcode;
+        int first, second;
+        pc = decodeInstruction(code, pc, &opcode, &first, &second);
+        if (isSend(opcode)) method->siteCount++;
+    }
+    if (method->siteCount == 0) return 1;
+    method->caches = (SendCache*)calloc((size_t)method->siteCount, sizeof(SendCache));
+    method->siteIndex = (uint32_t*)calloc((size_t)code->length, sizeof(uint32_t));
+    if (method->caches == NULL || method->siteIndex == NULL) {
+        method->siteCount = 0;
+        return 0;
+    }
+    uint32_t site = 0;
+    pc = 0;
+    while (pc < code->length) {
+        Bytecode opcode;
+        int first, second;
+        int next = decodeInstruction(code, pc, &opcode, &first, &second);
+        if (isSend(opcode)) method->siteIndex[pc] = site++;
+        pc = next;
+    }
+    return 1;
+}
+
+static int containsNonLocalReturn(const CompiledCode* code) {
+    int pc = 0;
+    while (pc < code->length) {
+        Bytecode opcode;
+        int first, second;
+        pc = decodeInstruction(code, pc, &opcode, &first, &second);
+        if (opcode == BC_NON_LOCAL_RETURN) return 1;
+    }
+    for (int i = 0; i < code->literalCount; i++) {
+        if (code->literals[i].kind == LITERAL_BLOCK && containsNonLocalReturn(code->literals[i].as.block)) return 1;
+    }
+    return 0;
+}
+
+// Make a method, and its blocks, from compiled code. Once the method is
+// registered the VM owns the code, even if making it fails later on.
+static Method* makeMethod(VM* vm, CompiledCode* code, int classIndex, Method* outer) {
+    int count = code->literalCount > 0 ? code->literalCount : 1;
+    Method* method = (Method*)calloc(1, sizeof(Method));
+    if (method != NULL) {
+        // Cleared, as the collector looks at them before they are all made
+        method->literals = (Oop*)calloc((size_t)count, sizeof(Oop));
+        method->blocks = (Method**)calloc((size_t)count, sizeof(Method*));
+    }
+    if (method == NULL || method->literals == NULL || method->blocks == NULL || !registerMethod(vm, method)) {
+        if (method != NULL) freeMethod(vm, method);
+        // Blocks belong to the code of their method
+        if (outer == NULL) freeCompiledCode(code);
+        return NULL;
+    }
+    method->code = code;
+    method->classIndex = classIndex;
+    method->outer = outer;
+    method->selector = vm->nil;
+    method->primitive = findPrimitive(code->primitive);
+    method->nonLocalReturn = code->isBlock && containsNonLocalReturn(code);
+    if (code->selector != NULL) {
+        method->selector = symbolFor(vm, code->selector);
+        if (method->selector == 0) return NULL;
+    }
+    if (!makeSendCaches(method)) return NULL;
+
+    for (int i = 0; i < code->literalCount; i++) {
+        method->literals[i] = literalObject(vm, &code->literals[i]);
+        if (method->literals[i] == 0) return NULL;
+        if (code->literals[i].kind == LITERAL_BLOCK) {
+            method->blocks[i] = makeMethod(vm, code->literals[i].as.block, classIndex, method);
+            if (method->blocks[i] == NULL) return NULL;
+            // One closure serves every evaluation of a clean block
+            if (method->blocks[i]->code->kind == BLOCK_CLEAN) {
+                method->literals[i] = instantiate(vm, CLASS_BLOCK_CLOSURE, 0);
+                if (method->literals[i] == 0) return NULL;
+                asClosure(method->literals[i])->method = method->blocks[i];
+            }
+        }
+    }
+    return method;
+}
+
+// Compile a tree and report what goes wrong against the text it came from
+static CompiledCode* compileTree(ASTNode* ast, const char* text, int firstLine, const char* path,
+                                 char** variables, int variableCount) {
+    SourceMap map;
+    initSourceMap(&map, text, strlen(text), firstLine);
+    ScopeOptions options = {variables, variableCount, NULL, NULL};
+    CompileError error;
+    CompiledCode* code = compileAST(ast, &options, &error);
+    if (code == NULL) {
+        int line = 0;
+        int column = 0;
+        spanStart(&map, error.span, &line, &column);
+        fprintf(stderr, "%s:%d:%d: %s\n", path, line, column, error.message);
+    }
+    freeSourceMap(&map);
+    return code;
+}
+
+Method* compileDoit(VM* vm, const char* source, const char* path, int firstLine) {
+    Parser parser;
+    initParserAtLine(&parser, source, firstLine);
+    ASTNode* ast = parse(&parser);
+    CompiledCode* code = NULL;
+    if (!parser.hadError && ast != NULL) {
+        code = compileTree(ast, source, firstLine, path, NULL, 0);
+    }
+    freeASTNode(ast);
+    if (code == NULL) return NULL;
+
+    Method* method = makeMethod(vm, code, CLASS_UNDEFINED_OBJECT, NULL);
+    if (method == NULL) outOfMemory(vm);
+    return method;
+}
+
+// Loading
+
+static void echoValue(VM* vm, Oop value) {
+    Oop text;
+    if (!sendMessage(vm, value, symbolFor(vm, "printString"), NULL, 0, &text)) return;
+    if (isString(vm, text)) {
+        writeBytes(&vm->transcript, (const char*)objectBytes(text), objectHeader(text)->size);
+        writeChar(&vm->transcript, '\n');
+    }
+}
+
+static int runDoit(VM* vm, const char* text, const char* path, int firstLine, int echo) {
+    Method* method = compileDoit(vm, text, path, firstLine);
+    Oop result;
+    if (method == NULL || !interpret(vm, method, vm->nil, &result)) return 0;
+    if (echo) echoValue(vm, result);
+    return 1;
+}
+
+static int installChunkMethod(VM* vm, const SourceChunk* chunk, const char* path) {
+    Oop className = internSymbol(vm, chunk->className, (size_t)chunk->classNameLength);
+    Oop classObject = className != 0 ? globalValue(vm, className) : 0;
+    int classIndex = classObject != 0 ? behaviorIndex(vm, classObject) : NO_CLASS;
+    if (classIndex == NO_CLASS) {
+        fprintf(stderr, "%s:%d: methods for the undefined class %.*s\n", path, chunk->firstLine,
+                chunk->classNameLength, chunk->className);
+        return 0;
+    }
+    if (chunk->isMeta) classIndex = vm->classes[classIndex].partner;
+
+    int hadError = 0;
+    char* text = NULL;
+    ASTNode* ast = parseChunk(chunk, &text, &hadError);
+    CompiledCode* code = NULL;
+    if (!hadError && ast != NULL) {
+        RuntimeClass* class = &vm->classes[classIndex];
+        code = compileTree(ast, text, chunk->firstLine, path, class->variables, class->variableCount);
+    }
+    freeASTNode(ast);
+    free(text);
+    if (code == NULL) return 0;
+
+    Method* method = makeMethod(vm, code, classIndex, NULL);
+    if (method == NULL || !addMethod(&vm->classes[classIndex].methods, method->selector, method)) {
+        outOfMemory(vm);
+        return 0;
+    }
+    // Cached lookups may now answer an overridden or replaced method
+    vm->lookupEpoch++;
+    return 1;
+}
+
+int loadSource(VM* vm, const char* source, const char* path, int echo) {
+    size_t length = strlen(source);
+    if (!containsMethodChunks(source, length)) {
+        return runDoit(vm, source, path, 1, echo) ? 0 : 1;
+    }
+
+    ChunkScanner scanner;
+    SourceChunk chunk;
+    int failures = 0;
+    initChunkScanner(&scanner, source, length);
+    while (nextChunk(&scanner, &chunk)) {
+        // No object is held in C between chunks
+        if (vm->memory.collectionRequested) collectGarbage(&vm->memory, 0);
+        if (chunk.kind == CHUNK_METHOD) {
+            if (!installChunkMethod(vm, &chunk, path)) failures++;
+        } else if (chunk.kind == CHUNK_DOIT) {
+            // Collapse the '!!' escapes, as parseChunk does
+            char* text = (char*)malloc((size_t)chunk.length + 1);
+            if (text == NULL) {
+                failures++;
+                continue;
+            }
+            int textLength = 0;
+            for (int i = 0; i < chunk.length; i++) {
+                text[textLength++] = chunk.start[i];
+                if (chunk.start[i] == '!' && i + 1 < chunk.length && chunk.start[i + 1] == '!') i++;
+            }
+            text[textLength] = '\0';
+            if (!runDoit(vm, text, path, chunk.firstLine, echo)) failures++;
+            free(text);
+        }
+    }
+    flushOutputBuffer(&vm->transcript);
+    return failures;
+}
+
+// Garbage collection
+
+int pushRoot(VM* vm, Oop* variable) {
+    if (vm->rootCount == vm->rootCapacity) {
+        int capacity = vm->rootCapacity < 16 ? 16 : vm->rootCapacity * 2;
+        Oop** roots = (Oop**)realloc(vm->roots, sizeof(Oop*) * (size_t)capacity);
+        if (roots == NULL) {
+            outOfMemory(vm);
+            return 0;
+        }
+        vm->roots = roots;
+        vm->rootCapacity = capacity;
+    }
+    vm->roots[vm->rootCount++] = variable;
+    return 1;
+}
+
+void popRoots(VM* vm, int count) {
+    vm->rootCount -= count;
+}
+
+static void visitTable(ObjectMemory* memory, SlotVisitor visit, Oop* table, int capacity) {
+    for (int i = 0; i < capacity; i++) {
+        if (table[i] != 0) visit(memory, &table[i]);
+    }
+}
+
+// Every slot outside the heap that holds an object
+static void enumerateRoots(void* context, ObjectMemory* memory, SlotVisitor visit) {
+    VM* vm = (VM*)context;
+    visit(memory, &memory->nil);
+    visit(memory, &vm->nil);
+    visit(memory, &vm->trueObject);
+    visit(memory, &vm->falseObject);
+    visit(memory, &vm->doesNotUnderstandSelector);
+    visitTable(memory, visit, vm->specialSelectors, SPECIAL_SELECTOR_COUNT);
+    visitTable(memory, visit, vm->symbols, vm->symbolCapacity);
+    visitTable(memory, visit, vm->globals, vm->globalCapacity);
+
+    for (int i = 0; i < vm->classCount; i++) {
+        RuntimeClass* class = &vm->classes[i];
+        if (class->name != 0) visit(memory, &class->name);
+        if (class->object != 0) visit(memory, &class->object);
+        for (int j = 0; j < class->methods.capacity; j++) {
+            if (class->methods.entries[j].selector != 0) visit(memory, &class->methods.entries[j].selector);
+        }
+    }
+    for (int i = 0; i < vm->methodCount; i++) {
+        Method* method = vm->methods[i];
+        if (method->selector != 0) visit(memory, &method->selector);
+        if (method->code != NULL) visitTable(memory, visit, method->literals, method->code->literalCount);
+    }
+    for (int i = 0; i < LOOKUP_CACHE_SIZE; i++) {
+        if (vm->lookupCache[i].selector != 0) visit(memory, &vm->lookupCache[i].selector);
+    }
+
+    for (Oop* slot = vm->stack; slot < vm->stackTop; slot++) visit(memory, slot);
+    for (int i = 0; i < vm->frameCount; i++) {
+        visit(memory, &vm->frames[i].receiver);
+        visit(memory, &vm->frames[i].environment);
+    }
+    for (int i = 0; i < vm->rootCount; i++) visit(memory, vm->roots[i]);
+}
+
+// Startup
+
+#define KERNEL_CLASS_TABLE_ENTRY(index, name, superclass, format, variables) \
+    {#name, CLASS_##superclass, format, variables},
+
+static const struct {
+    const char* name;
+    int superclass;
+    ObjectFormat format;
+    const char* variables;
+} kernelClasses[] = {
+    KERNEL_CLASSES(KERNEL_CLASS_TABLE_ENTRY)
+};
+
+static int bootKernelClasses(VM* vm) {
+    for (int i = 0; i < KERNEL_CLASS_COUNT; i++) {
+        int classIndex = addClassEntry(vm);
+        if (classIndex != i) return 0;
+        RuntimeClass* class = &vm->classes[i];
+        class->superclass = kernelClasses[i].superclass;
+        class->format = kernelClasses[i].format;
+        if (!parseVariables(vm, class->superclass, kernelClasses[i].variables, strlen(kernelClasses[i].variables),
+                            &class->variables, &class->variableCount)) {
+            return 0;
+        }
+    }
+
+    // The objects below need SmallInteger and Symbol, which now exist
+    Oop nil = allocateObject(&vm->memory, CLASS_UNDEFINED_OBJECT, FORMAT_POINTERS, 0);
+    if (nil == 0) return 0;
+    vm->nil = nil;
+    vm->memory.nil = nil;
+    for (int i = 0; i < vm->classCount; i++) {
+        vm->classes[i].name = nil;
+        vm->classes[i].object = nil;
+    }
+    vm->trueObject = instantiate(vm, CLASS_TRUE, 0);
+    vm->falseObject = instantiate(vm, CLASS_FALSE, 0);
+    if (vm->trueObject == 0 || vm->falseObject == 0) return 0;
+
+    for (int i = 0; i < KERNEL_CLASS_COUNT; i++) {
+        vm->classes[i].name = symbolFor(vm, kernelClasses[i].name);
+        if (vm->classes[i].name == 0 || !addMetaclass(vm, i)) return 0;
+    }
+    for (int i = 0; i < KERNEL_CLASS_COUNT; i++) {
+        if (!makeBehaviorObject(vm, i) || !makeBehaviorObject(vm, vm->classes[i].partner) ||
+            !setGlobal(vm, vm->classes[i].name, vm->classes[i].object)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int bootObjects(VM* vm) {
+    for (int i = 0; i < SPECIAL_SELECTOR_COUNT; i++) {
+        vm->specialSelectors[i] = symbolFor(vm, specialSelector(i));
+        if (vm->specialSelectors[i] == 0) return 0;
+    }
+    vm->doesNotUnderstandSelector = symbolFor(vm, "doesNotUnderstand:");
+
+    Oop smalltalk = instantiate(vm, CLASS_SYSTEM_DICTIONARY, 0);
+    Oop name = symbolFor(vm, "Smalltalk");
+    return vm->doesNotUnderstandSelector != 0 && smalltalk != 0 && name != 0 && setGlobal(vm, name, smalltalk);
+}
+
+int initVM(VM* vm, const char* imagePath) {
+    memset(vm, 0, sizeof(VM));
+    int memory = initObjectMemory(&vm->memory);
+    vm->memory.enumerateRoots = enumerateRoots;
+    vm->memory.rootContext = vm;
+    vm->maxFrames = MAX_FRAMES;
+    vm->lookupEpoch = 1;
+    vm->stack = (Oop*)malloc(sizeof(Oop) * STACK_SLOTS);
+    vm->frames = (Frame*)malloc(sizeof(Frame) * MAX_FRAMES);
+    if (!memory || vm->stack == NULL || vm->frames == NULL || !initOutputBuffer(&vm->transcript, stdout, 0)) {
+        fprintf(stderr, "Not enough memory for the virtual machine.\n");
+        return 0;
+    }
+    vm->stackTop = vm->stack;
+    vm->stackLimit = vm->stack + STACK_SLOTS;
+
+    if (imagePath != NULL) return loadImage(vm, imagePath);
+    if (!bootKernelClasses(vm) || !bootObjects(vm)) {
+        fprintf(stderr, "Not enough memory to boot the kernel classes.\n");
+        return 0;
+    }
+    if (loadSource(vm, kernelSource, "kernel", 0) != 0) {
+        fprintf(stderr, "The kernel library failed to load.\n");
+        return 0;
+    }
+    return 1;
+}
+
+void freeVM(VM* vm) {
+    flushOutputBuffer(&vm->transcript);
+    freeOutputBuffer(&vm->transcript);
+    for (int i = 0; i < vm->methodCount; i++) {
+        // Blocks belong to the code of their method
+        Method* method = vm->methods[i];
+        if (method->outer == NULL && !isImageAddress(vm->image, method)) freeCompiledCode(method->code);
+        freeMethod(vm, method);
+    }
+    free(vm->methods);
+    for (int i = 0; i < vm->classCount; i++) {
+        freeVariables(vm->classes[i].variables, vm->classes[i].variableCount);
+        free(vm->classes[i].methods.entries);
+    }
+    free(vm->classes);
+    free(vm->symbols);
+    free(vm->globals);
+    free(vm->stack);
+    free(vm->frames);
+    free(vm->roots);
+    freeJit(vm);
+    freeObjectMemory(&vm->memory);
+    freeImage(vm);
+}
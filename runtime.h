@@ -0,0 +1,370 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "memory.h"
+#include "bytecode.h"
+#include "output.h"
+#include "sendcache.h"
+
+/*
+ * Runtime of the virtual machine: the class table, interned symbols, global
+ * variables, installed methods and the loader that runs doits and installs
+ * methods from source. The interpreter is in interpreter.h and the primitives
+ * in primitives.h.
+ *
+ * Every class has an entry in the class table; an object's header holds the
+ * index of its class. Class objects are instances of their metaclass and
+ * metaclass objects instances of Metaclass; both keep their own index in a
+ * hidden first instance variable. The classes the VM refers to directly sit
+ * at fixed indices, generated from KERNEL_CLASSES; their methods come from
+ * the kernel library (kernel.c), which is loaded like any other source.
+ */
+
+#define NO_CLASS -1
+
+/* Index, name, superclass, format of instances and instance variables */
+#define KERNEL_CLASSES(X) \
+    X(OBJECT, Object, NONE, FORMAT_POINTERS, "") \
+    X(BEHAVIOR, Behavior, OBJECT, FORMAT_POINTERS, CLASS_INDEX_VARIABLE) \
+    X(CLASS, Class, BEHAVIOR, FORMAT_POINTERS, "") \
+    X(METACLASS, Metaclass, BEHAVIOR, FORMAT_POINTERS, "") \
+    X(UNDEFINED_OBJECT, UndefinedObject, OBJECT, FORMAT_POINTERS, "") \
+    X(BOOLEAN, Boolean, OBJECT, FORMAT_POINTERS, "") \
+    X(TRUE, True, BOOLEAN, FORMAT_POINTERS, "") \
+    X(FALSE, False, BOOLEAN, FORMAT_POINTERS, "") \
+    X(MAGNITUDE, Magnitude, OBJECT, FORMAT_POINTERS, "") \
+    X(CHARACTER, Character, MAGNITUDE, FORMAT_RAW, "") \
+    X(NUMBER, Number, MAGNITUDE, FORMAT_POINTERS, "") \
+    X(INTEGER, Integer, NUMBER, FORMAT_POINTERS, "") \
+    X(SMALL_INTEGER, SmallInteger, INTEGER, FORMAT_RAW, "") \
+    X(LARGE_POSITIVE_INTEGER, LargePositiveInteger, INTEGER, FORMAT_BYTES, "") \
+    X(LARGE_NEGATIVE_INTEGER, LargeNegativeInteger, LARGE_POSITIVE_INTEGER, FORMAT_BYTES, "") \
+    X(FLOAT, Float, NUMBER, FORMAT_RAW, "") \
+    X(COLLECTION, Collection, OBJECT, FORMAT_POINTERS, "") \
+    X(SEQUENCEABLE_COLLECTION, SequenceableCollection, COLLECTION, FORMAT_POINTERS, "") \
+    X(ARRAYED_COLLECTION, ArrayedCollection, SEQUENCEABLE_COLLECTION, FORMAT_POINTERS, "") \
+    X(ARRAY, Array, ARRAYED_COLLECTION, FORMAT_INDEXABLE, "") \
+    X(BYTE_ARRAY, ByteArray, ARRAYED_COLLECTION, FORMAT_BYTES, "") \
+    X(STRING, String, ARRAYED_COLLECTION, FORMAT_BYTES, "") \
+    X(SYMBOL, Symbol, STRING, FORMAT_BYTES, "") \
+    X(BLOCK_CLOSURE, BlockClosure, OBJECT, FORMAT_CLOSURE, "") \
+    X(ASSOCIATION, Association, MAGNITUDE, FORMAT_POINTERS, "key value") \
+    X(MESSAGE, Message, OBJECT, FORMAT_POINTERS, "selector arguments") \
+    X(ENVIRONMENT, Environment, OBJECT, FORMAT_INDEXABLE, "") \
+    X(SYSTEM_DICTIONARY, SystemDictionary, OBJECT, FORMAT_POINTERS, "")
+
+/* Name of the hidden variable of class and metaclass objects; it cannot be
+ * written in source */
+#define CLASS_INDEX_VARIABLE "#index"
+
+#define KERNEL_CLASS_ENUM_ENTRY(index, name, superclass, format, variables) CLASS_##index,
+
+enum {
+    CLASS_NONE = NO_CLASS,
+    KERNEL_CLASSES(KERNEL_CLASS_ENUM_ENTRY)
+    KERNEL_CLASS_COUNT
+};
+
+typedef struct VM VM;
+typedef struct NativeCode NativeCode;
+typedef struct Jit Jit;
+typedef struct Image Image;
+
+/* Answers PRIMITIVE_SUCCEEDED with the result stored, PRIMITIVE_FAILED to run
+ * the method's own code instead, or PRIMITIVE_ERROR after reporting a runtime
+ * error. arguments[0] is the receiver. */
+typedef int (*PrimitiveFunction)(VM* vm, Oop* arguments, int argumentCount, Oop* result);
+
+#define PRIMITIVE_SUCCEEDED 1
+#define PRIMITIVE_FAILED 0
+#define PRIMITIVE_ERROR -1
+
+struct Method {
+    CompiledCode* code;
+    Oop* literals;              /* Objects of the literal frame; nil for blocks */
+    Method** blocks;            /* Code of the block literals, NULL elsewhere */
+    PrimitiveFunction primitive;
+    Oop selector;               /* nil for blocks and doits */
+    int classIndex;             /* Class it is installed in; super sends look above it */
+    Method* outer;              /* Blocks: the method or block they appear in */
+    int nonLocalReturn;         /* Blocks: ^ appears in it or in a block inside it */
+    SendCache* caches;          /* One per send site, in code order */
+    uint32_t* siteIndex;        /* Cache of the send at each bytecode offset */
+    int siteCount;
+    uint32_t hotness;           /* Activations and loop iterations, until compiled */
+    NativeCode* native;         /* Machine code (jit.h), NULL while interpreted */
+};
+
+typedef struct {
+    Oop selector;
+    Method* method;
+} MethodEntry;
+
+typedef struct {
+    MethodEntry* entries;       /* Open addressing on the selector's identity hash */
+    int count;
+    int capacity;
+} MethodDictionary;
+
+typedef struct {
+    Oop name;                   /* Symbol; a metaclass shares its class's name */
+    int superclass;             /* Class index, or NO_CLASS */
+    int partner;                /* Metaclass of a class, class of a metaclass */
+    int isMeta;
+    ObjectFormat format;        /* Of instances */
+    char** variables;           /* Named instance variables, inherited ones first */
+    int variableCount;
+    MethodDictionary methods;
+    Oop object;                 /* The class or metaclass object */
+} RuntimeClass;
+
+/* Global method cache, direct-mapped on the class index and the selector's
+ * identity hash. It answers lookups that miss the inline caches; entries of
+ * an earlier lookup epoch count as empty. */
+#define LOOKUP_CACHE_SIZE 1024
+
+typedef struct {
+    Oop selector;
+    Method* method;
+    int classIndex;
+    uint32_t epoch;
+} LookupCacheEntry;
+
+/* Stack slots kept free above an activation for values primitives push */
+#define STACK_SLACK 16
+
+/* An activation. The receiver (or the closure, for blocks), the arguments,
+ * the temporaries and the operand stack lie in that order on the VM stack
+ * from base upwards. */
+typedef struct {
+    Method* method;
+    const uint8_t* ip;          /* Saved while a callee runs */
+    Oop* base;
+    Oop receiver;
+    Oop environment;            /* Captured variables, or those of the enclosing code; nil for none */
+    uint64_t serial;            /* Tells apart the activations that use this frame in turn */
+    uint64_t homeSerial;        /* Blocks: the method activation ^ returns from */
+    uint32_t home;              /* Blocks: frame index of that activation */
+    int isBlock;
+    int hasClosures;            /* Blocks that may ^ to this method activation exist */
+} Frame;
+
+typedef struct {
+    uint64_t bytecodes;
+    uint64_t sends;
+    uint64_t primitiveCalls;
+    uint64_t tailSends;
+    uint64_t lookupHits;        /* Of the global method cache */
+    uint64_t lookupMisses;
+} VMStatistics;
+
+struct VM {
+    ObjectMemory memory;
+    RuntimeClass* classes;
+    int classCount;
+    int classCapacity;
+
+    Oop* symbols;               /* Open addressing on the text */
+    int symbolCount;
+    int symbolCapacity;
+    Oop* globals;               /* Associations, open addressing on the key */
+    int globalCount;
+    int globalCapacity;
+    Method** methods;           /* Every method, block and doit, for freeing */
+    int methodCount;
+    int methodCapacity;
+
+    Oop nil;
+    Oop trueObject;
+    Oop falseObject;
+    Oop specialSelectors[SPECIAL_SELECTOR_COUNT];
+    Oop doesNotUnderstandSelector;
+
+    Oop* stack;
+    Oop* stackTop;              /* First free slot while no code runs */
+    Oop* stackLimit;
+    Frame* frames;
+    int frameCount;
+    int maxFrames;
+    int returnBarrier;          /* Lowest frame ^ may return to: that of the innermost call from C */
+    int unwindFrame;            /* While native code unwinds to a ^'s home: its frame and value */
+    Oop unwindValue;
+    uint64_t nextSerial;
+    uint32_t lookupEpoch;       /* Moves on when lookups may answer differently */
+    LookupCacheEntry lookupCache[LOOKUP_CACHE_SIZE];
+    Oop** roots;                /* Variables of C code; see pushRoot */
+    int rootCount;
+    int rootCapacity;
+
+    OutputBuffer transcript;
+    VMStatistics statistics;
+    Jit* jit;                   /* NULL when methods are only interpreted */
+    Image* image;               /* The image the VM was loaded from (image.h), or NULL */
+};
+
+/* Boots the kernel classes and loads the kernel library, or with an image
+ * path loads that image instead. Answers 0 on failure. */
+int initVM(VM* vm, const char* imagePath);
+void freeVM(VM* vm);
+
+/* Print a runtime error and the active methods on stderr */
+void runtimeError(VM* vm, const char* format, ...);
+
+/* Objects */
+
+static inline int classIndexOf(VM* vm, Oop object) {
+    (void)vm;
+    switch (object & TAG_MASK) {
+        case 0: return (int)objectHeader(object)->classIndex;
+        case INTEGER_TAG: return CLASS_SMALL_INTEGER;
+        case CHARACTER_TAG: return CLASS_CHARACTER;
+        default: return CLASS_FLOAT;
+    }
+}
+
+/*
+ * Numbers and characters. SmallIntegers are 64-bit: those that fit in 61 bits
+ * are immediate, the others are boxed in a FORMAT_RAW object of the same
+ * class. Integers beyond 64 bits are LargeIntegers (see largeinteger.h).
+ * Floats are SmallFloats when their exponent is within 127 of the bias (and
+ * for zero), boxed otherwise; the class is Float either way. Characters are
+ * always immediate. Only newInteger and newFloat decide on a representation,
+ * and they box only what does not fit.
+ */
+
+#define SMALL_INTEGER_MIN (-(1LL << 60))
+#define SMALL_INTEGER_MAX ((1LL << 60) - 1)
+
+/* SmallFloats store the exponent less this, which must come out in 1..255;
+ * 0 stands for a zero of either sign */
+#define SMALL_FLOAT_EXPONENT_OFFSET 895
+
+static inline int isSmallInteger(Oop object) {
+    return (object & TAG_MASK) == INTEGER_TAG;
+}
+
+static inline int fitsSmallInteger(long long value) {
+    return value >= SMALL_INTEGER_MIN && value <= SMALL_INTEGER_MAX;
+}
+
+/* value must fit */
+static inline Oop smallIntegerObject(long long value) {
+    return ((Oop)value << TAG_BITS) | INTEGER_TAG;
+}
+
+static inline long long smallIntegerValue(Oop object) {
+    return (long long)((intptr_t)object >> TAG_BITS);
+}
+
+static inline int isSmallFloat(Oop object) {
+    return (object & TAG_MASK) == FLOAT_TAG;
+}
+
+typedef union {
+    double value;
+    uint64_t bits;
+} FloatBits;
+
+/* The SmallFloat for a value, or 0 when it needs a box. The bits are rotated
+ * to put the sign lowest, so the rebased exponent ends up highest. */
+static inline Oop smallFloatObject(double value) {
+    FloatBits number = { value };
+    uint64_t exponent = (number.bits >> 52) & 0x7ff;
+    uint64_t rotated = (number.bits << 1) | (number.bits >> 63);
+    if (exponent > SMALL_FLOAT_EXPONENT_OFFSET && exponent <= SMALL_FLOAT_EXPONENT_OFFSET + 255) {
+        return ((rotated - ((uint64_t)SMALL_FLOAT_EXPONENT_OFFSET << 53)) << TAG_BITS) | FLOAT_TAG;
+    }
+    if (exponent == 0 && (number.bits << 12) == 0) return (rotated << TAG_BITS) | FLOAT_TAG;
+    return 0;
+}
+
+static inline double smallFloatValue(Oop object) {
+    uint64_t rotated = object >> TAG_BITS;
+    if (rotated > 1) rotated += (uint64_t)SMALL_FLOAT_EXPONENT_OFFSET << 53;
+    FloatBits number;
+    number.bits = (rotated >> 1) | (rotated << 63);
+    return number.value;
+}
+
+static inline Oop characterObject(int value) {
+    return ((Oop)value << TAG_BITS) | CHARACTER_TAG;
+}
+
+static inline int characterCode(Oop object) {
+    return (int)(object >> TAG_BITS);
+}
+
+static inline int isInteger(VM* vm, Oop object) {
+    return classIndexOf(vm, object) == CLASS_SMALL_INTEGER;
+}
+
+static inline long long integerValue(Oop object) {
+    return isSmallInteger(object) ? smallIntegerValue(object) : *(long long*)objectSlots(object);
+}
+
+static inline int isFloat(VM* vm, Oop object) {
+    return classIndexOf(vm, object) == CLASS_FLOAT;
+}
+
+static inline double floatValue(Oop object) {
+    return isSmallFloat(object) ? smallFloatValue(object) : *(double*)objectSlots(object);
+}
+
+/* The allocation functions answer 0 when out of memory, after reporting it */
+Oop instantiate(VM* vm, int classIndex, uint32_t size);
+Oop newInteger(VM* vm, long long value);
+Oop newFloat(VM* vm, double value);
+Oop newString(VM* vm, const char* text, size_t length);
+Oop internSymbol(VM* vm, const char* text, size_t length);
+
+/* Strings and symbols */
+int isString(VM* vm, Oop object);
+
+/* Garbage collection. The collector runs at safepoints of the interpreter,
+ * where everything live is on the stack, in the frames or in the tables of
+ * the VM. C code that keeps objects across a call into the interpreter
+ * registers the variables that hold them, and pops them in reverse order. */
+int pushRoot(VM* vm, Oop* variable);
+void popRoots(VM* vm, int count);
+
+static inline Oop booleanObject(VM* vm, int value) {
+    return value ? vm->trueObject : vm->falseObject;
+}
+
+/* Classes and methods */
+
+/* Index of the class a class or metaclass object stands for, or NO_CLASS */
+int behaviorIndex(VM* vm, Oop object);
+/* Defines a subclass, or redefines the instance variables of an existing
+ * class of that name. Answers the class index, or NO_CLASS. */
+int defineClass(VM* vm, int superclass, Oop name, const char* variables, size_t length);
+/* Sets the class-side instance variables of a class */
+int defineClassSideVariables(VM* vm, int classIndex, const char* variables, size_t length);
+/* First method for the selector in the class or its superclasses, through
+ * the global method cache */
+Method* lookupMethod(VM* vm, int classIndex, Oop selector);
+/* Name of a class for messages, such as "Foo class" */
+void writeClassName(VM* vm, OutputBuffer* out, int classIndex);
+
+/* Globals */
+
+/* The association of a global, made with a nil value if it does not exist */
+Oop globalAssociation(VM* vm, Oop name);
+/* Value of a global, or 0 if there is none */
+Oop globalValue(VM* vm, Oop name);
+
+/* Loading */
+
+/* Compile top-level code into a doit method. Answers NULL after reporting a
+ * problem on stderr; path and firstLine place messages. */
+Method* compileDoit(VM* vm, const char* source, const char* path, int firstLine);
+/* Run every doit and install every method of a source, which is either plain
+ * top-level code or a chunk-format fileout. With echo, the printString of
+ * each doit's value is printed. Answers the number of chunks that failed. */
+int loadSource(VM* vm, const char* source, const char* path, int echo);
+
+extern const char kernelSource[];
+
+#endif /* RUNTIME_H */
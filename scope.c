@@ -0,0 +1,714 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "scope.h"
+#include "visitor.h"
+
+// Buckets of the name table; chains stay short for any realistic method
+#define NAME_BUCKETS 256
+#define NO_DECLARATION -1
+// Scope number of the instance variables, outside every method and block
+#define INSTANCE_SCOPE -1
+#define NO_LOOP -1
+
+typedef struct {
+    const char* name;
+    uint32_t bucket;
+    int next;               // Next declaration in the bucket, which it may shadow
+    int scope;              // Declaring scope, or INSTANCE_SCOPE
+    VariableKind kind;
+    int slot;
+} Declaration;
+
+typedef struct {
+    ASTNode* node;
+    int firstDeclaration;
+    unsigned char* captured;
+    int inlined;            // A block compiled into the enclosing code
+    int loopStart;          // Start of the outermost inlined loop around this point of the
+                            // enclosing code, or NO_LOOP
+    int captureTime;        // When a block of its own captures variables: its start, or the
+                            // start of the loop it is made in, as it may be made again
+    int* lastStore;         // Per variable: when the code stores into it last, or INT_MAX
+                            // when a block of its own does
+    int* firstCapture;      // Per variable: the earliest captureTime of blocks referring to it
+} Scope;
+
+typedef struct {
+    const ScopeOptions* options;
+    int buckets[NAME_BUCKETS];
+    Declaration* declarations;
+    int declarationCount;
+    int declarationCapacity;
+    Scope* scopes;
+    int scopeCount;
+    int scopeCapacity;
+    ScopeProblem* problems;     // Reported once the last pass is done
+    int problemCount;
+    int problemCapacity;
+    ASTBlockNode** refused;     // Blocks not to inline: their variables are captured
+    int refusedCount;
+    int refusedCapacity;
+    int refusedMore;            // In this pass; another one is needed
+    ASTBlockNode** loops;       // Inlined blocks that run repeatedly, in this pass
+    int loopCount;
+    int loopCapacity;
+    int time;                   // Counts nodes entered and left, in the order they run
+    int failed;
+} Resolver;
+
+static uint32_t nameBucket(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)name; *c != '\0'; c++) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash & (NAME_BUCKETS - 1);
+}
+
+static void report(Resolver* resolver, ScopeProblemKind kind, const char* name, SourceSpan span) {
+    if (resolver->problemCount == resolver->problemCapacity) {
+        int capacity = resolver->problemCapacity < 8 ? 8 : resolver->problemCapacity * 2;
+        ScopeProblem* problems = (ScopeProblem*)realloc(resolver->problems, sizeof(ScopeProblem) * capacity);
+        if (problems == NULL) {
+            resolver->failed = 1;
+            return;
+        }
+        resolver->problems = problems;
+        resolver->problemCapacity = capacity;
+    }
+    ScopeProblem problem = {kind, name, span};
+    resolver->problems[resolver->problemCount++] = problem;
+}
+
+// Innermost declaration of a name, or NULL
+static Declaration* lookup(Resolver* resolver, const char* name) {
+    int index = resolver->buckets[nameBucket(name)];
+    while (index != NO_DECLARATION) {
+        Declaration* declaration = &resolver->declarations[index];
+        if (strcmp(declaration->name, name) == 0) return declaration;
+        index = declaration->next;
+    }
+    return NULL;
+}
+
+static int declare(Resolver* resolver, const char* name, int scope, VariableKind kind, int slot) {
+    if (resolver->declarationCount == resolver->declarationCapacity) {
+        int capacity = resolver->declarationCapacity < 64 ? 64 : resolver->declarationCapacity * 2;
+        Declaration* declarations = (Declaration*)realloc(resolver->declarations, sizeof(Declaration) * capacity);
+        if (declarations == NULL) return 0;
+        resolver->declarations = declarations;
+        resolver->declarationCapacity = capacity;
+    }
+
+    Declaration* previous = lookup(resolver, name);
+    if (previous != NULL && previous->scope == scope && scope != INSTANCE_SCOPE) {
+        report(resolver, SCOPE_DUPLICATE, name, resolver->scopes[scope].node->span);
+    }
+
+    int index = resolver->declarationCount++;
+    Declaration* declaration = &resolver->declarations[index];
+    declaration->name = name;
+    declaration->bucket = nameBucket(name);
+    declaration->next = resolver->buckets[declaration->bucket];
+    declaration->scope = scope;
+    declaration->kind = kind;
+    declaration->slot = slot;
+    resolver->buckets[declaration->bucket] = index;
+    return 1;
+}
+
+static int isLoop(Resolver* resolver, ASTNode* node) {
+    for (int i = 0; i < resolver->loopCount; i++) {
+        if ((ASTNode*)resolver->loops[i] == node) return 1;
+    }
+    return 0;
+}
+
+// Open the scope of a method or block and declare its arguments and temporaries
+static int pushScope(Resolver* resolver, ASTNode* node, char** parameters, int parameterCount,
+                     char** temporaries, int temporaryCount, unsigned char** captured) {
+    if (resolver->scopeCount == resolver->scopeCapacity) {
+        int capacity = resolver->scopeCapacity < 16 ? 16 : resolver->scopeCapacity * 2;
+        Scope* scopes = (Scope*)realloc(resolver->scopes, sizeof(Scope) * capacity);
+        if (scopes == NULL) return 0;
+        resolver->scopes = scopes;
+        resolver->scopeCapacity = capacity;
+    }
+
+    // Flags from an earlier resolution are recomputed
+    int count = parameterCount + temporaryCount;
+    if (*captured == NULL) *captured = (unsigned char*)malloc(count > 0 ? count : 1);
+    if (*captured == NULL) return 0;
+    memset(*captured, 0, count > 0 ? count : 1);
+    int* times = (int*)malloc(sizeof(int) * 2 * (count > 0 ? count : 1));
+    if (times == NULL) return 0;
+    for (int i = 0; i < count; i++) {
+        times[i] = -1;
+        times[count + i] = INT_MAX;
+    }
+
+    int scope = resolver->scopeCount++;
+    Scope* entry = &resolver->scopes[scope];
+    entry->node = node;
+    entry->firstDeclaration = resolver->declarationCount;
+    entry->captured = *captured;
+    entry->inlined = node->type == AST_BLOCK && ((ASTBlockNode*)node)->inlined;
+    entry->lastStore = times;
+    entry->firstCapture = times + count;
+
+    // A loop's blocks run again after anything made in them, so what they
+    // capture counts as captured where the outermost loop starts
+    int enclosingLoop = scope > 0 ? resolver->scopes[scope - 1].loopStart : NO_LOOP;
+    if (!entry->inlined) {
+        entry->loopStart = NO_LOOP;
+    } else if (enclosingLoop == NO_LOOP && isLoop(resolver, node)) {
+        entry->loopStart = resolver->time;
+    } else {
+        entry->loopStart = enclosingLoop;
+    }
+    entry->captureTime = enclosingLoop != NO_LOOP ? enclosingLoop : resolver->time;
+
+    for (int i = 0; i < parameterCount; i++) {
+        if (!declare(resolver, parameters[i], scope, VAR_ARGUMENT, i)) return 0;
+    }
+    for (int i = 0; i < temporaryCount; i++) {
+        if (!declare(resolver, temporaries[i], scope, VAR_TEMPORARY, parameterCount + i)) return 0;
+    }
+    return 1;
+}
+
+// Declarations are removed in reverse, so each is the head of its bucket.
+// Captured variables that no store follows once a block captures them can
+// be copied into the blocks.
+static void popScope(Resolver* resolver) {
+    Scope* scope = &resolver->scopes[--resolver->scopeCount];
+    int count = resolver->declarationCount - scope->firstDeclaration;
+    for (int i = 0; i < count; i++) {
+        if (scope->captured[i] != CAPTURE_NONE) {
+            scope->captured[i] = scope->lastStore[i] < scope->firstCapture[i] ? CAPTURE_COPIED : CAPTURE_SHARED;
+        }
+    }
+    free(scope->lastStore);
+    while (resolver->declarationCount > scope->firstDeclaration) {
+        Declaration* declaration = &resolver->declarations[--resolver->declarationCount];
+        resolver->buckets[declaration->bucket] = declaration->next;
+    }
+}
+
+// The outermost block of its own between a declaring scope and the current
+// one, or -1 when the current code is the declaring code or inlined into it
+static int capturingScope(Resolver* resolver, int declaringScope) {
+    for (int i = declaringScope + 1; i < resolver->scopeCount; i++) {
+        if (!resolver->scopes[i].inlined) return i;
+    }
+    return -1;
+}
+
+static VariableBinding resolveName(Resolver* resolver, const char* name, SourceSpan span) {
+    VariableBinding binding = {VAR_GLOBAL, -1, 0};
+    Declaration* declaration = lookup(resolver, name);
+
+    if (declaration == NULL) {
+        // Globals are capitalized by convention; anything else is a typo or a missing declaration
+        if (name[0] >= 'a' && name[0] <= 'z') report(resolver, SCOPE_UNDECLARED, name, span);
+        return binding;
+    }
+
+    binding.kind = declaration->kind;
+    binding.slot = declaration->slot;
+    if (declaration->scope != INSTANCE_SCOPE) {
+        binding.depth = resolver->scopeCount - 1 - declaration->scope;
+        // Only a block of its own keeps a reference to the declaring scope
+        int capturing = capturingScope(resolver, declaration->scope);
+        if (capturing >= 0) {
+            Scope* declaring = &resolver->scopes[declaration->scope];
+            int captureTime = resolver->scopes[capturing].captureTime;
+            declaring->captured[declaration->slot] = CAPTURE_SHARED;
+            if (captureTime < declaring->firstCapture[declaration->slot]) {
+                declaring->firstCapture[declaration->slot] = captureTime;
+            }
+        }
+    }
+    return binding;
+}
+
+// Note a store into a variable, which its declaring code makes once the
+// assignment is done
+static void noteStore(Resolver* resolver, const char* name) {
+    Declaration* declaration = lookup(resolver, name);
+    if (declaration == NULL || declaration->scope == INSTANCE_SCOPE) return;
+    Scope* declaring = &resolver->scopes[declaration->scope];
+    declaring->lastStore[declaration->slot] =
+        capturingScope(resolver, declaration->scope) >= 0 ? INT_MAX : resolver->time;
+}
+
+// Inlined blocks
+
+static int isLiteralBlock(ASTNode* node, int parameterCount) {
+    return node != NULL && node->type == AST_BLOCK && ((ASTBlockNode*)node)->parameterCount == parameterCount;
+}
+
+static int isSuper(ASTNode* node) {
+    return node->type == AST_VARIABLE && ((ASTVariableNode*)node)->isPseudoVariable &&
+           strcmp(((ASTVariableNode*)node)->name, "super") == 0;
+}
+
+int controlStructureBlocks(ASTNode* message, ASTBlockNode** blocks) {
+    if (message->type == AST_MESSAGE_UNARY) {
+        ASTUnaryMessageNode* unary = (ASTUnaryMessageNode*)message;
+        if ((strcmp(unary->selector, "whileTrue") != 0 && strcmp(unary->selector, "whileFalse") != 0) ||
+            !isLiteralBlock(unary->receiver, 0)) {
+            return 0;
+        }
+        blocks[0] = (ASTBlockNode*)unary->receiver;
+        return 1;
+    }
+
+    // Messages of a cascade have no receiver of their own
+    if (message->type != AST_MESSAGE_KEYWORD) return 0;
+    ASTKeywordMessageNode* keyword = (ASTKeywordMessageNode*)message;
+    ASTNode** arguments = keyword->arguments;
+    const char* selector = keyword->message.selector;
+    if (keyword->message.receiver == NULL || isSuper(keyword->message.receiver)) return 0;
+
+    switch (keyword->argumentCount) {
+        case 1:
+            if (!isLiteralBlock(arguments[0], 0)) return 0;
+            if (strcmp(selector, "whileTrue:") == 0 || strcmp(selector, "whileFalse:") == 0) {
+                if (!isLiteralBlock(keyword->message.receiver, 0)) return 0;
+                blocks[0] = (ASTBlockNode*)keyword->message.receiver;
+                blocks[1] = (ASTBlockNode*)arguments[0];
+                return 2;
+            }
+            if (strcmp(selector, "ifTrue:") != 0 && strcmp(selector, "ifFalse:") != 0 &&
+                strcmp(selector, "and:") != 0 && strcmp(selector, "or:") != 0 &&
+                strcmp(selector, "timesRepeat:") != 0) {
+                return 0;
+            }
+            blocks[0] = (ASTBlockNode*)arguments[0];
+            return 1;
+        case 2:
+            if ((strcmp(selector, "ifTrue:ifFalse:") == 0 || strcmp(selector, "ifFalse:ifTrue:") == 0) &&
+                isLiteralBlock(arguments[0], 0) && isLiteralBlock(arguments[1], 0)) {
+                blocks[0] = (ASTBlockNode*)arguments[0];
+                blocks[1] = (ASTBlockNode*)arguments[1];
+                return 2;
+            }
+            if (strcmp(selector, "to:do:") == 0 && isLiteralBlock(arguments[1], 1)) {
+                blocks[0] = (ASTBlockNode*)arguments[1];
+                return 1;
+            }
+            return 0;
+        case 3:
+            if (strcmp(selector, "to:by:do:") == 0 && arguments[1]->type == AST_LITERAL_INTEGER &&
+                ((ASTIntegerLiteral*)arguments[1])->value != 0 && isLiteralBlock(arguments[2], 1)) {
+                blocks[0] = (ASTBlockNode*)arguments[2];
+                return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+static int isRefused(Resolver* resolver, ASTBlockNode* block) {
+    for (int i = 0; i < resolver->refusedCount; i++) {
+        if (resolver->refused[i] == block) return 1;
+    }
+    return 0;
+}
+
+// Control structures whose blocks run repeatedly
+static int isLoopMessage(ASTNode* message) {
+    const char* selector = ((ASTMessageNode*)message)->selector;
+    return strncmp(selector, "while", 5) == 0 || strcmp(selector, "timesRepeat:") == 0 ||
+           strcmp(selector, "to:do:") == 0 || strcmp(selector, "to:by:do:") == 0;
+}
+
+// Flag the blocks of a control structure before their scopes open
+static void markInlinedBlocks(Resolver* resolver, ASTNode* message) {
+    ASTBlockNode* blocks[2];
+    int count = controlStructureBlocks(message, blocks);
+    int inlined = 1;
+    for (int i = 0; i < count; i++) {
+        if (isRefused(resolver, blocks[i])) inlined = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        blocks[i]->inlined = inlined;
+    }
+    if (count == 0 || !inlined || !isLoopMessage(message)) return;
+
+    if (resolver->loopCount + count > resolver->loopCapacity) {
+        int capacity = resolver->loopCapacity < 8 ? 8 : resolver->loopCapacity * 2;
+        ASTBlockNode** loops = (ASTBlockNode**)realloc(resolver->loops, sizeof(ASTBlockNode*) * capacity);
+        if (loops == NULL) {
+            resolver->failed = 1;
+            return;
+        }
+        resolver->loops = loops;
+        resolver->loopCapacity = capacity;
+    }
+    for (int i = 0; i < count; i++) {
+        resolver->loops[resolver->loopCount++] = blocks[i];
+    }
+}
+
+// An inlined block's variables share the frame of the enclosing code from
+// one run of the block to the next, so one that a block of its own captures
+// would be shared too. Such blocks are refused, and resolved again.
+static void checkInlinedBlock(Resolver* resolver, ASTBlockNode* block) {
+    int captured = 0;
+    for (int i = 0; i < block->parameterCount + block->temporaryCount; i++) {
+        if (block->captured[i]) captured = 1;
+    }
+    if (!block->inlined || !captured) return;
+
+    if (resolver->refusedCount == resolver->refusedCapacity) {
+        int capacity = resolver->refusedCapacity < 8 ? 8 : resolver->refusedCapacity * 2;
+        ASTBlockNode** refused = (ASTBlockNode**)realloc(resolver->refused, sizeof(ASTBlockNode*) * capacity);
+        if (refused == NULL) {
+            resolver->failed = 1;
+            return;
+        }
+        resolver->refused = refused;
+        resolver->refusedCapacity = capacity;
+    }
+    resolver->refused[resolver->refusedCount++] = block;
+    resolver->refusedMore = 1;
+}
+
+static int pseudoVariableSlot(const char* name) {
+    if (strcmp(name, "super") == 0) return PSEUDO_SUPER;
+    if (strcmp(name, "thisContext") == 0) return PSEUDO_THIS_CONTEXT;
+    return PSEUDO_SELF;
+}
+
+static VisitAction resolveEnter(ASTNode* node, int depth, void* context) {
+    Resolver* resolver = (Resolver*)context;
+    (void)depth;
+    resolver->time++;
+
+    switch (node->type) {
+        case AST_METHOD: {
+            ASTMethodNode* methodNode = (ASTMethodNode*)node;
+            if (!pushScope(resolver, node, methodNode->parameters, methodNode->parameterCount,
+                           methodNode->temporaries, methodNode->temporaryCount, &methodNode->captured)) {
+                resolver->failed = 1;
+                return VISIT_STOP;
+            }
+            break;
+        }
+        case AST_BLOCK: {
+            ASTBlockNode* blockNode = (ASTBlockNode*)node;
+            if (!pushScope(resolver, node, blockNode->parameters, blockNode->parameterCount,
+                           blockNode->temporaries, blockNode->temporaryCount, &blockNode->captured)) {
+                resolver->failed = 1;
+                return VISIT_STOP;
+            }
+            break;
+        }
+        case AST_VARIABLE: {
+            ASTVariableNode* variableNode = (ASTVariableNode*)node;
+            if (variableNode->isPseudoVariable) {
+                VariableBinding binding = {VAR_PSEUDO, pseudoVariableSlot(variableNode->name), 0};
+                variableNode->binding = binding;
+            } else {
+                variableNode->binding = resolveName(resolver, variableNode->name, node->span);
+            }
+            break;
+        }
+        case AST_MESSAGE_UNARY:
+        case AST_MESSAGE_KEYWORD:
+            markInlinedBlocks(resolver, node);
+            break;
+        case AST_ASSIGNMENT: {
+            ASTAssignmentNode* assignmentNode = (ASTAssignmentNode*)node;
+            assignmentNode->binding = resolveName(resolver, assignmentNode->variable, node->span);
+            if (assignmentNode->binding.kind == VAR_ARGUMENT) {
+                report(resolver, SCOPE_STORE_INTO_ARGUMENT, assignmentNode->variable, node->span);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return VISIT_CONTINUE;
+}
+
+static VisitAction resolveLeave(ASTNode* node, int depth, void* context) {
+    Resolver* resolver = (Resolver*)context;
+    (void)depth;
+    resolver->time++;
+    if (node->type == AST_ASSIGNMENT) noteStore(resolver, ((ASTAssignmentNode*)node)->variable);
+    if (node->type == AST_BLOCK) checkInlinedBlock(resolver, (ASTBlockNode*)node);
+    if (node->type == AST_METHOD || node->type == AST_BLOCK) popScope(resolver);
+    return resolver->failed ? VISIT_STOP : VISIT_CONTINUE;
+}
+
+int resolveScopes(ASTNode* root, const ScopeOptions* options) {
+    Resolver resolver;
+    memset(&resolver, 0, sizeof(resolver));
+    resolver.options = options;
+    for (int i = 0; i < NAME_BUCKETS; i++) {
+        resolver.buckets[i] = NO_DECLARATION;
+    }
+
+    int ok = 1;
+    for (int i = 0; ok && i < options->instanceVariableCount; i++) {
+        ok = declare(&resolver, options->instanceVariables[i], INSTANCE_SCOPE, VAR_INSTANCE, i);
+    }
+
+    // Each refused block may capture more variables of those around it, so
+    // resolve again until no more blocks are refused
+    ASTVisitor visitor = {resolveEnter, NULL, resolveLeave, &resolver};
+    do {
+        resolver.problemCount = 0;
+        resolver.refusedMore = 0;
+        resolver.loopCount = 0;
+        resolver.time = 0;
+        if (ok) ok = walkAST(root, &visitor) == 1 && !resolver.failed;
+    } while (ok && resolver.refusedMore);
+
+    for (int i = 0; ok && options->report != NULL && i < resolver.problemCount; i++) {
+        options->report(&resolver.problems[i], options->context);
+    }
+    // Scopes still open when a walk stopped early
+    for (int i = 0; i < resolver.scopeCount; i++) {
+        free(resolver.scopes[i].lastStore);
+    }
+    free(resolver.declarations);
+    free(resolver.scopes);
+    free(resolver.loops);
+    free(resolver.problems);
+    free(resolver.refused);
+    return ok ? resolver.problemCount : -1;
+}
+
+const char* scopeProblemName(ScopeProblemKind kind) {
+    switch (kind) {
+        case SCOPE_UNDECLARED: return "undeclared variable";
+        case SCOPE_DUPLICATE: return "duplicate declaration";
+        case SCOPE_STORE_INTO_ARGUMENT: return "assignment to argument";
+        default: return "unknown problem";
+    }
+}
+
+// Class definitions
+
+void initClassTable(ClassTable* table) {
+    table->classes = NULL;
+    table->count = 0;
+    table->capacity = 0;
+}
+
+static void freeNameList(char** names, int count) {
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+void freeClassTable(ClassTable* table) {
+    for (int i = 0; i < table->count; i++) {
+        ClassShape* shape = &table->classes[i];
+        free(shape->name);
+        free(shape->superclass);
+        freeNameList(shape->variables, shape->variableCount);
+        freeNameList(shape->classSideVariables, shape->classSideVariableCount);
+    }
+    free(table->classes);
+    initClassTable(table);
+}
+
+static ClassShape* findClass(const ClassTable* table, const char* name, size_t length) {
+    for (int i = 0; i < table->count; i++) {
+        ClassShape* shape = &table->classes[i];
+        if (strlen(shape->name) == length && memcmp(shape->name, name, length) == 0) return shape;
+    }
+    return NULL;
+}
+
+// The entry for a class, added with no variables if it is new
+static ClassShape* classNamed(ClassTable* table, const char* name, size_t length) {
+    ClassShape* shape = findClass(table, name, length);
+    if (shape != NULL) return shape;
+
+    if (table->count == table->capacity) {
+        int capacity = table->capacity < 16 ? 16 : table->capacity * 2;
+        ClassShape* classes = (ClassShape*)realloc(table->classes, sizeof(ClassShape) * capacity);
+        if (classes == NULL) return NULL;
+        table->classes = classes;
+        table->capacity = capacity;
+    }
+
+    char* copy = (char*)malloc(length + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+
+    shape = &table->classes[table->count++];
+    memset(shape, 0, sizeof(*shape));
+    shape->name = copy;
+    return shape;
+}
+
+// Split a string such as 'x y' into names
+static char** splitNames(const char* text, int length, int* count) {
+    char** names = NULL;
+    int capacity = 0;
+    *count = 0;
+
+    int i = 0;
+    while (i < length) {
+        while (i < length && (text[i] == ' ' || text[i] == '\t' || text[i] == '\r' || text[i] == '\n')) i++;
+        int start = i;
+        while (i < length && text[i] != ' ' && text[i] != '\t' && text[i] != '\r' && text[i] != '\n') i++;
+        if (i == start) break;
+
+        if (*count == capacity) {
+            capacity = capacity < 8 ? 8 : capacity * 2;
+            char** newNames = (char**)realloc(names, sizeof(char*) * capacity);
+            if (newNames == NULL) {
+                freeNameList(names, *count);
+                *count = -1;
+                return NULL;
+            }
+            names = newNames;
+        }
+        names[*count] = (char*)malloc((size_t)(i - start) + 1);
+        if (names[*count] == NULL) {
+            freeNameList(names, *count);
+            *count = -1;
+            return NULL;
+        }
+        memcpy(names[*count], text + start, (size_t)(i - start));
+        names[*count][i - start] = '\0';
+        (*count)++;
+    }
+    return names;
+}
+
+// The argument following a keyword of a keyword message, or NULL
+static ASTNode* keywordArgument(ASTKeywordMessageNode* message, const char* keyword) {
+    size_t keywordLength = strlen(keyword);
+    const char* part = message->message.selector;
+    for (int i = 0; i < message->argumentCount; i++) {
+        const char* colon = strchr(part, ':');
+        if (colon == NULL) return NULL;
+        size_t partLength = (size_t)(colon - part + 1);
+        if (partLength == keywordLength && memcmp(part, keyword, keywordLength) == 0) {
+            return message->arguments[i];
+        }
+        part = colon + 1;
+    }
+    return NULL;
+}
+
+// Replace a variable list with the names in a string literal; answers 0 when out of memory
+static int setVariables(char*** variables, int* variableCount, ASTNode* names) {
+    if (names == NULL || names->type != AST_LITERAL_STRING) return 1;
+
+    int length;
+    const char* text = literalText(names, &length);
+    int count;
+    char** list = splitNames(text, length, &count);
+    if (count < 0) return 0;
+
+    freeNameList(*variables, *variableCount);
+    *variables = list;
+    *variableCount = count;
+    return 1;
+}
+
+static int addDefinition(ClassTable* table, ASTKeywordMessageNode* message) {
+    ASTNode* receiver = message->message.receiver;
+    const char* firstColon = strchr(message->message.selector, ':');
+    if (receiver == NULL || firstColon == NULL) return 1;
+    size_t firstLength = (size_t)(firstColon - message->message.selector);
+
+    // Foo class instanceVariableNames: 'a b'
+    if (strcmp(message->message.selector, "instanceVariableNames:") == 0 && receiver->type == AST_MESSAGE_UNARY) {
+        ASTUnaryMessageNode* classMessage = (ASTUnaryMessageNode*)receiver;
+        if (strcmp(classMessage->selector, "class") != 0 || classMessage->receiver == NULL ||
+            classMessage->receiver->type != AST_VARIABLE) {
+            return 1;
+        }
+        const char* name = ((ASTVariableNode*)classMessage->receiver)->name;
+        ClassShape* shape = classNamed(table, name, strlen(name));
+        return shape != NULL &&
+               setVariables(&shape->classSideVariables, &shape->classSideVariableCount, message->arguments[0]);
+    }
+
+    // Super subclass: #Foo ..., and the variableSubclass: family
+    if (firstLength < 8 || memcmp(firstColon - 7, "ubclass", 7) != 0 ||
+        message->arguments[0] == NULL || message->arguments[0]->type != AST_LITERAL_SYMBOL) {
+        return 1;
+    }
+    if (receiver->type != AST_VARIABLE && receiver->type != AST_CONSTANT) return 1;
+
+    int length;
+    const char* name = literalText(message->arguments[0], &length);
+    ClassShape* shape = classNamed(table, name, (size_t)length);
+    if (shape == NULL) return 0;
+
+    free(shape->superclass);
+    shape->superclass = NULL;
+    if (receiver->type == AST_VARIABLE) {
+        shape->superclass = strdup(((ASTVariableNode*)receiver)->name);
+        if (shape->superclass == NULL) return 0;
+    }
+
+    ASTNode* variables = keywordArgument(message, "instanceVariableNames:");
+    if (variables == NULL) {
+        freeNameList(shape->variables, shape->variableCount);
+        shape->variables = NULL;
+        shape->variableCount = 0;
+        return 1;
+    }
+    return setVariables(&shape->variables, &shape->variableCount, variables);
+}
+
+int addClassDefinitions(ClassTable* table, ASTNode* doit) {
+    if (doit == NULL || doit->type != AST_BLOCK) return 1;
+
+    ASTBlockNode* body = (ASTBlockNode*)doit;
+    for (int i = 0; i < body->statementCount; i++) {
+        ASTNode* statement = body->statements[i];
+        if (statement == NULL || statement->type != AST_MESSAGE_KEYWORD) continue;
+        if (!addDefinition(table, (ASTKeywordMessageNode*)statement)) return 0;
+    }
+    return 1;
+}
+
+char** classInstanceVariables(const ClassTable* table, const char* name, int nameLength,
+                              int isMeta, int* count) {
+    *count = 0;
+    ClassShape* shape = findClass(table, name, (size_t)nameLength);
+    if (shape == NULL) return NULL;
+
+    // Count along the superclass chain; the table size bounds a cyclic one
+    int total = 0;
+    int chainLength = 0;
+    for (ClassShape* c = shape; c != NULL && chainLength < table->count; chainLength++) {
+        total += isMeta ? c->classSideVariableCount : c->variableCount;
+        c = c->superclass != NULL ? findClass(table, c->superclass, strlen(c->superclass)) : NULL;
+    }
+
+    char** names = (char**)malloc(sizeof(char*) * (total > 0 ? total : 1));
+    if (names == NULL) return NULL;
+
+    // Fill from the back, so that inherited variables come first
+    int next = total;
+    ClassShape* c = shape;
+    for (int i = 0; i < chainLength; i++) {
+        char** variables = isMeta ? c->classSideVariables : c->variables;
+        int variableCount = isMeta ? c->classSideVariableCount : c->variableCount;
+        next -= variableCount;
+        if (variableCount > 0) memcpy(names + next, variables, sizeof(char*) * variableCount);
+        if (i + 1 < chainLength) c = findClass(table, c->superclass, strlen(c->superclass));
+    }
+
+    *count = total;
+    return names;
+}
@@ -0,0 +1,110 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include "ast.h"
+
+/*
+ * Name resolution. resolveScopes() walks a method, a block or top-level
+ * code once and fills in the binding of every variable reference and
+ * assignment (see VariableBinding in ast.h):
+ *
+ *   arguments, temporaries   slot in the declaring method or block, with
+ *                            its arguments first, and the number of block
+ *                            scopes between the reference and that scope
+ *   instance variables       index in the list given in the options
+ *   self, super, thisContext PSEUDO_SELF, PSEUDO_SUPER, PSEUDO_THIS_CONTEXT
+ *   anything else            global
+ *
+ * The names in scope are kept in a hash table whose chains link each name
+ * to the declaration it shadows, so a lookup costs no more than one chain
+ * walk however deeply the blocks nest. Declarations referenced from an inner
+ * block are flagged in the captured array of their method or block node.
+ * Those that nothing stores into once a block has captured them are
+ * CAPTURE_COPIED: the blocks can take copies of their values, and the
+ * variables stay on the stack. The others are CAPTURE_SHARED and must live in
+ * a heap context. A store from an inner block, or one that follows the
+ * capturing block or shares a loop with it, makes a variable shared.
+ *
+ * The literal blocks of control structures (see controlStructureBlocks) are
+ * flagged as inlined: the compiler puts their code and variables in the
+ * enclosing method or block, so references from them capture nothing. A
+ * block whose own variables are captured, by a block that outlives one of
+ * its runs, is not inlined, and neither are the other blocks of its message.
+ */
+
+typedef enum {
+    SCOPE_UNDECLARED,           /* Lower-case name declared nowhere; bound as a global */
+    SCOPE_DUPLICATE,            /* Name declared twice in one method or block */
+    SCOPE_STORE_INTO_ARGUMENT   /* Assignment to a method or block argument */
+} ScopeProblemKind;
+
+typedef struct {
+    ScopeProblemKind kind;
+    const char* name;
+    SourceSpan span;            /* The reference, or the declaring method or block */
+} ScopeProblem;
+
+typedef void (*ScopeProblemHandler)(const ScopeProblem* problem, void* context);
+
+typedef struct {
+    char** instanceVariables;   /* Of the receiver's class, inherited ones first */
+    int instanceVariableCount;
+    ScopeProblemHandler report; /* Called for each problem; may be NULL */
+    void* context;
+} ScopeOptions;
+
+/* Answers the number of problems found, or -1 when out of memory. A tree
+ * may be resolved again, e.g. with other instance variables. */
+int resolveScopes(ASTNode* root, const ScopeOptions* options);
+
+/* The literal blocks of a message the compiler may compile in line:
+ *
+ *   ifTrue: ifFalse: ifTrue:ifFalse: ifFalse:ifTrue: and: or: timesRepeat:
+ *   whileTrue: whileFalse: whileTrue whileFalse (a literal block receiver)
+ *   to:do: to:by:do: (a non-zero integer literal step)
+ *
+ * with blocks of no parameters, or one for the loop variable of to:do:.
+ * Answers the number of blocks stored, at most 2, or 0 for other messages. */
+int controlStructureBlocks(ASTNode* message, ASTBlockNode** blocks);
+
+/* Description of a problem kind, such as "undeclared variable" */
+const char* scopeProblemName(ScopeProblemKind kind);
+
+/*
+ * Instance variables of the classes defined in a fileout, gathered from
+ * top-level definitions such as
+ *
+ *   Object subclass: #Point instanceVariableNames: 'x y' classVariableNames: ''
+ *       package: 'Kernel'
+ *   Point class instanceVariableNames: 'origin'
+ *
+ * so that its methods can be resolved against them.
+ */
+
+typedef struct {
+    char* name;
+    char* superclass;           /* NULL for nil or an unknown superclass */
+    char** variables;           /* Declared by this class, not inherited */
+    int variableCount;
+    char** classSideVariables;  /* Class-side instance variables */
+    int classSideVariableCount;
+} ClassShape;
+
+typedef struct {
+    ClassShape* classes;
+    int count;
+    int capacity;
+} ClassTable;
+
+void initClassTable(ClassTable* table);
+void freeClassTable(ClassTable* table);
+/* Record every class definition among the statements of a doit. Answers 0
+ * when out of memory. */
+int addClassDefinitions(ClassTable* table, ASTNode* doit);
+/* Instance variables of a class, inherited ones first, as far as the table
+ * knows its superclasses. The names belong to the table; the caller frees the
+ * array. Answers NULL with a count of 0 for an unknown class. */
+char** classInstanceVariables(const ClassTable* table, const char* name, int nameLength,
+                              int isMeta, int* count);
+
+#endif /* SCOPE_H */
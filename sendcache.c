@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include "sendcache.h"
+
+void updateSendCache(SendCache* cache, int classIndex, Method* method, uint32_t epoch) {
+    if (cache->epoch != epoch) {
+        // Entries of an earlier epoch may name replaced methods
+        cache->epoch = epoch;
+        cache->moreCount = 0;
+        cache->state = CACHE_EMPTY;
+    }
+
+    switch (cache->state) {
+        case CACHE_EMPTY:
+            cache->first.classIndex = classIndex;
+            cache->first.method = method;
+            cache->state = CACHE_MONOMORPHIC;
+            break;
+        case CACHE_MONOMORPHIC:
+        case CACHE_POLYMORPHIC:
+            if (cache->more == NULL) {
+                cache->more = (CacheEntry*)malloc(sizeof(CacheEntry) * (POLYMORPHIC_CACHE_SIZE - 1));
+            }
+            if (cache->more == NULL || cache->moreCount == POLYMORPHIC_CACHE_SIZE - 1) {
+                // Too many classes: keep the entries, learn no more
+                cache->state = CACHE_MEGAMORPHIC;
+                break;
+            }
+            cache->more[cache->moreCount].classIndex = classIndex;
+            cache->more[cache->moreCount].method = method;
+            cache->moreCount++;
+            cache->state = CACHE_POLYMORPHIC;
+            break;
+        case CACHE_MEGAMORPHIC:
+            break;
+    }
+}
+
+void freeSendCache(SendCache* cache) {
+    free(cache->more);
+    cache->more = NULL;
+    cache->moreCount = 0;
+}
+
+void summarizeSendCaches(SendCacheSummary* summary, const SendCache* caches, int count) {
+    for (int i = 0; i < count; i++) {
+        summary->hits += caches[i].hits;
+        summary->misses += caches[i].misses;
+        summary->sites[caches[i].state]++;
+    }
+}
+
+const char* cacheStateName(CacheState state) {
+    switch (state) {
+        case CACHE_EMPTY: return "empty";
+        case CACHE_MONOMORPHIC: return "monomorphic";
+        case CACHE_POLYMORPHIC: return "polymorphic";
+        case CACHE_MEGAMORPHIC: return "megamorphic";
+    }
+    return "unknown";
+}
@@ -0,0 +1,77 @@
+#ifndef SENDCACHE_H
+#define SENDCACHE_H
+
+#include <stdint.h>
+#include "memory.h"
+
+/*
+ * Inline caches: every send site of a method remembers the methods its
+ * receivers' classes looked up to. A site starts empty, caches one class
+ * (monomorphic), grows to POLYMORPHIC_CACHE_SIZE classes (polymorphic) and
+ * then stops learning (megamorphic), leaving further lookups to the method
+ * dictionaries.
+ *
+ * Entries are only valid for the lookup epoch they were made in; the VM
+ * moves to a new epoch whenever a method is installed or a hierarchy
+ * changes, which empties every cache at once.
+ */
+
+#define POLYMORPHIC_CACHE_SIZE 8
+
+typedef enum {
+    CACHE_EMPTY,
+    CACHE_MONOMORPHIC,
+    CACHE_POLYMORPHIC,
+    CACHE_MEGAMORPHIC
+} CacheState;
+
+#define CACHE_STATE_COUNT (CACHE_MEGAMORPHIC + 1)
+
+typedef struct {
+    int classIndex;
+    Method* method;
+} CacheEntry;
+
+typedef struct {
+    CacheEntry first;           /* Checked inline */
+    CacheEntry* more;           /* Allocated when a second class shows up */
+    int moreCount;
+    CacheState state;
+    uint32_t epoch;
+    uint64_t hits;
+    uint64_t misses;
+} SendCache;
+
+/* The cached method for a receiver class, or NULL on a miss */
+static inline Method* probeSendCache(SendCache* cache, int classIndex, uint32_t epoch) {
+    if (cache->epoch == epoch) {
+        if (cache->first.classIndex == classIndex) {
+            cache->hits++;
+            return cache->first.method;
+        }
+        for (int i = 0; i < cache->moreCount; i++) {
+            if (cache->more[i].classIndex == classIndex) {
+                cache->hits++;
+                return cache->more[i].method;
+            }
+        }
+    }
+    cache->misses++;
+    return NULL;
+}
+
+/* Record what a lookup found after a miss */
+void updateSendCache(SendCache* cache, int classIndex, Method* method, uint32_t epoch);
+void freeSendCache(SendCache* cache);
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    int sites[CACHE_STATE_COUNT];   /* Send sites per state */
+} SendCacheSummary;
+
+/* Add the counters of some caches to a summary */
+void summarizeSendCaches(SendCacheSummary* summary, const SendCache* caches, int count);
+const char* cacheStateName(CacheState state);
+
+#endif /* SENDCACHE_H */
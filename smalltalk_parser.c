@@ -3,236 +3,158 @@
 #include <string.h>
 #include "lexer.h"
 #include "parser.h"
+#include "pipeline.h"
+#include "chunks.h"
+#include "flatast.h"
+#include "astcache.h"
+#include "visitor.h"
+#include "sourcemap.h"
+#include "fileio.h"
+#include "emitter.h"
+#include "tokendump.h"
+#include "scope.h"
+#include "compiler.h"
 
-// Function to print AST nodes with indentation
-void printAST(ASTNode* node, int indent) {
-    if (node == NULL) return;
-    
-    char indentStr[128] = {0};
-    for (int i = 0; i < indent; i++) {
-        strcat(indentStr, "  ");
-    }
-    
-    switch (node->type) {
-        case AST_LITERAL_INTEGER: {
-            ASTIntegerLiteral* intNode = (ASTIntegerLiteral*)node;
-            printf("%sInteger: %lld\n", indentStr, intNode->value);
-            break;
-        }
-        case AST_LITERAL_FLOAT: {
-            ASTFloatLiteral* floatNode = (ASTFloatLiteral*)node;
-            printf("%sFloat: %f\n", indentStr, floatNode->value);
-            break;
-        }
-        case AST_LITERAL_SCALED: {
-            ASTScaledLiteral* scaledNode = (ASTScaledLiteral*)node;
-            printf("%sScaled: %f s%d\n", indentStr, scaledNode->value, scaledNode->scale);
-            break;
-        }
-        case AST_LITERAL_CHARACTER: {
-            ASTCharacterLiteral* charNode = (ASTCharacterLiteral*)node;
-            printf("%sCharacter: '%c'\n", indentStr, charNode->value);
-            break;
-        }
-        case AST_LITERAL_STRING: {
-            ASTStringLiteral* stringNode = (ASTStringLiteral*)node;
-            printf("%sString: '%s'\n", indentStr, stringNode->value);
-            break;
-        }
-        case AST_LITERAL_SYMBOL: {
-            ASTSymbolLiteral* symbolNode = (ASTSymbolLiteral*)node;
-            printf("%sSymbol: #%s\n", indentStr, symbolNode->value);
-            break;
-        }
-        case AST_LITERAL_ARRAY: {
-            ASTArrayLiteral* arrayNode = (ASTArrayLiteral*)node;
-            printf("%sArray: #(\n", indentStr);
-            for (int i = 0; i < arrayNode->count; i++) {
-                printAST(arrayNode->elements[i], indent + 1);
-            }
-            printf("%s)\n", indentStr);
-            break;
-        }
-        case AST_LITERAL_BYTE_ARRAY: {
-            ASTByteArrayLiteral* byteArrayNode = (ASTByteArrayLiteral*)node;
-            printf("%sByteArray: #[\n", indentStr);
-            for (int i = 0; i < byteArrayNode->count; i++) {
-                printf("%s  %d\n", indentStr, byteArrayNode->bytes[i]);
-            }
-            printf("%s]\n", indentStr);
-            break;
-        }
-        case AST_CONSTANT: {
-            ASTConstantNode* constNode = (ASTConstantNode*)node;
-            printf("%sConstant: ", indentStr);
-            switch (constNode->type) {
-                case TOKEN_NIL:
-                    printf("nil\n");
-                    break;
-                case TOKEN_TRUE:
-                    printf("true\n");
-                    break;
-                case TOKEN_FALSE:
-                    printf("false\n");
-                    break;
-                default:
-                    printf("unknown\n");
-                    break;
-            }
-            break;
-        }
-        case AST_VARIABLE: {
-            ASTVariableNode* varNode = (ASTVariableNode*)node;
-            if (varNode->isPseudoVariable) {
-                printf("%sPseudoVariable: %s\n", indentStr, varNode->name);
-            } else {
-                printf("%sVariable: %s\n", indentStr, varNode->name);
-            }
-            break;
-        }
-        case AST_ASSIGNMENT: {
-            ASTAssignmentNode* assignNode = (ASTAssignmentNode*)node;
-            printf("%sAssignment:\n", indentStr);
-            printf("%s  Variable: %s\n", indentStr, assignNode->variable);
-            printf("%s  Value:\n", indentStr);
-            printAST(assignNode->value, indent + 2);
-            break;
-        }
-        case AST_RETURN: {
-            ASTReturnNode* returnNode = (ASTReturnNode*)node;
-            printf("%sReturn:\n", indentStr);
-            printAST(returnNode->expression, indent + 1);
-            break;
-        }
-        case AST_MESSAGE_UNARY: {
-            ASTUnaryMessageNode* msgNode = (ASTUnaryMessageNode*)node;
-            printf("%sUnaryMessage:\n", indentStr);
-            printf("%s  Selector: %s\n", indentStr, msgNode->selector);
-            printf("%s  Receiver:\n", indentStr);
-            printAST(msgNode->receiver, indent + 2);
-            break;
-        }
-        case AST_MESSAGE_BINARY: {
-            ASTBinaryMessageNode* msgNode = (ASTBinaryMessageNode*)node;
-            printf("%sBinaryMessage:\n", indentStr);
-            printf("%s  Selector: %s\n", indentStr, msgNode->selector);
-            printf("%s  Receiver:\n", indentStr);
-            printAST(msgNode->receiver, indent + 2);
-            printf("%s  Argument:\n", indentStr);
-            printAST(msgNode->argument, indent + 2);
-            break;
-        }
-        case AST_MESSAGE_KEYWORD: {
-            ASTKeywordMessageNode* msgNode = (ASTKeywordMessageNode*)node;
-            printf("%sKeywordMessage:\n", indentStr);
-            printf("%s  Selector: %s\n", indentStr, msgNode->selector);
-            printf("%s  Receiver:\n", indentStr);
-            printAST(msgNode->receiver, indent + 2);
-            printf("%s  Arguments:\n", indentStr);
-            for (int i = 0; i < msgNode->argumentCount; i++) {
-                printAST(msgNode->arguments[i], indent + 2);
-            }
-            break;
-        }
-        case AST_CASCADE: {
-            ASTCascadeNode* cascadeNode = (ASTCascadeNode*)node;
-            printf("%sCascade:\n", indentStr);
-            printf("%s  Receiver:\n", indentStr);
-            printAST(cascadeNode->receiver, indent + 2);
-            printf("%s  Messages:\n", indentStr);
-            for (int i = 0; i < cascadeNode->messageCount; i++) {
-                printAST(cascadeNode->messages[i], indent + 2);
-            }
-            break;
-        }
-        case AST_BLOCK: {
-            ASTBlockNode* blockNode = (ASTBlockNode*)node;
-            printf("%sBlock:\n", indentStr);
-            if (blockNode->parameterCount > 0) {
-                printf("%s  Parameters: [", indentStr);
-                for (int i = 0; i < blockNode->parameterCount; i++) {
-                    printf("%s", blockNode->parameters[i]);
-                    if (i < blockNode->parameterCount - 1) {
-                        printf(", ");
-                    }
-                }
-                printf("]\n");
-            }
-            printf("%s  Statements:\n", indentStr);
-            for (int i = 0; i < blockNode->statementCount; i++) {
-                printAST(blockNode->statements[i], indent + 2);
-            }
-            break;
-        }
-        case AST_ARRAY_EXPRESSION: {
-            ASTArrayExpressionNode* arrayNode = (ASTArrayExpressionNode*)node;
-            printf("%sArrayExpression: {\n", indentStr);
-            for (int i = 0; i < arrayNode->count; i++) {
-                printAST(arrayNode->expressions[i], indent + 1);
-            }
-            printf("%s}\n", indentStr);
-            break;
-        }
-        case AST_METHOD: {
-            ASTMethodNode* methodNode = (ASTMethodNode*)node;
-            printf("%sMethod:\n", indentStr);
-            printf("%s  Selector: %s\n", indentStr, methodNode->selector);
-            if (methodNode->parameterCount > 0) {
-                printf("%s  Parameters: [", indentStr);
-                for (int i = 0; i < methodNode->parameterCount; i++) {
-                    printf("%s", methodNode->parameters[i]);
-                    if (i < methodNode->parameterCount - 1) {
-                        printf(", ");
-                    }
-                }
-                printf("]\n");
-            }
-            if (methodNode->isPrimitive) {
-                printf("%s  Primitive: %d\n", indentStr, methodNode->primitiveNumber);
-            }
-            printf("%s  Statements:\n", indentStr);
-            for (int i = 0; i < methodNode->statementCount; i++) {
-                printAST(methodNode->statements[i], indent + 2);
-            }
-            break;
-        }
-        default:
-            printf("%sUnknown node type: %d\n", indentStr, node->type);
-            break;
-    }
+// Only the text format has a heading; the others are one tree per line
+static void writeHeading(OutputBuffer* out, ASTFormat format, const char* filePath) {
+    if (format != AST_FORMAT_TEXT) return;
+    writeString(out, "Abstract Syntax Tree for ");
+    writeString(out, filePath);
+    writeString(out, ":\n");
 }
 
-// Function to read a file into a string
-char* readFile(const char* path) {
-    FILE* file = fopen(path, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "Could not open file \"%s\".\n", path);
-        return NULL;
+typedef struct {
+    SourceMap map;
+    OutputBuffer* out;
+} SpanContext;
+
+// Print each node's source range and the start of its text
+static VisitAction printSpan(ASTNode* node, int depth, void* context) {
+    SpanContext* spans = (SpanContext*)context;
+    int firstLine, firstColumn, lastLine, lastColumn;
+    if (!spanStart(&spans->map, node->span, &firstLine, &firstColumn) ||
+        !spanEnd(&spans->map, node->span, &lastLine, &lastColumn)) {
+        return VISIT_STOP;
     }
     
-    fseek(file, 0L, SEEK_END);
-    size_t fileSize = ftell(file);
-    rewind(file);
+    const char* text = spans->map.source + node->span.start;
+    int length = (int)node->span.length;
+    const char* newline = memchr(text, '\n', length);
+    if (newline != NULL) length = (int)(newline - text);
+    if (length > 40) length = 40;
     
-    char* buffer = (char*)malloc(fileSize + 1);
-    if (buffer == NULL) {
-        fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
-        fclose(file);
-        return NULL;
-    }
+    OutputBuffer* out = spans->out;
+    writeSpaces(out, depth * 2);
+    writeString(out, astNodeTypeName(node->type));
+    writeChar(out, ' ');
+    writeInteger(out, firstLine);
+    writeChar(out, ':');
+    writeInteger(out, firstColumn);
+    writeChar(out, '-');
+    writeInteger(out, lastLine);
+    writeChar(out, ':');
+    writeInteger(out, lastColumn);
+    writeChar(out, ' ');
+    writeBytes(out, text, (size_t)length);
+    writeChar(out, '\n');
+    return VISIT_CONTINUE;
+}
+
+static void printSpans(OutputBuffer* out, ASTNode* ast, const char* source, const char* filePath) {
+    SpanContext spans;
+    initSourceMap(&spans.map, source, strlen(source), 1);
+    spans.out = out;
+    writeString(out, "Source spans for ");
+    writeString(out, filePath);
+    writeString(out, ":\n");
+    ASTVisitor visitor = {printSpan, NULL, NULL, &spans};
+    walkAST(ast, &visitor);
+    freeSourceMap(&spans.map);
+}
+
+typedef struct {
+    SourceMap map;
+    const char* filePath;
+} ProblemContext;
+
+static void printScopeProblem(const ScopeProblem* problem, void* context) {
+    ProblemContext* problems = (ProblemContext*)context;
+    int line = 0;
+    int column = 0;
+    spanStart(&problems->map, problem->span, &line, &column);
+    fprintf(stderr, "%s:%d:%d: %s '%s'\n", problems->filePath, line, column,
+            scopeProblemName(problem->kind), problem->name);
+}
+
+// Resolve the variables of a tree parsed from text, which starts at firstLine of the file
+static void resolveNames(ASTNode* ast, const char* text, int firstLine, const char* filePath,
+                         char** instanceVariables, int instanceVariableCount) {
+    ProblemContext problems;
+    initSourceMap(&problems.map, text, strlen(text), firstLine);
+    problems.filePath = filePath;
     
-    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-    if (bytesRead < fileSize) {
-        fprintf(stderr, "Could not read file \"%s\".\n", path);
-        free(buffer);
-        fclose(file);
-        return NULL;
+    ScopeOptions options = {instanceVariables, instanceVariableCount, printScopeProblem, &problems};
+    if (resolveScopes(ast, &options) < 0) {
+        fprintf(stderr, "Not enough memory to resolve the variables of %s.\n", filePath);
     }
+    freeSourceMap(&problems.map);
+}
+
+// Compile a tree parsed from text and print its bytecode instead of the tree
+static void printBytecode(OutputBuffer* out, ASTNode* ast, const char* text, int firstLine,
+                          const char* filePath, char** instanceVariables, int instanceVariableCount) {
+    ProblemContext problems;
+    initSourceMap(&problems.map, text, strlen(text), firstLine);
+    problems.filePath = filePath;
     
-    buffer[bytesRead] = '\0';
+    flushOutputBuffer(out);
+    ScopeOptions options = {instanceVariables, instanceVariableCount, printScopeProblem, &problems};
+    CompileError error;
+    CompiledCode* code = compileAST(ast, &options, &error);
+    if (code != NULL) {
+        disassemble(out, code, 0);
+        freeCompiledCode(code);
+    } else {
+        int line = 0;
+        int column = 0;
+        spanStart(&problems.map, error.span, &line, &column);
+        fprintf(stderr, "%s:%d:%d: %s\n", filePath, line, column, error.message);
+    }
+    freeSourceMap(&problems.map);
+}
+
+// Print a tree for the whole file as the options ask: its spans, its bytecode
+// or the tree itself. Parsed, flattened and cached trees all come through here.
+static void printTree(OutputBuffer* out, ASTNode* ast, const char* source, const char* filePath,
+                      ASTFormat format, int showSpans, int scopes, int bytecode) {
+    if (showSpans) {
+        printSpans(out, ast, source, filePath);
+    } else if (bytecode) {
+        printBytecode(out, ast, source, 1, filePath, NULL, 0);
+    } else {
+        if (scopes) resolveNames(ast, source, 1, filePath, NULL, 0);
+        writeHeading(out, format, filePath);
+        emitAST(out, ast, format, 0);
+    }
+}
+
+// Class definitions of a fileout, for the instance variables of its methods
+static int collectClassDefinitions(ClassTable* classes, const char* source) {
+    ChunkScanner scanner;
+    SourceChunk chunk;
+    int ok = 1;
+    initChunkScanner(&scanner, source, strlen(source));
     
-    fclose(file);
-    return buffer;
+    while (ok && nextChunk(&scanner, &chunk)) {
+        if (chunk.kind != CHUNK_DOIT) continue;
+        int hadError = 0;
+        char* chunkText = NULL;
+        ASTNode* ast = parseChunk(&chunk, &chunkText, &hadError);
+        if (!hadError) ok = addClassDefinitions(classes, ast);
+        freeASTNode(ast);
+        free(chunkText);
+    }
+    return ok;
 }
 
 void printUsage(char* programName) {
@@ -240,7 +162,22 @@ void printUsage(char* programName) {
     printf("Options:\n");
     printf("  -h, --help     Display this help message\n");
     printf("  --tokens       Display tokens only\n");
+    printf("  --token-stream FILE\n");
+    printf("                 Write the tokens to FILE in the binary token stream format\n");
     printf("  --ast          Display AST only (default)\n");
+    printf("  --pipelined    Run the lexer on a separate thread\n");
+    printf("  --spans        Print the source range of every AST node\n");
+    printf("  --format FMT   Print the AST as text (default), json (JSON Lines) or sexpr\n");
+    printf("  --flat         Convert the AST to the flat index-based form before printing\n");
+    printf("  --hash-cons    Share identical literal and constant nodes while parsing;\n");
+    printf("                 not with --spans, --scopes, --bytecode, --cache or json\n");
+    printf("  --scopes       Resolve every variable to its declaration and report\n");
+    printf("                 undeclared variables\n");
+    printf("  --bytecode     Compile to bytecode and print the disassembly instead of the AST\n");
+    printf("  --cache DIR    Reuse parse results cached in DIR, keyed by source hash\n");
+    printf("  --select SEL   Parse only methods with selector SEL\n");
+    printf("  --class NAME   Parse only methods of class NAME (\"Foo class\" for the metaclass)\n");
+    printf("  --lines A-B    Parse only chunks overlapping lines A to B\n");
 }
 
 int main(int argc, char* argv[]) {
@@ -252,6 +189,17 @@ int main(int argc, char* argv[]) {
     
     int showTokens = 0;
     int showAST = 1;
+    int pipelined = 0;
+    int selective = 0;
+    int flatten = 0;
+    int showSpans = 0;
+    int hashCons = 0;
+    int scopes = 0;
+    int bytecode = 0;
+    ASTFormat format = AST_FORMAT_TEXT;
+    const char* cacheDir = NULL;
+    const char* tokenStreamPath = NULL;
+    ChunkFilter filter = {NULL, NULL, 0, 0};
     char* filePath = NULL;
     
     // Parse command-line arguments
@@ -262,8 +210,44 @@ int main(int argc, char* argv[]) {
         } else if (strcmp(argv[i], "--tokens") == 0) {
             showTokens = 1;
             showAST = 0;
+        } else if (strcmp(argv[i], "--token-stream") == 0 && i + 1 < argc) {
+            tokenStreamPath = argv[++i];
+            showAST = 0;
         } else if (strcmp(argv[i], "--ast") == 0) {
             showAST = 1;
+        } else if (strcmp(argv[i], "--pipelined") == 0) {
+            pipelined = 1;
+        } else if (strcmp(argv[i], "--spans") == 0) {
+            showSpans = 1;
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            int parsed = parseASTFormat(argv[++i]);
+            if (parsed < 0) {
+                fprintf(stderr, "Unknown format %s; expected text, json or sexpr.\n", argv[i]);
+                return 1;
+            }
+            format = (ASTFormat)parsed;
+        } else if (strcmp(argv[i], "--flat") == 0) {
+            flatten = 1;
+        } else if (strcmp(argv[i], "--hash-cons") == 0) {
+            hashCons = 1;
+        } else if (strcmp(argv[i], "--scopes") == 0) {
+            scopes = 1;
+        } else if (strcmp(argv[i], "--bytecode") == 0) {
+            bytecode = 1;
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (strcmp(argv[i], "--select") == 0 && i + 1 < argc) {
+            filter.selector = argv[++i];
+            selective = 1;
+        } else if (strcmp(argv[i], "--class") == 0 && i + 1 < argc) {
+            filter.className = argv[++i];
+            selective = 1;
+        } else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d-%d", &filter.firstLine, &filter.lastLine) != 2) {
+                fprintf(stderr, "Expected a line range like 10-20.\n");
+                return 1;
+            }
+            selective = 1;
         } else {
             filePath = argv[i];
         }
@@ -275,111 +259,180 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Shared nodes only carry the span of their first occurrence
+    const char* spanOption = showSpans ? "--spans" : scopes ? "--scopes" : bytecode ? "--bytecode" :
+                             cacheDir != NULL ? "--cache" : format == AST_FORMAT_JSON ? "--format json" : NULL;
+    if (hashCons && spanOption != NULL) {
+        fprintf(stderr, "--hash-cons cannot be combined with %s, which needs the span of every node.\n", spanOption);
+        return 1;
+    }
+    
     char* source = readFile(filePath);
     if (source == NULL) {
         return 1;
     }
     
+    // Fileouts compile chunk by chunk, so that methods see their class's instance variables
+    if (bytecode && containsMethodChunks(source, strlen(source))) {
+        selective = 1;
+    }
+    
+    OutputBuffer out;
+    if (!initOutputBuffer(&out, stdout, 0)) {
+        fprintf(stderr, "Not enough memory for the output buffer.\n");
+        free(source);
+        return 1;
+    }
+    
     if (showTokens) {
-        // Initialize lexer and print all tokens
-        Lexer lexer;
-        initLexer(&lexer, source);
-        
-        printf("Tokens from %s:\n", filePath);
-        printf("%-20s %-30s %-5s %-5s\n", "Token Type", "Value", "Line", "Col");
-        printf("------------------------------------------------------------\n");
+        writeTokenListing(&out, source, filePath);
+    }
+    
+    int streamFailed = tokenStreamPath != NULL && !writeTokenStream(tokenStreamPath, source, strlen(source));
+    if (streamFailed) {
+        fprintf(stderr, "Could not write the token stream %s.\n", tokenStreamPath);
+    }
+    
+    // A cached tree for the whole file replaces lexing and parsing entirely
+    FlatAST* cached = NULL;
+    if (showAST && !selective && cacheDir != NULL) {
+        cached = lookupASTCache(cacheDir, source, strlen(source));
+    }
+    
+    if (showAST && selective) {
+        // Find chunk boundaries without lexing, then parse only the matching chunks
+        ChunkScanner scanner;
+        SourceChunk chunk;
+        ClassTable classes;
+        initClassTable(&classes);
+        if ((scopes || bytecode) && !collectClassDefinitions(&classes, source)) {
+            fprintf(stderr, "Not enough memory for the class definitions of %s.\n", filePath);
+        }
+        initChunkScanner(&scanner, source, strlen(source));
         
-        for (;;) {
-            Token token = nextToken(&lexer);
+        while (nextChunk(&scanner, &chunk)) {
+            if (!chunkMatches(&chunk, &filter)) continue;
             
-            char tokenValue[32] = {0};
-            if (token.length < 30) {
-                strncpy(tokenValue, token.start, token.length);
-                tokenValue[token.length] = '\0';
-            } else {
-                strncpy(tokenValue, token.start, 27);
-                strcat(tokenValue, "...");
+            // The machine formats are one tree per line, with no headings
+            if (format == AST_FORMAT_TEXT && chunk.kind == CHUNK_METHOD) {
+                writeString(&out, "Method ");
+                writeBytes(&out, chunk.className, (size_t)chunk.classNameLength);
+                writeString(&out, chunk.isMeta ? " class>>" : ">>");
+                writeString(&out, chunk.selector);
+                writeString(&out, " (lines ");
+                writeInteger(&out, chunk.firstLine);
+                writeChar(&out, '-');
+                writeInteger(&out, chunk.lastLine);
+                writeString(&out, "):\n");
+            } else if (format == AST_FORMAT_TEXT) {
+                writeString(&out, "Doit (lines ");
+                writeInteger(&out, chunk.firstLine);
+                writeChar(&out, '-');
+                writeInteger(&out, chunk.lastLine);
+                writeString(&out, "):\n");
             }
             
-            char tokenTypeName[32] = {0};
-            switch (token.type) {
-                case TOKEN_EOF: strcpy(tokenTypeName, "EOF"); break;
-                case TOKEN_ERROR: strcpy(tokenTypeName, "ERROR"); break;
-                case TOKEN_IDENTIFIER: strcpy(tokenTypeName, "IDENTIFIER"); break;
-                case TOKEN_KEYWORD: strcpy(tokenTypeName, "KEYWORD"); break;
-                case TOKEN_INTEGER: strcpy(tokenTypeName, "INTEGER"); break;
-                case TOKEN_FLOAT: strcpy(tokenTypeName, "FLOAT"); break;
-                case TOKEN_SCALED: strcpy(tokenTypeName, "SCALED"); break;
-                case TOKEN_CHAR: strcpy(tokenTypeName, "CHAR"); break;
-                case TOKEN_STRING: strcpy(tokenTypeName, "STRING"); break;
-                case TOKEN_SYMBOL: strcpy(tokenTypeName, "SYMBOL"); break;
-                case TOKEN_HASH_PAREN: strcpy(tokenTypeName, "HASH_PAREN"); break;
-                case TOKEN_NIL: strcpy(tokenTypeName, "NIL"); break;
-                case TOKEN_TRUE: strcpy(tokenTypeName, "TRUE"); break;
-                case TOKEN_FALSE: strcpy(tokenTypeName, "FALSE"); break;
-                case TOKEN_SELF: strcpy(tokenTypeName, "SELF"); break;
-                case TOKEN_SUPER: strcpy(tokenTypeName, "SUPER"); break;
-                case TOKEN_THIS_CONTEXT: strcpy(tokenTypeName, "THIS_CONTEXT"); break;
-                case TOKEN_BINARY_SELECTOR: strcpy(tokenTypeName, "BINARY_SELECTOR"); break;
-                case TOKEN_PERIOD: strcpy(tokenTypeName, "PERIOD"); break;
-                case TOKEN_SEMICOLON: strcpy(tokenTypeName, "SEMICOLON"); break;
-                case TOKEN_LEFT_PAREN: strcpy(tokenTypeName, "LEFT_PAREN"); break;
-                case TOKEN_RIGHT_PAREN: strcpy(tokenTypeName, "RIGHT_PAREN"); break;
-                case TOKEN_LEFT_BRACKET: strcpy(tokenTypeName, "LEFT_BRACKET"); break;
-                case TOKEN_RIGHT_BRACKET: strcpy(tokenTypeName, "RIGHT_BRACKET"); break;
-                case TOKEN_LEFT_BRACE: strcpy(tokenTypeName, "LEFT_BRACE"); break;
-                case TOKEN_RIGHT_BRACE: strcpy(tokenTypeName, "RIGHT_BRACE"); break;
-                case TOKEN_CARET: strcpy(tokenTypeName, "CARET"); break;
-                case TOKEN_PIPE: strcpy(tokenTypeName, "PIPE"); break;
-                case TOKEN_ASSIGNMENT: strcpy(tokenTypeName, "ASSIGNMENT"); break;
-                case TOKEN_HASH: strcpy(tokenTypeName, "HASH"); break;
-                case TOKEN_DOLLAR: strcpy(tokenTypeName, "DOLLAR"); break;
-                case TOKEN_COLON: strcpy(tokenTypeName, "COLON"); break;
-                case TOKEN_MINUS: strcpy(tokenTypeName, "MINUS"); break;
-                case TOKEN_PLUS: strcpy(tokenTypeName, "PLUS"); break;
-                case TOKEN_STAR: strcpy(tokenTypeName, "STAR"); break;
-                case TOKEN_SLASH: strcpy(tokenTypeName, "SLASH"); break;
-                case TOKEN_LESS: strcpy(tokenTypeName, "LESS"); break;
-                case TOKEN_GREATER: strcpy(tokenTypeName, "GREATER"); break;
-                case TOKEN_EQUAL: strcpy(tokenTypeName, "EQUAL"); break;
-                case TOKEN_AT: strcpy(tokenTypeName, "AT"); break;
-                case TOKEN_COMMA: strcpy(tokenTypeName, "COMMA"); break;
-                case TOKEN_UNDERSCORE: strcpy(tokenTypeName, "UNDERSCORE"); break;
-                case TOKEN_TILDE: strcpy(tokenTypeName, "TILDE"); break;
-                case TOKEN_PERCENT: strcpy(tokenTypeName, "PERCENT"); break;
-                case TOKEN_AMPERSAND: strcpy(tokenTypeName, "AMPERSAND"); break;
-                case TOKEN_QUESTION: strcpy(tokenTypeName, "QUESTION"); break;
-                case TOKEN_EXCLAMATION: strcpy(tokenTypeName, "EXCLAMATION"); break;
-                case TOKEN_BACKSLASH: strcpy(tokenTypeName, "BACKSLASH"); break;
-                default: strcpy(tokenTypeName, "UNKNOWN"); break;
+            int hadError = 0;
+            char* chunkText = NULL;
+            ASTNode* ast = parseChunk(&chunk, &chunkText, &hadError);
+            if (!hadError && ast != NULL && (scopes || bytecode)) {
+                int count = 0;
+                char** variables = chunk.kind == CHUNK_METHOD
+                    ? classInstanceVariables(&classes, chunk.className, chunk.classNameLength, chunk.isMeta, &count)
+                    : NULL;
+                flushOutputBuffer(&out);
+                if (bytecode) {
+                    printBytecode(&out, ast, chunkText, chunk.firstLine, filePath, variables, count);
+                } else {
+                    resolveNames(ast, chunkText, chunk.firstLine, filePath, variables, count);
+                }
+                free(variables);
             }
-            
-            printf("%-20s %-30s %-5d %-5d\n", tokenTypeName, tokenValue, token.line, token.column);
-            
-            if (token.type == TOKEN_EOF) break;
-            if (token.type == TOKEN_ERROR) {
-                fprintf(stderr, "Error: %s\n", tokenValue);
-                break;
+            if (!hadError && ast != NULL) {
+                if (!bytecode) emitAST(&out, ast, format, 1);
+            } else {
+                flushOutputBuffer(&out);
+                fprintf(stderr, "Failed to parse chunk at line %d of %s.\n", chunk.firstLine, filePath);
             }
+            freeASTNode(ast);
+            free(chunkText);
         }
-    }
-    
-    if (showAST) {
+        freeClassTable(&classes);
+    } else if (cached != NULL) {
+        // The cached tree is already flat, so --flat only adds its statistics
+        if (flatten) {
+            fprintf(stderr, "Flat AST: %u nodes, %u strings, %zu bytes\n",
+                    cached->nodeCount, cached->stringCount, flatASTMemoryUsage(cached));
+        }
+        // String nodes of the expanded tree point into the mapping
+        ASTNode* expanded = expandFlatAST(cached, 0);
+        if (expanded != NULL) {
+            printTree(&out, expanded, source, filePath, format, showSpans, scopes, bytecode);
+        } else {
+            fprintf(stderr, "Not enough memory to expand the cached AST of %s.\n", filePath);
+        }
+        freeASTNode(expanded);
+        freeFlatAST(cached);
+    } else if (showAST) {
         // Initialize parser and parse the source
         Parser parser;
-        initParser(&parser, source);
+        TokenPipeline* pipeline = NULL;
+        if (pipelined) {
+            // Sources too long for the token ring are lexed inline
+            pipeline = startTokenPipeline(source);
+            initPipelinedParser(&parser, source, pipeline);
+        } else {
+            initParser(&parser, source);
+        }
         
+        if (hashCons) beginHashConsing();
         ASTNode* ast = parse(&parser);
+        stopTokenPipeline(pipeline);
+        
+        if (!parser.hadError && ast != NULL && cacheDir != NULL) {
+            FlatAST* flat = flattenAST(ast);
+            if (flat == NULL || !storeASTCache(cacheDir, source, strlen(source), flat)) {
+                fprintf(stderr, "Could not write the AST cache in %s.\n", cacheDir);
+            }
+            freeFlatAST(flat);
+        }
         
-        if (!parser.hadError && ast != NULL) {
-            printf("Abstract Syntax Tree for %s:\n", filePath);
-            printAST(ast, 0);
+        if (!parser.hadError && ast != NULL && flatten) {
+            FlatAST* flat = flattenAST(ast);
+            freeASTNode(ast);
+            if (flat == NULL) {
+                fprintf(stderr, "Not enough memory to flatten the AST.\n");
+                freeOutputBuffer(&out);
+                free(source);
+                return 1;
+            }
+            fprintf(stderr, "Flat AST: %u nodes, %u strings, %zu bytes\n",
+                    flat->nodeCount, flat->stringCount, flatASTMemoryUsage(flat));
+            
+            // Print through the pointer-AST adapter
+            ASTNode* expanded = expandFlatAST(flat, 0);
+            if (expanded != NULL) {
+                printTree(&out, expanded, source, filePath, format, showSpans, scopes, bytecode);
+            } else {
+                fprintf(stderr, "Not enough memory to expand the flat AST.\n");
+            }
+            freeASTNode(expanded);
+            freeFlatAST(flat);
+        } else if (!parser.hadError && ast != NULL) {
+            printTree(&out, ast, source, filePath, format, showSpans, scopes, bytecode);
             freeASTNode(ast);
         } else {
             fprintf(stderr, "Failed to parse %s.\n", filePath);
         }
+        
+        if (hashCons) {
+            fprintf(stderr, "Hash-consing: %zu shared nodes\n", sharedNodeCount());
+            endHashConsing();
+        }
     }
     
+    int written = freeOutputBuffer(&out);
+    if (!written) fprintf(stderr, "Could not write the output.\n");
     free(source);
-    return 0;
+    return written && !streamFailed ? 0 : 1;
 }
\ No newline at end of file
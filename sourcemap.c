@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sourcemap.h"
+
+void initSourceMap(SourceMap* map, const char* source, size_t length, int firstLine) {
+    map->source = source;
+    map->length = length;
+    map->firstLine = firstLine;
+    map->lineStarts = NULL;
+    map->lineCount = 0;
+}
+
+void freeSourceMap(SourceMap* map) {
+    free(map->lineStarts);
+    map->lineStarts = NULL;
+    map->lineCount = 0;
+}
+
+static int buildLineStarts(SourceMap* map) {
+    int count = 1;
+    const char* p = map->source;
+    const char* end = map->source + map->length;
+    while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        count++;
+        p++;
+    }
+
+    map->lineStarts = (unsigned int*)malloc(sizeof(unsigned int) * count);
+    if (map->lineStarts == NULL) return 0;
+
+    map->lineStarts[0] = 0;
+    int line = 1;
+    for (p = map->source; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++) {
+        map->lineStarts[line++] = (unsigned int)(p + 1 - map->source);
+    }
+    map->lineCount = count;
+    return 1;
+}
+
+int sourcePosition(SourceMap* map, unsigned int offset, int* line, int* column) {
+    if (map->lineStarts == NULL && !buildLineStarts(map)) return 0;
+
+    // Last line starting at or before offset
+    int low = 0;
+    int high = map->lineCount - 1;
+    while (low < high) {
+        int middle = low + (high - low + 1) / 2;
+        if (map->lineStarts[middle] <= offset) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    *line = map->firstLine + low;
+    *column = (int)(offset - map->lineStarts[low]) + 1;
+    return 1;
+}
+
+int spanStart(SourceMap* map, SourceSpan span, int* line, int* column) {
+    return sourcePosition(map, span.start, line, column);
+}
+
+// Position of the last character of the span
+int spanEnd(SourceMap* map, SourceSpan span, int* line, int* column) {
+    return sourcePosition(map, span.length > 0 ? span.start + span.length - 1 : span.start, line, column);
+}
@@ -0,0 +1,28 @@
+#ifndef SOURCEMAP_H
+#define SOURCEMAP_H
+
+#include <stddef.h>
+#include "ast.h"
+
+/*
+ * Maps byte offsets in a source text to line and column numbers. AST nodes
+ * only carry spans; the table of line starts is built the first time a
+ * position is asked for, and each lookup is then a binary search.
+ */
+typedef struct {
+    const char* source;
+    size_t length;
+    int firstLine;              /* Line number of the first line of the text */
+    unsigned int* lineStarts;   /* Offset of each line, NULL until needed */
+    int lineCount;
+} SourceMap;
+
+void initSourceMap(SourceMap* map, const char* source, size_t length, int firstLine);
+void freeSourceMap(SourceMap* map);
+
+/* Line and 1-based column of an offset; answers 0 if the table cannot be built */
+int sourcePosition(SourceMap* map, unsigned int offset, int* line, int* column);
+int spanStart(SourceMap* map, SourceSpan span, int* line, int* column);
+int spanEnd(SourceMap* map, SourceSpan span, int* line, int* column);
+
+#endif /* SOURCEMAP_H */
@@ -1,68 +1,80 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+/*
+ * Every token type, in enum order. Expand TOKEN_TYPES with a macro taking the
+ * name without its TOKEN_ prefix to generate code per type, such as the name
+ * table behind tokenTypeName().
+ */
+#define TOKEN_TYPES(X) \
+    /* Basic tokens */ \
+    X(EOF) \
+    X(ERROR) \
+    \
+    /* Identifiers and references */ \
+    X(IDENTIFIER) \
+    X(KEYWORD)          /* Identifier with colon */ \
+    \
+    /* Literals */ \
+    X(INTEGER)          /* Integer literal */ \
+    X(FLOAT)            /* Floating point literal */ \
+    X(SCALED)           /* Scaled decimal literal */ \
+    X(CHAR)             /* Character literal */ \
+    X(STRING)           /* String literal */ \
+    X(SYMBOL)           /* Symbol literal */ \
+    X(HASH_PAREN)       /* #( for array literals */ \
+    X(HASH_BRACKET)     /* #[ for byte array literals */ \
+    \
+    /* Constants */ \
+    X(NIL)              /* nil */ \
+    X(TRUE)             /* true */ \
+    X(FALSE)            /* false */ \
+    \
+    /* Pseudo-variables */ \
+    X(SELF)             /* self */ \
+    X(SUPER)            /* super */ \
+    X(THIS_CONTEXT)     /* thisContext */ \
+    \
+    /* Binary selectors */ \
+    X(BINARY_SELECTOR) \
+    \
+    /* Punctuation */ \
+    X(PERIOD)           /* . */ \
+    X(SEMICOLON)        /* ; */ \
+    X(LEFT_PAREN)       /* ( */ \
+    X(RIGHT_PAREN)      /* ) */ \
+    X(LEFT_BRACKET)     /* [ */ \
+    X(RIGHT_BRACKET)    /* ] */ \
+    X(LEFT_BRACE)       /* { */ \
+    X(RIGHT_BRACE)      /* } */ \
+    X(CARET)            /* ^ */ \
+    X(PIPE)             /* | */ \
+    X(ASSIGNMENT)       /* := */ \
+    X(HASH)             /* # */ \
+    X(DOLLAR)           /* $ */ \
+    X(COLON)            /* : */ \
+    X(MINUS)            /* - */ \
+    X(PLUS)             /* + */ \
+    X(STAR)             /* * */ \
+    X(SLASH)            /* / */ \
+    X(LESS)             /* < */ \
+    X(GREATER)          /* > */ \
+    X(EQUAL)            /* = */ \
+    X(AT)               /* @ */ \
+    X(COMMA)            /* , */ \
+    X(UNDERSCORE)       /* _ */ \
+    X(TILDE)            /* ~ */ \
+    X(PERCENT)          /* % */ \
+    X(AMPERSAND)        /* & */ \
+    X(QUESTION)         /* ? */ \
+    X(EXCLAMATION)      /* ! */ \
+    X(BACKSLASH)        /* \ */
+
+#define TOKEN_ENUM_ENTRY(name) TOKEN_##name,
+
 typedef enum {
-    /* Basic tokens */
-    TOKEN_EOF,
-    TOKEN_ERROR,
-    
-    /* Identifiers and references */
-    TOKEN_IDENTIFIER,
-    TOKEN_KEYWORD,      /* Identifier with colon */
-    
-    /* Literals */
-    TOKEN_INTEGER,      /* Integer literal */
-    TOKEN_FLOAT,        /* Floating point literal */
-    TOKEN_SCALED,       /* Scaled decimal literal */
-    TOKEN_CHAR,         /* Character literal */
-    TOKEN_STRING,       /* String literal */
-    TOKEN_SYMBOL,       /* Symbol literal */
-    TOKEN_HASH_PAREN,   /* #( for array literals */
-    
-    /* Constants */
-    TOKEN_NIL,          /* nil */
-    TOKEN_TRUE,         /* true */
-    TOKEN_FALSE,        /* false */
-    
-    /* Pseudo-variables */
-    TOKEN_SELF,         /* self */
-    TOKEN_SUPER,        /* super */
-    TOKEN_THIS_CONTEXT, /* thisContext */
-    
-    /* Binary selectors */
-    TOKEN_BINARY_SELECTOR,
-    
-    /* Punctuation */
-    TOKEN_PERIOD,       /* . */
-    TOKEN_SEMICOLON,    /* ; */
-    TOKEN_LEFT_PAREN,   /* ( */
-    TOKEN_RIGHT_PAREN,  /* ) */
-    TOKEN_LEFT_BRACKET, /* [ */
-    TOKEN_RIGHT_BRACKET,/* ] */
-    TOKEN_LEFT_BRACE,   /* { */
-    TOKEN_RIGHT_BRACE,  /* } */
-    TOKEN_CARET,        /* ^ */
-    TOKEN_PIPE,         /* | */
-    TOKEN_ASSIGNMENT,   /* := */
-    TOKEN_HASH,         /* # */
-    TOKEN_DOLLAR,       /* $ */
-    TOKEN_COLON,        /* : */
-    TOKEN_MINUS,        /* - */
-    TOKEN_PLUS,         /* + */
-    TOKEN_STAR,         /* * */
-    TOKEN_SLASH,        /* / */
-    TOKEN_LESS,         /* < */
-    TOKEN_GREATER,      /* > */
-    TOKEN_EQUAL,        /* = */
-    TOKEN_AT,           /* @ */
-    TOKEN_COMMA,        /* , */
-    TOKEN_UNDERSCORE,   /* _ */
-    TOKEN_TILDE,        /* ~ */
-    TOKEN_PERCENT,      /* % */
-    TOKEN_AMPERSAND,    /* & */
-    TOKEN_QUESTION,     /* ? */
-    TOKEN_EXCLAMATION,  /* ! */
-    TOKEN_BACKSLASH     /* \ */
+    TOKEN_TYPES(TOKEN_ENUM_ENTRY)
+    TOKEN_TYPE_COUNT
 } TokenType;
 
 typedef struct {
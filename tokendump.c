@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tokendump.h"
+#include "lexer.h"
+#include "astcache.h"
+#include "fileio.h"
+
+// Digits in a non-negative value, for padding
+static int decimalWidth(int value) {
+    int width = 1;
+    while (value >= 10) {
+        value /= 10;
+        width++;
+    }
+    return width;
+}
+
+// Like printf's %-*d
+static void writePaddedInteger(OutputBuffer* out, int value, int width) {
+    writeInteger(out, value);
+    writeSpaces(out, width - (value < 0 ? decimalWidth(-value) + 1 : decimalWidth(value)));
+}
+
+int writeTokenListing(OutputBuffer* out, const char* source, const char* fileName) {
+    Lexer lexer;
+    initLexer(&lexer, source);
+
+    writeString(out, "Tokens from ");
+    writeString(out, fileName);
+    writeString(out, ":\n");
+    writeString(out, "Token Type           Value                          Line  Col  \n");
+    writeString(out, "------------------------------------------------------------\n");
+
+    for (;;) {
+        Token token = nextToken(&lexer);
+
+        // Long values are cut to 27 characters and an ellipsis
+        int shown = token.length < 30 ? token.length : 27;
+        const char* name = tokenTypeName(token.type);
+        writeString(out, name);
+        writeSpaces(out, 21 - (int)strlen(name));
+        writeBytes(out, token.start, (size_t)shown);
+        if (shown < token.length) writeString(out, "...");
+        writeSpaces(out, 31 - (shown < token.length ? 30 : shown));
+        writePaddedInteger(out, token.line, 5);
+        writeChar(out, ' ');
+        writePaddedInteger(out, token.column, 5);
+        writeChar(out, '\n');
+
+        if (token.type == TOKEN_EOF) return 1;
+        if (token.type == TOKEN_ERROR) {
+            flushOutputBuffer(out);
+            fprintf(stderr, "Error: %.*s%s\n", shown, token.start, shown < token.length ? "..." : "");
+            return 0;
+        }
+    }
+}
+
+static void fillRecord(TokenRecord* record, const Token* token, const Lexer* lexer, const char* source) {
+    memset(record, 0, sizeof(*record));
+    record->type = (uint8_t)token->type;
+    record->line = (uint32_t)token->line;
+
+    // An error token's text is its message, not part of the source
+    if (token->type == TOKEN_ERROR) {
+        record->offset = (uint32_t)(lexer->current - source);
+        return;
+    }
+    record->offset = (uint32_t)(token->start - source);
+    record->length = (uint32_t)token->length;
+
+    switch (token->type) {
+        case TOKEN_INTEGER:
+            record->value.intValue = token->value.intValue;
+            break;
+        case TOKEN_FLOAT:
+        case TOKEN_SCALED:
+            record->value.floatValue = token->value.floatValue;
+            break;
+        case TOKEN_CHAR:
+            record->value.intValue = (unsigned char)token->value.charValue;
+            break;
+        default:
+            break;
+    }
+}
+
+typedef struct {
+    TokenStreamHeader* header;
+    const char* source;
+} TokenStreamContents;
+
+static int writeTokenStreamContents(FILE* file, void* context) {
+    TokenStreamContents* contents = (TokenStreamContents*)context;
+    TokenStreamHeader* header = contents->header;
+
+    OutputBuffer out;
+    if (!initOutputBuffer(&out, file, 0)) return 0;
+
+    // The count is only known at the end; the header is rewritten then
+    writeBytes(&out, (const char*)header, sizeof(*header));
+
+    Lexer lexer;
+    initLexer(&lexer, contents->source);
+    for (;;) {
+        Token token = nextToken(&lexer);
+        TokenRecord record;
+        fillRecord(&record, &token, &lexer, contents->source);
+        writeBytes(&out, (const char*)&record, sizeof(record));
+        header->tokenCount++;
+        if (token.type == TOKEN_EOF || token.type == TOKEN_ERROR) break;
+    }
+
+    return freeOutputBuffer(&out)
+        && fseek(file, 0L, SEEK_SET) == 0
+        && fwrite(header, sizeof(*header), 1, file) == 1;
+}
+
+int writeTokenStream(const char* path, const char* source, size_t length) {
+    if (length > UINT32_MAX) return 0;
+
+    TokenStreamHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TOKEN_STREAM_MAGIC, sizeof(header.magic));
+    header.version = TOKEN_STREAM_VERSION;
+    header.byteOrder = TOKEN_STREAM_BYTE_ORDER;
+    header.sourceHash = hashSource(source, length);
+    header.sourceLength = length;
+    header.recordSize = sizeof(TokenRecord);
+
+    TokenStreamContents contents = { &header, source };
+    return writeFileAtomicallyWith(path, writeTokenStreamContents, &contents);
+}
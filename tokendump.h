@@ -0,0 +1,59 @@
+#ifndef TOKENDUMP_H
+#define TOKENDUMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "token.h"
+#include "output.h"
+
+/*
+ * Token dumps: the tabular listing behind --tokens, and a binary token
+ * stream for other tools. A stream file is a TokenStreamHeader followed
+ * directly by tokenCount fixed-size TokenRecords, so a reader maps the file
+ * and indexes the records in place. Records hold byte offsets into the
+ * source rather than text; the header repeats the hash (see hashSource() in
+ * astcache.h) and length of that source so a reader can check it has the
+ * right one. Integers are in native byte order, as in the AST cache.
+ *
+ * The stream ends with the EOF token, or with an ERROR token (offset at the
+ * point the lexer stopped, length 0) if the source did not lex.
+ */
+
+#define TOKEN_STREAM_MAGIC "STTOKENS"
+/* Bump whenever the header or record layout changes */
+#define TOKEN_STREAM_VERSION 1
+#define TOKEN_STREAM_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t sourceHash;
+    uint64_t sourceLength;
+    uint64_t tokenCount;
+    uint32_t recordSize;    /* sizeof(TokenRecord) */
+    uint32_t reserved;
+} TokenStreamHeader;
+
+typedef struct {
+    uint32_t offset;        /* Byte offset of the token's text in the source */
+    uint32_t length;
+    uint32_t line;
+    uint8_t type;           /* TokenType */
+    uint8_t reserved[3];
+    union {
+        int64_t intValue;   /* INTEGER, and the code of a CHAR */
+        double floatValue;  /* FLOAT and SCALED */
+    } value;                /* Zero for every other type */
+} TokenRecord;
+
+/* Write the --tokens table for source. Answers 1 if the whole source lexed;
+ * on an error the message also goes to stderr. */
+int writeTokenListing(OutputBuffer* out, const char* source, const char* fileName);
+
+/* Lex source into a token stream file at path, replacing any existing file
+ * atomically. Answers 1 if the file was written, even when it ends with an
+ * ERROR token; 0 if it could not be written or the source exceeds 4 GB. */
+int writeTokenStream(const char* path, const char* source, size_t length);
+
+#endif /* TOKENDUMP_H */
@@ -0,0 +1,656 @@
+#include <stdlib.h>
+#include <string.h>
+#include "treediff.h"
+#include "merkle.h"
+
+// Smallest subtree matched on its hash alone; single leaves such as `self`
+// are far too common for that and are only paired below matched parents
+#define MIN_EXACT_SIZE 2
+// Siblings examined when pairing the leftover children of matched nodes
+#define SIBLING_WINDOW 8
+
+typedef struct {
+    const FlatAST* flat;
+    MerkleHashes hashes;
+    FlatIndex* parents;
+    uint32_t* positions;        // Index of each node among its parent's children
+    FlatIndex* partners;        // Matched node in the other tree; owned by the TreeDiff
+} DiffSide;
+
+typedef struct {
+    uint64_t hash;
+    FlatIndex index;
+} HashEntry;
+
+static int initSide(DiffSide* side, const FlatAST* flat, FlatIndex* partners) {
+    uint32_t count = flat->nodeCount;
+    side->flat = flat;
+    side->partners = partners;
+    side->parents = (FlatIndex*)malloc(sizeof(FlatIndex) * (count > 0 ? count : 1));
+    side->positions = (uint32_t*)malloc(sizeof(uint32_t) * (count > 0 ? count : 1));
+    if (side->parents == NULL || side->positions == NULL) return 0;
+    if (!computeMerkleHashes(flat, 0, &side->hashes)) return 0;
+
+    for (FlatIndex i = 0; i < count; i++) {
+        partners[i] = FLAT_NONE;
+    }
+    if (count > 0) {
+        side->parents[0] = FLAT_NONE;
+        side->positions[0] = 0;
+    }
+    for (FlatIndex i = 0; i < count; i++) {
+        int children = flatChildCount(flat, i);
+        for (int c = 0; c < children; c++) {
+            FlatIndex child = flatChild(flat, i, c);
+            if (child == FLAT_NONE) continue;
+            side->parents[child] = i;
+            side->positions[child] = (uint32_t)c;
+        }
+    }
+    return 1;
+}
+
+static void freeSide(DiffSide* side) {
+    free(side->parents);
+    free(side->positions);
+    freeMerkleHashes(&side->hashes);
+}
+
+static void pairNodes(DiffSide* before, DiffSide* after, FlatIndex b, FlatIndex a, TreeDiff* diff) {
+    before->partners[b] = a;
+    after->partners[a] = b;
+    diff->matchedCount++;
+}
+
+// Equal hashes almost certainly mean equal subtrees; checking the node types
+// keeps a collision from pairing nodes that cannot correspond
+static int sameShape(const DiffSide* before, const DiffSide* after, FlatIndex b, FlatIndex a) {
+    uint32_t size = before->hashes.sizes[b];
+    if (after->hashes.sizes[a] != size) return 0;
+    return memcmp(before->flat->types + b, after->flat->types + a, size) == 0;
+}
+
+// Subtrees are contiguous in pre-order, so identical subtrees pair up offset
+// by offset. Descendants already matched elsewhere keep their partners.
+static void matchSubtrees(DiffSide* before, DiffSide* after, FlatIndex b, FlatIndex a, TreeDiff* diff) {
+    uint32_t size = before->hashes.sizes[b];
+    for (uint32_t k = 0; k < size; k++) {
+        if (before->partners[b + k] == FLAT_NONE && after->partners[a + k] == FLAT_NONE) {
+            pairNodes(before, after, b + k, a + k, diff);
+        }
+    }
+}
+
+static int compareEntries(const void* x, const void* y) {
+    const HashEntry* a = (const HashEntry*)x;
+    const HashEntry* b = (const HashEntry*)y;
+    if (a->hash != b->hash) return a->hash < b->hash ? -1 : 1;
+    return a->index < b->index ? -1 : (a->index > b->index);
+}
+
+// Hash of the sibling at the given offset from a node, or 0 if there is none
+static uint64_t siblingHash(const DiffSide* side, FlatIndex index, int offset) {
+    FlatIndex parent = side->parents[index];
+    if (parent == FLAT_NONE) return 0;
+
+    int position = (int)side->positions[index] + offset;
+    if (position < 0 || position >= flatChildCount(side->flat, parent)) return 0;
+    FlatIndex sibling = flatChild(side->flat, parent, position);
+    return sibling == FLAT_NONE ? 0 : side->hashes.hashes[sibling];
+}
+
+static uint64_t mixHash(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+    hash ^= hash >> 31;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    return hash ^ (hash >> 29);
+}
+
+// A subtree's hash together with its neighbours' and the type of its parent,
+// so that among duplicates the ones that stayed in place find each other
+// directly. The parent's hash would not do: it changes with any edit below it.
+static uint64_t contextKey(const DiffSide* side, FlatIndex index) {
+    FlatIndex parent = side->parents[index];
+    uint64_t key = mixHash(side->hashes.hashes[index], parent == FLAT_NONE ? 0xFF : side->flat->types[parent]);
+    key = mixHash(key, siblingHash(side, index, -1));
+    return mixHash(key, siblingHash(side, index, 1));
+}
+
+// Subtrees eligible for exact matching, sorted by key and then index
+static HashEntry* collectEntries(const DiffSide* side, int byContext, uint32_t* count) {
+    uint32_t nodeCount = side->flat->nodeCount;
+    HashEntry* entries = (HashEntry*)malloc(sizeof(HashEntry) * (nodeCount > 0 ? nodeCount : 1));
+    *count = 0;
+    if (entries == NULL) return NULL;
+
+    for (FlatIndex i = 0; i < nodeCount; i++) {
+        if (side->hashes.sizes[i] < MIN_EXACT_SIZE) continue;
+        HashEntry* entry = &entries[(*count)++];
+        entry->hash = byContext ? contextKey(side, i) : side->hashes.hashes[i];
+        entry->index = i;
+    }
+    qsort(entries, *count, sizeof(HashEntry), compareEntries);
+    return entries;
+}
+
+// Entries sharing a key on both sides; all have the same subtree size
+typedef struct {
+    uint32_t beforeStart;
+    uint32_t beforeEnd;
+    uint32_t afterStart;
+    uint32_t afterEnd;
+    uint32_t size;
+} KeyGroup;
+
+static int compareGroups(const void* x, const void* y) {
+    const KeyGroup* a = (const KeyGroup*)x;
+    const KeyGroup* b = (const KeyGroup*)y;
+    if (a->size != b->size) return a->size > b->size ? -1 : 1;
+    return a->beforeStart < b->beforeStart ? -1 : (a->beforeStart > b->beforeStart);
+}
+
+// Copies of one subtree laid out along the old tree, new ones at their
+// proportional place, and the adjacent old/new pairs still to consider
+typedef struct {
+    uint64_t position;
+    FlatIndex index;
+    int side;                   // 0 old, 1 new, -1 taken
+} LineItem;
+
+typedef struct {
+    uint64_t distance;
+    uint32_t left;
+    uint32_t right;
+} ItemPair;
+
+typedef struct {
+    LineItem* items;
+    uint32_t* previous;
+    uint32_t* next;
+    ItemPair* heap;
+    uint32_t heapCount;
+} PairScratch;
+
+static int pairBefore(const ItemPair* x, const ItemPair* y) {
+    return x->distance < y->distance || (x->distance == y->distance && x->left < y->left);
+}
+
+static void pushPair(PairScratch* scratch, uint32_t left, uint32_t right) {
+    ItemPair pair = {scratch->items[right].position - scratch->items[left].position, left, right};
+    uint32_t i = scratch->heapCount++;
+    while (i > 0 && pairBefore(&pair, &scratch->heap[(i - 1) / 2])) {
+        scratch->heap[i] = scratch->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    scratch->heap[i] = pair;
+}
+
+static ItemPair popPair(PairScratch* scratch) {
+    ItemPair top = scratch->heap[0];
+    ItemPair last = scratch->heap[--scratch->heapCount];
+    uint32_t i = 0;
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= scratch->heapCount) break;
+        if (child + 1 < scratch->heapCount && pairBefore(&scratch->heap[child + 1], &scratch->heap[child])) child++;
+        if (!pairBefore(&scratch->heap[child], &last)) break;
+        scratch->heap[i] = scratch->heap[child];
+        i = child;
+    }
+    scratch->heap[i] = last;
+    return top;
+}
+
+static void pushIfOpposite(PairScratch* scratch, uint32_t left, uint32_t right) {
+    if (left != UINT32_MAX && right != UINT32_MAX && scratch->items[left].side != scratch->items[right].side) {
+        pushPair(scratch, left, right);
+    }
+}
+
+// Pair the unmatched copies of a group closest first. Copies that stayed in
+// place pair with each other, and a copy moved from afar pairs with what is
+// left instead of shifting every copy in between by one.
+static void matchGroup(DiffSide* before, DiffSide* after, const KeyGroup* group, const HashEntry* beforeEntries,
+                       const HashEntry* afterEntries, PairScratch* scratch, TreeDiff* diff) {
+    uint64_t beforeCount = before->flat->nodeCount;
+    uint64_t afterCount = after->flat->nodeCount;
+    uint32_t i = group->beforeStart;
+    uint32_t j = group->afterStart;
+    uint32_t count = 0;
+    int sides = 0;
+
+    while (i < group->beforeEnd || j < group->afterEnd) {
+        if (i < group->beforeEnd && before->partners[beforeEntries[i].index] != FLAT_NONE) {
+            i++;
+            continue;
+        }
+        if (j < group->afterEnd && after->partners[afterEntries[j].index] != FLAT_NONE) {
+            j++;
+            continue;
+        }
+
+        uint64_t beforePosition = i < group->beforeEnd ? beforeEntries[i].index : UINT64_MAX;
+        uint64_t afterPosition = j < group->afterEnd ? afterEntries[j].index * beforeCount / afterCount : UINT64_MAX;
+        LineItem* item = &scratch->items[count];
+        if (beforePosition <= afterPosition) {
+            item->position = beforePosition;
+            item->index = beforeEntries[i++].index;
+            item->side = 0;
+            sides |= 1;
+        } else {
+            item->position = afterPosition;
+            item->index = afterEntries[j++].index;
+            item->side = 1;
+            sides |= 2;
+        }
+        scratch->previous[count] = count > 0 ? count - 1 : UINT32_MAX;
+        scratch->next[count] = UINT32_MAX;
+        if (count > 0) scratch->next[count - 1] = count;
+        count++;
+    }
+    if (sides != 3) return;
+
+    scratch->heapCount = 0;
+    for (uint32_t k = 0; k + 1 < count; k++) {
+        pushIfOpposite(scratch, k, k + 1);
+    }
+
+    while (scratch->heapCount > 0) {
+        ItemPair pair = popPair(scratch);
+        LineItem* left = &scratch->items[pair.left];
+        LineItem* right = &scratch->items[pair.right];
+        if (left->side < 0 || right->side < 0 || scratch->next[pair.left] != pair.right) continue;
+
+        FlatIndex b = left->side == 0 ? left->index : right->index;
+        FlatIndex a = left->side == 0 ? right->index : left->index;
+        if (!sameShape(before, after, b, a)) continue;
+        matchSubtrees(before, after, b, a, diff);
+
+        // Unlink both; their outer neighbours become adjacent
+        uint32_t outerLeft = scratch->previous[pair.left];
+        uint32_t outerRight = scratch->next[pair.right];
+        left->side = -1;
+        right->side = -1;
+        if (outerLeft != UINT32_MAX) scratch->next[outerLeft] = outerRight;
+        if (outerRight != UINT32_MAX) scratch->previous[outerRight] = outerLeft;
+        pushIfOpposite(scratch, outerLeft, outerRight);
+    }
+}
+
+// Match all groups of one keying, largest subtrees first, so that the
+// descendants of a matched subtree are already taken when their turn comes
+static int matchByKey(DiffSide* before, DiffSide* after, int byContext, PairScratch* scratch, TreeDiff* diff) {
+    uint32_t beforeEntryCount;
+    uint32_t afterEntryCount;
+    HashEntry* beforeEntries = collectEntries(before, byContext, &beforeEntryCount);
+    HashEntry* afterEntries = collectEntries(after, byContext, &afterEntryCount);
+    uint32_t groupCapacity = beforeEntryCount < afterEntryCount ? beforeEntryCount : afterEntryCount;
+    KeyGroup* groups = (KeyGroup*)malloc(sizeof(KeyGroup) * (groupCapacity > 0 ? groupCapacity : 1));
+    if (beforeEntries == NULL || afterEntries == NULL || groups == NULL) {
+        free(beforeEntries);
+        free(afterEntries);
+        free(groups);
+        return 0;
+    }
+
+    uint32_t groupCount = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+    while (i < beforeEntryCount && j < afterEntryCount) {
+        uint64_t key = beforeEntries[i].hash;
+        if (key < afterEntries[j].hash) {
+            i++;
+        } else if (key > afterEntries[j].hash) {
+            j++;
+        } else {
+            KeyGroup* group = &groups[groupCount++];
+            group->beforeStart = i;
+            group->afterStart = j;
+            group->size = before->hashes.sizes[beforeEntries[i].index];
+            while (i < beforeEntryCount && beforeEntries[i].hash == key) i++;
+            while (j < afterEntryCount && afterEntries[j].hash == key) j++;
+            group->beforeEnd = i;
+            group->afterEnd = j;
+        }
+    }
+    qsort(groups, groupCount, sizeof(KeyGroup), compareGroups);
+
+    for (uint32_t g = 0; g < groupCount; g++) {
+        matchGroup(before, after, &groups[g], beforeEntries, afterEntries, scratch, diff);
+    }
+
+    free(beforeEntries);
+    free(afterEntries);
+    free(groups);
+    return 1;
+}
+
+// Phase 1: identical subtrees, first those whose neighbours are unchanged
+// too, so that a copy moved in from elsewhere cannot take the place of one
+// that stayed; then the rest by hash alone
+static int matchIdenticalSubtrees(DiffSide* before, DiffSide* after, TreeDiff* diff) {
+    size_t capacity = (size_t)before->flat->nodeCount + after->flat->nodeCount + 1;
+    PairScratch scratch;
+    scratch.items = (LineItem*)malloc(sizeof(LineItem) * capacity);
+    scratch.previous = (uint32_t*)malloc(sizeof(uint32_t) * capacity);
+    scratch.next = (uint32_t*)malloc(sizeof(uint32_t) * capacity);
+    scratch.heap = (ItemPair*)malloc(sizeof(ItemPair) * capacity * 2);
+
+    int ok = scratch.items != NULL && scratch.previous != NULL && scratch.next != NULL && scratch.heap != NULL
+        && matchByKey(before, after, 1, &scratch, diff)
+        && matchByKey(before, after, 0, &scratch, diff);
+
+    free(scratch.items);
+    free(scratch.previous);
+    free(scratch.next);
+    free(scratch.heap);
+    return ok;
+}
+
+// Phase 2: bottom-up, each unmatched node follows its matched children
+static int matchAncestors(DiffSide* before, DiffSide* after, TreeDiff* diff) {
+    uint32_t beforeCount = before->flat->nodeCount;
+    uint32_t afterCount = after->flat->nodeCount;
+    uint32_t* votes = (uint32_t*)calloc(beforeCount > 0 ? beforeCount : 1, sizeof(uint32_t));
+    FlatIndex* touched = (FlatIndex*)malloc(sizeof(FlatIndex) * (afterCount > 0 ? afterCount : 1));
+    if (votes == NULL || touched == NULL) {
+        free(votes);
+        free(touched);
+        return 0;
+    }
+
+    // Backward over pre-order visits children before their parents
+    for (FlatIndex a = afterCount; a-- > 0;) {
+        if (after->partners[a] != FLAT_NONE) continue;
+
+        unsigned char type = after->flat->types[a];
+        FlatIndex best = FLAT_NONE;
+        uint32_t touchedCount = 0;
+        int children = flatChildCount(after->flat, a);
+
+        for (int c = 0; c < children; c++) {
+            FlatIndex child = flatChild(after->flat, a, c);
+            if (child == FLAT_NONE || after->partners[child] == FLAT_NONE) continue;
+
+            FlatIndex candidate = before->parents[after->partners[child]];
+            if (candidate == FLAT_NONE || before->partners[candidate] != FLAT_NONE ||
+                before->flat->types[candidate] != type) {
+                continue;
+            }
+            if (votes[candidate] == 0) touched[touchedCount++] = candidate;
+            votes[candidate] += after->hashes.sizes[child];
+            if (best == FLAT_NONE || votes[candidate] > votes[best]) best = candidate;
+        }
+        for (uint32_t t = 0; t < touchedCount; t++) {
+            votes[touched[t]] = 0;
+        }
+
+        // The roots correspond whenever they can
+        if (best == FLAT_NONE && a == 0 && beforeCount > 0 &&
+            before->partners[0] == FLAT_NONE && before->flat->types[0] == type) {
+            best = 0;
+        }
+        if (best != FLAT_NONE) pairNodes(before, after, best, a, diff);
+    }
+
+    free(votes);
+    free(touched);
+    return 1;
+}
+
+// Phase 3: pair leftover children of matched nodes, in order, first whole
+// identical subtrees and then single nodes of the same type
+static void recoverChildren(DiffSide* before, DiffSide* after, TreeDiff* diff) {
+    const FlatAST* beforeFlat = before->flat;
+    const FlatAST* afterFlat = after->flat;
+
+    for (FlatIndex a = 0; a < afterFlat->nodeCount; a++) {
+        FlatIndex b = after->partners[a];
+        if (b == FLAT_NONE) continue;
+
+        int afterChildren = flatChildCount(afterFlat, a);
+        int beforeChildren = flatChildCount(beforeFlat, b);
+
+        for (int pass = 0; pass < 2; pass++) {
+            int cursor = 0;
+            for (int i = 0; i < afterChildren; i++) {
+                FlatIndex x = flatChild(afterFlat, a, i);
+                if (x == FLAT_NONE || after->partners[x] != FLAT_NONE) continue;
+
+                for (int j = cursor; j < beforeChildren && j < cursor + SIBLING_WINDOW; j++) {
+                    FlatIndex y = flatChild(beforeFlat, b, j);
+                    if (y == FLAT_NONE || before->partners[y] != FLAT_NONE) continue;
+                    if (beforeFlat->types[y] != afterFlat->types[x]) continue;
+
+                    if (pass == 0) {
+                        if (before->hashes.hashes[y] != after->hashes.hashes[x] || !sameShape(before, after, y, x)) continue;
+                        matchSubtrees(before, after, y, x, diff);
+                    } else {
+                        pairNodes(before, after, y, x, diff);
+                    }
+                    cursor = j + 1;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static int sameString(const FlatAST* x, uint32_t i, const FlatAST* y, uint32_t j) {
+    int lengthX, lengthY;
+    const char* textX = flatString(x, i, &lengthX);
+    const char* textY = flatString(y, j, &lengthY);
+    return lengthX == lengthY && memcmp(textX, textY, (size_t)lengthX) == 0;
+}
+
+// Compare counted runs of names [count, ids...] and step past them
+static int sameNames(const FlatAST* x, uint32_t* startX, const FlatAST* y, uint32_t* startY) {
+    uint32_t count = x->extra[*startX];
+    int same = count == y->extra[*startY];
+    for (uint32_t k = 0; same && k < count; k++) {
+        same = sameString(x, x->extra[*startX + 1 + k], y, y->extra[*startY + 1 + k]);
+    }
+    *startX += 1 + x->extra[*startX];
+    *startY += 1 + y->extra[*startY];
+    return same;
+}
+
+// Whether two matched nodes have the same own attributes, ignoring children
+static int sameLabel(const FlatAST* x, FlatIndex i, const FlatAST* y, FlatIndex j) {
+    const FlatNodeData* dataX = &x->data[i];
+    const FlatNodeData* dataY = &y->data[j];
+
+    switch ((ASTNodeType)x->types[i]) {
+        case AST_LITERAL_INTEGER:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_SCALED:
+        case AST_LITERAL_CHARACTER:
+        case AST_CONSTANT:
+            return dataX->a == dataY->a && dataX->b == dataY->b && dataX->c == dataY->c;
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_SYMBOL:
+        case AST_ASSIGNMENT:
+            return sameString(x, dataX->a, y, dataY->a);
+        case AST_LITERAL_BYTE_ARRAY:
+        case AST_VARIABLE:
+            return dataX->b == dataY->b && sameString(x, dataX->a, y, dataY->a);
+        case AST_LITERAL_ARRAY: {
+            if (dataX->c != dataY->c) return 0;
+            if (dataX->c == PACKED_NONE) return 1;
+            if (dataX->b != dataY->b) return 0;
+            size_t bytes = dataX->c == PACKED_BYTES ? (size_t)dataX->b : (size_t)dataX->b * 8;
+            return memcmp(x->extra + dataX->a, y->extra + dataY->a, bytes) == 0;
+        }
+        case AST_MESSAGE_UNARY:
+        case AST_MESSAGE_BINARY:
+        case AST_MESSAGE_KEYWORD:
+            return sameString(x, dataX->b, y, dataY->b);
+        case AST_BLOCK: {
+            uint32_t startX = dataX->a;
+            uint32_t startY = dataY->a;
+            int sameParameters = sameNames(x, &startX, y, &startY);
+            return sameParameters && sameNames(x, &startX, y, &startY);
+        }
+        case AST_METHOD: {
+            uint32_t startX = dataX->b;
+            uint32_t startY = dataY->b;
+            if (dataX->c != dataY->c || !sameString(x, dataX->a, y, dataY->a)) return 0;
+            int sameParameters = sameNames(x, &startX, y, &startY);
+            return sameParameters && sameNames(x, &startX, y, &startY);
+        }
+        default:
+            return 1;
+    }
+}
+
+static int addOperation(TreeDiff* diff, EditKind kind, FlatIndex before, FlatIndex after) {
+    if (diff->operationCount == diff->operationCapacity) {
+        uint32_t capacity = diff->operationCapacity < 64 ? 64 : diff->operationCapacity * 2;
+        EditOperation* operations = (EditOperation*)realloc(diff->operations, sizeof(EditOperation) * capacity);
+        if (operations == NULL) return 0;
+        diff->operations = operations;
+        diff->operationCapacity = capacity;
+    }
+
+    EditOperation* operation = &diff->operations[diff->operationCount++];
+    operation->kind = kind;
+    operation->before = before;
+    operation->after = after;
+    return 1;
+}
+
+typedef struct {
+    uint32_t* positions;        // Old sibling position of each kept child
+    FlatIndex* members;
+    uint32_t* tails;
+    uint32_t* previous;
+} OrderScratch;
+
+// Among the children of a that stayed under the partner of a, keep a longest
+// run in the old order and mark the rest as moved
+static void markReordered(const DiffSide* before, const DiffSide* after, FlatIndex a,
+                          OrderScratch* scratch, unsigned char* reordered) {
+    FlatIndex b = after->partners[a];
+    int children = flatChildCount(after->flat, a);
+    uint32_t count = 0;
+
+    for (int c = 0; c < children; c++) {
+        FlatIndex x = flatChild(after->flat, a, c);
+        if (x == FLAT_NONE || after->partners[x] == FLAT_NONE) continue;
+        FlatIndex y = after->partners[x];
+        if (before->parents[y] != b) continue;
+
+        scratch->positions[count] = before->positions[y];
+        scratch->members[count] = x;
+        count++;
+    }
+    if (count < 2) return;
+
+    // Longest increasing subsequence by patience sorting
+    uint32_t length = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t low = 0;
+        uint32_t high = length;
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            if (scratch->positions[scratch->tails[middle]] < scratch->positions[i]) low = middle + 1; else high = middle;
+        }
+        scratch->previous[i] = low > 0 ? scratch->tails[low - 1] : UINT32_MAX;
+        scratch->tails[low] = i;
+        if (low == length) length++;
+    }
+    if (length == count) return;
+
+    for (uint32_t i = 0; i < count; i++) {
+        reordered[scratch->members[i]] = 1;
+    }
+    for (uint32_t i = scratch->tails[length - 1]; i != UINT32_MAX; i = scratch->previous[i]) {
+        reordered[scratch->members[i]] = 0;
+    }
+}
+
+static int buildEditScript(const DiffSide* before, const DiffSide* after, TreeDiff* diff) {
+    uint32_t afterCount = after->flat->nodeCount;
+    size_t scratchSize = afterCount > 0 ? afterCount : 1;
+    unsigned char* reordered = (unsigned char*)calloc(scratchSize, 1);
+    OrderScratch scratch;
+    scratch.positions = (uint32_t*)malloc(sizeof(uint32_t) * scratchSize);
+    scratch.members = (FlatIndex*)malloc(sizeof(FlatIndex) * scratchSize);
+    scratch.tails = (uint32_t*)malloc(sizeof(uint32_t) * scratchSize);
+    scratch.previous = (uint32_t*)malloc(sizeof(uint32_t) * scratchSize);
+
+    int ok = reordered != NULL && scratch.positions != NULL && scratch.members != NULL &&
+             scratch.tails != NULL && scratch.previous != NULL;
+
+    // Deleted subtrees, reported at their topmost unmatched node
+    for (FlatIndex b = 0; ok && b < before->flat->nodeCount; b++) {
+        FlatIndex parent = before->parents[b];
+        if (before->partners[b] == FLAT_NONE && (parent == FLAT_NONE || before->partners[parent] != FLAT_NONE)) {
+            ok = addOperation(diff, EDIT_DELETE, b, FLAT_NONE);
+        }
+    }
+
+    for (FlatIndex a = 0; ok && a < afterCount; a++) {
+        if (after->partners[a] != FLAT_NONE) markReordered(before, after, a, &scratch, reordered);
+    }
+
+    for (FlatIndex a = 0; ok && a < afterCount; a++) {
+        FlatIndex b = after->partners[a];
+        FlatIndex parent = after->parents[a];
+
+        if (b == FLAT_NONE) {
+            if (parent == FLAT_NONE || after->partners[parent] != FLAT_NONE) {
+                ok = addOperation(diff, EDIT_INSERT, FLAT_NONE, a);
+            }
+            continue;
+        }
+
+        FlatIndex expectedParent = parent == FLAT_NONE ? FLAT_NONE : after->partners[parent];
+        if (expectedParent != before->parents[b] || reordered[a]) {
+            ok = addOperation(diff, EDIT_MOVE, b, a);
+        }
+        if (ok && !sameLabel(before->flat, b, after->flat, a)) {
+            ok = addOperation(diff, EDIT_UPDATE, b, a);
+        }
+    }
+
+    free(reordered);
+    free(scratch.positions);
+    free(scratch.members);
+    free(scratch.tails);
+    free(scratch.previous);
+    return ok;
+}
+
+int diffFlatASTs(const FlatAST* before, const FlatAST* after, TreeDiff* diff) {
+    DiffSide beforeSide;
+    DiffSide afterSide;
+    memset(diff, 0, sizeof(*diff));
+    memset(&beforeSide, 0, sizeof(beforeSide));
+    memset(&afterSide, 0, sizeof(afterSide));
+
+    diff->beforeToAfter = (FlatIndex*)malloc(sizeof(FlatIndex) * (before->nodeCount > 0 ? before->nodeCount : 1));
+    diff->afterToBefore = (FlatIndex*)malloc(sizeof(FlatIndex) * (after->nodeCount > 0 ? after->nodeCount : 1));
+
+    int ok = diff->beforeToAfter != NULL && diff->afterToBefore != NULL
+        && initSide(&beforeSide, before, diff->beforeToAfter)
+        && initSide(&afterSide, after, diff->afterToBefore)
+        && matchIdenticalSubtrees(&beforeSide, &afterSide, diff)
+        && matchAncestors(&beforeSide, &afterSide, diff);
+    if (ok) {
+        recoverChildren(&beforeSide, &afterSide, diff);
+        ok = buildEditScript(&beforeSide, &afterSide, diff);
+    }
+
+    freeSide(&beforeSide);
+    freeSide(&afterSide);
+    if (!ok) freeTreeDiff(diff);
+    return ok;
+}
+
+void freeTreeDiff(TreeDiff* diff) {
+    free(diff->beforeToAfter);
+    free(diff->afterToBefore);
+    free(diff->operations);
+    memset(diff, 0, sizeof(*diff));
+}
@@ -0,0 +1,55 @@
+#ifndef TREEDIFF_H
+#define TREEDIFF_H
+
+#include <stdint.h>
+#include "flatast.h"
+
+/*
+ * Structural diff between two flat ASTs. Nodes are matched in three phases:
+ *
+ *   1. Identical subtrees, largest first, found through their Merkle hashes
+ *      (see merkle.h). Among equal candidates, the one whose parent and
+ *      neighbouring siblings also hash the same is preferred.
+ *   2. Bottom-up: an unmatched node is matched to the parent of the nodes its
+ *      children were matched to, if that parent is unmatched and of the same
+ *      type; the candidate backed by the largest matched children wins.
+ *   3. Top-down recovery: unmatched children of matched nodes are paired with
+ *      unmatched children of the partner, first by hash, then by type.
+ *
+ * Each phase does a bounded amount of work per node, so a diff costs
+ * O(n log n) in the size of the trees. The matching is turned into an edit
+ * script: deletions of old subtrees, insertions of new ones, moves of matched
+ * nodes to another parent or position, and updates of matched nodes whose
+ * selector, name or literal value changed.
+ */
+
+typedef enum {
+    EDIT_DELETE,    /* Old subtree with no counterpart */
+    EDIT_INSERT,    /* New subtree with no counterpart */
+    EDIT_MOVE,      /* Matched node under another parent, or reordered among its siblings */
+    EDIT_UPDATE     /* Matched node whose own label (selector, name, value) changed */
+} EditKind;
+
+typedef struct {
+    EditKind kind;
+    FlatIndex before;       /* Node in the old tree; FLAT_NONE for inserts */
+    FlatIndex after;        /* Node in the new tree; FLAT_NONE for deletes */
+} EditOperation;
+
+typedef struct {
+    FlatIndex* beforeToAfter;   /* Partner of each old node, or FLAT_NONE */
+    FlatIndex* afterToBefore;   /* Partner of each new node, or FLAT_NONE */
+    uint32_t matchedCount;
+
+    /* Deletes in old pre-order, then inserts, moves and updates in new pre-order.
+     * Unmatched descendants of a deleted or inserted node are implied. */
+    EditOperation* operations;
+    uint32_t operationCount;
+    uint32_t operationCapacity;
+} TreeDiff;
+
+/* Answers 1 on success, 0 if out of memory; release the result with freeTreeDiff */
+int diffFlatASTs(const FlatAST* before, const FlatAST* after, TreeDiff* diff);
+void freeTreeDiff(TreeDiff* diff);
+
+#endif /* TREEDIFF_H */
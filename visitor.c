@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <string.h>
+#include "visitor.h"
+
+// Frames kept on the C stack before the walk spills to the heap
+#define INLINE_FRAMES 64
+
+typedef struct {
+    ASTNode* node;
+    int nextChild;
+    int childCount;
+} VisitFrame;
+
+int astChildCount(ASTNode* node) {
+    switch (node->type) {
+        case AST_LITERAL_ARRAY: {
+            ASTArrayLiteral* arrayNode = (ASTArrayLiteral*)node;
+            return arrayNode->packedKind == PACKED_NONE ? arrayNode->count : 0;
+        }
+        case AST_ASSIGNMENT:
+        case AST_RETURN:
+        case AST_MESSAGE_UNARY:
+            return 1;
+        case AST_MESSAGE_BINARY:
+            return 2;
+        case AST_MESSAGE_KEYWORD:
+            return 1 + ((ASTKeywordMessageNode*)node)->argumentCount;
+        case AST_CASCADE:
+            return 1 + ((ASTCascadeNode*)node)->messageCount;
+        case AST_BLOCK:
+            return ((ASTBlockNode*)node)->statementCount;
+        case AST_ARRAY_EXPRESSION:
+            return ((ASTArrayExpressionNode*)node)->count;
+        case AST_METHOD:
+            return ((ASTMethodNode*)node)->statementCount;
+        default:
+            return 0;
+    }
+}
+
+ASTNode* astChild(ASTNode* node, int index) {
+    switch (node->type) {
+        case AST_LITERAL_ARRAY:
+            return ((ASTArrayLiteral*)node)->elements[index];
+        case AST_ASSIGNMENT:
+            return ((ASTAssignmentNode*)node)->value;
+        case AST_RETURN:
+            return ((ASTReturnNode*)node)->expression;
+        case AST_MESSAGE_UNARY:
+            return ((ASTUnaryMessageNode*)node)->receiver;
+        case AST_MESSAGE_BINARY: {
+            ASTBinaryMessageNode* msgNode = (ASTBinaryMessageNode*)node;
+            return index == 0 ? msgNode->message.receiver : msgNode->argument;
+        }
+        case AST_MESSAGE_KEYWORD: {
+            ASTKeywordMessageNode* msgNode = (ASTKeywordMessageNode*)node;
+            return index == 0 ? msgNode->message.receiver : msgNode->arguments[index - 1];
+        }
+        case AST_CASCADE: {
+            ASTCascadeNode* cascadeNode = (ASTCascadeNode*)node;
+            return index == 0 ? cascadeNode->receiver : cascadeNode->messages[index - 1];
+        }
+        case AST_BLOCK:
+            return ((ASTBlockNode*)node)->statements[index];
+        case AST_ARRAY_EXPRESSION:
+            return ((ASTArrayExpressionNode*)node)->expressions[index];
+        case AST_METHOD:
+            return ((ASTMethodNode*)node)->statements[index];
+        default:
+            return NULL;
+    }
+}
+
+// Call enter() and push a frame for the node. Answers 1 if the walk goes
+// on, 0 if enter() stopped it and -1 if the stack could not grow.
+static int pushNode(VisitFrame** stack, int* capacity, int* top, VisitFrame* inlineFrames,
+                    ASTNode* node, const ASTVisitor* visitor) {
+    int depth = *top + 1;
+
+    if (depth >= *capacity) {
+        int newCapacity = *capacity * 2;
+        VisitFrame* frames;
+        if (*stack == inlineFrames) {
+            frames = (VisitFrame*)malloc(sizeof(VisitFrame) * newCapacity);
+            if (frames != NULL) memcpy(frames, inlineFrames, sizeof(VisitFrame) * (*capacity));
+        } else {
+            frames = (VisitFrame*)realloc(*stack, sizeof(VisitFrame) * newCapacity);
+        }
+        if (frames == NULL) return -1;
+        *stack = frames;
+        *capacity = newCapacity;
+    }
+
+    VisitAction action = visitor->enter != NULL ? visitor->enter(node, depth, visitor->context) : VISIT_CONTINUE;
+    if (action == VISIT_STOP) return 0;
+
+    VisitFrame* frame = &(*stack)[depth];
+    frame->node = node;
+    frame->nextChild = 0;
+    frame->childCount = action == VISIT_SKIP_CHILDREN ? 0 : astChildCount(node);
+    *top = depth;
+    return 1;
+}
+
+int walkAST(ASTNode* root, const ASTVisitor* visitor) {
+    if (root == NULL) return 1;
+
+    VisitFrame inlineFrames[INLINE_FRAMES];
+    VisitFrame* stack = inlineFrames;
+    int capacity = INLINE_FRAMES;
+    int top = -1;
+
+    int result = pushNode(&stack, &capacity, &top, inlineFrames, root, visitor);
+
+    while (top >= 0 && result == 1) {
+        VisitFrame* frame = &stack[top];
+
+        if (frame->nextChild < frame->childCount) {
+            ASTNode* parent = frame->node;
+            int index = frame->nextChild++;
+            if (visitor->child != NULL && visitor->child(parent, index, top, visitor->context) == VISIT_STOP) {
+                result = 0;
+                break;
+            }
+
+            ASTNode* child = astChild(parent, index);
+            if (child == NULL) continue;
+
+            result = pushNode(&stack, &capacity, &top, inlineFrames, child, visitor);
+            continue;
+        }
+
+        // All children done: the frame is popped before leave() so it may free the node
+        ASTNode* node = frame->node;
+        int depth = top--;
+        if (visitor->leave != NULL && visitor->leave(node, depth, visitor->context) == VISIT_STOP) {
+            result = 0;
+        }
+    }
+
+    if (stack != inlineFrames) free(stack);
+    return result;
+}
@@ -0,0 +1,40 @@
+#ifndef VISITOR_H
+#define VISITOR_H
+
+#include "ast.h"
+
+/*
+ * Generic AST traversal. walkAST() drives a depth-first walk with an
+ * explicit stack, so deep trees cannot overflow the C stack. For each node
+ * the visitor sees:
+ *
+ *   enter(node)             pre-order; may skip the children or stop the walk
+ *   child(node, i)          before child i, including absent (NULL) children,
+ *                           so printers can emit labels between children
+ *   leave(node)             post-order, after all children
+ *
+ * Any callback may be NULL. Depth is 0 for the root.
+ */
+
+typedef enum {
+    VISIT_CONTINUE,
+    VISIT_SKIP_CHILDREN,  /* Do not descend; leave() is still called */
+    VISIT_STOP            /* End the walk immediately */
+} VisitAction;
+
+typedef struct {
+    VisitAction (*enter)(ASTNode* node, int depth, void* context);
+    VisitAction (*child)(ASTNode* parent, int index, int depth, void* context);
+    VisitAction (*leave)(ASTNode* node, int depth, void* context);
+    void* context;
+} ASTVisitor;
+
+/* Children in source order; entries may be NULL (e.g. cascade receivers) */
+int astChildCount(ASTNode* node);
+ASTNode* astChild(ASTNode* node, int index);
+
+/* Answers 1 when the walk completed, 0 when a callback stopped it, and -1
+ * when the traversal stack could not grow */
+int walkAST(ASTNode* root, const ASTVisitor* visitor);
+
+#endif /* VISITOR_H */